@@ -23,8 +23,11 @@
 #include "GMath.h"
 #include "GHolders.h"
 #include "GMatrix.h"
+#include "GThread.h"
 #include <stddef.h>
 #include <cmath>
+#include <algorithm>
+#include <map>
 
 using namespace GClasses;
 using std::vector;
@@ -33,6 +36,8 @@ using std::vector;
 #define MIN_LOG_PROB -1e300
 
 
+thread_local size_t GBNNode::s_chain = 0;
+
 GBNNode::GBNNode()
 : m_observed(false)
 {
@@ -184,7 +189,7 @@ size_t GBNVariable::currentCatIndex()
 
 
 GBNCategorical::GBNCategorical(size_t categors, GBNNode* pDefaultWeight)
-: GBNVariable(), m_categories(categors), m_val(0)
+: GBNVariable(), m_categories(categors), m_vals(1, 0)
 {
 	if(categors < 2)
 		throw Ex("Expected at least 2 categories. Got ", to_str(categors));
@@ -248,7 +253,13 @@ double GBNCategorical::currentValue()
 	if(m_observed)
 		return m_observedValue;
 	else
-		return (double)m_val;
+		return (double)m_vals[s_chain];
+}
+
+// virtual
+void GBNCategorical::setChainCount(size_t n)
+{
+	m_vals.resize(n, 0);
 }
 
 // virtual
@@ -258,6 +269,7 @@ void GBNCategorical::sample(GRand* pRand)
 		return;
 
 	// Compute the sum Markov-blanket probability over each category
+	size_t& val = m_vals[s_chain];
 	size_t base = m_categories * currentCatIndex();
 	double sumProb = 0.0;
 	for(size_t i = 0; i < m_categories; i++)
@@ -266,10 +278,10 @@ void GBNCategorical::sample(GRand* pRand)
 		for(vector<GBNVariable*>::const_iterator it = children().begin(); it != children().end(); it++)
 		{
 			GBNVariable* pChildNode = *it;
-			size_t oldVal = m_val;
-			m_val = i;
+			size_t oldVal = val;
+			val = i;
 			catProb *= pChildNode->likelihood(pChildNode->currentValue());
-			m_val = oldVal;
+			val = oldVal;
 		}
 		sumProb += catProb;
 	}
@@ -283,12 +295,12 @@ void GBNCategorical::sample(GRand* pRand)
 		for(vector<GBNVariable*>::const_iterator it = children().begin(); it != children().end(); it++)
 		{
 			GBNVariable* pChildNode = *it;
-			size_t oldVal = m_val;
-			m_val = i;
+			size_t oldVal = val;
+			val = i;
 			catProb *= pChildNode->likelihood(pChildNode->currentValue());
-			m_val = oldVal;
+			val = oldVal;
 		}
-		m_val = i;
+		val = i;
 		sumProb2 += catProb / sumProb;
 		if(sumProb2 >= uni)
 			break;
@@ -323,8 +335,19 @@ double GBNCategorical::likelihood(double x)
 
 
 GBNMetropolisNode::GBNMetropolisNode()
-: GBNVariable(), m_currentMean(UNKNOWN_REAL_VALUE), m_sumOfValues(UNKNOWN_REAL_VALUE), m_sumOfSquaredValues(UNKNOWN_REAL_VALUE)
+: GBNVariable()
 {
+	setChainCount(1);
+}
+
+// virtual
+void GBNMetropolisNode::setChainCount(size_t n)
+{
+	ChainState uninitialized;
+	uninitialized.currentMean = UNKNOWN_REAL_VALUE;
+	uninitialized.sumOfValues = UNKNOWN_REAL_VALUE;
+	uninitialized.sumOfSquaredValues = UNKNOWN_REAL_VALUE;
+	m_chainStates.resize(n, uninitialized);
 }
 
 double GBNMetropolisNode::markovBlanket(double x)
@@ -333,14 +356,15 @@ double GBNMetropolisNode::markovBlanket(double x)
 	double logSum = log(likelihood(x));
 	if(logSum >= MIN_LOG_PROB)
 	{
+		double& mean = m_chainStates[s_chain].currentMean;
 		const vector<GBNVariable*>& kids = children();
 		for(vector<GBNVariable*>::const_iterator it = kids.begin(); it != kids.end(); it++)
 		{
 			GBNVariable* pChildNode = *it;
-			double oldVal = m_currentMean;
-			m_currentMean = x;
+			double oldVal = mean;
+			mean = x;
 			d = log(pChildNode->likelihood(pChildNode->currentValue()));
-			m_currentMean = oldVal;
+			mean = oldVal;
 			if(d >= MIN_LOG_PROB)
 				logSum += d;
 			else
@@ -352,19 +376,19 @@ double GBNMetropolisNode::markovBlanket(double x)
 		return MIN_LOG_PROB;
 }
 
-void GBNMetropolisNode::metropolis(GRand* pRand)
+void GBNMetropolisNode::metropolis(GRand* pRand, ChainState& state)
 {
-	currentValue(); // (This needs to be called to potentially initialize m_sumOfValues and m_sumOfSquaredValues)
-	double sampleMean = m_sumOfValues / DEV_SAMPLES;
-	double sampleVariance = ((double)DEV_SAMPLES / (DEV_SAMPLES - 1)) * (m_sumOfSquaredValues / DEV_SAMPLES - (sampleMean * sampleMean));
-	double dCandidateValue = pRand->normal() * sqrt(sampleVariance) + m_currentMean;
+	currentValue(); // (This needs to be called to potentially initialize sumOfValues and sumOfSquaredValues)
+	double sampleMean = state.sumOfValues / DEV_SAMPLES;
+	double sampleVariance = ((double)DEV_SAMPLES / (DEV_SAMPLES - 1)) * (state.sumOfSquaredValues / DEV_SAMPLES - (sampleMean * sampleMean));
+	double dCandidateValue = pRand->normal() * sqrt(sampleVariance) + state.currentMean;
 	if(isDiscrete())
 		dCandidateValue = floor(dCandidateValue + 0.5);
 	double cand = markovBlanket(dCandidateValue);
 	if(cand >= MIN_LOG_PROB)
 	{
-		if(log(pRand->uniform()) < cand - markovBlanket(m_currentMean))
-			m_currentMean = dCandidateValue;
+		if(log(pRand->uniform()) < cand - markovBlanket(state.currentMean))
+			state.currentMean = dCandidateValue;
 	}
 }
 
@@ -372,11 +396,12 @@ void GBNMetropolisNode::sample(GRand* pRand)
 {
 	if(m_observed)
 		return;
-	metropolis(pRand);
-	m_sumOfValues *= DEV_DECAY;
-	m_sumOfSquaredValues *= DEV_DECAY;
-	m_sumOfValues += m_currentMean;
-	m_sumOfSquaredValues += (m_currentMean * m_currentMean);
+	ChainState& state = m_chainStates[s_chain];
+	metropolis(pRand, state);
+	state.sumOfValues *= DEV_DECAY;
+	state.sumOfSquaredValues *= DEV_DECAY;
+	state.sumOfValues += state.currentMean;
+	state.sumOfSquaredValues += (state.currentMean * state.currentMean);
 }
 
 // virtual
@@ -384,15 +409,14 @@ double GBNMetropolisNode::currentValue()
 {
 	if(m_observed)
 		return m_observedValue;
-	else if(m_currentMean == UNKNOWN_REAL_VALUE)
+	ChainState& state = m_chainStates[s_chain];
+	if(state.currentMean == UNKNOWN_REAL_VALUE)
 	{
-		m_currentMean = initMean();
-		m_sumOfValues = DEV_SAMPLES * m_currentMean;
-		m_sumOfSquaredValues = DEV_SAMPLES * (m_currentMean * m_currentMean + 1.0);
-		return m_currentMean;
+		state.currentMean = initMean();
+		state.sumOfValues = DEV_SAMPLES * state.currentMean;
+		state.sumOfSquaredValues = DEV_SAMPLES * (state.currentMean * state.currentMean + 1.0);
 	}
-	else
-		return m_currentMean;
+	return state.currentMean;
 }
 
 
@@ -909,8 +933,52 @@ double GBNInverseGamma::initMean()
 
 
 
+GBNChainStats::GBNChainStats(size_t maxLag)
+: m_n(0), m_sum(0.0), m_lagProducts(maxLag + 1, 0.0), m_first(maxLag, 0.0), m_recent(maxLag, 0.0)
+{
+}
+
+void GBNChainStats::add(double x)
+{
+	size_t lagCount = m_first.size();
+	m_lagProducts[0] += x * x;
+	size_t lags = std::min(lagCount, m_n);
+	for(size_t k = 1; k <= lags; k++)
+		m_lagProducts[k] += x * m_recent[(m_n - k) % lagCount];
+	if(lagCount > 0)
+	{
+		if(m_n < lagCount)
+			m_first[m_n] = x;
+		m_recent[m_n % lagCount] = x;
+	}
+	m_sum += x;
+	m_n++;
+}
+
+double GBNChainStats::autocovariance(size_t lag) const
+{
+	if(lag > m_first.size())
+		throw Ex("Lag ", to_str(lag), " is bigger than the maximum lag, ", to_str(m_first.size()));
+	if(lag >= m_n)
+		return 0.0;
+
+	// The sum of (x[t]-mu)*(x[t+lag]-mu) expands to sum(x[t]*x[t+lag]) - mu*(head+tail) + (n-lag)*mu^2,
+	// where head is the sum of all but the last lag values, and tail is the sum of all but the first lag values.
+	double mu = mean();
+	double head = m_sum;
+	double tail = m_sum;
+	for(size_t j = 0; j < lag; j++)
+	{
+		head -= m_recent[(m_n - 1 - j) % m_first.size()];
+		tail -= m_first[j];
+	}
+	return (m_lagProducts[lag] - mu * (head + tail) + (m_n - lag) * mu * mu) / m_n;
+}
+
+// --------------------------------------------------------------------------
+
 GBayesNet::GBayesNet(size_t seed)
-: m_heap(2048), m_rand(seed)
+: m_heap(2048), m_rand(seed), m_chains(1), m_workerThreads(1), m_blockSize(256), m_structureSignature(INVALID_INDEX), m_maxLag(100)
 {
 	m_pConstOne = newConst(1.0);
 }
@@ -919,6 +987,8 @@ GBayesNet::~GBayesNet()
 {
 	for(size_t i = 0; i < m_nodes.size(); i++)
 		m_nodes[i]->~GBNNode();
+	for(size_t i = 0; i < m_blockRands.size(); i++)
+		delete(m_blockRands[i]);
 }
 
 GBNConstant* GBayesNet::newConst(double val)
@@ -1059,6 +1129,337 @@ void GBayesNet::sample()
 		(*it)->sample(&m_rand);
 }
 
+void GBayesNet::setChains(size_t n)
+{
+	m_chains = std::max((size_t)1, n);
+	for(size_t i = 0; i < m_blockRands.size(); i++)
+		delete(m_blockRands[i]);
+	m_blockRands.clear();
+	resetDiagnostics(m_maxLag);
+}
+
+void GBayesNet::colorNodes()
+{
+	// Index the nodes, and find the variable parents of each one
+	size_t n = m_sampleNodes.size();
+	std::map<GBNVariable*, size_t> indexes;
+	for(size_t i = 0; i < n; i++)
+		indexes[m_sampleNodes[i]] = i;
+	vector< vector<size_t> > children(n);
+	vector< vector<size_t> > parents(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		const vector<GBNVariable*>& kids = m_sampleNodes[i]->children();
+		for(vector<GBNVariable*>::const_iterator it = kids.begin(); it != kids.end(); it++)
+		{
+			std::map<GBNVariable*, size_t>::iterator found = indexes.find(*it);
+			if(found == indexes.end())
+				continue; // This child is not managed by this network
+			children[i].push_back(found->second);
+			parents[found->second].push_back(i);
+		}
+	}
+
+	// Give each node the smallest color not used in its Markov blanket (its parents,
+	// its children, and the other parents of its children)
+	vector<size_t> colors(n, INVALID_INDEX);
+	vector<size_t> forbiddenBy;
+	size_t colorCount = 0;
+	for(size_t i = 0; i < n; i++)
+	{
+		for(size_t j = 0; j < parents[i].size(); j++)
+		{
+			size_t c = colors[parents[i][j]];
+			if(c != INVALID_INDEX)
+				forbiddenBy[c] = i;
+		}
+		for(size_t j = 0; j < children[i].size(); j++)
+		{
+			size_t child = children[i][j];
+			if(colors[child] != INVALID_INDEX)
+				forbiddenBy[colors[child]] = i;
+			for(size_t k = 0; k < parents[child].size(); k++)
+			{
+				size_t c = colors[parents[child][k]];
+				if(c != INVALID_INDEX)
+					forbiddenBy[c] = i;
+			}
+		}
+		size_t c = 0;
+		while(c < colorCount && forbiddenBy[c] == i)
+			c++;
+		if(c == colorCount)
+		{
+			colorCount++;
+			forbiddenBy.push_back(INVALID_INDEX);
+		}
+		colors[i] = c;
+	}
+	m_colors.clear();
+	m_colors.resize(colorCount);
+	for(size_t i = 0; i < n; i++)
+		m_colors[colors[i]].push_back(m_sampleNodes[i]);
+}
+
+size_t GBayesNet::colorCount()
+{
+	prepareChains();
+	return m_colors.size();
+}
+
+size_t GBayesNet::blocksPerChain()
+{
+	size_t blocks = 1;
+	for(size_t i = 0; i < m_colors.size(); i++)
+		blocks = std::max(blocks, (m_colors[i].size() + m_blockSize - 1) / m_blockSize);
+	return blocks;
+}
+
+void GBayesNet::prepareChains()
+{
+	// Find the groups again if any nodes or edges were added
+	size_t signature = m_sampleNodes.size();
+	for(size_t i = 0; i < m_sampleNodes.size(); i++)
+		signature += m_sampleNodes[i]->children().size();
+	if(signature != m_structureSignature)
+	{
+		colorNodes();
+		m_structureSignature = signature;
+		for(size_t i = 0; i < m_blockRands.size(); i++)
+			delete(m_blockRands[i]);
+		m_blockRands.clear();
+	}
+
+	// Make a random number generator for each block of each chain
+	size_t rands = m_chains * blocksPerChain();
+	if(m_blockRands.size() != rands)
+	{
+		for(size_t i = 0; i < m_blockRands.size(); i++)
+			delete(m_blockRands[i]);
+		m_blockRands.clear();
+		for(size_t i = 0; i < rands; i++)
+			m_blockRands.push_back(new GRand(m_rand.next()));
+	}
+
+	// Make sure every node has a value in every chain before any threads read them
+	for(size_t i = 0; i < m_sampleNodes.size(); i++)
+		m_sampleNodes[i]->setChainCount(std::max(m_chains, (size_t)1));
+	for(size_t chain = 0; chain < m_chains; chain++)
+	{
+		GBNNode::setCurrentChain(chain);
+		for(size_t i = 0; i < m_sampleNodes.size(); i++)
+			m_sampleNodes[i]->currentValue();
+	}
+	GBNNode::setCurrentChain(0);
+}
+
+namespace GClasses {
+
+/// Samples blocks of the nodes in one group of conditionally independent nodes.
+/// (Used by GBayesNet::sampleChains.)
+class GBayesNetChainWorker : public GWorkerThread
+{
+protected:
+	GBayesNet& m_net;
+	size_t m_randsPerChain;
+	const vector<GBNVariable*>* m_pNodes;
+	size_t m_blocks;
+
+public:
+	std::string m_error;
+
+	GBayesNetChainWorker(GMasterThread& master, GBayesNet& net, size_t randsPerChain)
+	: GWorkerThread(master), m_net(net), m_randsPerChain(randsPerChain), m_pNodes(NULL), m_blocks(1)
+	{
+	}
+
+	virtual ~GBayesNetChainWorker()
+	{
+	}
+
+	/// Specifies the group to sample in the next call to doJobs
+	void setGroup(const vector<GBNVariable*>* pNodes, size_t blocks)
+	{
+		m_pNodes = pNodes;
+		m_blocks = blocks;
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		size_t chain = jobId / m_blocks;
+		size_t block = jobId % m_blocks;
+		GRand* pRand = m_net.m_blockRands[chain * m_randsPerChain + block];
+		size_t start = block * m_net.m_blockSize;
+		size_t end = std::min(m_pNodes->size(), start + m_net.m_blockSize);
+		try
+		{
+			GBNNode::setCurrentChain(chain);
+			for(size_t i = start; i < end; i++)
+				(*m_pNodes)[i]->sample(pRand);
+		}
+		catch(const std::exception& e)
+		{
+			if(m_error.length() == 0)
+				m_error = e.what();
+		}
+		GBNNode::setCurrentChain(0);
+	}
+};
+
+} // namespace GClasses
+
+void GBayesNet::sampleChains()
+{
+	prepareChains();
+	size_t randsPerChain = blocksPerChain();
+
+	// Visit the groups in random order
+	vector<size_t> order(m_colors.size());
+	for(size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	for(size_t i = order.size(); i > 1; i--)
+		std::swap(order[i - 1], order[(size_t)m_rand.next(i)]);
+
+	// Sample the groups one at a time. All the blocks of one group in all the chains can be sampled at once.
+	std::string error;
+	{
+		size_t threads = std::min(m_workerThreads, m_chains * randsPerChain);
+		vector<GBayesNetChainWorker*> workers;
+		GMasterThread master;
+		for(size_t j = 0; j < threads; j++)
+		{
+			workers.push_back(new GBayesNetChainWorker(master, *this, randsPerChain));
+			master.addWorker(workers[j]);
+		}
+		for(size_t i = 0; i < order.size() && error.length() == 0; i++)
+		{
+			const vector<GBNVariable*>& nodes = m_colors[order[i]];
+			size_t blocks = (nodes.size() + m_blockSize - 1) / m_blockSize;
+			if(blocks == 0)
+				continue;
+			for(size_t j = 0; j < threads; j++)
+				workers[j]->setGroup(&nodes, blocks);
+			master.doJobs(m_chains * blocks);
+			for(size_t j = 0; j < threads; j++)
+			{
+				if(workers[j]->m_error.length() > 0 && error.length() == 0)
+					error = workers[j]->m_error;
+			}
+		}
+	}
+	if(error.length() > 0)
+		throw Ex(error);
+
+	// Update the statistics of the monitored nodes
+	for(size_t chain = 0; chain < m_chains; chain++)
+	{
+		GBNNode::setCurrentChain(chain);
+		for(size_t i = 0; i < m_monitored.size(); i++)
+			m_stats[i * m_chains + chain].add(m_monitored[i]->currentValue());
+	}
+	GBNNode::setCurrentChain(0);
+}
+
+size_t GBayesNet::monitor(GBNNode* pNode)
+{
+	m_monitored.push_back(pNode);
+	for(size_t i = 0; i < m_chains; i++)
+		m_stats.push_back(GBNChainStats(m_maxLag));
+	return m_monitored.size() - 1;
+}
+
+void GBayesNet::resetDiagnostics(size_t maxLag)
+{
+	m_maxLag = maxLag;
+	m_stats.clear();
+	for(size_t i = 0; i < m_monitored.size() * m_chains; i++)
+		m_stats.push_back(GBNChainStats(m_maxLag));
+}
+
+double GBayesNet::monitoredMean(size_t index)
+{
+	if(index >= m_monitored.size())
+		throw Ex("Index out of range");
+	double sum = 0.0;
+	for(size_t chain = 0; chain < m_chains; chain++)
+		sum += m_stats[index * m_chains + chain].mean();
+	return sum / m_chains;
+}
+
+void GBayesNet::chainVariances(size_t index, double& varPlus, double& within)
+{
+	if(index >= m_monitored.size())
+		throw Ex("Index out of range");
+	const GBNChainStats* pStats = &m_stats[index * m_chains];
+	size_t n = pStats[0].count();
+	if(n < 2)
+		throw Ex("At least 2 samples are needed");
+
+	// Compute the mean within-chain variance and the variance of the chain means
+	double grandMean = 0.0;
+	within = 0.0;
+	for(size_t chain = 0; chain < m_chains; chain++)
+	{
+		grandMean += pStats[chain].mean();
+		within += pStats[chain].autocovariance(0) * n / (n - 1);
+	}
+	grandMean /= m_chains;
+	within /= m_chains;
+	double between = 0.0; // (This is B/n in the notation of Gelman and Rubin.)
+	if(m_chains > 1)
+	{
+		for(size_t chain = 0; chain < m_chains; chain++)
+		{
+			double d = pStats[chain].mean() - grandMean;
+			between += d * d;
+		}
+		between /= (m_chains - 1);
+	}
+	varPlus = within * (n - 1) / n + between;
+}
+
+double GBayesNet::rHat(size_t index)
+{
+	if(m_chains < 2)
+		throw Ex("At least 2 chains are needed to compute R-hat");
+	double varPlus, within;
+	chainVariances(index, varPlus, within);
+	if(within <= 0.0)
+		return 1.0; // The chains are constant
+	return std::sqrt(varPlus / within);
+}
+
+double GBayesNet::effectiveSampleSize(size_t index)
+{
+	double varPlus, within;
+	chainVariances(index, varPlus, within);
+	const GBNChainStats* pStats = &m_stats[index * m_chains];
+	size_t n = pStats[0].count();
+	double total = (double)n * m_chains;
+	if(varPlus <= 0.0)
+		return total;
+
+	// Sum the autocorrelations in adjacent pairs until a pair becomes negative (Geyer's initial positive sequence)
+	size_t maxLag = std::min(pStats[0].maxLag(), n - 1);
+	double tau = -1.0;
+	for(size_t lag = 0; lag + 1 <= maxLag; lag += 2)
+	{
+		double pair = 0.0;
+		for(size_t k = lag; k <= lag + 1; k++)
+		{
+			double meanAcov = 0.0;
+			for(size_t chain = 0; chain < m_chains; chain++)
+				meanAcov += pStats[chain].autocovariance(k);
+			meanAcov /= m_chains;
+			pair += (k == 0 ? 1.0 : 1.0 - (within - meanAcov) / varPlus);
+		}
+		if(pair <= 0.0)
+			break;
+		tau += 2.0 * pair;
+	}
+	return total / std::max(tau, 1.0 / total);
+}
+
 #ifndef MIN_PREDICT
 void GBayesNet_simpleTest()
 {
@@ -1184,11 +1585,103 @@ void GBayesNet_alarmTest()
 		throw Ex("Not close enough");
 }
 
+void GBayesNet_chainsTest()
+{
+	// The same model as GBayesNet_simpleTest, sampled with 4 chains
+	GBayesNet bn;
+	GBNCategorical* pPar = bn.newCat(2);
+	pPar->setWeights(0, bn.newConst(0.4), bn.newConst(0.6));
+	GBNNormal* pChild = bn.newNormal();
+	pChild->addCatParent(pPar, bn.def());
+	pChild->setMeanAndDev(0, bn.newConst(0.0), bn.newConst(1.0));
+	pChild->setMeanAndDev(1, bn.newConst(3.0), bn.newConst(2.0));
+	pChild->setObserved(1.0);
+	bn.setChains(4);
+	size_t index = bn.monitor(pPar);
+	for(size_t burnin = 0; burnin < 2000; burnin++)
+		bn.sampleChains();
+	bn.resetDiagnostics(50);
+	for(size_t sample = 0; sample < 20000; sample++)
+		bn.sampleChains();
+	if(std::abs((1.0 - bn.monitoredMean(index)) - 0.5714286) > 0.01)
+		throw Ex("Not close enough");
+	if(bn.rHat(index) > 1.05)
+		throw Ex("The chains did not mix");
+	double ess = bn.effectiveSampleSize(index);
+	if(ess < 10000 || ess > 4 * 20000 * 1.1)
+		throw Ex("Unexpected effective sample size: ", to_str(ess));
+}
+
+void GBayesNet_makeLattice(GBayesNet& bn, size_t width, vector<GBNCategorical*>& nodes)
+{
+	// A grid of binary nodes, each with its left and upper neighbors as parents
+	for(size_t y = 0; y < width; y++)
+	{
+		for(size_t x = 0; x < width; x++)
+		{
+			GBNCategorical* pNode = bn.newCat(2);
+			if(x > 0)
+				pNode->addCatParent(nodes[nodes.size() - 1], bn.def());
+			if(y > 0)
+				pNode->addCatParent(nodes[nodes.size() - width], bn.def());
+			size_t combos = (x > 0 ? 2 : 1) * (y > 0 ? 2 : 1);
+			for(size_t i = 0; i < combos; i++)
+			{
+				size_t ones = (i & 1) + ((i >> 1) & 1);
+				double p = 0.2 + 0.3 * ones;
+				pNode->setWeights(i, bn.newConst(1.0 - p), bn.newConst(p));
+			}
+			nodes.push_back(pNode);
+		}
+	}
+	nodes[0]->setObserved(1.0);
+	nodes[nodes.size() - 1]->setObserved(0.0);
+}
+
+void GBayesNet_coloringTest()
+{
+	// Sampling with several threads should give exactly the same results as with one thread
+	vector<GBNCategorical*> nodesA;
+	vector<GBNCategorical*> nodesB;
+	GBayesNet bnA(1234);
+	GBayesNet bnB(1234);
+	GBayesNet_makeLattice(bnA, 30, nodesA);
+	GBayesNet_makeLattice(bnB, 30, nodesB);
+	bnA.setChains(3);
+	bnB.setChains(3);
+	bnB.setWorkerThreads(4);
+	bnB.setBlockSize(64);
+	bnA.setBlockSize(64);
+	for(size_t i = 0; i < 20; i++)
+	{
+		bnA.sampleChains();
+		bnB.sampleChains();
+	}
+	for(size_t chain = 0; chain < 3; chain++)
+	{
+		GBNNode::setCurrentChain(chain);
+		for(size_t i = 0; i < nodesA.size(); i++)
+		{
+			if(nodesA[i]->currentValue() != nodesB[i]->currentValue())
+				throw Ex("The threads changed the results");
+		}
+	}
+	GBNNode::setCurrentChain(0);
+
+	// Each node and its parents and co-parents need different colors, so the lattice needs
+	// more than 2 colors, but the greedy coloring should not need many
+	size_t colors = bnA.colorCount();
+	if(colors < 3 || colors > 6)
+		throw Ex("Unexpected number of colors: ", to_str(colors));
+}
+
 void GBayesNet::test()
 {
 	GBayesNet_simpleTest();
 	GBayesNet_threeTest();
 	GBayesNet_alarmTest();
+	GBayesNet_chainsTest();
+	GBayesNet_coloringTest();
 }
 #endif
 
@@ -39,10 +39,21 @@ protected:
 	bool m_observed;
 	double m_observedValue;
 
+	/// The chain whose values are read and written by the calling thread
+	static thread_local size_t s_chain;
+
 public:
 	GBNNode();
 	virtual ~GBNNode();
 
+	/// Returns the index of the chain whose values are read and written by
+	/// the calling thread. (This is 0 unless GBayesNet::sampleChains is in progress.)
+	static size_t currentChain() { return s_chain; }
+
+	/// Specifies the chain whose values will be read and written by the
+	/// calling thread. Every node must have at least chain+1 chains.
+	static void setCurrentChain(size_t chain) { s_chain = chain; }
+
 	/// Returns the current value of this node. If this node represents a
 	/// random variable, then it returns the value most-recently sampled
 	/// from its distribution.
@@ -183,6 +194,11 @@ public:
 	/// it its Markov blanket.
 	virtual void sample(GRand* pRand) = 0;
 
+	/// Makes room for the values of n independent sampling chains. (Chain 0 is the
+	/// one used by GBayesNet::sample, and any new chains start over from the
+	/// initial value.)
+	virtual void setChainCount(size_t n) = 0;
+
 	/// Set this node to an observed value. After calling this, subsequent calls to
 	/// sample will not change its value.
 	void setObserved(double value) { m_observed = true; m_observedValue = value; }
@@ -219,7 +235,7 @@ class GBNCategorical : public GBNVariable
 {
 protected:
 	size_t m_categories;
-	size_t m_val;
+	std::vector<size_t> m_vals; // The current value in each chain
 	std::vector<GBNNode*> m_weights;
 
 public:
@@ -251,6 +267,9 @@ public:
 	/// it its Markov blanket.
 	virtual void sample(GRand* pRand);
 
+	/// See the comment for GBNVariable::setChainCount
+	virtual void setChainCount(size_t n);
+
 	/// Computes the likelihood that the specified value (after being truncated to an integer)
 	/// would be drawn from this categorical distribution given the current values of all the
 	/// parent nodes of this class.
@@ -264,8 +283,14 @@ public:
 class GBNMetropolisNode : public GBNVariable
 {
 protected:
-	double m_currentMean;
-	double m_sumOfValues, m_sumOfSquaredValues;
+	/// The state of the sampler in one chain
+	struct ChainState
+	{
+		double currentMean;
+		double sumOfValues;
+		double sumOfSquaredValues;
+	};
+	std::vector<ChainState> m_chainStates;
 
 public:
 	/// General-purpose constructor.
@@ -279,6 +304,9 @@ public:
 	/// it its Markov blanket. Uses the Metropolis algorithm to do so.
 	void sample(GRand* pRand);
 
+	/// See the comment for GBNVariable::setChainCount
+	virtual void setChainCount(size_t n);
+
 	/// This should return true iff this node supports only discrete values
 	virtual bool isDiscrete() = 0;
 
@@ -295,7 +323,7 @@ protected:
 
 	/// Sample the network in a manner that can be proven to converge to a
 	/// true joint distribution for the network.
-	void metropolis(GRand* pRand);
+	void metropolis(GRand* pRand, ChainState& state);
 };
 
 
@@ -706,18 +734,70 @@ public:
 
 
 
+/// Streaming statistics about the values of one node in one sampling chain.
+/// Keeps the sums needed to compute the autocovariance at lags up to a fixed
+/// maximum, so the effective sample size can be estimated without storing
+/// the samples.
+class GBNChainStats
+{
+protected:
+	size_t m_n;
+	double m_sum;
+	std::vector<double> m_lagProducts; // m_lagProducts[k] is the sum of x[t]*x[t+k]
+	std::vector<double> m_first; // the first maxLag values
+	std::vector<double> m_recent; // the last maxLag values, in a circular buffer
+
+public:
+	GBNChainStats(size_t maxLag);
+
+	/// Adds a value
+	void add(double x);
+
+	/// Returns the number of values
+	size_t count() const { return m_n; }
+
+	/// Returns the mean of the values
+	double mean() const { return m_sum / m_n; }
+
+	/// Returns the autocovariance at the specified lag, normalized by count().
+	/// (Lag 0 gives the variance.) lag must be no bigger than maxLag.
+	double autocovariance(size_t lag) const;
+
+	/// Returns the maximum lag
+	size_t maxLag() const { return m_first.size(); }
+};
+
+
 /// This class provides a platform for Bayesian belief networks.
 /// It allocates nodes in its own heap using placement new, so you don't have to worry about deleting the nodes.
 /// You can allocate your nodes manually and use them separately from this class if you want, but it is a lot
 /// easier if you use this class to manage it all.
+///
+/// Besides the single chain drawn by sample, it can draw several independent
+/// chains at once with sampleChains. Each chain has its own values in every node
+/// and its own random number generators. Within a chain, the nodes are divided by
+/// a graph coloring into groups that are conditionally independent of each other
+/// (no two nodes in a group are in each other's Markov blanket), so the nodes of a
+/// group can be sampled concurrently. Nodes passed to monitor accumulate streaming
+/// statistics from which rHat and effectiveSampleSize are computed.
 class GBayesNet
 {
+friend class GBayesNetChainWorker;
 protected:
 	GHeap m_heap;
 	std::vector<GBNNode*> m_nodes;
 	std::vector<GBNVariable*> m_sampleNodes;
 	GRand m_rand;
 	GBNConstant* m_pConstOne;
+	size_t m_chains;
+	size_t m_workerThreads;
+	size_t m_blockSize;
+	size_t m_structureSignature;
+	std::vector< std::vector<GBNVariable*> > m_colors;
+	std::vector<GRand*> m_blockRands; // m_chains rows of blocksPerChain() generators
+	std::vector<GBNNode*> m_monitored;
+	std::vector<GBNChainStats> m_stats; // m_chains entries for each monitored node
+	size_t m_maxLag;
 
 public:
 	/// General-purpose constructor
@@ -782,6 +862,66 @@ public:
 
 	/// Draw a Gibbs sample for each node in the graph in random order.
 	void sample();
+
+	/// Specifies the number of independent chains drawn by sampleChains. (The default is 1.)
+	/// Chain 0 is the one drawn by sample. Each new chain starts from the initial values,
+	/// and has its own random number generators seeded from rand().
+	void setChains(size_t n);
+
+	/// Returns the number of chains.
+	size_t chains() { return m_chains; }
+
+	/// Specifies the number of threads used by sampleChains. (The default is 1.)
+	void setWorkerThreads(size_t n) { m_workerThreads = (n > 1 ? n : 1); }
+
+	/// Specifies the maximum number of nodes that one thread samples at a time in
+	/// sampleChains. (The default is 256.)
+	void setBlockSize(size_t n) { m_blockSize = (n > 1 ? n : 1); }
+
+	/// Draws a Gibbs sample for each node in each chain. The groups of conditionally
+	/// independent nodes are visited in random order, and the nodes in each group are
+	/// divided into blocks. The blocks of all the chains are sampled concurrently.
+	/// Then the values of the monitored nodes are added to their statistics.
+	/// (The groups are found again whenever nodes or edges have been added.)
+	void sampleChains();
+
+	/// Returns the number of groups of conditionally independent nodes.
+	size_t colorCount();
+
+	/// Adds pNode to the nodes whose values are monitored by sampleChains.
+	/// Returns the index of pNode for calls to rHat and effectiveSampleSize.
+	size_t monitor(GBNNode* pNode);
+
+	/// Sets the biggest lag for which autocorrelation is tracked (the default is 100),
+	/// and discards the statistics of all monitored nodes. (Call this after burn-in.)
+	void resetDiagnostics(size_t maxLag = 100);
+
+	/// Returns the mean of the samples of the specified monitored node in all chains.
+	double monitoredMean(size_t index);
+
+	/// Returns the potential scale reduction factor (Gelman and Rubin, 1992) of the
+	/// specified monitored node. Values close to 1 indicate that the chains have mixed.
+	/// Requires at least 2 chains.
+	double rHat(size_t index);
+
+	/// Estimates the number of independent samples that the samples of the specified
+	/// monitored node in all chains are worth, using the autocorrelations combined over
+	/// the chains, truncated where the sums of adjacent pairs become negative (Geyer, 1992).
+	double effectiveSampleSize(size_t index);
+
+protected:
+	/// Finds the groups of conditionally independent nodes by greedy graph coloring
+	void colorNodes();
+
+	/// Makes sure every node has enough chains, the colors are up to date, and every
+	/// chain has been initialized
+	void prepareChains();
+
+	/// Returns the number of blocks in the biggest group
+	size_t blocksPerChain();
+
+	/// Computes the combined variance estimate and mean within-chain variance of a monitored node
+	void chainVariances(size_t index, double& varPlus, double& within);
 };
 
 
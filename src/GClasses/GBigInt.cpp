@@ -25,6 +25,8 @@
 #include "GHolders.h"
 #include "GKeyPair.h"
 #include "GDom.h"
+#include "GRand.h"
+#include <algorithm>
 #ifndef WINDOWS
 #include <sys/types.h>
 typedef int64_t __int64;
@@ -32,6 +34,383 @@ typedef int64_t __int64;
 
 namespace GClasses {
 
+// --------------------------------------------------------------
+// 64-bit limb arithmetic
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 GBigInt_uint128;
+#endif
+
+/// Products of numbers with fewer limbs than this are computed with the schoolbook method
+#define GBIGINT_KARATSUBA_THRESHOLD 24
+
+/// Returns the low 64 bits of a * b + c + carry, and puts the high 64 bits in carry. (This cannot overflow.)
+inline uint64_t GBigInt_mulAdd(uint64_t a, uint64_t b, uint64_t c, uint64_t& carry)
+{
+#ifdef __SIZEOF_INT128__
+	GBigInt_uint128 p = (GBigInt_uint128)a * b + c + carry;
+	carry = (uint64_t)(p >> 64);
+	return (uint64_t)p;
+#else
+	uint64_t aLo = a & 0xffffffff;
+	uint64_t aHi = a >> 32;
+	uint64_t bLo = b & 0xffffffff;
+	uint64_t bHi = b >> 32;
+	uint64_t p0 = aLo * bLo;
+	uint64_t p1 = aLo * bHi;
+	uint64_t p2 = aHi * bLo;
+	uint64_t mid = (p0 >> 32) + (p1 & 0xffffffff) + (p2 & 0xffffffff);
+	uint64_t lo = (p0 & 0xffffffff) | (mid << 32);
+	uint64_t hi = aHi * bHi + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+	lo += c;
+	hi += (lo < c ? 1 : 0);
+	lo += carry;
+	hi += (lo < carry ? 1 : 0);
+	carry = hi;
+	return lo;
+#endif
+}
+
+/// out[0..na+nb) = a * b
+void GBigInt_mulSchoolbook(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* out)
+{
+	memset(out, '\0', sizeof(uint64_t) * (na + nb));
+	for(size_t i = 0; i < na; i++)
+	{
+		uint64_t carry = 0;
+		uint64_t ai = a[i];
+		for(size_t j = 0; j < nb; j++)
+			out[i + j] = GBigInt_mulAdd(ai, b[j], out[i + j], carry);
+		out[i + nb] = carry;
+	}
+}
+
+/// a[0..na) += b[0..nb), where na >= nb. Returns the carry out of the top limb.
+uint64_t GBigInt_addTo(uint64_t* a, size_t na, const uint64_t* b, size_t nb)
+{
+	uint64_t carry = 0;
+	size_t i;
+	for(i = 0; i < nb; i++)
+	{
+		uint64_t s = a[i] + carry;
+		carry = (s < carry ? 1 : 0);
+		a[i] = s + b[i];
+		carry += (a[i] < s ? 1 : 0);
+	}
+	for( ; carry && i < na; i++)
+	{
+		a[i]++;
+		carry = (a[i] == 0 ? 1 : 0);
+	}
+	return carry;
+}
+
+/// a[0..na) -= b[0..nb), where na >= nb. Returns the borrow out of the top limb.
+uint64_t GBigInt_subFrom(uint64_t* a, size_t na, const uint64_t* b, size_t nb)
+{
+	uint64_t borrow = 0;
+	size_t i;
+	for(i = 0; i < nb; i++)
+	{
+		uint64_t d = a[i] - b[i];
+		uint64_t nextBorrow = (d > a[i] ? 1 : 0);
+		a[i] = d - borrow;
+		nextBorrow += (a[i] > d ? 1 : 0);
+		borrow = nextBorrow;
+	}
+	for( ; borrow && i < na; i++)
+	{
+		borrow = (a[i] == 0 ? 1 : 0);
+		a[i]--;
+	}
+	return borrow;
+}
+
+/// out[0..2n) = a[0..n) * b[0..n)
+void GBigInt_mulKaratsuba(const uint64_t* a, const uint64_t* b, size_t n, uint64_t* out)
+{
+	if(n < GBIGINT_KARATSUBA_THRESHOLD)
+	{
+		GBigInt_mulSchoolbook(a, n, b, n, out);
+		return;
+	}
+
+	// Split each operand into a low half with h limbs and a high half with hh limbs
+	size_t h = n / 2;
+	size_t hh = n - h;
+	GBigInt_mulKaratsuba(a, b, h, out); // z0 = a0 * b0
+	GBigInt_mulKaratsuba(a + h, b + h, hh, out + 2 * h); // z2 = a1 * b1
+
+	// z1 = (a0 + a1) * (b0 + b1) - z0 - z2
+	std::vector<uint64_t> sa(a + h, a + n);
+	std::vector<uint64_t> sb(b + h, b + n);
+	sa.push_back(GBigInt_addTo(sa.data(), hh, a, h));
+	sb.push_back(GBigInt_addTo(sb.data(), hh, b, h));
+	std::vector<uint64_t> z1(2 * (hh + 1));
+	GBigInt_mulKaratsuba(sa.data(), sb.data(), hh + 1, z1.data());
+	GBigInt_subFrom(z1.data(), z1.size(), out, 2 * h);
+	GBigInt_subFrom(z1.data(), z1.size(), out + 2 * h, 2 * hh);
+
+	// Add z1 to the middle of the result. (The top limbs of z1 are zero, since the full product fits in 2n limbs.)
+	size_t len = std::min(z1.size(), 2 * n - h);
+	GBigInt_addTo(out + h, 2 * n - h, z1.data(), len);
+}
+
+/// out[0..na+nb) = a * b
+void GBigInt_mul(const uint64_t* a, size_t na, const uint64_t* b, size_t nb, uint64_t* out)
+{
+	if(na < nb)
+	{
+		std::swap(a, b);
+		std::swap(na, nb);
+	}
+	if(nb < GBIGINT_KARATSUBA_THRESHOLD)
+	{
+		GBigInt_mulSchoolbook(a, na, b, nb, out);
+		return;
+	}
+
+	// Multiply each nb-limb chunk of a by b with Karatsuba, and accumulate
+	memset(out, '\0', sizeof(uint64_t) * (na + nb));
+	std::vector<uint64_t> chunk(nb);
+	std::vector<uint64_t> prod(2 * nb);
+	for(size_t start = 0; start < na; start += nb)
+	{
+		size_t len = std::min(nb, na - start);
+		std::fill(chunk.begin(), chunk.end(), 0);
+		std::copy(a + start, a + start + len, chunk.begin());
+		GBigInt_mulKaratsuba(chunk.data(), b, nb, prod.data());
+		GBigInt_addTo(out + start, na + nb - start, prod.data(), len + nb);
+	}
+}
+
+/// Returns -1, 0, or 1 to compare a[0..n) with b[0..n)
+int GBigInt_cmp(const uint64_t* a, const uint64_t* b, size_t n)
+{
+	for(size_t i = n; i > 0; i--)
+	{
+		if(a[i - 1] != b[i - 1])
+			return a[i - 1] > b[i - 1] ? 1 : -1;
+	}
+	return 0;
+}
+
+/// Performs arithmetic in Montgomery form modulo an odd number
+class GBigIntMontgomery
+{
+public:
+	size_t m_n; // The number of limbs in the modulus
+	std::vector<uint64_t> m_mod;
+	uint64_t m_inv; // -1/mod (mod 2^64)
+	std::vector<uint64_t> m_r2; // R^2 mod m_mod, where R = 2^(64*m_n)
+	std::vector<uint64_t> m_one; // 1 in Montgomery form (R mod m_mod)
+	std::vector<uint64_t> m_t;
+
+	/// mod must be odd, greater than 1, and have no leading zero limbs
+	GBigIntMontgomery(const std::vector<uint64_t>& mod)
+	: m_n(mod.size()), m_mod(mod), m_r2(mod.size(), 0), m_one(mod.size(), 0), m_t(mod.size() + 2)
+	{
+		// Newton's method doubles the number of correct bits each iteration (starting with 3)
+		uint64_t x = mod[0];
+		for(size_t i = 0; i < 5; i++)
+			x *= 2 - mod[0] * x;
+		m_inv = (uint64_t)0 - x;
+
+		// Compute R mod m_mod and R^2 mod m_mod by doubling
+		std::vector<uint64_t> r(m_n, 0);
+		r[0] = 1;
+		for(size_t i = 0; i < 128 * m_n; i++)
+		{
+			if(i == 64 * m_n)
+				m_one = r;
+			uint64_t top = r[m_n - 1] >> 63;
+			for(size_t j = m_n - 1; j > 0; j--)
+				r[j] = (r[j] << 1) | (r[j - 1] >> 63);
+			r[0] <<= 1;
+			if(top || GBigInt_cmp(r.data(), m_mod.data(), m_n) >= 0)
+				GBigInt_subFrom(r.data(), m_n, m_mod.data(), m_n);
+		}
+		m_r2 = r;
+	}
+
+	/// out = a * b / R (mod m_mod). a and b must be less than m_mod. out may be a or b.
+	void mul(const uint64_t* a, const uint64_t* b, uint64_t* out)
+	{
+		size_t n = m_n;
+		uint64_t* t = m_t.data();
+		const uint64_t* mod = m_mod.data();
+		std::fill(m_t.begin(), m_t.end(), 0);
+		for(size_t i = 0; i < n; i++)
+		{
+			// t += a * b[i]
+			uint64_t carry = 0;
+			uint64_t bi = b[i];
+			for(size_t j = 0; j < n; j++)
+				t[j] = GBigInt_mulAdd(a[j], bi, t[j], carry);
+			uint64_t s = t[n] + carry;
+			t[n + 1] = (s < carry ? 1 : 0);
+			t[n] = s;
+
+			// t = (t + m * mod) / 2^64, where m is chosen to make the low limb zero
+			uint64_t m = t[0] * m_inv;
+			carry = 0;
+			GBigInt_mulAdd(m, mod[0], t[0], carry);
+			for(size_t j = 1; j < n; j++)
+				t[j - 1] = GBigInt_mulAdd(m, mod[j], t[j], carry);
+			s = t[n] + carry;
+			t[n - 1] = s;
+			t[n] = t[n + 1] + (s < carry ? 1 : 0);
+		}
+		if(t[n] != 0 || GBigInt_cmp(t, mod, n) >= 0)
+			GBigInt_subFrom(t, n + 1, mod, n);
+		std::copy(t, t + n, out);
+	}
+
+	/// Converts a (which must be less than the modulus) to Montgomery form
+	void toMont(const uint64_t* a, uint64_t* out)
+	{
+		mul(a, m_r2.data(), out);
+	}
+
+	/// Converts a from Montgomery form
+	void fromMont(const uint64_t* a, uint64_t* out)
+	{
+		std::vector<uint64_t> plainOne(m_n, 0);
+		plainOne[0] = 1;
+		mul(a, plainOne.data(), out);
+	}
+
+	/// out = base^k in Montgomery form, where base is in Montgomery form. Uses sliding-window exponentiation.
+	void power(const uint64_t* base, GBigInt* pK, uint64_t* out)
+	{
+		unsigned int bits = pK->getBitCount();
+		unsigned int window = bits > 671 ? 6 : (bits > 239 ? 5 : (bits > 79 ? 4 : (bits > 23 ? 3 : 1)));
+
+		// Precompute the odd powers base^1, base^3, ..., base^(2^window - 1)
+		size_t n = m_n;
+		size_t tableSize = (size_t)1 << (window - 1);
+		std::vector<uint64_t> table(tableSize * n);
+		std::copy(base, base + n, table.begin());
+		if(tableSize > 1)
+		{
+			std::vector<uint64_t> sq(n);
+			mul(base, base, sq.data());
+			for(size_t i = 1; i < tableSize; i++)
+				mul(table.data() + (i - 1) * n, sq.data(), table.data() + i * n);
+		}
+
+		// Scan the exponent from the most significant bit
+		std::vector<uint64_t> res(m_one);
+		int i = (int)bits - 1;
+		while(i >= 0)
+		{
+			if(!pK->getBit(i))
+			{
+				mul(res.data(), res.data(), res.data());
+				i--;
+				continue;
+			}
+			int l = std::max(i - (int)window + 1, 0);
+			while(!pK->getBit(l))
+				l++;
+			unsigned int val = 0;
+			for(int j = i; j >= l; j--)
+			{
+				val = (val << 1) | (pK->getBit(j) ? 1 : 0);
+				mul(res.data(), res.data(), res.data());
+			}
+			mul(res.data(), table.data() + ((val - 1) / 2) * n, res.data());
+			i = l - 1;
+		}
+		std::copy(res.begin(), res.end(), out);
+	}
+};
+
+/// Returns the odd primes less than 2000, which are used to quickly reject most composite candidates
+std::vector<unsigned int> GBigInt_sieve()
+{
+	std::vector<unsigned int> primes;
+	std::vector<bool> composite(2000, false);
+	for(unsigned int i = 3; i < 2000; i += 2)
+	{
+		if(composite[i])
+			continue;
+		primes.push_back(i);
+		for(unsigned int j = i * i; j < 2000; j += 2 * i)
+			composite[j] = true;
+	}
+	return primes;
+}
+
+const std::vector<unsigned int>& GBigInt_smallPrimes()
+{
+	static const std::vector<unsigned int> primes = GBigInt_sieve();
+	return primes;
+}
+
+void GBigInt::toLimbs(std::vector<uint64_t>& limbs)
+{
+	unsigned int digits = m_nUInts;
+	while(digits > 0 && m_pBits[digits - 1] == 0)
+		digits--;
+	limbs.resize((digits + 1) / 2);
+	for(size_t i = 0; i < limbs.size(); i++)
+	{
+		uint64_t lo = m_pBits[2 * i];
+		uint64_t hi = (2 * i + 1 < digits ? m_pBits[2 * i + 1] : 0);
+		limbs[i] = lo | (hi << 32);
+	}
+}
+
+void GBigInt::fromLimbs(const uint64_t* pLimbs, size_t count)
+{
+	while(count > 0 && pLimbs[count - 1] == 0)
+		count--;
+	if(count == 0)
+	{
+		bool sign = m_bSign;
+		resize(BITS_PER_INT);
+		setToZero();
+		m_bSign = sign;
+		return;
+	}
+	resize((unsigned int)(count * 64));
+	for(size_t i = 0; i < count; i++)
+	{
+		m_pBits[2 * i] = (unsigned int)(pLimbs[i] & 0xffffffff);
+		m_pBits[2 * i + 1] = (unsigned int)(pLimbs[i] >> 32);
+	}
+	for(size_t i = 2 * count; i < m_nUInts; i++)
+		m_pBits[i] = 0;
+}
+
+void GBigInt::fromDigits(const unsigned int* pDigits, size_t count)
+{
+	while(count > 0 && pDigits[count - 1] == 0)
+		count--;
+	if(count == 0)
+	{
+		bool sign = m_bSign;
+		resize(BITS_PER_INT);
+		setToZero();
+		m_bSign = sign;
+		return;
+	}
+	resize((unsigned int)(count * BITS_PER_INT));
+	for(size_t i = 0; i < count; i++)
+		m_pBits[i] = pDigits[i];
+	for(size_t i = count; i < m_nUInts; i++)
+		m_pBits[i] = 0;
+}
+
+unsigned int GBigInt::modSmall(unsigned int n)
+{
+	uint64_t r = 0;
+	for(unsigned int i = m_nUInts; i > 0; i--)
+		r = ((r << 32) | m_pBits[i - 1]) % n;
+	return (unsigned int)r;
+}
+
 GBigInt::GBigInt()
 {
 	m_pBits = NULL;
@@ -295,6 +674,8 @@ int GBigInt::compareTo(GBigInt* pOperand)
 	unsigned int n = m_nUInts;
 	if(pOperand->m_nUInts > n)
 		n = pOperand->m_nUInts;
+	if(n == 0)
+		return 0;
 	n--;
 	while(true)
 	{
@@ -621,47 +1002,130 @@ void GBigInt::multiply(GBigInt* pBigNumber, unsigned int nUInt)
 
 void GBigInt::multiply(GBigInt* pFirst, GBigInt* pSecond)
 {
-	setToZero();
-	resize(pFirst->getBitCount() + pSecond->getBitCount());
-	GBigInt tmp;
-	unsigned int nUInts = pFirst->m_nUInts;
-	if(pSecond->m_nUInts > nUInts)
-		nUInts = pSecond->m_nUInts;
-	unsigned int n;
-	for(n = 0; n < nUInts; n++)
+	std::vector<uint64_t> a;
+	std::vector<uint64_t> b;
+	pFirst->toLimbs(a);
+	pSecond->toLimbs(b);
+	bool sign = ((pFirst->m_bSign == pSecond->m_bSign) ? true : false);
+	if(a.size() == 0 || b.size() == 0)
 	{
-		shiftLeftUInts(1);
-		tmp.multiply(pFirst, pSecond->getUInt(nUInts - 1 - n));
-		add(&tmp);
+		setToZero();
+		m_bSign = sign;
+		return;
 	}
-	m_bSign = ((pFirst->m_bSign == pSecond->m_bSign) ? true : false);
+	std::vector<uint64_t> prod(a.size() + b.size());
+	GBigInt_mul(a.data(), a.size(), b.data(), b.size(), prod.data());
+	fromLimbs(prod.data(), prod.size());
+	m_bSign = sign;
 }
 
 void GBigInt::divide(GBigInt* pInNominator, GBigInt* pInDenominator, GBigInt* pOutRemainder)
 {
-	setToZero();
-	resize(pInNominator->getBitCount());
-	pOutRemainder->setToZero();
-	pOutRemainder->resize(pInDenominator->getBitCount());
-	unsigned int nBits = pInNominator->getBitCount();
-	unsigned int n;
-	for(n = 0; n < nBits; n++)
+	// Copy the magnitudes, so the operands may be the same objects as the results
+	std::vector<unsigned int> u(pInNominator->m_pBits, pInNominator->m_pBits + pInNominator->m_nUInts);
+	std::vector<unsigned int> v(pInDenominator->m_pBits, pInDenominator->m_pBits + pInDenominator->m_nUInts);
+	while(u.size() > 0 && u.back() == 0)
+		u.pop_back();
+	while(v.size() > 0 && v.back() == 0)
+		v.pop_back();
+	if(v.size() == 0)
+		throw Ex("Division by zero");
+	bool quotientSign = ((pInNominator->m_bSign == pInDenominator->m_bSign) ? true : false);
+	bool remainderSign = pInNominator->m_bSign;
+	size_t m = u.size();
+	size_t n = v.size();
+	if(m < n)
+	{
+		setToZero();
+		pOutRemainder->fromDigits(u.data(), u.size());
+	}
+	else if(n == 1)
 	{
-		pOutRemainder->shiftLeftBits(1);
-		pOutRemainder->setBit(0, pInNominator->getBit(nBits - 1 - n));
-		shiftLeftBits(1);
-		if(pOutRemainder->compareTo(pInDenominator) >= 0)
+		// Short division
+		std::vector<unsigned int> q(m);
+		uint64_t r = 0;
+		for(size_t j = m; j > 0; j--)
 		{
-			setBit(0, true);
-			pOutRemainder->subtract(pInDenominator);
+			uint64_t num = (r << 32) | u[j - 1];
+			q[j - 1] = (unsigned int)(num / v[0]);
+			r = num % v[0];
 		}
-		else
+		unsigned int rem = (unsigned int)r;
+		fromDigits(q.data(), q.size());
+		pOutRemainder->fromDigits(&rem, 1);
+	}
+	else
+	{
+		// Knuth's algorithm D, with 32-bit digits. First, normalize so the top bit of the divisor is set.
+		unsigned int s = 0;
+		while((v[n - 1] << s) < 0x80000000u)
+			s++;
+		std::vector<unsigned int> vn(n);
+		std::vector<unsigned int> un(m + 1);
+		for(size_t i = n - 1; i > 0; i--)
+			vn[i] = (v[i] << s) | (s > 0 ? v[i - 1] >> (32 - s) : 0);
+		vn[0] = v[0] << s;
+		un[m] = (s > 0 ? u[m - 1] >> (32 - s) : 0);
+		for(size_t i = m - 1; i > 0; i--)
+			un[i] = (u[i] << s) | (s > 0 ? u[i - 1] >> (32 - s) : 0);
+		un[0] = u[0] << s;
+
+		std::vector<unsigned int> q(m - n + 1);
+		const uint64_t base = (uint64_t)1 << 32;
+		for(size_t j = m - n + 1; j > 0; j--)
 		{
-			setBit(0, false);
+			size_t jj = j - 1;
+
+			// Estimate the next digit of the quotient
+			uint64_t num = ((uint64_t)un[jj + n] << 32) | un[jj + n - 1];
+			uint64_t qhat = num / vn[n - 1];
+			uint64_t rhat = num % vn[n - 1];
+			while(qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[jj + n - 2]))
+			{
+				qhat--;
+				rhat += vn[n - 1];
+				if(rhat >= base)
+					break;
+			}
+
+			// Multiply and subtract
+			int64_t t;
+			uint64_t borrow = 0;
+			for(size_t i = 0; i < n; i++)
+			{
+				uint64_t p = qhat * vn[i];
+				t = (int64_t)un[i + jj] - (int64_t)borrow - (int64_t)(p & 0xffffffff);
+				un[i + jj] = (unsigned int)t;
+				borrow = (p >> 32) - (t >> 32);
+			}
+			t = (int64_t)un[jj + n] - (int64_t)borrow;
+			un[jj + n] = (unsigned int)t;
+
+			// If the estimate was one too big, add the divisor back
+			q[jj] = (unsigned int)qhat;
+			if(t < 0)
+			{
+				q[jj]--;
+				uint64_t carry = 0;
+				for(size_t i = 0; i < n; i++)
+				{
+					uint64_t sum = (uint64_t)un[i + jj] + vn[i] + carry;
+					un[i + jj] = (unsigned int)sum;
+					carry = sum >> 32;
+				}
+				un[jj + n] += (unsigned int)carry;
+			}
 		}
+
+		// Unnormalize the remainder
+		std::vector<unsigned int> r(n);
+		for(size_t i = 0; i < n; i++)
+			r[i] = (un[i] >> s) | (s > 0 ? un[i + 1] << (32 - s) : 0);
+		fromDigits(q.data(), q.size());
+		pOutRemainder->fromDigits(r.data(), r.size());
 	}
-	m_bSign = ((pInNominator->m_bSign == pInDenominator->m_bSign) ? true : false);
-	pOutRemainder->m_bSign = pInNominator->m_bSign;
+	m_bSign = quotientSign;
+	pOutRemainder->m_bSign = remainderSign;
 }
 
 // DO NOT use for crypto
@@ -815,6 +1279,26 @@ void GBigInt::calculatePrivateKey(GBigInt* pPublicKey, GBigInt* pProd)
 // Output: "this" where "this" = (a^k)%n   (^ = exponent operator, not xor operatore)
 void GBigInt::powerMod(GBigInt* pA, GBigInt* pK, GBigInt* pN)
 {
+	if(pN->getBit(0) && pN->m_bSign && pA->m_bSign && pK->m_bSign && pN->getBitCount() > 1)
+	{
+		// Use Montgomery multiplication, since the modulus is odd
+		std::vector<uint64_t> mod;
+		pN->toLimbs(mod);
+		GBigIntMontgomery mont(mod);
+		GBigInt q;
+		GBigInt r;
+		q.divide(pA, pN, &r);
+		std::vector<uint64_t> a;
+		r.toLimbs(a);
+		a.resize(mod.size(), 0);
+		mont.toMont(a.data(), a.data());
+		mont.power(a.data(), pK, a.data());
+		mont.fromMont(a.data(), a.data());
+		fromLimbs(a.data(), a.size());
+		m_bSign = true;
+		return;
+	}
+
 	GBigInt k;
 	k.copy(pK);
 	GBigInt c;
@@ -851,41 +1335,41 @@ bool GBigInt::millerRabin(GBigInt* pA)
 	one.increment();
 	if(g.compareTo(&one) > 0)
 		return false;
+
+	// Find m and s, such that this - 1 = m * 2^s, and m is odd
 	GBigInt m;
 	m.copy(this);
 	m.decrement();
-	GBigInt s;
+	unsigned int s = 0;
 	while(!m.getBit(0))
 	{
-		m.shiftRightBits(1);
-		s.increment();
+		m.shiftRight(1);
+		s++;
 	}
-	GBigInt b;
-	b.powerMod(pA, &m, this);
-	if(b.compareTo(&one) == 0)
+
+	// Compute b = a^m, and then square it up to s - 1 times, all in Montgomery form
+	std::vector<uint64_t> mod;
+	toLimbs(mod);
+	size_t n = mod.size();
+	GBigIntMontgomery mont(mod);
+	std::vector<uint64_t> minusOne(mod);
+	GBigInt_subFrom(minusOne.data(), n, mont.m_one.data(), n); // -1 in Montgomery form is n - R mod n
+	std::vector<uint64_t> b;
+	pA->toLimbs(b);
+	b.resize(n, 0);
+	mont.toMont(b.data(), b.data());
+	mont.power(b.data(), &m, b.data());
+	if(GBigInt_cmp(b.data(), mont.m_one.data(), n) == 0)
 		return true;
-	decrement();
-	int nCmp = b.compareTo(this);
-	increment();
-	if(nCmp == 0)
+	if(GBigInt_cmp(b.data(), minusOne.data(), n) == 0)
 		return true;
-	GBigInt i;
-	GBigInt b1;
-	i.increment();
-	while(i.compareTo(&s) < 0)
+	for(unsigned int i = 1; i < s; i++)
 	{
-		m.multiply(&b, &b);
-		g.divide(&m, this, &b1);
-		decrement();
-		nCmp = b1.compareTo(this);
-		increment();
-		if(nCmp == 0)
+		mont.mul(b.data(), b.data(), b.data());
+		if(GBigInt_cmp(b.data(), minusOne.data(), n) == 0)
 			return true;
-
-		if(b1.compareTo(&one) == 0)
+		if(GBigInt_cmp(b.data(), mont.m_one.data(), n) == 0)
 			return false;
-		b.copy(&b1);
-		i.increment();
 	}
 	return false;
 }
@@ -919,6 +1403,16 @@ bool GBigInt::isPrime()
 		return true;
 	}
 
+	// Reject multiples of small primes. (This is much cheaper than a round of Miller-Rabin.)
+	if(!getBit(0))
+		return false;
+	const std::vector<unsigned int>& primes = GBigInt_smallPrimes();
+	for(size_t i = 0; i < primes.size(); i++)
+	{
+		if(modSmall(primes[i]) == 0)
+			return (nBits <= 11 && getUInt(0) == primes[i]);
+	}
+
 	// Do 25 iterations of Miller-Rabin
 	nBits--;
 	unsigned int i;
@@ -937,5 +1431,126 @@ bool GBigInt::isPrime()
 	return true;
 }
 
+#ifndef NO_TEST_CODE
+void GBigInt_setRandom(GBigInt* pX, GRand& rand, unsigned int uints)
+{
+	pX->setToZero();
+	for(unsigned int i = 0; i < uints; i++)
+		pX->setUInt(i, (unsigned int)rand.next());
+	if(uints > 0 && pX->getUInt(uints - 1) == 0)
+		pX->setUInt(uints - 1, 1);
+}
+
+// Multiplies with the schoolbook method, one 32-bit digit at a time
+void GBigInt_referenceMultiply(GBigInt* pA, GBigInt* pB, GBigInt* pOut)
+{
+	pOut->setToZero();
+	GBigInt tmp;
+	for(unsigned int i = pB->getUIntCount(); i > 0; i--)
+	{
+		pOut->shiftLeft(32);
+		tmp.multiply(pA, pB->getUInt(i - 1));
+		pOut->add(&tmp);
+	}
+}
+
+// static
+void GBigInt::test()
+{
+	GRand rand(0);
+	unsigned int sizes[] = { 1, 2, 3, 7, 16, 47, 48, 49, 64, 100, 131, 200 };
+	size_t sizeCount = sizeof(sizes) / sizeof(unsigned int);
+	GBigInt a, b, c, d, q, r;
+
+	// Multiplication (including Karatsuba and unbalanced sizes)
+	for(size_t i = 0; i < sizeCount; i++)
+	{
+		for(size_t j = 0; j < sizeCount; j++)
+		{
+			GBigInt_setRandom(&a, rand, sizes[i]);
+			GBigInt_setRandom(&b, rand, sizes[j]);
+			c.multiply(&a, &b);
+			GBigInt_referenceMultiply(&a, &b, &d);
+			if(c.compareTo(&d) != 0)
+				throw Ex("multiply failed");
+			a.negate();
+			c.multiply(&a, &b);
+			if(c.getSign() || (c.negate(), c.compareTo(&d) != 0))
+				throw Ex("wrong sign");
+		}
+	}
+
+	// Division
+	for(size_t i = 0; i < sizeCount; i++)
+	{
+		for(size_t j = 0; j < sizeCount; j++)
+		{
+			GBigInt_setRandom(&a, rand, sizes[i]);
+			GBigInt_setRandom(&b, rand, sizes[j]);
+			if(j % 3 == 0)
+				b.setUInt(sizes[j] - 1, 0xffffffff); // (This makes it more likely that the quotient digit estimate is too big)
+			q.divide(&a, &b, &r);
+			if(r.compareTo(&b) >= 0 || !r.getSign())
+				throw Ex("remainder out of range");
+			c.multiply(&q, &b);
+			c.add(&r);
+			if(c.compareTo(&a) != 0)
+				throw Ex("divide failed");
+		}
+	}
+	a.fromHex("100000000000000000000000000000000"); // 2^128
+	b.fromHex("ffffffffffffffff00000001"); // Produces a quotient digit estimate that needs correction
+	q.divide(&a, &b, &r);
+	c.multiply(&q, &b);
+	c.add(&r);
+	if(c.compareTo(&a) != 0 || r.compareTo(&b) >= 0)
+		throw Ex("divide failed");
+
+	// Modular exponentiation with odd and even moduli
+	for(size_t i = 0; i < 8; i++)
+	{
+		GBigInt n, k, res;
+		GBigInt_setRandom(&n, rand, 1 + (unsigned int)rand.next(20));
+		n.setBit(0, i % 4 != 0);
+		GBigInt_setRandom(&a, rand, 1 + (unsigned int)rand.next(25));
+		GBigInt_setRandom(&k, rand, 1 + (unsigned int)rand.next(12));
+		res.powerMod(&a, &k, &n);
+
+		// Square and multiply, reducing with divide
+		GBigInt base, expected;
+		q.divide(&a, &n, &base);
+		expected.increment();
+		for(unsigned int bit = k.getBitCount(); bit > 0; bit--)
+		{
+			c.multiply(&expected, &expected);
+			q.divide(&c, &n, &expected);
+			if(k.getBit(bit - 1))
+			{
+				c.multiply(&expected, &base);
+				q.divide(&c, &n, &expected);
+			}
+		}
+		if(res.compareTo(&expected) != 0)
+			throw Ex("powerMod failed");
+	}
+
+	// Primality
+	const char* primes[] = { "61", "7cf", "7fffffffffffffffffffffffffffffff", "1fffffffffffffff", "fffffffffffffffffffffffffffffffeffffffffffffffff" };
+	for(size_t i = 0; i < sizeof(primes) / sizeof(const char*); i++)
+	{
+		a.fromHex(primes[i]);
+		if(!a.isPrime())
+			throw Ex("Failed to recognize a prime");
+	}
+	const char* composites[] = { "231", "7d1", "80000000000000000000000000000001", "ffffffea00000055", "3ffffffffffffffdffffffe000000000000001" };
+	for(size_t i = 0; i < sizeof(composites) / sizeof(const char*); i++)
+	{
+		a.fromHex(composites[i]);
+		if(a.isPrime())
+			throw Ex("Failed to recognize a composite");
+	}
+}
+#endif // !NO_TEST_CODE
+
 } // namespace GClasses
 
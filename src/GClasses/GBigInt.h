@@ -20,6 +20,9 @@
 #ifndef __GBIGINT_H__
 #define __GBIGINT_H__
 
+#include <vector>
+#include <stdint.h>
+
 namespace GClasses {
 
 class GKeyPair;
@@ -28,7 +31,12 @@ class GDom;
 
 /// Represents an integer of arbitrary size, and provides basic
 /// arithmetic functionality. Also contains functionality for
-/// implementing RSA symmetric-key cryptography.
+/// implementing RSA symmetric-key cryptography. The number is stored
+/// in 32-bit unsigned integers, but multiplication and modular exponentiation
+/// are done with 64-bit limbs (and 128-bit intermediate products where the
+/// compiler supports them). Large products use Karatsuba multiplication, and
+/// powerMod uses Montgomery reduction with sliding-window exponentiation
+/// when the modulus is odd.
 class GBigInt
 {
 protected:
@@ -46,6 +54,11 @@ public:
 	GBigInt(GDomNode* pNode);
 	virtual ~GBigInt();
 
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif
+
 	/// Marshal this object into a DOM that can be converted to a variety of serial formats.
 	GDomNode* serialize(GDom* pDoc) const;
 
@@ -129,7 +142,8 @@ public:
 	/// Set this value to the product of two big numbers
 	void multiply(GBigInt* pFirst, GBigInt* pSecond);
 
-	/// Set this value to the ratio of two big numbers and return the remainder
+	/// Set this value to the ratio of two big numbers and return the remainder.
+	/// Throws if the denominator is zero.
 	void divide(GBigInt* pInNominator, GBigInt* pInDenominator, GBigInt* pOutRemainder);
 
 	/// Shift left (multiply by 2)
@@ -164,6 +178,8 @@ public:
 
 	/// Output: true = pretty darn sure (like 99.999%) it's prime
 	///         false = definately (100%) not prime
+	/// Candidates that have a small prime factor are rejected by trial division
+	/// before any rounds of Miller-Rabin are performed.
 	bool isPrime();
 
 	/// Input:  pProd is the product of (p - 1) * (q - 1) where p and q are prime
@@ -187,6 +203,18 @@ protected:
 	void shiftRightBits(unsigned int nBits);
 	void shiftLeftUInts(unsigned int nBits);
 	void shiftRightUInts(unsigned int nBits);
+
+	/// Puts the magnitude of this number in 64-bit limbs (little endian), with no leading zero limbs
+	void toLimbs(std::vector<uint64_t>& limbs);
+
+	/// Sets the magnitude of this number from 64-bit limbs (little endian). Does not change the sign.
+	void fromLimbs(const uint64_t* pLimbs, size_t count);
+
+	/// Sets the magnitude of this number from 32-bit digits (little endian). Does not change the sign.
+	void fromDigits(const unsigned int* pDigits, size_t count);
+
+	/// Returns the remainder when the magnitude of this number is divided by a small number
+	unsigned int modSmall(unsigned int n);
 };
 
 } // namespace GClasses
@@ -29,6 +29,7 @@
 #include "GTransform.h"
 #include "GEnsemble.h"
 #include "GHolders.h"
+#include "GProfiler.h"
 #include <string>
 #include <iostream>
 #include <memory>
@@ -385,6 +386,20 @@ GDomNode* GDecisionTree::serialize(GDom* pDoc) const
 	return pNode;
 }
 
+#ifndef MIN_PREDICT
+// virtual
+GSupervisedLearner* GDecisionTree::clone()
+{
+	GDecisionTree* pClone = new GDecisionTree();
+	pClone->m_eAlg = m_eAlg;
+	pClone->m_leafThresh = m_leafThresh;
+	pClone->m_randomDraws = m_randomDraws;
+	pClone->m_maxLevels = m_maxLevels;
+	pClone->m_binaryDivisions = m_binaryDivisions;
+	return pClone;
+}
+#endif // MIN_PREDICT
+
 size_t GDecisionTree::treeSize()
 {
 	return m_pRoot->GetBranchSize();
@@ -422,6 +437,7 @@ void GDecisionTree::print(ostream& stream, GArffRelation* pFeatureRel, GArffRela
 // virtual
 void GDecisionTree::trainInner(const GMatrix& features, const GMatrix& labels)
 {
+	GPROFILE_SCOPE("GDecisionTree::trainInner");
 	clear();
 
 	// Make a list of available features
@@ -560,6 +576,8 @@ double GDecisionTree_measureNominalSplitInfo(GMatrix& features, GMatrix& labels,
 
 size_t GDecisionTree::pickDivision(GMatrix& features, GMatrix& labels, double* pPivot, vector<size_t>& attrPool, size_t nDepth)
 {
+	GPROFILE_SCOPE("GDecisionTree::pickDivision");
+	GPROFILE_HISTOGRAM("GDecisionTree::pickDivision rows", features.rows());
 	GMatrix tmpFeatures(features.relation().clone());
 	tmpFeatures.reserve(features.rows());
 	GMatrix tmpLabels(labels.relation().clone());
@@ -573,6 +591,7 @@ size_t GDecisionTree::pickDivision(GMatrix& features, GMatrix& labels, double* p
 		double bestPivot = 0;
 		size_t index = 0;
 		size_t bestIndex = attrPool.size();
+		GPROFILE_COUNT("GDecisionTree::pickDivision candidates", attrPool.size());
 		for(vector<size_t>::iterator it = attrPool.begin(); it != attrPool.end(); it++)
 		{
 			double info;
@@ -605,6 +624,7 @@ size_t GDecisionTree::pickDivision(GMatrix& features, GMatrix& labels, double* p
 			size_t attr = attrPool[index];
 			double pivot = 0.0;
 			double info;
+			GPROFILE_COUNT("GDecisionTree::pickDivision candidates", 1);
 			if(features.relation().valueCount(attr) == 0)
 			{
 				double a = features[(size_t)m_rand.next(features.rows())][attr];
@@ -70,6 +70,11 @@ public:
 	/// Marshal this object into a DOM, which can then be converted to a variety of serial formats.
 	virtual GDomNode* serialize(GDom* pDoc) const;
 
+#ifndef MIN_PREDICT
+	/// Returns a new untrained decision tree with the same settings as this one.
+	virtual GSupervisedLearner* clone();
+#endif // MIN_PREDICT
+
 	/// Specifies for this decision tree to use random divisions (instead of
 	/// divisions that reduce entropy). Random divisions make the algorithm
 	/// train somewhat faster, and also increase model variance, so it is better
@@ -21,6 +21,7 @@
 #include "GFile.h"
 #include "GBlob.h"
 #include "GHolders.h"
+#include "GRand.h"
 #include <string.h>
 #ifdef WINDOWS
 #	include <direct.h> // for "getcwd", "chdir", etc.
@@ -49,7 +50,7 @@ GDirList::GDirList()
 #define BUF_SIZE 2048
 #define COMPRESS_BUF_SIZE 65536
 
-GFolderSerializer::GFolderSerializer(const char* szPath, bool compress)
+GFolderSerializer::GFolderSerializer(const char* szPath, bool compress, bool fast)
 {
 	m_szPath = szPath;
 	m_szOrigPath = new char[300];
@@ -61,8 +62,10 @@ GFolderSerializer::GFolderSerializer(const char* szPath, bool compress)
 	m_state = 0;
 	m_pInStream = NULL;
 	m_pCompressedBuf = NULL;
+	m_fast = compress && fast;
+	m_workerThreads = 1;
 	if(compress)
-		m_pUncompressedBuf = new char[COMPRESS_BUF_SIZE];
+		m_pUncompressedBuf = new char[m_fast ? GLZ_BLOCK_SIZE + BUF_SIZE : COMPRESS_BUF_SIZE];
 	else
 		m_pUncompressedBuf = NULL;
 	m_compressedSize = 0;
@@ -140,8 +143,60 @@ char* GFolderSerializer::nextPiece(size_t* pOutSize)
 	return m_pBuf;
 }
 
+void GFolderSerializer::setWorkerThreads(size_t n)
+{
+	m_workerThreads = (n > 1 ? n : 1);
+	if(m_fast)
+	{
+		// Bytes that are still waiting to be compressed are kept, even if there are more of them than the new blocks hold
+		char* pNewBuf = new char[std::max(m_workerThreads * GLZ_BLOCK_SIZE, m_uncompressedPos) + BUF_SIZE];
+		memcpy(pNewBuf, m_pUncompressedBuf, m_uncompressedPos);
+		delete[] m_pUncompressedBuf;
+		m_pUncompressedBuf = pNewBuf;
+	}
+}
+
+char* GFolderSerializer::nextFast(size_t* pOutSize)
+{
+	if(m_state == 0)
+	{
+		memcpy(m_pBuf, "zgfs", 4);
+		*pOutSize = 4;
+		m_state = 4;
+		m_bytesOut += 4;
+		return m_pBuf;
+	}
+
+	// Fill a block for each thread. (The buffer has room for one extra piece past the end.)
+	size_t cap = m_workerThreads * GLZ_BLOCK_SIZE;
+	while(m_uncompressedPos < cap)
+	{
+		size_t size;
+		char* pChunk = nextPiece(&size);
+		if(!pChunk)
+			break;
+		memcpy(m_pUncompressedBuf + m_uncompressedPos, pChunk, size);
+		m_uncompressedPos += size;
+	}
+	if(m_uncompressedPos == 0)
+		return NULL;
+
+	// Compress the blocks in parallel, and carry over anything past the last block
+	size_t len = std::min(m_uncompressedPos, cap);
+	uint64_t compressedSize;
+	delete[] m_pCompressedBuf;
+	m_pCompressedBuf = GLZCompressor::compress((unsigned char*)m_pUncompressedBuf, len, &compressedSize, m_workerThreads);
+	memmove(m_pUncompressedBuf, m_pUncompressedBuf + len, m_uncompressedPos - len);
+	m_uncompressedPos -= len;
+	*pOutSize = (size_t)compressedSize;
+	m_bytesOut += *pOutSize;
+	return (char*)m_pCompressedBuf;
+}
+
 char* GFolderSerializer::next(size_t* pOutSize)
 {
+	if(m_fast)
+		return nextFast(pOutSize);
 	if(m_pUncompressedBuf) // If we are supposed to compress the output...
 	{
 		if(m_state == 0)
@@ -319,6 +374,120 @@ void GFolderSerializer::continueDir()
 	}
 }
 
+#ifndef NO_TEST_CODE
+void GFolderSerializer_makeFile(const string& filename, size_t size, GRand& rand)
+{
+	// Runs of repeated bytes make the file compressible, but not trivially so
+	std::vector<char> buf(size);
+	for(size_t i = 0; i < size; i++)
+		buf[i] = (char)(rand.next(8) == 0 ? rand.next(256) : (i / 64) % 256);
+	GFile::saveFile(buf.data(), size, filename.c_str());
+}
+
+void GFolderSerializer_compareFiles(const string& a, const string& b)
+{
+	size_t lenA, lenB;
+	char* pA = GFile::loadFile(a.c_str(), &lenA);
+	std::unique_ptr<char[]> hA(pA);
+	char* pB = GFile::loadFile(b.c_str(), &lenB);
+	std::unique_ptr<char[]> hB(pB);
+	if(lenA != lenB || memcmp(pA, pB, lenA) != 0)
+		throw Ex("The file ", b, " does not match the original");
+}
+
+void GFolderSerializer_deleteFolder(const string& path)
+{
+	std::vector<string> names;
+	GFile::fileList(names, path.c_str());
+	for(size_t i = 0; i < names.size(); i++)
+		GFile::deleteFile((path + "/" + names[i]).c_str());
+	names.clear();
+	GFile::folderList(names, path.c_str());
+	for(size_t i = 0; i < names.size(); i++)
+		GFolderSerializer_deleteFolder(path + "/" + names[i]);
+	GFile::removeDir(path.c_str());
+}
+
+void GFolderSerializer_testFastRoundTrip(const string& root)
+{
+	// Make a folder with several files, including one that spans several compression blocks
+	GRand rand(0);
+	GFile::makeDir((root + "/src/sub").c_str());
+	GFile::makeDir((root + "/out").c_str());
+	GFolderSerializer_makeFile(root + "/src/small.txt", 100, rand);
+	GFolderSerializer_makeFile(root + "/src/empty.txt", 0, rand);
+	GFolderSerializer_makeFile(root + "/src/sub/big.bin", 3 * GLZ_BLOCK_SIZE + 1000, rand);
+	GFolderSerializer_makeFile(root + "/src/sub/medium.bin", 5000, rand);
+
+	// Serialize it with several threads, and change the number of threads part way through
+	std::vector<char> stream;
+	{
+		string src = root + "/src";
+		GFolderSerializer ser(src.c_str(), true, true);
+		ser.setWorkerThreads(2);
+		size_t pieces = 0;
+		while(true)
+		{
+			size_t size;
+			char* pPiece = ser.next(&size);
+			if(!pPiece)
+				break;
+			stream.insert(stream.end(), pPiece, pPiece + size);
+			if(++pieces == 2)
+				ser.setWorkerThreads(1);
+		}
+		if(ser.bytesOut() != stream.size())
+			throw Ex("Wrong number of bytes reported");
+	}
+
+	// Deserialize it into another folder, a few bytes at a time
+	char szOrigPath[300];
+	if(!getcwd(szOrigPath, 300))
+		throw Ex("getcwd failed");
+	if(chdir((root + "/out").c_str()) != 0)
+		throw Ex("Failed to change dir to ", root, "/out");
+	string baseName;
+	try
+	{
+		GFolderDeserializer deser(&baseName);
+		for(size_t i = 0; i < stream.size(); i += 7777)
+			deser.doNext(stream.data() + i, std::min((size_t)7777, stream.size() - i));
+	}
+	catch(...)
+	{
+		if(chdir(szOrigPath) != 0)
+			throw Ex("Failed to restore original path");
+		throw;
+	}
+	if(chdir(szOrigPath) != 0)
+		throw Ex("Failed to restore original path");
+	if(baseName.compare("src") != 0)
+		throw Ex("Wrong base name");
+	GFolderSerializer_compareFiles(root + "/src/small.txt", root + "/out/src/small.txt");
+	GFolderSerializer_compareFiles(root + "/src/empty.txt", root + "/out/src/empty.txt");
+	GFolderSerializer_compareFiles(root + "/src/sub/big.bin", root + "/out/src/sub/big.bin");
+	GFolderSerializer_compareFiles(root + "/src/sub/medium.bin", root + "/out/src/sub/medium.bin");
+}
+
+// static
+void GFolderSerializer::test()
+{
+	char szRoot[512];
+	GFile::tempFilename(szRoot);
+	string root = szRoot;
+	try
+	{
+		GFolderSerializer_testFastRoundTrip(root);
+	}
+	catch(...)
+	{
+		GFolderSerializer_deleteFolder(root);
+		throw;
+	}
+	GFolderSerializer_deleteFolder(root);
+}
+#endif // !NO_TEST_CODE
+
 
 
 
@@ -331,6 +500,7 @@ GFolderDeserializer::GFolderDeserializer(std::string* pBaseName)
 {
 	m_pBQ1 = new GBlobQueue();
 	m_pBQ2 = NULL;
+	m_pLZ = NULL;
 	m_compressedBlockSize = 0;
 	m_state = 0;
 	m_pOutStream = NULL;
@@ -343,6 +513,7 @@ GFolderDeserializer::~GFolderDeserializer()
 {
 	delete(m_pBQ1);
 	delete(m_pBQ2);
+	delete(m_pLZ);
 	delete(m_pOutStream);
 }
 
@@ -366,6 +537,15 @@ void GFolderDeserializer::pump1()
 					m_state = 1;
 					return;
 				}
+				else if(memcmp(pChunk, "zgfs", 4) == 0)
+				{
+					delete(m_pLZ);
+					m_pLZ = new GLZUncompressor();
+					size_t readyBytes = m_pBQ1->readyBytes();
+					m_pLZ->enqueue((const unsigned char*)m_pBQ1->dequeue(readyBytes), readyBytes);
+					m_state = 1;
+					return;
+				}
 				else
 					throw Ex("Unrecognized format");
 			}
@@ -496,6 +676,17 @@ void GFolderDeserializer::pump2()
 	}
 }
 
+void GFolderDeserializer::pump3()
+{
+	size_t len;
+	const unsigned char* pBlock;
+	while((pBlock = m_pLZ->next(&len)) != NULL)
+	{
+		m_pBQ1->enqueue((const char*)pBlock, len);
+		pump1();
+	}
+}
+
 void GFolderDeserializer::doNext(const char* pBuf, size_t bufLen)
 {
 	if(m_pBQ2)
@@ -503,12 +694,19 @@ void GFolderDeserializer::doNext(const char* pBuf, size_t bufLen)
 		m_pBQ2->enqueue(pBuf, bufLen);
 		pump2();
 	}
+	else if(m_pLZ)
+	{
+		m_pLZ->enqueue((const unsigned char*)pBuf, bufLen);
+		pump3();
+	}
 	else
 	{
 		m_pBQ1->enqueue(pBuf, bufLen);
 		pump1();
 		if(m_pBQ2)
 			pump2();
+		else if(m_pLZ)
+			pump3();
 	}
 }
 
@@ -26,6 +26,7 @@
 namespace GClasses {
 
 class GBlobQueue;
+class GLZUncompressor;
 
 /// This class contains a list of files and a list of folders.
 /// The constructor populates these lists with the names of files and folders in
@@ -59,12 +60,22 @@ protected:
 	unsigned int m_compressedSize;
 	bool m_compressedBufReady;
 	size_t m_bytesOut;
+	bool m_fast;
+	size_t m_workerThreads;
 
 public:
-	/// szPath can be a filename or a foldername
-	GFolderSerializer(const char* szPath, bool compress);
+	/// szPath can be a filename or a foldername. If compress is true and fast is false,
+	/// the stream is compressed with GCompressor, which is slow, but produces small output.
+	/// If compress and fast are both true, it is compressed with GLZCompressor, which is
+	/// much faster, and can use several threads.
+	GFolderSerializer(const char* szPath, bool compress, bool fast = false);
 	~GFolderSerializer();
 
+	/// Specifies the number of threads to use for fast compression. Each thread
+	/// compresses a separate block of GLZ_BLOCK_SIZE bytes. (The default is 1.)
+	/// This may be changed between calls to next.
+	void setWorkerThreads(size_t n);
+
 	/// Returns a pointer to the next chunk of bytes. Returns NULL
 	/// if it is done.
 	char* next(size_t* pOutSize);
@@ -72,8 +83,14 @@ public:
 	/// Returns the number of bytes that have been sent out so far
 	size_t bytesOut() { return m_bytesOut; }
 
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // !NO_TEST_CODE
+
 protected:
 	char* nextPiece(size_t* pOutSize);
+	char* nextFast(size_t* pOutSize);
 	void addName(const char* szName);
 	void startFile(const char* szFilename);
 	void continueFile();
@@ -87,6 +104,7 @@ class GFolderDeserializer
 protected:
 	GBlobQueue* m_pBQ1;
 	GBlobQueue* m_pBQ2;
+	GLZUncompressor* m_pLZ;
 	size_t m_compressedBlockSize;
 	size_t m_state;
 	unsigned int m_nameLen;
@@ -104,6 +122,7 @@ public:
 protected:
 	void pump1();
 	void pump2();
+	void pump3();
 };
 
 
@@ -40,6 +40,9 @@
 #include <sstream>
 #include <iostream>
 #include <memory>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 using namespace GClasses;
 using std::vector;
@@ -57,6 +60,7 @@ GDynamicPageSession::GDynamicPageSession(GDynamicPageServer* pServer, unsigned l
 	m_pServer = pServer;
 	onAccess();
 	m_pExtension = NULL;
+	m_requests = 0;
 }
 
 // virtual
@@ -148,9 +152,15 @@ void GDynamicPageConnection::doGet(ostream& response)
 {
 	// Set up the session
 	GDynamicPageSession* pSession = establishSession();
-	pSession->setCurrentUrl(m_szUrl, m_pContent, m_nContentLength);
 
 	// Handle the request
+	respond(pSession, response);
+}
+
+void GDynamicPageConnection::respond(GDynamicPageSession* pSession, ostream& response)
+{
+	std::lock_guard<std::mutex> lockHolder(pSession->lock());
+	pSession->setCurrentUrl(m_szUrl, m_pContent, m_nContentLength);
 	setContentType("text/html");
 	handleRequest(pSession, response);
 }
@@ -242,10 +252,49 @@ const char* GDynamicPageConnection::extensionToMimeType(const char* szFilename)
 }
 
 
+// ------------------------------------------------------
+
+namespace GClasses {
+
+/// A request that has been dispatched to a worker thread
+class GDynamicPageRequest
+{
+public:
+	GDynamicPageConnection* m_pConn;
+	GDynamicPageSession* m_pSession;
+	string m_payload;
+	string m_error;
+
+	GDynamicPageRequest(GDynamicPageConnection* pConn, GDynamicPageSession* pSession)
+	: m_pConn(pConn), m_pSession(pSession)
+	{
+	}
+};
+
+/// The requests and responses that are passed between the thread that calls
+/// GDynamicPageServer::process and the worker threads
+class GDynamicPageQueue
+{
+public:
+	std::mutex m_mutex; // protects all of the other members
+	std::condition_variable m_wakeWorkers; // notified when a request is queued, or the workers should stop
+	std::condition_variable m_workerStopped; // notified when a worker thread exits
+	std::deque<GDynamicPageRequest*> m_pending; // requests waiting for a worker thread
+	std::deque<GDynamicPageRequest*> m_done; // requests whose responses are ready to be sent
+	size_t m_runningWorkers;
+	bool m_stop;
+
+	GDynamicPageQueue() : m_runningWorkers(0), m_stop(false)
+	{
+	}
+};
+
+} // namespace GClasses
+
 // ------------------------------------------------------
 
 GDynamicPageServer::GDynamicPageServer(int port, GRand* pRand)
-: GHttpServer(port), m_pRand(pRand)
+: GHttpServer(port), m_pRand(pRand), m_workerThreads(1), m_pQueue(NULL), m_inFlight(0)
 {
 	m_bKeepGoing = true;
 
@@ -286,15 +335,157 @@ GDynamicPageServer::GDynamicPageServer(int port, GRand* pRand)
 
 GDynamicPageServer::~GDynamicPageServer()
 {
+	stopWorkers();
 	flushSessions();
 	delete[] m_szMyAddress;
 }
 
+void GDynamicPageServer::setWorkerThreads(size_t count)
+{
+	if(m_pQueue)
+		throw Ex("The number of worker threads cannot be changed after they have been started");
+	m_workerThreads = count;
+}
+
+// virtual
+void GDynamicPageServer::onRequest(GHttpConnection* pConn)
+{
+	if(m_workerThreads < 2)
+	{
+		GHttpServer::onRequest(pConn);
+		return;
+	}
+
+	// Start the workers
+	if(!m_pQueue)
+	{
+		m_pQueue = new GDynamicPageQueue();
+		m_pQueue->m_runningWorkers = m_workerThreads;
+		for(size_t i = 0; i < m_workerThreads; i++)
+			GThread::spawnThread(workerMain, this);
+	}
+
+	// The session is established on this thread because the session table and prng are not thread-safe.
+	// The session is pinned until the response is sent, so flushSessions will not delete it while a worker uses it.
+	GDynamicPageConnection* pDPConn = (GDynamicPageConnection*)pConn;
+	GDynamicPageRequest* pRequest = new GDynamicPageRequest(pDPConn, pDPConn->establishSession());
+	pRequest->m_pSession->m_requests++;
+	pConn->m_bBusy = true;
+	m_inFlight++;
+	{
+		std::lock_guard<std::mutex> lock(m_pQueue->m_mutex);
+		m_pQueue->m_pending.push_back(pRequest);
+	}
+	m_pQueue->m_wakeWorkers.notify_one();
+}
+
+// static
+unsigned int GDynamicPageServer::workerMain(void* pThis)
+{
+	GDynamicPageQueue* pQueue = ((GDynamicPageServer*)pThis)->m_pQueue;
+	while(true)
+	{
+		// Wait for the next request
+		GDynamicPageRequest* pRequest;
+		{
+			std::unique_lock<std::mutex> lock(pQueue->m_mutex);
+			while(pQueue->m_pending.size() == 0 && !pQueue->m_stop)
+				pQueue->m_wakeWorkers.wait(lock);
+			if(pQueue->m_pending.size() == 0)
+			{
+				pQueue->m_runningWorkers--;
+				pQueue->m_workerStopped.notify_all();
+				return 0;
+			}
+			pRequest = pQueue->m_pending.front();
+			pQueue->m_pending.pop_front();
+		}
+
+		// Handle it
+		ostringstream os;
+		try
+		{
+			pRequest->m_pConn->respond(pRequest->m_pSession, os);
+			pRequest->m_payload = os.str();
+		}
+		catch(const std::exception& e)
+		{
+			pRequest->m_error = e.what();
+			pRequest->m_payload = pRequest->m_error;
+		}
+
+		// Hand the response back to the thread that calls process
+		std::lock_guard<std::mutex> lock(pQueue->m_mutex);
+		pQueue->m_done.push_back(pRequest);
+	}
+}
+
+bool GDynamicPageServer::completeResponses()
+{
+	bool bDidSomething = false;
+	while(m_inFlight > 0)
+	{
+		GDynamicPageRequest* pRequest;
+		{
+			std::lock_guard<std::mutex> lock(m_pQueue->m_mutex);
+			if(m_pQueue->m_done.size() == 0)
+				break;
+			pRequest = m_pQueue->m_done.front();
+			m_pQueue->m_done.pop_front();
+		}
+		std::unique_ptr<GDynamicPageRequest> hRequest(pRequest);
+		m_inFlight--;
+		pRequest->m_pSession->m_requests--;
+		bDidSomething = true;
+		completeRequest(pRequest->m_pConn, pRequest->m_payload);
+		if(pRequest->m_error.length() > 0)
+			throw Ex(pRequest->m_error);
+	}
+	return bDidSomething;
+}
+
+void GDynamicPageServer::stopWorkers()
+{
+	if(!m_pQueue)
+		return;
+	{
+		// The workers finish all of the pending requests before they stop
+		std::unique_lock<std::mutex> lock(m_pQueue->m_mutex);
+		m_pQueue->m_stop = true;
+		m_pQueue->m_wakeWorkers.notify_all();
+		while(m_pQueue->m_runningWorkers > 0)
+			m_pQueue->m_workerStopped.wait(lock);
+	}
+
+	// Send the responses, so none of the clients are left waiting. (The errors thrown
+	// by request handlers have already been sent as responses, so they are not rethrown here.)
+	while(m_inFlight > 0)
+	{
+		try
+		{
+			if(!completeResponses())
+				break;
+		}
+		catch(const std::exception&)
+		{
+		}
+	}
+	delete(m_pQueue);
+	m_pQueue = NULL;
+}
+
 void GDynamicPageServer::flushSessions()
 {
-	for(map<unsigned long long, GDynamicPageSession*>::iterator it = m_sessions.begin(); it != m_sessions.end(); it++)
-		delete(it->second);
-	m_sessions.clear();
+	for(map<unsigned long long, GDynamicPageSession*>::iterator it = m_sessions.begin(); it != m_sessions.end(); )
+	{
+		if(it->second->isBusy())
+			it++;
+		else
+		{
+			delete(it->second);
+			m_sessions.erase(it++);
+		}
+	}
 }
 
 GDynamicPageSession* GDynamicPageServer::makeNewSession(unsigned long long id)
@@ -329,17 +520,23 @@ void GDynamicPageServer::go()
 	GSignalHandler sh;
 	while(m_bKeepGoing && sh.check() == 0)
 	{
-		if(!process())
+		bool bDidSomething = process();
+		if(completeResponses())
+			bDidSomething = true;
+		if(!bDidSomething)
 		{
-			if(GTime::seconds() - dLastMaintenance > 14400)	// 4 hours
+			if(m_inFlight > 0)
+				socket()->waitForActivity(1); // check back soon for responses from the workers
+			else if(GTime::seconds() - dLastMaintenance > 14400)	// 4 hours
 			{
 				doMaintenance();
 				dLastMaintenance = GTime::seconds();
 			}
 			else
-				GThread::sleep(100);
+				socket()->waitForActivity(100); // wakes up as soon as a request arrives
 		}
 	}
+	stopWorkers();
 	onShutDown();
 }
 
@@ -408,3 +605,136 @@ void GDynamicPageServer::redirect(std::ostream& response, const char* szUrl)
 	r << "\">here</a>\n";
 }
 
+#ifndef NO_TEST_CODE
+class GDynamicPageServer_testConnection : public GDynamicPageConnection
+{
+public:
+	GDynamicPageServer_testConnection(SOCKET sock, GDynamicPageServer* pServer) : GDynamicPageConnection(sock, pServer)
+	{
+	}
+
+protected:
+	virtual void handleRequest(GDynamicPageSession* pSession, std::ostream& response)
+	{
+		if(strcmp(pSession->url(), "/slow") == 0)
+			GThread::sleep(300);
+		response << "You asked for " << pSession->url();
+	}
+};
+
+class GDynamicPageServer_testServer : public GDynamicPageServer
+{
+public:
+	GDynamicPageServer_testServer(int port, GRand* pRand) : GDynamicPageServer(port, pRand)
+	{
+	}
+
+	virtual GHttpConnection* makeConnection(SOCKET s)
+	{
+		return new GDynamicPageServer_testConnection(s, this);
+	}
+};
+
+// Returns the payloads of all the responses that have fully arrived in s
+void GDynamicPageServer_testParse(const string& s, vector<string>& payloads)
+{
+	payloads.clear();
+	size_t pos = 0;
+	while(true)
+	{
+		size_t headerEnd = s.find("\r\n\r\n", pos);
+		size_t lenPos = s.find("Content-Length: ", pos);
+		if(headerEnd == string::npos || lenPos == string::npos)
+			return;
+		size_t len = (size_t)atoi(s.c_str() + lenPos + 16);
+		if(s.length() < headerEnd + 4 + len)
+			return;
+		payloads.push_back(s.substr(headerEnd + 4, len));
+		pos = headerEnd + 4 + len;
+	}
+}
+
+// static
+void GDynamicPageServer::test()
+{
+	GRand rand(0);
+	GDynamicPageServer_testServer server(7253, &rand);
+	server.setWorkerThreads(4);
+	GTCPClient slowClient;
+	GTCPClient fastClient;
+	slowClient.connect("localhost", 7253, 5);
+	fastClient.connect("localhost", 7253, 5);
+
+	// The fast client pipelines two requests, which should be answered in order
+	const char* szSlow = "GET /slow HTTP/1.1\r\n\r\n";
+	const char* szFast = "GET /fast1 HTTP/1.1\r\n\r\nGET /fast2 HTTP/1.1\r\n\r\n";
+	slowClient.send(szSlow, strlen(szSlow));
+	fastClient.send(szFast, strlen(szFast));
+	string slowIn;
+	string fastIn;
+	vector<string> slowPayloads;
+	vector<string> fastPayloads;
+	char buf[1024];
+	bool fastFirst = false;
+	double timeout = GTime::seconds() + 10.0;
+	while(slowPayloads.size() < 1)
+	{
+		if(GTime::seconds() > timeout)
+			throw Ex("timed out");
+		server.process();
+		server.completeResponses();
+		size_t n = slowClient.receive(buf, sizeof(buf));
+		slowIn.append(buf, n);
+		GDynamicPageServer_testParse(slowIn, slowPayloads);
+		n = fastClient.receive(buf, sizeof(buf));
+		fastIn.append(buf, n);
+		GDynamicPageServer_testParse(fastIn, fastPayloads);
+		if(fastPayloads.size() == 2 && slowPayloads.size() == 0)
+			fastFirst = true;
+		if(slowPayloads.size() == 0)
+			GThread::sleep(1);
+	}
+	if(!fastFirst || fastPayloads.size() != 2)
+		throw Ex("The slow request blocked the fast ones");
+	if(fastPayloads[0].compare("You asked for /fast1") != 0 || fastPayloads[1].compare("You asked for /fast2") != 0)
+		throw Ex("wrong response");
+	if(slowPayloads[0].compare("You asked for /slow") != 0)
+		throw Ex("wrong response");
+
+	// A session must not be deleted while a worker is handling a request in it
+	slowClient.send(szSlow, strlen(szSlow));
+	timeout = GTime::seconds() + 10.0;
+	while(server.m_inFlight == 0)
+	{
+		if(GTime::seconds() > timeout)
+			throw Ex("timed out");
+		server.process();
+		GThread::sleep(1);
+	}
+	server.flushSessions();
+	if(server.m_sessions.size() != 1)
+		throw Ex("Deleted a session that was in use");
+
+	// Stopping the workers should still send the responses they computed
+	server.stopWorkers();
+	if(server.m_inFlight != 0)
+		throw Ex("Some requests were not completed");
+	slowIn.clear();
+	slowPayloads.clear();
+	while(slowPayloads.size() < 1)
+	{
+		if(GTime::seconds() > timeout)
+			throw Ex("The response was dropped when the workers stopped");
+		size_t n = slowClient.receive(buf, sizeof(buf));
+		slowIn.append(buf, n);
+		GDynamicPageServer_testParse(slowIn, slowPayloads);
+		if(slowPayloads.size() == 0)
+			GThread::sleep(1);
+	}
+	if(slowPayloads[0].compare("You asked for /slow") != 0)
+		throw Ex("wrong response");
+	server.flushSessions();
+	if(server.m_sessions.size() != 0)
+		throw Ex("Sessions were not flushed");
+}
+#endif // !NO_TEST_CODE
@@ -24,12 +24,15 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <mutex>
 
 namespace GClasses {
 
 class GConstStringHashTable;
 class GDynamicPageServer;
 class GDynamicPageSession;
+class GDynamicPageRequest;
+class GDynamicPageQueue;
 class GRand;
 class GDom;
 
@@ -54,6 +57,7 @@ public:
 
 class GDynamicPageSession
 {
+friend class GDynamicPageServer;
 protected:
 	GDynamicPageServer* m_pServer;
 	unsigned long long m_id;
@@ -62,11 +66,23 @@ protected:
 	const char* m_szUrl;
 	const char* m_szParams;
 	size_t m_paramsLen;
+	std::mutex m_lock;
+	size_t m_requests; // the number of requests in this session that worker threads have not finished with
 
 public:
 	GDynamicPageSession(GDynamicPageServer* pServer, unsigned long long id);
 	virtual ~GDynamicPageSession();
 
+	/// Returns the lock that is held while a request in this session is being handled.
+	/// (When the server uses worker threads, this ensures that requests from the same
+	/// session are handled one at a time, while requests from different sessions are
+	/// handled in parallel. Requests that wait for it sleep instead of spinning.)
+	std::mutex& lock() { return m_lock; }
+
+	/// Returns true if a worker thread may still be handling a request in this session.
+	/// (GDynamicPageServer::flushSessions does not delete such sessions.)
+	bool isBusy() { return m_requests > 0; }
+
 	/// Returns the server object associated with this session
 	GDynamicPageServer* server() { return m_pServer; }
 
@@ -104,6 +120,7 @@ public:
 
 class GDynamicPageConnection : public GHttpConnection
 {
+friend class GDynamicPageServer;
 protected:
 	GDynamicPageServer* m_pServer;
 
@@ -114,9 +131,15 @@ public:
 	virtual void doGet(std::ostream& response);
 	virtual void doPost(std::ostream& response);
 protected:
-	/// This method is called by doGet or doPost when a client requests something from the server
+	/// This method is called by doGet or doPost when a client requests something from the server.
+	/// If the server has worker threads, this is called on a worker thread while the session's
+	/// lock is held, so it should not modify state that is shared across sessions without
+	/// taking a lock.
 	virtual void handleRequest(GDynamicPageSession* pSession, std::ostream& response) = 0;
 
+	/// Locks the session, sets its current URL, and calls handleRequest.
+	void respond(GDynamicPageSession* pSession, std::ostream& response);
+
 	virtual bool hasBeenModifiedSince(const char* szUrl, const char* szDate);
 	virtual void setHeaders(const char* szUrl, const char* szParams);
 	GDynamicPageSession* establishSession();
@@ -143,6 +166,9 @@ protected:
 	char* m_szMyAddress;
 	char m_daemonSalt[16];
 	char m_passwordSalt[16];
+	size_t m_workerThreads;
+	GDynamicPageQueue* m_pQueue; // passes requests to the worker threads and responses back. (NULL until the workers are started.)
+	size_t m_inFlight; // the number of requests that have been dispatched, but not yet completed
 
 public:
 	GDynamicPageServer(int port, GRand* pRand);
@@ -153,7 +179,29 @@ public:
 	virtual void onShutDown() {}
 	void go();
 	void shutDown();
+
+	/// Deletes all sessions, except any that have a request that is still being handled
+	/// by a worker thread. (Those are kept until a later call.)
 	void flushSessions();
+
+	/// Specifies the number of worker threads that handle requests. If count is 0 or 1 (the default),
+	/// each request is handled on the thread that calls process, so one slow request blocks all the
+	/// others. If count is 2 or more, requests are parsed on the thread that calls process, handled
+	/// by a pool of count worker threads (each holding the lock of the request's session), and the
+	/// responses are sent by completeResponses back on the thread that calls process. (go calls both.)
+	/// This must be called before any requests are received. Note that when worker threads are used,
+	/// GDynamicPageConnection::doGet and doPost are bypassed in favor of handleRequest.
+	void setWorkerThreads(size_t count);
+
+	/// Sends the responses that worker threads have finished computing. Returns true if any
+	/// responses were sent. If a worker thread threw an exception while handling a request,
+	/// this sends the error message as the response, and then rethrows the exception.
+	bool completeResponses();
+
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // !NO_TEST_CODE
 	
 	/// Returns the session with the specified id. If no session is found with that id, returns NULL.
 	GDynamicPageSession* findSession(unsigned long long id);
@@ -176,6 +224,16 @@ public:
 protected:
 	void doMaintenance();
 	void computePasswordSalt();
+
+	/// Dispatches the request to a worker thread if there are any. Otherwise, handles it immediately.
+	virtual void onRequest(GHttpConnection* pConn);
+
+	/// Waits for the worker threads to finish any queued requests, stops them, and then
+	/// sends all of the responses they computed.
+	void stopWorkers();
+
+	/// This is the main loop of each worker thread.
+	static unsigned int workerMain(void* pThis);
 };
 
 } // namespace GClasses
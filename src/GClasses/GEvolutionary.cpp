@@ -22,6 +22,7 @@
 #include "GRand.h"
 #include "GVec.h"
 #include <math.h>
+#include <algorithm>
 
 using namespace GClasses;
 
@@ -60,7 +61,7 @@ public:
 }
 
 GEvolutionaryOptimizer::GEvolutionaryOptimizer(GTargetFunction* pCritic, size_t nPopulation, GRand* pRand, double moreFitSurvivalRate)
-: GOptimizer(pCritic), m_pRand(pRand)
+: GOptimizer(pCritic), m_pRand(pRand), m_populationEvaluated(false)
 {
 	GAssert(nPopulation >= 2); // can't have a tournament without two members of the population
 
@@ -75,11 +76,6 @@ GEvolutionaryOptimizer::GEvolutionaryOptimizer(GTargetFunction* pCritic, size_t
 		GEvolutionaryOptimizerNode* pNode = new GEvolutionaryOptimizerNode(dims);
 		GVec& pVec = pNode->GetVector();
 		m_pCritic->initVector(pVec);
-		if(m_pCritic->isStable())
-		{
-			double error = pCritic->computeError(pVec);
-			pNode->SetError(error);
-		}
 		m_population.push_back(pNode);
 	}
 
@@ -125,7 +121,11 @@ size_t GEvolutionaryOptimizer::doTournament()
 
 void GEvolutionaryOptimizer::recomputeError(size_t index, GEvolutionaryOptimizerNode* pNode, const GVec& pVec)
 {
-	double err = m_pCritic->computeError(pVec);
+	setError(index, pNode, m_pCritic->computeError(pVec));
+}
+
+void GEvolutionaryOptimizer::setError(size_t index, GEvolutionaryOptimizerNode* pNode, double err)
+{
 	pNode->SetError(err);
 	if(err < m_bestErr)
 	{
@@ -134,11 +134,58 @@ void GEvolutionaryOptimizer::recomputeError(size_t index, GEvolutionaryOptimizer
 	}
 }
 
+void GEvolutionaryOptimizer::evaluatePopulation()
+{
+	m_populationEvaluated = true;
+	if(!m_pCritic->isStable())
+		return;
+	std::vector<const GVec*> candidates;
+	for(size_t i = 0; i < m_population.size(); i++)
+		candidates.push_back(&node(i)->GetVector());
+	GVec errors;
+	computeErrors(candidates, errors);
+	for(size_t i = 0; i < m_population.size(); i++)
+		node(i)->SetError(errors[i]);
+}
+
 // virtual
 double GEvolutionaryOptimizer::iterate()
+{
+	if(!m_populationEvaluated)
+		evaluatePopulation();
+
+	// Replace some members of the population with children. (If the critic is not stable,
+	// the errors are computed in the tournaments instead, so only one child is made.)
+	size_t children = 1;
+	if(m_pCritic->isStable())
+		children = std::max((size_t)1, std::min(m_workerThreads, m_population.size() / 2));
+	std::vector<size_t> targets;
+	for(size_t i = 0; i < children; i++)
+	{
+		size_t target = doTournament();
+		if(std::find(targets.begin(), targets.end(), target) != targets.end())
+			continue; // This member was already replaced in this iteration
+		makeChild(target);
+		targets.push_back(target);
+	}
+
+	// Evaluate the children at the same time
+	if(m_pCritic->isStable())
+	{
+		std::vector<const GVec*> candidates;
+		for(size_t i = 0; i < targets.size(); i++)
+			candidates.push_back(&node(targets[i])->GetVector());
+		GVec errors;
+		computeErrors(candidates, errors);
+		for(size_t i = 0; i < targets.size(); i++)
+			setError(targets[i], node(targets[i]), errors[i]);
+	}
+	return m_bestErr;
+}
+
+void GEvolutionaryOptimizer::makeChild(size_t target)
 {
 	size_t dims = m_pCritic->relation()->size();
-	size_t target = doTournament();
 	GEvolutionaryOptimizerNode* pNode = node(target);
 	size_t popSize = m_population.size();
 	GVec& pVec = pNode->GetVector();
@@ -216,9 +263,6 @@ double GEvolutionaryOptimizer::iterate()
 			}
 			break;
 	}
-	if(m_pCritic->isStable())
-		recomputeError(target, pNode, pVec);
-	return m_bestErr;
 }
 
 // virtual
@@ -226,3 +270,62 @@ const GVec& GEvolutionaryOptimizer::currentVector()
 {
 	return (node(m_bestIndex))->GetVector();
 }
+
+#ifndef MIN_PREDICT
+namespace GClasses {
+/// A target function that is not thread-safe, but can be cloned. It throws
+/// if two threads use the same instance at the same time.
+class GEvolutionaryOptimizerTestTarget : public GOptimizerBasicTestTargetFunction
+{
+protected:
+	volatile bool m_busy;
+	size_t* m_pCloneCount;
+
+public:
+	GEvolutionaryOptimizerTestTarget(size_t* pCloneCount)
+	: GOptimizerBasicTestTargetFunction(), m_busy(false), m_pCloneCount(pCloneCount)
+	{
+	}
+
+	virtual double computeError(const GVec& vector)
+	{
+		if(m_busy)
+			throw Ex("This target function was used by two threads at once");
+		m_busy = true;
+		double err = GOptimizerBasicTestTargetFunction::computeError(vector);
+		m_busy = false;
+		return err;
+	}
+
+	virtual bool isThreadSafe() { return false; }
+
+	virtual GTargetFunction* clone()
+	{
+		(*m_pCloneCount)++;
+		return new GEvolutionaryOptimizerTestTarget(m_pCloneCount);
+	}
+};
+} // namespace GClasses
+
+// static
+void GEvolutionaryOptimizer::test()
+{
+	// Each iteration with 4 threads makes 4 children, so it should need fewer
+	// iterations. (The clones must not be used by two threads at once.)
+	for(size_t threads = 1; threads <= 4; threads += 3)
+	{
+		GRand rand(0);
+		size_t clones = 0;
+		GEvolutionaryOptimizerTestTarget target(&clones);
+		GEvolutionaryOptimizer opt(&target, 50, &rand, 0.95);
+		opt.setWorkerThreads(threads);
+		double err = 0.0;
+		for(size_t i = 0; i < (threads == 1 ? 20000 : 2500); i++)
+			err = opt.iterate();
+		if(err > (threads == 1 ? 0.01 : 0.05))
+			throw Ex("Optimizer accuracy has regressed. Got ", to_str(err));
+		if(clones != threads - 1)
+			throw Ex("Expected ", to_str(threads - 1), " clones of the target function. Got ", to_str(clones));
+	}
+}
+#endif // MIN_PREDICT
@@ -37,6 +37,7 @@ protected:
 	std::vector<GEvolutionaryOptimizerNode*> m_population;
 	double m_bestErr;
 	size_t m_bestIndex;
+	bool m_populationEvaluated;
 
 public:
 	/// moreFitSurvivalRate is the probability that the more fit member (in a tournament selection) survives
@@ -47,15 +48,32 @@ public:
 	virtual const GVec& currentVector();
 
 	/// Do a little bit more optimization. (This method is typically called in a loop
-	/// until satisfactory results are obtained.)
+	/// until satisfactory results are obtained.) Each call replaces one member of
+	/// the population, or workerThreads() members if the critic is stable, whose
+	/// errors are computed at the same time. (The first call also computes the errors
+	/// of the initial population.)
 	virtual double iterate();
 
+#ifndef MIN_PREDICT
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // MIN_PREDICT
+
 protected:
 	/// Returns the index of the tournament loser (who should typically die and be replaced).
 	size_t doTournament();
 
 	void recomputeError(size_t index, GEvolutionaryOptimizerNode* pNode, const GVec& vec);
 
+	/// Records the error of a member of the population
+	void setError(size_t index, GEvolutionaryOptimizerNode* pNode, double err);
+
+	/// Replaces the vector of the specified member with a child of other members
+	void makeChild(size_t target);
+
+	/// Computes the errors of the whole population at the same time
+	void evaluatePopulation();
+
 	GEvolutionaryOptimizerNode* node(size_t index);
 };
 
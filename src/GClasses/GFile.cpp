@@ -23,6 +23,9 @@
 #include "GString.h"
 #include "GApp.h"
 #include "GBitTable.h"
+#include "GBlob.h"
+#include "GThread.h"
+#include "GRand.h"
 #ifdef WINDOWS
 #	include <windows.h>
 #	include <shlobj.h> // to get users' application data dir
@@ -964,3 +967,473 @@ void GCompressor::test()
 		throw Ex("not the same");
 }
 #endif
+
+
+
+#define GLZ_MIN_MATCH 4
+#define GLZ_WINDOW 65536
+#define GLZ_HASH_BITS 16
+#define GLZ_MAX_CHAIN 32
+#define GLZ_MAX_BLOCK_SIZE ((uint64_t)1 << 28)
+#define GLZ_NO_POS 0xffffffff
+
+inline uint32_t GLZ_read32(const unsigned char* p)
+{
+	uint32_t n;
+	memcpy(&n, p, sizeof(uint32_t));
+	return n;
+}
+
+inline uint32_t GLZ_hash(const unsigned char* p)
+{
+	return (GLZ_read32(p) * 2654435761u) >> (32 - GLZ_HASH_BITS);
+}
+
+inline unsigned char* GLZ_writeLength(unsigned char* pOut, size_t n)
+{
+	while(n >= 255)
+	{
+		*(pOut++) = 255;
+		n -= 255;
+	}
+	*(pOut++) = (unsigned char)n;
+	return pOut;
+}
+
+// static
+size_t GLZCompressor::encode(const unsigned char* pIn, size_t len, unsigned char* pOut)
+{
+	// Each sequence is a token byte (with the literal count in the high nibble and the match
+	// length in the low nibble), the extended literal count, the literals, a 2-byte offset,
+	// and the extended match length. The last sequence stops after its literals.
+	unsigned char* pStart = pOut;
+	size_t anchor = 0;
+	size_t pos = 0;
+	std::vector<uint32_t> head;
+	std::vector<uint32_t> chain;
+	if(len >= 4 * GLZ_MIN_MATCH) // (Tiny blocks are not worth the cost of the tables)
+	{
+		head.resize((size_t)1 << GLZ_HASH_BITS, GLZ_NO_POS);
+		chain.resize(GLZ_WINDOW, GLZ_NO_POS);
+	}
+	else
+		pos = len;
+	while(pos + GLZ_MIN_MATCH <= len)
+	{
+		// Find the longest match in the window
+		uint32_t h = GLZ_hash(pIn + pos);
+		uint32_t cand = head[h];
+		size_t bestLen = 0;
+		size_t bestOffset = 0;
+		for(size_t tries = 0; tries < GLZ_MAX_CHAIN && cand != GLZ_NO_POS && pos - cand < GLZ_WINDOW; tries++)
+		{
+			if(GLZ_read32(pIn + cand) == GLZ_read32(pIn + pos))
+			{
+				size_t n = GLZ_MIN_MATCH;
+				while(pos + n < len && pIn[cand + n] == pIn[pos + n])
+					n++;
+				if(n > bestLen)
+				{
+					bestLen = n;
+					bestOffset = pos - cand;
+				}
+			}
+			uint32_t prev = chain[cand & (GLZ_WINDOW - 1)];
+			if(prev == GLZ_NO_POS || prev >= cand)
+				break;
+			cand = prev;
+		}
+		chain[pos & (GLZ_WINDOW - 1)] = head[h];
+		head[h] = (uint32_t)pos;
+		if(bestLen < GLZ_MIN_MATCH)
+		{
+			pos++;
+			continue;
+		}
+
+		// Emit the literals and the match
+		size_t litLen = pos - anchor;
+		size_t matchLen = bestLen - GLZ_MIN_MATCH;
+		unsigned char* pToken = pOut++;
+		*pToken = (unsigned char)((std::min(litLen, (size_t)15) << 4) | std::min(matchLen, (size_t)15));
+		if(litLen >= 15)
+			pOut = GLZ_writeLength(pOut, litLen - 15);
+		memcpy(pOut, pIn + anchor, litLen);
+		pOut += litLen;
+		*(pOut++) = (unsigned char)(bestOffset & 0xff);
+		*(pOut++) = (unsigned char)(bestOffset >> 8);
+		if(matchLen >= 15)
+			pOut = GLZ_writeLength(pOut, matchLen - 15);
+
+		// Index the positions inside the match
+		size_t end = pos + bestLen;
+		for(pos++; pos < end && pos + GLZ_MIN_MATCH <= len; pos++)
+		{
+			h = GLZ_hash(pIn + pos);
+			chain[pos & (GLZ_WINDOW - 1)] = head[h];
+			head[h] = (uint32_t)pos;
+		}
+		pos = end;
+		anchor = end;
+	}
+
+	// Emit the trailing literals
+	size_t litLen = len - anchor;
+	*(pOut++) = (unsigned char)(std::min(litLen, (size_t)15) << 4);
+	if(litLen >= 15)
+		pOut = GLZ_writeLength(pOut, litLen - 15);
+	memcpy(pOut, pIn + anchor, litLen);
+	pOut += litLen;
+	return pOut - pStart;
+}
+
+// static
+size_t GLZCompressor::compressBlock(const unsigned char* pIn, size_t len, unsigned char* pOut)
+{
+	uint64_t uncompressedLen = len;
+	uint64_t compressedLen = encode(pIn, len, pOut + GLZ_HEADER_SIZE);
+	if(compressedLen >= uncompressedLen)
+	{
+		// Store it uncompressed
+		memcpy(pOut + GLZ_HEADER_SIZE, pIn, len);
+		compressedLen = uncompressedLen;
+	}
+	memcpy(pOut, &uncompressedLen, sizeof(uint64_t));
+	memcpy(pOut + sizeof(uint64_t), &compressedLen, sizeof(uint64_t));
+	return GLZ_HEADER_SIZE + (size_t)compressedLen;
+}
+
+inline size_t GLZ_readLength(const unsigned char*& pIn, const unsigned char* pEnd)
+{
+	size_t n = 0;
+	while(true)
+	{
+		if(pIn >= pEnd)
+			throw Ex("invalid data");
+		unsigned char b = *(pIn++);
+		n += b;
+		if(b != 255)
+			return n;
+	}
+}
+
+// static
+void GLZCompressor::uncompressBlock(const unsigned char* pIn, size_t len, unsigned char* pOut, size_t outLen)
+{
+	if(len == outLen)
+	{
+		memcpy(pOut, pIn, len);
+		return;
+	}
+	const unsigned char* pEnd = pIn + len;
+	unsigned char* pOutStart = pOut;
+	unsigned char* pOutEnd = pOut + outLen;
+	while(true)
+	{
+		if(pIn >= pEnd)
+			throw Ex("invalid data");
+		unsigned char token = *(pIn++);
+
+		// Copy the literals
+		size_t litLen = token >> 4;
+		if(litLen == 15)
+			litLen += GLZ_readLength(pIn, pEnd);
+		if(litLen > (size_t)(pEnd - pIn) || litLen > (size_t)(pOutEnd - pOut))
+			throw Ex("invalid data");
+		memcpy(pOut, pIn, litLen);
+		pIn += litLen;
+		pOut += litLen;
+		if(pIn == pEnd)
+			break;
+
+		// Copy the match
+		if(pEnd - pIn < 2)
+			throw Ex("invalid data");
+		size_t offset = (size_t)pIn[0] | ((size_t)pIn[1] << 8);
+		pIn += 2;
+		size_t matchLen = token & 15;
+		if(matchLen == 15)
+			matchLen += GLZ_readLength(pIn, pEnd);
+		matchLen += GLZ_MIN_MATCH;
+		if(offset == 0 || offset > (size_t)(pOut - pOutStart) || matchLen > (size_t)(pOutEnd - pOut))
+			throw Ex("invalid data");
+		const unsigned char* pMatch = pOut - offset;
+		if(offset >= matchLen)
+			memcpy(pOut, pMatch, matchLen);
+		else
+		{
+			for(size_t i = 0; i < matchLen; i++)
+				pOut[i] = pMatch[i];
+		}
+		pOut += matchLen;
+	}
+	if(pOut != pOutEnd)
+		throw Ex("invalid data");
+}
+
+class GLZCompressorWorker : public GWorkerThread
+{
+protected:
+	const unsigned char* m_pIn;
+	uint64_t m_len;
+	size_t m_blockSize;
+	std::vector<std::vector<unsigned char> >& m_blocks;
+
+public:
+	GLZCompressorWorker(GMasterThread& master, const unsigned char* pIn, uint64_t len, size_t blockSize, std::vector<std::vector<unsigned char> >& blocks)
+	: GWorkerThread(master), m_pIn(pIn), m_len(len), m_blockSize(blockSize), m_blocks(blocks)
+	{
+	}
+
+	virtual ~GLZCompressorWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		uint64_t start = (uint64_t)jobId * m_blockSize;
+		size_t n = (size_t)std::min((uint64_t)m_blockSize, m_len - start);
+		std::vector<unsigned char>& block = m_blocks[jobId];
+		block.resize(GLZ_HEADER_SIZE + GLZCompressor::maxCompressedSize(n));
+		block.resize(GLZCompressor::compressBlock(m_pIn + start, n, block.data()));
+	}
+};
+
+// static
+unsigned char* GLZCompressor::compress(const unsigned char* pIn, uint64_t len, uint64_t* pOutNewLen, size_t workerThreads, size_t blockSize)
+{
+	if(blockSize < 1 || blockSize > GLZ_MAX_BLOCK_SIZE)
+		throw Ex("blockSize out of range");
+	size_t blockCount = (size_t)((len + blockSize - 1) / blockSize);
+	std::vector<std::vector<unsigned char> > blocks(blockCount);
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < std::max((size_t)1, std::min(workerThreads, blockCount)); i++)
+			master.addWorker(new GLZCompressorWorker(master, pIn, len, blockSize, blocks));
+		master.doJobs(blockCount);
+	}
+	uint64_t newLen = 0;
+	for(size_t i = 0; i < blockCount; i++)
+		newLen += blocks[i].size();
+	unsigned char* pOut = new unsigned char[std::max((uint64_t)1, newLen)];
+	unsigned char* pPos = pOut;
+	for(size_t i = 0; i < blockCount; i++)
+	{
+		memcpy(pPos, blocks[i].data(), blocks[i].size());
+		pPos += blocks[i].size();
+	}
+	*pOutNewLen = newLen;
+	return pOut;
+}
+
+class GLZUncompressorWorker : public GWorkerThread
+{
+protected:
+	const unsigned char* m_pIn;
+	unsigned char* m_pOut;
+	const std::vector<uint64_t>& m_inOffsets;
+	const std::vector<uint64_t>& m_outOffsets;
+
+public:
+	std::string m_error;
+
+	GLZUncompressorWorker(GMasterThread& master, const unsigned char* pIn, unsigned char* pOut, const std::vector<uint64_t>& inOffsets, const std::vector<uint64_t>& outOffsets)
+	: GWorkerThread(master), m_pIn(pIn), m_pOut(pOut), m_inOffsets(inOffsets), m_outOffsets(outOffsets)
+	{
+	}
+
+	virtual ~GLZUncompressorWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		// Exceptions must not escape from a worker thread, so they are reported back to the master
+		try
+		{
+			uint64_t inStart = m_inOffsets[jobId] + GLZ_HEADER_SIZE;
+			GLZCompressor::uncompressBlock(m_pIn + inStart, (size_t)(m_inOffsets[jobId + 1] - inStart), m_pOut + m_outOffsets[jobId], (size_t)(m_outOffsets[jobId + 1] - m_outOffsets[jobId]));
+		}
+		catch(std::exception& e)
+		{
+			if(m_error.length() == 0)
+				m_error = e.what();
+		}
+	}
+};
+
+// static
+unsigned char* GLZCompressor::uncompress(const unsigned char* pIn, uint64_t len, uint64_t* pOutUncompressedLen, size_t workerThreads)
+{
+	// Find where each block starts
+	std::vector<uint64_t> inOffsets;
+	std::vector<uint64_t> outOffsets;
+	uint64_t inPos = 0;
+	uint64_t outPos = 0;
+	inOffsets.push_back(0);
+	outOffsets.push_back(0);
+	while(inPos < len)
+	{
+		if(len - inPos < GLZ_HEADER_SIZE)
+			throw Ex("invalid data");
+		uint64_t uncompressedLen, compressedLen;
+		memcpy(&uncompressedLen, pIn + inPos, sizeof(uint64_t));
+		memcpy(&compressedLen, pIn + inPos + sizeof(uint64_t), sizeof(uint64_t));
+		if(uncompressedLen > GLZ_MAX_BLOCK_SIZE || compressedLen > uncompressedLen || compressedLen > len - inPos - GLZ_HEADER_SIZE)
+			throw Ex("invalid data");
+		inPos += GLZ_HEADER_SIZE + compressedLen;
+		outPos += uncompressedLen;
+		inOffsets.push_back(inPos);
+		outOffsets.push_back(outPos);
+	}
+
+	// Uncompress the blocks
+	size_t blockCount = inOffsets.size() - 1;
+	unsigned char* pOut = new unsigned char[std::max((uint64_t)1, outPos)];
+	std::unique_ptr<unsigned char[]> hOut(pOut);
+	string error;
+	{
+		GMasterThread master;
+		std::vector<GLZUncompressorWorker*> workers;
+		for(size_t i = 0; i < std::max((size_t)1, std::min(workerThreads, blockCount)); i++)
+		{
+			workers.push_back(new GLZUncompressorWorker(master, pIn, pOut, inOffsets, outOffsets));
+			master.addWorker(workers.back());
+		}
+		master.doJobs(blockCount);
+		for(size_t i = 0; i < workers.size() && error.length() == 0; i++)
+			error = workers[i]->m_error;
+	}
+	if(error.length() > 0)
+		throw Ex(error);
+	*pOutUncompressedLen = outPos;
+	return hOut.release();
+}
+
+#ifndef NO_TEST_CODE
+// static
+void GLZCompressor::test()
+{
+	// Make some data with a mixture of repetitive text, runs, and noise
+	GRand rand(0);
+	const char* words[] = { "alpha ", "beta ", "gamma ", "delta ", "epsilon ", "zeta ", "eta ", "theta " };
+	std::vector<unsigned char> data;
+	while(data.size() < 3 * 65536 + 123)
+	{
+		size_t r = (size_t)rand.next(10);
+		if(r < 7)
+		{
+			const char* w = words[rand.next(8)];
+			data.insert(data.end(), w, w + strlen(w));
+		}
+		else if(r < 8)
+			data.insert(data.end(), (size_t)rand.next(300), (unsigned char)rand.next(256));
+		else
+		{
+			for(size_t i = rand.next(40); i > 0; i--)
+				data.push_back((unsigned char)rand.next(256));
+		}
+	}
+
+	// Round-trip it with several block sizes and thread counts
+	size_t blockSizes[] = { GLZ_BLOCK_SIZE, 65536, 1000, 7 };
+	for(size_t i = 0; i < 4; i++)
+	{
+		uint64_t compressedLen;
+		unsigned char* pCompressed = GLZCompressor::compress(data.data(), data.size(), &compressedLen, 1 + i, blockSizes[i]);
+		std::unique_ptr<unsigned char[]> hCompressed(pCompressed);
+		if(i == 0 && compressedLen * 3 > data.size())
+			throw Ex("poor compression");
+		uint64_t finalLen;
+		unsigned char* pFinal = GLZCompressor::uncompress(pCompressed, compressedLen, &finalLen, 3);
+		std::unique_ptr<unsigned char[]> hFinal(pFinal);
+		if(finalLen != data.size() || memcmp(pFinal, data.data(), data.size()) != 0)
+			throw Ex("not the same");
+
+		// Stream it through GLZUncompressor in uneven chunks
+		GLZUncompressor lz;
+		std::vector<unsigned char> streamed;
+		uint64_t pos = 0;
+		while(pos < compressedLen)
+		{
+			size_t n = (size_t)std::min((uint64_t)rand.next(5000) + 1, compressedLen - pos);
+			lz.enqueue(pCompressed + pos, n);
+			pos += n;
+			size_t blockLen;
+			const unsigned char* pBlock;
+			while((pBlock = lz.next(&blockLen)) != NULL)
+				streamed.insert(streamed.end(), pBlock, pBlock + blockLen);
+		}
+		if(streamed != data)
+			throw Ex("streaming failed");
+	}
+
+	// Incompressible data should be stored
+	std::vector<unsigned char> noise(5000);
+	for(size_t i = 0; i < noise.size(); i++)
+		noise[i] = (unsigned char)rand.next(256);
+	uint64_t compressedLen;
+	unsigned char* pCompressed = GLZCompressor::compress(noise.data(), noise.size(), &compressedLen);
+	std::unique_ptr<unsigned char[]> hCompressed(pCompressed);
+	if(compressedLen != noise.size() + GLZ_HEADER_SIZE)
+		throw Ex("expected the noise to be stored");
+
+	// Corrupt data should be rejected
+	pCompressed[GLZ_HEADER_SIZE - 1] ^= 0x40;
+	bool threw = false;
+	try
+	{
+		uint64_t finalLen;
+		delete[] GLZCompressor::uncompress(pCompressed, compressedLen, &finalLen);
+	}
+	catch(std::exception&)
+	{
+		threw = true;
+	}
+	if(!threw)
+		throw Ex("failed to detect corruption");
+}
+#endif
+
+
+
+
+
+GLZUncompressor::GLZUncompressor()
+: m_uncompressedLen(0), m_compressedLen(0), m_haveHeader(false)
+{
+	m_pQueue = new GBlobQueue();
+}
+
+GLZUncompressor::~GLZUncompressor()
+{
+	delete(m_pQueue);
+}
+
+void GLZUncompressor::enqueue(const unsigned char* pBytes, size_t len)
+{
+	m_pQueue->enqueue((const char*)pBytes, len);
+}
+
+const unsigned char* GLZUncompressor::next(size_t* pOutLen)
+{
+	if(!m_haveHeader)
+	{
+		const char* pChunk = m_pQueue->dequeue(GLZ_HEADER_SIZE);
+		if(!pChunk)
+			return NULL;
+		memcpy(&m_uncompressedLen, pChunk, sizeof(uint64_t));
+		memcpy(&m_compressedLen, pChunk + sizeof(uint64_t), sizeof(uint64_t));
+		if(m_uncompressedLen > GLZ_MAX_BLOCK_SIZE || m_compressedLen > m_uncompressedLen)
+			throw Ex("invalid data");
+		m_haveHeader = true;
+	}
+	const char* pChunk = m_pQueue->dequeue((size_t)m_compressedLen);
+	if(!pChunk)
+		return NULL;
+	m_block.resize(std::max((uint64_t)1, m_uncompressedLen));
+	GLZCompressor::uncompressBlock((const unsigned char*)pChunk, (size_t)m_compressedLen, m_block.data(), (size_t)m_uncompressedLen);
+	m_haveHeader = false;
+	*pOutLen = (size_t)m_uncompressedLen;
+	return m_block.data();
+}
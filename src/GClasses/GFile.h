@@ -24,9 +24,12 @@
 #include <fcntl.h>
 #include <istream>
 #include <vector>
+#include <stdint.h>
 
 namespace GClasses {
 
+class GBlobQueue;
+
 /// Helper struct to hold the results from GFile::ParsePath
 struct PathData
 {
@@ -155,6 +158,73 @@ public:
 };
 
 
+/// The default number of uncompressed bytes in each block of a GLZCompressor frame
+#define GLZ_BLOCK_SIZE 1048576
+
+/// The number of bytes in the header of each block of a GLZCompressor frame
+#define GLZ_HEADER_SIZE 16
+
+/// A fast LZ77-style compressor. Matches are found with a hash chain over a 64KB
+/// window, and each block is compressed independently, so the blocks of a large
+/// buffer are compressed (and uncompressed) in parallel. A frame is a sequence of
+/// blocks. Each block begins with its uncompressed size and its compressed size as
+/// 64-bit integers. (If the two sizes are equal, the block is stored uncompressed.)
+/// This trades some compression ratio for a great deal of speed compared with GCompressor.
+class GLZCompressor
+{
+public:
+	/// Compresses pIn into a frame of blocks with blockSize uncompressed bytes each.
+	/// You are responsible to delete[] the result.
+	static unsigned char* compress(const unsigned char* pIn, uint64_t len, uint64_t* pOutNewLen, size_t workerThreads = 1, size_t blockSize = GLZ_BLOCK_SIZE);
+
+	/// Uncompresses a frame. You are responsible to delete[] the result.
+	static unsigned char* uncompress(const unsigned char* pIn, uint64_t len, uint64_t* pOutUncompressedLen, size_t workerThreads = 1);
+
+	/// Returns the most bytes that compressBlock could write for len bytes of input.
+	static size_t maxCompressedSize(size_t len) { return len + len / 255 + 16; }
+
+	/// Compresses a block, including its header, into pOut, which must have room for
+	/// GLZ_HEADER_SIZE + maxCompressedSize(len) bytes. Returns the number of bytes written.
+	static size_t compressBlock(const unsigned char* pIn, size_t len, unsigned char* pOut);
+
+	/// Uncompresses the payload of a block (without its header) into exactly outLen bytes.
+	/// Throws if the data is not valid.
+	static void uncompressBlock(const unsigned char* pIn, size_t len, unsigned char* pOut, size_t outLen);
+
+#ifndef NO_TEST_CODE
+	static void test();
+#endif
+
+protected:
+	/// Encodes pIn as a sequence of literals and matches. Returns the number of bytes written to pOut.
+	static size_t encode(const unsigned char* pIn, size_t len, unsigned char* pOut);
+};
+
+
+/// Uncompresses a frame made by GLZCompressor one block at a time as its bytes arrive.
+class GLZUncompressor
+{
+protected:
+	GBlobQueue* m_pQueue;
+	uint64_t m_uncompressedLen;
+	uint64_t m_compressedLen;
+	bool m_haveHeader;
+	std::vector<unsigned char> m_block;
+
+public:
+	GLZUncompressor();
+	~GLZUncompressor();
+
+	/// Adds some compressed bytes to the stream. (As with GBlobQueue, pBytes must
+	/// remain valid until next returns NULL.)
+	void enqueue(const unsigned char* pBytes, size_t len);
+
+	/// If all the bytes of the next block have arrived, uncompresses it and returns
+	/// a pointer to its bytes, which remains valid until the next call. Otherwise,
+	/// returns NULL.
+	const unsigned char* next(size_t* pOutLen);
+};
+
 
 } // namespace GClasses
 
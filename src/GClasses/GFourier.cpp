@@ -24,8 +24,15 @@
 #include "GImage.h"
 #include "GBits.h"
 #include "GVec.h"
+#include "GThread.h"
+#include "GRand.h"
 #include <cmath>
+#include <map>
 #include <memory>
+#include <string.h>
+#ifdef __SSE2__
+#	include <emmintrin.h>
+#endif
 
 using namespace GClasses;
 
@@ -64,104 +71,436 @@ void ComplexNumber::interpolate(ComplexNumber& a, double w, ComplexNumber& b)
 }
 
 
-inline size_t ReverseBits(size_t nValue, size_t nBits)
+// A complex value in a form that the butterflies can operate on efficiently
+#ifdef __SSE2__
+class GFftValue
 {
-	size_t n;
-	size_t nReversed = 0;
-	for(n = 0; n < nBits; n++)
+public:
+	__m128d m_v; // (real, imag)
+
+	GFftValue() {}
+	GFftValue(__m128d v) : m_v(v) {}
+	GFftValue(double re, double im) : m_v(_mm_set_pd(im, re)) {}
+
+	static GFftValue load(const struct ComplexNumber* p) { return GFftValue(_mm_loadu_pd(&p->real)); }
+	void store(struct ComplexNumber* p) const { _mm_storeu_pd(&p->real, m_v); }
+	GFftValue operator+(const GFftValue& b) const { return GFftValue(_mm_add_pd(m_v, b.m_v)); }
+	GFftValue operator-(const GFftValue& b) const { return GFftValue(_mm_sub_pd(m_v, b.m_v)); }
+	GFftValue operator*(double d) const { return GFftValue(_mm_mul_pd(m_v, _mm_set1_pd(d))); }
+
+	// Complex multiplication
+	GFftValue operator*(const GFftValue& b) const
 	{
-		nReversed = (nReversed << 1) | (nValue & 1);
-		nValue >>= 1;
+		__m128d re = _mm_unpacklo_pd(b.m_v, b.m_v);
+		__m128d im = _mm_unpackhi_pd(b.m_v, b.m_v);
+		__m128d swapped = _mm_shuffle_pd(m_v, m_v, 1);
+		return GFftValue(_mm_add_pd(_mm_mul_pd(m_v, re), _mm_mul_pd(_mm_mul_pd(swapped, im), _mm_set_pd(1.0, -1.0))));
 	}
-	return nReversed;
-}
 
-void GFourier::fft(size_t arraySize, struct ComplexNumber* pComplexNumberArray, bool bForward)
+	// Returns this value multiplied by the imaginary number i * d
+	GFftValue timesI(double d) const
+	{
+		__m128d swapped = _mm_shuffle_pd(m_v, m_v, 1);
+		return GFftValue(_mm_mul_pd(swapped, _mm_set_pd(d, -d)));
+	}
+
+	GFftValue conj() const { return GFftValue(_mm_mul_pd(m_v, _mm_set_pd(-1.0, 1.0))); }
+};
+#else
+class GFftValue
+{
+public:
+	double m_re;
+	double m_im;
+
+	GFftValue() {}
+	GFftValue(double re, double im) : m_re(re), m_im(im) {}
+
+	static GFftValue load(const struct ComplexNumber* p) { return GFftValue(p->real, p->imag); }
+	void store(struct ComplexNumber* p) const { p->real = m_re; p->imag = m_im; }
+	GFftValue operator+(const GFftValue& b) const { return GFftValue(m_re + b.m_re, m_im + b.m_im); }
+	GFftValue operator-(const GFftValue& b) const { return GFftValue(m_re - b.m_re, m_im - b.m_im); }
+	GFftValue operator*(double d) const { return GFftValue(m_re * d, m_im * d); }
+	GFftValue operator*(const GFftValue& b) const { return GFftValue(m_re * b.m_re - m_im * b.m_im, m_re * b.m_im + m_im * b.m_re); }
+	GFftValue timesI(double d) const { return GFftValue(-m_im * d, m_re * d); }
+	GFftValue conj() const { return GFftValue(m_re, -m_im); }
+};
+#endif
+
+// Generates the order in which a decimation-in-time transform needs its input
+void GFftPlan_permutation(size_t stride, size_t base, const size_t* pRadices, size_t levels, size_t** ppOut)
 {
-	double* pData = (double*)pComplexNumberArray;
+	if(levels == 0)
+	{
+		*((*ppOut)++) = base;
+		return;
+	}
+	size_t radix = pRadices[levels - 1];
+	for(size_t q = 0; q < radix; q++)
+		GFftPlan_permutation(stride * radix, base + q * stride, pRadices, levels - 1, ppOut);
+}
 
-	// Make sure arraySize is a power of 2
-	if(arraySize == 0 || arraySize & (arraySize - 1))
-		throw Ex("Expected the array to be a power of 2");
+GFftPlan::GFftPlan(size_t size)
+: m_size(size)
+{
+	if(size == 0)
+		throw Ex("Expected a size greater than 0");
 
-	// Calculate the Log2 of arraySize and put it in nBits
-	size_t nBits = 0;
+	// Factor the size
+	size_t n = size;
+	while(n % 4 == 0)
 	{
-		size_t n = 1;
-		while(n < arraySize)
+		m_radices.push_back(4);
+		n /= 4;
+	}
+	if(n % 2 == 0)
+	{
+		m_radices.push_back(2);
+		n /= 2;
+	}
+	while(n % 3 == 0)
+	{
+		m_radices.push_back(3);
+		n /= 3;
+	}
+	while(n % 5 == 0)
+	{
+		m_radices.push_back(5);
+		n /= 5;
+	}
+	if(n == 1)
+	{
+		// Precompute the permutation and twiddle factors for the mixed-radix transform
+		m_permutation.resize(size);
+		size_t* pPerm = m_permutation.data();
+		GFftPlan_permutation(1, 0, m_radices.data(), m_radices.size(), &pPerm);
+		m_forwardTwiddles.resize(size);
+		m_inverseTwiddles.resize(size);
+		for(size_t i = 0; i < size; i++)
 		{
-			n = n << 1;
-			nBits++;
+			double angle = -2.0 * M_PI * (double)i / (double)size;
+			m_forwardTwiddles[i].real = cos(angle);
+			m_forwardTwiddles[i].imag = sin(angle);
+			m_inverseTwiddles[i].real = m_forwardTwiddles[i].real;
+			m_inverseTwiddles[i].imag = -m_forwardTwiddles[i].imag;
 		}
 	}
-
-	// Move the data to it's reversed-bit position
-	size_t totalSize = arraySize << 1;
+	else
 	{
-		GQUICKVEC(pTmp, totalSize);
-		for(size_t n = 0; n < arraySize; n++)
+		// Prepare for Bluestein's algorithm
+		m_radices.clear();
+		size_t convSize = 1;
+		while(convSize < 2 * size - 1)
+			convSize <<= 1;
+		m_pConvolutionPlan.reset(new GFftPlan(convSize));
+		m_chirp.resize(size);
+		for(size_t i = 0; i < size; i++)
+		{
+			// (i * i) is reduced modulo 2 * size to preserve precision for large i
+			double angle = -M_PI * (double)((i * i) % (2 * size)) / (double)size;
+			m_chirp[i].real = cos(angle);
+			m_chirp[i].imag = sin(angle);
+		}
+		m_chirpFft.resize(convSize);
+		for(size_t i = 0; i < convSize; i++)
 		{
-			size_t nReversed = ReverseBits(n, nBits);
-			pTmp[nReversed << 1] = pData[n << 1];
-			pTmp[(nReversed << 1) + 1] = pData[(n << 1) + 1];
+			m_chirpFft[i].real = 0.0;
+			m_chirpFft[i].imag = 0.0;
 		}
-		memcpy(pData, pTmp.data(), sizeof(double) * totalSize);
+		m_chirpFft[0].real = m_chirp[0].real;
+		m_chirpFft[0].imag = -m_chirp[0].imag;
+		for(size_t i = 1; i < size; i++)
+		{
+			m_chirpFft[i].real = m_chirp[i].real;
+			m_chirpFft[i].imag = -m_chirp[i].imag;
+			m_chirpFft[convSize - i] = m_chirpFft[i];
+		}
+		m_pConvolutionPlan->transform(m_chirpFft.data(), true);
 	}
+}
 
-	// Calculate the angle numerator
-	double dAngleNumerator;
-	if(bForward)
-		dAngleNumerator = -2.0 * M_PI;
+GFftPlan::~GFftPlan()
+{
+}
+
+void GFftPlan::transform(struct ComplexNumber* pData, bool bForward) const
+{
+	if(m_pConvolutionPlan)
+		transformBluestein(pData, bForward);
 	else
-		dAngleNumerator = 2.0 * M_PI;
-
-	// Do the Fast Forier Transform
-	double dR0, dR1, dR2, dR3, dI0, dI1, dI2, dI3;
-	for(size_t nHalfBlockSize = 1; nHalfBlockSize < arraySize; nHalfBlockSize = nHalfBlockSize << 1)
-	{
-		// Calculate angles, sines, and cosines
-		double dAngleDelta = dAngleNumerator / ((double)(nHalfBlockSize << 1));
-		double dCos1 = cos(-dAngleDelta);
-		double d2Cos1 = 2 * dCos1; // So we don't have to calculate this a bunch of times
-		double dCos2 = cos(-2 * dAngleDelta);
-		double dSin1 = sin(-dAngleDelta);
-		double dSin2 = sin(-2 * dAngleDelta);
-
-		// Do each block
-		for(size_t nStart = 0; nStart < arraySize; nStart += (nHalfBlockSize << 1))
+		transformMixedRadix(pData, bForward);
+}
+
+void GFftPlan::transformMixedRadix(struct ComplexNumber* pData, bool bForward) const
+{
+	// Move the data to its digit-reversed position
+	{
+		GTEMPBUF(struct ComplexNumber, pTmp, m_size);
+		memcpy(pTmp, pData, sizeof(struct ComplexNumber) * m_size);
+		const size_t* pPerm = m_permutation.data();
+		for(size_t i = 0; i < m_size; i++)
+			pData[i] = pTmp[pPerm[i]];
+	}
+
+	// Do the butterflies
+	const struct ComplexNumber* pTwiddles = bForward ? m_forwardTwiddles.data() : m_inverseTwiddles.data();
+	double sign = bForward ? -1.0 : 1.0;
+	size_t m = 1;
+	for(size_t r = 0; r < m_radices.size(); r++)
+	{
+		size_t radix = m_radices[r];
+		size_t blockSize = m * radix;
+		size_t twiddleStride = m_size / blockSize;
+		for(size_t j = 0; j < m; j++)
 		{
-			dR1 = dCos1;
-			dR2 = dCos2;
-			dI1 = dSin1;
-			dI2 = dSin2;
-			size_t nEnd = nStart + nHalfBlockSize;
-			for(size_t n = nStart; n < nEnd; n++)
+			GFftValue w1 = GFftValue::load(pTwiddles + j * twiddleStride);
+			GFftValue w2 = GFftValue::load(pTwiddles + 2 * j * twiddleStride);
+			for(size_t start = j; start < m_size; start += blockSize)
 			{
-				dR0 = d2Cos1 * dR1 - dR2;
-				dR2 = dR1;
-				dR1 = dR0;
-				dI0 = d2Cos1 * dI1 - dI2;
-				dI2 = dI1;
-				dI1 = dI0;
-				size_t n2 = n + nHalfBlockSize;
-				dR3 = dR0 * pData[n2 << 1] - dI0 * pData[(n2 << 1) + 1];
-				dI3 = dR0 * pData[(n2 << 1) + 1] + dI0 * pData[n2 << 1];
-				pData[n2 << 1] = pData[n << 1] - dR3;
-				pData[(n2 << 1) + 1] = pData[(n << 1) + 1] - dI3;
-				pData[n << 1] += dR3;
-				pData[(n << 1) + 1] += dI3;
+				struct ComplexNumber* p = pData + start;
+				if(radix == 4)
+				{
+					GFftValue w3 = GFftValue::load(pTwiddles + 3 * j * twiddleStride);
+					GFftValue a0 = GFftValue::load(p);
+					GFftValue a1 = GFftValue::load(p + m) * w1;
+					GFftValue a2 = GFftValue::load(p + 2 * m) * w2;
+					GFftValue a3 = GFftValue::load(p + 3 * m) * w3;
+					GFftValue t0 = a0 + a2;
+					GFftValue t1 = a0 - a2;
+					GFftValue t2 = a1 + a3;
+					GFftValue t3 = (a1 - a3).timesI(sign);
+					(t0 + t2).store(p);
+					(t1 + t3).store(p + m);
+					(t0 - t2).store(p + 2 * m);
+					(t1 - t3).store(p + 3 * m);
+				}
+				else if(radix == 2)
+				{
+					GFftValue a0 = GFftValue::load(p);
+					GFftValue a1 = GFftValue::load(p + m) * w1;
+					(a0 + a1).store(p);
+					(a0 - a1).store(p + m);
+				}
+				else if(radix == 3)
+				{
+					GFftValue a0 = GFftValue::load(p);
+					GFftValue a1 = GFftValue::load(p + m) * w1;
+					GFftValue a2 = GFftValue::load(p + 2 * m) * w2;
+					GFftValue t1 = a1 + a2;
+					GFftValue t2 = a0 - t1 * 0.5;
+					GFftValue t3 = (a1 - a2).timesI(sign * 0.86602540378443864676); // sqrt(3) / 2
+					(a0 + t1).store(p);
+					(t2 + t3).store(p + m);
+					(t2 - t3).store(p + 2 * m);
+				}
+				else
+				{
+					GAssert(radix == 5);
+					const double c1 = 0.30901699437494742410; // cos(2pi/5)
+					const double c2 = -0.80901699437494742410; // cos(4pi/5)
+					const double s1 = 0.95105651629515357212; // sin(2pi/5)
+					const double s2 = 0.58778525229247312917; // sin(4pi/5)
+					GFftValue w3 = GFftValue::load(pTwiddles + 3 * j * twiddleStride);
+					GFftValue w4 = GFftValue::load(pTwiddles + 4 * j * twiddleStride);
+					GFftValue a0 = GFftValue::load(p);
+					GFftValue a1 = GFftValue::load(p + m) * w1;
+					GFftValue a2 = GFftValue::load(p + 2 * m) * w2;
+					GFftValue a3 = GFftValue::load(p + 3 * m) * w3;
+					GFftValue a4 = GFftValue::load(p + 4 * m) * w4;
+					GFftValue t1 = a1 + a4;
+					GFftValue t2 = a2 + a3;
+					GFftValue t3 = a1 - a4;
+					GFftValue t4 = a2 - a3;
+					GFftValue b1 = a0 + t1 * c1 + t2 * c2;
+					GFftValue b2 = a0 + t1 * c2 + t2 * c1;
+					GFftValue d1 = (t3 * s1 + t4 * s2).timesI(sign);
+					GFftValue d2 = (t3 * s2 - t4 * s1).timesI(sign);
+					(a0 + t1 + t2).store(p);
+					(b1 + d1).store(p + m);
+					(b2 + d2).store(p + 2 * m);
+					(b2 - d2).store(p + 3 * m);
+					(b1 - d1).store(p + 4 * m);
+				}
 			}
 		}
+		m = blockSize;
 	}
 
 	// Normalize output if we're doing the inverse forier transform
 	if(!bForward)
 	{
-		GVecWrapper vw(pData, totalSize);
-		vw.vec() *= (1.0 / (double)arraySize);
+		double scale = 1.0 / (double)m_size;
+		for(size_t i = 0; i < m_size; i++)
+			(GFftValue::load(pData + i) * scale).store(pData + i);
+	}
+}
+
+void GFftPlan::transformBluestein(struct ComplexNumber* pData, bool bForward) const
+{
+	// The reverse transform is the forward transform of the conjugate, conjugated and scaled
+	size_t convSize = m_pConvolutionPlan->size();
+	GTEMPBUF(struct ComplexNumber, pConv, convSize);
+	for(size_t i = 0; i < m_size; i++)
+	{
+		GFftValue x = GFftValue::load(pData + i);
+		if(!bForward)
+			x = x.conj();
+		(x * GFftValue::load(&m_chirp[i])).store(pConv + i);
+	}
+	for(size_t i = m_size; i < convSize; i++)
+	{
+		pConv[i].real = 0.0;
+		pConv[i].imag = 0.0;
+	}
+
+	// Convolve with the conjugate chirp
+	m_pConvolutionPlan->transform(pConv, true);
+	for(size_t i = 0; i < convSize; i++)
+		(GFftValue::load(pConv + i) * GFftValue::load(&m_chirpFft[i])).store(pConv + i);
+	m_pConvolutionPlan->transform(pConv, false);
+
+	// Multiply by the chirp again
+	double scale = 1.0 / (double)m_size;
+	for(size_t i = 0; i < m_size; i++)
+	{
+		GFftValue x = GFftValue::load(pConv + i) * GFftValue::load(&m_chirp[i]);
+		if(!bForward)
+			x = x.conj() * scale;
+		x.store(pData + i);
 	}
 }
 
+// Holds the plans that GFftPlan::get has made
+class GFftPlanCache
+{
+public:
+	GSpinLock m_lock;
+	std::map<size_t, GFftPlan*> m_plans;
+
+	~GFftPlanCache()
+	{
+		for(std::map<size_t, GFftPlan*>::iterator it = m_plans.begin(); it != m_plans.end(); it++)
+			delete(it->second);
+	}
+};
+
+// static
+const GFftPlan& GFftPlan::get(size_t size)
+{
+	static GFftPlanCache cache;
+	GSpinLockHolder lockHolder(&cache.m_lock, "GFftPlan::get");
+	std::map<size_t, GFftPlan*>::iterator it = cache.m_plans.find(size);
+	if(it != cache.m_plans.end())
+		return *it->second;
+	GFftPlan* pPlan = new GFftPlan(size);
+	cache.m_plans[size] = pPlan;
+	return *pPlan;
+}
+
+// -----------------------------------------------------------------------------------
+
+GFftRealPlan::GFftRealPlan(size_t size)
+: m_size(size), m_plan(size % 2 == 0 ? size / 2 : size)
+{
+	if(size % 2 == 0)
+	{
+		m_twiddles.resize(size / 2);
+		for(size_t i = 0; i < size / 2; i++)
+		{
+			double angle = -2.0 * M_PI * (double)i / (double)size;
+			m_twiddles[i].real = cos(angle);
+			m_twiddles[i].imag = sin(angle);
+		}
+	}
+}
+
+GFftRealPlan::~GFftRealPlan()
+{
+}
+
+void GFftRealPlan::forward(const double* pIn, struct ComplexNumber* pOut) const
+{
+	if(m_size % 2 != 0)
+	{
+		// Odd sizes cannot be packed, so just do a complex transform
+		GTEMPBUF(struct ComplexNumber, pTmp, m_size);
+		for(size_t i = 0; i < m_size; i++)
+		{
+			pTmp[i].real = pIn[i];
+			pTmp[i].imag = 0.0;
+		}
+		m_plan.transform(pTmp, true);
+		memcpy(pOut, pTmp, sizeof(struct ComplexNumber) * (m_size / 2 + 1));
+		return;
+	}
+
+	// Pack the even samples into the real parts and the odd samples into the imaginary parts
+	size_t half = m_size / 2;
+	GTEMPBUF(struct ComplexNumber, pZ, half);
+	memcpy(pZ, pIn, sizeof(double) * m_size);
+	m_plan.transform(pZ, true);
+
+	// Separate the transforms of the even and odd samples, and combine them
+	for(size_t k = 0; k <= half / 2; k++)
+	{
+		size_t j = (half - k) % half;
+		GFftValue zk = GFftValue::load(pZ + k);
+		GFftValue zj = GFftValue::load(pZ + j).conj();
+		GFftValue evenK = (zk + zj) * 0.5;
+		GFftValue oddK = (zk - zj).timesI(-0.5);
+		GFftValue zjc = GFftValue::load(pZ + j);
+		GFftValue zkc = GFftValue::load(pZ + k).conj();
+		GFftValue evenJ = (zjc + zkc) * 0.5;
+		GFftValue oddJ = (zjc - zkc).timesI(-0.5);
+		(evenK + oddK * GFftValue::load(&m_twiddles[k])).store(pOut + k);
+		if(k == 0)
+			(evenK - oddK).store(pOut + half);
+		else
+			(evenJ + oddJ * GFftValue::load(&m_twiddles[j])).store(pOut + j);
+	}
+}
+
+void GFftRealPlan::inverse(const struct ComplexNumber* pIn, double* pOut) const
+{
+	if(m_size % 2 != 0)
+	{
+		// Odd sizes cannot be packed, so rebuild the whole spectrum and do a complex transform
+		GTEMPBUF(struct ComplexNumber, pTmp, m_size);
+		for(size_t i = 0; i <= m_size / 2; i++)
+			pTmp[i] = pIn[i];
+		for(size_t i = m_size / 2 + 1; i < m_size; i++)
+		{
+			pTmp[i].real = pIn[m_size - i].real;
+			pTmp[i].imag = -pIn[m_size - i].imag;
+		}
+		m_plan.transform(pTmp, false);
+		for(size_t i = 0; i < m_size; i++)
+			pOut[i] = pTmp[i].real;
+		return;
+	}
+
+	// Recombine the transforms of the even and odd samples into the packed signal
+	size_t half = m_size / 2;
+	GTEMPBUF(struct ComplexNumber, pZ, half);
+	for(size_t k = 0; k < half; k++)
+	{
+		GFftValue xk = GFftValue::load(pIn + k);
+		GFftValue xj = GFftValue::load(pIn + half - k).conj();
+		GFftValue even = (xk + xj) * 0.5;
+		GFftValue odd = ((xk - xj) * 0.5) * GFftValue::load(&m_twiddles[k]).conj();
+		(even + odd.timesI(1.0)).store(pZ + k);
+	}
+	m_plan.transform(pZ, false);
+	memcpy(pOut, pZ, sizeof(double) * m_size);
+}
+
+// -----------------------------------------------------------------------------------
+
+void GFourier::fft(size_t arraySize, struct ComplexNumber* pComplexNumberArray, bool bForward)
+{
+	GFftPlan::get(arraySize).transform(pComplexNumberArray, bForward);
+}
+
 void GFourier::fft2d(size_t arrayWidth, size_t arrayHeight, struct ComplexNumber* p2DComplexNumberArray, bool bForward)
 {
 	double* pData = (double*)p2DComplexNumberArray;
@@ -363,6 +702,70 @@ void GFourier::fftArrayToImage(struct ComplexNumber* pArray, int width, int oneT
 
 
 #ifndef NO_TEST_CODE
+void GFourier_testSize(size_t size, GRand& rand)
+{
+	// Compute the transform the slow way
+	std::vector<struct ComplexNumber> signal(size);
+	std::vector<struct ComplexNumber> expected(size);
+	for(size_t i = 0; i < size; i++)
+	{
+		signal[i].real = rand.normal();
+		signal[i].imag = rand.normal();
+	}
+	for(size_t k = 0; k < size; k++)
+	{
+		expected[k].real = 0.0;
+		expected[k].imag = 0.0;
+		for(size_t n = 0; n < size; n++)
+		{
+			double angle = -2.0 * M_PI * (double)((n * k) % size) / (double)size;
+			expected[k].real += signal[n].real * cos(angle) - signal[n].imag * sin(angle);
+			expected[k].imag += signal[n].real * sin(angle) + signal[n].imag * cos(angle);
+		}
+	}
+
+	// Check the complex transform
+	double tol = 1e-9 * (double)size;
+	std::vector<struct ComplexNumber> data(signal);
+	GFourier::fft(size, data.data(), true);
+	for(size_t k = 0; k < size; k++)
+	{
+		if(std::abs(data[k].real - expected[k].real) > tol || std::abs(data[k].imag - expected[k].imag) > tol)
+			throw Ex("wrong answer for size ", to_str(size));
+	}
+	GFourier::fft(size, data.data(), false);
+	for(size_t n = 0; n < size; n++)
+	{
+		if(std::abs(data[n].real - signal[n].real) > 1e-9 || std::abs(data[n].imag - signal[n].imag) > 1e-9)
+			throw Ex("the reverse transform did not restore the signal for size ", to_str(size));
+	}
+
+	// Check the real transform
+	std::vector<double> real(size);
+	for(size_t i = 0; i < size; i++)
+	{
+		real[i] = signal[i].real;
+		data[i] = signal[i];
+		data[i].imag = 0.0;
+	}
+	GFourier::fft(size, data.data(), true);
+	GFftRealPlan plan(size);
+	std::vector<struct ComplexNumber> bins(size / 2 + 1);
+	plan.forward(real.data(), bins.data());
+	for(size_t k = 0; k <= size / 2; k++)
+	{
+		if(std::abs(bins[k].real - data[k].real) > tol || std::abs(bins[k].imag - data[k].imag) > tol)
+			throw Ex("wrong answer from the real transform for size ", to_str(size));
+	}
+	std::vector<double> restored(size);
+	plan.inverse(bins.data(), restored.data());
+	for(size_t n = 0; n < size; n++)
+	{
+		if(std::abs(restored[n] - real[n]) > 1e-9)
+			throw Ex("the reverse real transform did not restore the signal for size ", to_str(size));
+	}
+}
+
 void GFourier::test()
 {
 	struct ComplexNumber cn[4];
@@ -395,6 +798,12 @@ void GFourier::test()
 		if(std::abs(cn[n].imag) > 1e-12)
 			throw Ex("wrong answer");
 	}
+
+	// Test mixed-radix sizes, Bluestein sizes, and both even and odd real sizes
+	GRand rand(0);
+	size_t sizes[] = { 1, 2, 3, 5, 6, 7, 8, 12, 13, 15, 16, 20, 30, 45, 64, 97, 100, 128, 250, 384, 1000 };
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(size_t); i++)
+		GFourier_testSize(sizes[i], rand);
 }
 
 #endif // NO_TEST_CODE
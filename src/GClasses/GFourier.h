@@ -20,6 +20,8 @@
 #define __GFOURIER_H__
 
 #include "GError.h"
+#include <vector>
+#include <memory>
 
 namespace GClasses {
 
@@ -50,16 +52,93 @@ struct ComplexNumber
 };
 
 
+/// A precomputed plan for performing Fast Fourier Transforms of one particular size.
+/// The twiddle factors and the input permutation are computed once, when the plan is constructed.
+/// Sizes whose only prime factors are 2, 3, and 5 are transformed with mixed-radix butterflies
+/// (radix 2, 3, 4, and 5). All other sizes use Bluestein's algorithm, which expresses the transform
+/// as a convolution that is computed with a power-of-2 plan.
+/// Transforming does not modify the plan, so one plan may be used by several threads at once.
+class GFftPlan
+{
+protected:
+	size_t m_size;
+	std::vector<size_t> m_radices;
+	std::vector<size_t> m_permutation;
+	std::vector<struct ComplexNumber> m_forwardTwiddles;
+	std::vector<struct ComplexNumber> m_inverseTwiddles;
+	std::unique_ptr<GFftPlan> m_pConvolutionPlan; // only used by Bluestein's algorithm
+	std::vector<struct ComplexNumber> m_chirp; // only used by Bluestein's algorithm
+	std::vector<struct ComplexNumber> m_chirpFft; // only used by Bluestein's algorithm
+
+public:
+	/// Prepares to perform transforms of the specified size.
+	GFftPlan(size_t size);
+	~GFftPlan();
+
+	// Plans are not copied, because they can be large. Share them by reference instead.
+	GFftPlan(const GFftPlan&) = delete;
+	GFftPlan& operator=(const GFftPlan&) = delete;
+
+	/// Returns the number of complex values that this plan transforms.
+	size_t size() const { return m_size; }
+
+	/// Transforms size() values in place. If bForward is false, it performs the reverse transform,
+	/// which also divides by size().
+	void transform(struct ComplexNumber* pData, bool bForward) const;
+
+	/// Returns a plan for the specified size from a process-wide cache, creating it if necessary.
+	/// (This is thread-safe. The plan remains valid until the process exits.) Plans are never
+	/// evicted from the cache, so code that transforms many different sizes should construct
+	/// its own plans instead.
+	static const GFftPlan& get(size_t size);
+
+protected:
+	void transformMixedRadix(struct ComplexNumber* pData, bool bForward) const;
+	void transformBluestein(struct ComplexNumber* pData, bool bForward) const;
+};
+
+
+/// A precomputed plan for transforming real-valued signals. When the size is even, the signal is packed
+/// into a complex signal of half the size, so the transform costs about half as much as a complex
+/// transform of the same size.
+class GFftRealPlan
+{
+protected:
+	size_t m_size;
+	GFftPlan m_plan;
+	std::vector<struct ComplexNumber> m_twiddles;
+
+public:
+	/// Prepares to transform real signals with size values.
+	GFftRealPlan(size_t size);
+	~GFftRealPlan();
+
+	GFftRealPlan(const GFftRealPlan&) = delete;
+	GFftRealPlan& operator=(const GFftRealPlan&) = delete;
+
+	/// Returns the number of real values in the signal.
+	size_t size() const { return m_size; }
+
+	/// Computes the first size() / 2 + 1 frequency bins of the real signal pIn.
+	/// (The other bins are the complex conjugates of these, mirrored.)
+	void forward(const double* pIn, struct ComplexNumber* pOut) const;
+
+	/// Reconstructs the real signal from the first size() / 2 + 1 frequency bins, which are assumed
+	/// to have the symmetry of a real signal's transform. (This is the inverse of forward.)
+	void inverse(const struct ComplexNumber* pIn, double* pOut) const;
+};
+
+
 /// Fourier transform
 class GFourier
 {
 public:
-	/// This will do a Fast Forier Transform. arraySize must be a power of 2. If bForward is
-	/// false, it will perform the reverse transform
+	/// This will do a Fast Forier Transform. Any arraySize is supported, but sizes whose
+	/// only prime factors are 2, 3, and 5 are fastest. If bForward is false, it will perform
+	/// the reverse transform. (This uses a cached GFftPlan for the size.)
 	static void fft(size_t arraySize, struct ComplexNumber* pComplexNumberArray, bool bForward);
 
-	/// 2D Fast Forier Transform.  nArrayWidth must be a power of 2. nArrayHeight must be a power of 2. If bForward
-	/// is false, it will perform the reverse transform.
+	/// 2D Fast Forier Transform. If bForward is false, it will perform the reverse transform.
 	static void fft2d(size_t arrayWidth, size_t arrayHeight, struct ComplexNumber* p2DComplexNumberArray, bool bForward);
 
 	/// pArrayWidth returns the width of the array and pOneThirdHeight returns one third the height of the array
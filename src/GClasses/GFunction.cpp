@@ -22,10 +22,13 @@
 #include "GError.h"
 #include "GHolders.h"
 #include "GMath.h"
+#include "GMatrix.h"
+#include "GRand.h"
 #include <stdlib.h>
 #include <cmath>
 #include <string>
 #include <memory>
+#include <algorithm>
 
 using namespace GClasses;
 using std::vector;
@@ -35,6 +38,8 @@ using std::map;
 typedef double (*MathFuncFunc)(vector<double>& params);
 
 namespace GClasses {
+class GFunctionCompiler;
+
 class GFunctionNode
 {
 public:
@@ -48,6 +53,104 @@ public:
 
 	virtual double eval(vector<double>& params, GFunctionParser& parser) = 0;
 	virtual void unlink(const char* szName) = 0;
+
+	/// Emits the instructions to compute this node, and returns the register that will
+	/// hold the result. args holds the registers of the parameters of the function
+	/// that this node belongs to.
+	virtual size_t compile(GFunctionCompiler& compiler, const vector<size_t>& args, size_t depth) = 0;
+};
+
+enum GFunctionOpcode
+{
+	op_plus,
+	op_minus,
+	op_times,
+	op_divide,
+	op_modulus,
+	op_exponent,
+	op_negate,
+	op_abs,
+	op_acos,
+	op_acosh,
+	op_asin,
+	op_asinh,
+	op_atan,
+	op_atanh,
+	op_ceil,
+	op_cos,
+	op_cosh,
+	op_erf,
+	op_floor,
+	op_gamma,
+	op_ifzero,
+	op_ifnegative,
+	op_lgamma,
+	op_log,
+	op_softexp,
+	op_max,
+	op_min,
+	op_normal,
+	op_sign,
+	op_sin,
+	op_sinh,
+	op_sqrt,
+	op_tan,
+	op_tanh,
+};
+
+/// Compiles a tree of GFunctionNodes into a GCompiledFunction. While compiling, the
+/// registers are virtual. (Each instruction gets a new one.) They are mapped to
+/// the registers of the GCompiledFunction when it is finished.
+class GFunctionCompiler
+{
+protected:
+	GFunctionParser& m_parser;
+	size_t m_params;
+	vector<bool> m_isConstant;
+	vector<double> m_values;
+	vector<GFunctionInstruction> m_program;
+
+public:
+	/// The first params virtual registers are the parameters of the function
+	GFunctionCompiler(GFunctionParser& parser, size_t params)
+	: m_parser(parser), m_params(params), m_isConstant(params, false), m_values(params, 0.0)
+	{
+	}
+
+	GFunctionParser& parser() { return m_parser; }
+
+	/// Returns a register that holds a constant value
+	size_t constant(double value)
+	{
+		m_isConstant.push_back(true);
+		m_values.push_back(value);
+		return m_isConstant.size() - 1;
+	}
+
+	bool isConstant(size_t reg) { return m_isConstant[reg]; }
+
+	double value(size_t reg) { return m_values[reg]; }
+
+	/// Adds an instruction and returns the register that will hold its result
+	size_t emit(int op, size_t a, size_t b = INVALID_INDEX, size_t c = INVALID_INDEX)
+	{
+		m_isConstant.push_back(false);
+		m_values.push_back(0.0);
+		GFunctionInstruction ins;
+		ins.m_op = op;
+		ins.m_dest = m_isConstant.size() - 1;
+		ins.m_a = a;
+		ins.m_b = b;
+		ins.m_c = c;
+		m_program.push_back(ins);
+		return ins.m_dest;
+	}
+
+	/// Emits the instructions for a built-in function, or folds it if all of the arguments are constant
+	size_t builtIn(MathFuncFunc pFunc, const vector<size_t>& args);
+
+	/// Removes dead instructions, assigns the registers, and puts the program in cf
+	void finish(size_t result, GCompiledFunction& cf);
 };
 }
 
@@ -88,6 +191,11 @@ public:
 
 	virtual void unlink(const char* szName) {}
 
+	virtual size_t compile(GFunctionCompiler& compiler, const vector<size_t>& args, size_t depth)
+	{
+		return compiler.builtIn(m_pFunc, args);
+	}
+
 	// The operators
 	static double plus(vector<double>& params) { return params[0] + params[1]; }
 	static double minus(vector<double>& params) { return params[0] - params[1]; }
@@ -182,6 +290,23 @@ public:
 	{
 		for(size_t i = 0; i < m_children.size(); i++)
 			m_params[i] = m_children[i]->eval(params, parser); // "params" holds the parameters to the root function. They are used when a leaf turns out to be one of the variables of the root function.
+		return link(parser)->eval(m_params, parser);
+	}
+
+	virtual size_t compile(GFunctionCompiler& compiler, const vector<size_t>& args, size_t depth)
+	{
+		// Protect against recursion. (Since all of the parameters are always evaluated, a recursive function would never finish anyway.)
+		if(depth > 1000)
+			throw Ex("The function ", m_name, " is recursive, or pathologically deep");
+		vector<size_t> childArgs;
+		for(size_t i = 0; i < m_children.size(); i++)
+			childArgs.push_back(m_children[i]->compile(compiler, args, depth));
+		return link(compiler.parser())->compile(compiler, childArgs, depth + 1);
+	}
+
+	/// Returns the root of the function this calls. Finds it in the parser if it is not already linked.
+	GFunctionNode* link(GFunctionParser& parser)
+	{
 		if(!m_pFunction)
 		{
 			GFunction* pFunc = parser.getFunction(m_name.c_str());
@@ -199,7 +324,7 @@ public:
 			}
 			m_pFunction = pFunc->m_pRoot;
 		}
-		return m_pFunction->eval(m_params, parser);
+		return m_pFunction;
 	}
 
 	virtual void unlink(const char* szName)
@@ -230,6 +355,11 @@ public:
 	}
 
 	virtual void unlink(const char* szName) {}
+
+	virtual size_t compile(GFunctionCompiler& compiler, const vector<size_t>& args, size_t depth)
+	{
+		return args[m_index];
+	}
 };
 
 class GFunctionConstant : public GFunctionNode
@@ -251,6 +381,11 @@ public:
 	}
 
 	virtual void unlink(const char* szName) {}
+
+	virtual size_t compile(GFunctionCompiler& compiler, const vector<size_t>& args, size_t depth)
+	{
+		return compiler.constant(m_value);
+	}
 };
 
 // --------------------------------------------------------------
@@ -761,6 +896,313 @@ void GFunctionParser::parseFunctionList(vector<string>& tokens)
 	functions.push_back(parseFunction(tokens, start, (int)tokens.size() - start));
 }
 
+// --------------------------------------------------------------
+
+size_t GFunctionCompiler::builtIn(MathFuncFunc pFunc, const vector<size_t>& args)
+{
+	// Fold it if all of the arguments are constant
+	bool allConstant = true;
+	for(size_t i = 0; i < args.size(); i++)
+	{
+		if(!m_isConstant[args[i]])
+			allConstant = false;
+	}
+	if(allConstant)
+	{
+		vector<double> params;
+		for(size_t i = 0; i < args.size(); i++)
+			params.push_back(m_values[args[i]]);
+		return constant(pFunc(params));
+	}
+
+	// Variadic functions are evaluated as a chain of binary operations
+	if(pFunc == GFunctionBuiltIn::_max || pFunc == GFunctionBuiltIn::_min)
+	{
+		int op = (pFunc == GFunctionBuiltIn::_max ? op_max : op_min);
+		size_t reg = args[0];
+		for(size_t i = 1; i < args.size(); i++)
+			reg = emit(op, reg, args[i]);
+		return reg;
+	}
+
+	// Binary and ternary functions
+	if(pFunc == GFunctionBuiltIn::plus) return emit(op_plus, args[0], args[1]);
+	if(pFunc == GFunctionBuiltIn::minus) return emit(op_minus, args[0], args[1]);
+	if(pFunc == GFunctionBuiltIn::times) return emit(op_times, args[0], args[1]);
+	if(pFunc == GFunctionBuiltIn::divide) return emit(op_divide, args[0], args[1]);
+	if(pFunc == GFunctionBuiltIn::modulus) return emit(op_modulus, args[0], args[1]);
+	if(pFunc == GFunctionBuiltIn::exponent) return emit(op_exponent, args[0], args[1]);
+	if(pFunc == GFunctionBuiltIn::_softexp) return emit(op_softexp, args[0], args[1]);
+	if(pFunc == GFunctionBuiltIn::_ifzero) return emit(op_ifzero, args[0], args[1], args[2]);
+	if(pFunc == GFunctionBuiltIn::_ifnegative) return emit(op_ifnegative, args[0], args[1], args[2]);
+
+	// Unary functions
+	int op;
+	if(pFunc == GFunctionBuiltIn::negate) op = op_negate;
+	else if(pFunc == GFunctionBuiltIn::_abs) op = op_abs;
+	else if(pFunc == GFunctionBuiltIn::_acos) op = op_acos;
+#ifndef WINDOWS
+	else if(pFunc == GFunctionBuiltIn::_acosh) op = op_acosh;
+#endif
+	else if(pFunc == GFunctionBuiltIn::_asin) op = op_asin;
+#ifndef WINDOWS
+	else if(pFunc == GFunctionBuiltIn::_asinh) op = op_asinh;
+#endif
+	else if(pFunc == GFunctionBuiltIn::_atan) op = op_atan;
+#ifndef WINDOWS
+	else if(pFunc == GFunctionBuiltIn::_atanh) op = op_atanh;
+#endif
+	else if(pFunc == GFunctionBuiltIn::_ceil) op = op_ceil;
+	else if(pFunc == GFunctionBuiltIn::_cos) op = op_cos;
+	else if(pFunc == GFunctionBuiltIn::_cosh) op = op_cosh;
+#ifndef WINDOWS
+	else if(pFunc == GFunctionBuiltIn::_erf) op = op_erf;
+#endif
+	else if(pFunc == GFunctionBuiltIn::_floor) op = op_floor;
+	else if(pFunc == GFunctionBuiltIn::_gamma) op = op_gamma;
+	else if(pFunc == GFunctionBuiltIn::_lgamma) op = op_lgamma;
+	else if(pFunc == GFunctionBuiltIn::_log) op = op_log;
+	else if(pFunc == GFunctionBuiltIn::_normal) op = op_normal;
+	else if(pFunc == GFunctionBuiltIn::_sign) op = op_sign;
+	else if(pFunc == GFunctionBuiltIn::_sin) op = op_sin;
+	else if(pFunc == GFunctionBuiltIn::_sinh) op = op_sinh;
+	else if(pFunc == GFunctionBuiltIn::_sqrt) op = op_sqrt;
+	else if(pFunc == GFunctionBuiltIn::_tan) op = op_tan;
+	else if(pFunc == GFunctionBuiltIn::_tanh) op = op_tanh;
+	else
+		throw Ex("This built-in function cannot be compiled");
+	return emit(op, args[0]);
+}
+
+void GFunctionCompiler::finish(size_t result, GCompiledFunction& cf)
+{
+	// Find the instructions that contribute to the result
+	size_t regCount = m_isConstant.size();
+	vector<bool> needed(regCount, false);
+	needed[result] = true;
+	vector<bool> live(m_program.size(), false);
+	for(size_t i = m_program.size(); i > 0; i--)
+	{
+		GFunctionInstruction& ins = m_program[i - 1];
+		if(!needed[ins.m_dest])
+			continue;
+		live[i - 1] = true;
+		needed[ins.m_a] = true;
+		if(ins.m_b != INVALID_INDEX)
+			needed[ins.m_b] = true;
+		if(ins.m_c != INVALID_INDEX)
+			needed[ins.m_c] = true;
+	}
+
+	// The parameters come first, then the constants
+	vector<size_t> phys(regCount, INVALID_INDEX);
+	for(size_t i = 0; i < m_params; i++)
+		phys[i] = i;
+	cf.m_constants.clear();
+	for(size_t i = m_params; i < regCount; i++)
+	{
+		if(!needed[i] || !m_isConstant[i])
+			continue;
+		for(size_t j = 0; j < cf.m_constants.size(); j++)
+		{
+			if(memcmp(&cf.m_constants[j], &m_values[i], sizeof(double)) == 0)
+			{
+				phys[i] = m_params + j;
+				break;
+			}
+		}
+		if(phys[i] == INVALID_INDEX)
+		{
+			phys[i] = m_params + cf.m_constants.size();
+			cf.m_constants.push_back(m_values[i]);
+		}
+	}
+
+	// Find the last instruction that reads each temporary register
+	vector<size_t> lastUse(regCount, 0);
+	for(size_t i = 0; i < m_program.size(); i++)
+	{
+		if(!live[i])
+			continue;
+		GFunctionInstruction& ins = m_program[i];
+		lastUse[ins.m_a] = i;
+		if(ins.m_b != INVALID_INDEX)
+			lastUse[ins.m_b] = i;
+		if(ins.m_c != INVALID_INDEX)
+			lastUse[ins.m_c] = i;
+	}
+	lastUse[result] = m_program.size();
+
+	// Assign the temporary registers, reusing each one after its last read. (Since every
+	// instruction works element-wise, the result may go in a register that it reads.)
+	size_t firstTemp = m_params + cf.m_constants.size();
+	size_t tempCount = 0;
+	vector<size_t> free;
+	cf.m_program.clear();
+	for(size_t i = 0; i < m_program.size(); i++)
+	{
+		if(!live[i])
+			continue;
+		GFunctionInstruction ins = m_program[i];
+		size_t operands[3] = { ins.m_a, ins.m_b, ins.m_c };
+		for(size_t j = 0; j < 3; j++)
+		{
+			size_t reg = operands[j];
+			if(reg == INVALID_INDEX || m_isConstant[reg] || reg < m_params || lastUse[reg] != i)
+				continue;
+			if(std::find(free.begin(), free.end(), phys[reg]) == free.end())
+				free.push_back(phys[reg]);
+		}
+		if(free.size() > 0)
+		{
+			phys[ins.m_dest] = free.back();
+			free.pop_back();
+		}
+		else
+			phys[ins.m_dest] = firstTemp + tempCount++;
+		ins.m_dest = phys[ins.m_dest];
+		ins.m_a = phys[ins.m_a];
+		if(ins.m_b != INVALID_INDEX)
+			ins.m_b = phys[ins.m_b];
+		if(ins.m_c != INVALID_INDEX)
+			ins.m_c = phys[ins.m_c];
+		cf.m_program.push_back(ins);
+	}
+	cf.m_registers = firstTemp + tempCount;
+	cf.m_result = phys[result];
+}
+
+GCompiledFunction::GCompiledFunction(GFunction* pFunc, GFunctionParser& parser, size_t blockSize)
+: m_blockSize(std::max((size_t)1, blockSize))
+{
+	if(pFunc->m_expectedParams < 0)
+		throw Ex("Functions with a variable number of parameters cannot be compiled");
+	m_params = (size_t)pFunc->m_expectedParams;
+	GFunctionCompiler compiler(parser, m_params);
+	vector<size_t> args;
+	for(size_t i = 0; i < m_params; i++)
+		args.push_back(i);
+	size_t result = pFunc->m_pRoot->compile(compiler, args, 0);
+	compiler.finish(result, *this);
+
+	// Allocate a block for each register that is not a parameter, and fill in the constants
+	m_buf.resize((m_registers - m_params) * m_blockSize);
+	m_regs.resize(m_registers, NULL);
+	for(size_t i = m_params; i < m_registers; i++)
+		m_regs[i] = m_buf.data() + (i - m_params) * m_blockSize;
+	for(size_t i = 0; i < m_constants.size(); i++)
+		std::fill(m_regs[m_params + i], m_regs[m_params + i] + m_blockSize, m_constants[i]);
+}
+
+GCompiledFunction::~GCompiledFunction()
+{
+}
+
+void GCompiledFunction::run(size_t n)
+{
+	for(vector<GFunctionInstruction>::iterator it = m_program.begin(); it != m_program.end(); it++)
+	{
+		double* d = m_regs[it->m_dest];
+		const double* a = m_regs[it->m_a];
+		const double* b = (it->m_b == INVALID_INDEX ? NULL : m_regs[it->m_b]);
+		const double* c = (it->m_c == INVALID_INDEX ? NULL : m_regs[it->m_c]);
+		switch(it->m_op)
+		{
+			case op_plus: for(size_t i = 0; i < n; i++) d[i] = a[i] + b[i]; break;
+			case op_minus: for(size_t i = 0; i < n; i++) d[i] = a[i] - b[i]; break;
+			case op_times: for(size_t i = 0; i < n; i++) d[i] = a[i] * b[i]; break;
+			case op_divide: for(size_t i = 0; i < n; i++) d[i] = a[i] / b[i]; break;
+			case op_modulus: for(size_t i = 0; i < n; i++) d[i] = fmod(a[i], b[i]); break;
+			case op_exponent: for(size_t i = 0; i < n; i++) d[i] = pow(a[i], b[i]); break;
+			case op_negate: for(size_t i = 0; i < n; i++) d[i] = -a[i]; break;
+			case op_abs: for(size_t i = 0; i < n; i++) d[i] = std::abs(a[i]); break;
+			case op_acos: for(size_t i = 0; i < n; i++) d[i] = acos(a[i]); break;
+#ifndef WINDOWS
+			case op_acosh: for(size_t i = 0; i < n; i++) d[i] = acosh(a[i]); break;
+#endif
+			case op_asin: for(size_t i = 0; i < n; i++) d[i] = asin(a[i]); break;
+#ifndef WINDOWS
+			case op_asinh: for(size_t i = 0; i < n; i++) d[i] = asinh(a[i]); break;
+#endif
+			case op_atan: for(size_t i = 0; i < n; i++) d[i] = atan(a[i]); break;
+#ifndef WINDOWS
+			case op_atanh: for(size_t i = 0; i < n; i++) d[i] = atanh(a[i]); break;
+#endif
+			case op_ceil: for(size_t i = 0; i < n; i++) d[i] = ceil(a[i]); break;
+			case op_cos: for(size_t i = 0; i < n; i++) d[i] = cos(a[i]); break;
+			case op_cosh: for(size_t i = 0; i < n; i++) d[i] = cosh(a[i]); break;
+#ifndef WINDOWS
+			case op_erf: for(size_t i = 0; i < n; i++) d[i] = erf(a[i]); break;
+#endif
+			case op_floor: for(size_t i = 0; i < n; i++) d[i] = floor(a[i]); break;
+			case op_gamma: for(size_t i = 0; i < n; i++) d[i] = GMath::gamma(a[i]); break;
+			case op_ifzero: for(size_t i = 0; i < n; i++) d[i] = (std::abs(a[i]) < 0.5) ? b[i] : c[i]; break;
+			case op_ifnegative: for(size_t i = 0; i < n; i++) d[i] = (a[i] < 0) ? b[i] : c[i]; break;
+			case op_lgamma: for(size_t i = 0; i < n; i++) d[i] = GMath::logGamma(a[i]); break;
+			case op_log: for(size_t i = 0; i < n; i++) d[i] = log(a[i]); break;
+			case op_softexp: for(size_t i = 0; i < n; i++) d[i] = GMath::softExponential(a[i], b[i]); break;
+			case op_max: for(size_t i = 0; i < n; i++) d[i] = std::max(a[i], b[i]); break;
+			case op_min: for(size_t i = 0; i < n; i++) d[i] = std::min(a[i], b[i]); break;
+			case op_normal: for(size_t i = 0; i < n; i++) d[i] = 0.39894228 * exp(-0.5 * a[i] * a[i]); break;
+			case op_sign: for(size_t i = 0; i < n; i++) d[i] = a[i] >= 0 ? 1.0 : -1.0; break;
+			case op_sin: for(size_t i = 0; i < n; i++) d[i] = sin(a[i]); break;
+			case op_sinh: for(size_t i = 0; i < n; i++) d[i] = sinh(a[i]); break;
+			case op_sqrt: for(size_t i = 0; i < n; i++) d[i] = sqrt(a[i]); break;
+			case op_tan: for(size_t i = 0; i < n; i++) d[i] = tan(a[i]); break;
+			case op_tanh: for(size_t i = 0; i < n; i++) d[i] = tanh(a[i]); break;
+			default: throw Ex("Unrecognized instruction");
+		}
+	}
+}
+
+double GCompiledFunction::call(const std::vector<double>& params)
+{
+	if(params.size() < m_params)
+		throw Ex("Expected ", to_str(m_params), " parameters. Got ", to_str(params.size()));
+	for(size_t i = 0; i < m_params; i++)
+		m_regs[i] = const_cast<double*>(&params[i]);
+	run(1);
+	return m_regs[m_result][0];
+}
+
+void GCompiledFunction::evaluate(const double* const* columns, size_t n, double* out)
+{
+	for(size_t start = 0; start < n; start += m_blockSize)
+	{
+		size_t count = std::min(m_blockSize, n - start);
+		for(size_t i = 0; i < m_params; i++)
+			m_regs[i] = const_cast<double*>(columns[i] + start); // (Parameters are only read.)
+		run(count);
+		memcpy(out + start, m_regs[m_result], sizeof(double) * count);
+	}
+}
+
+void GCompiledFunction::evaluate(const GMatrix& data, GMatrix& out, size_t outCol)
+{
+	if(data.cols() < m_params)
+		throw Ex("The function takes ", to_str(m_params), " parameters, but the data has only ", to_str(data.cols()), " columns");
+	if(out.rows() != data.rows() || outCol >= out.cols())
+		throw Ex("The output matrix is not big enough");
+	m_columns.resize(m_params * m_blockSize);
+	for(size_t i = 0; i < m_params; i++)
+		m_regs[i] = m_columns.data() + i * m_blockSize;
+	for(size_t start = 0; start < data.rows(); start += m_blockSize)
+	{
+		// Gather the parameter columns for this block of rows
+		size_t count = std::min(m_blockSize, data.rows() - start);
+		for(size_t j = 0; j < count; j++)
+		{
+			const GVec& row = data.row(start + j);
+			for(size_t i = 0; i < m_params; i++)
+				m_regs[i][j] = row[i];
+		}
+		run(count);
+		const double* pResult = m_regs[m_result];
+		for(size_t j = 0; j < count; j++)
+			out[start + j][outCol] = pResult[j];
+	}
+}
+
 #ifndef NO_TEST_CODE
 
 // static
@@ -795,4 +1237,119 @@ void GFunctionParser::test()
 	}
 }
 
+void GCompiledFunction_checkSame(double a, double b)
+{
+	if(std::isnan(a) && std::isnan(b))
+		return;
+	if(a == b)
+		return;
+	if(std::abs(a - b) > 1e-12 * std::max(1.0, std::abs(a)))
+		throw Ex("Compiled function disagrees with the parser. Expected ", to_str(a), ", got ", to_str(b));
+}
+
+// static
+void GCompiledFunction::test()
+{
+	// Compare against the interpreter with many rows, including a partial block at the end
+	GFunctionParser mfp;
+	mfp.add("h(bob)=bob^2;somefunc(x,y)=3+blah(x,5)*h(y)-(x/foo)+max(x,y,sin(x*y),2*pi);blah(a,b)=a*b-b;foo=3.2;"
+		"g(x,y)=ifnegative(x-y,sqrt(abs(x)),log(abs(y)+1))+ifzero(floor(x),tanh(y),min(x,y))%3+softexp(0.3,x)-normal(y);"
+		"unused(a,b)=b;k(x,y)=unused(cos(x)*e^y,sign(y)*ceil(x))+sinh(y/4)-atan(x)");
+	const char* names[] = { "somefunc", "g", "k" };
+	GRand rand(0);
+	size_t n = 1000;
+	vector<double> xs(n);
+	vector<double> ys(n);
+	for(size_t i = 0; i < n; i++)
+	{
+		xs[i] = rand.normal() * 3.0;
+		ys[i] = rand.normal() * 3.0;
+	}
+	const double* columns[2] = { xs.data(), ys.data() };
+	vector<double> out(n);
+	for(size_t f = 0; f < 3; f++)
+	{
+		GFunction* pFunc = mfp.getFunction(names[f]);
+		GCompiledFunction cf(pFunc, mfp, 64);
+		if(cf.params() != 2)
+			throw Ex("wrong number of params");
+		cf.evaluate(columns, n, out.data());
+		vector<double> params(2);
+		for(size_t i = 0; i < n; i++)
+		{
+			params[0] = xs[i];
+			params[1] = ys[i];
+			double expected = pFunc->call(params, mfp);
+			GCompiledFunction_checkSame(expected, out[i]);
+			if(i % 97 == 0)
+				GCompiledFunction_checkSame(expected, cf.call(params));
+		}
+	}
+
+	// Check that constants are folded and dead code is removed
+	{
+		GFunctionParser p2;
+		p2.add("c=2*pi;f(x)=x*(c+3)-sqrt(16);d(x,y)=x;g(x)=d(x, sin(x))");
+		GCompiledFunction cf(p2.getFunction("f"), p2);
+		if(cf.instructionCount() != 2)
+			throw Ex("Constants were not folded");
+		vector<double> params(1, 2.0);
+		if(std::abs(cf.call(params) - (2.0 * (2.0 * M_PI + 3.0) - 4.0)) > 1e-12)
+			throw Ex("wrong answer");
+		GCompiledFunction cg(p2.getFunction("g"), p2);
+		if(cg.instructionCount() != 0 || cg.call(params) != 2.0)
+			throw Ex("Dead code was not removed");
+	}
+
+	// Evaluate over the columns of a matrix
+	{
+		GFunctionParser p3;
+		p3.add("f(a,b,c)=a*b+c");
+		GCompiledFunction cf(p3.getFunction("f"), p3, 8);
+		GMatrix data(21, 3);
+		for(size_t i = 0; i < data.rows(); i++)
+		{
+			data[i][0] = (double)i;
+			data[i][1] = 2.0;
+			data[i][2] = 1.0;
+		}
+		GMatrix res(21, 2);
+		res.setAll(0.0);
+		cf.evaluate(data, res, 1);
+		for(size_t i = 0; i < data.rows(); i++)
+		{
+			if(res[i][1] != 2.0 * i + 1.0 || res[i][0] != 0.0)
+				throw Ex("wrong answer");
+		}
+	}
+
+	// Recursion and undefined functions should be caught when compiling
+	{
+		GFunctionParser p4;
+		p4.add("f(x)=ifzero(x,1,x*f(x-1));g(x)=nothere(x)");
+		bool threw = false;
+		try
+		{
+			GCompiledFunction cf(p4.getFunction("f"), p4);
+		}
+		catch(const std::exception&)
+		{
+			threw = true;
+		}
+		if(!threw)
+			throw Ex("Failed to detect recursion");
+		threw = false;
+		try
+		{
+			GCompiledFunction cf(p4.getFunction("g"), p4);
+		}
+		catch(const std::exception&)
+		{
+			threw = true;
+		}
+		if(!threw)
+			throw Ex("Failed to detect an undefined function");
+	}
+}
+
 #endif //NO_TEST_CODE
@@ -32,6 +32,7 @@ class GFunctionCall;
 class GFunctionBuiltIn;
 class GFunctionStub;
 class GFunctionParser;
+class GMatrix;
 
 struct strCmp
 {
@@ -57,6 +58,76 @@ public:
 	double call(std::vector<double>& params, GFunctionParser& parser);
 };
 
+
+/// One instruction of a GCompiledFunction. Each operand is the index of a register,
+/// and each register holds one value for every row in a block.
+struct GFunctionInstruction
+{
+	int m_op;
+	size_t m_dest;
+	size_t m_a;
+	size_t m_b;
+	size_t m_c;
+};
+
+/// A GFunction that has been compiled to a flat sequence of register-based
+/// instructions. All calls to other functions are linked and inlined, and
+/// sub-expressions that depend only on constants are folded. The compiled function
+/// evaluates many rows at once, in blocks, so each instruction runs a tight loop
+/// over all of the rows in a block instead of dispatching through the tree
+/// once for every row. Since calls are inlined, this is a snapshot of the
+/// function. Redefining a function in the parser afterward has no effect on it.
+/// (This object uses internal buffers, so it should not be used by more than
+/// one thread at a time.)
+class GCompiledFunction
+{
+friend class GFunctionCompiler;
+protected:
+	size_t m_params;
+	size_t m_blockSize;
+	std::vector<GFunctionInstruction> m_program;
+	std::vector<double> m_constants; // The values of the registers that follow the parameters
+	size_t m_registers;
+	size_t m_result; // The register that holds the result
+	std::vector<double> m_buf;
+	std::vector<double*> m_regs;
+	std::vector<double> m_columns;
+
+public:
+	/// Compiles pFunc. Throws if pFunc calls a function that is not defined in parser,
+	/// or passes the wrong number of parameters to it, or is recursive. pFunc must take
+	/// a fixed number of parameters. blockSize is the number of rows evaluated
+	/// by each instruction at a time.
+	GCompiledFunction(GFunction* pFunc, GFunctionParser& parser, size_t blockSize = 256);
+	~GCompiledFunction();
+
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif
+
+	/// Returns the number of parameters the function takes
+	size_t params() const { return m_params; }
+
+	/// Returns the number of instructions in the compiled program
+	size_t instructionCount() const { return m_program.size(); }
+
+	/// Evaluates the function with a single set of parameters
+	double call(const std::vector<double>& params);
+
+	/// Evaluates the function for n rows. columns[i] points to the n values of parameter i.
+	/// The n results are put in out.
+	void evaluate(const double* const* columns, size_t n, double* out);
+
+	/// Evaluates the function for each row in data, using the first params() columns
+	/// as the parameters, and puts the results in column outCol of out.
+	void evaluate(const GMatrix& data, GMatrix& out, size_t outCol);
+
+protected:
+	/// Runs the program over the first n rows. (The parameter registers must already point to the parameter values.)
+	void run(size_t n);
+};
+
 /// This class parses math equations. (This is useful, for example, for plotting tools.)
 class GFunctionParser
 {
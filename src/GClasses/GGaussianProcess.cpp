@@ -24,8 +24,11 @@
 #include "GDistribution.h"
 #include "GKernelTrick.h"
 #include "GHolders.h"
+#include "GThread.h"
 #include <cmath>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace GClasses {
 
@@ -107,19 +110,107 @@ void GRunningCovariance::test()
 
 
 
+/// Accumulates the FITC sums over blocks of training rows. (Used by GGaussianProcess::trainSparse.)
+class GGaussianProcessSparseWorker : public GWorkerThread
+{
+protected:
+	GKernel* m_pKernel;
+	double m_scale;
+	double m_noiseVar;
+	const GMatrix& m_inducing;
+	const GMatrix& m_lInv;
+	const GMatrix& m_features;
+	const GMatrix& m_labels;
+	size_t m_blockSize;
+	GMatrix m_kBlock;
+	GVec m_k;
+	GVec m_v;
+	std::string& m_error;
+
+public:
+	GMatrix m_a; // the sum of v*v^T/lambda
+	GMatrix m_b; // the sum of v*y^T/lambda
+
+	GGaussianProcessSparseWorker(GMasterThread& master, GKernel* pKernel, double scale, double noiseVar, const GMatrix& inducing, const GMatrix& lInv, const GMatrix& features, const GMatrix& labels, size_t blockSize, std::string& error)
+	: GWorkerThread(master), m_pKernel(pKernel), m_scale(scale), m_noiseVar(noiseVar), m_inducing(inducing), m_lInv(lInv), m_features(features), m_labels(labels), m_blockSize(blockSize), m_k(inducing.rows()), m_v(inducing.rows()), m_error(error), m_a(inducing.rows(), inducing.rows()), m_b(inducing.rows(), labels.cols())
+	{
+		m_a.setAll(0.0);
+		m_b.setAll(0.0);
+	}
+
+	virtual ~GGaussianProcessSparseWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		// Exceptions must not escape from a worker thread, so they are reported back to the master
+		try
+		{
+			// Compute the kernel between this block of samples and the inducing points
+			size_t m = m_inducing.rows();
+			size_t start = jobId * m_blockSize;
+			size_t end = std::min(m_features.rows(), start + m_blockSize);
+			GMatrix block(m_features.relation().clone());
+			GReleaseDataHolder hBlock(&block);
+			for(size_t i = start; i < end; i++)
+				block.takeRow((GVec*)&m_features[i]);
+			m_pKernel->applyBlock(block, m_inducing, m_kBlock);
+			for(size_t i = start; i < end; i++)
+			{
+				// Project the sample onto the inducing points
+				const GVec& x = m_features[i];
+				const GVec& kRow = m_kBlock[i - start];
+				for(size_t j = 0; j < m; j++)
+					m_k[j] = m_scale * kRow[j];
+				m_lInv.multiply(m_k, m_v);
+
+				// The FITC diagonal is the part of the prior variance that the inducing points do not explain, plus noise
+				double lambda = std::max(0.0, m_scale * m_pKernel->apply(x, x) - m_v.squaredMagnitude()) + m_noiseVar;
+				if(lambda < 1e-12)
+					lambda = 1e-12;
+				double w = 1.0 / lambda;
+
+				// Accumulate the upper triangle of v*v^T/lambda, and v*y^T/lambda
+				const GVec& y = m_labels[i];
+				for(size_t j = 0; j < m; j++)
+				{
+					double vj = w * m_v[j];
+					GVec& aRow = m_a[j];
+					for(size_t k = j; k < m; k++)
+						aRow[k] += vj * m_v[k];
+					GVec& bRow = m_b[j];
+					for(size_t k = 0; k < y.size(); k++)
+						bRow[k] += vj * y[k];
+				}
+			}
+		}
+		catch(const std::exception& e)
+		{
+			GSpinLockHolder hLock(m_master.getLock(), "GGaussianProcessSparseWorker::doJob");
+			m_error = e.what();
+		}
+	}
+};
+
 GGaussianProcess::GGaussianProcess()
-: GSupervisedLearner(), m_noiseVar(1.0), m_weightsPriorVar(1024.0), m_maxSamples(350), m_pLInv(NULL), m_pAlpha(NULL), m_pStoredFeatures(NULL), m_pBuf(NULL)
+: GSupervisedLearner(), m_noiseVar(1.0), m_weightsPriorVar(1024.0), m_maxSamples(350), m_inducingPoints(0), m_workerThreads(1), m_pLInv(NULL), m_pSparseInv(NULL), m_pAlpha(NULL), m_pStoredFeatures(NULL), m_pBuf(NULL)
 {
 	m_pKernel = new GKernelIdentity();
 }
 
 GGaussianProcess::GGaussianProcess(const GDomNode* pNode)
-: GSupervisedLearner(pNode), m_pBuf(NULL)
+: GSupervisedLearner(pNode), m_workerThreads(1), m_pSparseInv(NULL), m_pBuf(NULL)
 {
 	m_weightsPriorVar = pNode->field("wv")->asDouble();
 	m_noiseVar = pNode->field("nv")->asDouble();
 	m_maxSamples = (size_t)pNode->field("ms")->asInt();
+	GDomNode* pInducing = pNode->fieldIfExists("ip");
+	m_inducingPoints = pInducing ? (size_t)pInducing->asInt() : 0;
 	m_pLInv = new GMatrix(pNode->field("l"));
+	GDomNode* pSparseInv = pNode->fieldIfExists("si");
+	if(pSparseInv)
+		m_pSparseInv = new GMatrix(pSparseInv);
 	m_pAlpha = new GMatrix(pNode->field("a"));
 	m_pStoredFeatures = new GMatrix(pNode->field("feat"));
 	m_pKernel = GKernel::deserialize(pNode->field("kernel"));
@@ -143,6 +234,102 @@ void GGaussianProcess::test()
 	pGP->setKernel(new GKernelGaussianRBF(0.2));
 	GAutoFilter af2(pGP);
 	af2.basicTest(0.67, 0.92);
+	af2.clear();
+	GGaussianProcess* pSparse = new GGaussianProcess();
+	pSparse->setKernel(new GKernelGaussianRBF(0.2));
+	pSparse->setInducingPoints(100);
+	GAutoFilter af3(pSparse);
+	af3.basicTest(0.74, 0.92);
+	testSparse();
+}
+
+void GGaussianProcess_makeSine(GRand& rand, size_t n, GMatrix& features, GMatrix& labels)
+{
+	features.resize(n, 1);
+	labels.resize(n, 1);
+	for(size_t i = 0; i < n; i++)
+	{
+		features[i][0] = rand.uniform() * 6.0;
+		labels[i][0] = std::sin(features[i][0]) + 0.05 * rand.normal();
+	}
+}
+
+// static
+void GGaussianProcess::testSparse()
+{
+	GRand rand(0);
+	GMatrix features;
+	GMatrix labels;
+	GGaussianProcess_makeSine(rand, 200, features, labels);
+
+	// When every sample is an inducing point, FITC is the exact model
+	GGaussianProcess exact;
+	exact.setKernel(new GKernelGaussianRBF(1.0));
+	exact.setWeightsPriorVariance(1.0);
+	exact.setNoiseVariance(0.01);
+	exact.train(features, labels);
+	GGaussianProcess full;
+	full.setKernel(new GKernelGaussianRBF(1.0));
+	full.setWeightsPriorVariance(1.0);
+	full.setNoiseVariance(0.01);
+	full.setInducingPoints(features.rows());
+	full.train(features, labels);
+	GVec in(1);
+	GVec a(1);
+	GVec b(1);
+	GPrediction pa;
+	GPrediction pb;
+	for(size_t i = 0; i < 20; i++)
+	{
+		in[0] = 0.3 * i;
+		exact.predict(in, a);
+		full.predict(in, b);
+		if(std::abs(a[0] - b[0]) > 1e-5)
+			throw Ex("The sparse model with all the samples differs from the exact model");
+		exact.predictDistribution(in, &pa);
+		full.predictDistribution(in, &pb);
+		if(std::abs(pa.asNormal()->variance() - pb.asNormal()->variance()) > 1e-5)
+			throw Ex("The sparse variance with all the samples differs from the exact variance");
+	}
+
+	// Many samples summarized by a few inducing points should still fit well,
+	// and the number of threads should only affect rounding
+	GGaussianProcess_makeSine(rand, 5000, features, labels);
+	GGaussianProcess serial;
+	serial.setKernel(new GKernelGaussianRBF(1.0));
+	serial.setWeightsPriorVariance(1.0);
+	serial.setNoiseVariance(0.01);
+	serial.setInducingPoints(20);
+	serial.rand().setSeed(1234);
+	serial.train(features, labels);
+	GGaussianProcess parallel;
+	parallel.setKernel(new GKernelGaussianRBF(1.0));
+	parallel.setWeightsPriorVariance(1.0);
+	parallel.setNoiseVariance(0.01);
+	parallel.setInducingPoints(20);
+	parallel.setWorkerThreads(3);
+	parallel.rand().setSeed(1234);
+	parallel.train(features, labels);
+	double sse = 0.0;
+	for(size_t i = 0; i < 60; i++)
+	{
+		in[0] = 0.1 * i;
+		serial.predict(in, a);
+		parallel.predict(in, b);
+		if(std::abs(a[0] - b[0]) > 1e-8)
+			throw Ex("The number of threads changed the model");
+		double err = a[0] - std::sin(in[0]);
+		sse += err * err;
+	}
+	if(sse / 60 > 0.001)
+		throw Ex("The sparse model did not fit well enough: ", to_str(sse / 60));
+
+	// The variance should grow away from the training data
+	serial.predictDistribution(in, &pa);
+	in[0] = 12.0;
+	serial.predictDistribution(in, &pb);
+	if(pa.asNormal()->variance() > 0.01 || pb.asNormal()->variance() < 0.5)
+		throw Ex("Unexpected variance");
 }
 #endif
 
@@ -153,7 +340,11 @@ GDomNode* GGaussianProcess::serialize(GDom* pDoc) const
 	pNode->addField(pDoc, "wv", pDoc->newDouble(m_weightsPriorVar));
 	pNode->addField(pDoc, "nv", pDoc->newDouble(m_noiseVar));
 	pNode->addField(pDoc, "ms", pDoc->newInt(m_maxSamples));
+	if(m_inducingPoints > 0)
+		pNode->addField(pDoc, "ip", pDoc->newInt(m_inducingPoints));
 	pNode->addField(pDoc, "l", m_pLInv->serialize(pDoc));
+	if(m_pSparseInv)
+		pNode->addField(pDoc, "si", m_pSparseInv->serialize(pDoc));
 	pNode->addField(pDoc, "a", m_pAlpha->serialize(pDoc));
 	pNode->addField(pDoc, "feat", m_pStoredFeatures->serialize(pDoc));
 	pNode->addField(pDoc, "kernel", m_pKernel->serialize(pDoc));
@@ -165,6 +356,8 @@ void GGaussianProcess::clear()
 {
 	delete(m_pLInv);
 	m_pLInv = NULL;
+	delete(m_pSparseInv);
+	m_pSparseInv = NULL;
 	delete(m_pAlpha);
 	m_pAlpha = NULL;
 	delete(m_pStoredFeatures);
@@ -180,6 +373,11 @@ void GGaussianProcess::trainInner(const GMatrix& features, const GMatrix& labels
 		throw Ex("GGaussianProcess only supports continuous features. Perhaps you should wrap it in a GAutoFilter.");
 	if(!labels.relation().areContinuous())
 		throw Ex("GGaussianProcess only supports continuous labels. Perhaps you should wrap it in a GAutoFilter.");
+	if(m_inducingPoints > 0)
+	{
+		trainSparse(features, labels);
+		return;
+	}
 	if(features.rows() <= m_maxSamples)
 	{
 		trainInnerInner(features, labels);
@@ -203,23 +401,20 @@ void GGaussianProcess::trainInner(const GMatrix& features, const GMatrix& labels
 	trainInnerInner(f, l);
 }
 
+void GGaussianProcess::kernelMatrix(const GMatrix& features, GMatrix& k)
+{
+	m_pKernel->gramMatrix(features, k, m_workerThreads);
+	k.multiply(m_weightsPriorVar);
+}
+
 void GGaussianProcess::trainInnerInner(const GMatrix& features, const GMatrix& labels)
 {
 	clear();
 	GMatrix* pL;
 	{
 		// Compute the kernel matrix
-		GMatrix k(features.rows(), features.rows());
-		for(size_t i = 0; i < features.rows(); i++)
-		{
-			GVec& row = k[i];
-			const GVec& a = features[i];
-			for(size_t j = 0; j < features.rows(); j++)
-			{
-				const GVec& b = features[j];
-				row[j] = m_weightsPriorVar * m_pKernel->apply(a, b);
-			}
-		}
+		GMatrix k;
+		kernelMatrix(features, k);
 
 		// Add the noise variance to the diagonal of the kernel matrix
 		for(size_t i = 0; i < features.rows(); i++)
@@ -245,6 +440,87 @@ void GGaussianProcess::trainInnerInner(const GMatrix& features, const GMatrix& l
 	m_pStoredFeatures->copy(&features);
 }
 
+void GGaussianProcess::trainSparse(const GMatrix& features, const GMatrix& labels)
+{
+	clear();
+	if(features.rows() < 1)
+		throw Ex("Expected at least one training sample");
+
+	// Select the inducing points
+	size_t m = std::min(m_inducingPoints, features.rows());
+	GIndexVec indexes(features.rows());
+	GIndexVec::makeIndexVec(indexes.v, features.rows());
+	GIndexVec::shuffle(indexes.v, features.rows(), &m_rand);
+	m_pStoredFeatures = new GMatrix(features.relation().clone());
+	for(size_t i = 0; i < m; i++)
+		m_pStoredFeatures->newRow().copy(features[indexes.v[i]]);
+
+	// Factor the kernel matrix of the inducing points, Kmm = Lm*Lm^T
+	{
+		GMatrix kmm;
+		kernelMatrix(*m_pStoredFeatures, kmm);
+		double jitter = 0.0;
+		for(size_t i = 0; i < m; i++)
+			jitter += kmm[i][i];
+		jitter = std::max(1e-10, 1e-8 * jitter / m);
+		for(size_t i = 0; i < m; i++)
+			kmm[i][i] += jitter;
+		GMatrix* pLm = kmm.cholesky(true);
+		std::unique_ptr<GMatrix> hLm(pLm);
+		m_pLInv = pLm->pseudoInverse();
+	}
+
+	// Accumulate A = V*Lambda^-1*V^T and B = V*Lambda^-1*Y over all the training samples,
+	// where V = Lm^-1*Kmn, and Lambda is the FITC diagonal.
+	size_t blockSize = 256;
+	size_t blocks = (features.rows() + blockSize - 1) / blockSize;
+	size_t threads = std::max((size_t)1, std::min(m_workerThreads, blocks));
+	std::vector<GGaussianProcessSparseWorker*> workers;
+	std::string error;
+	GMatrix a(m, m);
+	a.setAll(0.0);
+	GMatrix b(m, labels.cols());
+	b.setAll(0.0);
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < threads; i++)
+		{
+			workers.push_back(new GGaussianProcessSparseWorker(master, m_pKernel, m_weightsPriorVar, m_noiseVar, *m_pStoredFeatures, *m_pLInv, features, labels, blockSize, error));
+			master.addWorker(workers[i]);
+		}
+		master.doJobs(blocks);
+
+		// The master deletes the workers, so their sums must be collected before it goes out of scope
+		for(size_t i = 0; i < threads; i++)
+		{
+			a.add(&workers[i]->m_a);
+			b.add(&workers[i]->m_b);
+		}
+	}
+	if(error.length() > 0)
+		throw Ex(error);
+	for(size_t i = 0; i < m; i++)
+	{
+		a[i][i] += 1.0;
+		for(size_t j = 0; j < i; j++)
+			a[i][j] = a[j][i];
+	}
+
+	// Factor I + A = La*La^T, and cache La^-1*Lm^-1 for computing the variance
+	GMatrix* pLa = a.cholesky(true);
+	std::unique_ptr<GMatrix> hLa(pLa);
+	GMatrix* pLaInv = pLa->pseudoInverse();
+	std::unique_ptr<GMatrix> hLaInv(pLaInv);
+	m_pSparseInv = GMatrix::multiply(*pLaInv, *m_pLInv, false, false);
+
+	// The weights of the inducing points are Lm^-T*La^-T*La^-1*B
+	GMatrix* pTmp = GMatrix::multiply(*pLaInv, b, false, false);
+	std::unique_ptr<GMatrix> hTmp(pTmp);
+	m_pAlpha = GMatrix::multiply(*m_pSparseInv, *pTmp, true, false);
+	GAssert(m_pAlpha->rows() == m);
+	GAssert(m_pAlpha->cols() == labels.cols());
+}
+
 // virtual
 void GGaussianProcess::predict(const GVec& in, GVec& out)
 {
@@ -264,8 +540,8 @@ void GGaussianProcess::predict(const GVec& in, GVec& out)
 void GGaussianProcess::predictDistribution(const GVec& in, GPrediction* out)
 {
 	if(!m_pBuf)
-		m_pBuf = new GMatrix(2, m_pStoredFeatures->rows());
-	else if(m_pBuf->rows() < 2)
+		m_pBuf = new GMatrix(0, m_pStoredFeatures->rows());
+	while(m_pBuf->rows() < 3)
 		m_pBuf->newRow();
 
 	// Compute k*
@@ -274,18 +550,26 @@ void GGaussianProcess::predictDistribution(const GVec& in, GPrediction* out)
 		k[i] = m_weightsPriorVar * m_pKernel->apply(m_pStoredFeatures->row(i), in);
 
 	// Compute the prediction
-	GVec pred;
+	GVec pred(m_pAlpha->cols());
 	m_pAlpha->multiply(m_pBuf->row(0), pred, true);
 
-	// Compute the variance
+	// Compute the variance with the cached factorizations
 	GVec& v = m_pBuf->row(1);
 	m_pLInv->multiply(k, v);
-	double variance = m_pKernel->apply(k, k) - v.squaredMagnitude();
+	double variance = m_weightsPriorVar * m_pKernel->apply(in, in) - v.squaredMagnitude();
+	if(m_pSparseInv)
+	{
+		// The posterior of the inducing points adds back some of the variance
+		GVec& u = m_pBuf->row(2);
+		m_pSparseInv->multiply(k, u);
+		variance += u.squaredMagnitude();
+	}
+	variance = std::max(0.0, variance);
 
 	// Store the results
 	for(size_t i = 0; i < m_pAlpha->cols(); i++)
 	{
-		GNormalDistribution* pNorm = out->makeNormal();
+		GNormalDistribution* pNorm = out[i].makeNormal();
 		pNorm->setMeanAndVariance(pred[i], variance);
 	}
 }
@@ -63,13 +63,20 @@ public:
 /// A Gaussian Process model. This class was implemented according to the specification
 /// in Algorithm 2.1 on page 19 of chapter 2 of http://www.gaussianprocesses.org/gpml/chapters/
 /// by Carl Edward Rasmussen and Christopher K. I. Williams.
+/// By default, it computes the exact model, which requires O(n^3) time, so it sub-samples
+/// large training sets. If setInducingPoints is called, it instead uses the FITC sparse
+/// approximation (Snelson and Ghahramani, 2006), which summarizes all n training samples
+/// with m inducing points in O(n*m^2) time.
 class GGaussianProcess : public GSupervisedLearner
 {
 protected:
 	double m_noiseVar;
 	double m_weightsPriorVar;
 	size_t m_maxSamples;
+	size_t m_inducingPoints;
+	size_t m_workerThreads;
 	GMatrix* m_pLInv;
+	GMatrix* m_pSparseInv;
 	GMatrix* m_pAlpha;
 	GMatrix* m_pStoredFeatures;
 	GMatrix* m_pBuf;
@@ -87,6 +94,9 @@ public:
 
 #ifndef NO_TEST_CODE
 	static void test();
+
+	/// Tests the sparse approximation
+	static void testSparse();
 #endif
 
 	/// Marshal this object into a DOM, which can then be converted to a variety of serial formats.
@@ -111,6 +121,17 @@ public:
 	/// in order to train efficiently. The default is 350.
 	void setMaxSamples(size_t m) { m_maxSamples = m; }
 
+	/// Sets the number of inducing points to use. If m is 0 (the default), the exact
+	/// model is trained with at most maxSamples samples. Otherwise, m of the training
+	/// samples are selected at random to be inducing points, and every training sample
+	/// contributes to the model through them. (maxSamples is ignored in this case.)
+	void setInducingPoints(size_t m) { m_inducingPoints = m; }
+
+	/// Sets the number of threads used to compute the kernel matrices during training.
+	/// (The default is 1. In sparse mode, the sums accumulate in a different order
+	/// with different numbers of threads, so the models may differ by rounding error.)
+	void setWorkerThreads(size_t n) { m_workerThreads = (n > 1 ? n : 1); }
+
 protected:
 	/// See the comment for GSupervisedLearner::trainInner
 	virtual void trainInner(const GMatrix& features, const GMatrix& labels);
@@ -132,6 +153,12 @@ protected:
 
 	/// Called by trainInner
 	void trainInnerInner(const GMatrix& features, const GMatrix& labels);
+
+	/// Called by trainInner to train the sparse model
+	void trainSparse(const GMatrix& features, const GMatrix& labels);
+
+	/// Computes the kernel matrix of features, scaled by the weights prior variance
+	void kernelMatrix(const GMatrix& features, GMatrix& k);
 };
 
 } // namespace GClasses
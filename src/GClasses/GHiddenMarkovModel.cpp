@@ -24,16 +24,87 @@
 #include <algorithm>
 #include <math.h>
 #include <cmath>
+#include <string>
 #include "GError.h"
 #include "GHolders.h"
+#include "GRand.h"
+#include "GThread.h"
 #include "GVec.h"
 #include <string.h>
 
 using namespace GClasses;
 using std::vector;
 
+namespace GClasses {
+
+/// Holds the expected counts and working buffers of one Baum-Welch thread
+class GHiddenMarkovModelAccumulator
+{
+public:
+	GVec m_initial; // expected counts of the initial states
+	GVec m_transition; // expected counts of the transitions
+	GVec m_symbol; // expected counts of the symbols
+	GVec m_beta; // scaled beta values for each time step
+	GVec m_cur; // alpha at the current time step
+	GVec m_prev; // alpha at the previous time step
+	GVec m_gamma;
+	GVec m_tmp;
+
+	GHiddenMarkovModelAccumulator(size_t states, size_t symbols, size_t maxLen)
+	: m_initial(states), m_transition(states * states), m_symbol(states * symbols), m_beta(states * maxLen), m_cur(states), m_prev(states), m_gamma(states), m_tmp(states)
+	{
+	}
+
+	void reset()
+	{
+		m_initial.fill(0.0);
+		m_transition.fill(0.0);
+		m_symbol.fill(0.0);
+	}
+};
+
+/// Adds a range of sequences to the accumulator of one thread. (Used by GHiddenMarkovModel::baumWelch.)
+class GHiddenMarkovModelWorker : public GWorkerThread
+{
+protected:
+	GHiddenMarkovModel& m_model;
+	size_t m_thread;
+	const vector<int*>& m_sequences;
+	const vector<int>& m_lengths;
+	size_t m_chunkSize;
+	std::string& m_error;
+
+public:
+	GHiddenMarkovModelWorker(GMasterThread& master, GHiddenMarkovModel& model, size_t thread, const vector<int*>& sequences, const vector<int>& lengths, size_t chunkSize, std::string& error)
+	: GWorkerThread(master), m_model(model), m_thread(thread), m_sequences(sequences), m_lengths(lengths), m_chunkSize(chunkSize), m_error(error)
+	{
+	}
+
+	virtual ~GHiddenMarkovModelWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		// Exceptions must not escape from a worker thread, so they are reported back to the master
+		try
+		{
+			size_t end = std::min(m_sequences.size(), (jobId + 1) * m_chunkSize);
+			for(size_t i = jobId * m_chunkSize; i < end; i++)
+				m_model.baumWelchAddSequence(m_sequences[i], m_lengths[i], m_thread);
+		}
+		catch(const std::exception& e)
+		{
+			GSpinLockHolder hLock(m_master.getLock(), "GHiddenMarkovModelWorker::doJob");
+			m_error = e.what();
+		}
+	}
+};
+
+} // namespace GClasses
+
 GHiddenMarkovModel::GHiddenMarkovModel(int stateCount, int symbolCount)
-: m_stateCount(stateCount), m_symbolCount(symbolCount), m_pTrainingBuffer(NULL)
+: m_stateCount(stateCount), m_symbolCount(symbolCount), m_workerThreads(1)
 {
 	int modelSize = m_stateCount + m_stateCount * m_stateCount + m_stateCount * m_symbolCount;
 	m_pInitialStateProbabilities = new double[modelSize];
@@ -43,255 +114,287 @@ GHiddenMarkovModel::GHiddenMarkovModel(int stateCount, int symbolCount)
 
 GHiddenMarkovModel::~GHiddenMarkovModel()
 {
+	baumWelchEndTraining();
 	delete[] m_pInitialStateProbabilities;
-	delete[] m_pTrainingBuffer;
+}
+
+void GHiddenMarkovModel::checkObservations(const int* pObservations, int len)
+{
+	for(int i = 0; i < len; i++)
+	{
+		if(pObservations[i] < 0 || pObservations[i] >= m_symbolCount)
+			throw Ex("Observation ", to_str(pObservations[i]), " is out of range. Expected a symbol from 0 to ", to_str(m_symbolCount - 1));
+	}
+}
+
+// Computes pDest += scalar * pSource. (The loop is simple enough for the compiler to vectorize.)
+void GHMM_addScaled(double* pDest, double scalar, const double* pSource, size_t size)
+{
+	for(size_t i = 0; i < size; i++)
+		pDest[i] += scalar * pSource[i];
+}
+
+// Returns the dot product of two vectors
+double GHMM_dot(const double* pA, const double* pB, size_t size)
+{
+	double d = 0.0;
+	for(size_t i = 0; i < size; i++)
+		d += pA[i] * pB[i];
+	return d;
+}
+
+void GHMM_setAll(double* pVector, double val, size_t size)
+{
+	for(size_t i = 0; i < size; i++)
+		pVector[i] = val;
+}
+
+void GHMM_sumToOne(double* pVector, size_t size)
+{
+	GConstVecWrapper vw(pVector, size);
+	double sum = vw.vec().sum();
+	if(sum == 0)
+		GHMM_setAll(pVector, 1.0 / size, size);
+	else
+	{
+		for(size_t i = 0; i < size; i++)
+			pVector[i] *= (1.0 / sum);
+	}
 }
 
 double GHiddenMarkovModel::forwardAlgorithm(const int* pObservations, int len)
 {
+	if(len < 1)
+		return 0.0;
+	checkObservations(pObservations, len);
+
 	// Compute probabilities of initial observation
-	GVec cur(m_stateCount);
-	GVec prev(m_stateCount);
+	size_t states = m_stateCount;
+	GVec cur(states);
+	GVec prev(states);
 	GVec* pCur = &cur;
 	GVec* pPrev = &prev;
-	double logProb = 0;
-	for(int j = 0; j < m_stateCount; j++)
-		(*pCur)[j] = m_pInitialStateProbabilities[j] * m_pSymbolProbabilities[m_symbolCount * j + pObservations[0]];
+	for(size_t j = 0; j < states; j++)
+		cur[j] = m_pInitialStateProbabilities[j] * m_pSymbolProbabilities[m_symbolCount * j + pObservations[0]];
+	double sum = cur.sum();
+	if(sum <= 0.0)
+		return -HUGE_VAL;
+	double logProb = log(sum);
+	cur *= (1.0 / sum);
 
 	// Do the rest
 	for(int i = 1; i < len; i++)
 	{
-		// Compute probabilities for the next time step
+		// Compute probabilities for the next time step. (Each row of the transition matrix is
+		// scaled and added, so the inner loop runs over contiguous states.)
 		std::swap(pPrev, pCur);
-		for(int j = 0; j < m_stateCount; j++)
+		pCur->fill(0.0);
+		for(size_t k = 0; k < states; k++)
 		{
-			(*pCur)[j] = 0;
-			for(int k = 0; k < m_stateCount; k++)
-				(*pCur)[j] += (*pPrev)[k] * m_pTransitionProbabilities[m_stateCount * j + k];
-			(*pCur)[j] *= m_pSymbolProbabilities[m_symbolCount * j + pObservations[i]];
+			if((*pPrev)[k] != 0.0)
+				GHMM_addScaled(pCur->data(), (*pPrev)[k], m_pTransitionProbabilities + states * k, states);
 		}
+		for(size_t j = 0; j < states; j++)
+			(*pCur)[j] *= m_pSymbolProbabilities[m_symbolCount * j + pObservations[i]];
 
 		// Normalize to preserve numerical stability
-		double sum = (*pCur).sum();
+		sum = pCur->sum();
+		if(sum <= 0.0)
+			return -HUGE_VAL;
 		(*pCur) *= (1.0 / sum);
 		logProb += log(sum);
 	}
-
-	// Sum to get final probabilities
-	logProb += log((*pCur).sum());
 	return logProb;
 }
 
 double GHiddenMarkovModel::viterbi(int* pMostLikelyStates, const int* pObservations, int len)
 {
-	// Compute probabilities of initial observation
-	GTEMPBUF(int, backpointers, m_stateCount * (len - 1));
-	GVec cur(m_stateCount);
-	GVec prev(m_stateCount);
+	if(len < 1)
+		return 0.0;
+	checkObservations(pObservations, len);
+
+	// Take the log of the transition probabilities, transposed so that the
+	// predecessors of each state are contiguous
+	size_t states = m_stateCount;
+	GVec logTrans(states * states);
+	for(size_t j = 0; j < states; j++)
+	{
+		for(size_t k = 0; k < states; k++)
+			logTrans[states * j + k] = log(m_pTransitionProbabilities[states * k + j]);
+	}
+
+	// Compute log probabilities of initial observation
+	vector<int> backpointers(states * (len - 1));
+	GVec cur(states);
+	GVec prev(states);
 	GVec* pCur = &cur;
 	GVec* pPrev = &prev;
-	double logProb = 0;
-	for(int j = 0; j < m_stateCount; j++)
-		(*pCur)[j] = m_pInitialStateProbabilities[j] * m_pSymbolProbabilities[m_symbolCount * j + pObservations[0]];
+	for(size_t j = 0; j < states; j++)
+		cur[j] = log(m_pInitialStateProbabilities[j]) + log(m_pSymbolProbabilities[m_symbolCount * j + pObservations[0]]);
 
 	// Do the rest
 	for(int i = 1; i < len; i++)
 	{
-		// Compute probabilities for the next time step
 		std::swap(pPrev, pCur);
-		for(int j = 0; j < m_stateCount; j++)
+		for(size_t j = 0; j < states; j++)
 		{
-			(*pCur)[j] = 0;
-			int index = 0;
-			for(int k = 0; k < m_stateCount; k++)
+			const double* pLogTrans = logTrans.data() + states * j;
+			double best = -HUGE_VAL;
+			size_t index = 0;
+			for(size_t k = 0; k < states; k++)
 			{
-				double p = (*pPrev)[k] * m_pTransitionProbabilities[m_stateCount * j + k];
-				if(p >= (*pCur)[j])
+				double p = (*pPrev)[k] + pLogTrans[k];
+				if(p > best)
 				{
-					(*pCur)[j] = p;
+					best = p;
 					index = k;
 				}
 			}
-			(*pCur)[j] *= m_pSymbolProbabilities[m_symbolCount * j + pObservations[i]];
-			backpointers[m_stateCount * (i - 1) + j] = index;
+			(*pCur)[j] = best + log(m_pSymbolProbabilities[m_symbolCount * j + pObservations[i]]);
+			backpointers[states * (i - 1) + j] = (int)index;
 		}
-
-		// Normalize to preserve numerical stability
-		double sum = (*pCur).sum();
-		(*pCur) *= (1.0 / sum);
-		logProb += log(sum);
 	}
 
 	// Find the best path
-	int index = 0;
-	for(int j = 1; j < m_stateCount; j++)
+	size_t index = 0;
+	for(size_t j = 1; j < states; j++)
 	{
 		if((*pCur)[j] > (*pCur)[index])
 			index = j;
 	}
-	pMostLikelyStates[m_stateCount - 1] = index;
-	for(int i = m_stateCount - 2; i >= 0; i--)
-	{
-		pMostLikelyStates[i] = backpointers[m_stateCount * i + index];
-		index = pMostLikelyStates[i];
-	}
-	logProb += log((*pCur)[index]);
-	return logProb;
-}
-
-void GHiddenMarkovModel::baumWelchBeginTraining(int maxLen)
-{
-	// ensure that the buffers are allocated for alpha and beta
-	m_maxLen = maxLen;
-	delete[] m_pTrainingBuffer;
-	m_pTrainingBuffer = new double[
-			m_stateCount + // initial state probabilities accumulator
-			m_stateCount * m_stateCount + // transition probabilities accumulator
-			m_stateCount * m_symbolCount + // symbol probabilities accumulator
-			m_stateCount * maxLen + // beta
-			m_stateCount + // alpha cur
-			m_stateCount + // alpha prev
-			m_stateCount + // gamma
-			m_stateCount * m_stateCount // xi
-		];
+	pMostLikelyStates[len - 1] = (int)index;
+	for(int i = len - 2; i >= 0; i--)
+		pMostLikelyStates[i] = backpointers[states * i + pMostLikelyStates[i + 1]];
+	return (*pCur)[index];
 }
 
-void GHMM_setAll(double* pVector, double val, size_t size)
+void GHiddenMarkovModel::baumWelchBeginTraining(int maxLen, size_t threads)
 {
-	for(size_t i = 0; i < size; i++)
-		pVector[i] = val;
+	baumWelchEndTraining();
+	for(size_t i = 0; i < threads; i++)
+		m_accumulators.push_back(new GHiddenMarkovModelAccumulator(m_stateCount, m_symbolCount, std::max(1, maxLen)));
+	m_symbolsByState.resize(m_stateCount * m_symbolCount);
 }
 
 void GHiddenMarkovModel::baumWelchBeginPass()
 {
 	// Reset the accumulators
-	double* pAccumInitProb = m_pTrainingBuffer;
-	double* pAccumTransProb = pAccumInitProb + m_stateCount;
-	double* pAccumSymbolProb = pAccumTransProb + m_stateCount * m_stateCount;
-	GHMM_setAll(pAccumInitProb, 0.0, m_stateCount);
-	GHMM_setAll(pAccumTransProb, 0.0, m_stateCount * m_stateCount);
-	GHMM_setAll(pAccumSymbolProb, 0.0, m_stateCount * m_symbolCount);
-}
+	for(size_t i = 0; i < m_accumulators.size(); i++)
+		m_accumulators[i]->reset();
 
-void GHMM_sumToOne(double* pVector, size_t size)
-{
-	GConstVecWrapper vw(pVector, size);
-	double sum = vw.vec().sum();
-	if(sum == 0)
-		GHMM_setAll(pVector, 1.0 / size, size);
-	else
+	// Transpose the symbol probabilities so the emission probabilities of all states are contiguous
+	for(int j = 0; j < m_stateCount; j++)
 	{
-		for(size_t i = 0; i < size; i++)
-			pVector[i] *= (1.0 / sum);
+		for(int k = 0; k < m_symbolCount; k++)
+			m_symbolsByState[m_stateCount * k + j] = m_pSymbolProbabilities[m_symbolCount * j + k];
 	}
 }
 
-void GHiddenMarkovModel::backwardAlgorithm(const int* pObservations, int len)
+void GHiddenMarkovModel::backwardAlgorithm(const int* pObservations, int len, GHiddenMarkovModelAccumulator& acc)
 {
 	// Initialize probabilities of the last state
-	double* pBeta = m_pTrainingBuffer + m_stateCount + m_stateCount * m_stateCount + m_stateCount * m_symbolCount;
-	double* pCur = pBeta + m_stateCount * (len - 1);
-	for(int j = 0; j < m_stateCount; j++)
-	{
-		*pCur = 1.0;
-		pCur++;
-	}
+	size_t states = m_stateCount;
+	double* pBeta = acc.m_beta.data();
+	GHMM_setAll(pBeta + states * (len - 1), 1.0, states);
 
 	// Induct backwards
+	double* pTmp = acc.m_tmp.data();
 	for(int i = len - 2; i >= 0; i--)
 	{
-		for(int j = 0; j < m_stateCount; j++)
-		{
-			double d = 0;
-			for(int k = 0; k < m_stateCount; k++)
-				d += 	m_pTransitionProbabilities[m_stateCount * j + k] *
-					m_pSymbolProbabilities[m_symbolCount * k + pObservations[i + 1]] *
-					pBeta[m_stateCount * (i + 1) + k];
-			pBeta[m_stateCount * i + j] = d;
-		}
+		const double* pEmit = m_symbolsByState.data() + states * pObservations[i + 1];
+		const double* pNext = pBeta + states * (i + 1);
+		for(size_t k = 0; k < states; k++)
+			pTmp[k] = pEmit[k] * pNext[k];
+		double* pCur = pBeta + states * i;
+		for(size_t j = 0; j < states; j++)
+			pCur[j] = GHMM_dot(m_pTransitionProbabilities + states * j, pTmp, states);
 
 		// Normalize to preserve numerical stability
-		pCur = pBeta + m_stateCount * i;
-		GHMM_sumToOne(pCur, m_stateCount);
+		GHMM_sumToOne(pCur, states);
 	}
 }
 
-void GVec_add(double* pDest, const double* pSource, size_t nDims)
+void GHiddenMarkovModel::baumWelchAddSequence(const int* pObservations, int len, size_t thread)
 {
-	for(size_t i = 0; i < nDims; i++)
-	{
-		*pDest += *pSource;
-		pDest++;
-		pSource++;
-	}
-}
+	if(len < 1)
+		return;
+	GHiddenMarkovModelAccumulator& acc = *m_accumulators[thread];
+	if(acc.m_beta.size() < (size_t)m_stateCount * len)
+		throw Ex("The sequence is longer than the maximum length specified when training began");
 
-void GHiddenMarkovModel::baumWelchAddSequence(const int* pObservations, int len)
-{
 	// Do backward algorithm to obtain beta values
-	backwardAlgorithm(pObservations, len);
+	backwardAlgorithm(pObservations, len, acc);
 
 	// Do forward algorithm to update accumulators
-	double* pAccumInitProb = m_pTrainingBuffer;
-	double* pAccumTransProb = pAccumInitProb + m_stateCount;
-	double* pAccumSymbolProb = pAccumTransProb + m_stateCount * m_stateCount;
-	double* pBeta = pAccumSymbolProb + m_stateCount * m_symbolCount;
-	double* pCur = pBeta + m_stateCount * m_maxLen;
-	double* pPrev = pCur + m_stateCount;
-	double* pGamma = pPrev + m_stateCount;
-	double* pXi = pGamma + m_stateCount;
+	size_t states = m_stateCount;
+	const double* pBeta = acc.m_beta.data();
+	double* pCur = acc.m_cur.data();
+	double* pPrev = acc.m_prev.data();
+	double* pGamma = acc.m_gamma.data();
+	double* pTmp = acc.m_tmp.data();
+	double* pAccumTransProb = acc.m_transition.data();
 	for(int i = 0; i < len; i++)
 	{
 		// Compute alpha values
+		const double* pEmit = m_symbolsByState.data() + states * pObservations[i];
 		if(i == 0)
 		{
 			// Compute initial alpha values
-			for(int j = 0; j < m_stateCount; j++)
-				pCur[j] = m_pInitialStateProbabilities[j] * m_pSymbolProbabilities[m_symbolCount * j + pObservations[0]];
+			for(size_t j = 0; j < states; j++)
+				pCur[j] = m_pInitialStateProbabilities[j] * pEmit[j];
 		}
 		else
 		{
 			// Compute probabilities for the next time step
 			std::swap(pPrev, pCur);
-			for(int j = 0; j < m_stateCount; j++)
+			GHMM_setAll(pCur, 0.0, states);
+			for(size_t k = 0; k < states; k++)
 			{
-				pCur[j] = 0;
-				for(int k = 0; k < m_stateCount; k++)
-					pCur[j] += pPrev[k] * m_pTransitionProbabilities[m_stateCount * j + k];
-				pCur[j] *= m_pSymbolProbabilities[m_symbolCount * j + pObservations[i]];
+				if(pPrev[k] != 0.0)
+					GHMM_addScaled(pCur, pPrev[k], m_pTransitionProbabilities + states * k, states);
 			}
+			for(size_t j = 0; j < states; j++)
+				pCur[j] *= pEmit[j];
 		}
 
 		// Normalize to preserve numerical stability
-		GHMM_sumToOne(pCur, m_stateCount);
+		GHMM_sumToOne(pCur, states);
+
+		// Compute gamma
+		for(size_t j = 0; j < states; j++)
+			pGamma[j] = pCur[j] * pBeta[states * i + j];
+		GHMM_sumToOne(pGamma, states);
 
-		// Compute xi and gamma
-		for(int j = 0; j < m_stateCount; j++)
+		// Accumulate xi, which is proportional to alpha[i][j] * trans[j][k] * emit[k][o[i + 1]] * beta[i + 1][k]
+		if(i < len - 1)
 		{
-			pGamma[j] = pCur[j] * pBeta[m_stateCount * i + j];
-			if(i < len - 1)
+			const double* pNextEmit = m_symbolsByState.data() + states * pObservations[i + 1];
+			const double* pNextBeta = pBeta + states * (i + 1);
+			for(size_t k = 0; k < states; k++)
+				pTmp[k] = pNextEmit[k] * pNextBeta[k];
+			double sum = 0.0;
+			for(size_t j = 0; j < states; j++)
+				sum += pCur[j] * GHMM_dot(m_pTransitionProbabilities + states * j, pTmp, states);
+			if(sum > 0.0)
 			{
-				for(int k = 0; k < m_stateCount; k++)
+				for(size_t j = 0; j < states; j++)
 				{
-					pXi[m_stateCount * j + k] =
-						pCur[j] *
-						m_pTransitionProbabilities[m_stateCount * j + k] *
-						m_pSymbolProbabilities[m_symbolCount * j + pObservations[i]] *
-						pBeta[m_stateCount * (i + 1) + k];
+					double a = pCur[j] / sum;
+					if(a == 0.0)
+						continue;
+					const double* pTrans = m_pTransitionProbabilities + states * j;
+					double* pAccum = pAccumTransProb + states * j;
+					for(size_t k = 0; k < states; k++)
+						pAccum[k] += a * pTrans[k] * pTmp[k];
 				}
 			}
 		}
-		GHMM_sumToOne(pGamma, m_stateCount);
-		if(i < len - 1)
-			GHMM_sumToOne(pXi, m_stateCount * m_stateCount);
 
 		// Accumulate probabilities
-		if(i ==  0)
-			GVec_add(pAccumInitProb, pGamma, m_stateCount);
-		if(i < len - 1)
-			GVec_add(pAccumTransProb, pXi, m_stateCount * m_stateCount);
-		for(int j = 0; j < m_stateCount; j++)
-			pAccumSymbolProb[m_symbolCount * j + pObservations[i]] += pGamma[j];
+		if(i == 0)
+			acc.m_initial += acc.m_gamma;
+		for(size_t j = 0; j < states; j++)
+			acc.m_symbol[m_symbolCount * j + pObservations[i]] += pGamma[j];
 	}
 }
 
@@ -311,10 +414,19 @@ double GHMM_sqDist(const double* pA, const double* pB, size_t nDims)
 
 double GHiddenMarkovModel::baumWelchEndPass()
 {
+	// Merge the accumulators of all the threads into the first one
+	GHiddenMarkovModelAccumulator& acc = *m_accumulators[0];
+	for(size_t i = 1; i < m_accumulators.size(); i++)
+	{
+		acc.m_initial += m_accumulators[i]->m_initial;
+		acc.m_transition += m_accumulators[i]->m_transition;
+		acc.m_symbol += m_accumulators[i]->m_symbol;
+	}
+
 	// Normalize all of the probabilities
-	double* pAccumInitProb = m_pTrainingBuffer;
-	double* pAccumTransProb = pAccumInitProb + m_stateCount;
-	double* pAccumSymbolProb = pAccumTransProb + m_stateCount * m_stateCount;
+	double* pAccumInitProb = acc.m_initial.data();
+	double* pAccumTransProb = acc.m_transition.data();
+	double* pAccumSymbolProb = acc.m_symbol.data();
 	GHMM_sumToOne(pAccumInitProb, m_stateCount);
 	for(int i = 0; i < m_stateCount; i++)
 	{
@@ -338,8 +450,9 @@ double GHiddenMarkovModel::baumWelchEndPass()
 
 void GHiddenMarkovModel::baumWelchEndTraining()
 {
-	delete[] m_pTrainingBuffer;
-	m_pTrainingBuffer = NULL;
+	for(size_t i = 0; i < m_accumulators.size(); i++)
+		delete(m_accumulators[i]);
+	m_accumulators.clear();
 }
 
 void GHiddenMarkovModel::baumWelch(vector<int*>& sequences, vector<int>& lengths, int maxPasses)
@@ -348,14 +461,40 @@ void GHiddenMarkovModel::baumWelch(vector<int*>& sequences, vector<int>& lengths
 		throw Ex("Expected both vectors to have the same size");
 	int maxLen = 0;
 	for(size_t i = 0; i < lengths.size(); i++)
+	{
+		checkObservations(sequences[i], lengths[i]);
 		maxLen = std::max(maxLen, lengths[i]);
-	baumWelchBeginTraining(maxLen);
+	}
+
+	// Each chunk of sequences is a job, and each thread accumulates into its own buffers
+	size_t chunkSize = 16;
+	size_t chunks = (sequences.size() + chunkSize - 1) / chunkSize;
+	size_t threads = std::max((size_t)1, std::min(m_workerThreads, chunks));
+	baumWelchBeginTraining(maxLen, threads);
 	double prevErr = 1e200;
 	while(maxPasses > 0)
 	{
 		baumWelchBeginPass();
-		for(size_t i = 0; i < lengths.size(); i++)
-			baumWelchAddSequence(sequences[i], lengths[i]);
+		if(threads > 1)
+		{
+			std::string error;
+			{
+				GMasterThread master;
+				for(size_t i = 0; i < threads; i++)
+					master.addWorker(new GHiddenMarkovModelWorker(master, *this, i, sequences, lengths, chunkSize, error));
+				master.doJobs(chunks);
+			}
+			if(error.length() > 0)
+			{
+				baumWelchEndTraining();
+				throw Ex(error);
+			}
+		}
+		else
+		{
+			for(size_t i = 0; i < lengths.size(); i++)
+				baumWelchAddSequence(sequences[i], lengths[i]);
+		}
 		double err = baumWelchEndPass();
 		if(err <= 0)
 			break;
@@ -369,9 +508,152 @@ void GHiddenMarkovModel::baumWelch(vector<int*>& sequences, vector<int>& lengths
 }
 
 #ifndef NO_TEST_CODE
+void GHiddenMarkovModel_randomModel(GHiddenMarkovModel& hmm, size_t states, size_t symbols, GRand& rand)
+{
+	GVecWrapper init(hmm.initialStateProbabilities(), states);
+	init.vec().fillSimplex(rand);
+	for(size_t i = 0; i < states; i++)
+	{
+		GVecWrapper trans(hmm.transitionProbabilities() + states * i, states);
+		trans.vec().fillSimplex(rand);
+		GVecWrapper sym(hmm.symbolProbabilities() + symbols * i, symbols);
+		sym.vec().fillSimplex(rand);
+	}
+}
+
+size_t GHiddenMarkovModel_draw(const double* pProbs, size_t size, GRand& rand)
+{
+	double r = rand.uniform();
+	for(size_t i = 0; i + 1 < size; i++)
+	{
+		r -= pProbs[i];
+		if(r < 0.0)
+			return i;
+	}
+	return size - 1;
+}
+
+void GHiddenMarkovModel_sample(GHiddenMarkovModel& hmm, size_t states, size_t symbols, int* pSeq, int len, GRand& rand)
+{
+	size_t state = GHiddenMarkovModel_draw(hmm.initialStateProbabilities(), states, rand);
+	for(int i = 0; i < len; i++)
+	{
+		pSeq[i] = (int)GHiddenMarkovModel_draw(hmm.symbolProbabilities() + symbols * state, symbols, rand);
+		state = GHiddenMarkovModel_draw(hmm.transitionProbabilities() + states * state, states, rand);
+	}
+}
+
+void GHiddenMarkovModel_testAgainstBruteForce()
+{
+	// Enumerate every state sequence of a small model with asymmetric transitions
+	GRand rand(0);
+	const size_t states = 3;
+	const size_t symbols = 4;
+	const int len = 6;
+	GHiddenMarkovModel hmm(states, symbols);
+	GHiddenMarkovModel_randomModel(hmm, states, symbols, rand);
+	int seq[len];
+	GHiddenMarkovModel_sample(hmm, states, symbols, seq, len, rand);
+	double* pInit = hmm.initialStateProbabilities();
+	double* pTrans = hmm.transitionProbabilities();
+	double* pSym = hmm.symbolProbabilities();
+	double total = 0.0;
+	double best = 0.0;
+	int path[len];
+	int bestPath[len];
+	size_t paths = 1;
+	for(int i = 0; i < len; i++)
+		paths *= states;
+	for(size_t p = 0; p < paths; p++)
+	{
+		size_t code = p;
+		for(int i = 0; i < len; i++)
+		{
+			path[i] = (int)(code % states);
+			code /= states;
+		}
+		double prob = pInit[path[0]] * pSym[symbols * path[0] + seq[0]];
+		for(int i = 1; i < len; i++)
+			prob *= pTrans[states * path[i - 1] + path[i]] * pSym[symbols * path[i] + seq[i]];
+		total += prob;
+		if(prob > best)
+		{
+			best = prob;
+			memcpy(bestPath, path, sizeof(int) * len);
+		}
+	}
+	if(std::abs(hmm.forwardAlgorithm(seq, len) - log(total)) > 1e-10)
+		throw Ex("forwardAlgorithm disagrees with brute force");
+	if(std::abs(hmm.viterbi(path, seq, len) - log(best)) > 1e-10)
+		throw Ex("viterbi disagrees with brute force");
+	for(int i = 0; i < len; i++)
+	{
+		if(path[i] != bestPath[i])
+			throw Ex("viterbi found the wrong path");
+	}
+}
+
+void GHiddenMarkovModel_testParallel()
+{
+	GRand rand(1);
+	const size_t states = 4;
+	const size_t symbols = 6;
+	GHiddenMarkovModel truth(states, symbols);
+	GHiddenMarkovModel_randomModel(truth, states, symbols, rand);
+
+	// Long sequences must not underflow
+	vector<int> longSeq(100000);
+	GHiddenMarkovModel_sample(truth, states, symbols, longSeq.data(), (int)longSeq.size(), rand);
+	double logProb = truth.forwardAlgorithm(longSeq.data(), (int)longSeq.size());
+	if(!(logProb < 0.0 && logProb > -1e6))
+		throw Ex("forwardAlgorithm underflowed");
+	vector<int> path(longSeq.size());
+	double logPath = truth.viterbi(path.data(), longSeq.data(), (int)longSeq.size());
+	if(!(logPath <= logProb && logPath > -1e6))
+		throw Ex("viterbi underflowed");
+
+	// Training with several threads should only differ by rounding
+	vector< vector<int> > data(300);
+	vector<int*> sequences;
+	vector<int> lengths;
+	for(size_t i = 0; i < data.size(); i++)
+	{
+		data[i].resize(20 + (size_t)rand.next(60));
+		GHiddenMarkovModel_sample(truth, states, symbols, data[i].data(), (int)data[i].size(), rand);
+		sequences.push_back(data[i].data());
+		lengths.push_back((int)data[i].size());
+	}
+	GHiddenMarkovModel serial(states, symbols);
+	GHiddenMarkovModel_randomModel(serial, states, symbols, rand);
+	GHiddenMarkovModel parallel(states, symbols);
+	size_t modelSize = states + states * states + states * symbols;
+	memcpy(parallel.initialStateProbabilities(), serial.initialStateProbabilities(), sizeof(double) * modelSize);
+	double before = 0.0;
+	for(size_t i = 0; i < sequences.size(); i++)
+		before += serial.forwardAlgorithm(sequences[i], lengths[i]);
+	serial.baumWelch(sequences, lengths, 5);
+	parallel.setWorkerThreads(4);
+	parallel.baumWelch(sequences, lengths, 5);
+	for(size_t i = 0; i < modelSize; i++)
+	{
+		if(std::abs(serial.initialStateProbabilities()[i] - parallel.initialStateProbabilities()[i]) > 1e-9)
+			throw Ex("The number of threads changed the model");
+	}
+
+	// Baum-Welch should improve the likelihood
+	double after = 0.0;
+	for(size_t i = 0; i < sequences.size(); i++)
+		after += serial.forwardAlgorithm(sequences[i], lengths[i]);
+	if(after <= before)
+		throw Ex("Baum-Welch did not improve the likelihood");
+}
+
 // static
 void GHiddenMarkovModel::test()
 {
+	GHiddenMarkovModel_testAgainstBruteForce();
+	GHiddenMarkovModel_testParallel();
+
 	GHiddenMarkovModel hmm(2, 2);
 
 	// Set priors
@@ -399,13 +681,13 @@ void GHiddenMarkovModel::test()
 		throw Ex("wrong");
 	if(std::abs(pInitial[1] - 0.70150033979821202) > 1e-12)
 		throw Ex("wrong");
-	if(std::abs(pTrans[0] - 0.40399443180411687) > 1e-12)
+	if(std::abs(pTrans[0] - 0.39030955585464333) > 1e-12)
 		throw Ex("wrong");
-	if(std::abs(pTrans[1] - 0.59600556819588313) > 1e-12)
+	if(std::abs(pTrans[1] - 0.60969044414535670) > 1e-12)
 		throw Ex("wrong");
-	if(std::abs(pTrans[2] - 0.61206063945288547) > 1e-12)
+	if(std::abs(pTrans[2] - 0.66072245084590760) > 1e-12)
 		throw Ex("wrong");
-	if(std::abs(pTrans[3] - 0.38793936054711436) > 1e-12)
+	if(std::abs(pTrans[3] - 0.33927754915409230) > 1e-12)
 		throw Ex("wrong");
 	if(std::abs(pSym[0] - 0.49547467745041401) > 1e-12)
 		throw Ex("wrong");
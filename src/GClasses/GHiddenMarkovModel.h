@@ -21,19 +21,28 @@
 #define __GHMM_H__
 
 #include <vector>
+#include <cstddef>
 
 namespace GClasses {
 
+class GHiddenMarkovModelAccumulator;
+
+/// A hidden Markov model with discrete observations. The forward-backward
+/// computations are scaled at every time step, and Viterbi is computed in
+/// log space, so long sequences do not underflow. Baum-Welch can process
+/// many sequences in parallel.
 class GHiddenMarkovModel
 {
+friend class GHiddenMarkovModelWorker;
 protected:
 	int m_stateCount;
 	int m_symbolCount;
 	double* m_pInitialStateProbabilities;
 	double* m_pTransitionProbabilities;
 	double* m_pSymbolProbabilities;
-	double* m_pTrainingBuffer;
-	int m_maxLen;
+	size_t m_workerThreads;
+	std::vector<double> m_symbolsByState; // the symbol probabilities transposed, so each symbol's column is contiguous
+	std::vector<GHiddenMarkovModelAccumulator*> m_accumulators; // one per thread during Baum-Welch
 
 public:
 	GHiddenMarkovModel(int stateCount, int symbolCount);
@@ -57,13 +66,18 @@ public:
 	/// observing symbol j when in state i.
 	double* symbolProbabilities() { return m_pSymbolProbabilities; }
 
+	/// Specifies the number of threads that baumWelch uses to process the
+	/// sequences. (The default is 1. Each thread accumulates its own expected
+	/// counts, so different numbers of threads may differ by rounding error.)
+	void setWorkerThreads(size_t n) { m_workerThreads = (n > 1 ? n : 1); }
+
 	/// Calculates the log probability that the specified observation
 	/// sequence would occur with this model.
 	double forwardAlgorithm(const int* pObservations, int len);
 
 	/// Finds the most likely state sequence to explain the specified
-	/// observation sequence, and also returns the log probability of
-	/// that state sequence given the observation sequence.
+	/// observation sequence, and also returns the log of the joint probability
+	/// of that state sequence and the observation sequence.
 	double viterbi(int* pMostLikelyStates, const int* pObservations, int len);
 
 	/// Uses expectation maximization to refine the model based on
@@ -73,12 +87,26 @@ public:
 	void baumWelch(std::vector<int*>& sequences, std::vector<int>& lengths, int maxPasses = 0x7fffffff);
 
 protected:
-	void backwardAlgorithm(const int* pObservations, int len);
-	void baumWelchBeginTraining(int maxLen);
+	/// Computes the scaled beta values of the specified sequence in the accumulator's buffer
+	void backwardAlgorithm(const int* pObservations, int len, GHiddenMarkovModelAccumulator& acc);
+
+	/// Allocates an accumulator for each thread
+	void baumWelchBeginTraining(int maxLen, size_t threads = 1);
+
+	/// Resets the accumulators
 	void baumWelchBeginPass();
-	void baumWelchAddSequence(const int* pObservations, int len);
+
+	/// Adds the expected counts of a sequence to the accumulator of the specified thread
+	void baumWelchAddSequence(const int* pObservations, int len, size_t thread = 0);
+
+	/// Merges the accumulators into a new model, and returns the squared change of the model
 	double baumWelchEndPass();
+
+	/// Deletes the accumulators
 	void baumWelchEndTraining();
+
+	/// Throws if any of the observations is not a valid symbol
+	void checkObservations(const int* pObservations, int len);
 };
 
 } // namespace GClasses
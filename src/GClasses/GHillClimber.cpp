@@ -150,6 +150,8 @@ GVec& GHillClimber::stepSizes()
 	double accel = m_pStepSizes[m_dim] / m_dChangeFactor;
 	if(std::abs(accel) > 1e14)
 		accel = 0.1;
+	if(m_workerThreads > 1)
+		return iterateParallel(decel, accel);
 	if(!m_pCritic->isStable())
 		m_dError = m_pCritic->computeError(m_pVector); // Current spot
 	m_pVector[m_dim] += decel;
@@ -223,6 +225,74 @@ GVec& GHillClimber::stepSizes()
 	return m_dError;
 }
 
+double GHillClimber::iterateParallel(double decel, double accel)
+{
+	// Make the candidates: forward decelerated, forward accelerated, reverse
+	// decelerated, reverse accelerated, and the current spot if the critic is not stable
+	bool stable = m_pCritic->isStable();
+	double base = m_pVector[m_dim];
+	double offsets[4] = { decel, accel, -decel, -accel };
+	GMatrix cands(stable ? 4 : 5, m_nDims);
+	std::vector<const GVec*> pCands;
+	for(size_t i = 0; i < cands.rows(); i++)
+	{
+		cands[i].copy(m_pVector);
+		if(i < 4)
+			cands[i][m_dim] = base + offsets[i];
+		pCands.push_back(&cands[i]);
+	}
+	GVec errors;
+	computeErrors(pCands, errors);
+	if(!stable)
+		m_dError = errors[4];
+
+	// Pick a move the same way iterate does
+	double decScore = errors[0];
+	double accScore = errors[1];
+	if(m_dError < decScore && m_dError < accScore)
+	{
+		decScore = errors[2];
+		accScore = errors[3];
+		if(m_dError < decScore && m_dError < accScore)
+			m_pStepSizes[m_dim] = decel; // Stay put and decelerate
+		else if(decScore < accScore)
+		{
+			// Reverse and decelerate
+			m_pVector[m_dim] = base - decel;
+			m_dError = decScore;
+			m_pStepSizes[m_dim] = -decel;
+		}
+		else
+		{
+			// Reverse and accelerate
+			m_pVector[m_dim] = base - accel;
+			m_dError = accScore;
+			m_pStepSizes[m_dim] = -accel;
+		}
+	}
+	else if(decScore < accScore)
+	{
+		// Forward and decelerate
+		m_pVector[m_dim] = base + decel;
+		m_dError = decScore;
+		m_pStepSizes[m_dim] = decel;
+	}
+	else
+	{
+		// Forward and accelerate. (On a plateau, keep the same step size.)
+		m_pVector[m_dim] = base + accel;
+		if(decScore != accScore || m_dError != decScore)
+		{
+			m_dError = accScore;
+			m_pStepSizes[m_dim] = accel;
+		}
+	}
+
+	if(++m_dim >= m_nDims)
+		m_dim = 0;
+	return m_dError;
+}
+
 double GHillClimber::anneal(double dev, GRand* pRand)
 {
 	if(!m_pCritic->isStable())
@@ -243,9 +313,17 @@ double GHillClimber::anneal(double dev, GRand* pRand)
 // static
 void GHillClimber::test()
 {
-	GOptimizerBasicTestTargetFunction target;
-	GHillClimber opt(&target);
-	opt.basicTest(1.39e-17);
+	{
+		GOptimizerBasicTestTargetFunction target;
+		GHillClimber opt(&target);
+		opt.basicTest(1.39e-17);
+	}
+	{
+		GOptimizerBasicTestTargetFunction target;
+		GHillClimber opt(&target);
+		opt.setWorkerThreads(4);
+		opt.basicTest(1e-15, 1.0);
+	}
 }
 #endif
 
@@ -75,6 +75,9 @@ protected:
 /// a lot smaller, a little smaller, same spot, a little bigger, and a lot bigger.
 /// If it picks a smaller adjustment, the step size in that dimension is made smaller.
 /// If it picks a bigger adjustment, the step size in that dimension is made bigger.
+/// Usually the reverse adjustments are only tried if both forward adjustments are
+/// worse. If workerThreads() is bigger than 1, all of them are evaluated at the same
+/// time instead, which takes more evaluations but less time when they are expensive.
 class GHillClimber : public GOptimizer
 {
 protected:
@@ -118,6 +121,10 @@ public:
 
 protected:
 	void reset();
+
+	/// Evaluates all four candidate moves in the current dimension at the same
+	/// time, and then makes the same choice iterate would make.
+	double iterateParallel(double decel, double accel);
 };
 
 
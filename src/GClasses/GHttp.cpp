@@ -29,6 +29,7 @@
 #include <string>
 #include <sstream>
 #include <stdlib.h>
+#include <algorithm>
 
 using std::vector;
 using std::string;
@@ -713,7 +714,7 @@ void GWebSocketClient::onLoseConnection()
 
 
 
-GHttpConnection::GHttpConnection(SOCKET sock) : GTCPConnection(sock), m_pPostBuffer(NULL)
+GHttpConnection::GHttpConnection(SOCKET sock) : GTCPConnection(sock), m_pPostBuffer(NULL), m_bBusy(false)
 {
 	reset();
 }
@@ -777,6 +778,11 @@ protected:
 	{
 		return m_pServer->makeConnection(s);
 	}
+
+	virtual bool isBusy(GTCPConnection* pConn)
+	{
+		return ((GHttpConnection*)pConn)->m_bBusy;
+	}
 };
 
 GHttpServer::GHttpServer(int nPort)
@@ -795,46 +801,56 @@ GHttpServer::~GHttpServer()
 
 bool GHttpServer::process()
 {
-	unsigned char* pIn;
-	char c;
 	bool bDidSomething = false;
 	while(true)
 	{
 		GTCPConnection* pCon;
 		size_t nMessageSize = m_pSocket->receive(m_pReceiveBuf, 2048, &pCon);
-		GHttpConnection* pConn = (GHttpConnection*)pCon;
 		if(nMessageSize == 0)
 			break;
 		bDidSomething = true;
-		pIn = (unsigned char*)m_pReceiveBuf;
-		while(nMessageSize > 0)
+		processData((GHttpConnection*)pCon, (const unsigned char*)m_pReceiveBuf, nMessageSize);
+	}
+	return bDidSomething;
+}
+
+void GHttpServer::processData(GHttpConnection* pConn, const unsigned char* pIn, size_t nMessageSize)
+{
+	char c;
+	while(nMessageSize > 0)
+	{
+		if(pConn->m_bBusy)
 		{
-			if(pConn->m_pPostBuffer)
-			{
-				processPostData(pConn, pIn, nMessageSize);
-				break;
-			}
-			else
+			// The response to the previous request is still being computed, so save the rest for later
+			pConn->m_deferred.append((const char*)pIn, nMessageSize);
+			break;
+		}
+		else if(pConn->m_pPostBuffer)
+		{
+			size_t nPostSize = std::min(nMessageSize, pConn->m_nContentLength - pConn->m_nPos);
+			processPostData(pConn, pIn, nPostSize);
+			pIn += nPostSize;
+			nMessageSize -= nPostSize;
+		}
+		else
+		{
+			// Obtain a single header line
+			while(nMessageSize > 0)
 			{
-				// Obtain a single header line
-				while(nMessageSize > 0)
+				c = *pIn;
+				pConn->m_szLine[pConn->m_nPos++] = c;
+				pIn++;
+				nMessageSize--;
+				if(c == '\n' || pConn->m_nPos >= MAX_HEADER_LEN - 1)
 				{
-					c = *pIn;
-					pConn->m_szLine[pConn->m_nPos++] = c;
-					pIn++;
-					nMessageSize--;
-					if(c == '\n' || pConn->m_nPos >= MAX_HEADER_LEN - 1)
-					{
-						pConn->m_szLine[pConn->m_nPos] = '\0';
-						processHeaderLine(pConn, pConn->m_szLine);
-						pConn->m_nPos = 0;
-						break;
-					}
+					pConn->m_szLine[pConn->m_nPos] = '\0';
+					processHeaderLine(pConn, pConn->m_szLine);
+					pConn->m_nPos = 0;
+					break;
 				}
 			}
 		}
 	}
-	return bDidSomething;
 }
 
 void GHttpServer::beginRequest(GHttpConnection* pConn, int eType, const char* szIn)
@@ -869,17 +885,44 @@ void GHttpServer::onReceiveFullPostRequest(GHttpConnection* pConn)
 {
 	pConn->m_modifiedTime = 0;
 	pConn->m_pContent = pConn->m_pPostBuffer;
-	pConn->doPost(m_stream);
-	delete(pConn->m_pPostBuffer);
-	pConn->m_pPostBuffer = NULL;
 	pConn->m_nPos = 0;
+	onRequest(pConn);
+}
+
+// virtual
+void GHttpServer::onRequest(GHttpConnection* pConn)
+{
+	if(pConn->m_eRequestType == GHttpConnection::Post)
+		pConn->doPost(m_stream);
+	else
+		pConn->doGet(m_stream);
+	string sPayload = m_stream.str();
+	m_stream.str("");
+	m_stream.clear();
+	completeRequest(pConn, sPayload);
+}
+
+void GHttpServer::completeRequest(GHttpConnection* pConn, const std::string& sPayload)
+{
+	pConn->m_bBusy = false;
+	delete[] pConn->m_pPostBuffer; // (The content of a POST request is needed until the response is computed)
+	pConn->m_pPostBuffer = NULL;
 	try
 	{
-		sendResponse(pConn);
+		sendResponse(pConn, sPayload);
 	}
 	catch(std::exception&)
 	{
-		// failed to send response
+		// failed to send response. (The connection has been closed.)
+		return;
+	}
+
+	// Process any data that arrived while the response was being computed
+	if(pConn->m_deferred.size() > 0)
+	{
+		string s;
+		s.swap(pConn->m_deferred);
+		processData(pConn, (const unsigned char*)s.c_str(), s.length());
 	}
 }
 
@@ -916,15 +959,7 @@ void GHttpServer::processHeaderLine(GHttpConnection* pConn, const char* szLine)
 				pConn->m_modifiedTime = 0;
 				pConn->m_nContentLength = strlen(pConn->m_szParams);
 				pConn->m_pContent = pConn->m_szParams;
-				pConn->doGet(m_stream);
-				try
-				{
-					sendResponse(pConn);
-				}
-				catch(std::exception&)
-				{
-					// failed to send response
-				}
+				onRequest(pConn);
 			}
 			else
 			{
@@ -1039,26 +1074,19 @@ void GHttpServer::sendResponse(GHttpConnection* pConn)
 	string sPayload = m_stream.str();
 	m_stream.str("");
 	m_stream.clear();
+	sendResponse(pConn, sPayload);
+}
 
+void GHttpServer::sendResponse(GHttpConnection* pConn, const std::string& sPayload)
+{
 	// Make the header
-	const char pTmp1[] = "HTTP/1.1 200 OK\r\nContent-Type: ";
-	m_pSocket->send(pTmp1, sizeof(pTmp1) - 1, pConn);
-	m_pSocket->send(pConn->m_szContentType, strlen(pConn->m_szContentType), pConn);
-
+	std::ostringstream os;
+	os << "HTTP/1.1 200 OK\r\nContent-Type: " << pConn->m_szContentType << "\r\n";
 	if(pConn->m_eRequestType != GHttpConnection::Head)
-	{
-		std::ostringstream os;
-		os << "\r\nContent-Length: ";
-		os << sPayload.length();
-		os << "\r\n";
-		string s = os.str();
-		m_pSocket->send(s.c_str(), s.length(), pConn);
-	}
+		os << "Content-Length: " << sPayload.length() << "\r\n";
 
 	// Set the date header
 	{
-		std::ostringstream os;
-		os << "Date: ";
 		time_t t = time((time_t*)0);
 #ifdef WINDOWS
 		struct tm thetime;
@@ -1070,47 +1098,36 @@ void GHttpServer::sendResponse(GHttpConnection* pConn)
 		const char* szAscTime = asctime(pTime);
 		char szGMT[40];
 		AscTimeToGMT(szAscTime, szGMT);
-		os << szGMT;
-		os << "\r\n";
-		string s = os.str();
-		m_pSocket->send(s.c_str(), s.length(), pConn);
+		os << "Date: " << szGMT << "\r\n";
 	}
 
 	// Set the last-modified header
 	if(pConn->m_modifiedTime != 0)
 	{
-		std::ostringstream os;
-		os << "Last-Modified: ";
 		struct tm* pTime = gmtime(&pConn->m_modifiedTime);
 		const char* szAscTime = asctime(pTime);
 		char szGMT[40];
 		AscTimeToGMT(szAscTime, szGMT);
-		os << szGMT;
-		os << "\r\n";
-		string s = os.str();
-		m_pSocket->send(s.c_str(), s.length(), pConn);
+		os << "Last-Modified: " << szGMT << "\r\n";
 	}
 
 	// Set cookie
 	if(pConn->m_szCookieOutgoing[0] != '\0')
 	{
-		std::ostringstream os;
-		os << "Set-Cookie: ";
-		os << pConn->m_szCookieOutgoing;
-		os << "; path=/";
+		os << "Set-Cookie: " << pConn->m_szCookieOutgoing << "; path=/";
 		if(pConn->m_bPersistCookie)
 			os << "; expires=Sat, 01-Jan-2060 00:00:00 GMT";
 		os << "\r\n";
-		string s = os.str();
-		m_pSocket->send(s.c_str(), s.length(), pConn);
 	}
 
 	// End of header
-	m_pSocket->send("\r\n", 2, pConn);
+	os << "\r\n";
 
-	// Send the payload
-	if(pConn->m_eRequestType != GHttpConnection::Head)
-		m_pSocket->send(sPayload.c_str(), sPayload.length(), pConn);
+	// Send the header and payload together
+	string sHeader = os.str();
+	const char* bufs[2] = { sHeader.c_str(), sPayload.c_str() };
+	size_t lens[2] = { sHeader.length(), pConn->m_eRequestType != GHttpConnection::Head ? sPayload.length() : 0 };
+	m_pSocket->send(bufs, lens, 2, pConn);
 }
 
 void GHttpServer::sendNotModifiedResponse(GHttpConnection* pConn)
@@ -173,6 +173,8 @@ public:
 	RequestType m_eRequestType;
 	size_t m_nContentLength;
 	time_t m_modifiedTime;
+	bool m_bBusy; // true while the response to the current request is being computed asynchronously
+	std::string m_deferred; // data that arrived while m_bBusy was true. (It is processed after the response is sent.)
 
 	/// General-purpose constructor
 	GHttpConnection(SOCKET sock);
@@ -247,10 +249,23 @@ public:
 
 protected:
 	virtual void onProcessLine(GHttpConnection* pConn, const char* szLine) {}
+
+	/// This is called when a complete GET or POST request has been received. The default
+	/// implementation calls doGet or doPost, and sends the response. An overload may instead
+	/// set pConn->m_bBusy, compute the response on another thread, and then call completeRequest
+	/// on the thread that calls process. (Any data that arrives on pConn in the meantime is deferred.)
+	virtual void onRequest(GHttpConnection* pConn);
+
+	/// Sends sPayload as the response to the current request on pConn, clears pConn->m_bBusy, and
+	/// then processes any data that was deferred while the response was being computed.
+	void completeRequest(GHttpConnection* pConn, const std::string& sPayload);
+
+	void processData(GHttpConnection* pConn, const unsigned char* pIn, size_t nSize);
 	void processPostData(GHttpConnection* pConn, const unsigned char* pData, size_t nDataSize);
 	void processHeaderLine(GHttpConnection* pConn, const char* szLine);
 	void beginRequest(GHttpConnection* pConn, int eType, const char* szIn);
 	void sendResponse(GHttpConnection* pConn);
+	void sendResponse(GHttpConnection* pConn, const std::string& sPayload);
 	void sendNotModifiedResponse(GHttpConnection* pConn);
 	void onReceiveFullPostRequest(GHttpConnection* pConn);
 };
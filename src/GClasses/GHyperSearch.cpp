@@ -0,0 +1,625 @@
+/*
+  The contents of this file are dedicated by all of its authors, including
+
+    Michael S. Gashler,
+    anonymous contributors,
+
+  to the public domain (http://creativecommons.org/publicdomain/zero/1.0/).
+
+  Note that some moral obligations still exist in the absence of legal ones.
+  For example, it would still be dishonest to deliberately misrepresent the
+  origin of a work. Although we impose no legal requirements to obtain a
+  license, it is beseeming for those who build on the works of others to
+  give back useful improvements, or find a way to pay it forward. If
+  you would like to cite us, a published paper about Waffles can be found
+  at http://jmlr.org/papers/volume12/gashler11a/gashler11a.pdf. If you find
+  our code to be useful, the Waffles team would love to hear how you use it.
+*/
+
+#include "GHyperSearch.h"
+#include "GLearner.h"
+#include "GDom.h"
+#include "GFile.h"
+#include "GThread.h"
+#include "GHolders.h"
+#include <cmath>
+#include <cstdio>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <memory>
+
+using std::string;
+using std::vector;
+
+namespace GClasses {
+
+// virtual
+string GHyperTarget::describe(const GVec& candidate)
+{
+	std::ostringstream os;
+	candidate.print(os);
+	return os.str();
+}
+
+// ---------------------------------------------------------------
+
+GLearnerHyperTarget::GLearnerHyperTarget(const GMatrix& features, const GMatrix& labels, GRand& rand, double validationPortion)
+: GHyperTarget(),
+m_trainFeatures(features.relation().cloneMinimal()),
+m_trainLabels(labels.relation().cloneMinimal()),
+m_testFeatures(features.relation().cloneMinimal()),
+m_testLabels(labels.relation().cloneMinimal())
+{
+	if(features.rows() != labels.rows())
+		throw Ex("Expected the features and labels to have the same number of rows");
+	size_t testRows = (size_t)floor(validationPortion * features.rows() + 0.5);
+	if(testRows < 1 || testRows >= features.rows())
+		throw Ex("Not enough rows to set aside ", to_str(validationPortion), " of them for validation");
+	GIndexVec order(features.rows());
+	GIndexVec::makeIndexVec(order.v, features.rows());
+	GIndexVec::shuffle(order.v, features.rows(), &rand);
+	for(size_t i = 0; i < features.rows(); i++)
+	{
+		size_t r = order.v[i];
+		if(i < testRows)
+		{
+			m_testFeatures.takeRow((GVec*)&features[r]);
+			m_testLabels.takeRow((GVec*)&labels[r]);
+		}
+		else
+		{
+			m_trainFeatures.takeRow((GVec*)&features[r]);
+			m_trainLabels.takeRow((GVec*)&labels[r]);
+		}
+	}
+}
+
+// virtual
+GLearnerHyperTarget::~GLearnerHyperTarget()
+{
+	m_trainFeatures.releaseAllRows();
+	m_trainLabels.releaseAllRows();
+	m_testFeatures.releaseAllRows();
+	m_testLabels.releaseAllRows();
+}
+
+// virtual
+double GLearnerHyperTarget::evaluate(const GVec& candidate, double budget, GRand& rand)
+{
+	// Take the first part of the training rows
+	size_t rows = std::min(m_trainFeatures.rows(), std::max((size_t)2, (size_t)floor(budget * m_trainFeatures.rows() + 0.5)));
+	GMatrix features(m_trainFeatures.relation().cloneMinimal());
+	GReleaseDataHolder hFeatures(&features);
+	GMatrix labels(m_trainLabels.relation().cloneMinimal());
+	GReleaseDataHolder hLabels(&labels);
+	features.reserve(rows);
+	labels.reserve(rows);
+	for(size_t i = 0; i < rows; i++)
+	{
+		features.takeRow(&m_trainFeatures[i]);
+		labels.takeRow(&m_trainLabels[i]);
+	}
+
+	// Train and test
+	std::unique_ptr<GSupervisedLearner> hLearner(makeLearner(candidate));
+	hLearner->rand().setSeed(rand.next());
+	hLearner->train(features, labels);
+	return hLearner->sumSquaredError(m_testFeatures, m_testLabels) / m_testFeatures.rows();
+}
+
+// ---------------------------------------------------------------
+
+class GHyperSearchWorker : public GWorkerThread
+{
+protected:
+	GHyperSearch& m_search;
+	const vector<GVec>& m_candidates;
+	const vector<size_t>& m_ids;
+	const vector<uint64_t>& m_seeds;
+	double m_budget;
+	vector<double>& m_errors;
+	vector<string>& m_exceptions;
+	GSpinLock& m_lock;
+
+public:
+	GHyperSearchWorker(GMasterThread& master, GHyperSearch& search, const vector<GVec>& candidates, const vector<size_t>& ids, const vector<uint64_t>& seeds, double budget, vector<double>& errors, vector<string>& exceptions, GSpinLock& lock)
+	: GWorkerThread(master),
+	m_search(search),
+	m_candidates(candidates),
+	m_ids(ids),
+	m_seeds(seeds),
+	m_budget(budget),
+	m_errors(errors),
+	m_exceptions(exceptions),
+	m_lock(lock)
+	{
+	}
+
+	virtual ~GHyperSearchWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		// Exceptions must not escape from a worker thread, so they are reported back to the master
+		try
+		{
+			GRand rand(m_seeds[jobId]);
+			double err = m_search.m_target.evaluate(m_candidates[jobId], m_budget, rand);
+			m_errors[jobId] = err;
+
+			// Record the result right away, so it will not be lost if the search is interrupted
+			GSpinLockHolder hLock(&m_lock, "GHyperSearchWorker::doJob");
+			m_search.addTrial(m_candidates[jobId], m_ids[jobId], m_budget, err, false);
+			m_search.appendCheckpoint(m_search.trialCount() - 1);
+		}
+		catch(const std::exception& e)
+		{
+			m_exceptions[jobId] = e.what();
+		}
+	}
+};
+
+GHyperSearch::GHyperSearch(GHyperTarget& target, GRand* pRand)
+: m_target(target), m_pRand(pRand), m_workerThreads(1), m_seed(0), m_nextCandidate(0)
+{
+}
+
+GHyperSearch::~GHyperSearch()
+{
+}
+
+void GHyperSearch::setCheckpointFile(const char* szFilename, uint64_t seed)
+{
+	m_checkpoint = szFilename;
+	m_seed = seed;
+	if(GFile::doesFileExist(szFilename))
+		loadCheckpoint();
+	else
+		startCheckpoint();
+}
+
+// static
+bool GHyperSearch::checkpointSeed(const char* szFilename, uint64_t* pSeed)
+{
+	if(!GFile::doesFileExist(szFilename))
+		return false;
+	size_t len;
+	char* pFile = GFile::loadFile(szFilename, &len);
+	std::unique_ptr<char[]> hFile(pFile);
+	size_t eol = 0;
+	while(eol < len && pFile[eol] != '\n')
+		eol++;
+	if(eol >= len)
+		throw Ex("Invalid checkpoint file: ", szFilename);
+	GDom doc;
+	doc.parseJson(pFile, eol);
+	*pSeed = (uint64_t)doc.root()->field("seed")->asInt();
+	return true;
+}
+
+void GHyperSearch::loadCheckpoint()
+{
+	size_t len;
+	char* pFile = GFile::loadFile(m_checkpoint.c_str(), &len);
+	std::unique_ptr<char[]> hFile(pFile);
+	size_t pos = 0;
+	size_t lines = 0;
+	while(pos < len)
+	{
+		size_t eol = pos;
+		while(eol < len && pFile[eol] != '\n')
+			eol++;
+		if(eol >= len)
+			break; // an interrupted append left a partial line, so that evaluation will be repeated
+		GDom doc;
+		doc.parseJson(pFile + pos, eol - pos);
+		const GDomNode* pNode = doc.root();
+		if(lines == 0)
+		{
+			if((size_t)pNode->field("dims")->asInt() != m_target.dims())
+				throw Ex("The checkpoint file ", m_checkpoint, " is for a search with a different number of hyperparameters");
+			if((uint64_t)pNode->field("seed")->asInt() != m_seed)
+				throw Ex("The checkpoint file ", m_checkpoint, " was made by a search with a different seed");
+		}
+		else
+		{
+			GVec candidate(m_target.dims());
+			GDomListIterator it(pNode->field("x"));
+			for(size_t i = 0; i < candidate.size(); i++)
+			{
+				if(!it.current())
+					throw Ex("Invalid checkpoint file: ", m_checkpoint);
+				candidate[i] = it.current()->asDouble();
+				it.advance();
+			}
+			addTrial(candidate, (size_t)pNode->field("id")->asInt(), pNode->field("budget")->asDouble(), pNode->field("err")->asDouble(), true);
+		}
+		lines++;
+		pos = eol + 1;
+	}
+	if(lines == 0)
+		throw Ex("Invalid checkpoint file: ", m_checkpoint);
+	if(pos < len)
+	{
+		// Drop the partial line, so the next append will start on a line of its own
+		string tmp = m_checkpoint + ".tmp";
+		{
+			std::ofstream os;
+			os.exceptions(std::ios::failbit|std::ios::badbit);
+			try
+			{
+				os.open(tmp.c_str(), std::ios::binary);
+				os.write(pFile, pos);
+				os.close();
+			}
+			catch(const std::exception&)
+			{
+				throw Ex("Error while trying to write the checkpoint file: ", tmp);
+			}
+		}
+		if(std::rename(tmp.c_str(), m_checkpoint.c_str()) != 0)
+			throw Ex("Error while trying to replace the checkpoint file: ", m_checkpoint);
+	}
+}
+
+void GHyperSearch::startCheckpoint()
+{
+	GDom doc;
+	GDomNode* pHeader = doc.newObj();
+	pHeader->addField(&doc, "dims", doc.newInt(m_target.dims()));
+	pHeader->addField(&doc, "seed", doc.newInt((long long)m_seed));
+	std::ofstream os;
+	os.exceptions(std::ios::failbit|std::ios::badbit);
+	try
+	{
+		os.open(m_checkpoint.c_str(), std::ios::binary);
+		pHeader->writeJson(os);
+		os << "\n";
+		os.close();
+	}
+	catch(const std::exception&)
+	{
+		throw Ex("Error while trying to write the checkpoint file: ", m_checkpoint);
+	}
+}
+
+void GHyperSearch::appendCheckpoint(size_t trial)
+{
+	if(m_checkpoint.length() == 0)
+		return;
+	GDom doc;
+	GDomNode* pTrial = doc.newObj();
+	pTrial->addField(&doc, "id", doc.newInt(m_trialIds[trial]));
+	pTrial->addField(&doc, "budget", doc.newDouble(m_trialBudgets[trial]));
+	pTrial->addField(&doc, "err", doc.newDouble(m_trialErrors[trial]));
+	pTrial->addField(&doc, "desc", doc.newString(m_target.describe(m_trialCandidates[trial]).c_str()));
+	GDomNode* pX = pTrial->addField(&doc, "x", doc.newList());
+	for(size_t j = 0; j < m_trialCandidates[trial].size(); j++)
+		pX->addItem(&doc, doc.newDouble(m_trialCandidates[trial][j]));
+
+	// Only the new evaluation is written, so the cost of each checkpoint does not grow with the number of trials
+	std::ofstream os;
+	os.exceptions(std::ios::failbit|std::ios::badbit);
+	try
+	{
+		os.open(m_checkpoint.c_str(), std::ios::binary | std::ios::app);
+		os.precision(17); // (GDom::writeJson would round to 14 digits, but the errors should be restored exactly)
+		pTrial->writeJson(os);
+		os << "\n";
+		os.close();
+	}
+	catch(const std::exception&)
+	{
+		throw Ex("Error while trying to append to the checkpoint file: ", m_checkpoint);
+	}
+}
+
+void GHyperSearch::addTrial(const GVec& candidate, size_t id, double budget, double error, bool resumed)
+{
+	m_trialCandidates.push_back(candidate);
+	m_trialIds.push_back(id);
+	m_trialBudgets.push_back(budget);
+	m_trialErrors.push_back(error);
+	m_trialResumed.push_back(resumed);
+}
+
+size_t GHyperSearch::findTrial(size_t id, double budget)
+{
+	for(size_t i = 0; i < m_trialIds.size(); i++)
+	{
+		if(m_trialIds[i] == id && std::abs(m_trialBudgets[i] - budget) <= 1e-9 * budget)
+			return i;
+	}
+	return INVALID_INDEX;
+}
+
+size_t GHyperSearch::resumedCount()
+{
+	size_t n = 0;
+	for(size_t i = 0; i < m_trialResumed.size(); i++)
+	{
+		if(m_trialResumed[i])
+			n++;
+	}
+	return n;
+}
+
+void GHyperSearch::evaluate(const vector<GVec>& candidates, const vector<size_t>& ids, const vector<uint64_t>& seeds, double budget, vector<double>& errors)
+{
+	// Reuse any evaluations that were restored from the checkpoint
+	errors.resize(candidates.size());
+	vector<GVec> todoCandidates;
+	vector<size_t> todoIds;
+	vector<uint64_t> todoSeeds;
+	vector<size_t> todo;
+	for(size_t i = 0; i < candidates.size(); i++)
+	{
+		size_t index = findTrial(ids[i], budget);
+		if(index == INVALID_INDEX)
+		{
+			todo.push_back(i);
+			todoCandidates.push_back(candidates[i]);
+			todoIds.push_back(ids[i]);
+			todoSeeds.push_back(seeds[i]);
+		}
+		else
+		{
+			if(m_trialCandidates[index].squaredDistance(candidates[i]) > 1e-18)
+				throw Ex("The checkpoint file ", m_checkpoint, " was made by a search with a different seed or different settings");
+			errors[i] = m_trialErrors[index];
+		}
+	}
+	if(todo.size() == 0)
+		return;
+
+	// Evaluate the rest in parallel
+	vector<double> todoErrors(todo.size());
+	vector<string> exceptions(todo.size());
+	GSpinLock lock;
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < std::min(m_workerThreads, todo.size()); i++)
+			master.addWorker(new GHyperSearchWorker(master, *this, todoCandidates, todoIds, todoSeeds, budget, todoErrors, exceptions, lock));
+		master.doJobs(todo.size());
+	}
+	for(size_t i = 0; i < todo.size(); i++)
+	{
+		if(exceptions[i].length() > 0)
+			throw Ex(exceptions[i]);
+		errors[todo[i]] = todoErrors[i];
+	}
+}
+
+class GHyperSearchComparer
+{
+protected:
+	const vector<double>& m_errors;
+
+public:
+	GHyperSearchComparer(const vector<double>& errors) : m_errors(errors) {}
+
+	bool operator()(size_t a, size_t b) const
+	{
+		if(m_errors[a] != m_errors[b])
+			return m_errors[a] < m_errors[b];
+		return a < b;
+	}
+};
+
+void GHyperSearch::successiveHalving(size_t candidateCount, size_t rungs, size_t eta)
+{
+	if(eta < 2)
+		throw Ex("eta must be at least 2");
+	if(candidateCount < 1)
+		throw Ex("Expected at least one candidate");
+
+	// Draw all of the candidates and seeds up front, so they do not depend on how the evaluations turn out
+	size_t dims = m_target.dims();
+	vector<GVec> candidates(candidateCount);
+	vector<size_t> ids(candidateCount);
+	vector<uint64_t> seeds(candidateCount);
+	for(size_t i = 0; i < candidateCount; i++)
+	{
+		candidates[i].resize(dims);
+		for(size_t j = 0; j < dims; j++)
+			candidates[i][j] = m_pRand->uniform();
+		ids[i] = m_nextCandidate++;
+		seeds[i] = m_pRand->next();
+	}
+
+	// Evaluate with increasing budgets, keeping the best 1/eta each time
+	double budget = 1.0;
+	for(size_t i = 0; i < rungs; i++)
+		budget /= eta;
+	for(size_t rung = 0; rung <= rungs; rung++)
+	{
+		vector<uint64_t> rungSeeds(candidates.size());
+		for(size_t i = 0; i < candidates.size(); i++)
+			rungSeeds[i] = seeds[i] + rung;
+		vector<double> errors;
+		evaluate(candidates, ids, rungSeeds, rung == rungs ? 1.0 : budget, errors);
+		if(rung == rungs)
+			break;
+
+		// Select the survivors (ties go to the candidate drawn first)
+		vector<size_t> order(candidates.size());
+		for(size_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), GHyperSearchComparer(errors));
+		size_t keep = std::max((size_t)1, candidates.size() / eta);
+		std::sort(order.begin(), order.begin() + keep);
+		vector<GVec> survivors;
+		vector<size_t> survivorIds;
+		vector<uint64_t> survivorSeeds;
+		for(size_t i = 0; i < keep; i++)
+		{
+			survivors.push_back(candidates[order[i]]);
+			survivorIds.push_back(ids[order[i]]);
+			survivorSeeds.push_back(seeds[order[i]]);
+		}
+		candidates.swap(survivors);
+		ids.swap(survivorIds);
+		seeds.swap(survivorSeeds);
+		budget *= eta;
+	}
+}
+
+void GHyperSearch::hyperband(size_t maxBudget, size_t eta)
+{
+	if(eta < 2)
+		throw Ex("eta must be at least 2");
+	size_t sMax = 0;
+	for(size_t r = eta; r <= maxBudget; r *= eta)
+		sMax++;
+	for(size_t s = sMax + 1; s > 0; s--)
+	{
+		size_t rungs = s - 1;
+		size_t etaPow = 1;
+		for(size_t i = 0; i < rungs; i++)
+			etaPow *= eta;
+		size_t n = ((sMax + 1) * etaPow + rungs) / (rungs + 1); // = ceil((sMax + 1) / (rungs + 1) * eta^rungs)
+		successiveHalving(n, rungs, eta);
+	}
+}
+
+size_t GHyperSearch::bestTrial()
+{
+	size_t best = INVALID_INDEX;
+	for(size_t i = 0; i < m_trialErrors.size(); i++)
+	{
+		if(m_trialBudgets[i] >= 1.0 && (best == INVALID_INDEX || m_trialErrors[i] < m_trialErrors[best] || (m_trialErrors[i] == m_trialErrors[best] && m_trialIds[i] < m_trialIds[best])))
+			best = i;
+	}
+	if(best == INVALID_INDEX)
+		throw Ex("No candidates have been evaluated with the full budget yet");
+	return best;
+}
+
+const GVec& GHyperSearch::bestCandidate()
+{
+	return m_trialCandidates[bestTrial()];
+}
+
+double GHyperSearch::bestError()
+{
+	return m_trialErrors[bestTrial()];
+}
+
+#ifndef NO_TEST_CODE
+class GHyperSearchTestTarget : public GHyperTarget
+{
+public:
+	size_t m_failAfter;
+	size_t m_evaluations;
+	GSpinLock m_lock;
+
+	GHyperSearchTestTarget() : GHyperTarget(), m_failAfter(INVALID_INDEX), m_evaluations(0) {}
+	virtual ~GHyperSearchTestTarget() {}
+
+	virtual size_t dims() { return 2; }
+
+	virtual double evaluate(const GVec& candidate, double budget, GRand& rand)
+	{
+		{
+			GSpinLockHolder hLock(&m_lock, "GHyperSearchTestTarget::evaluate");
+			if(m_evaluations++ >= m_failAfter)
+				throw Ex("preempted");
+		}
+
+		// Smaller budgets give noisier measurements of the distance to (0.3, 0.7)
+		double dx = candidate[0] - 0.3;
+		double dy = candidate[1] - 0.7;
+		return dx * dx + dy * dy + (1.0 - budget) * 0.05 * rand.uniform();
+	}
+};
+
+void GHyperSearch_run(GHyperSearchTestTarget& target, const char* szCheckpoint, size_t threads, GVec& best, double& err, size_t& resumed, size_t& trials)
+{
+	GRand rand(0);
+	GHyperSearch search(target, &rand);
+	search.setWorkerThreads(threads);
+	if(szCheckpoint)
+		search.setCheckpointFile(szCheckpoint, 0);
+	search.hyperband(27, 3);
+	best.copy(search.bestCandidate());
+	err = search.bestError();
+	resumed = search.resumedCount();
+	trials = search.trialCount();
+}
+
+// static
+void GHyperSearch::test()
+{
+	// Make sure the search finds a good candidate, independent of the number of threads
+	GHyperSearchTestTarget target1;
+	GVec best1, best3;
+	double err1, err3;
+	size_t resumed, trials1, trials3;
+	GHyperSearch_run(target1, NULL, 1, best1, err1, resumed, trials1);
+	if(err1 > 0.01)
+		throw Ex("failed to find a good candidate");
+	if(trials1 != (27 + 9 + 3 + 1) + (12 + 4 + 1) + (6 + 2) + 4)
+		throw Ex("unexpected number of evaluations");
+	GHyperSearchTestTarget target3;
+	GHyperSearch_run(target3, NULL, 3, best3, err3, resumed, trials3);
+	if(err3 != err1 || best3.squaredDistance(best1) != 0.0 || trials3 != trials1)
+		throw Ex("results depend on the number of threads");
+
+	// Interrupt a search, then resume it from the checkpoint
+	char szCheckpoint[512];
+	GFile::tempFilename(szCheckpoint);
+	GHyperSearchTestTarget target4;
+	target4.m_failAfter = 30;
+	bool interrupted = false;
+	try
+	{
+		GHyperSearch_run(target4, szCheckpoint, 2, best3, err3, resumed, trials3);
+	}
+	catch(const std::exception& e)
+	{
+		interrupted = (strcmp(e.what(), "preempted") == 0);
+	}
+	if(!interrupted)
+	{
+		GFile::deleteFile(szCheckpoint);
+		throw Ex("expected the search to be interrupted");
+	}
+	uint64_t seed = 1;
+	if(!GHyperSearch::checkpointSeed(szCheckpoint, &seed) || seed != 0)
+	{
+		GFile::deleteFile(szCheckpoint);
+		throw Ex("the seed was not recorded in the checkpoint");
+	}
+	{
+		// Simulate an append that was interrupted part way through a line
+		std::ofstream os(szCheckpoint, std::ios::binary | std::ios::app);
+		os << "{\"id\":3,\"bud";
+	}
+	GHyperSearchTestTarget target5;
+	GHyperSearch_run(target5, szCheckpoint, 2, best3, err3, resumed, trials3);
+	bool rejected = false;
+	try
+	{
+		GHyperSearchTestTarget target6;
+		GRand rand(1);
+		GHyperSearch search(target6, &rand);
+		search.setCheckpointFile(szCheckpoint, 1);
+	}
+	catch(const std::exception&)
+	{
+		rejected = true;
+	}
+	GFile::deleteFile(szCheckpoint);
+	if(!rejected)
+		throw Ex("resumed from a checkpoint that was made with a different seed");
+	if(resumed != 30 || target5.m_evaluations != trials1 - resumed)
+		throw Ex("did not resume from the checkpoint");
+	if(err3 != err1 || best3.squaredDistance(best1) != 0.0 || trials3 != trials1)
+		throw Ex("the resumed search did not match the uninterrupted search");
+}
+#endif // !NO_TEST_CODE
+
+} // namespace GClasses
@@ -0,0 +1,188 @@
+/*
+  The contents of this file are dedicated by all of its authors, including
+
+    Michael S. Gashler,
+    anonymous contributors,
+
+  to the public domain (http://creativecommons.org/publicdomain/zero/1.0/).
+
+  Note that some moral obligations still exist in the absence of legal ones.
+  For example, it would still be dishonest to deliberately misrepresent the
+  origin of a work. Although we impose no legal requirements to obtain a
+  license, it is beseeming for those who build on the works of others to
+  give back useful improvements, or find a way to pay it forward. If
+  you would like to cite us, a published paper about Waffles can be found
+  at http://jmlr.org/papers/volume12/gashler11a/gashler11a.pdf. If you find
+  our code to be useful, the Waffles team would love to hear how you use it.
+*/
+
+#ifndef __GHYPERSEARCH_H__
+#define __GHYPERSEARCH_H__
+
+#include "GMatrix.h"
+#include "GRand.h"
+#include "GVec.h"
+#include <string>
+#include <vector>
+
+namespace GClasses {
+
+class GDom;
+class GSupervisedLearner;
+
+
+/// The interface of a problem for GHyperSearch. Candidate configurations are
+/// points in the unit hypercube. (The target should scale them as necessary to
+/// cover the desired space.) Unlike GTargetFunction, a candidate may be evaluated
+/// with only part of the full training budget, and several candidates are
+/// evaluated at the same time, so evaluate must be thread-safe.
+class GHyperTarget
+{
+public:
+	GHyperTarget() {}
+	virtual ~GHyperTarget() {}
+
+	/// Returns the number of hyperparameters.
+	virtual size_t dims() = 0;
+
+	/// Trains a model with the configuration specified by candidate and returns
+	/// its error (smaller is better). budget is the portion of the full training
+	/// budget to use, in the range (0, 1]. rand is a random number generator that
+	/// belongs to this evaluation only. This method is called concurrently from
+	/// several threads, so it must not modify any shared state.
+	virtual double evaluate(const GVec& candidate, double budget, GRand& rand) = 0;
+
+	/// Returns a human-readable description of a candidate. (The default just prints the vector.)
+	virtual std::string describe(const GVec& candidate);
+};
+
+
+/// A GHyperTarget that measures how well a supervised learner predicts a held-out
+/// portion of the data. The budget determines how many of the training rows are used.
+class GLearnerHyperTarget : public GHyperTarget
+{
+protected:
+	GMatrix m_trainFeatures;
+	GMatrix m_trainLabels;
+	GMatrix m_testFeatures;
+	GMatrix m_testLabels;
+
+public:
+	/// Shuffles the rows (with rand) and sets aside validationPortion of them
+	/// for testing. Only references the rows of features and labels, so they
+	/// must remain valid for the life of this object.
+	GLearnerHyperTarget(const GMatrix& features, const GMatrix& labels, GRand& rand, double validationPortion = 0.3);
+	virtual ~GLearnerHyperTarget();
+
+	/// Returns the number of rows available for training at full budget.
+	size_t trainRows() { return m_trainFeatures.rows(); }
+
+	/// Trains the learner made by makeLearner with the first budget portion
+	/// of the training rows and returns its mean squared error (or misclassification
+	/// rate) on the validation rows.
+	virtual double evaluate(const GVec& candidate, double budget, GRand& rand);
+
+protected:
+	/// Returns a new untrained learner configured as candidate specifies. The caller will delete it.
+	virtual GSupervisedLearner* makeLearner(const GVec& candidate) = 0;
+};
+
+
+/// Searches for the best configuration of a GHyperTarget with successive halving
+/// (Jamieson and Talwalkar, 2016) and Hyperband (Li et al., 2017). Candidates are
+/// drawn at random from the unit hypercube and first evaluated with a small portion
+/// of the training budget. Only the best 1/eta of them go on to be evaluated with
+/// eta times more budget, until the survivors are evaluated with the full budget.
+/// All of the candidates in each round are evaluated concurrently. If a checkpoint
+/// file is specified, every finished evaluation is recorded in it, so an interrupted
+/// search can be resumed (with the same seed and settings) without repeating them.
+class GHyperSearch
+{
+friend class GHyperSearchWorker;
+protected:
+	GHyperTarget& m_target;
+	GRand* m_pRand;
+	size_t m_workerThreads;
+	std::string m_checkpoint;
+	uint64_t m_seed;
+	size_t m_nextCandidate;
+	std::vector<GVec> m_trialCandidates;
+	std::vector<size_t> m_trialIds;
+	std::vector<double> m_trialBudgets;
+	std::vector<double> m_trialErrors;
+	std::vector<bool> m_trialResumed;
+
+public:
+	/// pRand is used to draw candidates and the seeds of each evaluation.
+	GHyperSearch(GHyperTarget& target, GRand* pRand);
+	~GHyperSearch();
+
+	/// Specifies the number of candidates to evaluate at the same time. (The default is 1.)
+	void setWorkerThreads(size_t n) { m_workerThreads = (n > 1 ? n : 1); }
+
+	/// Specifies a file for recording the finished evaluations. The first line is a JSON
+	/// object with the seed of pRand, and each evaluation is appended as one more line
+	/// when it finishes. If the file already exists, the evaluations it records will not
+	/// be repeated. Throws if it was made with a seed other than seed.
+	void setCheckpointFile(const char* szFilename, uint64_t seed);
+
+	/// If szFilename is an existing checkpoint file, puts the seed it was made with in
+	/// *pSeed and returns true. Otherwise returns false.
+	static bool checkpointSeed(const char* szFilename, uint64_t* pSeed);
+
+	/// Performs one bracket of successive halving. Draws new candidates,
+	/// evaluates them with budget eta^-rungs, and then keeps the best 1/eta of them
+	/// for each of the next rungs rounds, multiplying the budget by eta each time.
+	/// (With rungs=0, this is just a parallel random search.)
+	void successiveHalving(size_t candidates, size_t rungs, size_t eta = 3);
+
+	/// Performs Hyperband, which runs successive halving with several trade-offs
+	/// between the number of candidates and the minimum budget. maxBudget is the
+	/// ratio between the full budget and the smallest budget that will be tried.
+	void hyperband(size_t maxBudget = 27, size_t eta = 3);
+
+	/// Returns the best candidate that has been evaluated with the full budget.
+	/// Throws if none have been.
+	const GVec& bestCandidate();
+
+	/// Returns the error of bestCandidate.
+	double bestError();
+
+	/// Returns the number of evaluations that have been performed or restored from the checkpoint.
+	size_t trialCount() { return m_trialErrors.size(); }
+
+	/// Returns the number of evaluations that were restored from the checkpoint file instead of being performed.
+	size_t resumedCount();
+
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // !NO_TEST_CODE
+
+protected:
+	/// Evaluates each candidate with the specified budget, and puts the results in errors.
+	/// (ids identifies the candidates in the checkpoint.)
+	void evaluate(const std::vector<GVec>& candidates, const std::vector<size_t>& ids, const std::vector<uint64_t>& seeds, double budget, std::vector<double>& errors);
+
+	/// Loads the finished evaluations from the checkpoint file
+	void loadCheckpoint();
+
+	/// Starts a new checkpoint file
+	void startCheckpoint();
+
+	/// Appends the specified recorded evaluation to the checkpoint file
+	void appendCheckpoint(size_t trial);
+
+	/// Records a finished evaluation
+	void addTrial(const GVec& candidate, size_t id, double budget, double error, bool resumed);
+
+	/// Returns the index of the recorded evaluation of candidate id with budget, or INVALID_INDEX
+	size_t findTrial(size_t id, double budget);
+
+	/// Returns the index of the best evaluation with the full budget
+	size_t bestTrial();
+};
+
+} // namespace GClasses
+
+#endif // __GHYPERSEARCH_H__
@@ -30,12 +30,18 @@
 #include "GHillClimber.h"
 #include "GMath.h"
 #include "GHolders.h"
+#include "GThread.h"
+#include "GVec.h"
+#include "GRand.h"
 #include <vector>
 #include <algorithm>
 #include <string.h>
 #include <sstream>
 #include <cmath>
 #include <memory>
+#ifdef __SSE__
+#	include <xmmintrin.h>
+#endif
 
 namespace GClasses {
 using std::vector;
@@ -1496,6 +1502,16 @@ void GImage::scale(unsigned int nNewWidth, unsigned int nNewHeight)
 	}
 }
 
+void GImage::resample(unsigned int newWidth, unsigned int newHeight, GFloatImage::ResampleFilter filter, size_t threads)
+{
+	GFloatImage src;
+	src.setWorkerThreads(threads);
+	src.fromImage(*this);
+	GFloatImage dest;
+	src.resample(dest, newWidth, newHeight, filter);
+	dest.toImage(*this);
+}
+
 void GImage::flipHorizontally()
 {
 	unsigned int c1;
@@ -1661,6 +1677,24 @@ void GImage::blur(double dRadius)
 	convolve(&imgKernel);
 }
 
+void GImage::blurGaussian(double sigma, size_t threads)
+{
+	GFloatImage tmp;
+	tmp.setWorkerThreads(threads);
+	tmp.fromImage(*this);
+	tmp.blurGaussian(sigma);
+	tmp.toImage(*this);
+}
+
+void GImage::blurBox(size_t radius, size_t threads)
+{
+	GFloatImage tmp;
+	tmp.setWorkerThreads(threads);
+	tmp.fromImage(*this);
+	tmp.blurBox(radius);
+	tmp.toImage(*this);
+}
+
 void GImage::blurQuick(int iters, int nRadius)
 {
 	GImage tmp;
@@ -3572,4 +3606,639 @@ void GImage::replaceColor(unsigned int before, unsigned int after)
 	}
 }
 
+// --------------------------------------------------------------------------
+
+// The number of rows in each band of work in a GFloatImage pass. (This does not depend on the
+// number of threads, so the results do not either.)
+#define FLOAT_IMAGE_BAND_ROWS 16
+
+// Adds w * pSrc to pDest
+inline void GFloatImage_addScaled(float* pDest, const float* pSrc, float w, size_t n)
+{
+	size_t i = 0;
+#ifdef __SSE__
+	__m128 ww = _mm_set1_ps(w);
+	for( ; i + 4 <= n; i += 4)
+		_mm_storeu_ps(pDest + i, _mm_add_ps(_mm_loadu_ps(pDest + i), _mm_mul_ps(_mm_loadu_ps(pSrc + i), ww)));
+#endif
+	for( ; i < n; i++)
+		pDest[i] += w * pSrc[i];
+}
+
+// Returns the dot product of pA and pB
+inline float GFloatImage_dot(const float* pA, const float* pB, size_t n)
+{
+	size_t i = 0;
+	float sum = 0.0f;
+#ifdef __SSE__
+	__m128 acc = _mm_setzero_ps();
+	for( ; i + 4 <= n; i += 4)
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(pA + i), _mm_loadu_ps(pB + i)));
+	float parts[4];
+	_mm_storeu_ps(parts, acc);
+	sum = (parts[0] + parts[1]) + (parts[2] + parts[3]);
+#endif
+	for( ; i < n; i++)
+		sum += pA[i] * pB[i];
+	return sum;
+}
+
+/// The weights with which each destination sample combines a contiguous run of source samples
+class GFloatImageFilterTable
+{
+public:
+	std::vector<size_t> m_first; // The first source sample of each destination sample
+	std::vector<size_t> m_count; // The number of source samples of each destination sample
+	std::vector<size_t> m_offset; // The position in m_weights of the first weight of each destination sample
+	std::vector<float> m_weights;
+
+	/// Makes a table that convolves sourceSize samples with a Gaussian
+	void makeGaussian(size_t sourceSize, double sigma)
+	{
+		int radius = (int)std::ceil(3.0 * sigma);
+		vector<double> weights(2 * radius + 1);
+		for(int k = -radius; k <= radius; k++)
+			weights[k + radius] = std::exp(-0.5 * k * k / (sigma * sigma));
+		for(size_t i = 0; i < sourceSize; i++)
+			add((int)i - radius, weights, sourceSize);
+	}
+
+	/// Makes a table that resamples sourceSize samples to destSize samples
+	void makeResample(size_t sourceSize, size_t destSize, GFloatImage::ResampleFilter filter)
+	{
+		double scale = (double)sourceSize / destSize;
+		double stretch = std::max(1.0, scale); // Stretch the filter when shrinking to cover all the source samples
+		double support = stretch * (filter == GFloatImage::Bilinear ? 1.0 : (filter == GFloatImage::Bicubic ? 2.0 : 3.0));
+		vector<double> weights;
+		for(size_t i = 0; i < destSize; i++)
+		{
+			double center = (i + 0.5) * scale - 0.5;
+			int first = (int)std::ceil(center - support);
+			int last = (int)std::floor(center + support);
+			weights.resize(last - first + 1);
+			for(int j = first; j <= last; j++)
+				weights[j - first] = kernel(filter, (j - center) / stretch);
+			add(first, weights, sourceSize);
+		}
+	}
+
+protected:
+	/// Adds a destination sample that combines the source samples starting at first
+	/// with weights. (The weights are normalized. Samples beyond the edges are replaced
+	/// by the nearest edge sample.)
+	void add(int first, const vector<double>& weights, size_t sourceSize)
+	{
+		int lo = std::max(0, std::min((int)sourceSize - 1, first));
+		int hi = std::max(0, std::min((int)sourceSize - 1, first + (int)weights.size() - 1));
+		double sum = 0.0;
+		for(size_t k = 0; k < weights.size(); k++)
+			sum += weights[k];
+		if(std::abs(sum) < 1e-12)
+			throw Ex("The filter weights sum to zero");
+		size_t start = m_weights.size();
+		m_weights.resize(start + hi - lo + 1, 0.0f);
+		for(size_t k = 0; k < weights.size(); k++)
+		{
+			int j = std::max(lo, std::min(hi, first + (int)k));
+			m_weights[start + j - lo] += (float)(weights[k] / sum);
+		}
+		m_first.push_back(lo);
+		m_count.push_back(hi - lo + 1);
+		m_offset.push_back(start);
+	}
+
+	/// Evaluates a resampling filter
+	static double kernel(GFloatImage::ResampleFilter filter, double x)
+	{
+		x = std::abs(x);
+		if(filter == GFloatImage::Bilinear)
+			return std::max(0.0, 1.0 - x);
+		else if(filter == GFloatImage::Bicubic)
+		{
+			const double a = -0.5;
+			if(x < 1.0)
+				return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+			else if(x < 2.0)
+				return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+			return 0.0;
+		}
+		else
+		{
+			if(x < 1e-8)
+				return 1.0;
+			if(x >= 3.0)
+				return 0.0;
+			double px = M_PI * x;
+			return 3.0 * std::sin(px) * std::sin(px / 3.0) / (px * px);
+		}
+	}
+};
+
+/// One pass over the rows of a GFloatImage. The rows of each channel are divided into bands.
+class GFloatImagePass
+{
+public:
+	virtual ~GFloatImagePass() {}
+
+	/// Computes rows yStart to yEnd-1 of the specified channel
+	virtual void doBand(size_t channel, size_t yStart, size_t yEnd) = 0;
+};
+
+/// Filters each row with a GFloatImageFilterTable
+class GFloatImageRowPass : public GFloatImagePass
+{
+protected:
+	const GFloatImage& m_src;
+	GFloatImage& m_dest;
+	const GFloatImageFilterTable& m_table;
+
+public:
+	GFloatImageRowPass(const GFloatImage& src, GFloatImage& dest, const GFloatImageFilterTable& table)
+	: m_src(src), m_dest(dest), m_table(table)
+	{
+	}
+
+	virtual void doBand(size_t channel, size_t yStart, size_t yEnd)
+	{
+		size_t width = m_dest.width();
+		const float* pWeights = m_table.m_weights.data();
+		for(size_t y = yStart; y < yEnd; y++)
+		{
+			const float* pSrc = m_src.row(channel, y);
+			float* pDest = m_dest.row(channel, y);
+			for(size_t x = 0; x < width; x++)
+				pDest[x] = GFloatImage_dot(pWeights + m_table.m_offset[x], pSrc + m_table.m_first[x], m_table.m_count[x]);
+		}
+	}
+};
+
+/// Filters each column with a GFloatImageFilterTable. (Each destination row is a weighted sum
+/// of whole source rows, so this proceeds one row at a time too.)
+class GFloatImageColumnPass : public GFloatImagePass
+{
+protected:
+	const GFloatImage& m_src;
+	GFloatImage& m_dest;
+	const GFloatImageFilterTable& m_table;
+
+public:
+	GFloatImageColumnPass(const GFloatImage& src, GFloatImage& dest, const GFloatImageFilterTable& table)
+	: m_src(src), m_dest(dest), m_table(table)
+	{
+	}
+
+	virtual void doBand(size_t channel, size_t yStart, size_t yEnd)
+	{
+		size_t width = m_dest.width();
+		for(size_t y = yStart; y < yEnd; y++)
+		{
+			float* pDest = m_dest.row(channel, y);
+			std::fill(pDest, pDest + width, 0.0f);
+			const float* pWeights = m_table.m_weights.data() + m_table.m_offset[y];
+			for(size_t k = 0; k < m_table.m_count[y]; k++)
+				GFloatImage_addScaled(pDest, m_src.row(channel, m_table.m_first[y] + k), pWeights[k], width);
+		}
+	}
+};
+
+/// Computes the mean of a sliding window along each row
+class GFloatImageBoxRowPass : public GFloatImagePass
+{
+protected:
+	const GFloatImage& m_src;
+	GFloatImage& m_dest;
+	int m_radius;
+
+public:
+	GFloatImageBoxRowPass(const GFloatImage& src, GFloatImage& dest, size_t radius)
+	: m_src(src), m_dest(dest), m_radius((int)radius)
+	{
+	}
+
+	virtual void doBand(size_t channel, size_t yStart, size_t yEnd)
+	{
+		int last = (int)m_dest.width() - 1;
+		double scale = 1.0 / (2 * m_radius + 1);
+		for(size_t y = yStart; y < yEnd; y++)
+		{
+			const float* pSrc = m_src.row(channel, y);
+			float* pDest = m_dest.row(channel, y);
+			double sum = 0.0;
+			for(int k = -m_radius; k <= m_radius; k++)
+				sum += pSrc[std::max(0, std::min(last, k))];
+			for(int x = 0; x <= last; x++)
+			{
+				pDest[x] = (float)(sum * scale);
+				sum += pSrc[std::min(last, x + m_radius + 1)] - pSrc[std::max(0, x - m_radius)];
+			}
+		}
+	}
+};
+
+/// Computes the mean of a sliding window along each column, by adding and subtracting whole rows
+class GFloatImageBoxColumnPass : public GFloatImagePass
+{
+protected:
+	const GFloatImage& m_src;
+	GFloatImage& m_dest;
+	int m_radius;
+
+public:
+	GFloatImageBoxColumnPass(const GFloatImage& src, GFloatImage& dest, size_t radius)
+	: m_src(src), m_dest(dest), m_radius((int)radius)
+	{
+	}
+
+	virtual void doBand(size_t channel, size_t yStart, size_t yEnd)
+	{
+		size_t width = m_dest.width();
+		int last = (int)m_dest.height() - 1;
+		float scale = 1.0f / (2 * m_radius + 1);
+		vector<float> sum(width, 0.0f);
+		for(int k = -m_radius; k <= m_radius; k++)
+			GFloatImage_addScaled(sum.data(), m_src.row(channel, std::max(0, std::min(last, (int)yStart + k))), 1.0f, width);
+		for(int y = (int)yStart; y < (int)yEnd; y++)
+		{
+			float* pDest = m_dest.row(channel, y);
+			for(size_t x = 0; x < width; x++)
+				pDest[x] = sum[x] * scale;
+			GFloatImage_addScaled(sum.data(), m_src.row(channel, std::min(last, y + m_radius + 1)), 1.0f, width);
+			GFloatImage_addScaled(sum.data(), m_src.row(channel, std::max(0, y - m_radius)), -1.0f, width);
+		}
+	}
+};
+
+/// Does the bands of a GFloatImagePass
+class GFloatImagePassWorker : public GWorkerThread
+{
+protected:
+	GFloatImagePass& m_pass;
+	size_t m_rows;
+	size_t m_bands;
+
+public:
+	std::string m_error;
+
+	GFloatImagePassWorker(GMasterThread& master, GFloatImagePass& pass, size_t rows, size_t bands)
+	: GWorkerThread(master), m_pass(pass), m_rows(rows), m_bands(bands)
+	{
+	}
+
+	virtual ~GFloatImagePassWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		size_t channel = jobId / m_bands;
+		size_t yStart = (jobId % m_bands) * FLOAT_IMAGE_BAND_ROWS;
+		size_t yEnd = std::min(m_rows, yStart + FLOAT_IMAGE_BAND_ROWS);
+		try
+		{
+			m_pass.doBand(channel, yStart, yEnd);
+		}
+		catch(const std::exception& e)
+		{
+			if(m_error.length() == 0)
+				m_error = e.what();
+		}
+	}
+};
+
+// Does all the bands of a pass over an image with the specified number of channels and rows
+void GFloatImage_doPass(GFloatImagePass& pass, size_t channels, size_t rows, size_t threads)
+{
+	size_t bands = (rows + FLOAT_IMAGE_BAND_ROWS - 1) / FLOAT_IMAGE_BAND_ROWS;
+	size_t jobs = channels * bands;
+	if(jobs == 0)
+		return;
+	threads = std::min(threads, jobs);
+	std::string error;
+	{
+		vector<GFloatImagePassWorker*> workers;
+		GMasterThread master;
+		for(size_t i = 0; i < threads; i++)
+		{
+			workers.push_back(new GFloatImagePassWorker(master, pass, rows, bands));
+			master.addWorker(workers[i]);
+		}
+		master.doJobs(jobs);
+		for(size_t i = 0; i < threads; i++)
+		{
+			if(workers[i]->m_error.length() > 0 && error.length() == 0)
+				error = workers[i]->m_error;
+		}
+	}
+	if(error.length() > 0)
+		throw Ex(error);
+}
+
+GFloatImage::GFloatImage()
+: m_width(0), m_height(0), m_channels(0), m_workerThreads(1)
+{
+}
+
+GFloatImage::~GFloatImage()
+{
+}
+
+void GFloatImage::setSize(unsigned int width, unsigned int height, unsigned int channels)
+{
+	m_data.resize((size_t)width * height * channels);
+	m_width = width;
+	m_height = height;
+	m_channels = channels;
+}
+
+void GFloatImage::swapData(GFloatImage& other)
+{
+	m_data.swap(other.m_data);
+	std::swap(m_width, other.m_width);
+	std::swap(m_height, other.m_height);
+	std::swap(m_channels, other.m_channels);
+}
+
+void GFloatImage::fromImage(const GImage& image, bool alpha)
+{
+	setSize(image.width(), image.height(), alpha ? 4 : 3);
+	for(unsigned int y = 0; y < m_height; y++)
+	{
+		float* pRed = row(0, y);
+		float* pGreen = row(1, y);
+		float* pBlue = row(2, y);
+		for(unsigned int x = 0; x < m_width; x++)
+		{
+			unsigned int c = image.pixel(x, y);
+			pRed[x] = (float)gRed(c);
+			pGreen[x] = (float)gGreen(c);
+			pBlue[x] = (float)gBlue(c);
+		}
+		if(alpha)
+		{
+			float* pAlpha = row(3, y);
+			for(unsigned int x = 0; x < m_width; x++)
+				pAlpha[x] = (float)gAlpha(image.pixel(x, y));
+		}
+	}
+}
+
+inline int GFloatImage_toChan(float f)
+{
+	return ClipChan((int)std::floor(f + 0.5f));
+}
+
+void GFloatImage::toImage(GImage& image) const
+{
+	if(m_channels != 1 && m_channels != 3 && m_channels != 4)
+		throw Ex("Expected 1, 3, or 4 channels. Got ", to_str(m_channels));
+	image.setSize(m_width, m_height);
+	for(unsigned int y = 0; y < m_height; y++)
+	{
+		unsigned int* pPix = image.pixelRef(0, y);
+		if(m_channels == 1)
+		{
+			const float* pGray = row(0, y);
+			for(unsigned int x = 0; x < m_width; x++)
+			{
+				int g = GFloatImage_toChan(pGray[x]);
+				pPix[x] = gRGB(g, g, g);
+			}
+		}
+		else
+		{
+			const float* pRed = row(0, y);
+			const float* pGreen = row(1, y);
+			const float* pBlue = row(2, y);
+			const float* pAlpha = (m_channels == 4 ? row(3, y) : NULL);
+			for(unsigned int x = 0; x < m_width; x++)
+				pPix[x] = gARGB(pAlpha ? GFloatImage_toChan(pAlpha[x]) : 0xff, GFloatImage_toChan(pRed[x]), GFloatImage_toChan(pGreen[x]), GFloatImage_toChan(pBlue[x]));
+		}
+	}
+}
+
+void GFloatImage::toVec(GVec& out, double scale) const
+{
+	out.resize((size_t)m_width * m_height * m_channels);
+	for(size_t c = 0; c < m_channels; c++)
+	{
+		for(size_t y = 0; y < m_height; y++)
+		{
+			const float* pRow = row(c, y);
+			size_t pos = y * m_width * m_channels + c;
+			for(size_t x = 0; x < m_width; x++)
+			{
+				out[pos] = scale * pRow[x];
+				pos += m_channels;
+			}
+		}
+	}
+}
+
+void GFloatImage::blurGaussian(double sigma)
+{
+	if(sigma <= 0.0 || m_data.size() == 0)
+		return;
+	GFloatImageFilterTable horiz;
+	horiz.makeGaussian(m_width, sigma);
+	GFloatImageFilterTable vert;
+	vert.makeGaussian(m_height, sigma);
+	GFloatImage tmp;
+	tmp.setSize(m_width, m_height, m_channels);
+	GFloatImageRowPass rowPass(*this, tmp, horiz);
+	GFloatImage_doPass(rowPass, m_channels, m_height, m_workerThreads);
+	GFloatImageColumnPass columnPass(tmp, *this, vert);
+	GFloatImage_doPass(columnPass, m_channels, m_height, m_workerThreads);
+}
+
+void GFloatImage::blurBox(size_t radius)
+{
+	if(radius == 0 || m_data.size() == 0)
+		return;
+	GFloatImage tmp;
+	tmp.setSize(m_width, m_height, m_channels);
+	GFloatImageBoxRowPass rowPass(*this, tmp, radius);
+	GFloatImage_doPass(rowPass, m_channels, m_height, m_workerThreads);
+	GFloatImageBoxColumnPass columnPass(tmp, *this, radius);
+	GFloatImage_doPass(columnPass, m_channels, m_height, m_workerThreads);
+}
+
+void GFloatImage::resample(GFloatImage& out, unsigned int width, unsigned int height, ResampleFilter filter) const
+{
+	if(&out == this)
+		throw Ex("Cannot resample into the same image");
+	if(width == 0 || height == 0 || m_width == 0 || m_height == 0)
+		throw Ex("Cannot resample an empty image");
+
+	// Resample the rows, and then the columns
+	GFloatImageFilterTable horiz;
+	horiz.makeResample(m_width, width, filter);
+	GFloatImageFilterTable vert;
+	vert.makeResample(m_height, height, filter);
+	GFloatImage tmp;
+	tmp.setSize(width, m_height, m_channels);
+	GFloatImageRowPass rowPass(*this, tmp, horiz);
+	GFloatImage_doPass(rowPass, m_channels, m_height, m_workerThreads);
+	out.setSize(width, height, m_channels);
+	GFloatImageColumnPass columnPass(tmp, out, vert);
+	GFloatImage_doPass(columnPass, m_channels, height, m_workerThreads);
+}
+
+#ifndef NO_TEST_CODE
+void GFloatImage_randomImage(GFloatImage& image, unsigned int width, unsigned int height, unsigned int channels, GRand& rand)
+{
+	image.setSize(width, height, channels);
+	for(size_t c = 0; c < channels; c++)
+	{
+		for(size_t y = 0; y < height; y++)
+		{
+			float* pRow = image.row(c, y);
+			for(size_t x = 0; x < width; x++)
+				pRow[x] = (float)rand.uniform() * 255.0f;
+		}
+	}
+}
+
+void GFloatImage_checkSame(const GFloatImage& a, const GFloatImage& b, double tolerance)
+{
+	if(a.width() != b.width() || a.height() != b.height() || a.channels() != b.channels())
+		throw Ex("Wrong size");
+	for(size_t c = 0; c < a.channels(); c++)
+	{
+		for(size_t y = 0; y < a.height(); y++)
+		{
+			for(size_t x = 0; x < a.width(); x++)
+			{
+				if(std::abs(a.row(c, y)[x] - b.row(c, y)[x]) > tolerance)
+					throw Ex("Expected ", to_str(b.row(c, y)[x]), " at (", to_str(x), ", ", to_str(y), "). Got ", to_str(a.row(c, y)[x]));
+			}
+		}
+	}
+}
+
+// Convolves with a 2D kernel, one pixel at a time
+void GFloatImage_naiveFilter(const GFloatImage& in, GFloatImage& out, const vector<double>& kernel1d)
+{
+	int radius = (int)kernel1d.size() / 2;
+	double sum = 0.0;
+	for(size_t i = 0; i < kernel1d.size(); i++)
+		sum += kernel1d[i];
+	out.setSize(in.width(), in.height(), in.channels());
+	int lastX = (int)in.width() - 1;
+	int lastY = (int)in.height() - 1;
+	for(size_t c = 0; c < in.channels(); c++)
+	{
+		for(int y = 0; y <= lastY; y++)
+		{
+			for(int x = 0; x <= lastX; x++)
+			{
+				double v = 0.0;
+				for(int j = -radius; j <= radius; j++)
+				{
+					for(int i = -radius; i <= radius; i++)
+						v += kernel1d[i + radius] * kernel1d[j + radius] * in.row(c, std::max(0, std::min(lastY, y + j)))[std::max(0, std::min(lastX, x + i))];
+				}
+				out.row(c, y)[x] = (float)(v / (sum * sum));
+			}
+		}
+	}
+}
+
+// static
+void GFloatImage::test()
+{
+	GRand rand(0);
+
+	// Converting to and from a GImage should not change it
+	GImage image;
+	image.setSize(13, 7);
+	for(unsigned int y = 0; y < image.height(); y++)
+	{
+		for(unsigned int x = 0; x < image.width(); x++)
+			image.setPixel(x, y, (unsigned int)rand.next());
+	}
+	GFloatImage f;
+	f.fromImage(image);
+	GImage image2;
+	f.toImage(image2);
+	for(unsigned int y = 0; y < image.height(); y++)
+	{
+		for(unsigned int x = 0; x < image.width(); x++)
+		{
+			if(image.pixel(x, y) != image2.pixel(x, y))
+				throw Ex("Round-trip failed");
+		}
+	}
+
+	// The separable filters should match a 2D convolution
+	GFloatImage src;
+	GFloatImage_randomImage(src, 37, 29, 3, rand);
+	double sigma = 1.7;
+	int radius = (int)std::ceil(3.0 * sigma);
+	vector<double> gauss(2 * radius + 1);
+	for(int k = -radius; k <= radius; k++)
+		gauss[k + radius] = std::exp(-0.5 * k * k / (sigma * sigma));
+	GFloatImage expected;
+	GFloatImage_naiveFilter(src, expected, gauss);
+	GFloatImage blurred;
+	blurred.m_data = src.m_data;
+	blurred.setSize(src.width(), src.height(), src.channels());
+	blurred.blurGaussian(sigma);
+	GFloatImage_checkSame(blurred, expected, 1e-3);
+	vector<double> box(5, 1.0);
+	GFloatImage_naiveFilter(src, expected, box);
+	blurred.m_data = src.m_data;
+	blurred.blurBox(2);
+	GFloatImage_checkSame(blurred, expected, 1e-3);
+
+	// Resampling to the same size should not change the image, and constant images should stay constant
+	GFloatImage resampled;
+	GFloatImage constant;
+	constant.setSize(20, 15, 1);
+	std::fill(constant.m_data.begin(), constant.m_data.end(), 100.0f);
+	GFloatImage flat;
+	for(int filter = Bilinear; filter <= Lanczos3; filter++)
+	{
+		src.resample(resampled, src.width(), src.height(), (ResampleFilter)filter);
+		GFloatImage_checkSame(resampled, src, 1e-3);
+		constant.resample(resampled, 47, 6, (ResampleFilter)filter);
+		flat.setSize(47, 6, 1);
+		std::fill(flat.m_data.begin(), flat.m_data.end(), 100.0f);
+		GFloatImage_checkSame(resampled, flat, 1e-3);
+	}
+
+	// Halving a checkerboard should make it gray (away from the edges, which are repeated)
+	GFloatImage checkers;
+	checkers.setSize(16, 16, 1);
+	for(size_t y = 0; y < 16; y++)
+	{
+		for(size_t x = 0; x < 16; x++)
+			checkers.row(0, y)[x] = ((x + y) & 1) ? 255.0f : 0.0f;
+	}
+	checkers.resample(resampled, 8, 8, Bilinear);
+	for(size_t y = 1; y < 7; y++)
+	{
+		for(size_t x = 1; x < 7; x++)
+		{
+			if(std::abs(resampled.row(0, y)[x] - 127.5f) > 1e-3)
+				throw Ex("Expected gray");
+		}
+	}
+
+	// More threads should give exactly the same results
+	GFloatImage big;
+	GFloatImage_randomImage(big, 101, 75, 4, rand);
+	GFloatImage single;
+	big.resample(single, 64, 150, Lanczos3);
+	single.blurGaussian(2.5);
+	single.blurBox(3);
+	big.setWorkerThreads(3);
+	GFloatImage multi;
+	big.resample(multi, 64, 150, Lanczos3);
+	multi.setWorkerThreads(3);
+	multi.blurGaussian(2.5);
+	multi.blurBox(3);
+	GFloatImage_checkSame(multi, single, 0.0);
+}
+#endif // NO_TEST_CODE
+
 } // namespace GClasses
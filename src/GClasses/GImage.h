@@ -21,6 +21,7 @@
 #define __GIMAGE_H__
 
 #include <stddef.h>
+#include <vector>
 #include "GError.h"
 
 namespace GClasses {
@@ -29,6 +30,8 @@ class GBezier;
 class GRect;
 class GRand;
 class GDoubleRect;
+class GImage;
+class GVec;
 
 #define gBlue(c) ((c) & 0xff)
 #define gGreen(c) (((c) >> 8) & 0xff)
@@ -97,6 +100,89 @@ const char* rgbToHex(char* pOutHex, unsigned int c);
 
 unsigned int hexToRgb(const char* szHex);
 
+/// An image with a separate plane of floats for each channel. This is a good representation
+/// for filtering and resampling, which are done one channel and one row at a time. (The
+/// channels are red, green, blue, and optionally alpha, with values from 0 to 255.)
+/// The filters are separable, and the rows are divided into bands that may be processed
+/// by several threads. Each band is computed the same way regardless of the number of
+/// threads, so the results do not depend on it.
+class GFloatImage
+{
+public:
+	enum ResampleFilter
+	{
+		Bilinear,
+		Bicubic, // Catmull-Rom
+		Lanczos3,
+	};
+
+protected:
+	std::vector<float> m_data;
+	unsigned int m_width;
+	unsigned int m_height;
+	unsigned int m_channels;
+	size_t m_workerThreads;
+
+public:
+	GFloatImage();
+	~GFloatImage();
+
+	/// Resizes the image. The values are not preserved.
+	void setSize(unsigned int width, unsigned int height, unsigned int channels);
+
+	/// Returns the width of the image in pixels
+	unsigned int width() const { return m_width; }
+
+	/// Returns the height of the image in pixels
+	unsigned int height() const { return m_height; }
+
+	/// Returns the number of channels
+	unsigned int channels() const { return m_channels; }
+
+	/// Returns a pointer to the first value in the specified row of the specified channel.
+	/// (The rows of each channel are contiguous.)
+	float* row(size_t channel, size_t y) { return &m_data[(channel * m_height + y) * m_width]; }
+
+	/// Returns a const pointer to the first value in the specified row of the specified channel.
+	const float* row(size_t channel, size_t y) const { return &m_data[(channel * m_height + y) * m_width]; }
+
+	/// Specifies the number of threads used to filter and resample. (The default is 1.)
+	void setWorkerThreads(size_t n) { m_workerThreads = (n > 1 ? n : 1); }
+
+	/// Swaps the contents of this image with that of another
+	void swapData(GFloatImage& other);
+
+	/// Copies the red, green, and blue channels of image into this one. If alpha is true,
+	/// the alpha channel is copied too.
+	void fromImage(const GImage& image, bool alpha = true);
+
+	/// Rounds and clips the values into image. If there are only 3 channels, the alpha
+	/// values will be 255. If there is only 1 channel, it is treated as gray.
+	void toImage(GImage& image) const;
+
+	/// Copies the values, multiplied by scale, into out with the channels interleaved,
+	/// which is the order GLayerConvolutional2D expects its inputs.
+	void toVec(GVec& out, double scale = 1.0 / 255.0) const;
+
+	/// Blurs with a Gaussian kernel with standard deviation sigma, truncated
+	/// at 3 sigma. The edge pixels are repeated as necessary.
+	void blurGaussian(double sigma);
+
+	/// Replaces each value with the mean of the square of width 2*radius+1 around it.
+	/// (The cost does not depend on the radius.) The edge pixels are repeated as necessary.
+	void blurBox(size_t radius);
+
+	/// Resamples this image to the specified size, and puts the results in out. When
+	/// shrinking, the filter is stretched to cover all of the source pixels.
+	void resample(GFloatImage& out, unsigned int width, unsigned int height, ResampleFilter filter = Bicubic) const;
+
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif
+};
+
+
 /// Represents an image
 class GImage
 {
@@ -279,6 +365,11 @@ public:
 	/// Scale the image
 	void scale(unsigned int nNewWidth, unsigned int nNewHeight);
 
+	/// Resamples the image to the specified size with a separable filter. Unlike scale,
+	/// this aligns the pixel centers, and averages over all of the source pixels when
+	/// shrinking. See GFloatImage::resample.
+	void resample(unsigned int newWidth, unsigned int newHeight, GFloatImage::ResampleFilter filter = GFloatImage::Bicubic, size_t threads = 1);
+
 	/// Crops the image. (You can crop bigger by using values outside the picture)
 	void crop(int left, int top, int width, int height);
 
@@ -297,6 +388,14 @@ public:
 	/// Blurs by averaging uniformly over a square, plus some optimizations
 	void blurQuick(int iters, int nRadius);
 
+	/// Blurs with a separable Gaussian kernel with standard deviation sigma. (This
+	/// is much faster than blur, especially with big kernels.) See GFloatImage::blurGaussian.
+	void blurGaussian(double sigma, size_t threads = 1);
+
+	/// Replaces each pixel with the mean of the square of width 2*radius+1 around it.
+	/// See GFloatImage::blurBox.
+	void blurBox(size_t radius, size_t threads = 1);
+
 	/// Sharpen the image
 	void sharpen(double dFactor);
 
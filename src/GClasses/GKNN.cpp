@@ -31,6 +31,7 @@
 #include "GDistance.h"
 #include "GSparseMatrix.h"
 #include "GHolders.h"
+#include "GProfiler.h"
 #include "GBitTable.h"
 #include <map>
 #include <queue>
@@ -198,6 +199,37 @@ GDomNode* GKNN::serialize(GDom* pDoc) const
 	return pNode;
 }
 
+// virtual
+GSupervisedLearner* GKNN::clone()
+{
+	if(m_eInterpolationMethod == Learner)
+		return NULL;
+	if((m_pDistanceMetric || m_pSparseMetric) && !m_ownMetric)
+		return NULL;
+	GKNN* pClone = new GKNN();
+	std::unique_ptr<GKNN> hClone(pClone);
+	pClone->m_nNeighbors = m_nNeighbors;
+	pClone->m_eInterpolationMethod = m_eInterpolationMethod;
+	pClone->m_eTrainMethod = m_eTrainMethod;
+	pClone->m_trainParam = m_trainParam;
+	pClone->m_normalizeScaleFactors = m_normalizeScaleFactors;
+	pClone->m_optimizeScaleFactors = m_optimizeScaleFactors;
+	try
+	{
+		// Metrics are copied by round-tripping them through a DOM
+		GDom doc;
+		if(m_pDistanceMetric)
+			pClone->setMetric(GDistanceMetric::deserialize(m_pDistanceMetric->serialize(&doc)), true);
+		else if(m_pSparseMetric)
+			pClone->setMetric(GSparseSimilarity::deserialize(m_pSparseMetric->serialize(&doc)), true);
+	}
+	catch(const std::exception&)
+	{
+		return NULL;
+	}
+	return hClone.release();
+}
+
 void GKNN::autoTune(GMatrix& feats, GMatrix& labs)
 {
 	// Find the best value for k
@@ -352,6 +384,7 @@ void GKNN::trainIncremental(const GVec& in, const GVec& out)
 
 void GKNN::trainInner(const GMatrix& feats, const GMatrix& labs)
 {
+	GPROFILE_SCOPE("GKNN::trainInner");
 	if(m_pSparseMetric)
 		throw Ex("This method is not compatible with sparse similarity metrics. You should either use trainSparse instead, or use a dense dissimilarity metric.");
 	beginIncrementalLearningInner(feats.relation(), labs.relation());
@@ -439,6 +472,7 @@ size_t GKNN::findNeighbors(const GVec& vec)
 {
 	if(!m_pNeighborFinder)
 	{
+		GPROFILE_SCOPE("GKNN::findNeighbors build");
 		if(m_pDistanceMetric)
 		{
 			//m_pNeighborFinder = new GBruteForceNeighborFinder(m_pFeatures, m_nNeighbors, m_pDistanceMetric, false);
@@ -453,7 +487,10 @@ size_t GKNN::findNeighbors(const GVec& vec)
 		}
 	}
 	GAssert(m_pNeighborFinder->neighborCount() == m_nNeighbors);
-	return m_pNeighborFinder->findNeighbors(vec);
+	GPROFILE_SCOPE("GKNN::findNeighbors query");
+	size_t found = m_pNeighborFinder->findNeighbors(vec);
+	GPROFILE_HISTOGRAM("GKNN::findNeighbors found", found);
+	return found;
 }
 
 void GKNN::interpolateMean(size_t nc, const GVec& in, GPrediction* out, GVec* pOut2)
@@ -100,6 +100,10 @@ public:
 	/// Marshal this object into a DOM, which can then be converted to a variety of serial formats.
 	virtual GDomNode* serialize(GDom* pDoc) const;
 
+	/// Returns a new untrained instance with the same settings as this one, or NULL
+	/// if this uses an interpolation learner or a metric that it does not own.
+	virtual GSupervisedLearner* clone();
+
 	/// See the comment for GSupervisedLearner::predict
 	virtual void predict(const GVec& in, GVec& out);
 
@@ -20,8 +20,14 @@
 #include "GHillClimber.h"
 #include "GDistribution.h"
 #include "GMath.h"
+#include "GThread.h"
+#include "GRand.h"
+#include <memory>
+#include <string>
+#include <vector>
 
 using namespace GClasses;
+using std::vector;
 
 GDomNode* GKernel::makeBaseNode(GDom* pDoc) const
 {
@@ -86,3 +92,370 @@ GKernel* GKernel::kernelComplex1()
 	return pK14;
 }
 
+
+bool GKernel_hasUnknowns(const GMatrix& m)
+{
+	for(size_t i = 0; i < m.rows(); i++)
+	{
+		const GVec& r = m[i];
+		for(size_t j = 0; j < r.size(); j++)
+		{
+			if(r[j] == UNKNOWN_REAL_VALUE)
+				return true;
+		}
+	}
+	return false;
+}
+
+// Computes out = a * b^T, four columns of out at a time
+void GKernel_dotBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	if(a.cols() != b.cols())
+		throw Ex("Mismatching number of columns");
+	size_t dims = a.cols();
+	size_t n = b.rows();
+	out.resize(a.rows(), n);
+	for(size_t i = 0; i < a.rows(); i++)
+	{
+		const double* pA = a[i].data();
+		GVec& r = out[i];
+		size_t j = 0;
+		for( ; j + 4 <= n; j += 4)
+		{
+			const double* pB0 = b[j].data();
+			const double* pB1 = b[j + 1].data();
+			const double* pB2 = b[j + 2].data();
+			const double* pB3 = b[j + 3].data();
+			double s0 = 0.0;
+			double s1 = 0.0;
+			double s2 = 0.0;
+			double s3 = 0.0;
+			for(size_t k = 0; k < dims; k++)
+			{
+				double v = pA[k];
+				s0 += v * pB0[k];
+				s1 += v * pB1[k];
+				s2 += v * pB2[k];
+				s3 += v * pB3[k];
+			}
+			r[j] = s0;
+			r[j + 1] = s1;
+			r[j + 2] = s2;
+			r[j + 3] = s3;
+		}
+		for( ; j < n; j++)
+			r[j] = a[i].dotProduct(b[j]);
+	}
+}
+
+// virtual
+void GKernel::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	out.resize(a.rows(), b.rows());
+	for(size_t i = 0; i < a.rows(); i++)
+	{
+		const GVec& x = a[i];
+		GVec& r = out[i];
+		for(size_t j = 0; j < b.rows(); j++)
+			r[j] = apply(x, b[j]);
+	}
+}
+
+// virtual
+void GKernelIdentity::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	if(GKernel_hasUnknowns(a) || GKernel_hasUnknowns(b))
+		GKernel::applyBlock(a, b, out);
+	else
+		GKernel_dotBlock(a, b, out);
+}
+
+// virtual
+void GKernelPolynomial::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	if(GKernel_hasUnknowns(a) || GKernel_hasUnknowns(b))
+	{
+		GKernel::applyBlock(a, b, out);
+		return;
+	}
+	GKernel_dotBlock(a, b, out);
+	for(size_t i = 0; i < out.rows(); i++)
+	{
+		GVec& r = out[i];
+		for(size_t j = 0; j < r.size(); j++)
+			r[j] = pow(r[j] + m_offset, (int)m_order);
+	}
+}
+
+// virtual
+void GKernelGaussianRBF::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	if(GKernel_hasUnknowns(a) || GKernel_hasUnknowns(b))
+	{
+		GKernel::applyBlock(a, b, out);
+		return;
+	}
+	GKernel_dotBlock(a, b, out);
+	GVec bMag(b.rows());
+	for(size_t j = 0; j < b.rows(); j++)
+		bMag[j] = b[j].squaredMagnitude();
+	double scale = -0.5 / m_variance;
+	for(size_t i = 0; i < out.rows(); i++)
+	{
+		double aMag = a[i].squaredMagnitude();
+		GVec& r = out[i];
+		for(size_t j = 0; j < r.size(); j++)
+		{
+			// Rounding can make the squared distance slightly negative
+			double d = std::max(0.0, aMag + bMag[j] - 2.0 * r[j]);
+			r[j] = exp(scale * d);
+		}
+	}
+}
+
+// virtual
+void GKernelTranslate::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	m_pK->applyBlock(a, b, out);
+	for(size_t i = 0; i < out.rows(); i++)
+	{
+		GVec& r = out[i];
+		for(size_t j = 0; j < r.size(); j++)
+			r[j] += m_value;
+	}
+}
+
+// virtual
+void GKernelScale::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	m_pK->applyBlock(a, b, out);
+	out.multiply(m_value);
+}
+
+// virtual
+void GKernelAdd::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	m_pK1->applyBlock(a, b, out);
+	GMatrix tmp;
+	m_pK2->applyBlock(a, b, tmp);
+	out.add(&tmp);
+}
+
+// virtual
+void GKernelMultiply::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	m_pK1->applyBlock(a, b, out);
+	GMatrix tmp;
+	m_pK2->applyBlock(a, b, tmp);
+	for(size_t i = 0; i < out.rows(); i++)
+	{
+		GVec& r = out[i];
+		const GVec& t = tmp[i];
+		for(size_t j = 0; j < r.size(); j++)
+			r[j] *= t[j];
+	}
+}
+
+// virtual
+void GKernelPow::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	m_pK->applyBlock(a, b, out);
+	for(size_t i = 0; i < out.rows(); i++)
+	{
+		GVec& r = out[i];
+		for(size_t j = 0; j < r.size(); j++)
+			r[j] = pow(r[j], m_value);
+	}
+}
+
+// virtual
+void GKernelExp::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	m_pK->applyBlock(a, b, out);
+	for(size_t i = 0; i < out.rows(); i++)
+	{
+		GVec& r = out[i];
+		for(size_t j = 0; j < r.size(); j++)
+			r[j] = exp(r[j]);
+	}
+}
+
+// virtual
+void GKernelNormalize::applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out)
+{
+	m_pK->applyBlock(a, b, out);
+	GVec bSelf(b.rows());
+	for(size_t j = 0; j < b.rows(); j++)
+		bSelf[j] = m_pK->apply(b[j], b[j]);
+	for(size_t i = 0; i < out.rows(); i++)
+	{
+		double aSelf = m_pK->apply(a[i], a[i]);
+		GVec& r = out[i];
+		for(size_t j = 0; j < r.size(); j++)
+			r[j] /= sqrt(aSelf * bSelf[j]);
+	}
+}
+
+/// Computes the tiles of a Gram matrix. (Used by GKernel::gramMatrix.)
+class GKernelGramWorker : public GWorkerThread
+{
+protected:
+	GKernel* m_pKernel;
+	const vector<GMatrix*>& m_tiles;
+	const vector<size_t>& m_starts;
+	const vector<size_t>& m_jobRows;
+	const vector<size_t>& m_jobCols;
+	GMatrix& m_out;
+	vector<std::string>& m_errors;
+	GMatrix m_buf;
+
+public:
+	GKernelGramWorker(GMasterThread& master, GKernel* pKernel, const vector<GMatrix*>& tiles, const vector<size_t>& starts, const vector<size_t>& jobRows, const vector<size_t>& jobCols, GMatrix& out, vector<std::string>& errors)
+	: GWorkerThread(master), m_pKernel(pKernel), m_tiles(tiles), m_starts(starts), m_jobRows(jobRows), m_jobCols(jobCols), m_out(out), m_errors(errors)
+	{
+	}
+
+	virtual ~GKernelGramWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		// Exceptions must not escape from a worker thread, so they are reported back to the master
+		try
+		{
+			size_t ti = m_jobRows[jobId];
+			size_t tj = m_jobCols[jobId];
+			m_pKernel->applyBlock(*m_tiles[ti], *m_tiles[tj], m_buf);
+
+			// Each job writes to its own tile and its mirror image, so no lock is needed
+			size_t r0 = m_starts[ti];
+			size_t c0 = m_starts[tj];
+			for(size_t i = 0; i < m_buf.rows(); i++)
+			{
+				const GVec& r = m_buf[i];
+				for(size_t j = 0; j < r.size(); j++)
+				{
+					m_out[r0 + i][c0 + j] = r[j];
+					m_out[c0 + j][r0 + i] = r[j];
+				}
+			}
+		}
+		catch(const std::exception& e)
+		{
+			m_errors[jobId] = e.what();
+		}
+	}
+};
+
+void GKernel::gramMatrix(const GMatrix& x, GMatrix& out, size_t threads)
+{
+	// Make views of the tiles of rows
+	size_t n = x.rows();
+	out.resize(n, n);
+	size_t tileSize = 64;
+	vector<GMatrix*> tiles;
+	vector<size_t> starts;
+	for(size_t start = 0; start < n; start += tileSize)
+	{
+		GMatrix* pTile = new GMatrix(x.relation().clone());
+		for(size_t i = start; i < std::min(n, start + tileSize); i++)
+			pTile->takeRow((GVec*)&x[i]);
+		tiles.push_back(pTile);
+		starts.push_back(start);
+	}
+
+	// Enumerate the tiles on or below the diagonal
+	vector<size_t> jobRows;
+	vector<size_t> jobCols;
+	for(size_t i = 0; i < tiles.size(); i++)
+	{
+		for(size_t j = 0; j <= i; j++)
+		{
+			jobRows.push_back(i);
+			jobCols.push_back(j);
+		}
+	}
+	vector<std::string> errors(jobRows.size());
+	if(jobRows.size() > 0)
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < std::max((size_t)1, std::min(threads, jobRows.size())); i++)
+			master.addWorker(new GKernelGramWorker(master, this, tiles, starts, jobRows, jobCols, out, errors));
+		master.doJobs(jobRows.size());
+	}
+	for(size_t i = 0; i < tiles.size(); i++)
+	{
+		tiles[i]->releaseAllRows();
+		delete(tiles[i]);
+	}
+	for(size_t i = 0; i < errors.size(); i++)
+	{
+		if(errors[i].length() > 0)
+			throw Ex(errors[i]);
+	}
+}
+
+#ifndef NO_TEST_CODE
+void GKernel_testBlock(GKernel* pKernel, const GMatrix& a, const GMatrix& b)
+{
+	std::unique_ptr<GKernel> hKernel(pKernel);
+	GMatrix out;
+	pKernel->applyBlock(a, b, out);
+	if(out.rows() != a.rows() || out.cols() != b.rows())
+		throw Ex("wrong size");
+	for(size_t i = 0; i < a.rows(); i++)
+	{
+		for(size_t j = 0; j < b.rows(); j++)
+		{
+			double expected = pKernel->apply(a[i], b[j]);
+			if(std::abs(out[i][j] - expected) > 1e-9 * std::max(1.0, std::abs(expected)))
+				throw Ex("applyBlock disagrees with apply for the ", pKernel->name(), " kernel");
+		}
+	}
+
+	// The Gram matrix should be the same with any number of threads
+	GMatrix g1;
+	pKernel->gramMatrix(a, g1, 1);
+	GMatrix g3;
+	pKernel->gramMatrix(a, g3, 3);
+	for(size_t i = 0; i < a.rows(); i++)
+	{
+		for(size_t j = 0; j < a.rows(); j++)
+		{
+			double expected = pKernel->apply(a[i], a[j]);
+			if(std::abs(g1[i][j] - expected) > 1e-9 * std::max(1.0, std::abs(expected)))
+				throw Ex("gramMatrix disagrees with apply for the ", pKernel->name(), " kernel");
+			if(g3[i][j] != g1[i][j])
+				throw Ex("gramMatrix depends on the number of threads");
+		}
+	}
+}
+
+// static
+void GKernel::test()
+{
+	GRand rand(0);
+	GMatrix a(150, 5);
+	GMatrix b(37, 5);
+	for(size_t i = 0; i < a.rows(); i++)
+		a[i].fillNormal(rand, 0.5);
+	for(size_t i = 0; i < b.rows(); i++)
+		b[i].fillNormal(rand, 0.5);
+	for(size_t pass = 0; pass < 2; pass++)
+	{
+		GKernel_testBlock(new GKernelIdentity(), a, b);
+		GKernel_testBlock(new GKernelPolynomial(1.0, 3), a, b);
+		GKernel_testBlock(new GKernelGaussianRBF(0.3), a, b);
+		GKernel_testBlock(new GKernelScale(new GKernelGaussianRBF(2.0), 3.0), a, b);
+		GKernel_testBlock(new GKernelTranslate(new GKernelIdentity(), 0.5), a, b);
+		GKernel_testBlock(new GKernelExp(new GKernelIdentity()), a, b);
+		GKernel_testBlock(new GKernelPow(new GKernelGaussianRBF(1.0), 2), a, b);
+		GKernel_testBlock(kernelComplex1(), a, b);
+
+		// Unknown values should fall back to the pairwise computation
+		a[3][1] = UNKNOWN_REAL_VALUE;
+		b[5][4] = UNKNOWN_REAL_VALUE;
+	}
+}
+#endif // !NO_TEST_CODE
@@ -48,6 +48,17 @@ public:
 	/// Applies the kernel to the two specified vectors.
 	virtual double apply(const GVec& pA, const GVec& pB) = 0;
 
+	/// Applies the kernel to every pair of rows in a and b, such that out[i][j] = apply(a[i], b[j]).
+	/// out is resized to a.rows() x b.rows(). The default implementation calls apply for each pair,
+	/// but kernels that can be computed with matrix operations override it.
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
+
+	/// Computes the Gram matrix of the rows in x, such that out[i][j] = apply(x[i], x[j]).
+	/// The matrix is computed in square tiles with applyBlock, and only the tiles on or below
+	/// the diagonal are computed, since the matrix is symmetric. The tiles are distributed
+	/// among the specified number of threads.
+	void gramMatrix(const GMatrix& x, GMatrix& out, size_t threads = 1);
+
 	/// Deserializes a kernel object
 	static GKernel* deserialize(GDomNode* pNode);
 
@@ -56,6 +67,10 @@ public:
 	/// The caller is responsible to delete the object this returns.
 	static GKernel* kernelComplex1();
 
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // !NO_TEST_CODE
 
 protected:
 	/// Helper method used by the serialize methods in child classes
@@ -85,6 +100,9 @@ public:
 	{
 		return pA.dotProductIgnoringUnknowns(pB);
 	}
+
+	/// Computes a*b^T
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 /// Chi Squared kernel
@@ -147,6 +165,9 @@ public:
 	{
 		return pow(pA.dotProductIgnoringUnknowns(pB) + m_offset, (int)m_order);
 	}
+
+	/// Computes (a*b^T + offset)^order
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 /// A Gaussian RBF kernel
@@ -176,6 +197,9 @@ public:
 	{
 		return exp(-0.5 * pA.estimateSquaredDistanceWithUnknowns(pB) / m_variance);
 	}
+
+	/// Computes the squared distances from the matrix product, as ||A||^2 + ||B||^2 - 2*A*B
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 /// A translation kernel
@@ -208,6 +232,9 @@ public:
 	{
 		return m_pK->apply(pA, pB) + m_value;
 	}
+
+	/// Applies the inner kernel to the whole block
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 /// A scalar kernel
@@ -240,6 +267,9 @@ public:
 	{
 		return m_pK->apply(pA, pB) * m_value;
 	}
+
+	/// Applies the inner kernel to the whole block
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 /// An addition kernel
@@ -272,6 +302,9 @@ public:
 	{
 		return m_pK1->apply(pA, pB) + m_pK2->apply(pA, pB);
 	}
+
+	/// Applies both kernels to the whole block
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 /// A multiplication kernel
@@ -304,6 +337,9 @@ public:
 	{
 		return m_pK1->apply(pA, pB) * m_pK2->apply(pA, pB);
 	}
+
+	/// Applies both kernels to the whole block
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 /// A power kernel
@@ -336,6 +372,9 @@ public:
 	{
 		return pow(m_pK->apply(pA, pB), m_value);
 	}
+
+	/// Applies the inner kernel to the whole block
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 /// The Exponential kernel
@@ -366,6 +405,9 @@ public:
 	{
 		return exp(m_pK->apply(pA, pB));
 	}
+
+	/// Applies the inner kernel to the whole block
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 /// A Normalizing kernel
@@ -396,6 +438,9 @@ public:
 	{
 		return m_pK->apply(pA, pB) / sqrt(m_pK->apply(pA, pA) * m_pK->apply(pB, pB));
 	}
+
+	/// Applies the inner kernel to the whole block
+	virtual void applyBlock(const GMatrix& a, const GMatrix& b, GMatrix& out);
 };
 
 
@@ -23,6 +23,7 @@
 #include "GRand.h"
 #include "GDom.h"
 #include <time.h>
+#include <vector>
 
 namespace GClasses {
 
@@ -198,27 +199,36 @@ unsigned char* GKeyPair::powerMod(const unsigned char* pInput, int nInputSize, b
 /*static*/ void GKeyPair::test()
 {
 	GRand prng(0);
-	unsigned int buf[6];
-	for(int i = 0; i < 6; i++)
-		buf[i] = (unsigned int)prng.next();
-	GKeyPair kp;
-	kp.generateKeyPair(2, buf, buf + 2, buf + 4);
-
-	// Make up a message
-	GBigInt message;
-	message.setUInt(0, 0x6a54);
-
-	// Encrypt it
-	GBigInt cypher;
-	cypher.powerMod(&message, kp.privateKey(), kp.n());
-
-	// Decrypt it
-	GBigInt final;
-	final.powerMod(&cypher, kp.publicKey(), kp.n());
-
-	// Check the final value
-	if(final.compareTo(&message) != 0)
-		throw Ex("failed");
+
+	// Try a tiny key, and a 1024-bit key (which exercises the Karatsuba and Montgomery paths in GBigInt)
+	unsigned int sizes[] = { 2, 16 };
+	for(size_t s = 0; s < 2; s++)
+	{
+		unsigned int uintCount = sizes[s];
+		std::vector<unsigned int> buf(3 * uintCount);
+		for(size_t i = 0; i < buf.size(); i++)
+			buf[i] = (unsigned int)prng.next();
+		GKeyPair kp;
+		kp.generateKeyPair(uintCount, buf.data(), buf.data() + uintCount, buf.data() + 2 * uintCount);
+
+		// Make up a message
+		GBigInt message;
+		message.setUInt(0, 0x6a54);
+		if(uintCount > 2)
+			message.setUInt(uintCount, 0x1234abcd);
+
+		// Encrypt it
+		GBigInt cypher;
+		cypher.powerMod(&message, kp.privateKey(), kp.n());
+
+		// Decrypt it
+		GBigInt final;
+		final.powerMod(&cypher, kp.publicKey(), kp.n());
+
+		// Check the final value
+		if(final.compareTo(&message) != 0)
+			throw Ex("failed");
+	}
 }
 #endif // !NO_TEST_CODE
 
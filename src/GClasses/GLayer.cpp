@@ -42,6 +42,9 @@
 #include "GBits.h"
 #include "GFourier.h"
 #include <memory>
+#ifdef __SSE2__
+#	include <emmintrin.h>
+#endif
 
 using std::vector;
 using std::ostream;
@@ -68,6 +71,10 @@ GNeuralNetLayer* GNeuralNetLayer::deserialize(GDomNode* pNode)
 		return new GLayerSoftMax(pNode);
 	if(strcmp(szType, "conv1") == 0)
 		return new GLayerConvolutional1D(pNode);
+	if(strcmp(szType, "conv2") == 0)
+		return new GLayerConvolutional2D(pNode);
+	if(strcmp(szType, "quantized") == 0)
+		return new GLayerQuantized(pNode);
 	else
 		throw Ex("Unrecognized neural network layer type: ", szType);
 }
@@ -2322,5 +2329,344 @@ void GMaxPooling2D::renormalizeInput(size_t input, double oldMin, double oldMax,
 
 
 
+GLayerQuantized::GLayerQuantized(GNeuralNetLayer* pSource, double inputRange)
+: m_sourceType(pSource->type()),
+m_inputs(pSource->inputs()),
+m_outputs(pSource->outputs()),
+m_inputCols(0), m_inputRows(0), m_inputChannels(0), m_outputCols(0), m_outputRows(0), m_kernelsPerChannel(0),
+m_inputScale(inputRange > 0.0 ? inputRange / 127.0 : 1.0 / 127.0)
+{
+	GDom doc;
+	if(m_sourceType.compare("classic") == 0 || m_sourceType.compare("softmax") == 0)
+	{
+		// GLayerSoftMax feeds forward exactly like GLayerClassic
+		GLayerClassic* pClassic = (GLayerClassic*)pSource;
+		m_channels = m_outputs;
+		m_fanIn = m_inputs;
+		allocate();
+		GMatrix& w = pClassic->weights();
+		GVec col(m_fanIn);
+		for(size_t i = 0; i < m_channels; i++)
+		{
+			for(size_t j = 0; j < m_fanIn; j++)
+				col[j] = w[j][i];
+			quantizeChannel(i, col);
+		}
+		m_bias.copy(pClassic->bias());
+		m_pActivationFunction = GActivationFunction::deserialize(pClassic->activationFunction()->serialize(&doc));
+	}
+	else if(m_sourceType.compare("conv2") == 0)
+	{
+		GLayerConvolutional2D* pConv = (GLayerConvolutional2D*)pSource;
+		GMatrix& kernels = pConv->kernels();
+		size_t kernelSize = kernels.cols();
+		m_inputCols = pConv->inputCols();
+		m_inputRows = pConv->inputRows();
+		m_inputChannels = pConv->inputChannels();
+		m_outputCols = m_inputCols - kernelSize + 1;
+		m_outputRows = m_inputRows - kernelSize + 1;
+		m_kernelsPerChannel = pConv->kernelsPerChannel();
+		m_channels = m_inputChannels * m_kernelsPerChannel;
+		m_fanIn = kernelSize * kernelSize;
+		allocate();
+		GVec kern(m_fanIn);
+		for(size_t i = 0; i < m_channels; i++)
+		{
+			for(size_t j = 0; j < kernelSize; j++)
+				kern.put(j * kernelSize, kernels[i * kernelSize + j]);
+			quantizeChannel(i, kern);
+		}
+		m_bias.copy(pConv->bias());
+		m_pActivationFunction = GActivationFunction::deserialize(pConv->activationFunction()->serialize(&doc));
+	}
+	else
+		throw Ex("GLayerQuantized does not support layers of type ", m_sourceType);
+}
+
+GLayerQuantized::GLayerQuantized(GDomNode* pNode)
+: m_sourceType(pNode->field("src")->asString()),
+m_inputs((size_t)pNode->field("inputs")->asInt()),
+m_outputs((size_t)pNode->field("outputs")->asInt()),
+m_channels((size_t)pNode->field("channels")->asInt()),
+m_fanIn((size_t)pNode->field("fanin")->asInt()),
+m_inputCols(0), m_inputRows(0), m_inputChannels(0), m_outputCols(0), m_outputRows(0), m_kernelsPerChannel(0),
+m_inputScale(pNode->field("iscale")->asDouble())
+{
+	if(m_sourceType.compare("conv2") == 0)
+	{
+		m_inputCols = (size_t)pNode->field("icol")->asInt();
+		m_inputRows = (size_t)pNode->field("irow")->asInt();
+		m_inputChannels = (size_t)pNode->field("ichan")->asInt();
+		m_outputCols = (size_t)pNode->field("ocol")->asInt();
+		m_outputRows = (size_t)pNode->field("orow")->asInt();
+		m_kernelsPerChannel = (size_t)pNode->field("kpc")->asInt();
+	}
+	allocate();
+	m_weightScales.deserialize(pNode->field("wscale"));
+	m_bias.deserialize(pNode->field("bias"));
+	if(m_weightScales.size() != m_channels || m_bias.size() != m_channels)
+		throw Ex("Mismatching sizes in quantized layer");
+	const char* szHex = pNode->field("weights")->asString();
+	if(strlen(szHex) != 2 * m_channels * m_fanIn)
+		throw Ex("Expected ", to_str(2 * m_channels * m_fanIn), " hexadecimal digits of weights");
+	for(size_t i = 0; i < m_channels; i++)
+		GBits::hexToBuffer(szHex + 2 * i * m_fanIn, 2 * m_fanIn, (unsigned char*)&m_weights[i * m_stride]);
+	m_pActivationFunction = GActivationFunction::deserialize(pNode->field("act_func"));
+}
+
+GLayerQuantized::~GLayerQuantized()
+{
+	delete(m_pActivationFunction);
+}
+
+void GLayerQuantized::allocate()
+{
+	m_stride = (m_fanIn + 15) & ~(size_t)15;
+	m_weights.assign(m_channels * m_stride, 0);
+	m_weightScales.resize(m_channels);
+	m_bias.resize(m_channels);
+	m_quantizedInput.assign(m_inputs, 0);
+	m_window.assign(m_stride, 0);
+	m_activation.resize(3, m_outputs);
+}
+
+// static
+bool GLayerQuantized::canQuantize(GNeuralNetLayer* pLayer)
+{
+	const char* szType = pLayer->type();
+	return strcmp(szType, "classic") == 0 || strcmp(szType, "softmax") == 0 || strcmp(szType, "conv2") == 0;
+}
+
+void GLayerQuantized::quantizeChannel(size_t channel, const GVec& weights)
+{
+	double mag = 0.0;
+	for(size_t i = 0; i < m_fanIn; i++)
+		mag = std::max(mag, std::abs(weights[i]));
+	double scale = mag > 0.0 ? mag / 127.0 : 1.0;
+	m_weightScales[channel] = scale;
+	signed char* pW = &m_weights[channel * m_stride];
+	for(size_t i = 0; i < m_fanIn; i++)
+		pW[i] = (signed char)std::max(-127.0, std::min(127.0, std::floor(weights[i] / scale + 0.5)));
+}
+
+// virtual
+GDomNode* GLayerQuantized::serialize(GDom* pDoc)
+{
+	GDomNode* pNode = baseDomNode(pDoc);
+	pNode->addField(pDoc, "src", pDoc->newString(m_sourceType.c_str()));
+	pNode->addField(pDoc, "inputs", pDoc->newInt(m_inputs));
+	pNode->addField(pDoc, "outputs", pDoc->newInt(m_outputs));
+	pNode->addField(pDoc, "channels", pDoc->newInt(m_channels));
+	pNode->addField(pDoc, "fanin", pDoc->newInt(m_fanIn));
+	if(m_sourceType.compare("conv2") == 0)
+	{
+		pNode->addField(pDoc, "icol", pDoc->newInt(m_inputCols));
+		pNode->addField(pDoc, "irow", pDoc->newInt(m_inputRows));
+		pNode->addField(pDoc, "ichan", pDoc->newInt(m_inputChannels));
+		pNode->addField(pDoc, "ocol", pDoc->newInt(m_outputCols));
+		pNode->addField(pDoc, "orow", pDoc->newInt(m_outputRows));
+		pNode->addField(pDoc, "kpc", pDoc->newInt(m_kernelsPerChannel));
+	}
+	pNode->addField(pDoc, "iscale", pDoc->newDouble(m_inputScale));
+	pNode->addField(pDoc, "wscale", m_weightScales.serialize(pDoc));
+	pNode->addField(pDoc, "bias", m_bias.serialize(pDoc));
+	std::string hex;
+	hex.resize(2 * m_channels * m_fanIn + 1);
+	for(size_t i = 0; i < m_channels; i++)
+		GBits::bufferToHex((const unsigned char*)&m_weights[i * m_stride], m_fanIn, &hex[2 * i * m_fanIn]);
+	pNode->addField(pDoc, "weights", pDoc->newString(hex.c_str()));
+	pNode->addField(pDoc, "act_func", m_pActivationFunction->serialize(pDoc));
+	return pNode;
+}
+
+// static
+int GLayerQuantized::dotProduct(const signed char* a, const signed char* b, size_t n)
+{
+#ifdef __SSE2__
+	__m128i sum = _mm_setzero_si128();
+	for(size_t i = 0; i < n; i += 16)
+	{
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+
+		// Sign-extend to 16 bits, then multiply pairs and add them into 32-bit sums
+		__m128i aLo = _mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8);
+		__m128i aHi = _mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8);
+		__m128i bLo = _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8);
+		__m128i bHi = _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8);
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(aLo, bLo));
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(aHi, bHi));
+	}
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(sum);
+#else
+	int sum = 0;
+	for(size_t i = 0; i < n; i++)
+		sum += (int)a[i] * (int)b[i];
+	return sum;
+#endif
+}
+
+// virtual
+void GLayerQuantized::feedForward(const GVec& in)
+{
+	// Quantize the input
+	double invScale = 1.0 / m_inputScale;
+	for(size_t i = 0; i < m_inputs; i++)
+		m_quantizedInput[i] = (signed char)std::max(-127.0, std::min(127.0, std::floor(in[i] * invScale + 0.5)));
+
+	GVec& n = net();
+	GVec& a = activation();
+	if(m_inputChannels == 0)
+	{
+		// Fully-connected
+		if(m_stride != m_fanIn)
+		{
+			std::copy(m_quantizedInput.begin(), m_quantizedInput.end(), m_window.begin());
+			for(size_t i = 0; i < m_channels; i++)
+				n[i] = m_bias[i] + m_weightScales[i] * m_inputScale * dotProduct(&m_weights[i * m_stride], &m_window[0], m_stride);
+		}
+		else
+		{
+			for(size_t i = 0; i < m_channels; i++)
+				n[i] = m_bias[i] + m_weightScales[i] * m_inputScale * dotProduct(&m_weights[i * m_stride], &m_quantizedInput[0], m_stride);
+		}
+		for(size_t i = 0; i < m_outputs; i++)
+			a[i] = m_pActivationFunction->squash(n[i], i);
+	}
+	else
+	{
+		// Convolutional. (This visits the inputs in the same order as GLayerConvolutional2D::feedForward.)
+		size_t netPos = 0;
+		size_t inPos = 0;
+		for(size_t h = 0; h < m_outputRows; h++) // for each output row...
+		{
+			for(size_t i = 0; i < m_outputCols; i++) // for each output column...
+			{
+				size_t kern = 0;
+				for(size_t j = 0; j < m_inputChannels; j++) // for each input channel...
+				{
+					// Gather the inputs that each kernel in this channel will see
+					for(size_t l = 0; l < m_fanIn; l++)
+						m_window[l] = m_quantizedInput[inPos + l * m_inputChannels];
+					for(size_t k = 0; k < m_kernelsPerChannel; k++) // for each kernel...
+					{
+						n[netPos] = m_bias[kern] + m_weightScales[kern] * m_inputScale * dotProduct(&m_weights[kern * m_stride], &m_window[0], m_stride);
+						a[netPos] = m_pActivationFunction->squash(n[netPos], kern);
+						netPos++;
+						kern++;
+					}
+					inPos++;
+				}
+			}
+		}
+	}
+}
+
+void GLayerQuantized::throwInferenceOnly()
+{
+	throw Ex("GLayerQuantized only supports inference. Train the network before quantizing it.");
+}
+
+// virtual
+void GLayerQuantized::resize(size_t inputs, size_t outputs, GRand* pRand, double deviation)
+{
+	if(inputs != m_inputs || outputs != m_outputs)
+		throw Ex("Changing the size of GLayerQuantized is not supported");
+}
+
+// virtual
+void GLayerQuantized::dropOut(GRand& rand, double probOfDrop)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::computeError(const GVec& target)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::deactivateError()
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::backPropError(GNeuralNetLayer* pUpStreamLayer)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::updateDeltas(const GVec& upStreamActivation, double momentum)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::applyDeltas(double learningRate)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::applyAdaptive()
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::scaleWeights(double factor, bool scaleBiases)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::diminishWeights(double amount, bool regularizeBiases)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::copyWeights(const GNeuralNetLayer* pSource)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::resetWeights(GRand& rand)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::perturbWeights(GRand& rand, double deviation, size_t start, size_t count)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::maxNorm(double min, double max)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::regularizeActivationFunction(double lambda)
+{
+	throwInferenceOnly();
+}
+
+// virtual
+void GLayerQuantized::renormalizeInput(size_t input, double oldMin, double oldMax, double newMin, double newMax)
+{
+	throwInferenceOnly();
+}
+
+
+
 } // namespace GClasses
 
@@ -894,6 +894,11 @@ using GNeuralNetLayer::updateDeltas;
 	GVec& bias() { return m_bias[0]; }
 	GVec& biasDelta() { return m_bias[1]; }
 	GMatrix& kernels() { return m_kernels; }
+	GActivationFunction* activationFunction() { return m_pActivationFunction; }
+	size_t inputCols() { return m_inputCols; }
+	size_t inputRows() { return m_inputRows; }
+	size_t inputChannels() { return m_inputChannels; }
+	size_t kernelsPerChannel() { return m_kernelsPerChannel; }
 };
 
 
@@ -1018,6 +1023,152 @@ using GNeuralNetLayer::updateDeltas;
 
 
 
+/// An inference-only layer that approximates a GLayerClassic, GLayerSoftMax, or GLayerConvolutional2D
+/// with 8-bit weights. Each output channel (a unit of a fully-connected layer, or a kernel of a
+/// convolutional layer) has its own scale, so its weights span the full range from -127 to 127.
+/// The inputs are also quantized to 8 bits, using a scale determined by the range of inputs observed
+/// during calibration, so the dot products are computed with integer arithmetic (accumulated in
+/// 32 bits, and vectorized with SSE2 where it is available). The bias, the rescaling of each sum,
+/// and the activation function are computed in double precision. Inputs outside the calibrated
+/// range are clipped. (Use GNeuralNet::quantize to convert the layers of a trained network.)
+/// This layer cannot be trained, so the training methods throw exceptions.
+class GLayerQuantized : public GNeuralNetLayer
+{
+protected:
+	std::string m_sourceType; // the type of the layer that was quantized
+	size_t m_inputs;
+	size_t m_outputs;
+	size_t m_channels; // the number of units (or kernels) that have their own scale
+	size_t m_fanIn; // the number of weights that feed into each unit (or kernel)
+	size_t m_stride; // m_fanIn rounded up to a multiple of 16
+	size_t m_inputCols, m_inputRows, m_inputChannels, m_outputCols, m_outputRows, m_kernelsPerChannel; // only used for convolutional layers
+	std::vector<signed char> m_weights; // m_channels rows of m_stride weights. The padding is zero.
+	GVec m_weightScales; // the value of one step of a quantized weight in each channel
+	GVec m_bias;
+	double m_inputScale; // the value of one step of a quantized input
+	std::vector<signed char> m_quantizedInput;
+	std::vector<signed char> m_window; // the gathered inputs of one convolution. The padding is zero.
+	GMatrix m_activation; // Row 0 is the activation. Row 1 is the net. Row 2 is the error.
+	GActivationFunction* m_pActivationFunction;
+
+public:
+using GNeuralNetLayer::feedForward;
+using GNeuralNetLayer::updateDeltas;
+
+	/// Quantizes pSource, which must be a GLayerClassic, GLayerSoftMax, or GLayerConvolutional2D.
+	/// (pSource is not modified, and this object does not take ownership of it.) inputRange is
+	/// the largest magnitude of any input that is expected to be fed into this layer.
+	GLayerQuantized(GNeuralNetLayer* pSource, double inputRange);
+
+	/// Deserializing constructor
+	GLayerQuantized(GDomNode* pNode);
+
+	virtual ~GLayerQuantized();
+
+	/// Returns true iff pLayer is a type of layer that this class can quantize.
+	static bool canQuantize(GNeuralNetLayer* pLayer);
+
+	/// Returns the type of this layer
+	virtual const char* type() { return "quantized"; }
+
+	/// Returns the type of the layer that was quantized.
+	const char* sourceType() { return m_sourceType.c_str(); }
+
+	/// Marshall this layer into a DOM. (The weights are stored as a hexadecimal string.)
+	virtual GDomNode* serialize(GDom* pDoc);
+
+	/// Returns the number of values expected to be fed as input into this layer.
+	virtual size_t inputs() { return m_inputs; }
+
+	/// Returns the number of nodes or units in this layer.
+	virtual size_t outputs() { return m_outputs; }
+
+	/// Throws an exception.
+	virtual void resize(size_t inputs, size_t outputs, GRand* pRand = NULL, double deviation = 0.03);
+
+	/// Returns the activation values from the most recent call to feedForward().
+	virtual GVec& activation() { return m_activation[0]; }
+
+	/// Returns a buffer used to store error terms for each unit in this layer.
+	virtual GVec& error() { return m_activation[2]; }
+
+	/// Returns the net vector (that is, the values computed before the activation function was applied)
+	/// from the most recent call to feedForward().
+	GVec& net() { return m_activation[1]; }
+
+	/// Feeds a the inputs through this layer.
+	virtual void feedForward(const GVec& in);
+
+	/// Throws an exception.
+	virtual void dropOut(GRand& rand, double probOfDrop);
+
+	/// Throws an exception.
+	virtual void computeError(const GVec& target);
+
+	/// Throws an exception.
+	virtual void deactivateError();
+
+	/// Throws an exception.
+	virtual void backPropError(GNeuralNetLayer* pUpStreamLayer);
+
+	/// Throws an exception.
+	virtual void updateDeltas(const GVec& upStreamActivation, double momentum);
+
+	/// Throws an exception.
+	virtual void applyDeltas(double learningRate);
+
+	/// Throws an exception.
+	virtual void applyAdaptive();
+
+	/// Throws an exception.
+	virtual void scaleWeights(double factor, bool scaleBiases);
+
+	/// Throws an exception.
+	virtual void diminishWeights(double amount, bool regularizeBiases);
+
+	/// Returns 0, since this layer has no trainable weights.
+	virtual size_t countWeights() { return 0; }
+
+	/// Writes nothing, since this layer has no trainable weights.
+	virtual size_t weightsToVector(double* pOutVector) { return 0; }
+
+	/// Reads nothing, since this layer has no trainable weights.
+	virtual size_t vectorToWeights(const double* pVector) { return 0; }
+
+	/// Throws an exception.
+	virtual void copyWeights(const GNeuralNetLayer* pSource);
+
+	/// Throws an exception.
+	virtual void resetWeights(GRand& rand);
+
+	/// Throws an exception.
+	virtual void perturbWeights(GRand& rand, double deviation, size_t start = 0, size_t count = INVALID_INDEX);
+
+	/// Throws an exception.
+	virtual void maxNorm(double min, double max);
+
+	/// Throws an exception.
+	virtual void regularizeActivationFunction(double lambda);
+
+	/// Throws an exception.
+	virtual void renormalizeInput(size_t input, double oldMin, double oldMax, double newMin = 0.0, double newMax = 1.0);
+
+	/// Returns the dot product of two vectors of n 8-bit values, where n is a multiple of 16.
+	static int dotProduct(const signed char* a, const signed char* b, size_t n);
+
+protected:
+	/// Quantizes the m_fanIn weights that feed into one channel.
+	void quantizeChannel(size_t channel, const GVec& weights);
+
+	/// Sizes the buffers after the geometry has been set.
+	void allocate();
+
+	/// Throws an exception that explains that this layer cannot be trained.
+	void throwInferenceOnly();
+};
+
+
+
 } // namespace GClasses
 
 #endif // __GLAYER_H__
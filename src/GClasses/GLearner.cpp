@@ -42,6 +42,7 @@
 #include "GRand.h"
 #include "GHolders.h"
 #ifndef MIN_PREDICT
+#include "GThread.h"
 #include "GPlot.h"
 #include "GDistribution.h"
 #include "GRecommender.h"
@@ -50,6 +51,7 @@
 #include <iostream>
 
 using std::vector;
+using std::string;
 
 namespace GClasses {
 
@@ -128,7 +130,7 @@ GNormalDistribution* GPrediction::asNormal()
 // ---------------------------------------------------------------
 
 GTransducer::GTransducer()
-: m_rand(0)
+: m_rand(0), m_validationThreads(1)
 {
 }
 
@@ -341,6 +343,13 @@ double GTransducer::crossValidate(const GMatrix& features, const GMatrix& labels
 {
 	if(features.rows() != labels.rows())
 		throw Ex("Expected the features and labels to have the same number of rows");
+	if(m_validationThreads > 1 && folds > 1)
+	{
+		// Learners that cannot copy all of their settings are validated serially
+		GTransducer* pClone = clone();
+		if(pClone)
+			return crossValidateParallel(features, labels, 1, folds, false, pCB, nRep, pThis, pClone);
+	}
 
 	// Do cross-validation
 	GMatrix trainFeatures(features.relation().cloneMinimal());
@@ -390,6 +399,12 @@ double GTransducer::repValidate(const GMatrix& features, const GMatrix& labels,
 {
 	if(features.rows() != labels.rows())
 		throw Ex("Expected the features and labels to have the same number of rows");
+	if(m_validationThreads > 1 && reps * folds > 1)
+	{
+		GTransducer* pClone = clone();
+		if(pClone)
+			return crossValidateParallel(features, labels, reps, folds, true, pCB, 0, pThis, pClone) / reps;
+	}
 	GMatrix f(features.relation().cloneMinimal());
 	GReleaseDataHolder hF(&f);
 	GMatrix l(labels.relation().cloneMinimal());
@@ -407,6 +422,158 @@ double GTransducer::repValidate(const GMatrix& features, const GMatrix& labels,
 	}
 	return ssse / reps;
 }
+
+class GCrossValidateWorker : public GWorkerThread
+{
+protected:
+	GTransducer* m_pLearner;
+	const GMatrix& m_features;
+	const GMatrix& m_labels;
+	size_t m_folds;
+	const vector< vector<size_t> >& m_orders;
+	const vector<uint64_t>& m_seeds;
+	vector<double>& m_sse;
+	vector<size_t>& m_testRows;
+	vector<string>& m_errors;
+
+public:
+	GCrossValidateWorker(GMasterThread& master, GTransducer* pLearner, const GMatrix& features, const GMatrix& labels, size_t folds, const vector< vector<size_t> >& orders, const vector<uint64_t>& seeds, vector<double>& sse, vector<size_t>& testRows, vector<string>& errors)
+	: GWorkerThread(master),
+	m_pLearner(pLearner),
+	m_features(features),
+	m_labels(labels),
+	m_folds(folds),
+	m_orders(orders),
+	m_seeds(seeds),
+	m_sse(sse),
+	m_testRows(testRows),
+	m_errors(errors)
+	{
+	}
+
+	virtual ~GCrossValidateWorker()
+	{
+		delete(m_pLearner);
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		// Exceptions must not escape from a worker thread, so they are reported back to the master
+		try
+		{
+			// Each fold gets its own views of the shared rows
+			const vector<size_t>& order = m_orders[jobId / m_folds];
+			size_t fold = jobId % m_folds;
+			size_t rows = order.size();
+			size_t foldStart = fold * rows / m_folds;
+			size_t foldEnd = (fold + 1) * rows / m_folds;
+			GMatrix trainFeatures(m_features.relation().cloneMinimal());
+			GReleaseDataHolder hTrainFeatures(&trainFeatures);
+			GMatrix testFeatures(m_features.relation().cloneMinimal());
+			GReleaseDataHolder hTestFeatures(&testFeatures);
+			GMatrix trainLabels(m_labels.relation().cloneMinimal());
+			GReleaseDataHolder hTrainLabels(&trainLabels);
+			GMatrix testLabels(m_labels.relation().cloneMinimal());
+			GReleaseDataHolder hTestLabels(&testLabels);
+			trainFeatures.reserve(rows - (foldEnd - foldStart));
+			trainLabels.reserve(rows - (foldEnd - foldStart));
+			testFeatures.reserve(foldEnd - foldStart);
+			testLabels.reserve(foldEnd - foldStart);
+			for(size_t j = 0; j < rows; j++)
+			{
+				size_t r = order[j];
+				if(j >= foldStart && j < foldEnd)
+				{
+					testFeatures.takeRow((GVec*)&m_features[r]);
+					testLabels.takeRow((GVec*)&m_labels[r]);
+				}
+				else
+				{
+					trainFeatures.takeRow((GVec*)&m_features[r]);
+					trainLabels.takeRow((GVec*)&m_labels[r]);
+				}
+			}
+
+			// Evaluate
+			m_pLearner->rand().setSeed(m_seeds[jobId]);
+			GSupervisedLearner* pInner = dynamic_cast<GSupervisedLearner*>(m_pLearner);
+			if(pInner && pInner->isFilter())
+			{
+				// The learner inside the filters has its own random number generator, so it is reseeded too.
+				// (The filters in between may differ between a learner that has already been trained and a new copy.)
+				while(pInner->isFilter())
+					pInner = ((GFilter*)pInner)->innerLearner();
+				pInner->rand().setSeed(m_pLearner->rand().next());
+			}
+			m_sse[jobId] = m_pLearner->trainAndTest(trainFeatures, trainLabels, testFeatures, testLabels);
+			m_testRows[jobId] = testLabels.rows();
+		}
+		catch(const std::exception& e)
+		{
+			m_errors[jobId] = e.what();
+		}
+	}
+};
+
+double GTransducer::crossValidateParallel(const GMatrix& features, const GMatrix& labels, size_t reps, size_t folds, bool shuffle, RepValidateCallback pCB, size_t nRep, void* pThis, GTransducer* pClone)
+{
+	std::unique_ptr<GTransducer> hClone(pClone);
+
+	// Decide the row order of each rep and the seed of each fold up front, so the results do not depend on the scheduling
+	size_t jobs = reps * folds;
+	vector< vector<size_t> > orders(reps);
+	vector<size_t> order(features.rows());
+	for(size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	for(size_t i = 0; i < reps; i++)
+	{
+		if(shuffle)
+		{
+			for(size_t n = order.size(); n > 0; n--)
+				std::swap(order[(size_t)m_rand.next(n)], order[n - 1]);
+		}
+		orders[i] = order;
+	}
+	vector<uint64_t> seeds(jobs);
+	for(size_t i = 0; i < jobs; i++)
+		seeds[i] = m_rand.next();
+	uint64_t nextSeed = m_rand.next(); // (This learner reseeds itself for each fold it does, so it is restored to a known state afterward)
+	vector<double> sse(jobs, 0.0);
+	vector<size_t> testRows(jobs, 0);
+	vector<string> errors(jobs);
+
+	// Every worker trains its own copy, so this learner is left as it was, and the
+	// results do not depend on which worker does which fold
+	{
+		size_t workers = std::min(m_validationThreads, jobs);
+		GMasterThread master;
+		master.addWorker(new GCrossValidateWorker(master, hClone.release(), features, labels, folds, orders, seeds, sse, testRows, errors));
+		for(size_t i = 1; i < workers; i++)
+		{
+			GTransducer* pCopy = clone();
+			if(!pCopy)
+				throw Ex("Expected clone to succeed again");
+			master.addWorker(new GCrossValidateWorker(master, pCopy, features, labels, folds, orders, seeds, sse, testRows, errors));
+		}
+		master.doJobs(jobs);
+	}
+	m_rand.setSeed(nextSeed);
+	for(size_t i = 0; i < jobs; i++)
+	{
+		if(errors[i].length() > 0)
+			throw Ex(errors[i]);
+	}
+
+	// Report the folds in order
+	double total = 0.0;
+	for(size_t i = 0; i < jobs; i++)
+	{
+		total += sse[i];
+		if(pCB)
+			pCB(pThis, nRep + i / folds, i % folds, sse[i], testRows[i]);
+	}
+	return total;
+}
 #endif // MIN_PREDICT
 
 // ---------------------------------------------------------------
@@ -443,6 +610,15 @@ const GRelation& GSupervisedLearner::relLabels()
 	return *m_pRelLabels;
 }
 
+// virtual
+void GSupervisedLearner::predictBatch(const GMatrix& features, GMatrix& labels)
+{
+	if(labels.rows() != features.rows())
+		throw Ex("Expected labels to have the same number of rows as features");
+	for(size_t i = 0; i < features.rows(); i++)
+		predict(features[i], labels[i]);
+}
+
 #ifndef MIN_PREDICT
 GDomNode* GSupervisedLearner::baseDomNode(GDom* pDoc, const char* szClassName) const
 {
@@ -723,6 +899,118 @@ void GSupervisedLearner::precisionRecall(double* pOutPrecision, size_t nPrecisio
 
 #define TEST_SIZE 5000
 // static
+void GSupervisedLearner_testParallelValidationCallback(void* pThis, size_t nRep, size_t nFold, double foldSSE, size_t rows)
+{
+	vector<double>* pLog = (vector<double>*)pThis;
+	pLog->push_back((double)(nRep * 1000 + nFold));
+	pLog->push_back(foldSSE);
+}
+
+double GSupervisedLearner_testParallelValidationRun(GSupervisedLearner& learner, GMatrix& features, GMatrix& labels, size_t threads, vector<double>& log)
+{
+	learner.rand().setSeed(1234);
+	learner.setValidationThreads(threads);
+	return learner.repValidate(features, labels, 3, 4, GSupervisedLearner_testParallelValidationCallback, &log);
+}
+
+// A neural network that cannot be copied, so repValidate does every fold with the original, one at a time
+class GSupervisedLearner_testUncloneableNeuralNet : public GNeuralNet
+{
+public:
+	virtual GSupervisedLearner* clone() { return NULL; }
+};
+
+double GSupervisedLearner_testParallelValidationNeuralNet(GNeuralNet* pNN, GMatrix& features, GMatrix& labels, size_t threads, vector<double>& log)
+{
+	pNN->addLayer(new GLayerClassic(FLEXIBLE_SIZE, 4));
+	pNN->addLayer(new GLayerClassic(4, FLEXIBLE_SIZE));
+	pNN->setValidationPortion(0.2);
+	pNN->setImprovementThresh(0.05);
+	pNN->setWindowSize(3);
+	GAutoFilter af(pNN);
+	return GSupervisedLearner_testParallelValidationRun(af, features, labels, threads, log);
+}
+
+void GSupervisedLearner_testParallelValidation()
+{
+	// Make a noisy classification problem
+	GRand rand(0);
+	GMatrix features(150, 2);
+	vector<size_t> vals(1, 2);
+	GMatrix labels(vals);
+	labels.newRows(150);
+	for(size_t i = 0; i < features.rows(); i++)
+	{
+		features[i][0] = rand.uniform();
+		features[i][1] = rand.uniform();
+		labels[i][0] = (features[i][0] + features[i][1] + 0.3 * rand.normal() > 1.0 ? 1.0 : 0.0);
+	}
+
+	// A learner that does not use random numbers should get exactly the same results serially and in parallel, with folds reported in order
+	GKNN knn;
+	knn.setNeighborCount(3);
+	vector<double> log1, log2, log3;
+	double serial = GSupervisedLearner_testParallelValidationRun(knn, features, labels, 1, log1);
+	double parallel2 = GSupervisedLearner_testParallelValidationRun(knn, features, labels, 2, log2);
+	double parallel3 = GSupervisedLearner_testParallelValidationRun(knn, features, labels, 3, log3);
+	if(serial != parallel2 || serial != parallel3 || log1 != log2 || log1 != log3)
+		throw Ex("parallel cross-validation did not match serial cross-validation");
+	if(log1.size() != 24 || log1[22] != 2003.0)
+		throw Ex("folds were not reported in order");
+	GKNN knn2;
+	vector<double> log12;
+	GSupervisedLearner_testParallelValidationRun(knn2, features, labels, 3, log12);
+	bool threw = false;
+	try
+	{
+		knn2.relFeatures();
+	}
+	catch(const std::exception&)
+	{
+		threw = true;
+	}
+	if(!threw)
+		throw Ex("parallel cross-validation trained the original learner");
+
+	// A randomized learner should not depend on the number of threads
+	GDecisionTree tree;
+	tree.useRandomDivisions();
+	vector<double> log4, log5;
+	double tree2 = GSupervisedLearner_testParallelValidationRun(tree, features, labels, 2, log4);
+	double tree4 = GSupervisedLearner_testParallelValidationRun(tree, features, labels, 4, log5);
+	if(tree2 != tree4 || log4 != log5)
+		throw Ex("parallel cross-validation depends on the number of threads");
+
+	// A filtered learner should not depend on the number of threads, and its copies should keep its settings
+	GNaiveBayes* pNB = new GNaiveBayes();
+	pNB->setEquivalentSampleSize(0.25);
+	GAutoFilter af(pNB);
+	std::unique_ptr<GSupervisedLearner> hAfClone(af.clone());
+	if(!hAfClone.get() || ((GNaiveBayes*)((GAutoFilter*)hAfClone.get())->innerLearner())->equivalentSampleSize() != 0.25)
+		throw Ex("clone did not copy the settings");
+	vector<double> log6, log7;
+	double nb2 = GSupervisedLearner_testParallelValidationRun(af, features, labels, 2, log6);
+	double nb3 = GSupervisedLearner_testParallelValidationRun(af, features, labels, 3, log7);
+	if(nb2 != nb3 || log6 != log7)
+		throw Ex("parallel cross-validation depends on the number of threads");
+	if(nb2 / features.rows() > 0.35)
+		throw Ex("poor accuracy");
+
+	// Copies of a neural network should not depend on the number of threads, even though some of its settings are not serialized
+	vector<double> log8, log9;
+	double nn2 = GSupervisedLearner_testParallelValidationNeuralNet(new GNeuralNet(), features, labels, 2, log8);
+	double nn3 = GSupervisedLearner_testParallelValidationNeuralNet(new GNeuralNet(), features, labels, 3, log9);
+	if(nn2 != nn3 || log8 != log9)
+		throw Ex("parallel cross-validation of a neural network depends on the number of threads");
+
+	// A learner that cannot be copied should be validated serially
+	vector<double> log10, log11;
+	double uncloneableSerial = GSupervisedLearner_testParallelValidationNeuralNet(new GSupervisedLearner_testUncloneableNeuralNet(), features, labels, 1, log10);
+	double uncloneableParallel = GSupervisedLearner_testParallelValidationNeuralNet(new GSupervisedLearner_testUncloneableNeuralNet(), features, labels, 3, log11);
+	if(uncloneableSerial != uncloneableParallel || log10 != log11)
+		throw Ex("a learner that cannot be copied was not validated serially");
+}
+
 void GSupervisedLearner::test()
 {
 /*	// Make a probabilistic training set
@@ -799,6 +1087,7 @@ void GSupervisedLearner::test()
 	prob = out.asCategorical()->values(2)[0];
 	if(std::abs(prob - 0.85) > .11)
 		throw Ex("failed");*/
+	GSupervisedLearner_testParallelValidation();
 }
 
 void GSupervisedLearner_basicTestEngine(GSupervisedLearner* pLearner, GMatrix& features, GMatrix& labels, GMatrix& testFeatures, GMatrix& testLabels, double minAccuracy, GRand* pRand, double warnRange, double deviation, bool printAccuracy)
@@ -1204,12 +1493,12 @@ void GFilter::trainSparse(GSparseMatrix& features, GMatrix& labels)
 // ---------------------------------------------------------------
 
 GFeatureFilter::GFeatureFilter(GSupervisedLearner* pLearner, GIncrementalTransform* pTransform, bool ownLearner, bool ownTransform)
-: GFilter(pLearner, ownLearner), m_pTransform(pTransform), m_ownTransform(ownTransform)
+: GFilter(pLearner, ownLearner), m_pTransform(pTransform), m_ownTransform(ownTransform), m_pPipeline(NULL), m_pPipelineLearner(NULL)
 {
 }
 
 GFeatureFilter::GFeatureFilter(const GDomNode* pNode, GLearnerLoader& ll)
-: GFilter(pNode, ll), m_ownTransform(true)
+: GFilter(pNode, ll), m_ownTransform(true), m_pPipeline(NULL), m_pPipelineLearner(NULL)
 {
 	m_pTransform = ll.loadIncrementalTransform(pNode->field("trans"));
 }
@@ -1217,10 +1506,40 @@ GFeatureFilter::GFeatureFilter(const GDomNode* pNode, GLearnerLoader& ll)
 // virtual
 GFeatureFilter::~GFeatureFilter()
 {
+	delete(m_pPipeline);
 	if(m_ownTransform)
 		delete(m_pTransform);
 }
 
+void GFeatureFilter::compilePipeline()
+{
+	if(m_pPipeline)
+		return;
+
+	// Gather the transforms of this filter and any feature filters directly inside it
+	GTransformPipeline* pPipeline = new GTransformPipeline();
+	std::unique_ptr<GTransformPipeline> hPipeline(pPipeline);
+	pPipeline->add(m_pTransform);
+	GSupervisedLearner* pLearner = m_pLearner;
+	while(pLearner->isFilter() && ((GFilter*)pLearner)->featureTransform())
+	{
+		pPipeline->add(((GFilter*)pLearner)->featureTransform());
+		pLearner = ((GFilter*)pLearner)->innerLearner();
+	}
+	pPipeline->compile();
+	m_pipelineBuf.resize(pPipeline->outputDims());
+	m_pPipelineLearner = pLearner;
+	m_pPipeline = hPipeline.release();
+}
+
+void GFeatureFilter::discardPipeline()
+{
+	delete(m_pPipeline);
+	m_pPipeline = NULL;
+	m_pPipelineLearner = NULL;
+	m_pipelineFeatures.resize(0, 0);
+}
+
 // virtual
 GDomNode* GFeatureFilter::serialize(GDom* pDoc) const
 {
@@ -1234,31 +1553,47 @@ void GFeatureFilter::trainInner(const GMatrix& features, const GMatrix& labels)
 {
 	if(features.rows() != labels.rows())
 		throw Ex("Expected features and labels to have the same number of rows");
+	discardPipeline();
 	m_pTransform->train(features);
 	GMatrix temp(m_pTransform->after().clone());
 	temp.newRows(features.rows());
-	for(size_t i = 0; i < features.rows(); i++)
-		m_pTransform->transform(features[i], temp[i]);
+	GTransformPipeline pipeline;
+	pipeline.add(m_pTransform);
+	pipeline.compile();
+	pipeline.transformBatch(features, temp);
 	m_pLearner->train(temp, labels);
 }
 
 // virtual
 void GFeatureFilter::predict(const GVec& in, GVec& out)
 {
-	m_pTransform->transform(in, m_pTransform->innerBuf());
-	m_pLearner->predict(m_pTransform->innerBuf(), out);
+	compilePipeline();
+	m_pPipeline->transform(in, m_pipelineBuf);
+	m_pPipelineLearner->predict(m_pipelineBuf, out);
 }
 
 // virtual
 void GFeatureFilter::predictDistribution(const GVec& in, GPrediction* out)
 {
-	m_pTransform->transform(in, m_pTransform->innerBuf());
-	m_pLearner->predictDistribution(m_pTransform->innerBuf(), out);
+	compilePipeline();
+	m_pPipeline->transform(in, m_pipelineBuf);
+	m_pPipelineLearner->predictDistribution(m_pipelineBuf, out);
+}
+
+// virtual
+void GFeatureFilter::predictBatch(const GMatrix& features, GMatrix& labels)
+{
+	compilePipeline();
+	if(m_pipelineFeatures.rows() != features.rows() || m_pipelineFeatures.cols() != m_pPipeline->outputDims())
+		m_pipelineFeatures.resize(features.rows(), m_pPipeline->outputDims());
+	m_pPipeline->transformBatch(features, m_pipelineFeatures);
+	m_pPipelineLearner->predictBatch(m_pipelineFeatures, labels);
 }
 
 // virtual
 void GFeatureFilter::beginIncrementalLearningInner(const GRelation& featureRel, const GRelation& labelRel)
 {
+	discardPipeline();
 	m_pTransform->train(featureRel);
 	m_pIncrementalLearner->beginIncrementalLearning(m_pTransform->after(), labelRel);
 }
@@ -1266,6 +1601,7 @@ void GFeatureFilter::beginIncrementalLearningInner(const GRelation& featureRel,
 // virtual
 void GFeatureFilter::beginIncrementalLearningInner(const GMatrix& features, const GMatrix& labels)
 {
+	discardPipeline();
 	m_pTransform->train(features);
 	m_pIncrementalLearner->beginIncrementalLearning(m_pTransform->after(), labels.relation());
 }
@@ -1280,11 +1616,12 @@ void GFeatureFilter::trainIncremental(const GVec& in, const GVec& out)
 // virtual
 const GVec& GFeatureFilter::prefilterFeatures(const GVec& in)
 {
-	m_pTransform->transform(in, m_pTransform->innerBuf());
-	if(m_pLearner->isFilter())
-		return ((GFilter*)m_pLearner)->prefilterFeatures(m_pTransform->innerBuf());
+	compilePipeline();
+	m_pPipeline->transform(in, m_pipelineBuf);
+	if(m_pPipelineLearner->isFilter())
+		return ((GFilter*)m_pPipelineLearner)->prefilterFeatures(m_pipelineBuf);
 	else
-		return m_pTransform->innerBuf();
+		return m_pipelineBuf;
 }
 
 // virtual
@@ -1351,6 +1688,17 @@ void GLabelFilter::predictDistribution(const GVec& in, GPrediction* out)
 	m_pTransform->untransformToDistribution(m_pTransform->innerBuf(), out);
 }
 
+// virtual
+void GLabelFilter::predictBatch(const GMatrix& features, GMatrix& labels)
+{
+	if(labels.rows() != features.rows())
+		throw Ex("Expected labels to have the same number of rows as features");
+	GMatrix inner(features.rows(), m_pTransform->after().size());
+	m_pLearner->predictBatch(features, inner);
+	for(size_t i = 0; i < features.rows(); i++)
+		m_pTransform->untransform(inner[i], labels[i]);
+}
+
 // virtual
 void GLabelFilter::beginIncrementalLearningInner(const GRelation& featureRel, const GRelation& labelRel)
 {
@@ -1419,6 +1767,15 @@ GDomNode* GAutoFilter::serialize(GDom* pDoc) const
 	return pNode;
 }
 
+// virtual
+GSupervisedLearner* GAutoFilter::clone()
+{
+	GSupervisedLearner* pLearner = m_pOriginal->clone();
+	if(!pLearner)
+		return NULL;
+	return new GAutoFilter(pLearner);
+}
+
 void GAutoFilter::whatTypesAreNeeded(const GRelation& featureRel, const GRelation& labelRel, bool& hasNominalFeatures, bool& hasContinuousFeatures, bool& hasNominalLabels, bool& hasContinuousLabels)
 {
 	// Determine what types are present in the feature data
@@ -1655,6 +2012,12 @@ void GAutoFilter::predictDistribution(const GVec& in, GPrediction* out)
 	m_pLearner->predictDistribution(in, out);
 }
 
+// virtual
+void GAutoFilter::predictBatch(const GMatrix& features, GMatrix& labels)
+{
+	m_pLearner->predictBatch(features, labels);
+}
+
 // virtual
 void GAutoFilter::beginIncrementalLearningInner(const GMatrix& features, const GMatrix& labels)
 {
@@ -1702,6 +2065,19 @@ void GAutoFilter::test()
 		if(std::abs(pred[0] - pat[0]) > 1e-12)
 			throw Ex("failed");
 	}
+
+	// Predict a batch through the same filters
+	GMatrix batch(rel.clone());
+	batch.newRows(20);
+	for(size_t i = 0; i < batch.rows(); i++)
+		batch[i][0] = (double)rand.next(3);
+	GMatrix batchPred(batch.rows(), 1);
+	af.predictBatch(batch, batchPred);
+	for(size_t i = 0; i < batch.rows(); i++)
+	{
+		if(std::abs(batchPred[i][0] - batch[i][0]) > 1e-12)
+			throw Ex("failed");
+	}
 }
 #endif // MIN_PREDICT
 
@@ -34,6 +34,7 @@ class GNormalDistribution;
 class GUniformDistribution;
 class GUnivariateDistribution;
 class GIncrementalTransform;
+class GTransformPipeline;
 class GSparseMatrix;
 class GCollaborativeFilter;
 class GNeuralNet;
@@ -106,13 +107,14 @@ class GTransducer
 {
 protected:
 	GRand m_rand;
+	size_t m_validationThreads;
 
 public:
 	/// General-purpose constructor.
 	GTransducer();
 
 	/// Copy-constructor. Throws an exception to prevent models from being copied by value.
-	GTransducer(const GTransducer& that) : m_rand(0)
+	GTransducer(const GTransducer& that) : m_rand(0), m_validationThreads(1)
 	{
 		throw Ex("This object is not intended to be copied by value");
 	}
@@ -150,6 +152,11 @@ public:
 	/// nRep is just the rep number that will be passed to the callback.
 	/// pThis is just a pointer that will be passed to the callback for you
 	/// to use however you want. It doesn't affect this method.
+	/// If validationThreads() is greater than 1, the folds are evaluated concurrently, each by
+	/// its own copy of this learner (see clone). In that case, each fold reseeds the
+	/// learner's random number generator with a seed drawn in advance, so the results
+	/// do not depend on the number of threads, and the callback is still called in fold order
+	/// from the calling thread.
 	double crossValidate(const GMatrix& features, const GMatrix& labels, size_t nFolds, RepValidateCallback pCB = NULL, size_t nRep = 0, void* pThis = NULL);
 
 	/// Perform cross validation "nReps" times and return the
@@ -157,7 +164,23 @@ public:
 	/// It can be NULL if you don't want intermediate reporting.
 	/// pThis is just a pointer that will be passed to the callback for you
 	/// to use however you want. It doesn't affect this method.
+	/// If validationThreads() is greater than 1, all of the reps and folds are evaluated
+	/// concurrently, as described for crossValidate.
 	double repValidate(const GMatrix& features, const GMatrix& labels, size_t reps, size_t nFolds, RepValidateCallback pCB = NULL, void* pThis = NULL);
+
+	/// Specifies the number of threads that crossValidate and repValidate may use. (The default is 1.)
+	/// Since autoTune methods use crossValidate to compare candidate settings, this also speeds them up.
+	void setValidationThreads(size_t n) { m_validationThreads = (n > 1 ? n : 1); }
+
+	/// Returns the number of threads that crossValidate and repValidate may use.
+	size_t validationThreads() { return m_validationThreads; }
+
+	/// Returns a new, untrained instance of this learner with all of the same settings,
+	/// or NULL if this learner does not know how to copy all of its settings. This is
+	/// used to evaluate several folds of cross-validation at the same time. (Learners
+	/// that return NULL are validated serially.) The caller is responsible to delete
+	/// the object that is returned.
+	virtual GTransducer* clone() { return NULL; }
 #endif // MIN_PREDICT
 
 	/// Returns a reference to the random number generator associated with this object.
@@ -206,6 +229,12 @@ protected:
 #ifndef MIN_PREDICT
 	/// This is the algorithm's implementation of transduction. (It is called by the transduce method.)
 	virtual std::unique_ptr<GMatrix> transduceInner(const GMatrix& features1, const GMatrix& labels1, const GMatrix& features2) = 0;
+
+	/// Evaluates reps*folds folds of cross-validation with several threads. (Used by crossValidate and repValidate.)
+	/// If shuffle is true, the rows are shuffled before each rep. Returns the total sum-squared error. Each fold
+	/// is done by a copy of this learner, so this learner is not trained. pClone is the first copy, which this
+	/// method takes ownership of.
+	double crossValidateParallel(const GMatrix& features, const GMatrix& labels, size_t reps, size_t folds, bool shuffle, RepValidateCallback pCB, size_t nRep, void* pThis, GTransducer* pClone);
 #endif // MIN_PREDICT
 };
 
@@ -233,6 +262,10 @@ public:
 	/// Marshal this object into a DOM that can be converted to a variety
 	/// of formats. (Implementations of this method should use baseDomNode.)
 	virtual GDomNode* serialize(GDom* pDoc) const = 0;
+
+	/// Returns NULL. (Serialization omits many training settings, so it cannot be used to
+	/// copy a learner faithfully. Learners that can copy all of their settings override this.)
+	virtual GSupervisedLearner* clone() { return NULL; }
 #endif // MIN_PREDICT
 
 	/// Returns true because fully supervised learners have an internal
@@ -261,6 +294,12 @@ public:
 	/// method.
 	virtual void predict(const GVec& in, GVec& out) = 0;
 
+	/// Predicts a label vector for each row in features. labels must already have
+	/// features.rows() rows with the same number of columns as the training labels.
+	/// (The default implementation calls predict for each row. Filters override it
+	/// so that their transforms process the whole batch at once.)
+	virtual void predictBatch(const GMatrix& features, GMatrix& labels);
+
 #ifndef MIN_PREDICT
 	/// Evaluate pIn and compute a prediction for pOut. pOut is expected
 	/// to point to an array of GPrediction objects which have already been
@@ -496,6 +535,10 @@ public:
 
 	/// Returns a pointer to the inner learner
 	GSupervisedLearner* innerLearner() { return m_pLearner; }
+
+	/// Returns the transform that this filter applies to the features before it passes
+	/// them to the inner learner (with nothing else), or NULL if it does something else.
+	virtual GIncrementalTransform* featureTransform() { return NULL; }
 #ifndef MIN_PREDICT
 	/// Throws an exception
 	virtual void trainSparse(GSparseMatrix& features, GMatrix& labels);
@@ -508,6 +551,10 @@ class GFeatureFilter : public GFilter
 protected:
 	GIncrementalTransform* m_pTransform;
 	bool m_ownTransform;
+	GTransformPipeline* m_pPipeline;
+	GSupervisedLearner* m_pPipelineLearner;
+	GVec m_pipelineBuf;
+	GMatrix m_pipelineFeatures;
 
 public:
 using GFilter::prefilterFeatures;
@@ -530,6 +577,10 @@ using GFilter::prefilterLabels;
 	/// See the comment for GSupervisedLearner::predictDistributionInner
 	virtual void predictDistribution(const GVec& in, GPrediction* pOut);
 
+	/// Transforms all the features with one fused pipeline, and then predicts them
+	/// all with the inner learner.
+	virtual void predictBatch(const GMatrix& features, GMatrix& labels);
+
 	/// See the comment for GIncrementalLearner::trainIncremental
 	virtual void trainIncremental(const GVec& in, const GVec& out);
 
@@ -539,7 +590,17 @@ using GFilter::prefilterLabels;
 	/// Transform a label vector to the form for presenting to the inner learner
 	virtual const GVec& prefilterLabels(const GVec& in);
 
+	/// Returns the transform
+	virtual GIncrementalTransform* featureTransform() { return m_pTransform; }
+
 protected:
+	/// Compiles the transform of this filter, and those of any feature filters directly
+	/// inside it, into one pipeline. (Does nothing if it is already compiled.)
+	void compilePipeline();
+
+	/// Discards the compiled pipeline. (This is called whenever the transform is retrained.)
+	void discardPipeline();
+
 	/// See the comment for GSupervisedLearner::trainInner
 	virtual void trainInner(const GMatrix& features, const GMatrix& labels);
 
@@ -579,6 +640,9 @@ using GFilter::prefilterLabels;
 	/// See the comment for GSupervisedLearner::predictDistribution
 	virtual void predictDistribution(const GVec& in, GPrediction* pOut);
 
+	/// Predicts with the inner learner, and then untransforms each row
+	virtual void predictBatch(const GMatrix& features, GMatrix& labels);
+
 	/// See the comment for GIncrementalLearner::trainIncremental
 	virtual void trainIncremental(const GVec& in, const GVec& out);
 
@@ -627,12 +691,21 @@ using GFilter::prefilterLabels;
 	/// Marshal this object into a DOM, which can then be converted to a variety of serial formats.
 	virtual GDomNode* serialize(GDom* pDoc) const;
 
+#ifndef MIN_PREDICT
+	/// Returns a new GAutoFilter that wraps a clone of the original inner learner,
+	/// or NULL if the inner learner cannot be cloned.
+	virtual GSupervisedLearner* clone();
+#endif // MIN_PREDICT
+
 	/// See the comment for GSupervisedLearner::predict
 	virtual void predict(const GVec& in, GVec& out);
 
 	/// See the comment for GSupervisedLearner::predictDistribution
 	virtual void predictDistribution(const GVec& in, GPrediction* pOut);
 
+	/// See the comment for GSupervisedLearner::predictBatch
+	virtual void predictBatch(const GMatrix& features, GMatrix& labels);
+
 	/// See the comment for GIncrementalLearner::trainIncremental
 	virtual void trainIncremental(const GVec& in, const GVec& out);
 
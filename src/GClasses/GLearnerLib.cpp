@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <fstream>
 #include "GLearnerLib.h"
+#include "GHyperSearch.h"
+#include "GParameterServer.h"
 #include <cassert>
 #include <time.h>
 #include <iostream>
@@ -492,6 +494,10 @@ GGaussianProcess* GLearnerLib::InstantiateGaussianProcess(GArgReader& args, GMat
 			pModel->setWeightsPriorVariance(args.pop_double());
 		}else if(args.if_pop("-maxsamples")){
 			pModel->setMaxSamples(args.pop_uint());
+		}else if(args.if_pop("-inducing")){
+			pModel->setInducingPoints(args.pop_uint());
+		}else if(args.if_pop("-threads")){
+			pModel->setWorkerThreads(args.pop_uint());
 		}else if(args.if_pop("-kernel")){
 			if(args.if_pop("identity"))
 				pModel->setKernel(new GKernelIdentity());
@@ -966,9 +972,10 @@ GTransducer* GLearnerLib::InstantiateAlgorithm(GArgReader& args, GMatrix* pFeatu
 	return pAlg;
 }
 
-void GLearnerLib::autoTuneDecisionTree(GMatrix& features, GMatrix& labels)
+void GLearnerLib::autoTuneDecisionTree(GMatrix& features, GMatrix& labels, size_t threads)
 {
 	GDecisionTree dt;
+	dt.setValidationThreads(threads);
 	dt.autoTune(features, labels);
 	cout << "decisiontree";
 	if(dt.leafThresh() != 1)
@@ -978,9 +985,10 @@ void GLearnerLib::autoTuneDecisionTree(GMatrix& features, GMatrix& labels)
 	cout << "\n";
 }
 
-void GLearnerLib::autoTuneKNN(GMatrix& features, GMatrix& labels)
+void GLearnerLib::autoTuneKNN(GMatrix& features, GMatrix& labels, size_t threads)
 {
 	GKNN model;
+	model.setValidationThreads(threads);
 	model.autoTune(features, labels);
 	cout << "knn";
 	if(model.neighborCount() != 1)
@@ -988,11 +996,12 @@ void GLearnerLib::autoTuneKNN(GMatrix& features, GMatrix& labels)
 	cout << "\n";
 }
 
-void GLearnerLib::autoTuneNeuralNet(GMatrix& features, GMatrix& labels)
+void GLearnerLib::autoTuneNeuralNet(GMatrix& features, GMatrix& labels, size_t threads)
 {
 	cout << "Warning: Because neural nets take a long time to train, it could take hours to train with enough parameter variations to determine with confidence which parameters are best. (If possible, I would strongly advise running this as a background process while you do something else, rather than sit around waiting for it to finish.)";
 	cout.flush();
 	GNeuralNet nn;
+	nn.setValidationThreads(threads);
 	nn.autoTune(features, labels);
 //	const char* szCurrent = "logistic";
 	cout << "neuralnet";
@@ -1012,35 +1021,267 @@ void GLearnerLib::autoTuneNeuralNet(GMatrix& features, GMatrix& labels)
 	cout << "\n";
 }
 
-void GLearnerLib::autoTuneNaiveBayes(GMatrix& features, GMatrix& labels)
+void GLearnerLib::autoTuneNaiveBayes(GMatrix& features, GMatrix& labels, size_t threads)
 {
 	GNaiveBayes model;
+	model.setValidationThreads(threads);
 	model.autoTune(features, labels);
 	cout << "naivebayes";
 	cout << " -ess " << model.equivalentSampleSize();
 	cout << "\n";
 }
 
-void GLearnerLib::autoTuneNaiveInstance(GMatrix& features, GMatrix& labels)
+void GLearnerLib::autoTuneNaiveInstance(GMatrix& features, GMatrix& labels, size_t threads)
 {
 	GNaiveInstance model;
+	model.setValidationThreads(threads);
 	model.autoTune(features, labels);
 	cout << "naiveinstance";
 	cout << " -neighbors " << model.neighbors();
 	cout << "\n";
 }
 
-void GLearnerLib::autoTuneGraphCutTransducer(GMatrix& features, GMatrix& labels)
+void GLearnerLib::autoTuneGraphCutTransducer(GMatrix& features, GMatrix& labels, size_t threads)
 {
 	GGraphCutTransducer transducer;
+	transducer.setValidationThreads(threads);
 	transducer.autoTune(features, labels);
 	cout << "graphcuttransducer";
 	cout << " -neighbors " << transducer.neighbors();
 	cout << "\n";
 }
 
+class GKnnHyperTarget : public GLearnerHyperTarget
+{
+public:
+	GKnnHyperTarget(const GMatrix& features, const GMatrix& labels, GRand& rand) : GLearnerHyperTarget(features, labels, rand) {}
+	virtual ~GKnnHyperTarget() {}
+	virtual size_t dims() { return 1; }
+
+	size_t neighbors(const GVec& candidate)
+	{
+		double maxK = std::max(1.0, std::sqrt((double)trainRows()));
+		return (size_t)floor(exp(candidate[0] * log(maxK)) + 0.5);
+	}
+
+	virtual std::string describe(const GVec& candidate)
+	{
+		return string("knn -neighbors ") + to_str(neighbors(candidate));
+	}
+
+protected:
+	virtual GSupervisedLearner* makeLearner(const GVec& candidate)
+	{
+		GKNN* pModel = new GKNN();
+		pModel->setNeighborCount(neighbors(candidate));
+		return new GAutoFilter(pModel);
+	}
+};
+
+class GDecisionTreeHyperTarget : public GLearnerHyperTarget
+{
+public:
+	GDecisionTreeHyperTarget(const GMatrix& features, const GMatrix& labels, GRand& rand) : GLearnerHyperTarget(features, labels, rand) {}
+	virtual ~GDecisionTreeHyperTarget() {}
+	virtual size_t dims() { return 2; }
+
+	size_t leafThresh(const GVec& candidate)
+	{
+		return 1 + (size_t)floor(candidate[0] * std::sqrt((double)trainRows()));
+	}
+
+	virtual std::string describe(const GVec& candidate)
+	{
+		string s = "decisiontree";
+		if(leafThresh(candidate) != 1)
+			s += string(" -leafthresh ") + to_str(leafThresh(candidate));
+		if(candidate[1] >= 0.5)
+			s += " -binary";
+		return s;
+	}
+
+protected:
+	virtual GSupervisedLearner* makeLearner(const GVec& candidate)
+	{
+		GDecisionTree* pModel = new GDecisionTree();
+		pModel->setLeafThresh(leafThresh(candidate));
+		if(candidate[1] >= 0.5)
+			pModel->useBinaryDivisions();
+		return new GAutoFilter(pModel);
+	}
+};
+
+class GNeuralNetHyperTarget : public GLearnerHyperTarget
+{
+public:
+	GNeuralNetHyperTarget(const GMatrix& features, const GMatrix& labels, GRand& rand) : GLearnerHyperTarget(features, labels, rand) {}
+	virtual ~GNeuralNetHyperTarget() {}
+	virtual size_t dims() { return 3; }
+
+	size_t hiddenUnits(const GVec& candidate)
+	{
+		if(candidate[0] < 0.25)
+			return 0;
+		return (size_t)floor(exp(log(4.0) + (candidate[0] - 0.25) / 0.75 * log(64.0)) + 0.5); // 4 to 256
+	}
+
+	double learningRate(const GVec& candidate)
+	{
+		return pow(10.0, -3.0 + 2.0 * candidate[1]); // 0.001 to 0.1
+	}
+
+	double momentum(const GVec& candidate)
+	{
+		return candidate[2] < 0.5 ? 0.0 : (candidate[2] - 0.5) * 1.8; // 0 to 0.9
+	}
+
+	virtual std::string describe(const GVec& candidate)
+	{
+		string s = "neuralnet";
+		if(hiddenUnits(candidate) > 0)
+			s += string(" -addlayer ") + to_str(hiddenUnits(candidate));
+		s += string(" -learningrate ") + to_str(learningRate(candidate));
+		if(momentum(candidate) > 0.0)
+			s += string(" -momentum ") + to_str(momentum(candidate));
+		return s;
+	}
+
+protected:
+	virtual GSupervisedLearner* makeLearner(const GVec& candidate)
+	{
+		GNeuralNet* pModel = new GNeuralNet();
+		if(hiddenUnits(candidate) > 0)
+			pModel->addLayer(new GLayerClassic(FLEXIBLE_SIZE, hiddenUnits(candidate)));
+		pModel->addLayer(new GLayerClassic(FLEXIBLE_SIZE, FLEXIBLE_SIZE));
+		pModel->setLearningRate(learningRate(candidate));
+		pModel->setMomentum(momentum(candidate));
+		return new GAutoFilter(pModel);
+	}
+};
+
+class GNaiveBayesHyperTarget : public GLearnerHyperTarget
+{
+public:
+	GNaiveBayesHyperTarget(const GMatrix& features, const GMatrix& labels, GRand& rand) : GLearnerHyperTarget(features, labels, rand) {}
+	virtual ~GNaiveBayesHyperTarget() {}
+	virtual size_t dims() { return 1; }
+
+	double ess(const GVec& candidate)
+	{
+		return pow(10.0, -1.0 + 3.0 * candidate[0]); // 0.1 to 100
+	}
+
+	virtual std::string describe(const GVec& candidate)
+	{
+		return string("naivebayes -ess ") + to_str(ess(candidate));
+	}
+
+protected:
+	virtual GSupervisedLearner* makeLearner(const GVec& candidate)
+	{
+		GNaiveBayes* pModel = new GNaiveBayes();
+		pModel->setEquivalentSampleSize(ess(candidate));
+		return new GAutoFilter(pModel);
+	}
+};
+
+class GNaiveInstanceHyperTarget : public GLearnerHyperTarget
+{
+public:
+	GNaiveInstanceHyperTarget(const GMatrix& features, const GMatrix& labels, GRand& rand) : GLearnerHyperTarget(features, labels, rand) {}
+	virtual ~GNaiveInstanceHyperTarget() {}
+	virtual size_t dims() { return 1; }
+
+	size_t neighbors(const GVec& candidate)
+	{
+		double maxK = std::max(2.0, std::sqrt((double)trainRows()));
+		return (size_t)floor(exp(candidate[0] * log(maxK)) + 0.5);
+	}
+
+	virtual std::string describe(const GVec& candidate)
+	{
+		return string("naiveinstance -neighbors ") + to_str(neighbors(candidate));
+	}
+
+protected:
+	virtual GSupervisedLearner* makeLearner(const GVec& candidate)
+	{
+		GNaiveInstance* pModel = new GNaiveInstance();
+		pModel->setNeighbors(neighbors(candidate));
+		return new GAutoFilter(pModel);
+	}
+};
+
+void GLearnerLib::autoTuneHyperband(GMatrix& features, GMatrix& labels, const char* szModel, size_t threads, size_t maxBudget, size_t eta, const char* szCheckpoint, uint64_t seed)
+{
+	GRand rand(seed);
+	std::unique_ptr<GLearnerHyperTarget> hTarget;
+	if(strcmp(szModel, "decisiontree") == 0)
+		hTarget.reset(new GDecisionTreeHyperTarget(features, labels, rand));
+	else if(strcmp(szModel, "knn") == 0)
+		hTarget.reset(new GKnnHyperTarget(features, labels, rand));
+	else if(strcmp(szModel, "neuralnet") == 0)
+		hTarget.reset(new GNeuralNetHyperTarget(features, labels, rand));
+	else if(strcmp(szModel, "naivebayes") == 0)
+		hTarget.reset(new GNaiveBayesHyperTarget(features, labels, rand));
+	else if(strcmp(szModel, "naiveinstance") == 0)
+		hTarget.reset(new GNaiveInstanceHyperTarget(features, labels, rand));
+	else
+		throw Ex("Sorry, autotune -hyperband does not currently support a model named ", szModel, ".");
+	GHyperSearch search(*hTarget.get(), &rand);
+	search.setWorkerThreads(threads);
+	if(szCheckpoint)
+		search.setCheckpointFile(szCheckpoint, seed);
+	search.hyperband(maxBudget, eta);
+	cout << hTarget->describe(search.bestCandidate()) << "\n";
+}
+
 void GLearnerLib::autoTune(GArgReader& args)
 {
+	// Parse options
+	size_t threads = 1;
+	bool hyperband = false;
+	size_t maxBudget = 27;
+	size_t eta = 3;
+	const char* szCheckpoint = NULL;
+	uint64_t seed = getpid() * (unsigned int)time(NULL);
+	bool seedSpecified = false;
+	while(args.next_is_flag())
+	{
+		if(args.if_pop("-threads"))
+			threads = args.pop_uint();
+		else if(args.if_pop("-hyperband"))
+		{
+			hyperband = true;
+			maxBudget = args.pop_uint();
+		}
+		else if(args.if_pop("-eta"))
+			eta = args.pop_uint();
+		else if(args.if_pop("-checkpoint"))
+		{
+			hyperband = true;
+			szCheckpoint = args.pop_string();
+		}
+		else if(args.if_pop("-seed"))
+		{
+			seed = args.pop_uint();
+			seedSpecified = true;
+		}
+		else
+			throw Ex("Invalid autotune option: ", args.peek());
+	}
+	if(szCheckpoint)
+	{
+		// Resume with the seed that the checkpoint was made with
+		uint64_t checkpointSeed;
+		if(GHyperSearch::checkpointSeed(szCheckpoint, &checkpointSeed))
+		{
+			if(seedSpecified && seed != checkpointSeed)
+				throw Ex("The checkpoint file ", szCheckpoint, " was made with -seed ", to_str(checkpointSeed));
+			seed = checkpointSeed;
+		}
+	}
+
 	// Load the data
 	std::unique_ptr<GMatrix> hFeatures, hLabels;
 	loadData(args, hFeatures, hLabels);
@@ -1049,22 +1290,24 @@ void GLearnerLib::autoTune(GArgReader& args)
 
 	// Load the model name
 	const char* szModel = args.pop_string();
-	if(strcmp(szModel, "agglomerativetransducer") == 0)
+	if(hyperband)
+		autoTuneHyperband(*pFeatures, *pLabels, szModel, threads, maxBudget, eta, szCheckpoint, seed);
+	else if(strcmp(szModel, "agglomerativetransducer") == 0)
 		cout << "agglomerativetransducer\n"; // no params to tune
 	else if(strcmp(szModel, "decisiontree") == 0)
-		autoTuneDecisionTree(*pFeatures, *pLabels);
+		autoTuneDecisionTree(*pFeatures, *pLabels, threads);
 	else if(strcmp(szModel, "graphcuttransducer") == 0)
-		autoTuneGraphCutTransducer(*pFeatures, *pLabels);
+		autoTuneGraphCutTransducer(*pFeatures, *pLabels, threads);
 	else if(strcmp(szModel, "knn") == 0)
-		autoTuneKNN(*pFeatures, *pLabels);
+		autoTuneKNN(*pFeatures, *pLabels, threads);
 	else if(strcmp(szModel, "meanmarginstree") == 0)
 		cout << "meanmarginstree\n"; // no params to tune
 	else if(strcmp(szModel, "neuralnet") == 0)
-		autoTuneNeuralNet(*pFeatures, *pLabels);
+		autoTuneNeuralNet(*pFeatures, *pLabels, threads);
 	else if(strcmp(szModel, "naivebayes") == 0)
-		autoTuneNaiveBayes(*pFeatures, *pLabels);
+		autoTuneNaiveBayes(*pFeatures, *pLabels, threads);
 	else if(strcmp(szModel, "naiveinstance") == 0)
-		autoTuneNaiveInstance(*pFeatures, *pLabels);
+		autoTuneNaiveInstance(*pFeatures, *pLabels, threads);
 	else
 		throw Ex("Sorry, autotune does not currently support a model named ", szModel, ".");
 }
@@ -1122,6 +1365,109 @@ void GLearnerLib::Train(GArgReader& args)
 		doc.writeJson(cout);
 }
 
+void GLearnerLib::paramServer(GArgReader& args)
+{
+	// Parse options
+	size_t seed = getpid() * (unsigned int)time(NULL);
+	size_t port = 9393;
+	size_t workers = 2;
+	size_t rounds = 10;
+	size_t staleness = 0;
+	double timeout = 600.0;
+	while(args.next_is_flag())
+	{
+		if(args.if_pop("-seed"))
+			seed = args.pop_uint();
+		else if(args.if_pop("-port"))
+			port = args.pop_uint();
+		else if(args.if_pop("-workers"))
+			workers = args.pop_uint();
+		else if(args.if_pop("-rounds"))
+			rounds = args.pop_uint();
+		else if(args.if_pop("-staleness"))
+			staleness = args.pop_uint();
+		else if(args.if_pop("-timeout"))
+			timeout = args.pop_double();
+		else
+			throw Ex("Invalid paramserver option: ", args.peek());
+	}
+
+	// Load the data (only to determine the shape of the model)
+	std::unique_ptr<GMatrix> hFeatures, hLabels;
+	loadData(args, hFeatures, hLabels);
+	GMatrix* pFeatures = hFeatures.get();
+	GMatrix* pLabels = hLabels.get();
+	if(!pFeatures->relation().areContinuous() || !pLabels->relation().areContinuous())
+		throw Ex("Distributed training requires continuous data. (Perhaps you should use waffles_transform to convert it first.)");
+
+	// Instantiate the model
+	if(!args.if_pop("neuralnet"))
+		throw Ex("Only \"neuralnet\" can be trained with a parameter server");
+	GNeuralNet* pNN = InstantiateNeuralNet(args, NULL, NULL);
+	std::unique_ptr<GNeuralNet> hNN(pNN);
+	if(args.size() > 0)
+		throw Ex("Superfluous argument: ", args.peek());
+	pNN->rand().setSeed(seed);
+	GNeuralNetParameterModel model(*pNN, *pFeatures, *pLabels);
+
+	// Coordinate the workers
+	GParameterServer server(model, (unsigned short)port);
+	server.setStaleness(staleness);
+	server.serve(workers, rounds, timeout);
+
+	// Output the trained model
+	GDom doc;
+	doc.setRoot(pNN->serialize(&doc));
+	doc.writeJson(cout);
+}
+
+void GLearnerLib::paramWorker(GArgReader& args)
+{
+	// Parse options
+	size_t seed = getpid() * (unsigned int)time(NULL);
+	size_t port = 9393;
+	size_t epochs = 1;
+	double timeout = 600.0;
+	while(args.next_is_flag())
+	{
+		if(args.if_pop("-seed"))
+			seed = args.pop_uint();
+		else if(args.if_pop("-port"))
+			port = args.pop_uint();
+		else if(args.if_pop("-epochs"))
+			epochs = args.pop_uint();
+		else if(args.if_pop("-timeout"))
+			timeout = args.pop_double();
+		else
+			throw Ex("Invalid paramworker option: ", args.peek());
+	}
+	const char* szHost = args.pop_string();
+
+	// Load the shard of data
+	std::unique_ptr<GMatrix> hFeatures, hLabels;
+	loadData(args, hFeatures, hLabels);
+	GMatrix* pFeatures = hFeatures.get();
+	GMatrix* pLabels = hLabels.get();
+	if(!pFeatures->relation().areContinuous() || !pLabels->relation().areContinuous())
+		throw Ex("Distributed training requires continuous data. (Perhaps you should use waffles_transform to convert it first.)");
+
+	// Instantiate the model
+	if(!args.if_pop("neuralnet"))
+		throw Ex("Only \"neuralnet\" can be trained with a parameter server");
+	GNeuralNet* pNN = InstantiateNeuralNet(args, NULL, NULL);
+	std::unique_ptr<GNeuralNet> hNN(pNN);
+	if(args.size() > 0)
+		throw Ex("Superfluous argument: ", args.peek());
+	pNN->rand().setSeed(seed);
+	GNeuralNetParameterModel model(*pNN, *pFeatures, *pLabels);
+	model.setEpochsPerRound(epochs);
+
+	// Train
+	GParameterWorker worker(model);
+	size_t rounds = worker.run(szHost, (unsigned short)port, timeout);
+	cerr << "Completed " << rounds << " rounds\n";
+}
+
 void GLearnerLib::predict(GArgReader& args)
 {
 	// Parse options
@@ -1698,6 +2044,7 @@ void GLearnerLib::CrossValidate(GArgReader& args)
 	int reps = 5;
 	int folds = 2;
 	bool succinct = false;
+	size_t threads = 1;
 	while(args.next_is_flag())
 	{
 		if(args.if_pop("-seed"))
@@ -1708,6 +2055,8 @@ void GLearnerLib::CrossValidate(GArgReader& args)
 			folds = args.pop_uint();
 		else if(args.if_pop("-succinct"))
 			succinct = true;
+		else if(args.if_pop("-threads"))
+			threads = args.pop_uint();
 		else
 			throw Ex("Invalid crossvalidate option: ", args.peek());
 	}
@@ -1728,6 +2077,7 @@ void GLearnerLib::CrossValidate(GArgReader& args)
 	if(args.size() > 0)
 		throw Ex("Superfluous argument: ", args.peek());
 	pSupLearner->rand().setSeed(seed);
+	pSupLearner->setValidationThreads(threads);
 
 	// Test
 	cout.precision(8);
@@ -1945,6 +2295,52 @@ void GLearnerLib::sterilize(GArgReader& args)
 	std::unique_ptr<GMatrix> hSterile(pSterile);
 	pSterile->print(cout);
 }
+
+void GLearnerLib::quantize(GArgReader& args)
+{
+	// Load the model
+	GDom doc;
+	if(args.size() < 1)
+		throw Ex("Model not specified.");
+	doc.loadJson(args.pop_string());
+	GLearnerLoader ll(true);
+	GSupervisedLearner* pModeler = ll.loadLearner(doc.root());
+	std::unique_ptr<GSupervisedLearner> hModeler(pModeler);
+
+	// Load the calibration data
+	std::unique_ptr<GMatrix> hFeatures, hLabels;
+	loadData(args, hFeatures, hLabels, true);
+	GMatrix* pFeatures = hFeatures.get();
+	if(!pFeatures->relation().isCompatible(pModeler->relFeatures()))
+		throw Ex("This data is not compatible with the data that was used to train the model. (The column meta-data is different.)");
+	if(args.size() > 0)
+		throw Ex("Superfluous argument: ", args.peek());
+
+	// Transform the calibration data through any filters, and find the neural network inside them
+	std::unique_ptr<GMatrix> hCalibration;
+	const GMatrix* pCalibration = pFeatures;
+	GSupervisedLearner* pLearner = pModeler;
+	if(pLearner->isFilter())
+	{
+		hCalibration.reset(((GFilter*)pLearner)->prefilterFeatures(*pFeatures));
+		pCalibration = hCalibration.get();
+		while(pLearner->isFilter())
+			pLearner = ((GFilter*)pLearner)->innerLearner();
+	}
+	GNeuralNet* pNN = dynamic_cast<GNeuralNet*>(pLearner);
+	if(!pNN)
+		throw Ex("Only models that contain a neural network can be quantized");
+
+	// Quantize
+	if(pNN->quantize(*pCalibration) == 0)
+		throw Ex("The neural network has no layers that can be quantized");
+
+	// Output the quantized model
+	GDom docOut;
+	docOut.setRoot(pModeler->serialize(&docOut));
+	docOut.writeJson(cout);
+}
+
 /*
 void GLearnerLib::trainRecurrent(GArgReader& args)
 {
@@ -134,22 +134,28 @@ public:
 
         static void showInstantiateAlgorithmError(const char* szMessage, GArgReader& args);
 
-        static void autoTuneDecisionTree(GMatrix& features, GMatrix& labels);
+        static void autoTuneDecisionTree(GMatrix& features, GMatrix& labels, size_t threads);
 
-        static void autoTuneKNN(GMatrix& features, GMatrix& labels);
+        static void autoTuneKNN(GMatrix& features, GMatrix& labels, size_t threads);
 
-        static void autoTuneNeuralNet(GMatrix& features, GMatrix& labels);
+        static void autoTuneNeuralNet(GMatrix& features, GMatrix& labels, size_t threads);
 
-        static void autoTuneNaiveBayes(GMatrix& features, GMatrix& labels);
+        static void autoTuneNaiveBayes(GMatrix& features, GMatrix& labels, size_t threads);
 
-        static void autoTuneNaiveInstance(GMatrix& features, GMatrix& labels);
+        static void autoTuneNaiveInstance(GMatrix& features, GMatrix& labels, size_t threads);
 
-        static void autoTuneGraphCutTransducer(GMatrix& features, GMatrix& labels);
+        static void autoTuneGraphCutTransducer(GMatrix& features, GMatrix& labels, size_t threads);
+
+        static void autoTuneHyperband(GMatrix& features, GMatrix& labels, const char* szModel, size_t threads, size_t maxBudget, size_t eta, const char* szCheckpoint, uint64_t seed);
 
         static void autoTune(GArgReader& args);
 
         static void Train(GArgReader& args);
 
+        static void paramServer(GArgReader& args);
+
+        static void paramWorker(GArgReader& args);
+
         static void predict(GArgReader& args);
 
         static void predictDistribution(GArgReader& args);
@@ -228,6 +234,8 @@ public:
 
         static void sterilize(GArgReader& args);
 
+        static void quantize(GArgReader& args);
+
 //        static void trainRecurrent(GArgReader& args);
 
         static void regress(GArgReader& args);
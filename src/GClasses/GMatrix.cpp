@@ -37,6 +37,8 @@
 #include "GRand.h"
 #include "GTokenizer.h"
 #include "GTime.h"
+#include "GThread.h"
+#include "GHolders.h"
 #include <algorithm>
 #include <fstream>
 #include <sstream>
@@ -44,6 +46,7 @@
 #include <set>
 #include <errno.h>
 #include <memory>
+#include "GProfiler.h"
 
 using std::vector;
 using std::string;
@@ -474,6 +477,9 @@ public:
 	GArffTokenizer(const char* pFile, size_t len) : GTokenizer(pFile, len),
 	m_whitespace("\t\n\r "), m_spaces(" \t"), m_space(" "), m_valEnd(",}\n"), m_valEnder(" ,\t}\n"), m_valHardEnder(",}\t\n"), m_argEnd(" \t\n{\r"), m_newline("\n"), m_commaNewlineTab(",\n\t") {}
 	virtual ~GArffTokenizer() {}
+
+	/// Sets the line number that will be reported for the current position
+	void setLine(size_t line) { m_line = line; }
 };
 
 GArffRelation::GArffRelation()
@@ -1041,6 +1047,82 @@ void GMatrix::flush()
 	m_rows.clear();
 }
 
+/// Converts a string that has already been found to be a valid float. This uses the
+/// exact fast-path for values with at most 15 significant digits and a small decimal
+/// exponent (which covers nearly all values in typical data files), and defers to atof
+/// for everything else.
+inline double GMatrix_parseReal(const char* sz)
+{
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const char* p = sz;
+	bool neg = false;
+	if(*p == '-')
+	{
+		neg = true;
+		p++;
+	}
+	else if(*p == '+')
+		p++;
+	unsigned long long mant = 0;
+	int sigDigits = 0;
+	int digits = 0;
+	int exp10 = 0;
+	while(*p >= '0' && *p <= '9')
+	{
+		mant = mant * 10 + (*p - '0');
+		if(mant != 0 && ++sigDigits > 15)
+			return atof(sz);
+		digits++;
+		p++;
+	}
+	if(*p == '.')
+	{
+		p++;
+		while(*p >= '0' && *p <= '9')
+		{
+			mant = mant * 10 + (*p - '0');
+			if(mant != 0 && ++sigDigits > 15)
+				return atof(sz);
+			digits++;
+			exp10--;
+			p++;
+		}
+	}
+	if(digits == 0)
+		return atof(sz);
+	if(*p == 'e' || *p == 'E')
+	{
+		p++;
+		bool negExp = false;
+		if(*p == '-')
+		{
+			negExp = true;
+			p++;
+		}
+		else if(*p == '+')
+			p++;
+		int e = 0;
+		if(*p < '0' || *p > '9')
+			return atof(sz);
+		while(*p >= '0' && *p <= '9')
+		{
+			if(e > 1000)
+				return atof(sz);
+			e = e * 10 + (*p - '0');
+			p++;
+		}
+		exp10 += (negExp ? -e : e);
+	}
+	if(*p != '\0' || exp10 < -22 || exp10 > 22)
+		return atof(sz);
+	double d = (double)mant;
+	if(exp10 < 0)
+		d /= pow10[-exp10];
+	else
+		d *= pow10[exp10];
+	return neg ? -d : d;
+}
+
 inline bool IsRealValue(const char* szValue)
 {
 	if(*szValue == '-')
@@ -1064,7 +1146,7 @@ double GMatrix_parseValue(GArffRelation* pRelation, size_t col, const char* szVa
 		{
 			if(!IsRealValue(szVal))
 				throw Ex("Expected a numeric value at line ", to_str(tok.line()), ", col ", to_str(tok.col()));
-			return atof(szVal);
+			return GMatrix_parseReal(szVal);
 		}
 	}
 	else if(vals < (size_t)-10) // Nominal
@@ -1100,7 +1182,8 @@ double GMatrix_parseValue(GArffRelation* pRelation, size_t col, const char* szVa
 }
 
 #ifndef MIN_PREDICT
-void GMatrix::parseArff(GArffTokenizer& tok)
+/// Parses the meta-data of an ARFF file, up through the @DATA line
+GArffRelation* GMatrix_parseArffHeader(GArffTokenizer& tok)
 {
 	// Parse the meta data
 	GArffRelation* pRelation = new GArffRelation();
@@ -1138,8 +1221,12 @@ void GMatrix::parseArff(GArffTokenizer& tok)
 			throw Ex("Expected a '%' or a '@' at line ", to_str(tok.line()), ", col ", to_str(tok.col()));
 	}
 
-	flush();
-	setRelation(pRelation);
+	return pRelation;
+}
+
+/// Parses rows of ARFF data and adds them to out
+void GMatrix_parseArffData(GArffRelation* pRelation, GArffTokenizer& tok, GMatrix& out)
+{
 	size_t colCount = pRelation->size();
 	while(true)
 	{
@@ -1156,7 +1243,7 @@ void GMatrix::parseArff(GArffTokenizer& tok)
 		{
 			// Parse ARFF sparse data format
 			tok.advance(1);
-			GVec& r = newRow();
+			GVec& r = out.newRow();
 			r.fill(0.0);
 			while(true)
 			{
@@ -1194,7 +1281,7 @@ void GMatrix::parseArff(GArffTokenizer& tok)
 		else
 		{
 			// Parse ARFF dense data format
-			GVec& r = newRow();
+			GVec& r = out.newRow();
 			size_t column = 0;
 			while(true)
 			{
@@ -1225,7 +1312,17 @@ void GMatrix::parseArff(GArffTokenizer& tok)
 				throw Ex("Not enough values on line ", to_str(tok.line()), ", col ", to_str(tok.col()));
 		}
 	}
-	for(size_t i = 0; i < colCount; i++)
+}
+
+void GMatrix::parseArff(GArffTokenizer& tok)
+{
+	GPROFILE_SCOPE("GMatrix::parseArff");
+	GArffRelation* pRelation = GMatrix_parseArffHeader(tok);
+	flush();
+	setRelation(pRelation);
+	GMatrix_parseArffData(pRelation, tok, *this);
+	GPROFILE_COUNT("GMatrix::parseArff rows", rows());
+	for(size_t i = 0; i < pRelation->size(); i++)
 	{
 		if(pRelation->valueCount(i) == INVALID_INDEX)
 			pRelation->setAttrValueCount(i, 0);
@@ -1269,11 +1366,148 @@ void GMatrix::saveRaw(const char* szFilename)
 	fout.close();
 }
 
-// static
-void GMatrix::parseArff(const char* szFile, size_t nLen)
+/// Returns the position of the first line after the @DATA line, or INVALID_INDEX if there is none
+size_t GMatrix_findArffData(const char* pFile, size_t len)
 {
-	GArffTokenizer tok(szFile, nLen);
-	parseArff(tok);
+	size_t pos = 0;
+	while(pos < len)
+	{
+		while(pos < len && (pFile[pos] == ' ' || pFile[pos] == '\t' || pFile[pos] == '\r' || pFile[pos] == '\n'))
+			pos++;
+		if(pos + 5 <= len && pFile[pos] == '@' && _strnicmp(pFile + pos + 1, "data", 4) == 0 && (pos + 5 == len || pFile[pos + 5] <= ' '))
+		{
+			const char* pNewline = (const char*)memchr(pFile + pos, '\n', len - pos);
+			return pNewline ? (size_t)(pNewline - pFile) + 1 : len;
+		}
+		const char* pNewline = (const char*)memchr(pFile + pos, '\n', len - pos);
+		if(!pNewline)
+			break;
+		pos = (size_t)(pNewline - pFile) + 1;
+	}
+	return INVALID_INDEX;
+}
+
+class GArffChunkWorker : public GWorkerThread
+{
+protected:
+	GArffRelation* m_pRelation;
+	const char* m_pFile;
+	vector<size_t>& m_starts;
+	vector<size_t>& m_lines;
+	vector<GMatrix*>& m_chunks;
+	vector<string>& m_errors;
+
+public:
+	GArffChunkWorker(GMasterThread& master, GArffRelation* pRelation, const char* pFile, vector<size_t>& starts, vector<size_t>& lines, vector<GMatrix*>& chunks, vector<string>& errors)
+	: GWorkerThread(master),
+	m_pRelation(pRelation),
+	m_pFile(pFile),
+	m_starts(starts),
+	m_lines(lines),
+	m_chunks(chunks),
+	m_errors(errors)
+	{
+	}
+
+	virtual ~GArffChunkWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		// Exceptions must not escape from a worker thread, so they are reported back to the master
+		try
+		{
+			GArffTokenizer tok(m_pFile + m_starts[jobId], m_starts[jobId + 1] - m_starts[jobId]);
+			tok.setLine(m_lines[jobId]);
+			GMatrix_parseArffData(m_pRelation, tok, *m_chunks[jobId]);
+		}
+		catch(const std::exception& e)
+		{
+			m_errors[jobId] = e.what();
+		}
+	}
+};
+
+void GMatrix::parseArff(const char* szFile, size_t nLen, size_t threads)
+{
+	size_t dataStart = threads > 1 ? GMatrix_findArffData(szFile, nLen) : INVALID_INDEX;
+	if(dataStart == INVALID_INDEX || dataStart >= nLen)
+	{
+		GArffTokenizer tok(szFile, nLen);
+		parseArff(tok);
+		return;
+	}
+	GPROFILE_SCOPE("GMatrix::parseArff parallel");
+
+	// Parse the meta-data
+	GArffRelation* pRelation;
+	{
+		GArffTokenizer tok(szFile, dataStart);
+		pRelation = GMatrix_parseArffHeader(tok);
+	}
+	flush();
+	setRelation(pRelation);
+
+	// Divide the data into newline-aligned chunks, and count the lines so errors will report the right line
+	size_t nLine = 1;
+	for(const char* p = szFile; (p = (const char*)memchr(p, '\n', szFile + dataStart - p)) != NULL; p++)
+		nLine++;
+	size_t chunkSize = std::max((size_t)65536, (nLen - dataStart) / (threads * 4) + 1);
+	vector<size_t> starts;
+	vector<size_t> lines;
+	size_t pos = dataStart;
+	while(pos < nLen)
+	{
+		starts.push_back(pos);
+		lines.push_back(nLine);
+		size_t end = std::min(nLen, pos + chunkSize);
+		if(end < nLen)
+		{
+			const char* pNewline = (const char*)memchr(szFile + end, '\n', nLen - end);
+			end = pNewline ? (size_t)(pNewline - szFile) + 1 : nLen;
+		}
+		for(const char* p = szFile + pos; (p = (const char*)memchr(p, '\n', szFile + end - p)) != NULL; p++)
+			nLine++;
+		pos = end;
+	}
+	size_t chunkCount = starts.size();
+	starts.push_back(nLen);
+
+	// Parse the chunks in parallel
+	vector<GMatrix*> chunks;
+	VectorOfPointersHolder<GMatrix> hChunks(chunks);
+	for(size_t i = 0; i < chunkCount; i++)
+		chunks.push_back(new GMatrix(0, pRelation->size()));
+	vector<string> errors(chunkCount);
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < std::min(threads, chunkCount); i++)
+			master.addWorker(new GArffChunkWorker(master, pRelation, szFile, starts, lines, chunks, errors));
+		master.doJobs(chunkCount);
+	}
+
+	// Assemble the rows in order
+	size_t total = 0;
+	for(size_t i = 0; i < chunkCount; i++)
+	{
+		if(errors[i].length() > 0)
+			throw Ex(errors[i]);
+		total += chunks[i]->rows();
+	}
+	GPROFILE_COUNT("GMatrix::parseArff rows", total);
+	reserve(total);
+	for(size_t i = 0; i < chunkCount; i++)
+	{
+		for(size_t j = 0; j < chunks[i]->rows(); j++)
+			takeRow(&chunks[i]->row(j));
+		chunks[i]->releaseAllRows();
+	}
+	for(size_t i = 0; i < pRelation->size(); i++)
+	{
+		if(pRelation->valueCount(i) == INVALID_INDEX)
+			pRelation->setAttrValueCount(i, 0);
+	}
 }
 
 size_t GMatrix::countUniqueValues(size_t column, size_t maxCount) const
@@ -4730,6 +4964,99 @@ void GMatrix_testImport()
 		throw Ex("failed");
 }
 
+class GMatrix_testRowCollector : public GCSVRowHandler
+{
+public:
+	GMatrix* m_pData;
+
+	GMatrix_testRowCollector() : m_pData(NULL) {}
+	virtual ~GMatrix_testRowCollector() { delete(m_pData); }
+
+	virtual void onRelation(const GArffRelation& relation)
+	{
+		m_pData = new GMatrix(relation.clone());
+	}
+
+	virtual void onRow(const GVec& row)
+	{
+		m_pData->newRow().copy(row);
+	}
+};
+
+void GMatrix_testParallelParsing(GRand& prng)
+{
+	// Make a CSV file that is big enough to be divided into several chunks
+	std::ostringstream os;
+	os << "num,word,sparse\n";
+	for(size_t i = 0; i < 20000; i++)
+	{
+		os << prng.normal() << "," << (char)('a' + prng.next(5)) << (prng.next(3) == 0 ? "x" : "") << ",";
+		if(prng.next(4) == 0)
+			os << "?";
+		else
+			os << (double)prng.next(1000) * 0.25;
+		os << "\n";
+	}
+	string csv = os.str();
+
+	// Parse it serially
+	GCSVParser serial;
+	serial.columnNamesInFirstRow();
+	GMatrix a;
+	serial.parse(a, csv.c_str(), csv.length());
+	if(a.rows() != 20000 || a.cols() != 3)
+		throw Ex("failed");
+	std::ostringstream osA;
+	a.print(osA);
+	string arff = osA.str();
+
+	// Parse it in parallel
+	GCSVParser parallel;
+	parallel.columnNamesInFirstRow();
+	parallel.setThreadCount(4);
+	GMatrix b;
+	parallel.parse(b, csv.c_str(), csv.length());
+	std::ostringstream osB;
+	b.print(osB);
+	if(osB.str().compare(arff) != 0)
+		throw Ex("Parallel CSV parsing gave different results");
+	for(size_t i = 0; i < 3; i++)
+	{
+		if(serial.report(i).compare(parallel.report(i)) != 0)
+			throw Ex("Parallel CSV parsing gave a different report");
+	}
+
+	// Stream it in small blocks
+	const char* szFilename = "gmatrix_test_stream.csv";
+	GFile::saveFile(csv.c_str(), csv.length(), szFilename);
+	GCSVParser streaming;
+	streaming.columnNamesInFirstRow();
+	streaming.setStreamBlockSize(1000);
+	GMatrix_testRowCollector collector;
+	try
+	{
+		streaming.parseStream(szFilename, collector);
+	}
+	catch(const std::exception&)
+	{
+		GFile::deleteFile(szFilename);
+		throw;
+	}
+	GFile::deleteFile(szFilename);
+	std::ostringstream osC;
+	collector.m_pData->print(osC);
+	if(osC.str().compare(arff) != 0)
+		throw Ex("Streaming CSV parsing gave different results");
+
+	// Parse the ARFF form in parallel
+	GMatrix c;
+	c.parseArff(arff.c_str(), arff.length(), 4);
+	std::ostringstream osD;
+	c.print(osD);
+	if(osD.str().compare(arff) != 0)
+		throw Ex("Parallel ARFF parsing gave different results");
+}
+
 // static
 void GMatrix::test()
 {
@@ -4750,6 +5077,7 @@ void GMatrix::test()
 	GMatrix_testWilcoxon();
 	GMatrix_testBoundingSphere(prng);
 	GMatrix_testImport();
+	GMatrix_testParallelParsing(prng);
 }
 #endif // !MIN_PREDICT
 
@@ -4816,7 +5144,9 @@ GCSVParser::GCSVParser()
 m_columnNamesInFirstRow(false),
 m_tolerant(false),
 m_clearlyNumericalThreshold(10),
-m_maxVals(200)
+m_maxVals(200),
+m_threads(1),
+m_streamBlockSize(4 * 1024 * 1024)
 {
 
 }
@@ -4854,15 +5184,8 @@ void GCSVParser::parse(GMatrix& outMatrix, const char* szFilename)
 	parse(outMatrix, szFile, nLen);
 }
 
-void GCSVParser::parse(GMatrix& outMatrix, const char* pFile, size_t len)
+size_t GCSVParser::tokenize(const char* pFile, size_t nPos, size_t len, size_t& nLine, size_t& columnCount, size_t& nFirstDataLine, vector<ImportRow>& rows, GHeap& heap, bool stopAfterCounting)
 {
-	// Extract the elements
-	GHeap heap(2048);
-	vector<ImportRow> rows;
-	size_t columnCount = INVALID_INDEX;
-	size_t nFirstDataLine = 1;
-	size_t nLine = 1;
-	size_t nPos = 0;
 	while(true)
 	{
 		// Skip Whitespace
@@ -4876,8 +5199,10 @@ void GCSVParser::parse(GMatrix& outMatrix, const char* pFile, size_t len)
 			break;
 
 		// Count the elements
+		bool counted = false;
 		if(columnCount == INVALID_INDEX && (!m_columnNamesInFirstRow || nLine > 1))
 		{
+			counted = true;
 			if(m_separator == '\0')
 			{
 				// Elements are separated by an arbitrary amount of whitespace, element values contain no whitespace, and there are no missing elements
@@ -4890,7 +5215,7 @@ void GCSVParser::parse(GMatrix& outMatrix, const char* pFile, size_t len)
 						i++;
 					while(i < len && pFile[i] <= ' ' && pFile[i] != '\n')
 						i++;
-					if(pFile[i] == '\n')
+					if(i >= len || pFile[i] == '\n')
 						break;
 				}
 			}
@@ -5006,281 +5331,744 @@ void GCSVParser::parse(GMatrix& outMatrix, const char* pFile, size_t len)
 		for(; nPos < len && pFile[nPos] != '\n'; nPos++)
 		{
 		}
-		continue;
+		if(counted && stopAfterCounting)
+			break;
 	}
-	if(m_columnNamesInFirstRow && m_tolerant)
+	return nPos;
+}
+
+class GCSVTokenizeWorker : public GWorkerThread
+{
+protected:
+	GCSVParser& m_parser;
+	const char* m_pFile;
+	vector<size_t>& m_starts;
+	vector<size_t>& m_lines;
+	size_t m_columnCount;
+	size_t m_nFirstDataLine;
+	vector< vector<ImportRow> >& m_chunkRows;
+	vector<GHeap*>& m_heaps;
+	vector<string>& m_errors;
+
+public:
+	GCSVTokenizeWorker(GMasterThread& master, GCSVParser& parser, const char* pFile, vector<size_t>& starts, vector<size_t>& lines, size_t columnCount, size_t nFirstDataLine, vector< vector<ImportRow> >& chunkRows, vector<GHeap*>& heaps, vector<string>& errors)
+	: GWorkerThread(master),
+	m_parser(parser),
+	m_pFile(pFile),
+	m_starts(starts),
+	m_lines(lines),
+	m_columnCount(columnCount),
+	m_nFirstDataLine(nFirstDataLine),
+	m_chunkRows(chunkRows),
+	m_heaps(heaps),
+	m_errors(errors)
 	{
-		ImportRow& row = rows[0];
-		while(row.m_elements.size() < columnCount)
-			row.m_elements.push_back("attr");
 	}
 
-	// Parse it all
-	size_t rowCount = rows.size();
-	outMatrix.flush();
-	GArffRelation* pRelation = new GArffRelation();
-	outMatrix.setRelation(pRelation);
-	for(size_t i = 0; i < rowCount; i++)
+	virtual ~GCSVTokenizeWorker()
 	{
-		GVec* pNewVec = new GVec();
-		outMatrix.takeRow(pNewVec);
-		pNewVec->resize(columnCount);
 	}
-	m_report.resize(columnCount);
+
+	virtual void doJob(size_t jobId)
+	{
+		// Exceptions must not escape from a worker thread, so they are reported back to the master
+		try
+		{
+			size_t nLine = m_lines[jobId];
+			size_t columnCount = m_columnCount;
+			size_t nFirstDataLine = m_nFirstDataLine;
+			m_parser.tokenize(m_pFile, m_starts[jobId], m_starts[jobId + 1], nLine, columnCount, nFirstDataLine, m_chunkRows[jobId], *m_heaps[jobId], false);
+		}
+		catch(const std::exception& e)
+		{
+			m_errors[jobId] = e.what();
+		}
+	}
+};
+
+void GCSVParser::tokenizeAll(const char* pFile, size_t len, size_t& columnCount, vector<ImportRow>& rows, vector<GHeap*>& heaps)
+{
+	GPROFILE_SCOPE("GCSVParser::tokenizeAll");
+	size_t nLine = 1;
+	size_t nFirstDataLine = 1;
+	heaps.push_back(new GHeap(2048));
+	if(m_threads < 2)
+	{
+		tokenize(pFile, 0, len, nLine, columnCount, nFirstDataLine, rows, *heaps[0], false);
+		return;
+	}
+
+	// Extract the rows up to the one that determines the number of columns
+	size_t nPos = tokenize(pFile, 0, len, nLine, columnCount, nFirstDataLine, rows, *heaps[0], true);
+
+	// Divide the rest into newline-aligned chunks, and count the lines in each one so errors will report the right line
+	size_t chunkSize = std::max((size_t)65536, (len - std::min(nPos, len)) / (m_threads * 4) + 1);
+	vector<size_t> starts;
+	vector<size_t> lines;
+	while(nPos < len)
+	{
+		starts.push_back(nPos);
+		lines.push_back(nLine);
+		size_t end = std::min(len, nPos + chunkSize);
+		if(end < len)
+		{
+			const char* pNewline = (const char*)memchr(pFile + end, '\n', len - end);
+			end = pNewline ? (size_t)(pNewline - pFile) + 1 : len;
+		}
+		for(const char* p = pFile + nPos; (p = (const char*)memchr(p, '\n', pFile + end - p)) != NULL; p++)
+			nLine++;
+		nPos = end;
+	}
+	size_t chunkCount = starts.size();
+	if(chunkCount == 0)
+		return;
+	starts.push_back(len);
+
+	// Tokenize the chunks in parallel
+	vector< vector<ImportRow> > chunkRows(chunkCount);
+	vector<GHeap*> chunkHeaps;
+	for(size_t i = 0; i < chunkCount; i++)
+	{
+		chunkHeaps.push_back(new GHeap(2048));
+		heaps.push_back(chunkHeaps.back());
+	}
+	vector<string> errors(chunkCount);
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < std::min(m_threads, chunkCount); i++)
+			master.addWorker(new GCSVTokenizeWorker(master, *this, pFile, starts, lines, columnCount, nFirstDataLine, chunkRows, chunkHeaps, errors));
+		master.doJobs(chunkCount);
+	}
+	for(size_t i = 0; i < chunkCount; i++)
+	{
+		if(errors[i].length() > 0)
+			throw Ex(errors[i]);
+	}
+
+	// Concatenate the rows in order
+	size_t total = rows.size();
+	for(size_t i = 0; i < chunkCount; i++)
+		total += chunkRows[i].size();
+	rows.reserve(total);
+	for(size_t i = 0; i < chunkCount; i++)
+	{
+		for(size_t j = 0; j < chunkRows[i].size(); j++)
+		{
+			rows.resize(rows.size() + 1);
+			rows.back().m_elements.swap(chunkRows[i][j].m_elements);
+		}
+		vector<ImportRow>().swap(chunkRows[i]);
+	}
+}
+
+std::string GCSVParser::makeAttrName(size_t attr, vector<ImportRow>& rows)
+{
+	string attrName = "";
 	if(m_columnNamesInFirstRow)
-		rowCount--;
-	for(size_t attr = 0; attr < columnCount; attr++)
 	{
-		std::map<size_t, string>::iterator itFormat = m_formats.find(attr);
-		if(itFormat != m_formats.end())
+		bool quot = false;
+		if(rows[0].m_elements[attr][0] != '"' && rows[0].m_elements[attr][0] != '\'')
+			quot = true;
+		if(quot)
+			attrName += "\"";
+		attrName += rows[0].m_elements[attr];
+		if(quot)
+			attrName += "\"";
+	}
+	else
+	{
+		attrName = "attr";
+		attrName += to_str(attr);
+	}
+	return attrName;
+}
+
+size_t GCSVParser::parseColumn(size_t attr, vector<ImportRow>& rows, GMatrix& outMatrix, string& attrName, vector<const char*>& values)
+{
+	attrName = makeAttrName(attr, rows);
+	std::map<size_t, string>::iterator itFormat = m_formats.find(attr);
+	if(itFormat != m_formats.end())
+	{
+		const char* szFormat = itFormat->second.c_str();
+		size_t i = 0;
+		size_t errs = 0;
+		string firstErr;
+		for(size_t rowNum = m_columnNamesInFirstRow ? 1 : 0; rowNum < rows.size(); rowNum++)
 		{
-			const char* szFormat = itFormat->second.c_str();
-			if(m_columnNamesInFirstRow)
-			{
-				bool quot = false;
-				if(rows[0].m_elements[attr][0] != '"' && rows[0].m_elements[attr][0] != '\'')
-					quot = true;
-				string attrName = "";
-				if(quot)
-					attrName += "\"";
-				attrName += rows[0].m_elements[attr];
-				if(quot)
-					attrName += "\"";
-				pRelation->addAttribute(attrName.c_str(), 0, NULL);
-			}
+			const char* el = rows[rowNum].m_elements[attr];
+			time_t t;
+			if(*el == '\0')
+				outMatrix[i][attr] = UNKNOWN_REAL_VALUE;
+			else if(GTime::fromString(&t, el, szFormat))
+				outMatrix[i][attr] = (double)t;
 			else
 			{
-				string attrName = "attr";
-				attrName += to_str(attr);
-				pRelation->addAttribute(attrName.c_str(), 0, NULL);
+				outMatrix[i][attr] = UNKNOWN_REAL_VALUE;
+				if(errs == 0)
+					firstErr = el;
+				errs++;
 			}
+			i++;
+		}
 
-			size_t i = 0;
-			size_t errs = 0;
-			string firstErr;
-			for(size_t rowNum = m_columnNamesInFirstRow ? 1 : 0; rowNum < rows.size(); rowNum++)
-			{
-				const char* el = rows[rowNum].m_elements[attr];
-				time_t t;
-				if(*el == '\0')
-					outMatrix[i][attr] = UNKNOWN_REAL_VALUE;
-				else if(GTime::fromString(&t, el, szFormat))
-					outMatrix[i][attr] = (double)t;
-				else
-				{
-					outMatrix[i][attr] = UNKNOWN_REAL_VALUE;
-					if(errs == 0)
-						firstErr = el;
-					errs++;
-				}
-				i++;
-			}
+		if(m_columnNamesInFirstRow)
+		{
+			m_report[attr] = rows[0].m_elements[attr];
+			m_report[attr] += ": ";
+		}
+		else
+			m_report[attr] = "";
+		m_report[attr] += "Formatted. ";
+		m_report[attr] += to_str(errs);
+		m_report[attr] += " errors";
+		if(errs > 0)
+		{
+			m_report[attr] += ", such as \"";
+			m_report[attr] += firstErr;
+			m_report[attr] += "\".";
+		}
+		return 0;
+	}
+
+	// Determine if the attribute can be real
+	bool real = true;
+	string firstNonNumericalValue;
+	std::map<size_t, size_t>::iterator itSpecifiedReal = m_specifiedReal.find(attr);
+	std::map<size_t, size_t>::iterator itSpecifiedNominal = m_specifiedNominal.find(attr);
+	if(itSpecifiedReal != m_specifiedReal.end())
+		real = true;
+	else if(itSpecifiedNominal != m_specifiedNominal.end())
+		real = false;
+	else
+	{
+		for(size_t rowNum = m_columnNamesInFirstRow ? 1 : 0; rowNum < rows.size(); rowNum++)
+		{
+			const char* el = rows[rowNum].m_elements[attr];
+			if(el[0] == '\0')
+				continue; // unknown value
+			if(strcmp(el, "?") == 0)
+				continue; // unknown value
+			if(GBits::isValidFloat(el, strlen(el)))
+				continue;
+			firstNonNumericalValue = el;
+			real = false;
+			break;
+		}
+	}
 
-			if(m_columnNamesInFirstRow)
+	// Make the attribute
+	if(real)
+	{
+		string firstRealError = "";
+		size_t realErrs = 0;
+		size_t i = 0;
+		for(size_t rowNum = m_columnNamesInFirstRow ? 1 : 0; rowNum < rows.size(); rowNum++)
+		{
+			const char* el = rows[rowNum].m_elements[attr];
+			double val;
+			if(el[0] == '\0')
+				val = UNKNOWN_REAL_VALUE;
+			else if(strcmp(el, "?") == 0)
+				val = UNKNOWN_REAL_VALUE;
+			else if(!GBits::isValidFloat(el, strlen(el)))
 			{
-				m_report[attr] = rows[0].m_elements[attr];
-				m_report[attr] += ": ";
+				val = UNKNOWN_REAL_VALUE;
+				if(firstRealError.length() < 1)
+					firstRealError = el;
+				realErrs++;
 			}
 			else
-				m_report[attr] = "";
-			m_report[attr] += "Formatted. ";
-			m_report[attr] += to_str(errs);
+				val = GMatrix_parseReal(el);
+			outMatrix[i][attr] = val;
+			i++;
+		}
+
+		// Report this column
+		if(m_columnNamesInFirstRow)
+		{
+			m_report[attr] = rows[0].m_elements[attr];
+			m_report[attr] += ": ";
+		}
+		else
+			m_report[attr] = "";
+		size_t uniqueVals = outMatrix.countUniqueValues(attr, m_clearlyNumericalThreshold);
+		if(itSpecifiedReal != m_specifiedReal.end())
+		{
+			m_report[attr] += "Constrained to be real. ";
+			m_report[attr] += to_str(realErrs);
 			m_report[attr] += " errors";
-			if(errs > 0)
+			if(realErrs > 0)
 			{
 				m_report[attr] += ", such as \"";
-				m_report[attr] += firstErr;
-				m_report[attr] += "\".";
+				m_report[attr] += firstRealError;
+				m_report[attr] += "\"";
 			}
-			continue;
+			m_report[attr] += ".";
+		}
+		else if(uniqueVals < m_clearlyNumericalThreshold)
+		{
+			m_report[attr] += "Ambiguous type. All values in this column are numerical, but there are only ";
+			m_report[attr] += to_str(uniqueVals);
+			m_report[attr] += " unique values. Assuming a numerical attribute was intended.";
 		}
-
-		// Determine if the attribute can be real
-		bool real = true;
-		string firstNonNumericalValue;
-		std::map<size_t, size_t>::iterator itSpecifiedReal = m_specifiedReal.find(attr);
-		std::map<size_t, size_t>::iterator itSpecifiedNominal = m_specifiedNominal.find(attr);
-		if(itSpecifiedReal != m_specifiedReal.end())
-			real = true;
-		else if(itSpecifiedNominal != m_specifiedNominal.end())
-			real = false;
 		else
+			m_report[attr] += "Clearly numerical.";
+		return 0;
+	}
+	else
+	{
+		// Make the data
+		GConstStringHashTable ht(31, true);
+		void* pVal;
+		uintptr_t n;
+		size_t i = 0;
+		size_t valueCount = 0;
+		for(size_t rowNum = m_columnNamesInFirstRow ? 1 : 0; rowNum < rows.size(); rowNum++)
 		{
-			for(size_t rowNum = m_columnNamesInFirstRow ? 1 : 0; rowNum < rows.size(); rowNum++)
+			const char* el = rows[rowNum].m_elements[attr];
+			if(el[0] == '\0')
+				outMatrix[i][attr] = UNKNOWN_DISCRETE_VALUE;
+			else if(strcmp(el, "?") == 0)
+				outMatrix[i][attr] = UNKNOWN_DISCRETE_VALUE;
+			else
 			{
-				const char* el = rows[rowNum].m_elements[attr];
-				if(el[0] == '\0')
-					continue; // unknown value
-				if(strcmp(el, "?") == 0)
-					continue; // unknown value
-				if(GBits::isValidFloat(el, strlen(el)))
-					continue;
-				firstNonNumericalValue = el;
-				real = false;
-				break;
+				if(valueCount <= m_maxVals)
+				{
+					if(ht.get(el, &pVal))
+						n = (uintptr_t)pVal;
+					else
+					{
+						values.push_back(el);
+						n = valueCount++;
+						ht.add(el, (const void*)n);
+					}
+					outMatrix[i][attr] = (double)n;
+				}
+				else
+					outMatrix[i][attr] = UNKNOWN_DISCRETE_VALUE;
 			}
+			i++;
 		}
 
 		// Make the attribute
-		if(real)
+		if(m_columnNamesInFirstRow)
 		{
-			string firstRealError = "";
-			size_t realErrs = 0;
-			if(m_columnNamesInFirstRow)
-			{
-				bool quot = false;
-				if(rows[0].m_elements[attr][0] != '"' && rows[0].m_elements[attr][0] != '\'')
-					quot = true;
-				string attrName = "";
-				if(quot)
-					attrName += "\"";
-				attrName += rows[0].m_elements[attr];
-				if(quot)
-					attrName += "\"";
-				pRelation->addAttribute(attrName.c_str(), 0, NULL);
-			}
-			else
-			{
-				string attrName = "attr";
-				attrName += to_str(attr);
-				pRelation->addAttribute(attrName.c_str(), 0, NULL);
-			}
-			size_t i = 0;
-			for(size_t rowNum = m_columnNamesInFirstRow ? 1 : 0; rowNum < rows.size(); rowNum++)
+			m_report[attr] = rows[0].m_elements[attr];
+			m_report[attr] += ": ";
+		}
+		else
+			m_report[attr] = "";
+		if(valueCount <= m_maxVals)
+			m_report[attr] += "Clearly categorical.";
+		else
+		{
+			m_report[attr] += "Problematic column!!! Contains non-numerical values, such as \"";
+			m_report[attr] += firstNonNumericalValue;
+			m_report[attr] += "\", but contains more than ";
+			m_report[attr] += to_str(m_maxVals);
+			m_report[attr] += " unique values. Parsing of this column was aborted!!!";
+			attrName += "_aborted_due_to_too_many_vals";
+		}
+		return valueCount;
+	}
+}
+
+class GCSVColumnWorker : public GWorkerThread
+{
+protected:
+	GCSVParser& m_parser;
+	vector<ImportRow>& m_rows;
+	GMatrix& m_outMatrix;
+	vector<string>& m_attrNames;
+	vector< vector<const char*> >& m_values;
+	vector<size_t>& m_valueCounts;
+	vector<string>& m_errors;
+
+public:
+	GCSVColumnWorker(GMasterThread& master, GCSVParser& parser, vector<ImportRow>& rows, GMatrix& outMatrix, vector<string>& attrNames, vector< vector<const char*> >& values, vector<size_t>& valueCounts, vector<string>& errors)
+	: GWorkerThread(master),
+	m_parser(parser),
+	m_rows(rows),
+	m_outMatrix(outMatrix),
+	m_attrNames(attrNames),
+	m_values(values),
+	m_valueCounts(valueCounts),
+	m_errors(errors)
+	{
+	}
+
+	virtual ~GCSVColumnWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		try
+		{
+			m_valueCounts[jobId] = m_parser.parseColumn(jobId, m_rows, m_outMatrix, m_attrNames[jobId], m_values[jobId]);
+		}
+		catch(const std::exception& e)
+		{
+			m_errors[jobId] = e.what();
+		}
+	}
+};
+
+void GCSVParser::parse(GMatrix& outMatrix, const char* pFile, size_t len)
+{
+	GPROFILE_SCOPE("GCSVParser::parse");
+	// Extract the elements
+	vector<ImportRow> rows;
+	vector<GHeap*> heaps;
+	VectorOfPointersHolder<GHeap> hHeaps(heaps);
+	size_t columnCount = INVALID_INDEX;
+	tokenizeAll(pFile, len, columnCount, rows, heaps);
+	if(columnCount == INVALID_INDEX)
+		columnCount = 0;
+	if(m_columnNamesInFirstRow && m_tolerant && rows.size() > 0)
+	{
+		ImportRow& row = rows[0];
+		while(row.m_elements.size() < columnCount)
+			row.m_elements.push_back("attr");
+	}
+
+	// Parse it all
+	size_t rowCount = rows.size();
+	GPROFILE_COUNT("GCSVParser::parse rows", rowCount);
+	if(m_columnNamesInFirstRow && rowCount > 0)
+		rowCount--;
+	outMatrix.flush();
+	GArffRelation* pRelation = new GArffRelation();
+	outMatrix.setRelation(pRelation);
+	outMatrix.reserve(rowCount);
+	for(size_t i = 0; i < rowCount; i++)
+	{
+		GVec* pNewVec = new GVec();
+		outMatrix.takeRow(pNewVec);
+		pNewVec->resize(columnCount);
+	}
+	m_report.resize(columnCount);
+	vector<string> attrNames(columnCount);
+	vector< vector<const char*> > values(columnCount);
+	vector<size_t> valueCounts(columnCount);
+	vector<string> errors(columnCount);
+	if(columnCount > 0)
+	{
+		// Each column is independent, so they can be converted in parallel
+		GMasterThread master;
+		for(size_t i = 0; i < std::min(m_threads, columnCount); i++)
+			master.addWorker(new GCSVColumnWorker(master, *this, rows, outMatrix, attrNames, values, valueCounts, errors));
+		master.doJobs(columnCount);
+	}
+	for(size_t attr = 0; attr < columnCount; attr++)
+	{
+		if(errors[attr].length() > 0)
+			throw Ex(errors[attr]);
+		pRelation->addAttribute(attrNames[attr].c_str(), valueCounts[attr], valueCounts[attr] > 0 ? &values[attr] : NULL);
+	}
+}
+
+void GCSVParser::streamBlocks(const char* szFilename, void (*pFunc)(void* pThis, vector<ImportRow>& rows, size_t firstRow, size_t columnCount), void* pThis)
+{
+	std::ifstream s(szFilename, std::ios::binary);
+	if(s.fail())
+		throw Ex("Error while trying to open the file, ", szFilename, ". ", strerror(errno));
+	vector<char> buf;
+	size_t used = 0;
+	size_t nLine = 1;
+	size_t columnCount = INVALID_INDEX;
+	size_t nFirstDataLine = 1;
+	size_t firstRow = 0;
+	GHeap heap(2048);
+	vector<ImportRow> rows;
+	bool eof = false;
+	while(!eof)
+	{
+		// Read another block
+		if(buf.size() < used + m_streamBlockSize + 1)
+			buf.resize(used + m_streamBlockSize + 1);
+		s.read(&buf[used], m_streamBlockSize);
+		size_t got = (size_t)s.gcount();
+		used += got;
+		if(got < m_streamBlockSize)
+			eof = true;
+		buf[used] = '\0';
+
+		// Find the end of the last complete line
+		size_t end = used;
+		if(!eof)
+		{
+			while(end > 0 && buf[end - 1] != '\n')
+				end--;
+			if(end == 0)
+				continue; // This line is longer than a block, so read some more
+		}
+
+		// Extract and deliver the complete lines
+		rows.clear();
+		heap.clear();
+		size_t nPrevLine = nLine;
+		tokenize(&buf[0], 0, end, nLine, columnCount, nFirstDataLine, rows, heap, false);
+		if(columnCount == INVALID_INDEX && !eof)
+		{
+			// Nothing can be delivered until the number of columns is known, so read some more
+			nLine = nPrevLine;
+			continue;
+		}
+		if(rows.size() > 0)
+			pFunc(pThis, rows, firstRow, columnCount);
+		firstRow += rows.size();
+		memmove(&buf[0], &buf[end], used - end);
+		used -= end;
+	}
+}
+
+/// Holds the state that GCSVParser::parseStream accumulates about each column
+class GCSVStreamColumn
+{
+public:
+	string m_name;
+	string m_header;
+	const char* m_szFormat;
+	bool m_specifiedReal;
+	bool m_real;
+	string m_firstNonNumericalValue;
+	size_t m_errs;
+	string m_firstErr;
+	std::set<double> m_unique;
+	vector<string> m_values;
+	std::map<string, size_t> m_dict;
+
+	GCSVStreamColumn() : m_szFormat(NULL), m_specifiedReal(false), m_real(true), m_errs(0) {}
+
+	size_t findValue(const char* el)
+	{
+		std::map<string, size_t>::iterator it = m_dict.find(el);
+		if(it == m_dict.end())
+			return INVALID_INDEX;
+		return it->second;
+	}
+
+	void addValue(const char* el)
+	{
+		m_dict.insert(std::pair<string,size_t>(el, m_values.size()));
+		m_values.push_back(el);
+	}
+};
+
+class GCSVStreamer
+{
+public:
+	GCSVParser& m_parser;
+	GCSVRowHandler& m_handler;
+	vector<GCSVStreamColumn> m_cols;
+	GVec m_row;
+
+	GCSVStreamer(GCSVParser& parser, GCSVRowHandler& handler)
+	: m_parser(parser), m_handler(handler)
+	{
+	}
+
+	void init(vector<ImportRow>& rows, size_t columnCount)
+	{
+		m_cols.resize(columnCount);
+		if(m_parser.m_columnNamesInFirstRow)
+		{
+			while(rows[0].m_elements.size() < columnCount)
+				rows[0].m_elements.push_back("attr");
+		}
+		for(size_t attr = 0; attr < columnCount; attr++)
+		{
+			GCSVStreamColumn& col = m_cols[attr];
+			col.m_name = m_parser.makeAttrName(attr, rows);
+			if(m_parser.m_columnNamesInFirstRow)
+				col.m_header = rows[0].m_elements[attr];
+			std::map<size_t, string>::iterator itFormat = m_parser.m_formats.find(attr);
+			if(itFormat != m_parser.m_formats.end())
+				col.m_szFormat = itFormat->second.c_str();
+			if(m_parser.m_specifiedReal.find(attr) != m_parser.m_specifiedReal.end())
+				col.m_specifiedReal = true;
+			else if(m_parser.m_specifiedNominal.find(attr) != m_parser.m_specifiedNominal.end())
+				col.m_real = false;
+		}
+	}
+
+	static void firstPass(void* pThis, vector<ImportRow>& rows, size_t firstRow, size_t columnCount)
+	{
+		GCSVStreamer* pStreamer = (GCSVStreamer*)pThis;
+		size_t start = 0;
+		if(firstRow == 0)
+		{
+			pStreamer->init(rows, columnCount == INVALID_INDEX ? 0 : columnCount);
+			if(pStreamer->m_parser.m_columnNamesInFirstRow)
+				start = 1;
+		}
+		for(size_t i = start; i < rows.size(); i++)
+		{
+			for(size_t attr = 0; attr < pStreamer->m_cols.size(); attr++)
+				pStreamer->examine(pStreamer->m_cols[attr], rows[i].m_elements[attr]);
+		}
+	}
+
+	void examine(GCSVStreamColumn& col, const char* el)
+	{
+		if(col.m_szFormat)
+		{
+			time_t t;
+			if(*el != '\0' && !GTime::fromString(&t, el, col.m_szFormat))
 			{
-				const char* el = rows[rowNum].m_elements[attr];
-				double val;
-				if(el[0] == '\0')
-					val = UNKNOWN_REAL_VALUE;
-				else if(strcmp(el, "?") == 0)
-					val = UNKNOWN_REAL_VALUE;
-				else if(!GBits::isValidFloat(el, strlen(el)))
-				{
-					val = UNKNOWN_REAL_VALUE;
-					if(firstRealError.length() < 1)
-						firstRealError = el;
-					realErrs++;
-				}
-				else
-					val = atof(el);
-				outMatrix[i][attr] = val;
-				i++;
+				if(col.m_errs == 0)
+					col.m_firstErr = el;
+				col.m_errs++;
 			}
+			return;
+		}
+		bool unknown = (el[0] == '\0' || strcmp(el, "?") == 0);
+		bool isFloat = !unknown && GBits::isValidFloat(el, strlen(el));
+		if(col.m_real && !col.m_specifiedReal && !unknown && !isFloat)
+		{
+			col.m_firstNonNumericalValue = el;
+			col.m_real = false;
+		}
+		if(col.m_specifiedReal && !unknown && !isFloat)
+		{
+			if(col.m_errs == 0)
+				col.m_firstErr = el;
+			col.m_errs++;
+		}
+		if(col.m_unique.size() < m_parser.m_clearlyNumericalThreshold)
+			col.m_unique.insert(isFloat ? GMatrix_parseReal(el) : UNKNOWN_REAL_VALUE);
 
-			// Report this column
-			if(m_columnNamesInFirstRow)
+		// The column may turn out to be nominal, so the dictionary is kept until it would overflow
+		if(!col.m_specifiedReal && !unknown && col.m_values.size() <= m_parser.m_maxVals)
+		{
+			if(col.findValue(el) == INVALID_INDEX)
+				col.addValue(el);
+		}
+	}
+
+	void makeRelation(GArffRelation& relation)
+	{
+		m_parser.m_report.resize(m_cols.size());
+		for(size_t attr = 0; attr < m_cols.size(); attr++)
+		{
+			GCSVStreamColumn& col = m_cols[attr];
+			string& report = m_parser.m_report[attr];
+			report = "";
+			if(m_parser.m_columnNamesInFirstRow)
 			{
-				m_report[attr] = rows[0].m_elements[attr];
-				m_report[attr] += ": ";
+				report = col.m_header;
+				report += ": ";
 			}
-			else
-				m_report[attr] = "";
-			size_t uniqueVals = outMatrix.countUniqueValues(attr, m_clearlyNumericalThreshold);
-			if(itSpecifiedReal != m_specifiedReal.end())
+			if(col.m_szFormat)
 			{
-				m_report[attr] += "Constrained to be real. ";
-				m_report[attr] += to_str(realErrs);
-				m_report[attr] += " errors";
-				if(realErrs > 0)
+				report += "Formatted. ";
+				report += to_str(col.m_errs);
+				report += " errors";
+				if(col.m_errs > 0)
 				{
-					m_report[attr] += ", such as \"";
-					m_report[attr] += firstRealError;
-					m_report[attr] += "\"";
+					report += ", such as \"";
+					report += col.m_firstErr;
+					report += "\".";
 				}
-				m_report[attr] += ".";
+				relation.addAttribute(col.m_name.c_str(), 0, NULL);
 			}
-			else if(uniqueVals < m_clearlyNumericalThreshold)
+			else if(col.m_real)
 			{
-				m_report[attr] += "Ambiguous type. All values in this column are numerical, but there are only ";
-				m_report[attr] += to_str(uniqueVals);
-				m_report[attr] += " unique values. Assuming a numerical attribute was intended.";
-			}
-			else
-				m_report[attr] += "Clearly numerical.";
-		}
-		else
-		{
-			// Make the data
-			vector<const char*> values;
-			GConstStringHashTable ht(31, true);
-			void* pVal;
-			uintptr_t n;
-			size_t i = 0;
-			size_t valueCount = 0;
-			for(size_t rowNum = m_columnNamesInFirstRow ? 1 : 0; rowNum < rows.size(); rowNum++)
-			{
-				const char* el = rows[rowNum].m_elements[attr];
-				if(el[0] == '\0')
-					outMatrix[i][attr] = UNKNOWN_DISCRETE_VALUE;
-				else if(strcmp(el, "?") == 0)
-					outMatrix[i][attr] = UNKNOWN_DISCRETE_VALUE;
-				else
+				if(col.m_specifiedReal)
 				{
-					if(valueCount <= m_maxVals)
+					report += "Constrained to be real. ";
+					report += to_str(col.m_errs);
+					report += " errors";
+					if(col.m_errs > 0)
 					{
-						if(ht.get(el, &pVal))
-							n = (uintptr_t)pVal;
-						else
-						{
-							values.push_back(el);
-							n = valueCount++;
-							ht.add(el, (const void*)n);
-						}
-						outMatrix[i][attr] = (double)n;
+						report += ", such as \"";
+						report += col.m_firstErr;
+						report += "\"";
 					}
-					else
-						outMatrix[i][attr] = UNKNOWN_DISCRETE_VALUE;
+					report += ".";
 				}
-				i++;
-			}
-
-			// Make the attribute
-			if(m_columnNamesInFirstRow)
-			{
-				m_report[attr] = rows[0].m_elements[attr];
-				m_report[attr] += ": ";
-			}
-			else
-				m_report[attr] = "";
-			if(valueCount <= m_maxVals)
-				m_report[attr] += "Clearly categorical.";
-			else
-			{
-				m_report[attr] += "Problematic column!!! Contains non-numerical values, such as \"";
-				m_report[attr] += firstNonNumericalValue;
-				m_report[attr] += "\", but contains more than ";
-				m_report[attr] += to_str(m_maxVals);
-				m_report[attr] += " unique values. Parsing of this column was aborted!!!";
-			}
-			if(m_columnNamesInFirstRow)
-			{
-				bool quot = false;
-				if(rows[0].m_elements[attr][0] != '"' && rows[0].m_elements[attr][0] != '\'')
-					quot = true;
-				string attrName = "";
-				if(quot)
-					attrName += "\"";
-				attrName += rows[0].m_elements[attr];
-				if(quot)
-					attrName += "\"";
-				if(valueCount > m_maxVals)
+				else if(col.m_unique.size() < m_parser.m_clearlyNumericalThreshold)
 				{
-					attrName += "_aborted_due_to_too_many_vals";
-					pRelation->addAttribute(attrName.c_str(), valueCount, &values);
+					report += "Ambiguous type. All values in this column are numerical, but there are only ";
+					report += to_str(col.m_unique.size());
+					report += " unique values. Assuming a numerical attribute was intended.";
 				}
 				else
-					pRelation->addAttribute(attrName.c_str(), valueCount, &values);
+					report += "Clearly numerical.";
+				relation.addAttribute(col.m_name.c_str(), 0, NULL);
 			}
 			else
 			{
-				string attrName = "attr";
-				attrName += to_str(attr);
-				if(valueCount > m_maxVals)
+				string attrName = col.m_name;
+				if(col.m_values.size() <= m_parser.m_maxVals)
+					report += "Clearly categorical.";
+				else
+				{
+					report += "Problematic column!!! Contains non-numerical values, such as \"";
+					report += col.m_firstNonNumericalValue;
+					report += "\", but contains more than ";
+					report += to_str(m_parser.m_maxVals);
+					report += " unique values. Parsing of this column was aborted!!!";
 					attrName += "_aborted_due_to_too_many_vals";
-				pRelation->addAttribute(attrName.c_str(), valueCount, &values);
+				}
+				vector<const char*> values;
+				for(size_t i = 0; i < col.m_values.size(); i++)
+					values.push_back(col.m_values[i].c_str());
+				relation.addAttribute(attrName.c_str(), values.size(), &values);
 			}
 		}
 	}
+
+	static void secondPass(void* pThis, vector<ImportRow>& rows, size_t firstRow, size_t columnCount)
+	{
+		GCSVStreamer* pStreamer = (GCSVStreamer*)pThis;
+		size_t start = 0;
+		if(firstRow == 0 && pStreamer->m_parser.m_columnNamesInFirstRow)
+			start = 1;
+		GVec& r = pStreamer->m_row;
+		r.resize(pStreamer->m_cols.size());
+		for(size_t i = start; i < rows.size(); i++)
+		{
+			for(size_t attr = 0; attr < pStreamer->m_cols.size(); attr++)
+				r[attr] = pStreamer->convert(pStreamer->m_cols[attr], rows[i].m_elements[attr]);
+			pStreamer->m_handler.onRow(r);
+		}
+	}
+
+	double convert(GCSVStreamColumn& col, const char* el)
+	{
+		if(col.m_szFormat)
+		{
+			time_t t;
+			if(*el != '\0' && GTime::fromString(&t, el, col.m_szFormat))
+				return (double)t;
+			return UNKNOWN_REAL_VALUE;
+		}
+		bool unknown = (el[0] == '\0' || strcmp(el, "?") == 0);
+		if(col.m_real)
+		{
+			if(unknown || !GBits::isValidFloat(el, strlen(el)))
+				return UNKNOWN_REAL_VALUE;
+			return GMatrix_parseReal(el);
+		}
+		if(unknown)
+			return UNKNOWN_DISCRETE_VALUE;
+		size_t n = col.findValue(el);
+		if(n == INVALID_INDEX)
+			return UNKNOWN_DISCRETE_VALUE;
+		return (double)n;
+	}
+};
+
+void GCSVParser::parseStream(const char* szFilename, GCSVRowHandler& handler)
+{
+	GCSVStreamer streamer(*this, handler);
+	streamBlocks(szFilename, GCSVStreamer::firstPass, &streamer);
+	GArffRelation relation;
+	streamer.makeRelation(relation);
+	handler.onRelation(relation);
+	streamBlocks(szFilename, GCSVStreamer::secondPass, &streamer);
 }
 
 
@@ -5288,6 +6076,7 @@ void GCSVParser::parse(GMatrix& outMatrix, const char* pFile, size_t len)
 
 
 
+
 GDataRowSplitter::GDataRowSplitter(const GMatrix& features, const GMatrix& labels, GRand& rand, size_t part1Rows)
 : m_f1(features.relation().cloneMinimal()),
 m_f2(features.relation().cloneMinimal()),
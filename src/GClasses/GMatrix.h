@@ -45,6 +45,8 @@ class GRand;
 class GDom;
 class GDomNode;
 class GArffTokenizer;
+class GHeap;
+class ImportRow;
 class GDistanceMetric;
 class GSimpleAssignment;
 class GDistanceMetric;
@@ -627,7 +629,9 @@ public:
 	void loadRaw(const char* szFilename);
 
 	/// \brief Parses an ARFF file and replaces the contents of this matrix with it.
-	void parseArff(const char* szFile, size_t nLen);
+	/// If threads is greater than 1, the @DATA section is divided into newline-aligned
+	/// chunks, which are parsed concurrently by that many threads.
+	void parseArff(const char* szFile, size_t nLen, size_t threads = 1);
 
 	/// \brief Parses an ARFF file and replaces the contents of this matrix with it.
 	void parseArff(GArffTokenizer& tok);
@@ -1220,17 +1224,39 @@ protected:
 
 
 
+/// An abstract class for receiving the rows that GCSVParser::parseStream produces.
+class GCSVRowHandler
+{
+public:
+	GCSVRowHandler() {}
+	virtual ~GCSVRowHandler() {}
+
+	/// This is called once, before any rows are delivered, with the meta-data that
+	/// was determined for the columns.
+	virtual void onRelation(const GArffRelation& relation) = 0;
+
+	/// This is called once for each row of data, in the order the rows occur in the file.
+	/// The row is only valid for the duration of this call.
+	virtual void onRow(const GVec& row) = 0;
+};
+
+
 /// A class for parsing CSV files (or tab-separated files, or whitespace separated files, etc.).
 /// (This class does not support Mac line endings, so you should replace all '\r' with '\n' before using this class if your
 /// data comes from a Mac.)
 class GCSVParser
 {
+friend class GCSVTokenizeWorker;
+friend class GCSVColumnWorker;
+friend class GCSVStreamer;
 protected:
 	char m_separator;
 	bool m_columnNamesInFirstRow;
 	bool m_tolerant;
 	size_t m_clearlyNumericalThreshold;
 	size_t m_maxVals;
+	size_t m_threads;
+	size_t m_streamBlockSize;
 	std::vector<std::string> m_report;
 	std::map<size_t, std::string> m_formats;
 	std::map<size_t, size_t> m_specifiedReal;
@@ -1266,14 +1292,49 @@ public:
 	/// Indiciate that the specified attribute should be treated as real.
 	void setRealAttr(size_t attr);
 
+	/// Specify the number of threads to use for parsing. (The default is 1.) When more than one
+	/// thread is used, the text is divided into newline-aligned chunks that are tokenized
+	/// concurrently, and then the columns are converted concurrently. The results are identical
+	/// to those obtained with a single thread.
+	void setThreadCount(size_t n) { m_threads = std::max((size_t)1, n); }
+
+	/// Specify the number of bytes that parseStream reads from the file at a time. (The default is 4MB.)
+	void setStreamBlockSize(size_t n) { m_streamBlockSize = std::max((size_t)1, n); }
+
 	/// Load the specified file, and parse it.
 	void parse(GMatrix& outMatrix, const char* szFilename);
 
 	/// Parse the given string.
 	void parse(GMatrix& outMatrix, const char* pString, size_t len);
 
+	/// Parse the specified file without ever holding more than one block of its text in memory.
+	/// The file is read twice. The first pass determines the meta-data for each column (including
+	/// the dictionary of values for each nominal column), and the second pass converts each row
+	/// and passes it to pHandler. This is intended for files that are too big to parse with "parse".
+	void parseStream(const char* szFilename, GCSVRowHandler& handler);
+
 	/// Return a string that reports the status of the specified column. (This should only be called after parsing.)
 	std::string& report(size_t column) { return m_report[column]; }
+
+protected:
+	/// Extracts the elements of the lines in pFile from nPos up to end. columnCount is determined
+	/// from the first data row if it is INVALID_INDEX. If stopAfterCounting is true, returns as
+	/// soon as the row that determined columnCount has been extracted. Returns the position where it stopped.
+	size_t tokenize(const char* pFile, size_t nPos, size_t end, size_t& nLine, size_t& columnCount, size_t& nFirstDataLine, std::vector<ImportRow>& rows, GHeap& heap, bool stopAfterCounting);
+
+	/// Extracts the elements of all the lines in pFile, using m_threads threads.
+	void tokenizeAll(const char* pFile, size_t len, size_t& columnCount, std::vector<ImportRow>& rows, std::vector<GHeap*>& heaps);
+
+	/// Determines the type of the specified attribute and converts its values into the corresponding column of outMatrix.
+	/// Stores the attribute name in attrName, and the nominal values (if any) in values.
+	/// Returns the number of values in the attribute (0 if it is continuous).
+	size_t parseColumn(size_t attr, std::vector<ImportRow>& rows, GMatrix& outMatrix, std::string& attrName, std::vector<const char*>& values);
+
+	/// Returns the name of the specified attribute as it should appear in the relation
+	std::string makeAttrName(size_t attr, std::vector<ImportRow>& rows);
+
+	/// Calls pFunc with each block of complete lines in the specified file
+	void streamBlocks(const char* szFilename, void (*pFunc)(void* pThis, std::vector<ImportRow>& rows, size_t firstRow, size_t columnCount), void* pThis);
 };
 
 
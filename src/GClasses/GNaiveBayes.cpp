@@ -275,6 +275,16 @@ GDomNode* GNaiveBayes::serialize(GDom* pDoc) const
 	return pNode;
 }
 
+#ifndef MIN_PREDICT
+// virtual
+GSupervisedLearner* GNaiveBayes::clone()
+{
+	GNaiveBayes* pClone = new GNaiveBayes();
+	pClone->m_equivalentSampleSize = m_equivalentSampleSize;
+	return pClone;
+}
+#endif // MIN_PREDICT
+
 // virtual
 void GNaiveBayes::clear()
 {
@@ -51,6 +51,11 @@ public:
 	/// Marshal this object into a DOM, which can then be converted to a variety of serial formats.
 	virtual GDomNode* serialize(GDom* pDoc) const;
 
+#ifndef MIN_PREDICT
+	/// Returns a new untrained naive Bayes model with the same settings as this one.
+	virtual GSupervisedLearner* clone();
+#endif // MIN_PREDICT
+
 	/// See the comment for GIncrementalLearner::trainSparse
 	/// This method assumes that the values in pData are all binary values (0 or 1).
 	virtual void trainSparse(GSparseMatrix& features, GMatrix& labels);
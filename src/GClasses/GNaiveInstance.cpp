@@ -139,6 +139,16 @@ GDomNode* GNaiveInstance::serialize(GDom* pDoc) const
 	return pNode;
 }
 
+#ifndef MIN_PREDICT
+// virtual
+GSupervisedLearner* GNaiveInstance::clone()
+{
+	GNaiveInstance* pClone = new GNaiveInstance();
+	pClone->m_nNeighbors = m_nNeighbors;
+	return pClone;
+}
+#endif // MIN_PREDICT
+
 void GNaiveInstance::autoTune(GMatrix& features, GMatrix& labels)
 {
 	// Find the best ess value
@@ -67,6 +67,11 @@ public:
 	/// Marshal this object into a DOM, which can then be converted to a variety of serial formats.
 	virtual GDomNode* serialize(GDom* pDoc) const;
 
+#ifndef MIN_PREDICT
+	/// Returns a new untrained naive instance model with the same settings as this one.
+	virtual GSupervisedLearner* clone();
+#endif // MIN_PREDICT
+
 	/// Specify the number of neighbors to use.
 	void setNeighbors(size_t k) { m_nNeighbors = k; }
 
@@ -41,7 +41,9 @@
 #include "GHolders.h"
 #include "GBits.h"
 #include "GFourier.h"
+#include "GProfiler.h"
 #include <memory>
+#include <sstream>
 
 using std::vector;
 
@@ -106,6 +108,24 @@ GDomNode* GNeuralNet::serialize(GDom* pDoc) const
 
 	return pNode;
 }
+
+// virtual
+GSupervisedLearner* GNeuralNet::clone()
+{
+	GNeuralNet* pClone = new GNeuralNet();
+	std::unique_ptr<GNeuralNet> hClone(pClone);
+	for(size_t i = 0; i < m_layers.size(); i++)
+	{
+		GDom doc;
+		pClone->m_layers.push_back(GNeuralNetLayer::deserialize(m_layers[i]->serialize(&doc)));
+	}
+	pClone->m_learningRate = m_learningRate;
+	pClone->m_momentum = m_momentum;
+	pClone->m_validationPortion = m_validationPortion;
+	pClone->m_minImprovement = m_minImprovement;
+	pClone->m_epochsPerValidationCheck = m_epochsPerValidationCheck;
+	return hClone.release();
+}
 #endif // MIN_PREDICT
 
 // virtual
@@ -297,6 +317,44 @@ GNeuralNetLayer* GNeuralNet::releaseLayer(size_t index)
 	return pLayer;
 }
 
+size_t GNeuralNet::quantize(const GMatrix& calibration)
+{
+	if(m_layers.size() == 0)
+		throw Ex("No layers have been added to this neural network");
+	if(calibration.rows() == 0)
+		throw Ex("Expected at least one row of calibration data");
+	if(calibration.cols() != m_layers[0]->inputs())
+		throw Ex("Expected ", to_str(m_layers[0]->inputs()), " columns of calibration data. Got ", to_str(calibration.cols()));
+
+	// Find the largest magnitude of the values fed into each layer
+	GVec range(m_layers.size());
+	range.fill(0.0);
+	for(size_t i = 0; i < calibration.rows(); i++)
+	{
+		const GVec& row = calibration[i];
+		forwardProp(row);
+		for(size_t j = 0; j < m_layers.size(); j++)
+		{
+			const GVec& in = (j == 0 ? row : m_layers[j - 1]->activation());
+			for(size_t k = 0; k < in.size(); k++)
+				range[j] = std::max(range[j], std::abs(in[k]));
+		}
+	}
+
+	// Replace the layers
+	size_t count = 0;
+	for(size_t i = 0; i < m_layers.size(); i++)
+	{
+		if(!GLayerQuantized::canQuantize(m_layers[i]))
+			continue;
+		GLayerQuantized* pQuantized = new GLayerQuantized(m_layers[i], range[i]);
+		delete(m_layers[i]);
+		m_layers[i] = pQuantized;
+		count++;
+	}
+	return count;
+}
+
 #ifndef MIN_PREDICT
 void GNeuralNet::align(const GNeuralNet& that)
 {
@@ -424,6 +482,7 @@ void GNeuralNet::contractWeights(double factor, bool contractBiases)
 
 void GNeuralNet::forwardProp(const GVec& row, size_t maxLayers)
 {
+	GPROFILE_SCOPE("GNeuralNet::forwardProp");
 	GNeuralNetLayer* pLay = m_layers[0];
 	if(!pLay)
 		throw Ex("No layers have been added to this neural network");
@@ -534,6 +593,7 @@ void GNeuralNet::trainSparse(GSparseMatrix& features, GMatrix& labels)
 
 double GNeuralNet::validationSquaredError(const GMatrix& features, const GMatrix& labels)
 {
+	GPROFILE_SCOPE("GNeuralNet::validationSquaredError");
 	double sse = 0;
 	size_t nCount = features.rows();
 	for(size_t n = 0; n < nCount; n++)
@@ -560,6 +620,7 @@ size_t GNeuralNet::trainWithValidation(const GMatrix& trainFeatures, const GMatr
 	GRandomIndexIterator ii(trainFeatures.rows(), m_rand);
 	for(nEpochs = 0; true; nEpochs++)
 	{
+		GPROFILE_SCOPE("GNeuralNet::trainWithValidation epoch");
 		ii.reset();
 		size_t index;
 		while(ii.next(index))
@@ -697,6 +758,7 @@ void GNeuralNet::backpropagateErrorAlreadySet()
 
 void GNeuralNet::backpropagate(const GVec& target, size_t startLayer)
 {
+	GPROFILE_SCOPE("GNeuralNet::backpropagate");
 	size_t i = std::min(startLayer, m_layers.size() - 1);
 	GNeuralNetLayer* pLay = m_layers[i];
 	pLay->computeError(target);
@@ -783,6 +845,7 @@ void GNeuralNet::backpropagateSingleOutput(size_t outputNode, double target, siz
 
 void GNeuralNet::descendGradient(const GVec& feat, double learning_rate, double momentumTerm)
 {
+	GPROFILE_SCOPE("GNeuralNet::descendGradient");
 	GNeuralNetLayer* pLay = m_layers[0];
 	pLay->updateDeltas(feat, momentumTerm);
 	pLay->applyDeltas(learning_rate);
@@ -821,6 +884,7 @@ void GNeuralNet::descendGradientSingleOutput(size_t outputNeuron, const GVec& fe
 
 void GNeuralNet::updateDeltas(const GVec& feat, double momentumTerm)
 {
+	GPROFILE_SCOPE("GNeuralNet::updateDeltas");
 	GNeuralNetLayer* pLay = m_layers[0];
 	pLay->updateDeltas(feat, momentumTerm);
 	GNeuralNetLayer* pUpStream = pLay;
@@ -834,6 +898,7 @@ void GNeuralNet::updateDeltas(const GVec& feat, double momentumTerm)
 
 void GNeuralNet::applyDeltas(double learning_rate)
 {
+	GPROFILE_SCOPE("GNeuralNet::applyDeltas");
 	for(size_t i = 0; i < m_layers.size(); i++)
 		m_layers[i]->applyDeltas(learning_rate);
 }
@@ -876,6 +941,7 @@ void GNeuralNet::autoTune(GMatrix& features, GMatrix& labels)
 	hCand0->addLayer(new GLayerClassic(FLEXIBLE_SIZE, FLEXIBLE_SIZE));
 	std::unique_ptr<GNeuralNet> hCand1;
 	double scores[2];
+	hCand0->setValidationThreads(m_validationThreads);
 	scores[0] = hCand0.get()->crossValidate(features, labels, 2);
 	scores[1] = 1e308;
 
@@ -886,6 +952,7 @@ void GNeuralNet::autoTune(GMatrix& features, GMatrix& labels)
 		GNeuralNet* cand = new GNeuralNet();
 		cand->addLayer(new GLayerClassic(FLEXIBLE_SIZE, hidden));
 		cand->addLayer(new GLayerClassic(hidden, FLEXIBLE_SIZE));
+		cand->setValidationThreads(m_validationThreads);
 		double d = cand->crossValidate(features, labels, 2);
 		if(d < scores[0])
 		{
@@ -921,6 +988,7 @@ void GNeuralNet::autoTune(GMatrix& features, GMatrix& labels)
 		GNeuralNet* cand = new GNeuralNet();
 		cand->addLayer(new GLayerClassic(FLEXIBLE_SIZE, c));
 		cand->addLayer(new GLayerClassic(c, FLEXIBLE_SIZE));
+		cand->setValidationThreads(m_validationThreads);
 		double d = cand->crossValidate(features, labels, 2);
 		if(d < scores[0])
 		{
@@ -971,6 +1039,7 @@ void GNeuralNet::autoTune(GMatrix& features, GMatrix& labels)
 		cand->addLayer(new GLayerClassic(FLEXIBLE_SIZE, c1));
 		cand->addLayer(new GLayerClassic(c1, c2));
 		cand->addLayer(new GLayerClassic(c2, FLEXIBLE_SIZE));
+		cand->setValidationThreads(m_validationThreads);
 		double d = cand->crossValidate(features, labels, 2);
 		if(d < scores[0])
 		{
@@ -991,6 +1060,7 @@ void GNeuralNet::autoTune(GMatrix& features, GMatrix& labels)
 		if(hu2 > 0) cand->addLayer(new GLayerClassic(hu1, hu2));
 		cand->addLayer(new GLayerClassic(FLEXIBLE_SIZE, FLEXIBLE_SIZE));
 		cand->setMomentum(0.8);
+		cand->setValidationThreads(m_validationThreads);
 		double d = cand->crossValidate(features, labels, 2);
 		if(d < scores[0])
 		{
@@ -1762,6 +1832,101 @@ void GNeuralNet_testFourier()
 	}
 }
 
+void GNeuralNet_testQuantization(GRand& prng)
+{
+	// Build a network and a sample of its inputs
+	GNeuralNet nn;
+	nn.addLayer(new GLayerClassic(FLEXIBLE_SIZE, 24));
+	nn.addLayer(new GLayerClassic(24, 12));
+	nn.addLayer(new GLayerSoftMax(12, FLEXIBLE_SIZE));
+	GUniformRelation relIn(20);
+	GUniformRelation relOut(4);
+	nn.beginIncrementalLearning(relIn, relOut);
+	nn.perturbAllWeights(0.3);
+	GMatrix feat(100, 20);
+	for(size_t i = 0; i < feat.rows(); i++)
+		feat[i].fillNormal(prng);
+	GMatrix before(feat.rows(), 4);
+	for(size_t i = 0; i < feat.rows(); i++)
+		nn.predict(feat[i], before[i]);
+	std::ostringstream osBefore;
+	GDom docBefore;
+	docBefore.setRoot(nn.serialize(&docBefore));
+	docBefore.writeJson(osBefore);
+
+	// Quantize it, and check that the predictions are close
+	if(nn.quantize(feat) != 3)
+		throw Ex("Expected 3 layers to be quantized");
+	if(strcmp(nn.layer(2).type(), "quantized") != 0 || strcmp(((GLayerQuantized*)&nn.layer(2))->sourceType(), "softmax") != 0)
+		throw Ex("wrong layer type");
+	GVec after(4);
+	for(size_t i = 0; i < feat.rows(); i++)
+	{
+		nn.predict(feat[i], after);
+		for(size_t j = 0; j < 4; j++)
+		{
+			if(std::abs(after[j] - before[i][j]) > 0.01)
+				throw Ex("The quantized network strays too far from the original");
+		}
+	}
+
+	// Round-trip it, and check that it is much smaller
+	GDom doc;
+	doc.setRoot(nn.serialize(&doc));
+	std::ostringstream os;
+	doc.writeJson(os);
+	if(os.str().size() * 4 > osBefore.str().size())
+		throw Ex("The quantized model is not small enough");
+	GNeuralNet nn2(doc.root());
+	GVec after2(4);
+	for(size_t i = 0; i < feat.rows(); i++)
+	{
+		nn.predict(feat[i], after);
+		nn2.predict(feat[i], after2);
+		if(after.squaredDistance(after2) != 0.0)
+			throw Ex("The deserialized network differs");
+	}
+
+	// Check a convolutional layer, with a kernel size that is not a multiple of 16
+	GLayerConvolutional2D conv(9, 7, 3, 3, 2);
+	conv.resetWeights(prng);
+	GLayerQuantized convQ(&conv, 1.0);
+	GDom docConv;
+	docConv.setRoot(convQ.serialize(&docConv));
+	GNeuralNetLayer* pConvQ2 = GNeuralNetLayer::deserialize((GDomNode*)docConv.root());
+	std::unique_ptr<GNeuralNetLayer> hConvQ2(pConvQ2);
+	GVec in(conv.inputs());
+	for(size_t i = 0; i < 20; i++)
+	{
+		in.fillUniform(prng, -1.0, 1.0);
+		conv.feedForward(in);
+		convQ.feedForward(in);
+		pConvQ2->feedForward(in);
+		if(conv.activation().size() != convQ.activation().size())
+			throw Ex("wrong size");
+		for(size_t j = 0; j < conv.activation().size(); j++)
+		{
+			if(std::abs(conv.activation()[j] - convQ.activation()[j]) > 0.01)
+				throw Ex("The quantized convolutional layer strays too far from the original");
+		}
+		if(convQ.activation().squaredDistance(pConvQ2->activation()) != 0.0)
+			throw Ex("The deserialized layer differs");
+	}
+
+	// Check the integer dot product
+	signed char a[48];
+	signed char b[48];
+	int expected = 0;
+	for(size_t i = 0; i < 48; i++)
+	{
+		a[i] = (signed char)((int)prng.next(255) - 127);
+		b[i] = (signed char)((int)prng.next(255) - 127);
+		expected += (int)a[i] * (int)b[i];
+	}
+	if(GLayerQuantized::dotProduct(a, b, 48) != expected)
+		throw Ex("dotProduct failed");
+}
+
 // static
 void GNeuralNet::test()
 {
@@ -1776,6 +1941,7 @@ void GNeuralNet::test()
 	GNeuralNet_testCompressFeatures(prng);
 	GNeuralNet_testConvolutionalLayerMath();
 	GNeuralNet_testFourier();
+	GNeuralNet_testQuantization(prng);
 
 	// Test with no hidden layers (logistic regression)
 	{
@@ -56,6 +56,11 @@ public:
 
 	/// Saves the model to a text file.
 	virtual GDomNode* serialize(GDom* pDoc) const;
+
+	/// Returns a new neural network with copies of this one's layers and all of its
+	/// training settings, including the ones that serialize omits. (The copy is
+	/// only intended to be trained again.)
+	virtual GSupervisedLearner* clone();
 #endif // MIN_PREDICT
 
 	/// Returns the number of layers in this neural network. These include the hidden
@@ -84,6 +89,13 @@ public:
 	/// network again.)
 	GNeuralNetLayer* releaseLayer(size_t index);
 
+	/// Replaces each layer that GLayerQuantized supports with an 8-bit approximation of it, which
+	/// is much smaller and faster to evaluate, but cannot be trained. The range of the values fed
+	/// into each layer is calibrated by forward-propagating each row in calibration, which should
+	/// be a representative sample of the features this network will be asked to predict. (Inputs
+	/// outside the calibrated range are clipped.) Returns the number of layers that were quantized.
+	size_t quantize(const GMatrix& calibration);
+
 	/// Set the portion of the data that will be used for validation. If the
 	/// value is 0, then all of the data is used for both training and validation.
 	void setValidationPortion(double d) { m_validationPortion = d; }
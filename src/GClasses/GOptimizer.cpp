@@ -20,6 +20,7 @@
 #include <string.h>
 #include "GVec.h"
 #include "GRand.h"
+#include "GThread.h"
 #include <math.h>
 
 namespace GClasses {
@@ -56,15 +57,115 @@ double GOptimizerBasicTestTargetFunction::computeError(const GVec& pVector)
 
 // -------------------------------------------------------
 
+class GBatchEvaluatorWorker : public GWorkerThread
+{
+protected:
+	GTargetFunction* m_pTarget;
+	const std::vector<const GVec*>& m_candidates;
+	GVec& m_errors;
+
+public:
+	std::string m_error;
+
+	GBatchEvaluatorWorker(GMasterThread& master, GTargetFunction* pTarget, const std::vector<const GVec*>& candidates, GVec& errors)
+	: GWorkerThread(master), m_pTarget(pTarget), m_candidates(candidates), m_errors(errors)
+	{
+	}
+
+	virtual ~GBatchEvaluatorWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		try
+		{
+			m_errors[jobId] = m_pTarget->computeError(*m_candidates[jobId]);
+		}
+		catch(const std::exception& e)
+		{
+			if(m_error.length() == 0)
+				m_error = e.what();
+		}
+	}
+};
+
+GBatchEvaluator::GBatchEvaluator(GTargetFunction* pTarget, size_t threads)
+: m_pTarget(pTarget), m_threads(threads > 1 ? threads : 1)
+{
+	if(m_threads > 1 && !m_pTarget->isThreadSafe())
+	{
+		// Make a clone for each of the other threads
+		for(size_t i = 1; i < m_threads; i++)
+		{
+			GTargetFunction* pClone = m_pTarget->clone();
+			if(!pClone)
+				break;
+			m_clones.push_back(pClone);
+		}
+		m_threads = m_clones.size() + 1;
+	}
+}
+
+GBatchEvaluator::~GBatchEvaluator()
+{
+	for(size_t i = 0; i < m_clones.size(); i++)
+		delete(m_clones[i]);
+}
+
+void GBatchEvaluator::evaluate(const std::vector<const GVec*>& candidates, GVec& errors)
+{
+	errors.resize(candidates.size());
+	if(candidates.size() == 0)
+		return;
+	size_t threads = std::min(m_threads, candidates.size());
+	vector<GBatchEvaluatorWorker*> workers;
+	std::string error;
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < threads; i++)
+		{
+			GTargetFunction* pTarget = (i == 0 || m_clones.size() == 0 ? m_pTarget : m_clones[i - 1]);
+			workers.push_back(new GBatchEvaluatorWorker(master, pTarget, candidates, errors));
+			master.addWorker(workers[i]);
+		}
+		master.doJobs(candidates.size());
+		for(size_t i = 0; i < threads; i++)
+		{
+			if(workers[i]->m_error.length() > 0 && error.length() == 0)
+				error = workers[i]->m_error;
+		}
+	}
+	if(error.length() > 0)
+		throw Ex(error);
+}
+
+// -------------------------------------------------------
+
 
 GOptimizer::GOptimizer(GTargetFunction* pCritic)
-: m_pCritic(pCritic)
+: m_pCritic(pCritic), m_workerThreads(1), m_pEvaluator(NULL)
 {
 }
 
 // virtual
 GOptimizer::~GOptimizer()
 {
+	delete(m_pEvaluator);
+}
+
+void GOptimizer::setWorkerThreads(size_t n)
+{
+	m_workerThreads = (n > 1 ? n : 1);
+	delete(m_pEvaluator);
+	m_pEvaluator = NULL;
+}
+
+void GOptimizer::computeErrors(const std::vector<const GVec*>& candidates, GVec& errors)
+{
+	if(!m_pEvaluator)
+		m_pEvaluator = new GBatchEvaluator(m_pCritic, m_workerThreads);
+	m_pEvaluator->evaluate(candidates, errors);
 }
 
 double GOptimizer::searchUntil(size_t nBurnInIterations, size_t nIterations, double dImprovement)
@@ -101,6 +202,7 @@ void GOptimizer::basicTest(double minAccuracy, double warnRange)
 // -------------------------------------------------------
 
 GParallelOptimizers::GParallelOptimizers(size_t dims)
+: m_pRelation(NULL), m_workerThreads(1)
 {
 	if(dims > 0)
 		m_pRelation = new GUniformRelation(dims, 0);
@@ -120,12 +222,63 @@ void GParallelOptimizers::add(GTargetFunction* pTargetFunction, GOptimizer* pOpt
 	m_optimizers.push_back(pOptimizer);
 }
 
+class GParallelOptimizersWorker : public GWorkerThread
+{
+protected:
+	std::vector<GOptimizer*>& m_optimizers;
+	GVec& m_errors;
+
+public:
+	std::string m_error;
+
+	GParallelOptimizersWorker(GMasterThread& master, std::vector<GOptimizer*>& optimizers, GVec& errors)
+	: GWorkerThread(master), m_optimizers(optimizers), m_errors(errors)
+	{
+	}
+
+	virtual ~GParallelOptimizersWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		try
+		{
+			m_errors[jobId] = m_optimizers[jobId]->iterate();
+		}
+		catch(const std::exception& e)
+		{
+			if(m_error.length() == 0)
+				m_error = e.what();
+		}
+	}
+};
+
 double GParallelOptimizers::iterateAll()
 {
-	double err = 0;
-	for(vector<GOptimizer*>::iterator it = m_optimizers.begin(); it != m_optimizers.end(); it++)
-		err += (*it)->iterate();
-	return err;
+	if(m_optimizers.size() == 0)
+		return 0.0;
+	GVec errors(m_optimizers.size());
+	size_t threads = std::min(m_workerThreads, m_optimizers.size());
+	vector<GParallelOptimizersWorker*> workers;
+	std::string error;
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < threads; i++)
+		{
+			workers.push_back(new GParallelOptimizersWorker(master, m_optimizers, errors));
+			master.addWorker(workers[i]);
+		}
+		master.doJobs(m_optimizers.size());
+		for(size_t i = 0; i < threads; i++)
+		{
+			if(workers[i]->m_error.length() > 0 && error.length() == 0)
+				error = workers[i]->m_error;
+		}
+	}
+	if(error.length() > 0)
+		throw Ex(error);
+	return errors.sum();
 }
 
 double GParallelOptimizers::searchUntil(size_t nBurnInIterations, size_t nIterations, double dImprovement)
@@ -63,6 +63,18 @@ public:
 
 	/// Computes the error of the given vector using all patterns
 	virtual double computeError(const GVec& vector) = 0;
+
+	/// Returns true if computeError may be called on this object by several
+	/// threads at the same time. The default is false. Override this method
+	/// if computeError does not modify any state.
+	virtual bool isThreadSafe() { return false; }
+
+	/// Returns a new target function that computes the same errors as this one,
+	/// and that can be used by another thread at the same time as this one.
+	/// The caller will delete it. The default returns NULL, which means clones
+	/// are not supported. (If isThreadSafe returns false and this returns NULL,
+	/// the candidates of an optimizer will be evaluated one at a time.)
+	virtual GTargetFunction* clone() { return NULL; }
 };
 
 
@@ -73,10 +85,40 @@ public:
 	GOptimizerBasicTestTargetFunction() : GTargetFunction(3) {}
 
 	virtual double computeError(const GVec& vector);
+
+	virtual bool isThreadSafe() { return true; }
 };
 #endif // MIN_PREDICT
 
 
+/// Evaluates batches of candidate vectors with a target function on several
+/// threads. If the target function is thread-safe, all of the threads share it.
+/// Otherwise, each additional thread uses its own clone of it. If the target
+/// function is neither thread-safe nor clonable, the candidates are evaluated
+/// one at a time.
+class GBatchEvaluator
+{
+protected:
+	GTargetFunction* m_pTarget;
+	size_t m_threads;
+	std::vector<GTargetFunction*> m_clones;
+
+public:
+	/// Does not take ownership of pTarget.
+	GBatchEvaluator(GTargetFunction* pTarget, size_t threads);
+	~GBatchEvaluator();
+
+	/// Returns the number of threads that will actually be used.
+	size_t threads() { return m_threads; }
+
+	/// Computes the error of each of the candidates and puts them in errors.
+	/// Returns when all of them have been evaluated. If computeError throws
+	/// for any candidate, the first such exception is rethrown after all the
+	/// threads finish.
+	void evaluate(const std::vector<const GVec*>& candidates, GVec& errors);
+};
+
+
 /// This is the base class of all search algorithms
 /// that can jump to any vector in the search space
 /// seek the vector that minimizes error.
@@ -84,6 +126,8 @@ class GOptimizer
 {
 protected:
 	GTargetFunction* m_pCritic;
+	size_t m_workerThreads;
+	GBatchEvaluator* m_pEvaluator;
 
 public:
 	GOptimizer(GTargetFunction* pCritic);
@@ -108,11 +152,25 @@ public:
 	/// stable, then the value of nIterations should be large.
 	double searchUntil(size_t nBurnInIterations, size_t nIterations, double dImprovement);
 
+	/// Specifies the number of candidate vectors to evaluate at the same time.
+	/// (The default is 1.) Optimizers that produce several independent candidates
+	/// in each iteration evaluate them concurrently with a GBatchEvaluator.
+	/// Some optimizers also produce more candidates per iteration when this is
+	/// bigger than 1.
+	void setWorkerThreads(size_t n);
+
+	/// Returns the number of worker threads.
+	size_t workerThreads() { return m_workerThreads; }
+
 #ifndef MIN_PREDICT
 	/// This is a helper method used by the unit tests of several model learners
 	void basicTest(double minAccuracy, double warnRange = 0.001);
 #endif // MIN_PREDICT
 
+protected:
+	/// Computes the error of each of the candidates with the critic, using
+	/// workerThreads() threads, and puts them in errors.
+	void computeErrors(const std::vector<const GVec*>& candidates, GVec& errors);
 };
 
 
@@ -124,6 +182,7 @@ protected:
 	GRelation* m_pRelation;
 	std::vector<GTargetFunction*> m_targetFunctions;
 	std::vector<GOptimizer*> m_optimizers;
+	size_t m_workerThreads;
 
 public:
 	/// If the problems all have the same number of dims, and they're all continuous, you can call
@@ -144,7 +203,12 @@ public:
 	/// Returns a vector of pointers to the target functions
 	std::vector<GTargetFunction*>& targetFunctions() { return m_targetFunctions; }
 
-	/// Perform one iteration on all of the optimizers
+	/// Specifies the number of optimizers to iterate at the same time. (The
+	/// default is 1.) If this is bigger than 1, the optimizers must not share
+	/// any state, such as a random number generator or a target function.
+	void setWorkerThreads(size_t n) { m_workerThreads = (n > 1 ? n : 1); }
+
+	/// Perform one iteration on all of the optimizers, and returns the sum of their errors
 	double iterateAll();
 
 	/// Optimize until the specified conditions are met
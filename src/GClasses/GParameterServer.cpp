@@ -0,0 +1,725 @@
+/*
+  The contents of this file are dedicated by all of its authors, including
+
+    Michael S. Gashler,
+    anonymous contributors,
+
+  to the public domain (http://creativecommons.org/publicdomain/zero/1.0/).
+
+  Note that some moral obligations still exist in the absence of legal ones.
+  For example, it would still be dishonest to deliberately misrepresent the
+  origin of a work. Although we impose no legal requirements to obtain a
+  license, it is beseeming for those who build on the works of others to
+  give back useful improvements, or find a way to pay it forward. If
+  you would like to cite us, a published paper about Waffles can be found
+  at http://jmlr.org/papers/volume12/gashler11a/gashler11a.pdf. If you find
+  our code to be useful, the Waffles team would love to hear how you use it.
+*/
+
+#include "GParameterServer.h"
+#include "GNeuralNet.h"
+#include "GRecommender.h"
+#include "GFile.h"
+#include "GThread.h"
+#include "GTime.h"
+#include "GRand.h"
+#include "GString.h"
+#include "GHolders.h"
+#include <string.h>
+#include <float.h>
+#include <cmath>
+#include <memory>
+#include <string>
+
+using std::vector;
+using std::string;
+
+namespace GClasses {
+
+GNeuralNetParameterModel::GNeuralNetParameterModel(GNeuralNet& nn, const GMatrix& features, const GMatrix& labels)
+: GParameterModel(), m_nn(nn), m_features(features), m_labels(labels), m_epochsPerRound(1)
+{
+	if(features.rows() != labels.rows())
+		throw Ex("Expected the features and labels to have the same number of rows");
+	nn.beginIncrementalLearning(features.relation(), labels.relation());
+	for(size_t i = 0; i < features.rows(); i++)
+		m_indexes.push_back(i);
+}
+
+// virtual
+GNeuralNetParameterModel::~GNeuralNetParameterModel()
+{
+}
+
+// virtual
+size_t GNeuralNetParameterModel::countWeights()
+{
+	return m_nn.countWeights();
+}
+
+// virtual
+void GNeuralNetParameterModel::weights(double* pOutWeights)
+{
+	m_nn.weights(pOutWeights);
+}
+
+// virtual
+void GNeuralNetParameterModel::setWeights(const double* pWeights)
+{
+	m_nn.setWeights(pWeights);
+}
+
+// virtual
+void GNeuralNetParameterModel::trainRound(size_t round)
+{
+	for(size_t epoch = 0; epoch < m_epochsPerRound; epoch++)
+	{
+		GIndexVec::shuffle(m_indexes.data(), m_indexes.size(), &m_nn.rand());
+		for(size_t i = 0; i < m_indexes.size(); i++)
+			m_nn.trainIncremental(m_features[m_indexes[i]], m_labels[m_indexes[i]]);
+	}
+}
+
+// --------------------------------------------------------------------------
+
+GMatrixFactorizationParameterModel::GMatrixFactorizationParameterModel(GMatrixFactorization& mf, GMatrix& ratings, size_t users, size_t items)
+: GParameterModel(), m_mf(mf), m_ratings(ratings.relation().clone()), m_learningRate(0.01), m_epochsPerRound(1)
+{
+	if(ratings.cols() != 3)
+		throw Ex("Expected 3 columns (user, item, rating)");
+	for(size_t i = 0; i < ratings.rows(); i++)
+	{
+		GVec& row = ratings[i];
+		if(row[0] < 0.0 || (size_t)row[0] >= users || row[1] < 0.0 || (size_t)row[1] >= items)
+			throw Ex("Rating ", to_str(i), " refers to a user or item that is out of range");
+		m_ratings.takeRow(&row);
+	}
+	mf.initProfiles(users, items);
+}
+
+// virtual
+GMatrixFactorizationParameterModel::~GMatrixFactorizationParameterModel()
+{
+	m_ratings.releaseAllRows();
+}
+
+// virtual
+size_t GMatrixFactorizationParameterModel::countWeights()
+{
+	return (m_mf.getP()->rows() + m_mf.getQ()->rows()) * m_mf.getP()->cols();
+}
+
+// virtual
+void GMatrixFactorizationParameterModel::weights(double* pOutWeights)
+{
+	GMatrix* pMatrices[2] = { m_mf.getP(), m_mf.getQ() };
+	for(size_t m = 0; m < 2; m++)
+	{
+		GMatrix& mat = *pMatrices[m];
+		for(size_t i = 0; i < mat.rows(); i++)
+		{
+			memcpy(pOutWeights, mat[i].data(), sizeof(double) * mat.cols());
+			pOutWeights += mat.cols();
+		}
+	}
+}
+
+// virtual
+void GMatrixFactorizationParameterModel::setWeights(const double* pWeights)
+{
+	GMatrix* pMatrices[2] = { m_mf.getP(), m_mf.getQ() };
+	for(size_t m = 0; m < 2; m++)
+	{
+		GMatrix& mat = *pMatrices[m];
+		for(size_t i = 0; i < mat.rows(); i++)
+		{
+			memcpy(mat[i].data(), pWeights, sizeof(double) * mat.cols());
+			pWeights += mat.cols();
+		}
+	}
+}
+
+// virtual
+void GMatrixFactorizationParameterModel::trainRound(size_t round)
+{
+	for(size_t epoch = 0; epoch < m_epochsPerRound; epoch++)
+	{
+		m_ratings.shuffle(m_mf.rand());
+		m_mf.trainEpoch(m_ratings, m_learningRate);
+	}
+}
+
+// --------------------------------------------------------------------------
+
+#define GPS_MAGIC 0x31535047 // "GPS1"
+#define GPS_HELLO 1 // a worker introduces itself (count is the number of weights in its model)
+#define GPS_WEIGHTS 2 // the server sends the weights for a round (as compressed doubles)
+#define GPS_DELTA 3 // a worker sends the change it made in a round (as compressed floats)
+#define GPS_STOP 4 // the server sends the final weights (as compressed doubles)
+
+// Every message begins with this header, followed by the compressed values (if any)
+struct GParameterServerHeader
+{
+	uint32_t magic;
+	uint32_t type;
+	uint64_t round;
+	uint64_t count;
+};
+
+// Returns a package size that is big enough for count compressed doubles
+size_t GParameterServer_maxMessageSize(size_t count)
+{
+	size_t bytes = count * sizeof(double);
+	return sizeof(GParameterServerHeader) + GLZCompressor::maxCompressedSize(bytes) + GLZ_HEADER_SIZE * (bytes / GLZ_BLOCK_SIZE + 1);
+}
+
+// Puts a message in out
+void GParameterServer_encode(uint32_t type, uint64_t round, uint64_t count, const void* pValues, size_t bytes, vector<unsigned char>& out)
+{
+	GParameterServerHeader header;
+	header.magic = GPS_MAGIC;
+	header.type = type;
+	header.round = round;
+	header.count = count;
+	out.resize(sizeof(header));
+	memcpy(out.data(), &header, sizeof(header));
+	if(bytes > 0)
+	{
+		uint64_t compressedLen;
+		unsigned char* pCompressed = GLZCompressor::compress((const unsigned char*)pValues, bytes, &compressedLen);
+		std::unique_ptr<unsigned char[]> hCompressed(pCompressed);
+		out.insert(out.end(), pCompressed, pCompressed + compressedLen);
+	}
+}
+
+// Reads the header of a message. If bytesPerValue is non-zero, also checks that the message
+// carries exactly expectedCount values, and uncompresses them into pOutValues, which must be
+// big enough to hold bytesPerValue * expectedCount bytes. Messages that would uncompress to
+// more than maxBytes are rejected without being uncompressed.
+void GParameterServer_decode(const char* pMsg, size_t len, GParameterServerHeader& header, size_t bytesPerValue, size_t expectedCount, size_t maxBytes, void* pOutValues)
+{
+	if(len < sizeof(header))
+		throw Ex("Message too short");
+	memcpy(&header, pMsg, sizeof(header));
+	if(header.magic != GPS_MAGIC)
+		throw Ex("Not a parameter server message");
+	if(bytesPerValue == 0)
+		return;
+	if(header.count > maxBytes / bytesPerValue)
+		throw Ex("Message is too big");
+	if(header.count != expectedCount)
+		throw Ex("Expected a message with ", to_str(expectedCount), " values. Got one with ", to_str(header.count));
+	if(len == sizeof(header))
+	{
+		if(header.count != 0)
+			throw Ex("Message has the wrong size");
+		return;
+	}
+	uint64_t uncompressedLen;
+	unsigned char* pValues = GLZCompressor::uncompress((const unsigned char*)pMsg + sizeof(header), len - sizeof(header), &uncompressedLen);
+	std::unique_ptr<unsigned char[]> hValues(pValues);
+	if(uncompressedLen != bytesPerValue * expectedCount)
+		throw Ex("Message has the wrong size");
+	memcpy(pOutValues, pValues, uncompressedLen);
+}
+
+// Returns the type of a message without decoding it
+uint32_t GParameterServer_type(const char* pMsg, size_t len)
+{
+	GParameterServerHeader header;
+	if(len < sizeof(header))
+		throw Ex("Message too short");
+	memcpy(&header, pMsg, sizeof(header));
+	if(header.magic != GPS_MAGIC)
+		throw Ex("Not a parameter server message");
+	return header.type;
+}
+
+GParameterServer::GParameterServer(GParameterModel& model, unsigned short port)
+: GPackageServer(port), m_model(model), m_staleness(0), m_updates(0), m_lostWorker(false)
+{
+}
+
+// virtual
+GParameterServer::~GParameterServer()
+{
+}
+
+// virtual
+void GParameterServer::onDisconnect(GTCPConnection* pConn)
+{
+	GParameterServerConnection* pC = (GParameterServerConnection*)pConn;
+	if(pC->m_joined && !pC->m_done)
+		m_lostWorker = true;
+}
+
+size_t GParameterServer::dispatch(size_t rounds)
+{
+	// Find the slowest worker
+	size_t minRounds = INVALID_INDEX;
+	for(std::set<GPackageConnection*>::iterator it = m_socks.begin(); it != m_socks.end(); it++)
+	{
+		GParameterServerConnection* pConn = (GParameterServerConnection*)*it;
+		if(pConn->m_joined)
+			minRounds = std::min(minRounds, pConn->m_rounds);
+	}
+
+	// Decide who to send the weights to. (Workers that are done wait for the others,
+	// so they all end with the same weights.)
+	vector<GParameterServerConnection*> go;
+	vector<GParameterServerConnection*> stop;
+	for(std::set<GPackageConnection*>::iterator it = m_socks.begin(); it != m_socks.end(); it++)
+	{
+		GParameterServerConnection* pConn = (GParameterServerConnection*)*it;
+		if(!pConn->m_joined || !pConn->m_waiting)
+			continue;
+		if(pConn->m_rounds >= rounds)
+		{
+			if(minRounds >= rounds)
+				stop.push_back(pConn);
+		}
+		else if(pConn->m_rounds <= minRounds + m_staleness)
+			go.push_back(pConn);
+	}
+	if(go.size() + stop.size() == 0)
+		return 0;
+
+	// Send the weights
+	GParameterServer_encode(GPS_WEIGHTS, 0, m_weights.size(), m_weights.data(), sizeof(double) * m_weights.size(), m_buf);
+	GParameterServerHeader* pHeader = (GParameterServerHeader*)m_buf.data();
+	for(size_t i = 0; i < go.size(); i++)
+	{
+		go[i]->m_waiting = false;
+		pHeader->round = go[i]->m_rounds;
+		send((const char*)m_buf.data(), m_buf.size(), go[i]);
+	}
+	pHeader->type = GPS_STOP;
+	for(size_t i = 0; i < stop.size(); i++)
+	{
+		stop[i]->m_waiting = false;
+		stop[i]->m_done = true;
+		pHeader->round = stop[i]->m_rounds;
+		send((const char*)m_buf.data(), m_buf.size(), stop[i]);
+	}
+	return stop.size();
+}
+
+void GParameterServer::serve(size_t workers, size_t rounds, double timeoutSecs)
+{
+	if(workers < 1)
+		throw Ex("Expected at least one worker");
+	size_t n = m_model.countWeights();
+	m_weights.resize(n);
+	m_model.weights(m_weights.data());
+	size_t maxPackageSize = std::max((size_t)0x1000000, GParameterServer_maxMessageSize(n));
+	setMaxBufferSizes(8192, maxPackageSize);
+	vector<float> delta(n);
+	double scale = 1.0 / workers;
+	size_t joined = 0;
+	size_t stopped = 0;
+	m_lostWorker = false;
+	double lastMessage = GTime::seconds();
+	while(stopped < workers)
+	{
+		if(m_lostWorker)
+			throw Ex("A worker disconnected before it was done");
+		size_t len;
+		GPackageConnection* pC;
+		char* pMsg = receive(&len, &pC);
+		if(!pMsg)
+		{
+			if(GTime::seconds() - lastMessage > timeoutSecs)
+				throw Ex("Timed out waiting for the workers");
+			GThread::sleep(1);
+			continue;
+		}
+		lastMessage = GTime::seconds();
+		GParameterServerConnection* pConn = (GParameterServerConnection*)pC;
+		uint32_t type = GParameterServer_type(pMsg, len);
+		GParameterServerHeader header;
+		if(type == GPS_HELLO)
+		{
+			GParameterServer_decode(pMsg, len, header, 0, 0, 0, NULL);
+			if(pConn->m_joined)
+				throw Ex("A worker introduced itself twice");
+			if(joined >= workers)
+			{
+				disconnect(pConn); // we already have enough workers
+				continue;
+			}
+			if(header.count != n)
+				throw Ex("A worker's model has ", to_str(header.count), " weights, but the server's model has ", to_str(n));
+			pConn->m_joined = true;
+			pConn->m_waiting = true;
+			joined++;
+		}
+		else if(type == GPS_DELTA)
+		{
+			if(!pConn->m_joined || pConn->m_waiting)
+				throw Ex("A worker sent a change when it was not expected");
+			GParameterServer_decode(pMsg, len, header, sizeof(float), n, maxPackageSize, delta.data());
+			if(header.round != pConn->m_rounds)
+				throw Ex("A worker sent a change for the wrong round");
+			for(size_t i = 0; i < n; i++)
+				m_weights[i] += scale * delta[i];
+			pConn->m_rounds++;
+			pConn->m_waiting = true;
+			m_updates++;
+		}
+		else
+			throw Ex("Unexpected message type: ", to_str(type));
+		if(joined == workers)
+			stopped += dispatch(rounds);
+	}
+	m_model.setWeights(m_weights.data());
+}
+
+// --------------------------------------------------------------------------
+
+GParameterWorker::GParameterWorker(GParameterModel& model)
+: GPackageClient(), m_model(model), m_lostServer(false)
+{
+}
+
+// virtual
+GParameterWorker::~GParameterWorker()
+{
+}
+
+size_t GParameterWorker::run(const char* szAddr, unsigned short port, double timeoutSecs)
+{
+	size_t n = m_model.countWeights();
+	m_base.resize(n);
+	m_current.resize(n);
+	m_residual.resize(n);
+	m_residual.fill(0.0);
+	vector<float> delta(n);
+	size_t maxPackageSize = std::max((size_t)0x1000000, GParameterServer_maxMessageSize(n));
+	setMaxBufferSizes(8192, maxPackageSize);
+	m_lostServer = false;
+	connect(szAddr, port, std::max(1, (int)timeoutSecs));
+
+	// Introduce ourself
+	GParameterServer_encode(GPS_HELLO, 0, n, NULL, 0, m_buf);
+	send((const char*)m_buf.data(), m_buf.size());
+
+	// Train until the server says to stop
+	size_t rounds = 0;
+	double lastMessage = GTime::seconds();
+	while(true)
+	{
+		size_t len;
+		char* pMsg = receive(&len);
+		if(!pMsg)
+		{
+			if(m_lostServer)
+				throw Ex("The server disconnected");
+			if(GTime::seconds() - lastMessage > timeoutSecs)
+				throw Ex("Timed out waiting for the server");
+			GThread::sleep(1);
+			continue;
+		}
+		lastMessage = GTime::seconds();
+		uint32_t type = GParameterServer_type(pMsg, len);
+		if(type != GPS_WEIGHTS && type != GPS_STOP)
+			throw Ex("Unexpected message type: ", to_str(type));
+		GParameterServerHeader header;
+		GParameterServer_decode(pMsg, len, header, sizeof(double), n, maxPackageSize, m_base.data());
+		if(header.round != rounds)
+			throw Ex("The server sent weights for the wrong round");
+		m_model.setWeights(m_base.data());
+		if(type == GPS_STOP)
+			break;
+
+		// Train, and send back the change. (The precision that is lost by sending
+		// floats is remembered, and added to the next change.)
+		m_model.trainRound(rounds);
+		m_model.weights(m_current.data());
+		for(size_t i = 0; i < n; i++)
+		{
+			double d = m_current[i] - m_base[i] + m_residual[i];
+			d = std::max(-(double)FLT_MAX, std::min((double)FLT_MAX, d));
+			delta[i] = (float)d;
+			m_residual[i] = d - delta[i];
+		}
+		GParameterServer_encode(GPS_DELTA, rounds, n, delta.data(), sizeof(float) * n, m_buf);
+		send((const char*)m_buf.data(), m_buf.size());
+		rounds++;
+	}
+	disconnect();
+	return rounds;
+}
+
+// --------------------------------------------------------------------------
+
+#ifndef NO_TEST_CODE
+#define GPS_TEST_PORT 7256
+
+class GParameterServerTestWorker : public GWorkerThread
+{
+protected:
+	GParameterServer& m_server;
+	vector<GParameterModel*>& m_models;
+	size_t m_rounds;
+	vector<size_t>& m_completed;
+	vector<string>& m_errors;
+
+public:
+	GParameterServerTestWorker(GMasterThread& master, GParameterServer& server, vector<GParameterModel*>& models, size_t rounds, vector<size_t>& completed, vector<string>& errors)
+	: GWorkerThread(master), m_server(server), m_models(models), m_rounds(rounds), m_completed(completed), m_errors(errors)
+	{
+	}
+
+	virtual ~GParameterServerTestWorker()
+	{
+	}
+
+	// Job 0 is the server. The others are workers.
+	virtual void doJob(size_t jobId)
+	{
+		try
+		{
+			if(jobId == 0)
+				m_server.serve(m_models.size(), m_rounds, 30.0);
+			else
+			{
+				GParameterWorker worker(*m_models[jobId - 1]);
+				m_completed[jobId - 1] = worker.run("localhost", GPS_TEST_PORT, 30.0);
+			}
+		}
+		catch(const std::exception& e)
+		{
+			m_errors[jobId] = e.what();
+		}
+	}
+};
+
+// Runs a server and one worker per model, each in its own thread
+void GParameterServer_run(GParameterServer& server, vector<GParameterModel*>& models, size_t rounds)
+{
+	vector<size_t> completed(models.size(), 0);
+	vector<string> errors(models.size() + 1);
+	{
+		GMasterThread master;
+		for(size_t i = 0; i <= models.size(); i++)
+			master.addWorker(new GParameterServerTestWorker(master, server, models, rounds, completed, errors));
+		master.doJobs(models.size() + 1);
+	}
+	for(size_t i = 0; i < errors.size(); i++)
+	{
+		if(errors[i].length() > 0)
+			throw Ex(errors[i]);
+	}
+	for(size_t i = 0; i < models.size(); i++)
+	{
+		if(completed[i] != rounds)
+			throw Ex("A worker completed the wrong number of rounds");
+	}
+	if(server.updates() != rounds * models.size())
+		throw Ex("The server received the wrong number of changes");
+}
+
+double GParameterServer_nnError(GNeuralNet& nn, const GMatrix& features, const GMatrix& labels)
+{
+	double sse = 0.0;
+	GVec pred(1);
+	for(size_t i = 0; i < features.rows(); i++)
+	{
+		nn.forwardProp(features[i]);
+		nn.copyPrediction(pred);
+		double d = labels[i][0] - pred[0];
+		sse += d * d;
+	}
+	return sse / features.rows();
+}
+
+void GParameterServer_testNeuralNet(size_t staleness)
+{
+	// Make some data, and divide it into three shards
+	const size_t workers = 3;
+	GRand rand(0);
+	GMatrix features(0, 2);
+	GMatrix labels(0, 1);
+	vector<GMatrix*> shardFeatures;
+	vector<GMatrix*> shardLabels;
+	VectorOfPointersHolder<GMatrix> hShardFeatures(shardFeatures);
+	VectorOfPointersHolder<GMatrix> hShardLabels(shardLabels);
+	for(size_t i = 0; i < workers; i++)
+	{
+		shardFeatures.push_back(new GMatrix(0, 2));
+		shardLabels.push_back(new GMatrix(0, 1));
+	}
+	for(size_t i = 0; i < 300; i++)
+	{
+		GVec& f = features.newRow();
+		f[0] = rand.uniform();
+		f[1] = rand.uniform();
+		GVec& l = labels.newRow();
+		l[0] = 0.5 * f[0] - 0.3 * f[1] + 0.1;
+		shardFeatures[i % workers]->newRow().copy(f);
+		shardLabels[i % workers]->newRow().copy(l);
+	}
+
+	// Train
+	GNeuralNet serverNN;
+	serverNN.addLayer(new GLayerClassic(FLEXIBLE_SIZE, FLEXIBLE_SIZE));
+	serverNN.setLearningRate(0.05);
+	GNeuralNetParameterModel serverModel(serverNN, features, labels);
+	double before = GParameterServer_nnError(serverNN, features, labels);
+	vector<GNeuralNet*> nets;
+	VectorOfPointersHolder<GNeuralNet> hNets(nets);
+	vector<GParameterModel*> models;
+	VectorOfPointersHolder<GParameterModel> hModels(models);
+	for(size_t i = 0; i < workers; i++)
+	{
+		GNeuralNet* pNN = new GNeuralNet();
+		nets.push_back(pNN);
+		pNN->addLayer(new GLayerClassic(FLEXIBLE_SIZE, FLEXIBLE_SIZE));
+		pNN->setLearningRate(0.05);
+		pNN->rand().setSeed(i + 1);
+		models.push_back(new GNeuralNetParameterModel(*pNN, *shardFeatures[i], *shardLabels[i]));
+	}
+	GParameterServer server(serverModel, GPS_TEST_PORT);
+	server.setStaleness(staleness);
+	GParameterServer_run(server, models, 20);
+
+	// Check the results
+	double after = GParameterServer_nnError(serverNN, features, labels);
+	if(after > 0.05 * before || after > 1e-3)
+		throw Ex("Distributed training did not reduce the error enough");
+	GVec serverWeights(serverNN.countWeights());
+	serverNN.weights(serverWeights.data());
+	GVec workerWeights(serverWeights.size());
+	for(size_t i = 0; i < workers; i++)
+	{
+		nets[i]->weights(workerWeights.data());
+		if(workerWeights.squaredDistance(serverWeights) > 1e-20)
+			throw Ex("A worker did not end with the final weights");
+	}
+}
+
+void GParameterServer_testMatrixFactorization()
+{
+	// Make ratings from random rank-2 profiles, and divide them into three shards
+	const size_t workers = 3;
+	const size_t users = 30;
+	const size_t items = 20;
+	GRand rand(0);
+	GMatrix p(users, 2);
+	GMatrix q(items, 2);
+	for(size_t i = 0; i < users; i++)
+		p[i].fillNormal(rand, 0.5);
+	for(size_t i = 0; i < items; i++)
+		q[i].fillNormal(rand, 0.5);
+	GMatrix ratings(0, 3);
+	vector<GMatrix*> shards;
+	VectorOfPointersHolder<GMatrix> hShards(shards);
+	for(size_t i = 0; i < workers; i++)
+		shards.push_back(new GMatrix(0, 3));
+	for(size_t u = 0; u < users; u++)
+	{
+		for(size_t i = 0; i < items; i++)
+		{
+			if(rand.next(3) == 0)
+				continue;
+			GVec& r = ratings.newRow();
+			r[0] = (double)u;
+			r[1] = (double)i;
+			r[2] = p[u].dotProduct(q[i]);
+			shards[rand.next(workers)]->newRow().copy(r);
+		}
+	}
+
+	// Train
+	GMatrixFactorization serverMF(2);
+	GMatrixFactorizationParameterModel serverModel(serverMF, ratings, users, items);
+	vector<GMatrixFactorization*> mfs;
+	VectorOfPointersHolder<GMatrixFactorization> hMfs(mfs);
+	vector<GParameterModel*> models;
+	VectorOfPointersHolder<GParameterModel> hModels(models);
+	for(size_t i = 0; i < workers; i++)
+	{
+		GMatrixFactorization* pMF = new GMatrixFactorization(2);
+		mfs.push_back(pMF);
+		pMF->rand().setSeed(i + 1);
+		GMatrixFactorizationParameterModel* pModel = new GMatrixFactorizationParameterModel(*pMF, *shards[i], users, items);
+		pModel->setLearningRate(0.05);
+		models.push_back(pModel);
+	}
+	GParameterServer server(serverModel, GPS_TEST_PORT);
+	server.setStaleness(1);
+	GParameterServer_run(server, models, 200);
+
+	// Check the results
+	double sseBaseline = 0.0;
+	double sse = 0.0;
+	for(size_t i = 0; i < ratings.rows(); i++)
+	{
+		double target = ratings[i][2];
+		double d = target - serverMF.predict((size_t)ratings[i][0], (size_t)ratings[i][1]);
+		sse += d * d;
+		sseBaseline += target * target;
+	}
+	if(sse > 0.1 * sseBaseline)
+		throw Ex("Distributed matrix factorization did not fit the ratings well enough");
+}
+
+void GParameterServer_testMalformedMessages()
+{
+	// A message that claims more values than the receiver expects must be rejected
+	// before anything is written into the receiver's buffer.
+	vector<double> big(64, 1.0);
+	vector<unsigned char> msg;
+	GParameterServer_encode(GPS_WEIGHTS, 0, big.size(), big.data(), big.size() * sizeof(double), msg);
+	vector<double> small(8, 0.0);
+	GParameterServerHeader header;
+	bool threw = false;
+	try
+	{
+		GParameterServer_decode((const char*)msg.data(), msg.size(), header, sizeof(double), small.size(), 0x1000000, small.data());
+	}
+	catch(const std::exception&)
+	{
+		threw = true;
+	}
+	if(!threw)
+		throw Ex("Accepted a message with too many values");
+	for(size_t i = 0; i < small.size(); i++)
+	{
+		if(small[i] != 0.0)
+			throw Ex("A rejected message was written into the buffer");
+	}
+
+	// A header that claims more bytes than the biggest allowed package must be rejected
+	GParameterServerHeader* pHeader = (GParameterServerHeader*)msg.data();
+	pHeader->count = (uint64_t)1 << 60;
+	threw = false;
+	try
+	{
+		GParameterServer_decode((const char*)msg.data(), msg.size(), header, sizeof(double), (size_t)pHeader->count, 0x1000000, small.data());
+	}
+	catch(const std::exception&)
+	{
+		threw = true;
+	}
+	if(!threw)
+		throw Ex("Accepted a message that is too big");
+
+	// A well-formed message round-trips
+	vector<double> same(64, 0.0);
+	pHeader->count = big.size();
+	GParameterServer_decode((const char*)msg.data(), msg.size(), header, sizeof(double), same.size(), 0x1000000, same.data());
+	if(same != big)
+		throw Ex("wrong values");
+}
+
+void GParameterServer::test()
+{
+	GParameterServer_testMalformedMessages();
+	GParameterServer_testNeuralNet(0);
+	GParameterServer_testNeuralNet(2);
+	GParameterServer_testMatrixFactorization();
+}
+#endif // !NO_TEST_CODE
+
+} // namespace GClasses
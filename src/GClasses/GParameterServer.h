@@ -0,0 +1,239 @@
+/*
+  The contents of this file are dedicated by all of its authors, including
+
+    Michael S. Gashler,
+    anonymous contributors,
+
+  to the public domain (http://creativecommons.org/publicdomain/zero/1.0/).
+
+  Note that some moral obligations still exist in the absence of legal ones.
+  For example, it would still be dishonest to deliberately misrepresent the
+  origin of a work. Although we impose no legal requirements to obtain a
+  license, it is beseeming for those who build on the works of others to
+  give back useful improvements, or find a way to pay it forward. If
+  you would like to cite us, a published paper about Waffles can be found
+  at http://jmlr.org/papers/volume12/gashler11a/gashler11a.pdf. If you find
+  our code to be useful, the Waffles team would love to hear how you use it.
+*/
+
+#ifndef __GPARAMETERSERVER_H__
+#define __GPARAMETERSERVER_H__
+
+#include "GSocket.h"
+#include "GMatrix.h"
+#include "GVec.h"
+#include <vector>
+
+namespace GClasses {
+
+class GNeuralNet;
+class GMatrixFactorization;
+
+
+/// The interface between a model and GParameterServer or GParameterWorker. It exposes
+/// the trainable weights of the model as one flat vector, and trains the model with
+/// a local shard of the training data.
+class GParameterModel
+{
+public:
+	GParameterModel() {}
+	virtual ~GParameterModel() {}
+
+	/// Returns the number of weights in the model.
+	virtual size_t countWeights() = 0;
+
+	/// Copies the weights of the model into pOutWeights.
+	virtual void weights(double* pOutWeights) = 0;
+
+	/// Sets the weights of the model.
+	virtual void setWeights(const double* pWeights) = 0;
+
+	/// Trains the model with the local shard of data for one round.
+	/// round is the number of rounds this worker has already completed.
+	virtual void trainRound(size_t round) = 0;
+};
+
+
+/// Trains a GNeuralNet with stochastic gradient descent over a shard of the training data.
+class GNeuralNetParameterModel : public GParameterModel
+{
+protected:
+	GNeuralNet& m_nn;
+	const GMatrix& m_features;
+	const GMatrix& m_labels;
+	std::vector<size_t> m_indexes;
+	size_t m_epochsPerRound;
+
+public:
+	/// Calls beginIncrementalLearning on nn, so all of its layers should be added before
+	/// this is called. (The server's model and each worker's model must have the same
+	/// layers.) features and labels are the local shard of the training data. They
+	/// are only referenced, so they must remain valid for the life of this object.
+	GNeuralNetParameterModel(GNeuralNet& nn, const GMatrix& features, const GMatrix& labels);
+	virtual ~GNeuralNetParameterModel();
+
+	/// Specifies the number of passes over the shard in each round. (The default is 1.)
+	void setEpochsPerRound(size_t n) { m_epochsPerRound = n; }
+
+	/// Returns the number of weights in the neural network.
+	virtual size_t countWeights();
+
+	/// Copies the weights of the neural network into pOutWeights.
+	virtual void weights(double* pOutWeights);
+
+	/// Sets the weights of the neural network.
+	virtual void setWeights(const double* pWeights);
+
+	/// Presents each row of the shard (in random order) to the neural network.
+	virtual void trainRound(size_t round);
+};
+
+
+/// Trains a GMatrixFactorization with stochastic gradient descent over a shard of the ratings.
+/// The weights are the rows of P followed by the rows of Q.
+class GMatrixFactorizationParameterModel : public GParameterModel
+{
+protected:
+	GMatrixFactorization& m_mf;
+	GMatrix m_ratings;
+	double m_learningRate;
+	size_t m_epochsPerRound;
+
+public:
+	/// Calls initProfiles on mf. users and items must be the same for the server and all of the
+	/// workers, and they must be greater than every user id and item id in the ratings.
+	/// ratings is the local shard of the ratings (in the format that GCollaborativeFilter::train
+	/// expects). Its rows are only referenced, so it must remain valid for the life of this object.
+	GMatrixFactorizationParameterModel(GMatrixFactorization& mf, GMatrix& ratings, size_t users, size_t items);
+	virtual ~GMatrixFactorizationParameterModel();
+
+	/// Specifies the learning rate. (The default is 0.01.)
+	void setLearningRate(double d) { m_learningRate = d; }
+
+	/// Specifies the number of passes over the shard in each round. (The default is 1.)
+	void setEpochsPerRound(size_t n) { m_epochsPerRound = n; }
+
+	/// Returns the number of elements in P and Q.
+	virtual size_t countWeights();
+
+	/// Copies P and Q into pOutWeights.
+	virtual void weights(double* pOutWeights);
+
+	/// Sets P and Q.
+	virtual void setWeights(const double* pWeights);
+
+	/// Presents each rating of the shard (in random order) to the model.
+	virtual void trainRound(size_t round);
+};
+
+
+/// Holds the state that GParameterServer keeps for each worker.
+class GParameterServerConnection : public GPackageConnection
+{
+public:
+	bool m_joined; // true iff the worker has introduced itself
+	bool m_waiting; // true iff the worker is waiting for weights
+	bool m_done; // true iff the worker has been told to stop
+	size_t m_rounds; // the number of rounds the worker has completed
+
+	GParameterServerConnection(SOCKET sock)
+	: GPackageConnection(sock), m_joined(false), m_waiting(false), m_done(false), m_rounds(0)
+	{
+	}
+
+	virtual ~GParameterServerConnection()
+	{
+	}
+};
+
+
+/// A parameter server for data-parallel training. It holds the master copy of the
+/// weights of a model. Each GParameterWorker trains its own copy of the model with
+/// a shard of the data, and after each round it sends back the change in its weights.
+/// The server adds the average of these changes (that is, each change divided by the
+/// number of workers) to the master weights, and sends the updated weights back.
+/// With a staleness of 0, training is synchronous: every worker begins each round with
+/// the same weights, which include the changes that every worker made in the previous
+/// round. With a staleness of s > 0, a worker may begin its next round as soon as it
+/// finishes one, as long as that does not put it more than s rounds ahead of the slowest
+/// worker. (Only the changes are sent to the server, as single-precision values that are
+/// compressed with GLZCompressor. The precision that this loses is carried over into the
+/// next change, so it is not lost in the sum.)
+class GParameterServer : public GPackageServer
+{
+protected:
+	GParameterModel& m_model;
+	GVec m_weights;
+	size_t m_staleness;
+	size_t m_updates;
+	bool m_lostWorker;
+	std::vector<unsigned char> m_buf;
+
+public:
+	/// Listens for workers on the specified port. model provides the initial weights,
+	/// and receives the final weights.
+	GParameterServer(GParameterModel& model, unsigned short port);
+	virtual ~GParameterServer();
+
+	/// Specifies how many rounds a worker may get ahead of the slowest worker.
+	/// (The default is 0, which makes training synchronous.)
+	void setStaleness(size_t n) { m_staleness = n; }
+
+	/// Waits for the specified number of workers to connect, and coordinates the training
+	/// until each of them has completed the specified number of rounds. Then sets the weights
+	/// of the model to the final weights. Throws if a worker disconnects before it is done,
+	/// or if no message arrives for timeoutSecs seconds.
+	void serve(size_t workers, size_t rounds, double timeoutSecs = 600.0);
+
+	/// Returns the number of changes that have been received from workers.
+	size_t updates() { return m_updates; }
+
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // !NO_TEST_CODE
+
+protected:
+	/// See the comment for GPackageServer::makeConnection
+	virtual GPackageConnection* makeConnection(SOCKET s) { return new GParameterServerConnection(s); }
+
+	/// Notes when a worker disconnects before it is done.
+	virtual void onDisconnect(GTCPConnection* pConn);
+
+	/// Sends the current weights to every waiting worker that is not too far ahead
+	/// of the slowest worker. Returns the number of workers that were told to stop.
+	size_t dispatch(size_t rounds);
+};
+
+
+/// Connects to a GParameterServer and trains a model with a local shard of the data
+/// until the server says to stop.
+class GParameterWorker : public GPackageClient
+{
+protected:
+	GParameterModel& m_model;
+	GVec m_base;
+	GVec m_current;
+	GVec m_residual;
+	std::vector<unsigned char> m_buf;
+	bool m_lostServer;
+
+public:
+	/// model should have the same structure as the server's model. (Its weights will be
+	/// replaced with the server's weights before each round.)
+	GParameterWorker(GParameterModel& model);
+	virtual ~GParameterWorker();
+
+	/// Connects to the server and trains until the server says to stop. Leaves the
+	/// final weights in the model. Returns the number of rounds that were completed.
+	/// Throws if the server disconnects first, or if no message arrives for timeoutSecs seconds.
+	size_t run(const char* szAddr, unsigned short port, double timeoutSecs = 600.0);
+
+protected:
+	/// Notes when the server disconnects.
+	virtual void onDisconnect() { m_lostServer = true; }
+};
+
+} // namespace GClasses
+
+#endif // __GPARAMETERSERVER_H__
@@ -25,7 +25,7 @@
 namespace GClasses {
 
 GParticleSwarm::GParticleSwarm(GTargetFunction* pCritic, size_t nPopulation, double dMin, double dRange, GRand* pRand)
-: GOptimizer(pCritic), m_pPositions(m_nPopulation, pCritic->relation()->size()), m_pVelocities(m_nPopulation, pCritic->relation()->size()), m_pBests(m_nPopulation, pCritic->relation()->size()), m_pErrors(m_nPopulation), m_pRand(pRand)
+: GOptimizer(pCritic), m_pPositions(nPopulation, pCritic->relation()->size()), m_pVelocities(nPopulation, pCritic->relation()->size()), m_pBests(nPopulation, pCritic->relation()->size()), m_pErrors(nPopulation), m_pRand(pRand)
 {
 	if(!pCritic->relation()->areContinuous(0, pCritic->relation()->size()))
 		throw Ex("Discrete attributes are not supported");
@@ -41,6 +41,27 @@ GParticleSwarm::GParticleSwarm(GTargetFunction* pCritic, size_t nPopulation, dou
 {
 }
 
+#ifndef MIN_PREDICT
+// static
+void GParticleSwarm::test()
+{
+	// Evaluating the particles concurrently should not change the results
+	GMatrix results(2, 3);
+	for(size_t threads = 1; threads <= 2; threads++)
+	{
+		GRand rand(0);
+		GOptimizerBasicTestTargetFunction target;
+		GParticleSwarm opt(&target, 20, -10.0, 20.0, &rand);
+		opt.setWorkerThreads(threads == 1 ? 1 : 4);
+		for(size_t i = 0; i < 1000; i++)
+			opt.iterate();
+		results[threads - 1].copy(opt.currentVector());
+	}
+	if(results[0].squaredDistance(results[1]) != 0.0)
+		throw Ex("Parallel evaluation changed the results");
+}
+#endif
+
 void GParticleSwarm::reset()
 {
 	for(size_t i = 0; i < m_nPopulation; i++)
@@ -56,19 +77,21 @@ void GParticleSwarm::reset()
 /*virtual*/ double GParticleSwarm::iterate()
 {
 	// Advance
-	size_t n = m_nPopulation * m_nDimensions;
-	for(size_t i = 0; i < n; i++)
+	for(size_t i = 0; i < m_nPopulation; i++)
 		m_pPositions[i] += m_pVelocities[i];
 
-	// Critique the current spots and find the global best
-	double dError;
+	// Critique the current spots (all at once) and find the global best
+	std::vector<const GVec*> candidates;
+	for(size_t i = 0; i < m_nPopulation; i++)
+		candidates.push_back(&m_pPositions[i]);
+	GVec errors;
+	computeErrors(candidates, errors);
 	double dGlobalBest = 1e100;
 	for(size_t i = 0; i < m_nPopulation; i++)
 	{
-		dError = m_pCritic->computeError(m_pPositions[i]);
-		if(dError < m_pErrors[i])
+		if(errors[i] < m_pErrors[i])
 		{
-			m_pErrors[i] = dError;
+			m_pErrors[i] = errors[i];
 			m_pBests[i].copy(m_pPositions[i]);
 		}
 		if(m_pErrors[i] < dGlobalBest)
@@ -79,12 +102,10 @@ void GParticleSwarm::reset()
 	}
 
 	// Update velocities
-	size_t nPos = 0;
 	for(size_t i = 0; i < m_nPopulation; i++)
 	{
 		for(size_t j = 0; j < m_nDimensions; j++)
 			m_pVelocities[i][j] += m_dLearningRate * m_pRand->uniform() * (m_pBests[i][j] - m_pPositions[i][j]) + m_dLearningRate * m_pRand->uniform() * (m_pPositions[m_nGlobalBest][j] - m_pPositions[i][j]);
-		nPos += m_nDimensions;
 	}
 
 	return dGlobalBest;
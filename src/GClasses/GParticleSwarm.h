@@ -46,9 +46,18 @@ public:
 	GParticleSwarm(GTargetFunction* pCritic, size_t nPopulation, double dMin, double dRange, GRand* pRand);
 	virtual ~GParticleSwarm();
 
-	/// Perform a little more optimization
+	/// Perform a little more optimization. (The errors of all the particles are
+	/// computed at the same time, with workerThreads() threads.)
 	virtual double iterate();
 
+	/// Returns the best position yet found
+	virtual const GVec& currentVector() { return m_pBests[m_nGlobalBest]; }
+
+#ifndef MIN_PREDICT
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif
+
 	/// Specify the learning rate
 	void setLearningRate(double d) { m_dLearningRate = d; }
 
@@ -0,0 +1,684 @@
+/*
+  The contents of this file are dedicated by all of its authors, including
+
+    Michael S. Gashler,
+    anonymous contributors,
+
+  to the public domain (http://creativecommons.org/publicdomain/zero/1.0/).
+
+  Note that some moral obligations still exist in the absence of legal ones.
+  For example, it would still be dishonest to deliberately misrepresent the
+  origin of a work. Although we impose no legal requirements to obtain a
+  license, it is beseeming for those who build on the works of others to
+  give back useful improvements, or find a way to pay it forward. If
+  you would like to cite us, a published paper about Waffles can be found
+  at http://jmlr.org/papers/volume12/gashler11a/gashler11a.pdf. If you find
+  our code to be useful, the Waffles team would love to hear how you use it.
+*/
+
+#include "GProfiler.h"
+#include "GError.h"
+#include "GDom.h"
+#include "GApp.h"
+#include "GThread.h"
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#ifdef WINDOWS
+#	include <windows.h>
+#else
+#	include <time.h>
+#	include <pthread.h>
+#endif
+
+using std::vector;
+using std::string;
+
+namespace GClasses {
+
+GProfilerSite::GProfilerSite(const char* szName, Kind kind, size_t index)
+: m_szName(szName), m_kind(kind), m_index(index)
+{
+	clear();
+}
+
+void GProfilerSite::clear()
+{
+	m_calls = 0;
+	m_total = 0.0;
+	m_min = 1e308;
+	m_max = -1e308;
+	for(size_t i = 0; i < GPROFILER_BUCKETS; i++)
+		m_buckets[i] = 0;
+}
+
+void GProfilerSite::add(double value)
+{
+	m_calls++;
+	m_total += value;
+	m_min = std::min(m_min, value);
+	m_max = std::max(m_max, value);
+	size_t bucket = 0;
+	if(value >= 1.0)
+	{
+		int exp;
+		frexp(value, &exp); // value = m * 2^exp, where 0.5 <= m < 1
+		bucket = std::min((size_t)exp, (size_t)GPROFILER_BUCKETS - 1);
+	}
+	m_buckets[bucket]++;
+}
+
+void GProfilerSite::merge(const GProfilerSite& other)
+{
+	m_calls += other.m_calls;
+	m_total += other.m_total;
+	m_min = std::min(m_min, other.m_min);
+	m_max = std::max(m_max, other.m_max);
+	for(size_t i = 0; i < GPROFILER_BUCKETS; i++)
+		m_buckets[i] += other.m_buckets[i];
+}
+
+double GProfilerSite::quantile(double portion) const
+{
+	if(m_calls == 0)
+		return 0.0;
+	size_t target = std::max((size_t)1, (size_t)ceil(portion * m_calls));
+	size_t sum = 0;
+	for(size_t i = 0; i < GPROFILER_BUCKETS; i++)
+	{
+		sum += m_buckets[i];
+		if(sum >= target)
+			return std::min(m_max, std::max(m_min, ldexp(1.0, (int)i)));
+	}
+	return m_max;
+}
+
+
+struct GProfilerEvent
+{
+	GProfilerSite* m_pSite;
+	double m_start;
+	double m_duration;
+	size_t m_thread;
+};
+
+/// Holds the measurements that one thread has made since they were last merged. Only
+/// its own thread adds to it, so m_lock is only contended while the measurements are merged.
+class GProfilerThread
+{
+public:
+	GSpinLock m_lock;
+	size_t m_thread;
+	vector<GProfilerSite*> m_sites; // indexed by GProfilerSite::m_index. (NULL until this thread uses the site.)
+	vector<GProfilerEvent> m_events;
+
+	GProfilerThread(size_t thread)
+	: m_thread(thread)
+	{
+	}
+
+	~GProfilerThread()
+	{
+		for(size_t i = 0; i < m_sites.size(); i++)
+			delete(m_sites[i]);
+	}
+
+	/// Returns this thread's accumulator for the specified shared site. (The caller must hold m_lock.)
+	GProfilerSite* site(const GProfilerSite* pShared)
+	{
+		if(pShared->m_index >= m_sites.size())
+			m_sites.resize(pShared->m_index + 1, NULL);
+		GProfilerSite*& pSite = m_sites[pShared->m_index];
+		if(!pSite)
+			pSite = new GProfilerSite(pShared->m_szName, pShared->m_kind, pShared->m_index);
+		return pSite;
+	}
+
+	/// Discards the measurements. (The caller must hold m_lock.)
+	void clear()
+	{
+		for(size_t i = 0; i < m_sites.size(); i++)
+		{
+			if(m_sites[i])
+				m_sites[i]->clear();
+		}
+		m_events.clear();
+	}
+};
+
+/// Holds everything that GProfiler records. (Access it only while holding m_lock. To also
+/// access a GProfilerThread, take m_lock first, and then the thread's lock.)
+class GProfilerState
+{
+public:
+	GSpinLock m_lock;
+	vector<GProfilerSite*> m_sites;
+	vector<GProfilerEvent> m_events;
+	vector<GProfilerThread*> m_threads; // the threads that are still running
+	size_t m_nextThread;
+	std::atomic<bool> m_traceEvents;
+	std::atomic<size_t> m_maxEvents;
+	std::atomic<size_t> m_eventCount; // the number of events since reset, including those that were dropped
+	double m_enableTime;
+	double m_disableTime;
+	string m_profileFilename;
+	string m_traceFilename;
+
+	GProfilerState()
+	: m_nextThread(0), m_traceEvents(false), m_maxEvents(0), m_eventCount(0), m_enableTime(0.0), m_disableTime(-1.0)
+	{
+	}
+
+	~GProfilerState()
+	{
+		for(size_t i = 0; i < m_sites.size(); i++)
+			delete(m_sites[i]);
+	}
+
+	/// Returns the number of events that exceeded the limit
+	size_t droppedEvents()
+	{
+		size_t count = m_eventCount.load(std::memory_order_relaxed);
+		size_t maxEvents = m_maxEvents.load(std::memory_order_relaxed);
+		return count > maxEvents ? count - maxEvents : 0;
+	}
+
+	/// Moves the measurements of pThread into the shared sites and events. (The caller must hold m_lock.)
+	void merge(GProfilerThread* pThread)
+	{
+		GSpinLockHolder hLock(&pThread->m_lock, "GProfilerState::merge");
+		for(size_t i = 0; i < pThread->m_sites.size(); i++)
+		{
+			if(pThread->m_sites[i])
+				m_sites[i]->merge(*pThread->m_sites[i]);
+		}
+		m_events.insert(m_events.end(), pThread->m_events.begin(), pThread->m_events.end());
+		pThread->clear();
+	}
+
+	/// Moves the measurements of every running thread into the shared sites and events. (The caller must hold m_lock.)
+	void mergeAll()
+	{
+		for(size_t i = 0; i < m_threads.size(); i++)
+			merge(m_threads[i]);
+	}
+};
+
+static GProfilerState& GProfiler_state()
+{
+	static GProfilerState state;
+	return state;
+}
+
+/// Owns the GProfilerThread of the thread that it belongs to, and merges its measurements when the thread exits
+class GProfilerThreadHolder
+{
+public:
+	GProfilerThread* m_pThread;
+
+	GProfilerThreadHolder()
+	: m_pThread(NULL)
+	{
+	}
+
+	~GProfilerThreadHolder()
+	{
+		if(!m_pThread)
+			return;
+		GProfilerState& state = GProfiler_state();
+		GSpinLockHolder hLock(&state.m_lock, "~GProfilerThreadHolder");
+		state.merge(m_pThread);
+		state.m_threads.erase(std::find(state.m_threads.begin(), state.m_threads.end(), m_pThread));
+		delete(m_pThread);
+	}
+};
+
+/// Returns the measurements of the calling thread
+static GProfilerThread* GProfiler_thread()
+{
+	static thread_local GProfilerThreadHolder holder;
+	if(!holder.m_pThread)
+	{
+		GProfilerState& state = GProfiler_state();
+		GSpinLockHolder hLock(&state.m_lock, "GProfiler_thread");
+		holder.m_pThread = new GProfilerThread(state.m_nextThread++);
+		state.m_threads.push_back(holder.m_pThread);
+	}
+	return holder.m_pThread;
+}
+
+static double GProfiler_clock()
+{
+#ifdef WINDOWS
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec * 1e-3;
+#endif
+}
+
+std::atomic<bool> GProfiler::s_enabled(false);
+
+// static
+void GProfiler::enable(bool traceEvents, size_t maxEvents)
+{
+	reset();
+	GProfilerState& state = GProfiler_state();
+	GSpinLockHolder hLock(&state.m_lock, "GProfiler::enable");
+	state.m_traceEvents.store(traceEvents, std::memory_order_relaxed);
+	state.m_maxEvents.store(maxEvents, std::memory_order_relaxed);
+	state.m_enableTime = GProfiler_clock();
+	state.m_disableTime = -1.0;
+	s_enabled.store(true, std::memory_order_release);
+}
+
+// static
+void GProfiler::disable()
+{
+	GProfilerState& state = GProfiler_state();
+	GSpinLockHolder hLock(&state.m_lock, "GProfiler::disable");
+	if(enabled())
+		state.m_disableTime = GProfiler_clock() - state.m_enableTime;
+	s_enabled.store(false, std::memory_order_release);
+}
+
+// static
+void GProfiler::reset()
+{
+	GProfilerState& state = GProfiler_state();
+	GSpinLockHolder hLock(&state.m_lock, "GProfiler::reset");
+	for(size_t i = 0; i < state.m_sites.size(); i++)
+		state.m_sites[i]->clear();
+	state.m_events.clear();
+	for(size_t i = 0; i < state.m_threads.size(); i++)
+	{
+		GSpinLockHolder hThreadLock(&state.m_threads[i]->m_lock, "GProfiler::reset");
+		state.m_threads[i]->clear();
+	}
+	state.m_eventCount.store(0, std::memory_order_relaxed);
+	state.m_enableTime = GProfiler_clock();
+}
+
+// static
+GProfilerSite* GProfiler::site(const char* szName, GProfilerSite::Kind kind)
+{
+	GProfilerState& state = GProfiler_state();
+	GSpinLockHolder hLock(&state.m_lock, "GProfiler::site");
+	for(size_t i = 0; i < state.m_sites.size(); i++)
+	{
+		GProfilerSite* pSite = state.m_sites[i];
+		if(strcmp(pSite->m_szName, szName) == 0)
+		{
+			if(pSite->m_kind != kind)
+				throw Ex("The profiler site \"", szName, "\" is used for two different kinds of measurements");
+			return pSite;
+		}
+	}
+	GProfilerSite* pSite = new GProfilerSite(szName, kind, state.m_sites.size());
+	state.m_sites.push_back(pSite);
+	return pSite;
+}
+
+// static
+double GProfiler::now()
+{
+	return GProfiler_clock() - GProfiler_state().m_enableTime;
+}
+
+// static
+void GProfiler::record(GProfilerSite* pSite, double value)
+{
+	GProfilerThread* pThread = GProfiler_thread();
+	GSpinLockHolder hLock(&pThread->m_lock, "GProfiler::record");
+	pThread->site(pSite)->add(value);
+}
+
+// static
+void GProfiler::recordScope(GProfilerSite* pSite, double start, double end)
+{
+	GProfilerState& state = GProfiler_state();
+	GProfilerThread* pThread = GProfiler_thread();
+	GSpinLockHolder hLock(&pThread->m_lock, "GProfiler::recordScope");
+	pThread->site(pSite)->add(end - start);
+	if(state.m_traceEvents.load(std::memory_order_relaxed))
+	{
+		// Reserve a place for the event, so the limit is shared by all of the threads
+		if(state.m_eventCount.fetch_add(1, std::memory_order_relaxed) < state.m_maxEvents.load(std::memory_order_relaxed))
+		{
+			pThread->m_events.resize(pThread->m_events.size() + 1);
+			GProfilerEvent& ev = pThread->m_events.back();
+			ev.m_pSite = pSite;
+			ev.m_start = start;
+			ev.m_duration = end - start;
+			ev.m_thread = pThread->m_thread;
+		}
+	}
+}
+
+static bool GProfiler_compareSites(const GProfilerSite* a, const GProfilerSite* b)
+{
+	if(a->m_kind != b->m_kind)
+		return a->m_kind < b->m_kind;
+	if(a->m_kind == GProfilerSite::TIMER && a->m_total != b->m_total)
+		return a->m_total > b->m_total;
+	return strcmp(a->m_szName, b->m_szName) < 0;
+}
+
+// static
+GDomNode* GProfiler::serialize(GDom* pDoc)
+{
+	GProfilerState& state = GProfiler_state();
+	GSpinLockHolder hLock(&state.m_lock, "GProfiler::serialize");
+	state.mergeAll();
+	vector<GProfilerSite*> sites;
+	for(size_t i = 0; i < state.m_sites.size(); i++)
+	{
+		if(state.m_sites[i]->m_calls > 0)
+			sites.push_back(state.m_sites[i]);
+	}
+	std::sort(sites.begin(), sites.end(), GProfiler_compareSites);
+	GDomNode* pNode = pDoc->newObj();
+	double elapsed = state.m_disableTime >= 0.0 ? state.m_disableTime : GProfiler_clock() - state.m_enableTime;
+	pNode->addField(pDoc, "units", pDoc->newString("microseconds"));
+	pNode->addField(pDoc, "elapsed", pDoc->newDouble(elapsed));
+	GDomNode* pTimers = pNode->addField(pDoc, "timers", pDoc->newList());
+	GDomNode* pCounters = pNode->addField(pDoc, "counters", pDoc->newList());
+	GDomNode* pHistograms = pNode->addField(pDoc, "histograms", pDoc->newList());
+	for(size_t i = 0; i < sites.size(); i++)
+	{
+		GProfilerSite* pSite = sites[i];
+		GDomNode* pS = pDoc->newObj();
+		pS->addField(pDoc, "name", pDoc->newString(pSite->m_szName));
+		pS->addField(pDoc, "calls", pDoc->newInt(pSite->m_calls));
+		pS->addField(pDoc, "total", pDoc->newDouble(pSite->m_total));
+		if(pSite->m_kind == GProfilerSite::COUNTER)
+		{
+			pCounters->addItem(pDoc, pS);
+			continue;
+		}
+		if(pSite->m_kind == GProfilerSite::TIMER)
+			pS->addField(pDoc, "portion", pDoc->newDouble(elapsed > 0.0 ? pSite->m_total / elapsed : 0.0));
+		pS->addField(pDoc, "mean", pDoc->newDouble(pSite->m_total / pSite->m_calls));
+		pS->addField(pDoc, "min", pDoc->newDouble(pSite->m_min));
+		pS->addField(pDoc, "p50", pDoc->newDouble(pSite->quantile(0.5)));
+		pS->addField(pDoc, "p90", pDoc->newDouble(pSite->quantile(0.9)));
+		pS->addField(pDoc, "p99", pDoc->newDouble(pSite->quantile(0.99)));
+		pS->addField(pDoc, "max", pDoc->newDouble(pSite->m_max));
+		GDomNode* pBuckets = pS->addField(pDoc, "buckets", pDoc->newList());
+		for(size_t j = 0; j < GPROFILER_BUCKETS; j++)
+		{
+			if(pSite->m_buckets[j] == 0)
+				continue;
+			GDomNode* pB = pBuckets->addItem(pDoc, pDoc->newList());
+			pB->addItem(pDoc, pDoc->newDouble(j == 0 ? 0.0 : ldexp(1.0, (int)j - 1)));
+			pB->addItem(pDoc, pDoc->newInt(pSite->m_buckets[j]));
+		}
+		if(pSite->m_kind == GProfilerSite::TIMER)
+			pTimers->addItem(pDoc, pS);
+		else
+			pHistograms->addItem(pDoc, pS);
+	}
+	if(state.m_traceEvents.load(std::memory_order_relaxed))
+	{
+		pNode->addField(pDoc, "events", pDoc->newInt(state.m_events.size()));
+		pNode->addField(pDoc, "droppedEvents", pDoc->newInt(state.droppedEvents()));
+	}
+	return pNode;
+}
+
+static void GProfiler_writeName(std::ostream& stream, const char* szName)
+{
+	stream << '"';
+	for(const char* p = szName; *p; p++)
+	{
+		if(*p == '"' || *p == '\\')
+			stream << '\\';
+		stream << *p;
+	}
+	stream << '"';
+}
+
+// static
+void GProfiler::writeChromeTrace(std::ostream& stream)
+{
+	// The events are streamed out directly because a GDom of a long trace would be huge
+	GProfilerState& state = GProfiler_state();
+	GSpinLockHolder hLock(&state.m_lock, "GProfiler::writeChromeTrace");
+	state.mergeAll();
+	stream.precision(12);
+	stream << "{\"traceEvents\":[\n";
+	bool first = true;
+	for(size_t i = 0; i < state.m_events.size(); i++)
+	{
+		const GProfilerEvent& ev = state.m_events[i];
+		if(!first)
+			stream << ",\n";
+		first = false;
+		stream << "{\"name\":";
+		GProfiler_writeName(stream, ev.m_pSite->m_szName);
+		stream << ",\"cat\":\"waffles\",\"ph\":\"X\",\"ts\":" << ev.m_start << ",\"dur\":" << ev.m_duration << ",\"pid\":1,\"tid\":" << ev.m_thread << "}";
+	}
+
+	// Report the final value of each counter at the end of the trace
+	double end = state.m_disableTime >= 0.0 ? state.m_disableTime : GProfiler_clock() - state.m_enableTime;
+	for(size_t i = 0; i < state.m_sites.size(); i++)
+	{
+		GProfilerSite* pSite = state.m_sites[i];
+		if(pSite->m_kind != GProfilerSite::COUNTER || pSite->m_calls == 0)
+			continue;
+		if(!first)
+			stream << ",\n";
+		first = false;
+		stream << "{\"name\":";
+		GProfiler_writeName(stream, pSite->m_szName);
+		stream << ",\"cat\":\"waffles\",\"ph\":\"C\",\"ts\":" << end << ",\"pid\":1,\"args\":{\"total\":" << pSite->m_total << "}}";
+	}
+	stream << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << state.droppedEvents() << "}}\n";
+}
+
+// static
+void GProfiler::parseArgs(GArgReader& args)
+{
+	GProfilerState& state = GProfiler_state();
+	bool found = false;
+	while(args.size() > 0)
+	{
+		if(args.if_pop("--profile"))
+			state.m_profileFilename = args.pop_string();
+		else if(args.if_pop("--profile-trace"))
+			state.m_traceFilename = args.pop_string();
+		else
+			break;
+		found = true;
+	}
+	if(found)
+		enable(state.m_traceFilename.length() > 0);
+}
+
+GProfilerReportWriter::~GProfilerReportWriter()
+{
+	try
+	{
+		GProfiler::writeRequestedReports();
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << "Failed to write the profiler reports: " << e.what() << "\n";
+	}
+}
+
+// static
+void GProfiler::writeRequestedReports()
+{
+	GProfilerState& state = GProfiler_state();
+	if(!enabled())
+		return;
+	disable();
+	if(state.m_profileFilename.length() > 0)
+	{
+		GDom doc;
+		doc.setRoot(serialize(&doc));
+		doc.saveJson(state.m_profileFilename.c_str());
+	}
+	if(state.m_traceFilename.length() > 0)
+	{
+		std::ofstream s;
+		s.exceptions(std::ios::failbit|std::ios::badbit);
+		try
+		{
+			s.open(state.m_traceFilename.c_str(), std::ios::binary);
+		}
+		catch(const std::exception&)
+		{
+			throw Ex("Error creating file: ", state.m_traceFilename);
+		}
+		writeChromeTrace(s);
+	}
+}
+
+#ifndef NO_TEST_CODE
+static void GProfiler_busy(size_t n, double* pSink)
+{
+	GPROFILE_SCOPE("GProfiler::test busy");
+	double d = 0.0;
+	for(size_t i = 0; i < n; i++)
+		d += sqrt((double)i);
+	*pSink += d;
+}
+
+class GProfilerTestWorker : public GWorkerThread
+{
+public:
+	double m_sink;
+
+	GProfilerTestWorker(GMasterThread& master)
+	: GWorkerThread(master), m_sink(0.0)
+	{
+	}
+
+	virtual ~GProfilerTestWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		GProfiler_busy(100, &m_sink);
+		GPROFILE_COUNT("GProfiler::test count", 3);
+	}
+};
+
+// static
+void GProfiler::test()
+{
+	// Nothing should be recorded while the profiler is disabled
+	GProfiler::disable();
+	double sink = 0.0;
+	GProfiler_busy(10, &sink);
+	GPROFILE_COUNT("GProfiler::test count", 3);
+	GProfilerSite* pBusy = site("GProfiler::test busy", GProfilerSite::TIMER);
+	GProfilerSite* pCount = site("GProfiler::test count", GProfilerSite::COUNTER);
+	GDom doc0;
+	serialize(&doc0); // merges the measurements of this thread into the sites
+	if(pBusy->m_calls != 0 || pCount->m_calls != 0)
+		throw Ex("recorded while disabled");
+
+	// Record some measurements
+	enable(true, 5);
+	for(size_t i = 0; i < 7; i++)
+	{
+		GProfiler_busy(20000, &sink);
+		GPROFILE_COUNT("GProfiler::test count", 3);
+		GPROFILE_HISTOGRAM("GProfiler::test histogram", (double)(1 << i));
+	}
+	disable();
+	GProfiler_busy(10, &sink);
+	GDom doc;
+	GDomNode* pNode = serialize(&doc);
+	if(pBusy->m_calls != 7)
+		throw Ex("wrong number of calls");
+	if(pBusy->m_total <= 0.0 || pBusy->m_min < 0.0 || pBusy->m_max < pBusy->m_min)
+		throw Ex("bad timings");
+	if(pCount->m_calls != 7 || pCount->m_total != 21.0)
+		throw Ex("bad counter");
+	GProfilerSite* pHist = site("GProfiler::test histogram", GProfilerSite::HISTOGRAM);
+	for(size_t i = 1; i <= 7; i++)
+	{
+		if(pHist->m_buckets[i] != 1)
+			throw Ex("bad histogram");
+	}
+	if(pHist->quantile(0.5) != 16.0 || pHist->quantile(1.0) != 64.0 || pHist->quantile(0.0) != 2.0)
+		throw Ex("bad quantiles");
+
+	// Check the summary
+	GDomNode* pTimers = pNode->field("timers");
+	bool foundBusy = false;
+	for(GDomListIterator it(pTimers); it.current(); it.advance())
+	{
+		if(strcmp(it.current()->field("name")->asString(), "GProfiler::test busy") == 0)
+		{
+			foundBusy = true;
+			if(it.current()->field("calls")->asInt() != 7)
+				throw Ex("wrong summary");
+		}
+	}
+	if(!foundBusy)
+		throw Ex("missing timer");
+	if(pNode->field("droppedEvents")->asInt() != 2)
+		throw Ex("events were not limited");
+
+	// Check that the trace is valid JSON
+	std::ostringstream oss;
+	writeChromeTrace(oss);
+	string s = oss.str();
+	GDom doc2;
+	doc2.parseJson(s.c_str(), s.length());
+	GDomNode* pEvents = doc2.root()->field("traceEvents");
+	GDomListIterator itEvents(pEvents);
+	if(itEvents.remaining() != 6) // 5 events and 1 counter
+		throw Ex("wrong number of trace events");
+
+	// Record from several threads. (Their measurements are merged when they exit.)
+	enable(true, 1000);
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < 4; i++)
+			master.addWorker(new GProfilerTestWorker(master));
+		master.doJobs(800);
+	}
+	disable();
+	GDom doc3;
+	GDomNode* pNode3 = serialize(&doc3);
+	if(pBusy->m_calls != 800 || pCount->m_calls != 800 || pCount->m_total != 2400.0)
+		throw Ex("lost measurements from other threads");
+	if(pNode3->field("events")->asInt() != 800 || pNode3->field("droppedEvents")->asInt() != 0)
+		throw Ex("lost events from other threads");
+
+	// Check the command-line options
+	const char* argv[] = { "--profile", "a.json", "--profile-trace", "b.json", "train" };
+	GArgReader args(5, (char**)argv);
+	parseArgs(args);
+	if(!enabled() || args.size() != 1 || strcmp(args.peek(), "train") != 0)
+		throw Ex("failed to parse the options");
+	GProfilerState& state = GProfiler_state();
+	if(state.m_profileFilename.compare("a.json") != 0 || state.m_traceFilename.compare("b.json") != 0 || !state.m_traceEvents)
+		throw Ex("failed to parse the options");
+	state.m_profileFilename = "";
+	state.m_traceFilename = "";
+	disable();
+	reset();
+	if(sink < 0.0)
+		throw Ex("unexpected");
+}
+#endif // !NO_TEST_CODE
+
+} // namespace GClasses
@@ -0,0 +1,201 @@
+/*
+  The contents of this file are dedicated by all of its authors, including
+
+    Michael S. Gashler,
+    anonymous contributors,
+
+  to the public domain (http://creativecommons.org/publicdomain/zero/1.0/).
+
+  Note that some moral obligations still exist in the absence of legal ones.
+  For example, it would still be dishonest to deliberately misrepresent the
+  origin of a work. Although we impose no legal requirements to obtain a
+  license, it is beseeming for those who build on the works of others to
+  give back useful improvements, or find a way to pay it forward. If
+  you would like to cite us, a published paper about Waffles can be found
+  at http://jmlr.org/papers/volume12/gashler11a/gashler11a.pdf. If you find
+  our code to be useful, the Waffles team would love to hear how you use it.
+*/
+
+#ifndef __GPROFILER_H__
+#define __GPROFILER_H__
+
+#include <stddef.h>
+#include <ostream>
+#include <atomic>
+
+namespace GClasses {
+
+class GDom;
+class GDomNode;
+class GArgReader;
+
+#define GPROFILER_BUCKETS 48
+
+/// Accumulates the measurements made at one site of instrumentation. (Sites with
+/// the same name share one GProfilerSite.)
+class GProfilerSite
+{
+public:
+	enum Kind
+	{
+		TIMER, // each measurement is the duration of a scope in microseconds
+		COUNTER, // each measurement is an amount to add to a running total
+		HISTOGRAM // each measurement is a value whose distribution is of interest
+	};
+
+	const char* m_szName;
+	Kind m_kind;
+	size_t m_index; // the position of this site in the order that the sites were created
+	size_t m_calls;
+	double m_total;
+	double m_min;
+	double m_max;
+	size_t m_buckets[GPROFILER_BUCKETS]; // bucket 0 counts values < 1. Bucket i counts values in [2^(i-1), 2^i).
+
+	GProfilerSite(const char* szName, Kind kind, size_t index);
+
+	/// Discards all measurements.
+	void clear();
+
+	/// Adds a measurement.
+	void add(double value);
+
+	/// Adds all of the measurements in other.
+	void merge(const GProfilerSite& other);
+
+	/// Returns an upper bound (accurate to within a factor of 2) on the value below which
+	/// the specified portion of the measurements fall.
+	double quantile(double portion) const;
+};
+
+
+/// Collects timings, counts, and distributions from instrumented code. Recording is
+/// off until enable is called, so the instrumentation costs only a test of a flag
+/// in normal runs. Define NO_PROFILER to compile the instrumentation out entirely.
+/// Instrument code with these macros:
+///
+///   GPROFILE_SCOPE("GFoo::bar"); // times the rest of the enclosing scope
+///   GPROFILE_COUNT("GFoo::bar rows", n); // adds n to a running total
+///   GPROFILE_HISTOGRAM("GFoo::bar depth", d); // records the distribution of d
+///
+/// The names should be string literals, since only the pointers are kept.
+/// It is safe to record from several threads at once. Each thread accumulates its
+/// measurements separately, and they are merged into the shared sites when the
+/// thread exits, or when serialize or writeChromeTrace is called.
+class GProfiler
+{
+protected:
+	static std::atomic<bool> s_enabled;
+
+public:
+	/// Returns true iff measurements are being recorded.
+	static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+	/// Discards any previous measurements, and begins recording. If traceEvents is true,
+	/// then each timed scope is also kept as an event for writeChromeTrace, up to maxEvents
+	/// of them. (Events past that limit are only counted.)
+	static void enable(bool traceEvents = false, size_t maxEvents = 1000000);
+
+	/// Stops recording. (The measurements are kept until enable or reset is called.)
+	static void disable();
+
+	/// Discards all measurements and events.
+	static void reset();
+
+	/// Returns the site with the specified name, creating it if necessary. (Its measurements
+	/// are only up to date after serialize or writeChromeTrace has merged those of the
+	/// running threads into it.)
+	static GProfilerSite* site(const char* szName, GProfilerSite::Kind kind);
+
+	/// Returns the number of microseconds since enable was called.
+	static double now();
+
+	/// Adds a measurement to the specified site.
+	static void record(GProfilerSite* pSite, double value);
+
+	/// Adds the duration of a scope to the specified site, and keeps it as an event if
+	/// events are being traced. start and end are values returned by now().
+	static void recordScope(GProfilerSite* pSite, double start, double end);
+
+	/// Returns a summary of every site that has measurements, with the timers ordered from
+	/// the most total time to the least.
+	static GDomNode* serialize(GDom* pDoc);
+
+	/// Writes the traced events in Chrome's trace-event format. (Load the file in
+	/// chrome://tracing or ui.perfetto.dev to view it.)
+	static void writeChromeTrace(std::ostream& stream);
+
+	/// Pops any "--profile [filename]" and "--profile-trace [filename]" options from
+	/// the front of args, and begins recording if there are any. The apps call this
+	/// before they parse the command.
+	static void parseArgs(GArgReader& args);
+
+	/// Writes the reports that were requested by the options that parseArgs popped.
+	static void writeRequestedReports();
+
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // !NO_TEST_CODE
+};
+
+
+/// Measures the time from its construction to its destruction. (Use GPROFILE_SCOPE
+/// instead of using this class directly.)
+class GProfilerScope
+{
+protected:
+	GProfilerSite* m_pSite;
+	double m_start;
+
+public:
+	GProfilerScope(GProfilerSite* pSite)
+	: m_pSite(pSite), m_start(GProfiler::enabled() ? GProfiler::now() : -1.0)
+	{
+	}
+
+	~GProfilerScope()
+	{
+		if(m_start >= 0.0)
+			GProfiler::recordScope(m_pSite, m_start, GProfiler::now());
+	}
+};
+
+
+/// Writes the reports requested on the command line when it is destroyed, so an app
+/// that fails with an exception still writes them. (Errors while writing are printed
+/// to stderr instead of thrown, so they do not hide that exception. Call
+/// GProfiler::writeRequestedReports on the success path to have them thrown as usual.)
+class GProfilerReportWriter
+{
+public:
+	GProfilerReportWriter() {}
+	~GProfilerReportWriter();
+};
+
+} // namespace GClasses
+
+
+#ifdef NO_PROFILER
+#	define GPROFILE_SCOPE(name)
+#	define GPROFILE_COUNT(name, n)
+#	define GPROFILE_HISTOGRAM(name, value)
+#else
+#	define GPROFILER_JOIN2(a, b) a##b
+#	define GPROFILER_JOIN(a, b) GPROFILER_JOIN2(a, b)
+#	define GPROFILE_SCOPE(name) \
+		static GClasses::GProfilerSite* GPROFILER_JOIN(g_profilerSite, __LINE__) = GClasses::GProfiler::site(name, GClasses::GProfilerSite::TIMER); \
+		GClasses::GProfilerScope GPROFILER_JOIN(profilerScope, __LINE__)(GPROFILER_JOIN(g_profilerSite, __LINE__))
+#	define GPROFILE_COUNT(name, n) \
+		do { if(GClasses::GProfiler::enabled()) { \
+			static GClasses::GProfilerSite* g_profilerSite = GClasses::GProfiler::site(name, GClasses::GProfilerSite::COUNTER); \
+			GClasses::GProfiler::record(g_profilerSite, (double)(n)); \
+		} } while(false)
+#	define GPROFILE_HISTOGRAM(name, value) \
+		do { if(GClasses::GProfiler::enabled()) { \
+			static GClasses::GProfilerSite* g_profilerSite = GClasses::GProfiler::site(name, GClasses::GProfilerSite::HISTOGRAM); \
+			GClasses::GProfiler::record(g_profilerSite, (double)(value)); \
+		} } while(false)
+#endif // NO_PROFILER
+
+#endif // __GPROFILER_H__
@@ -23,7 +23,11 @@
 #include <algorithm>
 #include "GImage.h"
 #include "GMath.h"
+#include "GThread.h"
 #include <cmath>
+#ifdef __SSE2__
+#	include <emmintrin.h>
+#endif
 
 namespace GClasses {
 
@@ -127,13 +131,17 @@ public:
 	bool m_bHitTexture;
 	G3DReal m_textureX;
 	G3DReal m_textureY;
-	GRand* m_pRand;
+	GRayTraceColor m_texel; // scratch space for materials that compute their color from the texture coordinates
+	GRand* m_pRand; // each thread renders with its own GRand
 
 	GRayTraceRay(GRand* m_pRand);
 	GRayTraceRay(GRayTraceRay* pThat);
 	~GRayTraceRay();
 
 	void Cast(GRayTraceScene* pScene, G3DVector* pRayOrigin, G3DVector* pDirectionVector, int nMaxDepth);
+
+	/// Computes the color of this ray, given the closest object that it hits (or NULL if it hits nothing)
+	void Shade(GRayTraceScene* pScene, GRayTraceObject* pClosestObject, G3DReal distance, G3DVector* pRayOrigin, G3DVector* pDirectionVector, int nMaxDepth);
 	void Trace(GRayTraceScene* pScene, G3DVector* pRayOrigin, G3DVector* pDirectionVector, int nMaxDepth, bool bEmissive);
 	void SetTextureCoords(G3DReal x, G3DReal y);
 	void GetTextureCoords(G3DReal* x, G3DReal* y);
@@ -225,6 +233,11 @@ void GRayTraceRay::Cast(GRayTraceScene* pScene, G3DVector* pRayOrigin, G3DVector
 	G3DReal distance;
 	GAssert(pScene->boundingBoxTree()); // You must to call RenderBegin first?
 	GRayTraceObject* pClosestObject = pScene->boundingBoxTree()->closestIntersection(pRayOrigin, pDirectionVector, &distance);
+	Shade(pScene, pClosestObject, distance, pRayOrigin, pDirectionVector, nMaxDepth);
+}
+
+void GRayTraceRay::Shade(GRayTraceScene* pScene, GRayTraceObject* pClosestObject, G3DReal distance, G3DVector* pRayOrigin, G3DVector* pDirectionVector, int nMaxDepth)
+{
 	if(!pClosestObject)
 	{
 		m_color.copy(pScene->backgroundColor());
@@ -424,6 +437,102 @@ void GRayTraceRay::GetTextureCoords(G3DReal* x, G3DReal* y)
 
 // -----------------------------------------------------------------------------
 
+#define RAY_PACKET_SIZE 4
+
+// Holds a small group of rays that are traced through the bounding box tree together
+class GRayTracePacket
+{
+public:
+	G3DVector m_origin[RAY_PACKET_SIZE];
+	G3DVector m_direction[RAY_PACKET_SIZE];
+	G3DReal m_o[3][RAY_PACKET_SIZE]; // the origins, stored by axis so the slab tests can be vectorized
+	G3DReal m_inv[3][RAY_PACKET_SIZE]; // the reciprocals of the directions, stored by axis
+	G3DReal m_closest[RAY_PACKET_SIZE]; // the distance to the closest intersection found so far
+	GRayTraceObject* m_pClosest[RAY_PACKET_SIZE];
+	int m_active; // bit i is set if lane i holds a ray
+
+	GRayTracePacket() : m_active(0)
+	{
+		for(size_t i = 0; i < RAY_PACKET_SIZE; i++)
+		{
+			for(size_t j = 0; j < 3; j++)
+			{
+				m_o[j][i] = 0;
+				m_inv[j][i] = 1;
+			}
+			m_closest[i] = -1;
+			m_pClosest[i] = NULL;
+		}
+	}
+
+	// Computes the reciprocal of a direction component. (Zero is replaced with a very small
+	// value so that the slab tests never have to multiply zero by infinity.)
+	static G3DReal inverse(G3DReal d)
+	{
+		return (G3DReal)1 / (d == 0 ? (G3DReal)1e-300 : d);
+	}
+
+	// Puts a ray in the specified lane
+	void set(size_t lane, const G3DVector* pOrigin, const G3DVector* pDirection)
+	{
+		m_origin[lane].copy(pOrigin);
+		m_direction[lane].copy(pDirection);
+		for(size_t j = 0; j < 3; j++)
+		{
+			m_o[j][lane] = pOrigin->m_vals[j];
+			m_inv[j][lane] = inverse(pDirection->m_vals[j]);
+		}
+		m_closest[lane] = (G3DReal)1e30;
+		m_pClosest[lane] = NULL;
+		m_active |= (1 << lane);
+	}
+
+	// Returns a bit mask of the active lanes whose rays enter the specified box before their closest intersection so far
+	int hitsBox(const G3DVector& min, const G3DVector& max)
+	{
+#ifdef __SSE2__
+		int mask = 0;
+		__m128d zero = _mm_setzero_pd();
+		for(size_t i = 0; i < RAY_PACKET_SIZE; i += 2)
+		{
+			__m128d tNear = _mm_set1_pd(-1e300);
+			__m128d tFar = _mm_loadu_pd(m_closest + i);
+			for(size_t j = 0; j < 3; j++)
+			{
+				__m128d o = _mm_loadu_pd(m_o[j] + i);
+				__m128d inv = _mm_loadu_pd(m_inv[j] + i);
+				__m128d t1 = _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(min.m_vals[j]), o), inv);
+				__m128d t2 = _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(max.m_vals[j]), o), inv);
+				tNear = _mm_max_pd(tNear, _mm_min_pd(t1, t2));
+				tFar = _mm_min_pd(tFar, _mm_max_pd(t1, t2));
+			}
+			__m128d hit = _mm_and_pd(_mm_cmple_pd(tNear, tFar), _mm_cmpge_pd(tFar, zero));
+			mask |= (_mm_movemask_pd(hit) << i);
+		}
+		return mask & m_active;
+#else
+		int mask = 0;
+		for(size_t i = 0; i < RAY_PACKET_SIZE; i++)
+		{
+			G3DReal tNear = (G3DReal)-1e300;
+			G3DReal tFar = m_closest[i];
+			for(size_t j = 0; j < 3; j++)
+			{
+				G3DReal t1 = (min.m_vals[j] - m_o[j][i]) * m_inv[j][i];
+				G3DReal t2 = (max.m_vals[j] - m_o[j][i]) * m_inv[j][i];
+				tNear = std::max(tNear, std::min(t1, t2));
+				tFar = std::min(tFar, std::max(t1, t2));
+			}
+			if(tNear <= tFar && tFar >= 0)
+				mask |= (1 << i);
+		}
+		return mask & m_active;
+#endif
+	}
+};
+
+// -----------------------------------------------------------------------------
+
 GRayTraceScene::GRayTraceScene(GRand* pRand)
 : m_backgroundColor(1, (G3DReal).6, (G3DReal).7, (G3DReal).5),
   m_ambientLight(1, (G3DReal).3, (G3DReal).3, (G3DReal).3), m_pRand(pRand)
@@ -435,6 +544,7 @@ GRayTraceScene::GRayTraceScene(GRand* pRand)
 	m_nY = -1;
 	m_toneMappingConstant = .5;
 	m_eMode = FAST_RAY_TRACE;
+	m_workerThreads = 1;
 }
 
 GRayTraceScene::GRayTraceScene(GDomNode* pNode, GRand* pRand)
@@ -454,6 +564,7 @@ GRayTraceScene::GRayTraceScene(GDomNode* pNode, GRand* pRand)
 	m_pCamera = new GRayTraceCamera(pNode->field("camera"));
 	m_toneMappingConstant = pNode->field("tone")->asDouble();
 	m_eMode = (RenderMode)pNode->field("mode")->asInt();
+	m_workerThreads = 1;
 }
 
 GRayTraceScene::~GRayTraceScene()
@@ -659,14 +770,27 @@ void GRayTraceScene::renderBegin()
 	m_nY = nHeight - 1;
 }
 
+void GRayTraceScene::screenPoint(int x, int y, G3DVector* pOutPoint)
+{
+	pOutPoint->copy(&m_pixSide);
+	G3DVector d(&m_pixDX);
+	d.multiply((G3DReal)x);
+	pOutPoint->add(&d);
+	d.copy(&m_pixDY);
+	d.multiply((G3DReal)(m_pImage->height() - 1 - y));
+	pOutPoint->add(&d);
+}
+
 unsigned int GRayTraceScene::renderPixel(GRayTraceRay* pRay, G3DVector* pScreenPoint, G3DReal* pDistance)
 {
 	G3DVector directionVector(pScreenPoint);
 	directionVector.subtract(m_pCamera->lookFromPoint());
 	directionVector.normalize();
-	pRay->Cast(this, m_pCamera->lookFromPoint(), &directionVector, m_pCamera->maxDepth());
+	G3DReal distance;
+	GRayTraceObject* pClosestObject = m_pBoundingBoxTree->closestIntersection(m_pCamera->lookFromPoint(), &directionVector, &distance);
+	pRay->Shade(this, pClosestObject, distance, m_pCamera->lookFromPoint(), &directionVector, m_pCamera->maxDepth());
 	if(pDistance)
-		m_pBoundingBoxTree->closestIntersection(m_pCamera->lookFromPoint(), &directionVector, pDistance);
+		*pDistance = distance;
 	return pRay->m_color.color();
 }
 
@@ -674,6 +798,8 @@ unsigned int GRayTraceScene::renderPixel(GRayTraceRay* pRay, G3DVector* pScreenP
 
 unsigned int GRayTraceScene::renderPixelAntiAliassed(GRayTraceRay* pRay, G3DVector* pScreenPoint, G3DReal* pDistance)
 {
+	G3DVector origins[SQRT_RAYS_PER_PIXEL * SQRT_RAYS_PER_PIXEL];
+	G3DVector directions[SQRT_RAYS_PER_PIXEL * SQRT_RAYS_PER_PIXEL];
 	G3DVector jitter;
 	int x, y;
 	GRayTraceColor col;
@@ -683,27 +809,30 @@ unsigned int GRayTraceScene::renderPixelAntiAliassed(GRayTraceRay* pRay, G3DVect
 	{
 		for(x = 0; x < SQRT_RAYS_PER_PIXEL; x++)
 		{
-			G3DVector directionVector(pScreenPoint);
+			G3DVector& directionVector = directions[SQRT_RAYS_PER_PIXEL * y + x];
+			directionVector.copy(pScreenPoint);
 
 			// Jitter in X direction
 			jitter.copy(&m_pixDX);
-			jitter.multiply((G3DReal)(((double)x + m_pRand->uniform()) / SQRT_RAYS_PER_PIXEL - .5));
+			jitter.multiply((G3DReal)(((double)x + pRay->m_pRand->uniform()) / SQRT_RAYS_PER_PIXEL - .5));
 			directionVector.add(&jitter);
 
 			// Jitter in Y direction
 			jitter.copy(&m_pixDY);
-			jitter.multiply((G3DReal)(((double)y + m_pRand->uniform()) / SQRT_RAYS_PER_PIXEL - .5));
+			jitter.multiply((G3DReal)(((double)y + pRay->m_pRand->uniform()) / SQRT_RAYS_PER_PIXEL - .5));
 			directionVector.add(&jitter);
 
-			// Cast the ray
+			// Compute the ray
 			directionVector.subtract(m_pCamera->lookFromPoint());
+			G3DVector& lensPoint = origins[SQRT_RAYS_PER_PIXEL * y + x];
+			lensPoint.copy(m_pCamera->lookFromPoint());
 			if(focalDistance > 0)
 			{
 				// Use focus lens -- Start from a random point on the lens and fire at the focal point
 				while(true)
 				{
-					r1 = (G3DReal)(m_pRand->uniform() - .5);
-					r2 = (G3DReal)(m_pRand->uniform() - .5);
+					r1 = (G3DReal)(pRay->m_pRand->uniform() - .5);
+					r2 = (G3DReal)(pRay->m_pRand->uniform() - .5);
 					if((r1 * r1) + (r2 * r2) <= .25)
 						break;
 				}
@@ -714,18 +843,24 @@ unsigned int GRayTraceScene::renderPixelAntiAliassed(GRayTraceRay* pRay, G3DVect
 				directionVector.multiply(focalDistance);
 				directionVector.subtract(&dx);
 				directionVector.subtract(&dy);
-				directionVector.normalize();
-				G3DVector lensPoint(m_pCamera->lookFromPoint());
 				lensPoint.add(&dx);
 				lensPoint.add(&dy);
-				pRay->Cast(this, &lensPoint, &directionVector, m_pCamera->maxDepth());
-			}
-			else
-			{
-				// Perfect focus -- just fire straight
-				directionVector.normalize();
-				pRay->Cast(this, m_pCamera->lookFromPoint(), &directionVector, m_pCamera->maxDepth());
 			}
+			directionVector.normalize();
+		}
+	}
+
+	// Trace the rays in packets
+	for(int i = 0; i < SQRT_RAYS_PER_PIXEL * SQRT_RAYS_PER_PIXEL; i += RAY_PACKET_SIZE)
+	{
+		GRayTracePacket packet;
+		int lanes = std::min(RAY_PACKET_SIZE, SQRT_RAYS_PER_PIXEL * SQRT_RAYS_PER_PIXEL - i);
+		for(int j = 0; j < lanes; j++)
+			packet.set(j, &origins[i + j], &directions[i + j]);
+		m_pBoundingBoxTree->closestIntersections(&packet);
+		for(int j = 0; j < lanes; j++)
+		{
+			pRay->Shade(this, packet.m_pClosest[j], packet.m_closest[j], &packet.m_origin[j], &packet.m_direction[j], m_pCamera->maxDepth());
 
 			// Make sure the color doesn't exceed pure white since it will be added with other measurements
 			pRay->m_color.clip();
@@ -760,12 +895,12 @@ unsigned int GRayTraceScene::renderPixelPathTrace(GRayTraceRay* pRay, G3DVector*
 
 			// Jitter in X direction
 			jitter.copy(&m_pixDX);
-			jitter.multiply((G3DReal)(((double)x + m_pRand->uniform()) / SQRT_RAYS_PER_PIXEL - .5));
+			jitter.multiply((G3DReal)(((double)x + pRay->m_pRand->uniform()) / SQRT_RAYS_PER_PIXEL - .5));
 			directionVector.add(&jitter);
 
 			// Jitter in Y direction
 			jitter.copy(&m_pixDY);
-			jitter.multiply((G3DReal)(((double)y + m_pRand->uniform()) / SQRT_RAYS_PER_PIXEL - .5));
+			jitter.multiply((G3DReal)(((double)y + pRay->m_pRand->uniform()) / SQRT_RAYS_PER_PIXEL - .5));
 			directionVector.add(&jitter);
 
 			// Cast the ray
@@ -775,8 +910,8 @@ unsigned int GRayTraceScene::renderPixelPathTrace(GRayTraceRay* pRay, G3DVector*
 				// Use focus lens -- Start from a random point on the lens and fire at the focal point
 				while(true)
 				{
-					r1 = (G3DReal)(m_pRand->uniform() - .5);
-					r2 = (G3DReal)(m_pRand->uniform() - .5);
+					r1 = (G3DReal)(pRay->m_pRand->uniform() - .5);
+					r2 = (G3DReal)(pRay->m_pRand->uniform() - .5);
 					if((r1 * r1) + (r2 * r2) <= .25)
 						break;
 				}
@@ -812,52 +947,119 @@ unsigned int GRayTraceScene::renderPixelPathTrace(GRayTraceRay* pRay, G3DVector*
 	return col.color();
 }
 
-bool GRayTraceScene::renderLine()
+void GRayTraceScene::renderRow(int y, int left, int right, GRayTraceRay* pRay)
 {
-	if(m_nY < 0)
-		return false;
-	GRayTraceRay ray(m_pRand);
-	int x;
-	G3DVector screenPoint(&m_pixSide);
 	int nWidth = m_pImage->width();
+	G3DReal* pDistanceRow = m_pDistanceMap ? m_pDistanceMap + (size_t)nWidth * y : NULL;
+	G3DVector point;
+	if(m_eMode == FAST_RAY_TRACE)
+	{
+		// Trace the primary rays in packets of adjacent pixels
+		G3DVector* pLookFrom = m_pCamera->lookFromPoint();
+		for(int x = left; x < right; x += RAY_PACKET_SIZE)
+		{
+			GRayTracePacket packet;
+			int lanes = std::min(RAY_PACKET_SIZE, right - x);
+			for(int i = 0; i < lanes; i++)
+			{
+				screenPoint(x + i, y, &point);
+				G3DVector directionVector(&point);
+				directionVector.subtract(pLookFrom);
+				directionVector.normalize();
+				packet.set(i, pLookFrom, &directionVector);
+			}
+			m_pBoundingBoxTree->closestIntersections(&packet);
+			for(int i = 0; i < lanes; i++)
+			{
+				pRay->Shade(this, packet.m_pClosest[i], packet.m_closest[i], &packet.m_origin[i], &packet.m_direction[i], m_pCamera->maxDepth());
+				m_pImage->setPixel(x + i, y, pRay->m_color.color());
+				if(pDistanceRow)
+					pDistanceRow[x + i] = packet.m_closest[i];
+			}
+		}
+		return;
+	}
 	G3DReal distance;
-	G3DReal* pDistance = m_pDistanceMap ? &distance : NULL;
+	G3DReal* pDistance = pDistanceRow ? &distance : NULL;
 	unsigned int col = 0;
-	for(x = 0; x < nWidth; x++)
+	for(int x = left; x < right; x++)
 	{
-//GAssert(x != 100 || m_nY != 143); // break
+		screenPoint(x, y, &point);
 		switch(m_eMode)
 		{
-			case FAST_RAY_TRACE:
-				col = renderPixel(&ray, &screenPoint, pDistance);
-				break;
 			case QUALITY_RAY_TRACE:
-				col = renderPixelAntiAliassed(&ray, &screenPoint, pDistance);
+				col = renderPixelAntiAliassed(pRay, &point, pDistance);
 				break;
 			case PATH_TRACE:
-				col = renderPixelPathTrace(&ray, &screenPoint);
+				col = renderPixelPathTrace(pRay, &point);
 				break;
 			default:
 				GAssert(false); // unrecognized case
 		}
-		m_pImage->setPixel(x, m_nY, col);
-		if(pDistance)
-			m_pDistanceMap[nWidth * m_nY + x] = distance;
-		screenPoint.add(&m_pixDX);
+		m_pImage->setPixel(x, y, col);
+		if(pDistanceRow)
+			pDistanceRow[x] = distance;
 	}
-	m_pixSide.add(&m_pixDY);
+}
+
+bool GRayTraceScene::renderLine()
+{
+	if(m_nY < 0)
+		return false;
+	GRayTraceRay ray(m_pRand);
+	renderRow(m_nY, 0, m_pImage->width(), &ray);
 	if(--m_nY >= 0)
 		return true;
 	else
 		return false;
 }
 
-void GRayTraceScene::render()
+#define RAY_TRACE_TILE_SIZE 32
+
+class GRayTraceTileWorker : public GWorkerThread
 {
-	renderBegin();
-	while(renderLine())
+protected:
+	GRayTraceScene* m_pScene;
+	uint64_t m_seed;
+	int m_tilesAcross;
+
+public:
+	GRayTraceTileWorker(GMasterThread& master, GRayTraceScene* pScene, uint64_t seed, int tilesAcross)
+	: GWorkerThread(master), m_pScene(pScene), m_seed(seed), m_tilesAcross(tilesAcross)
+	{
+	}
+
+	virtual ~GRayTraceTileWorker()
 	{
 	}
+
+	virtual void doJob(size_t jobId)
+	{
+		// Each tile has its own random number generator, so the image does not depend on which thread renders it
+		GRand rand(m_seed + jobId);
+		GRayTraceRay ray(&rand);
+		GImage* pImage = m_pScene->image();
+		int left = ((int)jobId % m_tilesAcross) * RAY_TRACE_TILE_SIZE;
+		int top = ((int)jobId / m_tilesAcross) * RAY_TRACE_TILE_SIZE;
+		int right = std::min((int)pImage->width(), left + RAY_TRACE_TILE_SIZE);
+		int bottom = std::min((int)pImage->height(), top + RAY_TRACE_TILE_SIZE);
+		for(int y = top; y < bottom; y++)
+			m_pScene->renderRow(y, left, right, &ray);
+	}
+};
+
+void GRayTraceScene::render()
+{
+	renderBegin();
+	int tilesAcross = ((int)m_pImage->width() + RAY_TRACE_TILE_SIZE - 1) / RAY_TRACE_TILE_SIZE;
+	int tilesDown = ((int)m_pImage->height() + RAY_TRACE_TILE_SIZE - 1) / RAY_TRACE_TILE_SIZE;
+	size_t tiles = (size_t)tilesAcross * tilesDown;
+	uint64_t seed = m_pRand->next();
+	GMasterThread master;
+	for(size_t i = 0; i < std::max((size_t)1, std::min(m_workerThreads, tiles)); i++)
+		master.addWorker(new GRayTraceTileWorker(master, this, seed, tilesAcross));
+	master.doJobs(tiles);
+	m_nY = -1;
 }
 
 unsigned int GRayTraceScene::renderSinglePixel(int x, int y)
@@ -866,18 +1068,110 @@ unsigned int GRayTraceScene::renderSinglePixel(int x, int y)
 	renderBegin();
 
 	// Compute the screen point
-	G3DVector screenPoint(&m_pixSide);
-	m_pixDY.multiply((G3DReal)(m_pImage->height() - 1 - y));
-	screenPoint.add(&m_pixDY);
-	m_pixDX.multiply((G3DReal)(m_pImage->width() - 1 - x));
-	screenPoint.add(&m_pixDX);
+	G3DVector point;
+	screenPoint(x, y, &point);
 
 	// Cast the ray
 	GRayTraceRay ray(m_pRand);
-	unsigned int c = renderPixel(&ray, &screenPoint, NULL);
+	unsigned int c = renderPixel(&ray, &point, NULL);
 	return c;
 }
 
+#ifndef NO_TEST_CODE
+void GRayTraceScene_testScene(GRayTraceScene& scene, GRand& rand)
+{
+	GRayTracePhysicalMaterial* pMaterial = new GRayTracePhysicalMaterial();
+	scene.addMaterial(pMaterial);
+	pMaterial->setColor(GRayTraceMaterial::Diffuse, (G3DReal).8, (G3DReal).6, (G3DReal).1);
+	pMaterial->setColor(GRayTraceMaterial::Reflective, (G3DReal).3, (G3DReal).3, (G3DReal).2);
+	for(size_t i = 0; i < 60; i++)
+		scene.addObject(new GRayTraceSphere(pMaterial, (G3DReal)(rand.uniform() * 4 - 2), (G3DReal)(rand.uniform() * 4 - 2), (G3DReal)(rand.uniform() * 4 - 2), (G3DReal)(0.05 + 0.3 * rand.uniform())));
+	scene.addLight(new GRayTraceDirectionalLight((G3DReal).1, (G3DReal).7, (G3DReal).3, (G3DReal).8, (G3DReal).8, 1, (G3DReal).05));
+	GRayTraceCamera* pCamera = scene.camera();
+	pCamera->setImageSize(70, 50);
+	G3DVector dir((G3DReal)-.35, (G3DReal)-.15, (G3DReal)-.5);
+	G3DVector* pPos = pCamera->lookFromPoint();
+	pPos->copy(&dir);
+	pPos->multiply(-1);
+	pPos->normalize();
+	pPos->multiply(6);
+	pCamera->setDirection(&dir, (G3DReal)0);
+}
+
+// static
+void GRayTraceScene::test()
+{
+	// Check that the bounding box tree finds the same intersections as a brute-force search
+	GRand rand(0);
+	GRayTraceScene scene(&rand);
+	GRayTraceScene_testScene(scene, rand);
+	scene.renderBegin();
+	for(size_t i = 0; i < 100; i++)
+	{
+		GRayTracePacket packet;
+		for(size_t j = 0; j < RAY_PACKET_SIZE; j++)
+		{
+			G3DVector origin((G3DReal)(rand.uniform() * 6 - 3), (G3DReal)(rand.uniform() * 6 - 3), (G3DReal)(rand.uniform() * 6 - 3));
+			G3DVector direction((G3DReal)rand.normal(), (G3DReal)rand.normal(), (G3DReal)rand.normal());
+			direction.normalize();
+			packet.set(j, &origin, &direction);
+		}
+		scene.boundingBoxTree()->closestIntersections(&packet);
+		for(size_t j = 0; j < RAY_PACKET_SIZE; j++)
+		{
+			G3DReal closestDistance = (G3DReal)1e30;
+			GRayTraceObject* pClosestObject = NULL;
+			for(size_t k = 0; k < scene.objectCount(); k++)
+			{
+				G3DReal d = scene.object(k)->rayDistance(&packet.m_origin[j], &packet.m_direction[j]);
+				if(d < closestDistance && d > MIN_RAY_DISTANCE)
+				{
+					closestDistance = d;
+					pClosestObject = scene.object(k);
+				}
+			}
+			G3DReal distance;
+			if(scene.boundingBoxTree()->closestIntersection(&packet.m_origin[j], &packet.m_direction[j], &distance) != pClosestObject || distance != closestDistance)
+				throw Ex("The bounding box tree missed the closest intersection");
+			if(packet.m_pClosest[j] != pClosestObject || packet.m_closest[j] != closestDistance)
+				throw Ex("The packet missed the closest intersection");
+		}
+	}
+
+	// Check that rendering with several threads produces the same image as rendering with one
+	RenderMode modes[] = { FAST_RAY_TRACE, QUALITY_RAY_TRACE };
+	for(size_t i = 0; i < 2; i++)
+	{
+		GRand rand1(1234);
+		GRayTraceScene scene1(&rand1);
+		GRayTraceScene_testScene(scene1, rand1);
+		scene1.setRenderMode(modes[i]);
+		scene1.render();
+		GRand rand2(1234);
+		GRayTraceScene scene2(&rand2);
+		GRayTraceScene_testScene(scene2, rand2);
+		scene2.setRenderMode(modes[i]);
+		scene2.setWorkerThreads(3);
+		scene2.render();
+		GImage* pImage1 = scene1.image();
+		GImage* pImage2 = scene2.image();
+		size_t background = 0;
+		for(unsigned int y = 0; y < pImage1->height(); y++)
+		{
+			for(unsigned int x = 0; x < pImage1->width(); x++)
+			{
+				if(pImage1->pixel(x, y) != pImage2->pixel(x, y))
+					throw Ex("The image depends on the number of threads");
+				if(pImage1->pixel(x, y) == scene1.backgroundColor()->color())
+					background++;
+			}
+		}
+		if(background == 0 || background == (size_t)pImage1->width() * pImage1->height())
+			throw Ex("Expected some of the spheres to be visible");
+	}
+}
+#endif // !NO_TEST_CODE
+
 // -----------------------------------------------------------------------------
 
 GRayTraceLight::GRayTraceLight(G3DReal r, G3DReal g, G3DReal b)
@@ -949,7 +1243,7 @@ GDomNode* GRayTraceDirectionalLight::serialize(GDom* pDoc, const GRayTraceScene*
 {
 	G3DVector direction(&m_direction);
 	if(m_jitter > 0)
-		GRayTraceRay::JitterRay(&direction, m_jitter, pScene->rand());
+		GRayTraceRay::JitterRay(&direction, m_jitter, pRay->m_pRand);
 
 	// Check if the point is in a shadow
 	G3DReal distance;
@@ -1008,9 +1302,9 @@ GDomNode* GRayTracePointLight::serialize(GDom* pDoc, const GRayTraceScene* pScen
 	if(m_jitter > 0)
 	{
 		// Jitter light position (to create soft shadows)
-		lightDirection.m_vals[0] += (G3DReal)(m_jitter * 2 * pScene->rand()->uniform() - m_jitter);
-		lightDirection.m_vals[1] += (G3DReal)(m_jitter * 2 * pScene->rand()->uniform() - m_jitter);
-		lightDirection.m_vals[2] += (G3DReal)(m_jitter * 2 * pScene->rand()->uniform() - m_jitter);
+		lightDirection.m_vals[0] += (G3DReal)(m_jitter * 2 * pRay->m_pRand->uniform() - m_jitter);
+		lightDirection.m_vals[1] += (G3DReal)(m_jitter * 2 * pRay->m_pRand->uniform() - m_jitter);
+		lightDirection.m_vals[2] += (G3DReal)(m_jitter * 2 * pRay->m_pRand->uniform() - m_jitter);
 	}
 
 	// Check if the point is in a shadow
@@ -1079,8 +1373,8 @@ GDomNode* GRayTraceAreaLight::serialize(GDom* pDoc, const GRayTraceScene* pScene
 		u.subtract(pTri->vertex(0));
 		G3DVector v(pTri->vertex(2));
 		v.subtract(pTri->vertex(0));
-		double a = pScene->rand()->uniform() * 2 - 1;
-		double b = pScene->rand()->uniform() * 2 - 1;
+		double a = pRay->m_pRand->uniform() * 2 - 1;
+		double b = pRay->m_pRand->uniform() * 2 - 1;
 		if(a + b > 1)
 		{
 			a = 1 - a;
@@ -1115,8 +1409,8 @@ GDomNode* GRayTraceAreaLight::serialize(GDom* pDoc, const GRayTraceScene* pScene
 		double a, b;
 		while(true)
 		{
-			a = pScene->rand()->uniform() * 2 - 1;
-			b = pScene->rand()->uniform() * 2 - 1;
+			a = pRay->m_pRand->uniform() * 2 - 1;
+			b = pRay->m_pRand->uniform() * 2 - 1;
 			if((a * a) + (b * b) < 1)
 				break;
 		}
@@ -1381,92 +1675,187 @@ GRayTraceColor* GRayTraceImageTexture::color(ColorType eType, GRayTraceRay* pRay
 			G3DReal x, y;
 			pRay->GetTextureCoords(&x, &y);
 			y = m_pTextureImage->height() - y;
-			m_col.set(m_pTextureImage->interpolatePixel((float)x, (float)y));
+			pRay->m_texel.set(m_pTextureImage->interpolatePixel((float)x, (float)y));
 		}
 		else
-			m_col.set(1, 0, 1, 1); // if you see cyan, you forgot to set the texture image
-		return &m_col;
+			pRay->m_texel.set(1, 0, 1, 1); // if you see cyan, you forgot to set the texture image
+		return &pRay->m_texel;
 	}
 	else
 	{
-		m_col.set(1, 0, 0, 0);
-		return &m_col;
+		pRay->m_texel.set(1, 0, 0, 0);
+		return &pRay->m_texel;
 	}
 }
 
 
 // -----------------------------------------------------------------------------
 
-class Ray_Trace_Object_Comparing_Functor
+#define SAH_BIN_COUNT 16
+
+// Holds the bounding box and center of an object while the bounding box tree is being built
+class GRayTraceBuildItem
+{
+public:
+	GRayTraceObject* m_pObject;
+	G3DVector m_min;
+	G3DVector m_max;
+	G3DVector m_center;
+	int m_bin;
+};
+
+// Returns the surface area of a box
+static G3DReal GRayTraceBoundingBox_area(const G3DVector& min, const G3DVector& max)
+{
+	G3DReal dx = std::max((G3DReal)0, max.m_vals[0] - min.m_vals[0]);
+	G3DReal dy = std::max((G3DReal)0, max.m_vals[1] - min.m_vals[1]);
+	G3DReal dz = std::max((G3DReal)0, max.m_vals[2] - min.m_vals[2]);
+	return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+// Expands the box (pMin, pMax) to include the box (min, max)
+static void GRayTraceBoundingBox_grow(G3DVector* pMin, G3DVector* pMax, const G3DVector& min, const G3DVector& max)
+{
+	for(size_t i = 0; i < 3; i++)
+	{
+		pMin->m_vals[i] = std::min(pMin->m_vals[i], min.m_vals[i]);
+		pMax->m_vals[i] = std::max(pMax->m_vals[i], max.m_vals[i]);
+	}
+}
+
+class GRayTraceBuildItem_binComparer
 {
 protected:
-	int m_dim;
+	int m_split;
 
 public:
-	Ray_Trace_Object_Comparing_Functor(int dim) : m_dim(dim)
+	GRayTraceBuildItem_binComparer(int split) : m_split(split)
 	{
 	}
 
-	bool operator() (GRayTraceObject* pA, GRayTraceObject* pB) const
+	bool operator() (const GRayTraceBuildItem& item) const
 	{
-		G3DVector a, b;
-		pA->center(&a);
-		pB->center(&b);
-		return (a.m_vals[m_dim] < b.m_vals[m_dim]);
+		return item.m_bin < m_split;
 	}
 };
 
-//static
-GRayTraceBoundingBoxBase* GRayTraceBoundingBoxBase::BuildTree(vector<GRayTraceObject*>& objects)
+// Builds a subtree for items[begin] through items[end - 1]. The objects are binned along each axis
+// by their centers, and the split that minimizes the surface area heuristic is chosen.
+static GRayTraceBoundingBoxBase* GRayTraceBoundingBox_build(vector<GRayTraceBuildItem>& items, size_t begin, size_t end)
 {
 	// Make a leaf node if we can
-	if(objects.size() <= MAX_OBJECTS_PER_BOUNDING_BOX)
+	size_t count = end - begin;
+	if(count <= MAX_OBJECTS_PER_BOUNDING_BOX)
+	{
+		vector<GRayTraceObject*> objects;
+		objects.reserve(count);
+		for(size_t i = begin; i < end; i++)
+			objects.push_back(items[i].m_pObject);
 		return new GRayTraceBoundingBoxLeaf(objects);
+	}
 
-	// Find the biggest dimension
-	double dBiggestRange = 0;
-	int nBiggestDim = -1;
-	double dRange;
-	int i;
-	GRayTraceObject* pFirst;
-	GRayTraceObject* pLast;
-	G3DVector vFirst, vLast;
-	for(i = 0; i < 3; i++)
-	{
-		Ray_Trace_Object_Comparing_Functor comparer(i);
-		std::sort(objects.begin(), objects.end(), comparer);
-		pFirst = objects[0];
-		pLast = objects[objects.size() - 1];
-		pFirst->center(&vFirst);
-		pLast->center(&vLast);
-		dRange = vLast.m_vals[i] - vFirst.m_vals[i];
-		if(dRange > dBiggestRange)
+	// Find the range of the centers
+	G3DVector cMin((G3DReal)1e30, (G3DReal)1e30, (G3DReal)1e30);
+	G3DVector cMax((G3DReal)-1e30, (G3DReal)-1e30, (G3DReal)-1e30);
+	for(size_t i = begin; i < end; i++)
+		GRayTraceBoundingBox_grow(&cMin, &cMax, items[i].m_center, items[i].m_center);
+
+	// Find the split with the lowest cost
+	G3DReal bestCost = (G3DReal)1e300;
+	int bestAxis = -1;
+	int bestSplit = 0;
+	size_t binCounts[SAH_BIN_COUNT];
+	G3DVector binMin[SAH_BIN_COUNT];
+	G3DVector binMax[SAH_BIN_COUNT];
+	G3DReal rightCost[SAH_BIN_COUNT];
+	for(int axis = 0; axis < 3; axis++)
+	{
+		G3DReal extent = cMax.m_vals[axis] - cMin.m_vals[axis];
+		if(extent <= 0)
+			continue;
+
+		// Put the objects in bins
+		for(size_t j = 0; j < SAH_BIN_COUNT; j++)
+		{
+			binCounts[j] = 0;
+			binMin[j].set((G3DReal)1e30, (G3DReal)1e30, (G3DReal)1e30);
+			binMax[j].set((G3DReal)-1e30, (G3DReal)-1e30, (G3DReal)-1e30);
+		}
+		for(size_t i = begin; i < end; i++)
+		{
+			int bin = std::min(SAH_BIN_COUNT - 1, (int)((items[i].m_center.m_vals[axis] - cMin.m_vals[axis]) * SAH_BIN_COUNT / extent));
+			binCounts[bin]++;
+			GRayTraceBoundingBox_grow(&binMin[bin], &binMax[bin], items[i].m_min, items[i].m_max);
+		}
+
+		// Sweep from the right to compute the cost of everything at or above each bin
+		G3DVector min((G3DReal)1e30, (G3DReal)1e30, (G3DReal)1e30);
+		G3DVector max((G3DReal)-1e30, (G3DReal)-1e30, (G3DReal)-1e30);
+		size_t n = 0;
+		for(int j = SAH_BIN_COUNT - 1; j > 0; j--)
 		{
-			nBiggestDim = i;
-			dBiggestRange = dRange;
+			n += binCounts[j];
+			GRayTraceBoundingBox_grow(&min, &max, binMin[j], binMax[j]);
+			rightCost[j] = n > 0 ? GRayTraceBoundingBox_area(min, max) * n : 0;
+		}
+
+		// Sweep from the left to find the best split on this axis
+		min.set((G3DReal)1e30, (G3DReal)1e30, (G3DReal)1e30);
+		max.set((G3DReal)-1e30, (G3DReal)-1e30, (G3DReal)-1e30);
+		n = 0;
+		for(int j = 1; j < SAH_BIN_COUNT; j++)
+		{
+			n += binCounts[j - 1];
+			GRayTraceBoundingBox_grow(&min, &max, binMin[j - 1], binMax[j - 1]);
+			if(n == 0 || n == count)
+				continue;
+			G3DReal cost = GRayTraceBoundingBox_area(min, max) * n + rightCost[j];
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = j;
+			}
 		}
 	}
 
-	// Split into two arrays
-	if(nBiggestDim != 2)
+	// Split into two ranges
+	size_t mid;
+	if(bestAxis >= 0)
 	{
-		Ray_Trace_Object_Comparing_Functor comparer(nBiggestDim);
-		std::sort(objects.begin(), objects.end(), comparer);
+		G3DReal extent = cMax.m_vals[bestAxis] - cMin.m_vals[bestAxis];
+		for(size_t i = begin; i < end; i++)
+			items[i].m_bin = std::min(SAH_BIN_COUNT - 1, (int)((items[i].m_center.m_vals[bestAxis] - cMin.m_vals[bestAxis]) * SAH_BIN_COUNT / extent));
+		GRayTraceBuildItem_binComparer comparer(bestSplit);
+		mid = std::partition(items.begin() + begin, items.begin() + end, comparer) - items.begin();
 	}
-	int nSize = (int)objects.size();
-	int nLesserSize = nSize / 2;
-	vector<GRayTraceObject*> other;
-	other.reserve(nSize - nLesserSize);
-	for(i = nSize - 1; i >= nLesserSize; i--)
+	else
 	{
-		other.push_back(objects[objects.size() - 1]);
-		objects.pop_back();
+		// All of the centers are the same, so just split them in half
+		bestAxis = 0;
+		mid = begin + count / 2;
 	}
 
 	// Make an interior node
-	GRayTraceBoundingBoxBase* pLesser = BuildTree(objects);
-	GRayTraceBoundingBoxBase* pGreater = BuildTree(other);
-	return new GRayTraceBoundingBoxInterior(pLesser, pGreater);
+	GRayTraceBoundingBoxBase* pLesser = GRayTraceBoundingBox_build(items, begin, mid);
+	GRayTraceBoundingBoxBase* pGreater = GRayTraceBoundingBox_build(items, mid, end);
+	return new GRayTraceBoundingBoxInterior(pLesser, pGreater, bestAxis);
+}
+
+//static
+GRayTraceBoundingBoxBase* GRayTraceBoundingBoxBase::BuildTree(vector<GRayTraceObject*>& objects)
+{
+	vector<GRayTraceBuildItem> items(objects.size());
+	for(size_t i = 0; i < objects.size(); i++)
+	{
+		GRayTraceBuildItem& item = items[i];
+		item.m_pObject = objects[i];
+		item.m_min.set((G3DReal)1e30, (G3DReal)1e30, (G3DReal)1e30);
+		item.m_max.set((G3DReal)-1e30, (G3DReal)-1e30, (G3DReal)-1e30);
+		objects[i]->adjustBoundingBox(&item.m_min, &item.m_max);
+		objects[i]->center(&item.m_center);
+	}
+	return GRayTraceBoundingBox_build(items, 0, items.size());
 }
 
 //static
@@ -1482,87 +1871,82 @@ GRayTraceBoundingBoxBase* GRayTraceBoundingBoxBase::makeBoundingBoxTree(GRayTrac
 	return BuildTree(objects);
 }
 
-bool GRayTraceBoundingBoxBase::DoesRayHitBox(G3DVector* pRayOrigin, G3DVector* pDirectionVector)
+GRayTraceObject* GRayTraceBoundingBoxBase::closestIntersection(G3DVector* pRayOrigin, G3DVector* pDirectionVector, G3DReal* pOutDistance)
 {
-	G3DVector point;
-	if(pDirectionVector->m_vals[0] != 0)
-	{
-		point.copy(pDirectionVector);
-		point.multiply((m_min.m_vals[0] - pRayOrigin->m_vals[0]) / pDirectionVector->m_vals[0]);
-		point.add(pRayOrigin);
-		if(point.m_vals[1] >= m_min.m_vals[1] && point.m_vals[2] >= m_min.m_vals[2] &&
-			point.m_vals[1] <= m_max.m_vals[1] && point.m_vals[2] <= m_max.m_vals[2])
-			return true;
-		point.copy(pDirectionVector);
-		point.multiply((m_max.m_vals[0] - pRayOrigin->m_vals[0]) / pDirectionVector->m_vals[0]);
-		point.add(pRayOrigin);
-		if(point.m_vals[1] >= m_min.m_vals[1] && point.m_vals[2] >= m_min.m_vals[2] &&
-			point.m_vals[1] <= m_max.m_vals[1] && point.m_vals[2] <= m_max.m_vals[2])
-			return true;
-	}
-	if(pDirectionVector->m_vals[1] != 0)
-	{
-		point.copy(pDirectionVector);
-		point.multiply((m_min.m_vals[1] - pRayOrigin->m_vals[1]) / pDirectionVector->m_vals[1]);
-		point.add(pRayOrigin);
-		if(point.m_vals[0] >= m_min.m_vals[0] && point.m_vals[2] >= m_min.m_vals[2] &&
-			point.m_vals[0] <= m_max.m_vals[0] && point.m_vals[2] <= m_max.m_vals[2])
-			return true;
-		point.copy(pDirectionVector);
-		point.multiply((m_max.m_vals[1] - pRayOrigin->m_vals[1]) / pDirectionVector->m_vals[1]);
-		point.add(pRayOrigin);
-		if(point.m_vals[0] >= m_min.m_vals[0] && point.m_vals[2] >= m_min.m_vals[2] &&
-			point.m_vals[0] <= m_max.m_vals[0] && point.m_vals[2] <= m_max.m_vals[2])
-			return true;
-	}
-	if(pDirectionVector->m_vals[2] != 0)
-	{
-		point.copy(pDirectionVector);
-		point.multiply((m_min.m_vals[2] - pRayOrigin->m_vals[2]) / pDirectionVector->m_vals[2]);
-		point.add(pRayOrigin);
-		if(point.m_vals[0] >= m_min.m_vals[0] && point.m_vals[1] >= m_min.m_vals[1] &&
-			point.m_vals[0] <= m_max.m_vals[0] && point.m_vals[1] <= m_max.m_vals[1])
-			return true;
-		point.copy(pDirectionVector);
-		point.multiply((m_max.m_vals[2] - pRayOrigin->m_vals[2]) / pDirectionVector->m_vals[2]);
-		point.add(pRayOrigin);
-		if(point.m_vals[0] >= m_min.m_vals[0] && point.m_vals[1] >= m_min.m_vals[1] &&
-			point.m_vals[0] <= m_max.m_vals[0] && point.m_vals[1] <= m_max.m_vals[1])
-			return true;
+	G3DReal invDirection[3];
+	for(size_t i = 0; i < 3; i++)
+		invDirection[i] = GRayTracePacket::inverse(pDirectionVector->m_vals[i]);
+	G3DReal closestDistance = (G3DReal)1e30;
+	GRayTraceObject* pClosestObject = NULL;
+	findClosest(pRayOrigin, pDirectionVector, invDirection, &closestDistance, &pClosestObject);
+	*pOutDistance = closestDistance;
+	return pClosestObject;
+}
+
+void GRayTraceBoundingBoxBase::closestIntersections(GRayTracePacket* pPacket)
+{
+	findClosest(pPacket);
+}
+
+bool GRayTraceBoundingBoxBase::doesRayHitBox(G3DVector* pRayOrigin, const G3DReal* pInvDirection, G3DReal closestDistance)
+{
+	// This uses the same arithmetic as GRayTracePacket::hitsBox, so both find the same intersections
+	G3DReal tNear = (G3DReal)-1e300;
+	G3DReal tFar = closestDistance;
+	for(size_t i = 0; i < 3; i++)
+	{
+		G3DReal t1 = (m_min.m_vals[i] - pRayOrigin->m_vals[i]) * pInvDirection[i];
+		G3DReal t2 = (m_max.m_vals[i] - pRayOrigin->m_vals[i]) * pInvDirection[i];
+		tNear = std::max(tNear, std::min(t1, t2));
+		tFar = std::min(tFar, std::max(t1, t2));
 	}
-	return false;
+	return tNear <= tFar && tFar >= 0;
 }
 
 // -----------------------------------------------------------------------------
 
 // virtual
-GRayTraceObject* GRayTraceBoundingBoxInterior::closestIntersection(G3DVector* pRayOrigin, G3DVector* pDirectionVector, G3DReal* pOutDistance)
+void GRayTraceBoundingBoxInterior::findClosest(G3DVector* pRayOrigin, G3DVector* pDirectionVector, const G3DReal* pInvDirection, G3DReal* pClosestDistance, GRayTraceObject** ppClosestObject)
 {
-	if(!DoesRayHitBox(pRayOrigin, pDirectionVector))
-		return NULL;
-	G3DReal lesserDist = 0;
-	G3DReal greaterDist = 0;
-	GRayTraceObject* pLesser = m_pLesser->closestIntersection(pRayOrigin, pDirectionVector, &lesserDist);
-	GRayTraceObject* pGreater = m_pGreater->closestIntersection(pRayOrigin, pDirectionVector, &greaterDist);
-	if(!pGreater)
+	if(!doesRayHitBox(pRayOrigin, pInvDirection, *pClosestDistance))
+		return;
+
+	// Visit the nearer child first, so the farther one can often be skipped
+	if(pDirectionVector->m_vals[m_axis] >= 0)
+	{
+		m_pLesser->findClosest(pRayOrigin, pDirectionVector, pInvDirection, pClosestDistance, ppClosestObject);
+		m_pGreater->findClosest(pRayOrigin, pDirectionVector, pInvDirection, pClosestDistance, ppClosestObject);
+	}
+	else
 	{
-		*pOutDistance = lesserDist;
-		return pLesser;
+		m_pGreater->findClosest(pRayOrigin, pDirectionVector, pInvDirection, pClosestDistance, ppClosestObject);
+		m_pLesser->findClosest(pRayOrigin, pDirectionVector, pInvDirection, pClosestDistance, ppClosestObject);
 	}
-	if(!pLesser)
+}
+
+// virtual
+void GRayTraceBoundingBoxInterior::findClosest(GRayTracePacket* pPacket)
+{
+	int mask = pPacket->hitsBox(m_min, m_max);
+	if(!mask)
+		return;
+
+	// Visit first the child that is nearer for most of the rays
+	G3DReal sum = 0;
+	for(size_t i = 0; i < RAY_PACKET_SIZE; i++)
 	{
-		*pOutDistance = greaterDist;
-		return pGreater;
+		if(mask & (1 << i))
+			sum += pPacket->m_direction[i].m_vals[m_axis];
 	}
-	if(lesserDist < greaterDist)
+	if(sum >= 0)
 	{
-		*pOutDistance = lesserDist;
-		return pLesser;
+		m_pLesser->findClosest(pPacket);
+		m_pGreater->findClosest(pPacket);
 	}
 	else
 	{
-		*pOutDistance = greaterDist;
-		return pGreater;
+		m_pGreater->findClosest(pPacket);
+		m_pLesser->findClosest(pPacket);
 	}
 }
 
@@ -1580,6 +1964,14 @@ GRayTraceBoundingBoxLeaf::GRayTraceBoundingBoxLeaf(vector<GRayTraceObject*>& obj
 		m_pObjects[i] = objects[i];
 		m_pObjects[i]->adjustBoundingBox(&m_min, &m_max);
 	}
+
+	// Pad the box a little, so rounding errors in the slab test cannot make grazing rays miss it
+	for(i = 0; i < 3; i++)
+	{
+		G3DReal pad = (G3DReal)1e-9 * (1 + std::max(std::abs(m_min.m_vals[i]), std::abs(m_max.m_vals[i])));
+		m_min.m_vals[i] -= pad;
+		m_max.m_vals[i] += pad;
+	}
 }
 
 //virtual
@@ -1589,27 +1981,39 @@ GRayTraceBoundingBoxLeaf::~GRayTraceBoundingBoxLeaf()
 }
 
 // virtual
-GRayTraceObject* GRayTraceBoundingBoxLeaf::closestIntersection(G3DVector* pRayOrigin, G3DVector* pDirectionVector, G3DReal* pOutDistance)
+void GRayTraceBoundingBoxLeaf::findClosest(G3DVector* pRayOrigin, G3DVector* pDirectionVector, const G3DReal* pInvDirection, G3DReal* pClosestDistance, GRayTraceObject** ppClosestObject)
 {
-	if(!DoesRayHitBox(pRayOrigin, pDirectionVector))
-		return NULL;
+	if(!doesRayHitBox(pRayOrigin, pInvDirection, *pClosestDistance))
+		return;
+	for(int n = 0; n < m_nObjectCount; n++)
+	{
+		G3DReal distance = m_pObjects[n]->rayDistance(pRayOrigin, pDirectionVector);
+		if(distance < *pClosestDistance && distance > MIN_RAY_DISTANCE)
+		{
+			*pClosestDistance = distance;
+			*ppClosestObject = m_pObjects[n];
+		}
+	}
+}
 
-	// Find the closest intersection
-	G3DReal distance;
-	G3DReal closestDistance = (G3DReal)1e30;
-	GRayTraceObject* pClosestObject = NULL;
-	int n;
-	for(n = 0; n < m_nObjectCount; n++)
+// virtual
+void GRayTraceBoundingBoxLeaf::findClosest(GRayTracePacket* pPacket)
+{
+	int mask = pPacket->hitsBox(m_min, m_max);
+	for(size_t i = 0; mask; i++, mask >>= 1)
 	{
-		distance = m_pObjects[n]->rayDistance(pRayOrigin, pDirectionVector);
-		if(distance < closestDistance && distance > MIN_RAY_DISTANCE)
+		if(!(mask & 1))
+			continue;
+		for(int n = 0; n < m_nObjectCount; n++)
 		{
-			closestDistance = distance;
-			pClosestObject = m_pObjects[n];
+			G3DReal distance = m_pObjects[n]->rayDistance(&pPacket->m_origin[i], &pPacket->m_direction[i]);
+			if(distance < pPacket->m_closest[i] && distance > MIN_RAY_DISTANCE)
+			{
+				pPacket->m_closest[i] = distance;
+				pPacket->m_pClosest[i] = m_pObjects[n];
+			}
 		}
 	}
-	*pOutDistance = closestDistance;
-	return pClosestObject;
 }
 
 // -----------------------------------------------------------------------------
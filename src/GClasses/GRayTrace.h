@@ -32,6 +32,7 @@ class GRayTraceLight;
 class GRayTraceMaterial;
 class GRayTraceObject;
 class GRayTraceRay;
+class GRayTracePacket;
 class GRayTraceScene;
 class GRayTraceTriMesh;
 class GRayTraceBoundingBoxBase;
@@ -200,6 +201,7 @@ protected:
 	G3DVector m_pixDX;
 	G3DVector m_pixDY;
 	GRand* m_pRand;
+	size_t m_workerThreads;
 
 public:
 	GRayTraceScene(GRand* pRand);
@@ -220,8 +222,13 @@ public:
 	/// Specify whether to emphasize quality or speed
 	void setRenderMode(RenderMode eMode) { m_eMode = eMode; }
 
-	/// This method calls RenderBegin, then calls RenderLine until
-	/// the whole image has been rendered.
+	/// Specify the number of threads that render should use. (The default is 1.)
+	void setWorkerThreads(size_t count) { m_workerThreads = count; }
+
+	/// This method calls RenderBegin, then renders the whole image in square tiles.
+	/// The tiles are distributed across the number of threads specified by setWorkerThreads.
+	/// Each tile draws its random values from its own GRand, seeded from the scene's GRand,
+	/// so the image does not depend on the number of threads.
 	void render();
 
 	/// Call this before calling RenderLine(). It resets the image and
@@ -294,9 +301,22 @@ public:
 	size_t meshIndex(GRayTraceTriMesh* pMesh) const;
 	size_t objectIndex(GRayTraceObject* pObj) const;
 
+	/// Renders the pixels from left (inclusive) to right (exclusive) in row y of the image.
+	/// (Rays are traced in packets where possible.) pRay supplies the random number generator.
+	/// This is thread-safe as long as each thread uses its own pRay and renders different pixels.
+	void renderRow(int y, int left, int right, GRayTraceRay* pRay);
+
+	/// Computes the point on the screen through which the ray for pixel (x, y) passes.
+	void screenPoint(int x, int y, G3DVector* pOutPoint);
+
 	unsigned int renderPixel(GRayTraceRay* pRay, G3DVector* pScreenPoint, G3DReal* pDistance);
 	unsigned int renderPixelAntiAliassed(GRayTraceRay* pRay, G3DVector* pScreenPoint, G3DReal* pDistance);
 	unsigned int renderPixelPathTrace(GRayTraceRay* pRay, G3DVector* pScreenPoint);
+
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // !NO_TEST_CODE
 };
 
 
@@ -472,7 +492,6 @@ class GRayTraceImageTexture : public GRayTraceMaterial
 protected:
 	GImage* m_pTextureImage;
 	bool m_bDeleteTextureImage;
-	GRayTraceColor m_col;
 
 public:
 	GRayTraceImageTexture();
@@ -509,13 +528,32 @@ public:
 	GRayTraceBoundingBoxBase() {}
 	virtual ~GRayTraceBoundingBoxBase() {}
 
+	/// Builds a tree of bounding boxes around all the objects in the scene.
+	/// Each split is chosen to minimize the surface area heuristic.
 	static GRayTraceBoundingBoxBase* makeBoundingBoxTree(GRayTraceScene* pScene);
 	virtual bool isLeaf() = 0;
-	virtual GRayTraceObject* closestIntersection(G3DVector* pRayOrigin, G3DVector* pDirectionVector, G3DReal* pOutDistance) = 0;
+
+	/// Returns the closest object that the ray intersects (and its distance
+	/// at pOutDistance), or NULL if the ray does not hit anything.
+	GRayTraceObject* closestIntersection(G3DVector* pRayOrigin, G3DVector* pDirectionVector, G3DReal* pOutDistance);
+
+	/// Finds the closest intersection of each ray in the packet. The slab tests
+	/// against each bounding box are performed for all rays in the packet at once.
+	void closestIntersections(GRayTracePacket* pPacket);
 
 protected:
 	static GRayTraceBoundingBoxBase* BuildTree(std::vector<GRayTraceObject*>& objects);
-	bool DoesRayHitBox(G3DVector* pRayOrigin, G3DVector* pDirectionVector);
+
+	/// Returns true if the ray enters this box before it travels *pClosestDistance.
+	bool doesRayHitBox(G3DVector* pRayOrigin, const G3DReal* pInvDirection, G3DReal closestDistance);
+
+	/// Searches this subtree for an intersection closer than *pClosestDistance.
+	virtual void findClosest(G3DVector* pRayOrigin, G3DVector* pDirectionVector, const G3DReal* pInvDirection, G3DReal* pClosestDistance, GRayTraceObject** ppClosestObject) = 0;
+
+	/// Searches this subtree for intersections closer than the ones already found for each ray in the packet.
+	virtual void findClosest(GRayTracePacket* pPacket) = 0;
+
+	friend class GRayTraceBoundingBoxInterior;
 };
 
 
@@ -525,13 +563,15 @@ class GRayTraceBoundingBoxInterior : public GRayTraceBoundingBoxBase
 protected:
 	GRayTraceBoundingBoxBase* m_pLesser;
 	GRayTraceBoundingBoxBase* m_pGreater;
+	int m_axis; // the axis along which the objects in m_pLesser tend to be less than those in m_pGreater
 
 public:
-	GRayTraceBoundingBoxInterior(GRayTraceBoundingBoxBase* pLesser, GRayTraceBoundingBoxBase* pGreater)
+	GRayTraceBoundingBoxInterior(GRayTraceBoundingBoxBase* pLesser, GRayTraceBoundingBoxBase* pGreater, int axis = 0)
 	: GRayTraceBoundingBoxBase()
 	{
 		m_pLesser = pLesser;
 		m_pGreater = pGreater;
+		m_axis = axis;
 		m_min.m_vals[0] = std::min(pLesser->m_min.m_vals[0], pGreater->m_min.m_vals[0]);
 		m_min.m_vals[1] = std::min(pLesser->m_min.m_vals[1], pGreater->m_min.m_vals[1]);
 		m_min.m_vals[2] = std::min(pLesser->m_min.m_vals[2], pGreater->m_min.m_vals[2]);
@@ -547,7 +587,10 @@ public:
 	}
 
 	virtual bool isLeaf() { return false; };
-	virtual GRayTraceObject* closestIntersection(G3DVector* pRayOrigin, G3DVector* pDirectionVector, G3DReal* pOutDistance);
+
+protected:
+	virtual void findClosest(G3DVector* pRayOrigin, G3DVector* pDirectionVector, const G3DReal* pInvDirection, G3DReal* pClosestDistance, GRayTraceObject** ppClosestObject);
+	virtual void findClosest(GRayTracePacket* pPacket);
 };
 
 
@@ -563,7 +606,10 @@ public:
 	virtual ~GRayTraceBoundingBoxLeaf();
 
 	virtual bool isLeaf() { return true; }
-	virtual GRayTraceObject* closestIntersection(G3DVector* pRayOrigin, G3DVector* pDirectionVector, G3DReal* pOutDistance);
+
+protected:
+	virtual void findClosest(G3DVector* pRayOrigin, G3DVector* pDirectionVector, const G3DReal* pInvDirection, G3DReal* pClosestDistance, GRayTraceObject** ppClosestObject);
+	virtual void findClosest(GRayTracePacket* pPacket);
 };
 
 
@@ -38,6 +38,7 @@
 #include "GLearner.h"
 #include "GLearnerLib.h"
 #include "usage.h"
+#include "GProfiler.h"
 #include <memory>
 
 using std::map;
@@ -1101,11 +1102,8 @@ void GMatrixFactorization_absValues(double* pVec, size_t dims)
 }
 
 // virtual
-void GMatrixFactorization::train(GMatrix& data)
+void GMatrixFactorization::initProfiles(size_t users, size_t items)
 {
-	size_t users, items;
-	GCollaborativeFilter_dims(data, &users, &items);
-
 	// Initialize P and Q with small random values
 	delete(m_pP);
 	size_t colsP = 1 + m_intrinsicDims;
@@ -1126,6 +1124,87 @@ void GMatrixFactorization::train(GMatrix& data)
 		if(m_nonNeg)
 			GMatrixFactorization_absValues(m_pQ->row(i).data() + 1, m_intrinsicDims);
 	}
+}
+
+void GMatrixFactorization::trainEpoch(const GMatrix& data, double learningRate)
+{
+	GPROFILE_SCOPE("GMatrixFactorization::trainEpoch");
+	GPROFILE_COUNT("GMatrixFactorization::trainEpoch ratings", data.rows());
+	GVec pT(m_intrinsicDims + 1);
+	for(size_t j = 0; j < data.rows(); j++)
+	{
+		const GVec& vec = data[j];
+		size_t user = (size_t)vec[0];
+		size_t item = (size_t)vec[1];
+		if(m_pPMask && user < m_pPMask->rows())
+			clampP(user);
+		if(m_pQMask && item < m_pQMask->rows())
+			clampQ(item);
+
+		// Compute the error for this rating
+		GVec& p = m_pP->row(user);
+		GVec& q = m_pQ->row(item);
+		double pred = q[0] + p[0];
+		for(size_t i = 1; i <= m_intrinsicDims; i++)
+			pred += p[i] * q[i];
+		double err = vec[2] - pred;
+
+		// Update Q
+		q[0] += learningRate * (err - m_regularizer * (q[0]));
+		for(size_t i = 1; i <= m_intrinsicDims; i++)
+		{
+			pT[i] = q[i];
+			q[i] += learningRate * (err * p[i] - m_regularizer * q[i]);
+			if(m_nonNeg)
+				q[i] = std::max(0.0, q[i]);
+		}
+		if(m_pQMask && item < m_pQMask->rows())
+		{
+			// Update the bias and weights for clamped values
+			GVec& mask = m_pQMask->row(item);
+			GVec& bb = m_pQWeights->row(0);
+			GVec& w = m_pQWeights->row(1);
+			for(size_t i = 0; i < m_intrinsicDims; i++)
+			{
+				if(mask[i] != UNKNOWN_REAL_VALUE)
+				{
+					bb[i] += 0.1 * learningRate * err * p[i + 1];
+					w[i] += 0.1 * learningRate * err * p[i + 1] * mask[i];
+				}
+			}
+		}
+
+		// Update P
+		p[0] += learningRate * (err - m_regularizer * p[0]);
+		for(size_t i = 1; i <= m_intrinsicDims; i++)
+		{
+			p[i] += learningRate * (err * pT[i] - m_regularizer * p[i]);
+			if(m_nonNeg)
+				p[i] = std::max(0.0, p[i]);
+		}
+		if(m_pPMask && user < m_pPMask->rows())
+		{
+			// Update the bias and weights for clamped values
+			GVec& mask = m_pPMask->row(user);
+			GVec& bb = m_pPWeights->row(0);
+			GVec& w = m_pPWeights->row(1);
+			for(size_t i = 0; i < m_intrinsicDims; i++)
+			{
+				if(mask[i] != UNKNOWN_REAL_VALUE)
+				{
+					bb[i] += 0.1 * learningRate * err * pT[i + 1];
+					w[i] += 0.1 * learningRate * err * pT[i + 1] * mask[i];
+				}
+			}
+		}
+	}
+}
+
+void GMatrixFactorization::train(GMatrix& data)
+{
+	size_t users, items;
+	GCollaborativeFilter_dims(data, &users, &items);
+	initProfiles(users, items);
 
 	// Make a shallow copy of the data (so we can shuffle it)
 	GMatrix dataCopy(data.relation().clone());
@@ -1136,7 +1215,6 @@ void GMatrixFactorization::train(GMatrix& data)
 	// Train
 	double prevErr = 1e10;
 	double learningRate = 0.01;
-	GVec pT(m_intrinsicDims + 1);
 	size_t epochs = 0;
 	while(learningRate >= 0.001)
 	{
@@ -1148,73 +1226,7 @@ void GMatrixFactorization::train(GMatrix& data)
 			dataCopy.shuffle(m_rand);
 
 			// Do an epoch of training
-			for(size_t j = 0; j < dataCopy.rows(); j++)
-			{
-				GVec& vec = dataCopy[j];
-				size_t user = (size_t)vec[0];
-				size_t item = (size_t)vec[1];
-				if(m_pPMask && user < m_pPMask->rows())
-					clampP(user);
-				if(m_pQMask && item < m_pQMask->rows())
-					clampQ(item);
-
-				// Compute the error for this rating
-				GVec& p = m_pP->row(user);
-				GVec& q = m_pQ->row(item);
-				double pred = q[0] + p[0];
-				for(size_t i = 1; i <= m_intrinsicDims; i++)
-					pred += p[i] * q[i];
-				double err = vec[2] - pred;
-
-				// Update Q
-				q[0] += learningRate * (err - m_regularizer * (q[0]));
-				for(size_t i = 1; i <= m_intrinsicDims; i++)
-				{
-					pT[i] = q[i];
-					q[i] += learningRate * (err * p[i] - m_regularizer * q[i]);
-					if(m_nonNeg)
-						q[i] = std::max(0.0, q[i]);
-				}
-				if(m_pQMask && item < m_pQMask->rows())
-				{
-					// Update the bias and weights for clamped values
-					GVec& mask = m_pQMask->row(item);
-					GVec& bb = m_pQWeights->row(0);
-					GVec& w = m_pQWeights->row(1);
-					for(size_t i = 0; i < m_intrinsicDims; i++)
-					{
-						if(mask[i] != UNKNOWN_REAL_VALUE)
-						{
-							bb[i] += 0.1 * learningRate * err * p[i + 1];
-							w[i] += 0.1 * learningRate * err * p[i + 1] * mask[i];
-						}
-					}
-				}
-
-				// Update P
-				p[0] += learningRate * (err - m_regularizer * p[0]);
-				for(size_t i = 1; i <= m_intrinsicDims; i++)
-				{
-					p[i] += learningRate * (err * pT[i] - m_regularizer * p[i]);
-					if(m_nonNeg)
-						p[i] = std::max(0.0, p[i]);
-				}
-				if(m_pPMask && user < m_pPMask->rows())
-				{
-					// Update the bias and weights for clamped values
-					GVec& mask = m_pPMask->row(user);
-					GVec& bb = m_pPWeights->row(0);
-					GVec& w = m_pPWeights->row(1);
-					for(size_t i = 0; i < m_intrinsicDims; i++)
-					{
-						if(mask[i] != UNKNOWN_REAL_VALUE)
-						{
-							bb[i] += 0.1 * learningRate * err * pT[i + 1];
-							w[i] += 0.1 * learningRate * err * pT[i + 1] * mask[i];
-						}
-					}
-				}
-			}
+			trainEpoch(dataCopy, learningRate);
 			epochs++;
 		}
 
@@ -388,6 +388,14 @@ public:
 	/// See the comment for GCollaborativeFilter::train
 	virtual void train(GMatrix& data);
 
+	/// Allocates the user and item profiles, and initializes them with small random values.
+	/// (train calls this. It is only needed to drive the training yourself with trainEpoch.)
+	void initProfiles(size_t users, size_t items);
+
+	/// Performs one epoch of stochastic gradient descent over the ratings in data, in the
+	/// order they appear. (Assumes initProfiles has already been called with large enough dimensions.)
+	void trainEpoch(const GMatrix& data, double learningRate);
+
 	/// See the comment for GCollaborativeFilter::predict
 	virtual double predict(size_t user, size_t item);
 
@@ -23,7 +23,9 @@
 #include "GImage.h"
 #include "GDistance.h"
 #include "GDom.h"
+#include "GThread.h"
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <sstream>
 #include <fstream>
@@ -445,67 +447,6 @@ namespace GClasses {
       assert(reporter != NULL);
     }
 
-    namespace{
-      class IncrementalWeightedAverage{
-	std::vector<double> weightedSum;
-	double totalWeights;
-	typedef std::vector<double>::const_iterator cIter;
-	typedef std::vector<double>::iterator        iter;
-	bool sameSinceLastReset;
-      public:
-	///Create an IncrementalWeightedAverage object that takes an
-	///average of vectors of numDimensions dimensions
-	IncrementalWeightedAverage(unsigned numDimensions)
-	  :weightedSum(numDimensions,0), totalWeights(0)
-	  ,sameSinceLastReset(true)
-	{}
-
-	///Return the average so far.  Should not be called if the
-	///incremental average has not been updated with an add since
-	///the last reset (object creation counts as a reset).  Also
-	///should not be called if the sum of the weights is 0.
-	std::vector<double> average() const{
-	  if(sameSinceLastReset){
-	    throw Ex("Average called on IncrementalWeightedAverage ",
-		       "object that has not been updated since the last ",
-		       "reset (or since object creation)");
-	  }
-	  assert(totalWeights != 0);
-	  std::vector<double> out = weightedSum;
-	  for(iter i = out.begin(); i != out.end(); ++i){ (*i)/=totalWeights; }
-	  return out;
-	}
-
-	///Set the sums and weights to 0
-	void reset(){
-	  sameSinceLastReset = true;
-	  totalWeights = 0;
-	  std::fill(weightedSum.begin(), weightedSum.end(), 0);
-	}
-
-	///Return true if add has been called since the last reset (or
-	///since object creation if there have not been any resets)
-	bool changedSinceLastReset(){ return !sameSinceLastReset; }
-
-	///Add another value with the given weight.  It is assumed
-	///that the value array has at least as many entries as the
-	///weightedSum vector
-	void add(double weight, const double *value){
-	  sameSinceLastReset = false;
-	  totalWeights += weight;
-	  const double* val=value;
-	  iter sum=weightedSum.begin();
-	  for(; sum != weightedSum.end(); ++val,++sum){
-	    (*sum)+=weight * (*val);
-	  }
-	}
-      };
-
-      ///Resets a weighed average object
-      struct Reset{
-	void operator()(IncrementalWeightedAverage& a){ a.reset(); }
-      };
-    }//anonymous namespace
 
     //virtual
     void BatchTraining::train(GSelfOrganizingMap& map, const GMatrix* pIn){
@@ -520,37 +461,29 @@ namespace GClasses {
       //Set the before relation
       setPRelationBefore(map, pIn->relation());
 
-#if 0
-      //DEBUG - print the node locations and 1st 5 neighbors within
-      //startwidth distance
-      {
-	std::ofstream out ("nodeloc.txt");
-	for(unsigned i = 0; i < map.nodes().size(); ++i){
-	  out << "Node " << i << ": ";
-	  SOM::Node n = map.nodes()[i];
-	  for(unsigned j = 0; j < n.outputLocation.size(); ++j){
-	    out << n.outputLocation[j] << " ";
-	  }
-	  out << "\n";
-	  out << "Node " << i << " neighbors: ";
-	  std::vector<NodeAndDistance> nei = map.neighborsInCircle
-	    (i, m_windowFunc->minZeroDistance(m_initialNeighborhoodSize));
-	  for(unsigned j = 0; j < 5; ++j){
-	    out << nei[j].nodeIdx << "@" << nei[j].distance << " ";
-	  }
-	  out << "\n";
-	}
-      }
-#endif
-      //Create weighted averages for each node
-      std::vector<IncrementalWeightedAverage>
-	aves(map.nodes().size(), IncrementalWeightedAverage((unsigned int)pIn->cols()));
-
       //Create list of which node was closest to a given data point
       //last time - initializing to a non-existent node index
       std::size_t invalidIdx = std::numeric_limits<std::size_t>::max();
       assert(invalidIdx >= pIn->rows()); //Ensure it is really invalid
       std::vector<std::size_t> prevClosest(pIn->rows(), invalidIdx);
+      std::vector<std::size_t> closest;
+
+      //The sums of the points that matched each node, and how many
+      //there were.  The weighted average of these over a node's
+      //neighborhood is the same as the weighted average of all the
+      //points whose best matches are in that neighborhood, but it
+      //only visits each point once.
+      std::size_t nodeCount = map.nodes().size();
+      std::size_t dims = pIn->cols();
+      GMatrix sums(nodeCount, dims);
+      GVec counts(nodeCount);
+      GMatrix newWeights(nodeCount, dims);
+      std::vector<char> changed(nodeCount);
+
+      //Make sure the neighbor lists and the weight matrix are ready
+      //before they are shared among threads
+      map.neighborsInCircle(0, 0.0);
+      allWeightsChanged(map);
 
       //Report before first iteration
       m_reporter->newStatus(0, 0, map);
@@ -563,47 +496,35 @@ namespace GClasses {
 	//update weights until convergence or run out of time
 	for(unsigned epoch = 0;
 	    epoch < m_maxSubIterationsBeforeChangingNeighborhood; ++epoch){
-	  //assume that converged
+	  //Find the closest node to every input point
+	  map.bestMatches(*pIn, closest);
+
+	  //compare to closest last time - if different, not converged
 	  bool hasConverged = true;
-	  //For each input point
 	  for(std::size_t rIdx = 0; rIdx < pIn->rows(); ++rIdx){
-	    const GVec& pRow = pIn->row(rIdx);
-	    //Find the closest node
-	    std::size_t best = map.bestMatch(pRow);
-	    //compare to closest last time - if different, not converged
-	    ///OPTIMIZE: could try not zeroing the averages and then
-	    ///updating only places where closest point had changed -
-	    ///but doing it twice, first subtracting the old and then
-	    ///adding the new - introduces cumulative rounding error
-	    if(prevClosest[rIdx] != best){
+	    if(prevClosest[rIdx] != closest[rIdx]){
 	      hasConverged = false;
-	      prevClosest[rIdx] = best;
-	    }
-	    //For each neighbor within range of best so that the
-	    //window function is non-zero, add weighted input point to
-	    //incremental weighted average
-	    std::vector<SOM::NodeAndDistance> nbrs =
-	      map.neighborsInCircle((unsigned int)best, m_windowFunc->minZeroDistance(width));
-	    std::vector<SOM::NodeAndDistance>::const_iterator nItr;
-	    for(nItr = nbrs.begin(); nItr != nbrs.end(); ++nItr){
-	      double weight = (*m_windowFunc)(width, nItr->distance);
-	      aves[nItr->nodeIdx].add(weight, pRow.data());
+	      prevClosest[rIdx] = closest[rIdx];
 	    }
-	    //Add the point to the best point's average also
-	    aves[best].add((*m_windowFunc)(width, 0), pRow.data());
 	  }
-	  //Set all nodes' weights to final weighted average and zero
-	  //averages for next pass.  Any nodes that were not in the
-	  //neighborhood of any winners are left unchanged.
-	  std::vector<SOM::Node>::iterator nIter = map.nodes().begin();
-	  std::vector<IncrementalWeightedAverage>::iterator aIter
-	    = aves.begin();
-	  for(; aIter != aves.end(); ++nIter, ++aIter){
-	    if(aIter->changedSinceLastReset()){
-	      nIter->weights = aIter->average();
-	      aIter->reset();
+
+	  //Sum the points that matched each node, with each thread
+	  //accumulating a portion of the points
+	  accumulateMatches(map, *pIn, closest, sums, counts);
+
+	  //Each node's new weight is the weighted average of the sums in
+	  //its neighborhood, where the window function is non-zero.  Any
+	  //nodes that were not in the neighborhood of any winners are
+	  //left unchanged.
+	  smoothNeighborhoods(map, width, sums, counts, newWeights, changed);
+	  std::vector<SOM::Node>& nodes = map.nodes();
+	  for(std::size_t i = 0; i < nodeCount; ++i){
+	    if(changed[i]){
+	      const GVec& w = newWeights[i];
+	      nodes[i].weights.assign(w.data(), w.data() + dims);
 	    }
 	  }
+	  allWeightsChanged(map);
 	  //Report end of iteration.
 	  m_reporter->newStatus(superepoch, epoch, map);
 	  //if converged, start another major iteration
@@ -614,6 +535,130 @@ namespace GClasses {
       m_reporter->newStatus(m_numIterations+1, 0, map);
     }
 
+  } //namespace SOM
+
+  ///Sums the points that matched each node over a block of rows.
+  ///(Used by SOM::BatchTraining::accumulateMatches.)
+  class GSelfOrganizingMapAccumulateWorker : public GWorkerThread{
+  protected:
+    const GMatrix& m_in;
+    const std::vector<std::size_t>& m_closest;
+    std::size_t m_blockSize;
+  public:
+    GMatrix m_sums;
+    GVec m_counts;
+
+    GSelfOrganizingMapAccumulateWorker(GMasterThread& master, const GMatrix& in, const std::vector<std::size_t>& closest, std::size_t nodeCount, std::size_t blockSize)
+      : GWorkerThread(master), m_in(in), m_closest(closest), m_blockSize(blockSize), m_sums(nodeCount, in.cols()), m_counts(nodeCount)
+    {
+      m_sums.setAll(0.0);
+      m_counts.fill(0.0);
+    }
+
+    virtual ~GSelfOrganizingMapAccumulateWorker(){}
+
+    virtual void doJob(std::size_t jobId){
+      std::size_t end = std::min(m_in.rows(), (jobId + 1) * m_blockSize);
+      for(std::size_t i = jobId * m_blockSize; i < end; ++i){
+	m_sums[m_closest[i]] += m_in[i];
+	m_counts[m_closest[i]] += 1.0;
+      }
+    }
+  };
+
+  ///Computes the neighborhood averages for a block of nodes.  (Used by
+  ///SOM::BatchTraining::smoothNeighborhoods.)
+  class GSelfOrganizingMapSmoothWorker : public GWorkerThread{
+  protected:
+    const GSelfOrganizingMap& m_map;
+    const SOM::NeighborhoodWindowFunction& m_windowFunc;
+    double m_width;
+    const GMatrix& m_sums;
+    const GVec& m_counts;
+    GMatrix& m_newWeights;
+    std::vector<char>& m_changed;
+    std::size_t m_blockSize;
+  public:
+    GSelfOrganizingMapSmoothWorker(GMasterThread& master, const GSelfOrganizingMap& map, const SOM::NeighborhoodWindowFunction& windowFunc, double width, const GMatrix& sums, const GVec& counts, GMatrix& newWeights, std::vector<char>& changed, std::size_t blockSize)
+      : GWorkerThread(master), m_map(map), m_windowFunc(windowFunc), m_width(width), m_sums(sums), m_counts(counts), m_newWeights(newWeights), m_changed(changed), m_blockSize(blockSize)
+    {}
+
+    virtual ~GSelfOrganizingMapSmoothWorker(){}
+
+    virtual void doJob(std::size_t jobId){
+      double radius = m_windowFunc.minZeroDistance(m_width);
+      std::size_t end = std::min(m_sums.rows(), (jobId + 1) * m_blockSize);
+      for(std::size_t i = jobId * m_blockSize; i < end; ++i){
+	GVec& w = m_newWeights[i];
+	w.fill(0.0);
+	double totalWeight = 0;
+	bool changed = false;
+	//The node's own matches
+	if(m_counts[i] > 0){
+	  double h = m_windowFunc(m_width, 0);
+	  w.addScaled(h, m_sums[i]);
+	  totalWeight += h * m_counts[i];
+	  changed = true;
+	}
+	//The matches of its neighbors.  (Node distances are symmetric,
+	//so these are the nodes whose neighborhoods contain node i.)
+	std::vector<SOM::NodeAndDistance> nbrs =
+	  m_map.neighborsInCircle((unsigned int)i, radius);
+	std::vector<SOM::NodeAndDistance>::const_iterator nItr;
+	for(nItr = nbrs.begin(); nItr != nbrs.end(); ++nItr){
+	  if(m_counts[nItr->nodeIdx] > 0){
+	    double h = m_windowFunc(m_width, nItr->distance);
+	    w.addScaled(h, m_sums[nItr->nodeIdx]);
+	    totalWeight += h * m_counts[nItr->nodeIdx];
+	    changed = true;
+	  }
+	}
+	if(changed && totalWeight != 0){
+	  w *= (1.0 / totalWeight);
+	  m_changed[i] = 1;
+	}else{
+	  m_changed[i] = 0;
+	}
+      }
+    }
+  };
+
+  namespace SOM{
+
+    void BatchTraining::accumulateMatches(GSelfOrganizingMap& map, const GMatrix& in, const std::vector<std::size_t>& closest, GMatrix& sums, GVec& counts){
+      std::size_t nodeCount = sums.rows();
+      std::size_t blockSize = 4096;
+      std::size_t blocks = (in.rows() + blockSize - 1) / blockSize;
+      std::size_t threads = std::max((std::size_t)1, std::min(map.workerThreads(), blocks));
+      std::vector<GSelfOrganizingMapAccumulateWorker*> workers;
+      sums.setAll(0.0);
+      counts.fill(0.0);
+      GMasterThread master;
+      for(std::size_t i = 0; i < threads; ++i){
+	workers.push_back(new GSelfOrganizingMapAccumulateWorker(master, in, closest, nodeCount, blockSize));
+	master.addWorker(workers[i]);
+      }
+      master.doJobs(blocks);
+
+      //Merge the sums of each thread.  (The master deletes the workers,
+      //so this must be done before it goes out of scope.)
+      for(std::size_t i = 0; i < threads; ++i){
+	sums.add(&workers[i]->m_sums);
+	counts += workers[i]->m_counts;
+      }
+    }
+
+    void BatchTraining::smoothNeighborhoods(GSelfOrganizingMap& map, double width, const GMatrix& sums, const GVec& counts, GMatrix& newWeights, std::vector<char>& changed){
+      std::size_t blockSize = 64;
+      std::size_t blocks = (sums.rows() + blockSize - 1) / blockSize;
+      std::size_t threads = std::max((std::size_t)1, std::min(map.workerThreads(), blocks));
+      GMasterThread master;
+      for(std::size_t i = 0; i < threads; ++i){
+	master.addWorker(new GSelfOrganizingMapSmoothWorker(master, map, *m_windowFunc, width, sums, counts, newWeights, changed, blockSize));
+      }
+      master.doJobs(blocks);
+    }
+
     //virtual
     BatchTraining::~BatchTraining(){
       delete m_weightInitialization;
@@ -688,6 +733,9 @@ namespace GClasses {
       pInputCopy->copy(pInput);
       std::unique_ptr<GMatrix> inputCopy(pInputCopy);
 
+      std::vector<SOM::Node>& nodes = map.nodes();
+      allWeightsChanged(map);
+
       //For each iteration
       for(unsigned iteration = 0; iteration < m_numIterations; ++iteration){
 	//Calculate the width and learning rate
@@ -703,16 +751,20 @@ namespace GClasses {
 	//Find the best match to the current input point
 	std::size_t best = map.bestMatch(point);
 
-	//Move the best match and its neighbors closer to the input
+	//Move the best match and its neighbors closer to the input.
+	//(The nodes are changed through a reference, so the map must be
+	//told which ones changed to keep its weight matrix valid.)
 	std::vector<SOM::NodeAndDistance> nbrs =
 	  map.neighborsInCircle((unsigned int)best, m_windowFunc->minZeroDistance(width));
 	std::vector<SOM::NodeAndDistance>::const_iterator nItr;
 	for(nItr = nbrs.begin(); nItr != nbrs.end(); ++nItr){
-	  moveWeightsCloser(map.nodes()[nItr->nodeIdx].weights, point.data(),
+	  moveWeightsCloser(nodes[nItr->nodeIdx].weights, point.data(),
 			   rate*(*m_windowFunc)(width, nItr->distance));
+	  weightsChanged(map, nItr->nodeIdx);
 	}
-	moveWeightsCloser(map.nodes()[best].weights, point.data(),
+	moveWeightsCloser(nodes[best].weights, point.data(),
 			 rate*(*m_windowFunc)(width, 0));
+	weightsChanged(map, best);
 
 	//Report iteration
 	m_reporter->newStatus(iteration+1, 1, map);
@@ -834,6 +886,10 @@ GSelfOrganizingMap::GSelfOrganizingMap(const GDomNode* pNode) : GIncrementalTran
   typedef std::vector<SOM::Node> nodevec;
   m_nodes=objVectorDeserialize<nodevec>(pNode->field("nodes"));
   m_sortedNeighborsIsValid = false;
+  m_workerThreads = 1;
+  m_weightMatrixIsValid = false;
+  m_fastMatch = false;
+  regenerateWeightMatrix();
 }
 
 
@@ -849,7 +905,10 @@ GSelfOrganizingMap::GSelfOrganizingMap
     m_pWeightDistance(new GRowDistance()),
     m_pNodeDistance(new GRowDistance()),
     m_nodes((unsigned int)std::pow((double)nMapWidth,(double)nMapDims)),
-    m_sortedNeighborsIsValid(false)
+    m_sortedNeighborsIsValid(false),
+    m_workerThreads(1),
+    m_weightMatrixIsValid(false),
+    m_fastMatch(false)
 {
   //Set the node locations in a grid topology
   SOM::GridTopology g;
@@ -879,7 +938,8 @@ GSelfOrganizingMap::GSelfOrganizingMap(const std::vector<double>& output_Axes,
   :m_nInputDims(0), m_outputAxes(output_Axes), m_pTrainer(trainer),
    m_pWeightDistance(weightDist), m_pNodeDistance(nodeDist),
    m_nodes(numNodes),
-   m_sortedNeighborsIsValid(false){
+   m_sortedNeighborsIsValid(false), m_workerThreads(1),
+   m_weightMatrixIsValid(false), m_fastMatch(false){
 
   //Set the topology
   topology->setLocations(output_Axes, m_nodes);
@@ -919,8 +979,11 @@ GMatrix* GSelfOrganizingMap::reduce(const GMatrix& in)
   std::unique_ptr<GMatrix> hOut(pOut);
 
   // Transform the input, putting it in the output
+  std::vector<std::size_t> best;
+  bestMatches(in, best);
   for(std::size_t i = 0; i < in.rows(); ++i){
-    transform(in.row(i), pOut->row(i));
+    const SOM::Node& n = m_nodes[best[i]];
+    std::copy(n.outputLocation.begin(), n.outputLocation.end(), pOut->row(i).data());
   }
   return hOut.release();
 }
@@ -929,32 +992,243 @@ GMatrix* GSelfOrganizingMap::reduce(const GMatrix& in)
 
 void GSelfOrganizingMap::transform(const GVec& in, GVec& out){
   unsigned int idx = (unsigned int)bestMatch(in);
-  const SOM::Node& n = nodes().at(idx);
+  const SOM::Node& n = m_nodes.at(idx);
   std::copy(n.outputLocation.begin(), n.outputLocation.end(), out.data());
 }
 
 
 
+namespace{
+  //Returns the index of the node whose weights are closest to in
+  //according to metric, or the first such node if there is a tie
+  std::size_t metricBestMatch(const GDistanceMetric& metric,
+			      const std::vector<SOM::Node>& nodes,
+			      const GVec& in){
+    //Eventually this should use a cached k-d tree for low dimensional
+    //spaces
+    typedef std::vector<SOM::Node>::const_iterator NIter;
+    assert(nodes.size() > 0);
+    std::size_t best_Match = nodes.size() + 1;
+    double bestDistance = std::numeric_limits<double>::infinity();
+    for(NIter cur = nodes.begin(); cur != nodes.end(); ++cur){
+      const double *weights = &(cur->weights.front());
+      GConstVecWrapper w(weights, cur->weights.size());
+      double dissim = metric(w.vec(), in);
+      if(dissim < bestDistance || best_Match >= nodes.size()){
+	best_Match = cur - nodes.begin();
+	bestDistance = dissim;
+      }
+    }
+    return best_Match;
+  }
+
+  //Returns true if v contains an unknown real value
+  bool hasUnknowns(const double* v, std::size_t n){
+    for(std::size_t i = 0; i < n; ++i){
+      if(v[i] == UNKNOWN_REAL_VALUE){ return true; }
+    }
+    return false;
+  }
+}//anonymous namespace
+
+void GSelfOrganizingMap::regenerateWeightMatrix(){
+  std::size_t dims = 0;
+  const GRelation* pRel = m_pWeightDistance->relation();
+  m_fastMatch = (strcmp(m_pWeightDistance->name(), "GRowDistance") == 0 &&
+		 pRel != NULL && pRel->areContinuous() && m_nodes.size() > 0);
+  if(m_fastMatch){
+    dims = pRel->size();
+    m_fastMatch = (m_pWeightDistance->scaleFactors().size() == dims);
+  }
+  for(std::size_t i = 0; m_fastMatch && i < m_nodes.size(); ++i){
+    const std::vector<double>& w = m_nodes[i].weights;
+    if(w.size() != dims || hasUnknowns(w.data(), dims)){
+      m_fastMatch = false;
+    }
+  }
+  if(m_fastMatch){
+    m_weightScales.copy(m_pWeightDistance->scaleFactors());
+    m_weightMatrix.resize(m_nodes.size(), dims);
+    m_weightNorms.resize(m_nodes.size());
+    for(std::size_t i = 0; i < m_nodes.size(); ++i){
+      GVec& row = m_weightMatrix[i];
+      const double* w = m_nodes[i].weights.data();
+      for(std::size_t j = 0; j < dims; ++j){
+	row[j] = w[j] * m_weightScales[j];
+      }
+      m_weightNorms[i] = row.squaredMagnitude();
+    }
+  }else{
+    m_weightMatrix.resize(0, 0);
+    m_weightNorms.resize(0);
+  }
+  m_weightMatrixIsValid = true;
+}
+
+void GSelfOrganizingMap::updateWeightMatrixRow(std::size_t nodeIdx){
+  if(!m_weightMatrixIsValid || !m_fastMatch){
+    return;
+  }
+  const std::vector<double>& w = m_nodes[nodeIdx].weights;
+  std::size_t dims = m_weightMatrix.cols();
+  if(w.size() != dims || hasUnknowns(w.data(), dims)){
+    m_weightMatrixIsValid = false;
+    return;
+  }
+  GVec& row = m_weightMatrix[nodeIdx];
+  for(std::size_t j = 0; j < dims; ++j){
+    row[j] = w[j] * m_weightScales[j];
+  }
+  m_weightNorms[nodeIdx] = row.squaredMagnitude();
+}
+
 std::size_t GSelfOrganizingMap::bestMatch(const GVec& in) const{
-  //Eventually this should use a cached k-d tree for low dimensional
-  //spaces
-  using SOM::Node;
-  typedef std::vector<Node>::const_iterator NIter;
-  assert(nodes().size() > 0);
-  std::size_t best_Match = nodes().size() + 1;
+  std::size_t dims = m_weightMatrix.cols();
+  if(!m_weightMatrixIsValid || !m_fastMatch || in.size() != dims || hasUnknowns(in.data(), dims)){
+    return metricBestMatch(*m_pWeightDistance, m_nodes, in);
+  }
+
+  //The squared distance to node i is |w_i|^2 - 2 w_i.x + |x|^2, where
+  //the last term is the same for all nodes
+  GTEMPBUF(double, scaled, dims);
+  for(std::size_t j = 0; j < dims; ++j){
+    scaled[j] = in[j] * m_weightScales[j];
+  }
+  std::size_t best = 0;
   double bestDistance = std::numeric_limits<double>::infinity();
-  for(NIter cur = nodes().begin(); cur != nodes().end(); ++cur){
-    const double *weights = &(cur->weights.front());
-    {
-      GConstVecWrapper w(weights, cur->weights.size());
-      double dissim = (*m_pWeightDistance)(w.vec(), in);
-      if(dissim < bestDistance || best_Match >= nodes().size()){
-        best_Match = cur - nodes().begin();
-        bestDistance = dissim;
+  for(std::size_t i = 0; i < m_nodes.size(); ++i){
+    const double* w = m_weightMatrix[i].data();
+    double dot = 0.0;
+    for(std::size_t j = 0; j < dims; ++j){
+      dot += w[j] * scaled[j];
+    }
+    double dissim = m_weightNorms[i] - 2.0 * dot;
+    if(dissim < bestDistance){
+      best = i;
+      bestDistance = dissim;
+    }
+  }
+  return best;
+}
+
+void GSelfOrganizingMap::bestMatchBlock(const GMatrix& in, std::size_t start, std::size_t end, std::vector<std::size_t>& out) const{
+  std::size_t dims = m_weightMatrix.cols();
+  if(!m_weightMatrixIsValid || !m_fastMatch || in.cols() != dims){
+    for(std::size_t r = start; r < end; ++r){
+      out[r] = metricBestMatch(*m_pWeightDistance, m_nodes, in[r]);
+    }
+    return;
+  }
+
+  //Scale the rows of the block, and compute their distances to a tile
+  //of nodes at a time, so the tile stays in the cache while every row
+  //is compared with it.
+  std::size_t rows = end - start;
+  std::size_t nodeCount = m_nodes.size();
+  GMatrix scaled(rows, dims);
+  std::vector<char> known(rows);
+  GVec bestDistance(rows);
+  bestDistance.fill(std::numeric_limits<double>::infinity());
+  for(std::size_t r = 0; r < rows; ++r){
+    const GVec& x = in[start + r];
+    known[r] = !hasUnknowns(x.data(), dims);
+    GVec& s = scaled[r];
+    for(std::size_t j = 0; j < dims; ++j){
+      s[j] = x[j] * m_weightScales[j];
+    }
+    out[start + r] = 0;
+  }
+  const std::size_t tileSize = 64;
+  for(std::size_t tile = 0; tile < nodeCount; tile += tileSize){
+    std::size_t tileEnd = std::min(nodeCount, tile + tileSize);
+    for(std::size_t r = 0; r < rows; ++r){
+      if(!known[r]){
+	continue;
+      }
+      const double* x = scaled[r].data();
+      double best = bestDistance[r];
+      std::size_t bestIdx = out[start + r];
+      for(std::size_t i = tile; i < tileEnd; ++i){
+	const double* w = m_weightMatrix[i].data();
+	double dot = 0.0;
+	for(std::size_t j = 0; j < dims; ++j){
+	  dot += w[j] * x[j];
+	}
+	double dissim = m_weightNorms[i] - 2.0 * dot;
+	if(dissim < best){
+	  best = dissim;
+	  bestIdx = i;
+	}
       }
+      bestDistance[r] = best;
+      out[start + r] = bestIdx;
+    }
+  }
+
+  //Rows with unknown values need the metric's handling of them
+  for(std::size_t r = 0; r < rows; ++r){
+    if(!known[r]){
+      out[start + r] = metricBestMatch(*m_pWeightDistance, m_nodes, in[start + r]);
     }
   }
-  return best_Match;
+}
+
+///Finds the best matches for blocks of rows.  (Used by
+///GSelfOrganizingMap::bestMatches.)
+class GSelfOrganizingMapMatchWorker : public GWorkerThread{
+protected:
+  const GSelfOrganizingMap& m_map;
+  const GMatrix& m_in;
+  std::vector<std::size_t>& m_out;
+  std::size_t m_blockSize;
+public:
+  std::string m_error;
+
+  GSelfOrganizingMapMatchWorker(GMasterThread& master, const GSelfOrganizingMap& map, const GMatrix& in, std::vector<std::size_t>& out, std::size_t blockSize)
+    : GWorkerThread(master), m_map(map), m_in(in), m_out(out), m_blockSize(blockSize)
+  {}
+
+  virtual ~GSelfOrganizingMapMatchWorker(){}
+
+  virtual void doJob(std::size_t jobId){
+    try{
+      std::size_t start = jobId * m_blockSize;
+      m_map.bestMatchBlock(m_in, start, std::min(m_in.rows(), start + m_blockSize), m_out);
+    }catch(const std::exception& e){
+      m_error = e.what();
+    }
+  }
+};
+
+void GSelfOrganizingMap::bestMatches(const GMatrix& in, std::vector<std::size_t>& out) const{
+  if(m_nodes.size() == 0){
+    throw Ex("The map must have at least one node to find best matches");
+  }
+  out.resize(in.rows());
+  if(in.rows() == 0){
+    return;
+  }
+  const std::size_t blockSize = 256;
+  std::size_t blocks = (in.rows() + blockSize - 1) / blockSize;
+  std::size_t threads = std::max((std::size_t)1, std::min(m_workerThreads, blocks));
+  std::vector<GSelfOrganizingMapMatchWorker*> workers;
+  std::string error;
+  {
+    GMasterThread master;
+    for(std::size_t i = 0; i < threads; ++i){
+      workers.push_back(new GSelfOrganizingMapMatchWorker(master, *this, in, out, blockSize));
+      master.addWorker(workers[i]);
+    }
+    master.doJobs(blocks);
+    for(std::size_t i = 0; i < threads; ++i){
+      if(workers[i]->m_error.length() > 0){
+	error = workers[i]->m_error;
+      }
+    }
+  }
+  if(error.length() > 0){
+    throw Ex(error);
+  }
 }
 
 std::vector<std::size_t> GSelfOrganizingMap::bestData
@@ -1162,7 +1436,75 @@ void GSelfOrganizingMap::test(){
   }
   cylinderSom.train(uniformCylinderMat);
 
+  //Check that the fast best matches agree with the metric
+  GMatrix points(2000, 3);
+  for(std::size_t i = 0; i < points.rows(); ++i){
+    points[i].fillUniform(rand);
+  }
+  points[7][1] = UNKNOWN_REAL_VALUE;
+  std::vector<std::size_t> serialMatches;
+  std::vector<std::size_t> parallelMatches;
+  cylinderSom.bestMatches(points, serialMatches);
+  cylinderSom.setWorkerThreads(3);
+  cylinderSom.bestMatches(points, parallelMatches);
+  const GSelfOrganizingMap& cylinder = cylinderSom;
+  const GDistanceMetric& metric = *cylinder.weightDistance();
+  for(std::size_t i = 0; i < points.rows(); ++i){
+    if(serialMatches[i] != parallelMatches[i] ||
+       serialMatches[i] != cylinder.bestMatch(points[i])){
+      throw Ex("bestMatches disagrees with bestMatch");
+    }
+    std::size_t brute = metricBestMatch(metric, cylinder.nodes(), points[i]);
+    const std::vector<double>& wFast = cylinder.nodes()[serialMatches[i]].weights;
+    const std::vector<double>& wBrute = cylinder.nodes()[brute].weights;
+    double dFast = metric(GConstVecWrapper(wFast.data(), wFast.size()).vec(), points[i]);
+    double dBrute = metric(GConstVecWrapper(wBrute.data(), wBrute.size()).vec(), points[i]);
+    if(dFast > dBrute + 1e-12){
+      throw Ex("bestMatches did not find the closest node");
+    }
+  }
+
+  //A loaded map should find the same best matches
+  GDom doc;
+  doc.setRoot(cylinderSom.serialize(&doc));
+  GSelfOrganizingMap loadedSom(doc.root());
+  std::vector<std::size_t> loadedMatches;
+  loadedSom.bestMatches(points, loadedMatches);
+  if(loadedMatches != serialMatches){
+    throw Ex("a loaded map found different best matches");
+  }
+
+  //Best matches should not use a stale copy of weights that were
+  //changed through nodes()
+  std::vector<double>& moved = cylinderSom.nodes()[5].weights;
+  for(std::size_t j = 0; j < moved.size(); ++j){
+    moved[j] = points[0][j];
+  }
+  if(cylinder.bestMatch(points[0]) != 5){
+    throw Ex("bestMatch used stale weights");
+  }
 
+  //Check that parallel batch training gives the same map as serial training
+  GMatrix training(3000, 3);
+  for(std::size_t i = 0; i < training.rows(); ++i){
+    training[i].fillUniform(rand);
+  }
+  GRand serialRand(77);
+  GSelfOrganizingMap serialSom(2, 6, serialRand, new SOM::ReporterChain());
+  serialSom.train(training);
+  GRand parallelRand(77);
+  GSelfOrganizingMap parallelSom(2, 6, parallelRand, new SOM::ReporterChain());
+  parallelSom.setWorkerThreads(4);
+  parallelSom.train(training);
+  for(std::size_t i = 0; i < serialSom.nodes().size(); ++i){
+    const std::vector<double>& a = serialSom.nodes()[i].weights;
+    const std::vector<double>& b = parallelSom.nodes()[i].weights;
+    for(std::size_t j = 0; j < a.size(); ++j){
+      if(std::abs(a[j] - b[j]) > 1e-9){
+	throw Ex("parallel batch training differs from serial training");
+      }
+    }
+  }
 }
 #endif // !NO_TEST_CODE
 
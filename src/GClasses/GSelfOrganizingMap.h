@@ -497,6 +497,15 @@ class GDistanceMetric;
       /// call this in their train methods so that the map will appear
       /// trained for the purposes of GIncrementalTransform
       void setPRelationBefore(GSelfOrganizingMap& map, const GRelation& newval);
+
+      /// Tells the map that the weights of node nodeIdx were changed
+      /// through a reference obtained earlier from map.nodes(), so its
+      /// copy in the contiguous weight matrix must be refreshed.
+      void weightsChanged(GSelfOrganizingMap& map, std::size_t nodeIdx);
+
+      /// Tells the map that any of its weights may have changed, so it
+      /// regenerates the contiguous weight matrix from its nodes.
+      void allWeightsChanged(GSelfOrganizingMap& map);
     };
 
     /// A training algorithm that throws an exception when train is
@@ -576,6 +585,18 @@ class GDistanceMetric;
       virtual void train(GClasses::GSelfOrganizingMap& map, const GClasses::GMatrix* pIn);
 
       virtual ~BatchTraining();
+    protected:
+      /// Puts the sum of the rows of in whose best match is node i in
+      /// row i of sums, and the number of them in counts[i].  The rows
+      /// are divided among map.workerThreads() threads, each with its
+      /// own sums, which are merged at the end.
+      void accumulateMatches(GClasses::GSelfOrganizingMap& map, const GClasses::GMatrix& in, const std::vector<std::size_t>& closest, GClasses::GMatrix& sums, GClasses::GVec& counts);
+
+      /// Puts the window-weighted average of the matches in the
+      /// neighborhood of node i in row i of newWeights, and sets
+      /// changed[i] to 1 if any matches had a non-zero weight, or to 0
+      /// if the node should keep its old weights.
+      void smoothNeighborhoods(GClasses::GSelfOrganizingMap& map, double width, const GClasses::GMatrix& sums, const GClasses::GVec& counts, GClasses::GMatrix& newWeights, std::vector<char>& changed);
     };
 
 
@@ -672,6 +693,7 @@ class GDistanceMetric;
 class GSelfOrganizingMap : public GIncrementalTransform
 {
   friend class SOM::TrainingAlgorithm;
+  friend class GSelfOrganizingMapMatchWorker;
 protected:
   ///Number of input dimensions
   unsigned m_nInputDims;
@@ -732,6 +754,47 @@ protected:
     return m_sortedNeighbors;
   }
 
+  ///The number of threads used to find best matches for many points
+  ///at once
+  std::size_t m_workerThreads;
+
+  ///True if m_weightMatrix is valid, false if best matches must be
+  ///found with the metric until it is regenerated from m_nodes
+  bool m_weightMatrixIsValid;
+
+  ///True if the weight distance is the Euclidean distance over
+  ///continuous attributes, so best matches can be found from dot
+  ///products with m_weightMatrix instead of calling the metric
+  bool m_fastMatch;
+
+  ///A contiguous copy of the node weights, with each column
+  ///multiplied by the scale factor of the weight distance.  Row i
+  ///corresponds to m_nodes[i].
+  GMatrix m_weightMatrix;
+
+  ///The squared magnitude of each row of m_weightMatrix
+  GVec m_weightNorms;
+
+  ///The scale factors of the weight distance
+  GVec m_weightScales;
+
+  ///Marks the weight matrix as invalid and in need of regeneration
+  void invalidateWeightMatrix(){ m_weightMatrixIsValid = false; }
+
+  ///Copies the node weights into m_weightMatrix and sets
+  ///m_weightMatrixIsValid.  This is done when the map is trained or
+  ///loaded, and never by the const methods, so several threads may
+  ///find best matches at the same time.
+  void regenerateWeightMatrix();
+
+  ///Refreshes the row of the weight matrix for one node, if the
+  ///matrix is valid
+  void updateWeightMatrixRow(std::size_t nodeIdx);
+
+  ///Finds the best matching node for rows start..end-1 of in, and
+  ///puts them in out[start..end-1].
+  void bestMatchBlock(const GMatrix& in, std::size_t start, std::size_t end, std::vector<std::size_t>& out) const;
+
 
 public:
   /// Creates a map whose nodes are on a grid that uses euclidean
@@ -806,6 +869,7 @@ public:
     if(m_pTrainer != NULL){
       m_pTrainer->train(*this, &in);
     }
+    regenerateWeightMatrix();
     return new GUniformRelation(outputDimensions());
   }
 
@@ -828,6 +892,21 @@ public:
   ///least one node.
   std::size_t bestMatch(const GVec& pIn) const;
 
+  ///Finds the best matching node for every row of in, and puts their
+  ///indices in out.  The rows are processed in blocks, which are
+  ///divided among workerThreads() threads.  If the weight distance
+  ///is the default Euclidean distance, the distances are computed
+  ///from dot products with a contiguous copy of the weights, so ties
+  ///between nearly equidistant nodes may be broken by rounding.
+  void bestMatches(const GMatrix& in, std::vector<std::size_t>& out) const;
+
+  ///Specifies the number of threads used by bestMatches, by batch
+  ///training, and by reduce.  (The default is 1.)
+  void setWorkerThreads(std::size_t n){ m_workerThreads = (n > 1 ? n : 1); }
+
+  ///Returns the number of threads used to find many best matches
+  std::size_t workerThreads() const { return m_workerThreads; }
+
   ///Given a matrix containing input data of the correct dimensions,
   ///returns a vector v of nodes.size() indices into that matrix.
   ///v[i] is the index of the data in pData that gives the strongest
@@ -868,8 +947,12 @@ public:
   /// Inspector for the nodes making up this map
   const std::vector<SOM::Node>& nodes() const{ return m_nodes; }
 
-  /// Accessor for the nodes making up this map
-  std::vector<SOM::Node>& nodes() { return m_nodes; }
+  /// Accessor for the nodes making up this map.  Callers must not
+  /// change the weights through this reference.  (The fast best-match
+  /// search uses a copy of the weights that is made when the map is
+  /// trained or loaded, so this invalidates that copy, and best matches
+  /// are found with the slower metric until the map is trained again.)
+  std::vector<SOM::Node>& nodes() { invalidateWeightMatrix(); return m_nodes; }
 
   /// Inspector for the distance metric used in input space, that is,
   /// between an input point and a weight for determining the winner.
@@ -896,6 +979,8 @@ public:
 
 inline GDistanceMetric&
 SOM::TrainingAlgorithm::weightDistance(GSelfOrganizingMap& map){
+  //The caller may change the relation or scale factors
+  map.invalidateWeightMatrix();
   return *(map.m_pWeightDistance);
 }
 
@@ -904,6 +989,16 @@ SOM::TrainingAlgorithm::setPRelationBefore(GSelfOrganizingMap& map, const GRelat
 	map.setBefore(newval.clone());
 }
 
+inline void
+SOM::TrainingAlgorithm::weightsChanged(GSelfOrganizingMap& map, std::size_t nodeIdx){
+  map.updateWeightMatrixRow(nodeIdx);
+}
+
+inline void
+SOM::TrainingAlgorithm::allWeightsChanged(GSelfOrganizingMap& map){
+  map.regenerateWeightMatrix();
+}
+
 
 
 } // namespace GClasses
@@ -39,9 +39,15 @@
 #	include <netdb.h>
 #	include <stdlib.h>
 #	include <sys/ioctl.h>
+#	include <sys/uio.h>
 #	include <errno.h>
+#	include <unistd.h>
 #	define SOCKET_ERROR -1
 #endif
+#ifdef __linux__
+#	include <sys/epoll.h>
+#endif
+#include <algorithm>
 
 using std::cerr;
 using std::vector;
@@ -171,6 +177,39 @@ size_t GSocket_send(SOCKET s, const char* buf, size_t len)
 		return (size_t)bytesSent;
 }
 
+#ifndef WINDOWS
+// Sends as much of the count buffers as the socket will take with a single system call.
+// Returns the number of bytes sent, which is 0 if the socket would block.
+size_t GSocket_sendv(SOCKET s, const char** bufs, const size_t* lens, size_t count)
+{
+	if(s == INVALID_SOCKET)
+		throw Ex("Tried to send over a socket that was not connected");
+	vector<struct iovec> iov(count);
+	for(size_t i = 0; i < count; i++)
+	{
+		iov[i].iov_base = (void*)bufs[i];
+		iov[i].iov_len = lens[i];
+	}
+	struct msghdr msg;
+	memset(&msg, '\0', sizeof(struct msghdr));
+	msg.msg_iov = &iov[0];
+	msg.msg_iovlen = count;
+#ifdef __linux__
+	ssize_t bytesSent = sendmsg(s, &msg, MSG_NOSIGNAL);
+#else
+	ssize_t bytesSent = sendmsg(s, &msg, 0);
+#endif
+	if(bytesSent < 0)
+	{
+		if(errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR)
+			return 0;
+		else
+			throw Ex("Error sending in GTCPServer::send: ", strerror(errno));
+	}
+	return (size_t)bytesSent;
+}
+#endif
+
 void GSocket_init()
 {
 #ifdef WINDOWS
@@ -382,6 +421,7 @@ in_addr GTCPConnection::ipAddr()
 
 
 GTCPServer::GTCPServer(unsigned short port)
+: m_maxBuffered(0x10000000)
 {
 	GSocket_init();
 	m_sock = socket(AF_INET, SOCK_STREAM, 0); // use SOCK_DGRAM for UDP
@@ -412,6 +452,23 @@ GTCPServer::GTCPServer(unsigned short port)
 #else
 		throw Ex("Failed to listen on the socket: ", strerror(errno));
 #endif
+
+#ifdef __linux__
+	// Register the listening socket with the event loop. (A NULL data pointer identifies it.)
+	GSocket_setSocketMode(m_sock, false);
+	m_epoll = epoll_create1(0);
+	if(m_epoll < 0)
+		throw Ex("epoll_create1 failed: ", strerror(errno));
+	struct epoll_event ev;
+	memset(&ev, '\0', sizeof(struct epoll_event));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_sock, &ev) != 0)
+	{
+		close(m_epoll);
+		throw Ex("epoll_ctl failed: ", strerror(errno));
+	}
+#endif
 }
 
 GTCPServer::~GTCPServer()
@@ -419,18 +476,186 @@ GTCPServer::~GTCPServer()
 	while(m_socks.size() > 0)
 		disconnect(*m_socks.begin());
 	GSocket_closeSocket(m_sock);
+#ifdef __linux__
+	close(m_epoll);
+#endif
 }
 
 void GTCPServer::disconnect(GTCPConnection* pConn)
 {
 	onDisconnect(pConn);
+#ifdef __linux__
+	if(pConn->m_queued)
+		m_ready.erase(std::find(m_ready.begin(), m_ready.end(), pConn));
+	struct epoll_event ev; // (ignored, but older kernels require it to be non-NULL)
+	epoll_ctl(m_epoll, EPOLL_CTL_DEL, pConn->socket(), &ev);
+#endif
 	GSocket_closeSocket(pConn->socket());
 	m_socks.erase(pConn);
 	delete(pConn);
 }
 
+#ifdef __linux__
+void GTCPServer::pollEvents(int timeoutMs)
+{
+	struct epoll_event events[64];
+	int count = epoll_wait(m_epoll, events, 64, timeoutMs);
+	if(count < 0)
+	{
+		if(errno == EINTR)
+			return;
+		throw Ex("epoll_wait failed: ", strerror(errno));
+	}
+	for(int i = 0; i < count; i++)
+	{
+		GTCPConnection* pConn = (GTCPConnection*)events[i].data.ptr;
+		if(!pConn)
+		{
+			acceptConnections();
+			continue;
+		}
+		if(events[i].events & EPOLLOUT)
+			flush(pConn);
+		if(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+			drain(pConn);
+
+		// Connections are not disconnected here, because the caller may still hold
+		// pointers to them. Instead, they are queued, and receive disconnects them.
+		if(!pConn->m_queued && (pConn->m_inPos < pConn->m_inBuf.size() || pConn->m_peerClosed))
+		{
+			pConn->m_queued = true;
+			m_ready.push_back(pConn);
+		}
+	}
+}
+
+void GTCPServer::acceptConnections()
+{
+	while(true)
+	{
+		SOCKADDR_IN sHostAddrIn;
+		socklen_t nStructSize = sizeof(struct sockaddr);
+		SOCKET s = accept(m_sock, (struct sockaddr*)&sHostAddrIn, &nStructSize);
+		if(s < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK) // no more connections are ready to be accepted
+				return;
+			if(errno == EINTR)
+				continue;
+			string s2 = "Received bad data while trying to accept a connection: ";
+			s2 += strerror(errno);
+			onReceiveBadData(s2.c_str());
+			return;
+		}
+		GSocket_setSocketMode(s, false);
+		GTCPConnection* pConn = makeConnection(s);
+		m_socks.insert(pConn);
+
+		// Edge-triggered, so each event must be handled by reading or writing until the socket would block
+		struct epoll_event ev;
+		memset(&ev, '\0', sizeof(struct epoll_event));
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		ev.data.ptr = pConn;
+		if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, s, &ev) != 0)
+		{
+			string s2 = "epoll_ctl failed: ";
+			s2 += strerror(errno);
+			disconnect(pConn);
+			throw Ex(s2);
+		}
+	}
+}
+
+void GTCPServer::drain(GTCPConnection* pConn)
+{
+	vector<char>& buf = pConn->m_inBuf;
+	if(pConn->m_inPos >= buf.size())
+	{
+		// Everything has been consumed, so start over at the beginning of the buffer
+		buf.clear();
+		pConn->m_inPos = 0;
+	}
+	else if(pConn->m_inPos > 0)
+	{
+		// Discard the consumed bytes, so they do not accumulate while the client keeps sending
+		buf.erase(buf.begin(), buf.begin() + pConn->m_inPos);
+		pConn->m_inPos = 0;
+	}
+	while(!pConn->m_peerClosed)
+	{
+		if(buf.size() >= m_maxBuffered)
+		{
+			// Stop reading until receive consumes some of it. (Since the events are edge-triggered,
+			// receive must call drain again, because no new event will report the unread data.)
+			pConn->m_readPaused = true;
+			break;
+		}
+		size_t used = buf.size();
+		buf.resize(used + 4096);
+		ssize_t bytesReceived = recv(pConn->socket(), &buf[used], 4096, 0);
+		if(bytesReceived > 0)
+			buf.resize(used + (size_t)bytesReceived);
+		else
+		{
+			buf.resize(used);
+			if(bytesReceived == 0) // The client has disconnected gracefully
+				pConn->m_peerClosed = true;
+			else if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			else if(errno != EINTR)
+			{
+				string s2 = "Error calling recv: ";
+				s2 += strerror(errno);
+				onReceiveBadData(s2.c_str());
+				pConn->m_peerClosed = true;
+			}
+		}
+	}
+}
+
+void GTCPServer::flush(GTCPConnection* pConn)
+{
+	vector<char>& buf = pConn->m_outBuf;
+	size_t pos = 0;
+	try
+	{
+		while(pos < buf.size())
+		{
+			const char* pStart = &buf[pos];
+			size_t len = buf.size() - pos;
+			size_t bytesSent = GSocket_sendv(pConn->socket(), &pStart, &len, 1);
+			if(bytesSent == 0)
+				break;
+			pos += bytesSent;
+		}
+	}
+	catch(const std::exception& e)
+	{
+		onReceiveBadData(e.what());
+		pConn->m_peerClosed = true;
+		pos = buf.size();
+	}
+	buf.erase(buf.begin(), buf.begin() + pos);
+}
+#endif // __linux__
+
+bool GTCPServer::waitForActivity(unsigned int timeoutMs)
+{
+#ifdef __linux__
+	if(m_ready.size() == 0)
+		pollEvents((int)timeoutMs);
+	return m_ready.size() > 0;
+#else
+	GThread::sleep(timeoutMs);
+	return false;
+#endif
+}
+
 void GTCPServer::checkForNewConnections()
 {
+#ifdef __linux__
+	pollEvents(0);
+#else
 	if(!GSocket_isReady(m_sock))
 		return;
 
@@ -458,10 +683,49 @@ void GTCPServer::checkForNewConnections()
 	}
 	GSocket_setSocketMode(s, false);
 	m_socks.insert(makeConnection(s));
+#endif // !__linux__
 }
 
 size_t GTCPServer::receive(char* buf, size_t len, GTCPConnection** pOutConn)
 {
+#ifdef __linux__
+	if(m_ready.size() == 0)
+		pollEvents(0);
+	while(m_ready.size() > 0)
+	{
+		GTCPConnection* pConn = m_ready.front();
+		m_ready.pop_front();
+		size_t avail = pConn->m_inBuf.size() - pConn->m_inPos;
+		if(avail > 0)
+		{
+			size_t n = std::min(len, avail);
+			memcpy(buf, &pConn->m_inBuf[pConn->m_inPos], n);
+			pConn->m_inPos += n;
+			if(pConn->m_readPaused)
+			{
+				pConn->m_readPaused = false;
+				drain(pConn);
+			}
+			if(pConn->m_inPos < pConn->m_inBuf.size() || pConn->m_peerClosed)
+				m_ready.push_back(pConn); // Come back to it after the other connections have had a turn
+			else
+			{
+				pConn->m_queued = false;
+				if(pConn->m_inBuf.capacity() > 65536)
+					vector<char>().swap(pConn->m_inBuf); // Don't hold on to big buffers
+				else
+					pConn->m_inBuf.clear();
+				pConn->m_inPos = 0;
+			}
+			*pOutConn = pConn;
+			return n;
+		}
+		pConn->m_queued = false;
+		if(pConn->m_peerClosed && !isBusy(pConn))
+			disconnect(pConn);
+	}
+	return 0;
+#else
 	checkForNewConnections();
 	for(set<GTCPConnection*>::iterator it = m_socks.begin(); it != m_socks.end(); it++)
 	{
@@ -477,6 +741,8 @@ size_t GTCPServer::receive(char* buf, size_t len, GTCPConnection** pOutConn)
 			else if(bytesReceived == 0)
 			{
 				// The client has disconnected gracefully
+				if(isBusy(pConn))
+					continue;
 				disconnect(pConn);
 
 				// Recurse since the previous operation will invalidate the iterator
@@ -493,28 +759,90 @@ size_t GTCPServer::receive(char* buf, size_t len, GTCPConnection** pOutConn)
 		}
 	}
 	return 0;
+#endif // !__linux__
 }
 
 void GTCPServer::send(const char* buf, size_t len, GTCPConnection* pConn)
+{
+	send(&buf, &len, 1, pConn);
+}
+
+void GTCPServer::send(const char** bufs, const size_t* lens, size_t count, GTCPConnection* pConn)
 {
 	try
 	{
-		while(len > 0)
+#ifdef __linux__
+		if(pConn->m_peerClosed)
+			throw Ex("Tried to send to a client that has disconnected");
+		size_t skip = 0;
+		if(pConn->m_outBuf.size() == 0)
+			skip = GSocket_sendv(pConn->socket(), bufs, lens, count);
+
+		// Queue whatever did not fit. The event loop will send it when the socket becomes writable.
+		for(size_t i = 0; i < count; i++)
 		{
-			size_t bytesSent = GSocket_send(pConn->socket(), buf, len);
-			if(bytesSent > 0)
+			if(skip >= lens[i])
 			{
-				buf += bytesSent;
-				len -= bytesSent;
+				skip -= lens[i];
+				continue;
 			}
-			else
+			pConn->m_outBuf.insert(pConn->m_outBuf.end(), bufs[i] + skip, bufs[i] + lens[i]);
+			skip = 0;
+		}
+		if(pConn->m_outBuf.size() > 0)
+			flush(pConn);
+		if(pConn->m_peerClosed)
+			throw Ex("The client has disconnected");
+		if(pConn->m_outBuf.size() > m_maxBuffered)
+			throw Ex("Disconnected a client that is not receiving. (", to_str(pConn->m_outBuf.size()), " bytes were queued for it.)");
+#elif !defined(WINDOWS)
+		vector<const char*> b(bufs, bufs + count);
+		vector<size_t> l(lens, lens + count);
+		size_t first = 0;
+		while(first < count)
+		{
+			if(l[first] == 0)
+			{
+				first++;
+				continue;
+			}
+			size_t bytesSent = GSocket_sendv(pConn->socket(), &b[first], &l[first], count - first);
+			if(bytesSent == 0)
 				GThread::sleep(0);
+			while(bytesSent > 0)
+			{
+				size_t n = std::min(bytesSent, l[first]);
+				b[first] += n;
+				l[first] -= n;
+				bytesSent -= n;
+				if(l[first] == 0)
+					first++;
+			}
+		}
+#else
+		for(size_t i = 0; i < count; i++)
+		{
+			const char* buf = bufs[i];
+			size_t len = lens[i];
+			while(len > 0)
+			{
+				size_t bytesSent = GSocket_send(pConn->socket(), buf, len);
+				if(bytesSent > 0)
+				{
+					buf += bytesSent;
+					len -= bytesSent;
+				}
+				else
+					GThread::sleep(0);
+			}
 		}
+#endif
 	}
 	catch(const std::exception& e)
 	{
+		string s = e.what();
 		disconnect(pConn);
-		throw e;
+		throw Ex(s);
 	}
 }
 
@@ -745,6 +1073,25 @@ void GPackageClient::send(const char* buf, size_t len)
 	size_t hl = 2 * sizeof(unsigned int);
 	try
 	{
+#ifndef WINDOWS
+		// Send the header and the payload together, so the header is not delayed waiting for an ack
+		while(hl > 0)
+		{
+			const char* bufs[2] = { pH, buf };
+			size_t lens[2] = { hl, len };
+			size_t bytesSent = GSocket_sendv(m_conn.socket(), bufs, lens, 2);
+			if(bytesSent > 0)
+			{
+				size_t n = std::min(hl, bytesSent);
+				pH += n;
+				hl -= n;
+				buf += bytesSent - n;
+				len -= bytesSent - n;
+			}
+			else
+				pump();
+		}
+#else
 		while(hl > 0)
 		{
 			size_t bytesSent = GSocket_send(m_conn.socket(), pH, hl);
@@ -756,6 +1103,7 @@ void GPackageClient::send(const char* buf, size_t len)
 			else
 				pump();
 		}
+#endif
 		while(len > 0)
 		{
 			size_t bytesSent = GSocket_send(m_conn.socket(), buf, len);
@@ -903,6 +1251,25 @@ void GPackageServer::send(const char* buf, size_t len, GPackageConnection* pConn
 	size_t hl = 2 * sizeof(unsigned int);
 	try
 	{
+#ifndef WINDOWS
+		// Send the header and the payload together, so the header is not delayed waiting for an ack
+		while(hl > 0)
+		{
+			const char* bufs[2] = { pH, buf };
+			size_t lens[2] = { hl, len };
+			size_t bytesSent = GSocket_sendv(pConn->socket(), bufs, lens, 2);
+			if(bytesSent > 0)
+			{
+				size_t n = std::min(hl, bytesSent);
+				pH += n;
+				hl -= n;
+				buf += bytesSent - n;
+				len -= bytesSent - n;
+			}
+			else
+				pump(pConn);
+		}
+#else
 		while(hl > 0)
 		{
 			size_t bytesSent = GSocket_send(pConn->socket(), pH, hl);
@@ -914,6 +1281,7 @@ void GPackageServer::send(const char* buf, size_t len, GPackageConnection* pConn
 			else
 				pump(pConn);
 		}
+#endif
 		while(len > 0)
 		{
 			size_t bytesSent = GSocket_send(pConn->socket(), buf, len);
@@ -935,9 +1303,10 @@ void GPackageServer::send(const char* buf, size_t len, GPackageConnection* pConn
 char* GPackageServer::receive(size_t* pOutLen, GPackageConnection** pOutConn)
 {
 	checkForNewConnections();
-	for(set<GPackageConnection*>::iterator it = m_socks.begin(); it != m_socks.end(); it++)
+	for(set<GPackageConnection*>::iterator it = m_socks.begin(); it != m_socks.end(); )
 	{
 		GPackageConnection* pConn = *it;
+		it++; // (advance first, because disconnect removes pConn from the set)
 		int status = pConn->receive(m_maxBufSize, m_maxPackageSize);
 		if(status)
 		{
@@ -1053,6 +1422,157 @@ void GPackageServer_serial_test()
 		throw Ex("something is amiss");
 }
 
+class GTCPServer_testServer : public GTCPServer
+{
+public:
+	size_t m_connections;
+	size_t m_disconnects;
+
+	GTCPServer_testServer(unsigned short port)
+	: GTCPServer(port), m_connections(0), m_disconnects(0)
+	{
+	}
+
+protected:
+	virtual GTCPConnection* makeConnection(SOCKET s)
+	{
+		m_connections++;
+		return new GTCPConnection(s);
+	}
+
+	virtual void onDisconnect(GTCPConnection* pConn)
+	{
+		m_disconnects++;
+	}
+};
+
+// static
+void GTCPServer::test()
+{
+	GTCPServer_testServer server(TEST_PORT + 1);
+	GTCPClient clients[CLIENT_COUNT];
+	for(size_t i = 0; i < CLIENT_COUNT; i++)
+		clients[i].connect("localhost", TEST_PORT + 1, 5);
+
+	// Each client sends a one-byte request, and the server responds with that byte
+	// followed by a payload that is too big to fit in the socket buffers
+	GRand rand(0);
+	vector<char> payload(1 << 20);
+	for(size_t i = 0; i < payload.size(); i++)
+		payload[i] = (char)rand.next(256);
+	for(size_t i = 0; i < CLIENT_COUNT; i++)
+	{
+		char c = (char)i;
+		clients[i].send(&c, 1);
+	}
+	vector<size_t> received(CLIENT_COUNT, 0);
+	size_t done = 0;
+	size_t requests = 0;
+	char buf[4096];
+	for(size_t iters = 0; done < CLIENT_COUNT; iters++)
+	{
+		if(iters > 10000000)
+			throw Ex("timed out");
+		GTCPConnection* pConn;
+		size_t n = server.receive(buf, sizeof(buf), &pConn);
+		for(size_t i = 0; i < n; i++)
+		{
+			const char* bufs[2] = { buf + i, &payload[0] };
+			size_t lens[2] = { 1, payload.size() };
+			server.send(bufs, lens, 2, pConn);
+			requests++;
+		}
+		for(size_t i = 0; i < CLIENT_COUNT; i++)
+		{
+			size_t m = clients[i].receive(buf, sizeof(buf));
+			for(size_t j = 0; j < m; j++)
+			{
+				char expected = (received[i] == 0 ? (char)i : payload[received[i] - 1]);
+				if(buf[j] != expected)
+					throw Ex("corrupted response");
+				if(++received[i] == payload.size() + 1)
+					done++;
+			}
+		}
+	}
+	if(requests != CLIENT_COUNT || server.m_connections != CLIENT_COUNT)
+		throw Ex("wrong number of requests or connections");
+
+#ifdef __linux__
+	// The server should notice when a client disconnects
+	clients[0].disconnect();
+	for(size_t iters = 0; server.m_disconnects == 0; iters++)
+	{
+		if(iters > 1000)
+			throw Ex("failed to detect a disconnect");
+		server.waitForActivity(10);
+		GTCPConnection* pConn;
+		if(server.receive(buf, sizeof(buf), &pConn) > 0)
+			throw Ex("unexpected data");
+	}
+	if(server.connections().size() != CLIENT_COUNT - 1)
+		throw Ex("wrong number of connections");
+
+	// Test the limits on the buffered input and output
+	{
+		GTCPServer_testServer server2(TEST_PORT + 2);
+		server2.setMaxBufferedBytes(8192);
+		GTCPClient client;
+		client.connect("localhost", TEST_PORT + 2, 5);
+		for(size_t iters = 0; server2.connections().size() == 0; iters++)
+		{
+			if(iters > 1000)
+				throw Ex("failed to accept the connection");
+			server2.waitForActivity(10);
+		}
+		GTCPConnection* pServerConn = *server2.connections().begin();
+
+		// A client that sends faster than the server consumes should only get a bounded amount buffered
+		vector<char> data(65536);
+		for(size_t i = 0; i < data.size(); i++)
+			data[i] = (char)(i % 251);
+		client.send(&data[0], data.size());
+		for(size_t i = 0; i < 20; i++)
+			server2.waitForActivity(10);
+		if(pServerConn->m_inBuf.size() - pServerConn->m_inPos > 8192 + 4096)
+			throw Ex("buffered too much input");
+
+		// Reading should resume as the input is consumed, so all of the data still arrives
+		size_t consumed = 0;
+		for(size_t iters = 0; consumed < data.size(); iters++)
+		{
+			if(iters > 100000)
+				throw Ex("stopped receiving after the input limit was reached");
+			GTCPConnection* pConn;
+			size_t n = server2.receive(buf, sizeof(buf), &pConn);
+			if(n == 0)
+				server2.waitForActivity(10);
+			for(size_t i = 0; i < n; i++)
+			{
+				if(buf[i] != data[consumed++])
+					throw Ex("corrupted input");
+			}
+		}
+
+		// A client that does not read should be disconnected before too much output is queued for it
+		bool disconnected = false;
+		for(size_t i = 0; i < 1024 && !disconnected; i++)
+		{
+			try
+			{
+				server2.send(&data[0], data.size(), pServerConn);
+			}
+			catch(const std::exception&)
+			{
+				disconnected = true;
+			}
+		}
+		if(!disconnected || server2.connections().size() != 0 || server2.m_disconnects != 1)
+			throw Ex("did not disconnect a client that stopped reading");
+	}
+#endif
+}
+
 void GPackageServer::test()
 {
 	GPackageServer_serial_test();
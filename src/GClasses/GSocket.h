@@ -39,6 +39,7 @@
 #include <vector>
 #include <set>
 #include <queue>
+#include <deque>
 #include <string.h>
 
 namespace GClasses {
@@ -87,11 +88,18 @@ protected:
 /// to return your own custom object.)
 class GTCPConnection
 {
+friend class GTCPServer;
 protected:
 	SOCKET m_sock;
+	std::vector<char> m_inBuf; // data received by the event loop that has not yet been consumed by GTCPServer::receive
+	size_t m_inPos; // the position in m_inBuf of the next byte to be consumed
+	std::vector<char> m_outBuf; // data that could not be sent immediately because the socket's send buffer was full
+	bool m_queued; // true iff this connection is in the server's queue of connections that need attention
+	bool m_peerClosed; // true iff the client has closed the connection or an error occurred on it
+	bool m_readPaused; // true iff the event loop stopped reading because m_inBuf reached the server's limit
 
 public:
-	GTCPConnection(SOCKET sock) : m_sock(sock) {}
+	GTCPConnection(SOCKET sock) : m_sock(sock), m_inPos(0), m_queued(false), m_peerClosed(false), m_readPaused(false) {}
 	virtual ~GTCPConnection() {}
 
 	/// Returns the socket associated with this connection
@@ -112,6 +120,11 @@ class GTCPServer
 protected:
 	SOCKET m_sock; // used to listen for incoming connections
 	std::set<GTCPConnection*> m_socks; // used to communicate with each connected client
+#ifdef __linux__
+	int m_epoll; // reports which sockets have become readable or writable
+	std::deque<GTCPConnection*> m_ready; // connections with buffered data to consume, or which need to be disconnected
+#endif
+	size_t m_maxBuffered; // the most input or output that may be buffered for one connection
 
 public:
 	GTCPServer(unsigned short port);
@@ -119,18 +132,41 @@ public:
 
 	/// Send some data to the specified client. Throws an exception if the send fails for any reason (including
 	/// common reasons, such as if the client has closed the connection), so it is generally a good idea to send
-	/// within a try/catch block.
+	/// within a try/catch block. On Linux, any data that does not fit in the socket's send buffer is queued
+	/// and sent by the event loop when the socket becomes writable, so this method does not block.
 	void send(const char* buf, size_t len, GTCPConnection* pConn);
 
+	/// Sends count buffers to the specified client, in order, as if they were one
+	/// contiguous buffer. Where the platform supports it, this gathers all of the
+	/// buffers into a single system call (sendmsg/writev), which avoids both copying
+	/// and sending many small TCP segments. Throws in the same cases as send.
+	void send(const char** bufs, const size_t* lens, size_t count, GTCPConnection* pConn);
+
 	/// This method receives any data that is ready to be received. It returns the
 	/// number of bytes received. It immediately returns 0 if nothing is ready to
 	/// be recevied. The value at pOutConn will be set to indicate which client
-	/// it received the data from.
+	/// it received the data from. On Linux, this is driven by an edge-triggered
+	/// epoll event loop that drains each readable socket into a per-connection
+	/// buffer, so its cost does not grow with the number of idle connections.
 	size_t receive(char* buf, size_t len, GTCPConnection** pOutConn);
 
+	/// Blocks until there is data ready to be received, or until timeoutMs
+	/// milliseconds have elapsed. Returns true if data is ready. (This is useful in
+	/// place of sleeping between calls to receive, since it wakes up as soon as a
+	/// client sends something. On platforms without epoll, it just sleeps and returns false.)
+	bool waitForActivity(unsigned int timeoutMs);
+
 	/// Disconnect from the specified client.
 	void disconnect(GTCPConnection* pConn);
 
+	/// Limits how many bytes may be buffered for each connection. (The default is 256MB.)
+	/// When a connection has this many bytes of received data that receive has not consumed,
+	/// the event loop stops reading from it until some are consumed, so TCP flow control
+	/// slows the client down. If more than this many bytes of output are queued for a client
+	/// that is not reading them, send disconnects it and throws. (This only applies on Linux,
+	/// since the other platforms do not buffer.)
+	void setMaxBufferedBytes(size_t n) { m_maxBuffered = n; }
+
 	/// Obtains the name of this host.
 	static void hostName(char* buf, size_t len);
 
@@ -140,7 +176,29 @@ public:
 	/// Accept any new incoming connections
 	void checkForNewConnections();
 
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // !NO_TEST_CODE
+
 protected:
+#ifdef __linux__
+	/// Waits up to timeoutMs milliseconds for socket events, then accepts new
+	/// connections, reads everything available from readable sockets, and
+	/// flushes queued output to writable sockets.
+	void pollEvents(int timeoutMs);
+
+	/// Accepts all pending connections and registers them with the event loop.
+	void acceptConnections();
+
+	/// Reads from the connection until the socket would block, or until the
+	/// unconsumed input reaches the limit set by setMaxBufferedBytes.
+	void drain(GTCPConnection* pConn);
+
+	/// Sends as much of the connection's queued output as the socket will take.
+	void flush(GTCPConnection* pConn);
+#endif
+
 	/// This is called just before a new connection is accepted. It
 	/// returns a pointer to a new GTCPConnection object to
 	/// associate with this connection. (The connection, however, isn't yet fully
@@ -155,6 +213,11 @@ protected:
 
 	/// This is called when a client sends some bad data.
 	virtual void onReceiveBadData(const char* message) {}
+
+	/// Returns true if some other thread is still using pConn. While this returns
+	/// true, receive will not disconnect pConn when the client closes the connection.
+	/// (It will be disconnected when a subsequent attempt to send to it fails.)
+	virtual bool isBusy(GTCPConnection* pConn) { return false; }
 };
 
 
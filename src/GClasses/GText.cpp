@@ -20,11 +20,20 @@
 #include "GHashTable.h"
 #include "GHeap.h"
 #include "GStemmer.h"
+#include "GSparseMatrix.h"
+#include "GThread.h"
+#include "GRand.h"
+#include "GVec.h"
 #include <math.h>
+#include <cmath>
+#include <algorithm>
+#include <memory>
 
 namespace GClasses {
 
 using std::vector;
+using std::string;
+using std::map;
 
 GWordIterator::GWordIterator(const char* text, size_t len)
 : m_pText(text), m_len(len)
@@ -242,5 +251,435 @@ double GVocabulary::weight(size_t word)
 	return log((double)docCount() / ws.m_docsContainingWord) / ws.m_maxWordFreq;
 }
 
+
+
+
+/// Statistics about a word that is collected by GCorpusVectorizer
+struct GCorpusWordStats
+{
+	size_t m_docsContainingWord;
+	size_t m_maxWordFreq;
+	size_t m_firstDoc; // the first document in which the word occurs
+	size_t m_firstPos; // the position of the first occurrence of the word in that document
+};
+
+/// Sorts words in the order they first occur in the collection
+class GCorpusWordOrder
+{
+public:
+	bool operator()(const map<string,GCorpusWordStats>::iterator& a, const map<string,GCorpusWordStats>::iterator& b) const
+	{
+		if(a->second.m_firstDoc != b->second.m_firstDoc)
+			return a->second.m_firstDoc < b->second.m_firstDoc;
+		return a->second.m_firstPos < b->second.m_firstPos;
+	}
+};
+
+size_t GCorpusVectorizer_hash(const char* szStem)
+{
+	// FNV-1a
+	uint64_t h = 14695981039346656037ULL;
+	while(*szStem != '\0')
+	{
+		h ^= (unsigned char)*szStem;
+		h *= 1099511628211ULL;
+		szStem++;
+	}
+	return (size_t)h;
+}
+
+class GCorpusVectorizerWorker : public GWorkerThread
+{
+protected:
+	GCorpusVectorizer& m_vectorizer;
+	GCorpusDocuments& m_docs;
+	GStemmer* m_pStemmer;
+	char m_buf[GSTEMMER_MAX_WORD_SIZE];
+	string m_text;
+	string m_key;
+	GSparseMatrix* m_pOut;
+	map<size_t,size_t> m_row;
+
+public:
+	map<string,GCorpusWordStats> m_vocabulary;
+	string m_error;
+
+	GCorpusVectorizerWorker(GMasterThread& master, GCorpusVectorizer& vectorizer, GCorpusDocuments& docs)
+	: GWorkerThread(master), m_vectorizer(vectorizer), m_docs(docs), m_pOut(NULL)
+	{
+		m_pStemmer = vectorizer.m_stemWords ? new GStemmer() : NULL;
+	}
+
+	virtual ~GCorpusVectorizerWorker()
+	{
+		delete(m_pStemmer);
+	}
+
+	/// Specifies the matrix to emit rows into. If it is NULL, this collects the vocabulary instead.
+	void setOutput(GSparseMatrix* pOut) { m_pOut = pOut; }
+
+	virtual void doJob(size_t jobId)
+	{
+		// Exceptions must not escape from a worker thread, so they are reported back to the master
+		try
+		{
+			m_docs.load(jobId, m_text);
+			if(m_pOut)
+				emitRow(jobId);
+			else
+				collectWords(jobId);
+		}
+		catch(std::exception& e)
+		{
+			if(m_error.length() == 0)
+				m_error = e.what();
+		}
+	}
+
+protected:
+	/// Lowercases and stems a word. Returns NULL if the word should be ignored.
+	const char* stem(const char* pWord, size_t len)
+	{
+		if(len < m_vectorizer.m_minWordSize)
+			return NULL;
+		len = std::min(len, (size_t)GSTEMMER_MAX_WORD_SIZE - 1);
+		const char* szStem;
+		if(m_pStemmer)
+			szStem = m_pStemmer->getStem(pWord, len);
+		else
+		{
+			for(size_t i = 0; i < len; i++)
+				m_buf[i] = tolower(pWord[i]);
+			m_buf[len] = '\0';
+			szStem = m_buf;
+		}
+		m_key.assign(szStem);
+		if(m_vectorizer.m_stopWords.find(m_key) != m_vectorizer.m_stopWords.end())
+			return NULL;
+		return szStem;
+	}
+
+	void collectWords(size_t doc)
+	{
+		// Count the words in this document
+		GWordIterator it(m_text.c_str(), m_text.length());
+		const char* pWord;
+		size_t wordLen;
+		size_t pos = 0;
+		map<string,size_t> counts;
+		while(it.next(&pWord, &wordLen))
+		{
+			if(!stem(pWord, wordLen))
+				continue;
+			map<string,size_t>::iterator itCount = counts.find(m_key);
+			if(itCount == counts.end())
+			{
+				counts[m_key] = 1;
+				map<string,GCorpusWordStats>::iterator itStats = m_vocabulary.find(m_key);
+				if(itStats == m_vocabulary.end())
+				{
+					GCorpusWordStats& ws = m_vocabulary[m_key];
+					ws.m_docsContainingWord = 0;
+					ws.m_maxWordFreq = 0;
+					ws.m_firstDoc = doc;
+					ws.m_firstPos = pos;
+				}
+				else if(doc < itStats->second.m_firstDoc)
+				{
+					itStats->second.m_firstDoc = doc;
+					itStats->second.m_firstPos = pos;
+				}
+			}
+			else
+				itCount->second++;
+			pos++;
+		}
+
+		// Update the stats
+		for(map<string,size_t>::iterator itCount = counts.begin(); itCount != counts.end(); itCount++)
+		{
+			GCorpusWordStats& ws = m_vocabulary[itCount->first];
+			ws.m_docsContainingWord++;
+			ws.m_maxWordFreq = std::max(ws.m_maxWordFreq, itCount->second);
+		}
+	}
+
+	void emitRow(size_t doc)
+	{
+		// Count the occurrences of each column
+		m_row.clear();
+		GWordIterator it(m_text.c_str(), m_text.length());
+		const char* pWord;
+		size_t wordLen;
+		size_t buckets = m_vectorizer.m_hashBuckets;
+		while(it.next(&pWord, &wordLen))
+		{
+			const char* szStem = stem(pWord, wordLen);
+			if(!szStem)
+				continue;
+			size_t col;
+			if(buckets > 0)
+				col = GCorpusVectorizer_hash(szStem) % buckets;
+			else
+			{
+				map<string,size_t>::const_iterator itWord = m_vectorizer.m_vocabulary.find(m_key);
+				if(itWord == m_vectorizer.m_vocabulary.end())
+					continue;
+				col = itWord->second;
+			}
+			m_row[col]++;
+		}
+
+		// Each thread writes only to the rows of its own documents
+		for(map<size_t,size_t>::iterator itCol = m_row.begin(); itCol != m_row.end(); itCol++)
+		{
+			double val;
+			if(m_vectorizer.m_binary)
+				val = 1.0;
+			else if(buckets > 0)
+				val = (double)itCol->second;
+			else
+				val = itCol->second * m_vectorizer.m_weights[itCol->first];
+			m_pOut->set(doc, itCol->first, val);
+		}
+	}
+};
+
+GCorpusVectorizer::GCorpusVectorizer(bool stemWords)
+: m_stemWords(stemWords), m_minWordSize(4), m_workerThreads(1), m_binary(false), m_hashBuckets(0)
+{
+}
+
+GCorpusVectorizer::~GCorpusVectorizer()
+{
+}
+
+void GCorpusVectorizer::addStopWord(const char* szWord)
+{
+	string s(szWord);
+	for(size_t i = 0; i < s.length(); i++)
+		s[i] = tolower(s[i]);
+	if(m_stemWords)
+	{
+		GStemmer stemmer;
+		s = stemmer.getStem(s.c_str(), std::min(s.length(), (size_t)GSTEMMER_MAX_WORD_SIZE - 1));
+	}
+	m_stopWords.insert(s);
+}
+
+void GCorpusVectorizer::addTypicalStopWords()
+{
+	for(size_t i = 0; i < (sizeof(g_szStopWords) / sizeof(const char*)); i++)
+		m_stopWords.insert(g_szStopWords[i]);
+}
+
+size_t GCorpusVectorizer::wordIndex(const char* szStem)
+{
+	map<string,size_t>::iterator it = m_vocabulary.find(szStem);
+	if(it == m_vocabulary.end())
+		return INVALID_INDEX;
+	return it->second;
+}
+
+GSparseMatrix* GCorpusVectorizer::vectorize(GCorpusDocuments& docs)
+{
+	size_t docCount = docs.count();
+	m_vocabulary.clear();
+	m_words.clear();
+	m_weights.clear();
+	GSparseMatrix* pOut = NULL;
+	string error;
+	{
+		GMasterThread master;
+		vector<GCorpusVectorizerWorker*> workers;
+		for(size_t i = 0; i < std::max((size_t)1, std::min(m_workerThreads, docCount)); i++)
+		{
+			workers.push_back(new GCorpusVectorizerWorker(master, *this, docs));
+			master.addWorker(workers.back());
+		}
+
+		if(m_hashBuckets == 0)
+		{
+			// Collect a vocabulary in each thread
+			master.doJobs(docCount);
+			for(size_t i = 0; i < workers.size() && error.length() == 0; i++)
+				error = workers[i]->m_error;
+			if(error.length() > 0)
+				throw Ex(error);
+
+			// Merge the vocabularies
+			map<string,GCorpusWordStats> merged;
+			merged.swap(workers[0]->m_vocabulary);
+			for(size_t i = 1; i < workers.size(); i++)
+			{
+				for(map<string,GCorpusWordStats>::iterator it = workers[i]->m_vocabulary.begin(); it != workers[i]->m_vocabulary.end(); it++)
+				{
+					map<string,GCorpusWordStats>::iterator itMerged = merged.find(it->first);
+					if(itMerged == merged.end())
+					{
+						merged.insert(*it);
+						continue;
+					}
+					GCorpusWordStats& a = itMerged->second;
+					const GCorpusWordStats& b = it->second;
+					a.m_docsContainingWord += b.m_docsContainingWord;
+					a.m_maxWordFreq = std::max(a.m_maxWordFreq, b.m_maxWordFreq);
+					if(b.m_firstDoc < a.m_firstDoc)
+					{
+						a.m_firstDoc = b.m_firstDoc;
+						a.m_firstPos = b.m_firstPos;
+					}
+				}
+				map<string,GCorpusWordStats> empty;
+				workers[i]->m_vocabulary.swap(empty);
+			}
+
+			// Number the words in the order they first occur, so the columns do not depend on how the documents were divided among the threads
+			vector<map<string,GCorpusWordStats>::iterator> order;
+			order.reserve(merged.size());
+			for(map<string,GCorpusWordStats>::iterator it = merged.begin(); it != merged.end(); it++)
+				order.push_back(it);
+			GCorpusWordOrder comp;
+			std::sort(order.begin(), order.end(), comp);
+			m_words.reserve(order.size());
+			m_weights.reserve(order.size());
+			for(size_t i = 0; i < order.size(); i++)
+			{
+				const GCorpusWordStats& ws = order[i]->second;
+				m_vocabulary[order[i]->first] = i;
+				m_words.push_back(order[i]->first);
+				m_weights.push_back(log((double)docCount / ws.m_docsContainingWord) / ws.m_maxWordFreq);
+			}
+		}
+
+		// Emit the rows
+		pOut = new GSparseMatrix(docCount, m_hashBuckets > 0 ? m_hashBuckets : m_words.size());
+		for(size_t i = 0; i < workers.size(); i++)
+			workers[i]->setOutput(pOut);
+		master.doJobs(docCount);
+		for(size_t i = 0; i < workers.size() && error.length() == 0; i++)
+			error = workers[i]->m_error;
+	}
+	if(error.length() > 0)
+	{
+		delete(pOut);
+		throw Ex(error);
+	}
+	return pOut;
+}
+
+#ifndef NO_TEST_CODE
+class GCorpusVectorizerTestDocs : public GCorpusDocuments
+{
+public:
+	vector<string> m_docs;
+
+	virtual size_t count() { return m_docs.size(); }
+	virtual void load(size_t doc, string& text) { text = m_docs[doc]; }
+};
+
+// static
+void GCorpusVectorizer::test()
+{
+	GCorpusVectorizerTestDocs docs;
+	const char* words[] = { "Apple", "banana", "Cherry", "durian", "elderberry", "figs", "grape", "honeydew", "kiwi", "lemon", "mango", "nectarine", "the", "with" };
+	size_t wordTypes = sizeof(words) / sizeof(const char*);
+	GRand rand(0);
+	for(size_t i = 0; i < 60; i++)
+	{
+		string s;
+		size_t len = 5 + (size_t)rand.next(30);
+		for(size_t j = 0; j < len; j++)
+		{
+			s += words[rand.next(wordTypes)];
+			s += (j % 7 == 6 ? ". " : " ");
+		}
+		docs.m_docs.push_back(s);
+	}
+
+	// Compute the expected values with GVocabulary (which does not lowercase)
+	vector<string> lower(docs.m_docs);
+	for(size_t i = 0; i < lower.size(); i++)
+	{
+		for(size_t j = 0; j < lower[i].length(); j++)
+			lower[i][j] = tolower(lower[i][j]);
+	}
+	GVocabulary vocab(false);
+	vocab.addTypicalStopWords();
+	for(size_t i = 0; i < lower.size(); i++)
+	{
+		vocab.newDoc();
+		vocab.addWordsFromTextBlock(lower[i].c_str(), lower[i].length());
+	}
+
+	GSparseMatrix* pPrev = NULL;
+	for(size_t threads = 1; threads <= 3; threads++)
+	{
+		GCorpusVectorizer vec(false);
+		vec.addTypicalStopWords();
+		vec.setWorkerThreads(threads);
+		GSparseMatrix* pM = vec.vectorize(docs);
+		std::unique_ptr<GSparseMatrix> hM(pM);
+		if(vec.wordCount() != vocab.wordCount() || pM->cols() != vocab.wordCount() || pM->rows() != docs.m_docs.size())
+			throw Ex("wrong size");
+		for(size_t i = 0; i < vec.wordCount(); i++)
+		{
+			if(strcmp(vec.word(i), vocab.stats(i).m_szWord) != 0)
+				throw Ex("wrong word order");
+			if(std::abs(vec.weight(i) - vocab.weight(i)) > 1e-12)
+				throw Ex("wrong weight");
+		}
+		for(size_t i = 0; i < lower.size(); i++)
+		{
+			GVec expected(vocab.wordCount());
+			expected.fill(0.0);
+			GWordIterator it(lower[i].c_str(), lower[i].length());
+			const char* pWord;
+			size_t len;
+			while(it.next(&pWord, &len))
+			{
+				size_t index = vocab.wordIndex(pWord, len);
+				if(index != INVALID_INDEX && len >= 4)
+					expected[index] += vocab.weight(index);
+			}
+			for(size_t j = 0; j < vocab.wordCount(); j++)
+			{
+				if(std::abs(pM->get(i, j) - expected[j]) > 1e-9)
+					throw Ex("wrong value");
+			}
+		}
+		if(pPrev)
+		{
+			for(size_t i = 0; i < pM->rows(); i++)
+			{
+				if(pM->row(i) != pPrev->row(i))
+					throw Ex("results depend on the number of threads");
+			}
+		}
+		delete(pPrev);
+		pPrev = hM.release();
+	}
+	delete(pPrev);
+
+	// Test the hashing trick
+	GCorpusVectorizer hasher(true);
+	hasher.addTypicalStopWords();
+	hasher.useHashing(1024);
+	hasher.setBinary(true);
+	hasher.setWorkerThreads(2);
+	GSparseMatrix* pH = hasher.vectorize(docs);
+	std::unique_ptr<GSparseMatrix> hH(pH);
+	if(hasher.wordCount() != 0 || pH->cols() != 1024)
+		throw Ex("wrong size");
+	for(size_t i = 0; i < pH->rows(); i++)
+	{
+		if(pH->row(i).size() == 0 || pH->row(i).size() > wordTypes - 2)
+			throw Ex("wrong number of columns");
+		if(pH->get(i, GCorpusVectorizer_hash("appl") % 1024) != (lower[i].find("apple") != string::npos ? 1.0 : 0.0))
+			throw Ex("wrong value");
+	}
+}
+#endif // !NO_TEST_CODE
+
 } // namespace GClasses
 
@@ -22,6 +22,9 @@
 #include <sys/types.h>
 #include <cstddef>
 #include <vector>
+#include <string>
+#include <map>
+#include <set>
 
 namespace GClasses {
 
@@ -29,6 +32,7 @@ class GConstStringHashTable;
 class GConstStringToIndexHashTable;
 class GStemmer;
 class GHeap;
+class GSparseMatrix;
 
 
 /// This iterates over the words in a block of text
@@ -134,6 +138,102 @@ public:
 	double weight(size_t word);
 };
 
+
+/// The interface of a collection of documents for GCorpusVectorizer
+class GCorpusDocuments
+{
+public:
+	GCorpusDocuments() {}
+	virtual ~GCorpusDocuments() {}
+
+	/// Returns the number of documents in the collection
+	virtual size_t count() = 0;
+
+	/// Puts the text of the specified document in text. This is called
+	/// concurrently from several threads, so it must be thread-safe. Each
+	/// document is loaded once per pass.
+	virtual void load(size_t doc, std::string& text) = 0;
+};
+
+
+/// Converts a collection of documents to sparse vectors in the vector-space
+/// document model. Unlike GVocabulary, this does all of its tokenizing and stemming
+/// with buffers that belong to a worker thread, so the documents can be processed
+/// concurrently. In the first pass, each thread collects the words (lowercased,
+/// stemmed, and filtered through a list of stop-words) and their statistics
+/// in a vocabulary of its own. These are merged, and the words are numbered in
+/// the order they first occur in the collection, so the results do not depend
+/// on the number of threads. In the second pass, each thread emits the rows for
+/// its documents directly into the sparse matrix. Alternatively, with the hashing
+/// trick, no vocabulary is needed, and only one pass is made.
+class GCorpusVectorizer
+{
+friend class GCorpusVectorizerWorker;
+protected:
+	bool m_stemWords;
+	size_t m_minWordSize;
+	size_t m_workerThreads;
+	bool m_binary;
+	size_t m_hashBuckets;
+	std::set<std::string> m_stopWords;
+	std::map<std::string,size_t> m_vocabulary;
+	std::vector<std::string> m_words;
+	std::vector<double> m_weights;
+
+public:
+	GCorpusVectorizer(bool stemWords);
+	~GCorpusVectorizer();
+
+	/// Sets the minimum word size. Smaller words will be ignored. The
+	/// default is 4.
+	void setMinWordSize(size_t n) { m_minWordSize = n; }
+
+	/// Specifies the number of threads to use. (The default is 1.)
+	void setWorkerThreads(size_t n) { m_workerThreads = (n > 1 ? n : 1); }
+
+	/// If binary is true, each element is 1 if the document contains the word.
+	/// Otherwise (the default), each occurrence of a word adds its weight.
+	void setBinary(bool binary) { m_binary = binary; }
+
+	/// Specifies to use the hashing trick with the specified number of columns.
+	/// Each word is mapped to a column by a hash of its stem, so no vocabulary
+	/// is built, and only one pass is made over the documents. Since the number
+	/// of documents that contain each word is not known, each occurrence adds
+	/// 1 instead of a weight. Pass 0 to build a vocabulary again (the default).
+	void useHashing(size_t buckets) { m_hashBuckets = buckets; }
+
+	/// Adds a stop word (a common word that should always be ignored)
+	void addStopWord(const char* szWord);
+
+	/// Adds a typical set of stop words
+	void addTypicalStopWords();
+
+	/// Converts the documents to a sparse matrix with one row per document.
+	/// The caller is responsible to delete the matrix that is returned.
+	/// If a vocabulary is built, it is replaced each time this is called.
+	GSparseMatrix* vectorize(GCorpusDocuments& docs);
+
+	/// Returns the number of words in the vocabulary that was built by the last
+	/// call to vectorize. (This is 0 when hashing is used.)
+	size_t wordCount() { return m_words.size(); }
+
+	/// Returns the (stemmed) word that corresponds with the specified column
+	const char* word(size_t index) { return m_words[index].c_str(); }
+
+	/// Returns the weight that is added for each occurrence of the specified word.
+	/// It is log(number_of_docs/docs_containing_word)/max_word_frequency.
+	double weight(size_t index) { return m_weights[index]; }
+
+	/// Returns the column of the specified word, or INVALID_INDEX if it
+	/// is not in the vocabulary. (The word is expected to be stemmed already.)
+	size_t wordIndex(const char* szStem);
+
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // !NO_TEST_CODE
+};
+
 } // namespace GClasses
 
 #endif // __GTEXT_H__
@@ -30,11 +30,14 @@
 #include "GString.h"
 #endif // MIN_PREDICT
 #include "GNeuralNet.h"
+#include "GActivation.h"
 #ifndef MIN_PREDICT
 #include "GRecommender.h"
 #endif // MIN_PREDICT
 #include "GHolders.h"
+#include "GThread.h"
 #include <stdlib.h>
+#include <string.h>
 #include <vector>
 #include <algorithm>
 #include <math.h>
@@ -160,6 +163,12 @@ std::unique_ptr<GMatrix> GIncrementalTransform::untransformBatch(const GMatrix&
 	return pOut;
 }
 
+// virtual
+void GIncrementalTransform::addToPipeline(GTransformPipeline& pipeline)
+{
+	pipeline.addTransform(this);
+}
+
 #ifndef MIN_PREDICT
 //static
 void GIncrementalTransform::test()
@@ -286,6 +295,26 @@ void GIncrementalTransformChainer::transform(const GVec& in, GVec& out)
 	m_pSecond->transform(buf, out);
 }
 
+// virtual
+GMatrix* GIncrementalTransformChainer::transformBatch(const GMatrix& in)
+{
+	GTransformPipeline pipeline;
+	pipeline.add(this);
+	pipeline.compile();
+	GMatrix* pOut = new GMatrix(after().clone());
+	std::unique_ptr<GMatrix> hOut(pOut);
+	pOut->newRows(in.rows());
+	pipeline.transformBatch(in, *pOut);
+	return hOut.release();
+}
+
+// virtual
+void GIncrementalTransformChainer::addToPipeline(GTransformPipeline& pipeline)
+{
+	m_pFirst->addToPipeline(pipeline);
+	m_pSecond->addToPipeline(pipeline);
+}
+
 // virtual
 void GIncrementalTransformChainer::untransform(const GVec& in, GVec& out)
 {
@@ -417,6 +446,14 @@ void GPCA::untransformToDistribution(const GVec& in, GPrediction* out)
 	throw Ex("Sorry, PCA cannot untransform to a distribution");
 }
 
+// virtual
+void GPCA::addToPipeline(GTransformPipeline& pipeline)
+{
+	if(!m_pBasisVectors)
+		throw Ex("train has not been called");
+	pipeline.addProjection(*m_pBasisVectors, m_pCentroid->row(0));
+}
+
 // --------------------------------------------------------------------------
 
 GNoiseGenerator::GNoiseGenerator()
@@ -526,6 +563,12 @@ void GPairProduct::transform(const GVec& in, GVec& out)
 	GAssert(nAttr == nAttrsOut);
 }
 
+// virtual
+void GPairProduct::addToPipeline(GTransformPipeline& pipeline)
+{
+	pipeline.addPairProduct(before().size(), after().size());
+}
+
 // --------------------------------------------------------------------------
 
 GReservoir::GReservoir(double weightDeviation, size_t outputs, size_t hiddenLayers)
@@ -664,7 +707,7 @@ void GDataAugmenter::untransformToDistribution(const GVec& in, GPrediction* out)
 #ifndef MIN_PREDICT
 
 GAttributeSelector::GAttributeSelector(const GDomNode* pNode)
-: GIncrementalTransform(pNode), m_seed(1234567)
+: GIncrementalTransform(pNode), m_seed(1234567), m_ranker(NEURAL_WRAPPER), m_workerThreads(1), m_removalPortion(0.1)
 {
 	m_labelDims = (size_t)pNode->field("labels")->asInt();
 	m_targetFeatures = (size_t)pNode->field("target")->asInt();
@@ -710,12 +753,44 @@ GRelation* GAttributeSelector::setTargetFeatures(size_t n)
 	return pRelAfter;
 }
 
+// static
+GAttributeSelector::Ranker GAttributeSelector::rankerFromName(const char* szName)
+{
+	if(strcmp(szName, "nn") == 0)
+		return NEURAL_WRAPPER;
+	else if(strcmp(szName, "parallel") == 0)
+		return PARALLEL_WRAPPER;
+	else if(strcmp(szName, "mi") == 0)
+		return MUTUAL_INFORMATION;
+	else if(strcmp(szName, "anova") == 0)
+		return ANOVA_F;
+	else if(strcmp(szName, "corr") == 0)
+		return CORRELATION;
+	throw Ex("Unrecognized ranker: ", szName);
+	return NEURAL_WRAPPER;
+}
+
 // virtual
 GRelation* GAttributeSelector::trainInner(const GMatrix& data)
 {
-	// Normalize all the data
 	if(m_labelDims > data.cols())
 		throw Ex("label dims is greater than the number of columns in the data");
+	if(m_labelDims == data.cols())
+		throw Ex("there are no feature attributes to rank");
+	if(m_targetFeatures > data.cols() - m_labelDims)
+		throw Ex("the target number of features is greater than the number of feature attributes");
+	if(m_ranker == NEURAL_WRAPPER)
+		rankByNeuralWrapper(data);
+	else if(m_ranker == PARALLEL_WRAPPER)
+		rankByParallelWrapper(data);
+	else
+		rankByFilter(data);
+	return setTargetFeatures(m_targetFeatures);
+}
+
+void GAttributeSelector::rankByNeuralWrapper(const GMatrix& data)
+{
+	// Normalize all the data
 	GNormalize norm;
 	norm.train(data);
 	GMatrix* pNormData = norm.transformBatch(data);
@@ -786,7 +861,502 @@ GRelation* GAttributeSelector::trainInner(const GMatrix& data)
 		GAssert(pFeatures->cols() == curDims);
 	}
 	m_ranks[0] = indexMap[0];
-	return setTargetFeatures(m_targetFeatures);
+}
+
+class GAttributeAblationWorker : public GWorkerThread
+{
+protected:
+	const GMatrix& m_features;
+	const GMatrix& m_labels;
+	const GMatrix& m_nets;
+	GLayerClassic& m_layer;
+	const GVec& m_means;
+	const vector<size_t>& m_colStart;
+	vector<double>& m_errors;
+
+public:
+	GAttributeAblationWorker(GMasterThread& master, const GMatrix& features, const GMatrix& labels, const GMatrix& nets, GLayerClassic& layer, const GVec& means, const vector<size_t>& colStart, vector<double>& errors)
+	: GWorkerThread(master), m_features(features), m_labels(labels), m_nets(nets), m_layer(layer), m_means(means), m_colStart(colStart), m_errors(errors)
+	{
+	}
+
+	virtual ~GAttributeAblationWorker()
+	{
+	}
+
+	/// Measures the squared error of the network when the columns of attribute jobId are replaced by their means
+	virtual void doJob(size_t jobId)
+	{
+		GActivationFunction* pAct = m_layer.activationFunction();
+		const GMatrix& w = m_layer.weights();
+		size_t start = m_colStart[jobId];
+		size_t end = m_colStart[jobId + 1];
+		double sse = 0.0;
+		for(size_t r = 0; r < m_features.rows(); r++)
+		{
+			const GVec& x = m_features[r];
+			const GVec& y = m_labels[r];
+			const GVec& n = m_nets[r];
+			for(size_t o = 0; o < n.size(); o++)
+			{
+				double net = n[o];
+				for(size_t c = start; c < end; c++)
+					net += w[c][o] * (m_means[c] - x[c]);
+				double d = y[o] - pAct->squash(net, o);
+				sse += d * d;
+			}
+		}
+		m_errors[jobId] = sse;
+	}
+};
+
+class GAttributeAblationComparer
+{
+protected:
+	const vector<double>& m_errors;
+
+public:
+	GAttributeAblationComparer(const vector<double>& errors) : m_errors(errors) {}
+
+	bool operator()(size_t a, size_t b) const
+	{
+		if(m_errors[a] != m_errors[b])
+			return m_errors[a] < m_errors[b];
+		return a < b;
+	}
+};
+
+void GAttributeSelector::rankByParallelWrapper(const GMatrix& data)
+{
+	if(data.rows() < 2)
+		throw Ex("Expected at least two rows");
+
+	// Normalize all the data, and convert nominal attributes to a categorical distribution
+	GNormalize norm;
+	norm.train(data);
+	GMatrix* pNormData = norm.transformBatch(data);
+	std::unique_ptr<GMatrix> hNormData(pNormData);
+	size_t featureDims = data.cols() - m_labelDims;
+	GMatrix* pFeatures = pNormData->cloneSub(0, 0, data.rows(), featureDims);
+	std::unique_ptr<GMatrix> hFeatures(pFeatures);
+	GMatrix* pLabels = pNormData->cloneSub(0, featureDims, data.rows(), m_labelDims);
+	std::unique_ptr<GMatrix> hLabels(pLabels);
+	GNominalToCat ntc;
+	ntc.train(*pFeatures);
+	GMatrix* pFeatures2 = ntc.transformBatch(*pFeatures);
+	std::unique_ptr<GMatrix> hFeatures2(pFeatures2);
+	vector<size_t> rmap;
+	ntc.reverseAttrMap(rmap);
+	GNominalToCat ntc2;
+	ntc2.train(*pLabels);
+	GMatrix* pLabels2 = ntc2.transformBatch(*pLabels);
+	std::unique_ptr<GMatrix> hLabels2(pLabels2);
+	vector< vector<size_t> > attrCols(featureDims);
+	for(size_t i = 0; i < rmap.size(); i++)
+		attrCols[rmap[i]].push_back(i);
+
+	// Set aside a quarter of the rows for measuring the effect of each removal
+	GRand rand(m_seed);
+	m_seed += 77152487;
+	m_seed *= 37152487;
+	vector<size_t> rowOrder;
+	for(size_t i = 0; i < data.rows(); i++)
+		rowOrder.push_back(i);
+	for(size_t i = rowOrder.size(); i > 1; i--)
+		std::swap(rowOrder[i - 1], rowOrder[(size_t)rand.next(i)]);
+	size_t validationRows = std::max((size_t)1, data.rows() / 4);
+	size_t trainRows = data.rows() - validationRows;
+	GMatrix trainLabels(trainRows, pLabels2->cols());
+	GMatrix validLabels(validationRows, pLabels2->cols());
+	for(size_t i = 0; i < data.rows(); i++)
+	{
+		if(i < trainRows)
+			trainLabels[i].copy((*pLabels2)[rowOrder[i]]);
+		else
+			validLabels[i - trainRows].copy((*pLabels2)[rowOrder[i]]);
+	}
+
+	// Deselect a portion of the remaining attributes in each round
+	m_ranks.resize(featureDims);
+	size_t pos = featureDims;
+	vector<size_t> active;
+	for(size_t i = 0; i < featureDims; i++)
+		active.push_back(i);
+	while(active.size() > 1)
+	{
+		// Gather the columns of the remaining attributes
+		vector<size_t> colStart;
+		vector<size_t> cols;
+		for(size_t i = 0; i < active.size(); i++)
+		{
+			colStart.push_back(cols.size());
+			const vector<size_t>& ac = attrCols[active[i]];
+			cols.insert(cols.end(), ac.begin(), ac.end());
+		}
+		colStart.push_back(cols.size());
+		GMatrix trainFeatures(trainRows, cols.size());
+		GMatrix validFeatures(validationRows, cols.size());
+		for(size_t i = 0; i < data.rows(); i++)
+		{
+			const GVec& src = (*pFeatures2)[rowOrder[i]];
+			GVec& dest = (i < trainRows ? trainFeatures[i] : validFeatures[i - trainRows]);
+			for(size_t j = 0; j < cols.size(); j++)
+				dest[j] = src[cols[j]];
+		}
+
+		// Train a single-layer neural network with the remaining attributes
+		GNeuralNet nn;
+		nn.addLayer(new GLayerClassic(FLEXIBLE_SIZE, FLEXIBLE_SIZE));
+		nn.rand().setSeed(m_seed);
+		m_seed += 77152487;
+		m_seed *= 37152487;
+		nn.setWindowSize(30);
+		nn.setImprovementThresh(0.002);
+		nn.train(trainFeatures, trainLabels);
+		GLayerClassic& layer = *(GLayerClassic*)&nn.layer(nn.layerCount() - 1);
+
+		// Compute the nets of the validation rows, so each removal only needs to adjust them
+		GMatrix nets(validationRows, layer.outputs());
+		for(size_t r = 0; r < validationRows; r++)
+		{
+			GVec& n = nets[r];
+			n.copy(layer.bias());
+			const GVec& x = validFeatures[r];
+			for(size_t c = 0; c < cols.size(); c++)
+				n.addScaled(x[c], layer.weights()[c]);
+		}
+		GVec means(cols.size());
+		for(size_t c = 0; c < cols.size(); c++)
+			means[c] = trainFeatures.columnMean(c);
+
+		// Measure the effect of removing each remaining attribute concurrently
+		vector<double> errors(active.size());
+		{
+			GMasterThread master;
+			for(size_t i = 0; i < std::max((size_t)1, std::min(m_workerThreads, active.size())); i++)
+				master.addWorker(new GAttributeAblationWorker(master, validFeatures, validLabels, nets, layer, means, colStart, errors));
+			master.doJobs(active.size());
+		}
+
+		// Deselect the attributes whose removal hurts least
+		vector<size_t> order;
+		for(size_t i = 0; i < active.size(); i++)
+			order.push_back(i);
+		GAttributeAblationComparer comparer(errors);
+		std::sort(order.begin(), order.end(), comparer);
+		size_t removals = std::min(active.size() - 1, std::max((size_t)1, (size_t)(m_removalPortion * active.size())));
+		vector<bool> removed(active.size(), false);
+		for(size_t i = 0; i < removals; i++)
+		{
+			m_ranks[--pos] = active[order[i]];
+			removed[order[i]] = true;
+		}
+		vector<size_t> survivors;
+		for(size_t i = 0; i < active.size(); i++)
+		{
+			if(!removed[i])
+				survivors.push_back(active[i]);
+		}
+		active.swap(survivors);
+	}
+	GAssert(pos == 1);
+	m_ranks[0] = active[0];
+}
+
+#define GATTRSEL_MAX_BINS 16
+
+// Assigns each value to a group, and returns the number of groups. Nominal values
+// are their own groups. Continuous values are divided into equal-width bins.
+static size_t GAttributeSelector_group(const vector<double>& vals, size_t valueCount, vector<size_t>& groups)
+{
+	size_t n = vals.size();
+	groups.resize(n);
+	if(valueCount > 0)
+	{
+		for(size_t i = 0; i < n; i++)
+			groups[i] = std::min(valueCount - 1, (size_t)vals[i]);
+		return valueCount;
+	}
+	double lo = 1e308;
+	double hi = -1e308;
+	for(size_t i = 0; i < n; i++)
+	{
+		lo = std::min(lo, vals[i]);
+		hi = std::max(hi, vals[i]);
+	}
+	if(n == 0 || !(hi - lo > 1e-12 * std::max(1.0, std::abs(lo))))
+	{
+		groups.assign(n, 0);
+		return 1;
+	}
+	size_t bins = std::max((size_t)2, std::min((size_t)GATTRSEL_MAX_BINS, (size_t)std::sqrt(0.25 * n)));
+	double scale = bins / (hi - lo);
+	for(size_t i = 0; i < n; i++)
+		groups[i] = std::min(bins - 1, (size_t)((vals[i] - lo) * scale));
+	return bins;
+}
+
+// Returns the mutual information (in nats) between two grouped variables
+static double GAttributeSelector_mutualInformation(const vector<size_t>& a, size_t ka, const vector<size_t>& b, size_t kb)
+{
+	size_t n = a.size();
+	vector<size_t> joint(ka * kb, 0);
+	vector<size_t> ca(ka, 0);
+	vector<size_t> cb(kb, 0);
+	for(size_t i = 0; i < n; i++)
+	{
+		joint[a[i] * kb + b[i]]++;
+		ca[a[i]]++;
+		cb[b[i]]++;
+	}
+	double mi = 0.0;
+	for(size_t i = 0; i < ka; i++)
+	{
+		for(size_t j = 0; j < kb; j++)
+		{
+			size_t c = joint[i * kb + j];
+			if(c > 0)
+				mi += (double)c * std::log((double)c * n / ((double)ca[i] * cb[j]));
+		}
+	}
+	return mi / n;
+}
+
+// Returns Pearson's chi-square statistic of the contingency table of two grouped variables.
+// Also returns Cramer's V.
+static double GAttributeSelector_chiSquare(const vector<size_t>& a, size_t ka, const vector<size_t>& b, size_t kb, double* pCramersV, double* pDof)
+{
+	size_t n = a.size();
+	vector<size_t> joint(ka * kb, 0);
+	vector<size_t> ca(ka, 0);
+	vector<size_t> cb(kb, 0);
+	for(size_t i = 0; i < n; i++)
+	{
+		joint[a[i] * kb + b[i]]++;
+		ca[a[i]]++;
+		cb[b[i]]++;
+	}
+	double chi2 = 0.0;
+	size_t usedA = 0;
+	size_t usedB = 0;
+	for(size_t j = 0; j < kb; j++)
+	{
+		if(cb[j] > 0)
+			usedB++;
+	}
+	for(size_t i = 0; i < ka; i++)
+	{
+		if(ca[i] == 0)
+			continue;
+		usedA++;
+		for(size_t j = 0; j < kb; j++)
+		{
+			if(cb[j] == 0)
+				continue;
+			double e = (double)ca[i] * cb[j] / n;
+			double d = joint[i * kb + j] - e;
+			chi2 += d * d / e;
+		}
+	}
+	size_t m = std::min(usedA, usedB);
+	*pCramersV = (m > 1 ? std::sqrt(chi2 / ((double)n * (m - 1))) : 0.0);
+	*pDof = (double)((usedA > 0 ? usedA - 1 : 0) * (usedB > 0 ? usedB - 1 : 0));
+	return chi2;
+}
+
+// Returns the one-way ANOVA F statistic of vals divided into the specified groups.
+// Also returns the correlation ratio (eta).
+static double GAttributeSelector_anova(const vector<size_t>& groups, size_t k, const vector<double>& vals, double* pEta)
+{
+	size_t n = vals.size();
+	vector<double> sums(k, 0.0);
+	vector<size_t> counts(k, 0);
+	double mean = 0.0;
+	for(size_t i = 0; i < n; i++)
+	{
+		sums[groups[i]] += vals[i];
+		counts[groups[i]]++;
+		mean += vals[i];
+	}
+	mean /= n;
+	double ssb = 0.0;
+	size_t used = 0;
+	for(size_t i = 0; i < k; i++)
+	{
+		if(counts[i] == 0)
+			continue;
+		used++;
+		sums[i] /= counts[i];
+		double d = sums[i] - mean;
+		ssb += counts[i] * d * d;
+	}
+	double ssw = 0.0;
+	for(size_t i = 0; i < n; i++)
+	{
+		double d = vals[i] - sums[groups[i]];
+		ssw += d * d;
+	}
+	*pEta = (ssb + ssw > 0.0 ? std::sqrt(ssb / (ssb + ssw)) : 0.0);
+	if(used < 2 || n <= used || ssb <= 0.0)
+		return 0.0;
+	if(ssw <= 0.0)
+		return 1e300;
+	return (ssb / (used - 1)) / (ssw / (n - used));
+}
+
+// Returns the magnitude of Pearson's correlation coefficient
+static double GAttributeSelector_correlation(const vector<double>& a, const vector<double>& b)
+{
+	size_t n = a.size();
+	double ma = 0.0;
+	double mb = 0.0;
+	for(size_t i = 0; i < n; i++)
+	{
+		ma += a[i];
+		mb += b[i];
+	}
+	ma /= n;
+	mb /= n;
+	double sab = 0.0;
+	double saa = 0.0;
+	double sbb = 0.0;
+	for(size_t i = 0; i < n; i++)
+	{
+		double da = a[i] - ma;
+		double db = b[i] - mb;
+		sab += da * db;
+		saa += da * da;
+		sbb += db * db;
+	}
+	if(saa <= 0.0 || sbb <= 0.0)
+		return 0.0;
+	return std::abs(sab) / std::sqrt(saa * sbb);
+}
+
+// Scores how well x predicts y. (kx and ky are the number of values, or 0 for continuous.)
+static double GAttributeSelector_score(GAttributeSelector::Ranker ranker, const vector<double>& x, size_t kx, const vector<double>& y, size_t ky)
+{
+	vector<size_t> gx;
+	vector<size_t> gy;
+	double stat;
+	if(ranker == GAttributeSelector::MUTUAL_INFORMATION)
+	{
+		size_t nx = GAttributeSelector_group(x, kx, gx);
+		size_t ny = GAttributeSelector_group(y, ky, gy);
+		return GAttributeSelector_mutualInformation(gx, nx, gy, ny);
+	}
+	else if(ranker == GAttributeSelector::ANOVA_F)
+	{
+		if(kx > 0 && ky > 0)
+		{
+			double dof;
+			double chi2 = GAttributeSelector_chiSquare(gx, GAttributeSelector_group(x, kx, gx), gy, GAttributeSelector_group(y, ky, gy), &stat, &dof);
+			return (dof > 0.0 ? chi2 / dof : 0.0);
+		}
+		else if(kx > 0)
+			return GAttributeSelector_anova(gx, GAttributeSelector_group(x, kx, gx), y, &stat);
+		else
+			return GAttributeSelector_anova(gy, GAttributeSelector_group(y, ky, gy), x, &stat);
+	}
+	else
+	{
+		if(kx > 0 && ky > 0)
+		{
+			double dof;
+			GAttributeSelector_chiSquare(gx, GAttributeSelector_group(x, kx, gx), gy, GAttributeSelector_group(y, ky, gy), &stat, &dof);
+		}
+		else if(kx > 0)
+			GAttributeSelector_anova(gx, GAttributeSelector_group(x, kx, gx), y, &stat);
+		else if(ky > 0)
+			GAttributeSelector_anova(gy, GAttributeSelector_group(y, ky, gy), x, &stat);
+		else
+			stat = GAttributeSelector_correlation(x, y);
+		return stat;
+	}
+}
+
+class GAttributeScoreWorker : public GWorkerThread
+{
+protected:
+	const GMatrix& m_data;
+	GAttributeSelector::Ranker m_ranker;
+	size_t m_featureDims;
+	vector<double>& m_scores;
+	vector<double> m_x;
+	vector<double> m_y;
+
+public:
+	GAttributeScoreWorker(GMasterThread& master, const GMatrix& data, GAttributeSelector::Ranker ranker, size_t featureDims, vector<double>& scores)
+	: GWorkerThread(master), m_data(data), m_ranker(ranker), m_featureDims(featureDims), m_scores(scores)
+	{
+	}
+
+	virtual ~GAttributeScoreWorker()
+	{
+	}
+
+	/// Scores attribute jobId against each label attribute, skipping rows where either value is unknown
+	virtual void doJob(size_t jobId)
+	{
+		const GRelation& rel = m_data.relation();
+		size_t kx = rel.valueCount(jobId);
+		double score = 0.0;
+		for(size_t lab = m_featureDims; lab < m_data.cols(); lab++)
+		{
+			size_t ky = rel.valueCount(lab);
+			m_x.clear();
+			m_y.clear();
+			for(size_t i = 0; i < m_data.rows(); i++)
+			{
+				const GVec& row = m_data[i];
+				double x = row[jobId];
+				double y = row[lab];
+				if((kx == 0 ? x == UNKNOWN_REAL_VALUE : x < 0.0) || (ky == 0 ? y == UNKNOWN_REAL_VALUE : y < 0.0))
+					continue;
+				m_x.push_back(x);
+				m_y.push_back(y);
+			}
+			if(m_x.size() > 1)
+				score += GAttributeSelector_score(m_ranker, m_x, kx, m_y, ky);
+		}
+		m_scores[jobId] = score;
+	}
+};
+
+class GAttributeScoreComparer
+{
+protected:
+	const vector<double>& m_scores;
+
+public:
+	GAttributeScoreComparer(const vector<double>& scores) : m_scores(scores) {}
+
+	bool operator()(size_t a, size_t b) const
+	{
+		if(m_scores[a] != m_scores[b])
+			return m_scores[a] > m_scores[b];
+		return a < b;
+	}
+};
+
+void GAttributeSelector::rankByFilter(const GMatrix& data)
+{
+	// Score all of the feature attributes in one parallel pass
+	size_t featureDims = data.cols() - m_labelDims;
+	vector<double> scores(featureDims);
+	{
+		GMasterThread master;
+		for(size_t i = 0; i < std::max((size_t)1, std::min(m_workerThreads, featureDims)); i++)
+			master.addWorker(new GAttributeScoreWorker(master, data, m_ranker, featureDims, scores));
+		master.doJobs(featureDims);
+	}
+
+	// Sort them by score
+	m_ranks.resize(featureDims);
+	for(size_t i = 0; i < featureDims; i++)
+		m_ranks[i] = i;
+	GAttributeScoreComparer comparer(scores);
+	std::sort(m_ranks.begin(), m_ranks.end(), comparer);
 }
 
 // virtual
@@ -829,6 +1399,60 @@ void GAttributeSelector::test()
 		throw Ex("failed");
 	if(r[2] != 3 && r[2] != 13 && r[2] != 17)
 		throw Ex("failed");
+
+	// Test the other rankers on a larger sample of the same problem
+	GMatrix bigData(0, 21);
+	for(size_t i = 0; i < 1024; i++)
+	{
+		GVec& vec = bigData.newRow();
+		vec.fillUniform(prng);
+		vec[20] = 0.2 * vec[3] * vec[3] * - 7.0 * vec[3] * vec[13] + vec[17];
+	}
+	Ranker rankers[] = { PARALLEL_WRAPPER, MUTUAL_INFORMATION, ANOVA_F, CORRELATION };
+	for(size_t i = 0; i < sizeof(rankers) / sizeof(Ranker); i++)
+	{
+		GAttributeSelector as2(1, 3);
+		as2.setRanker(rankers[i]);
+		as2.setWorkerThreads(3);
+		as2.train(bigData);
+		std::vector<size_t>& r2 = as2.ranks();
+		if(r2.size() != 20)
+			throw Ex("wrong number of ranks");
+		if(r2[1] == r2[0] || r2[2] == r2[0] || r2[2] == r2[1])
+			throw Ex("bogus rankings");
+		if(r2[0] != 3 && r2[0] != 13 && r2[0] != 17)
+			throw Ex("failed");
+		if(r2[1] != 3 && r2[1] != 13 && r2[1] != 17)
+			throw Ex("failed");
+		if(r2[2] != 3 && r2[2] != 13 && r2[2] != 17)
+			throw Ex("failed");
+		if(as2.after().size() != 4)
+			throw Ex("wrong number of selected attributes");
+	}
+
+	// Test the filters with a nominal feature and a nominal label
+	GMixedRelation* pRel = new GMixedRelation();
+	pRel->addAttrs(6, 0);
+	pRel->addAttr(3);
+	pRel->addAttr(3);
+	GMatrix nomData(pRel);
+	for(size_t i = 0; i < 512; i++)
+	{
+		GVec& vec = nomData.newRow();
+		vec.fillUniform(prng);
+		size_t c = (vec[4] < 0.3 ? 0 : (vec[4] < 0.7 ? 1 : 2));
+		vec[6] = (double)(prng.next(5) == 0 ? prng.next(3) : c);
+		vec[7] = (double)c;
+	}
+	for(size_t i = 1; i < sizeof(rankers) / sizeof(Ranker); i++)
+	{
+		GAttributeSelector as3(1, 2);
+		as3.setRanker(rankers[i]);
+		as3.train(nomData);
+		std::vector<size_t>& r3 = as3.ranks();
+		if((r3[0] != 4 && r3[0] != 6) || (r3[1] != 4 && r3[1] != 6) || r3[0] == r3[1])
+			throw Ex("failed");
+	}
 }
 #endif // MIN_PREDICT
 
@@ -1075,6 +1699,12 @@ void GNominalToCat::reverseAttrMap(vector<size_t>& rmap)
 	}
 }
 
+// virtual
+void GNominalToCat::addToPipeline(GTransformPipeline& pipeline)
+{
+	pipeline.addNominalToCat(before(), m_valueCap, m_preserveUnknowns);
+}
+
 // --------------------------------------------------------------------------
 
 GNormalize::GNormalize(double min, double max)
@@ -1196,6 +1826,29 @@ void GNormalize::untransformToDistribution(const GVec& in, GPrediction* out)
 	throw Ex("Sorry, cannot denormalize to a distribution");
 }
 
+// virtual
+void GNormalize::addToPipeline(GTransformPipeline& pipeline)
+{
+	// Express the normalization of each continuous attribute as scale * x + shift
+	size_t nAttrCount = before().size();
+	GVec scale(nAttrCount);
+	GVec shift(nAttrCount);
+	for(size_t i = 0; i < nAttrCount; i++)
+	{
+		if(before().valueCount(i) == 0)
+		{
+			scale[i] = (m_max - m_min) / m_ranges[i];
+			shift[i] = m_min - m_mins[i] * scale[i];
+		}
+		else
+		{
+			scale[i] = 1.0;
+			shift[i] = 0.0;
+		}
+	}
+	pipeline.addAffine(scale, shift);
+}
+
 // --------------------------------------------------------------------------
 
 GDiscretize::GDiscretize(size_t buckets)
@@ -1571,6 +2224,525 @@ void GLogify::untransformToDistribution(const GVec& in, GPrediction* out)
 	throw Ex("Sorry, cannot unlogify to a distribution");
 }
 
+// virtual
+void GLogify::addToPipeline(GTransformPipeline& pipeline)
+{
+	pipeline.addLog(before());
+}
+
+// --------------------------------------------------------------------------
+
+/// A compiled stage of a GTransformPipeline. Rows are stored contiguously in row-major order.
+class GTransformPipelineOp
+{
+public:
+	size_t m_inDims;
+	size_t m_outDims;
+
+	GTransformPipelineOp(size_t inDims, size_t outDims) : m_inDims(inDims), m_outDims(outDims) {}
+	virtual ~GTransformPipelineOp() {}
+
+	/// Returns true if this stage writes its results over its input
+	virtual bool inPlace() { return false; }
+
+	/// Returns true if this is a GTransformPipelineElementwise
+	virtual bool isElementwise() { return false; }
+
+	/// Transforms rows rows from pIn into pOut. (If inPlace returns true, pIn and pOut are the same.)
+	virtual void apply(const double* pIn, double* pOut, size_t rows) = 0;
+};
+
+/// Applies a sequence of affine and logarithm passes to each element while it is in a register
+class GTransformPipelineElementwise : public GTransformPipelineOp
+{
+protected:
+	struct Pass
+	{
+		bool m_log;
+		GVec m_scale;
+		GVec m_shift;
+		std::vector<char> m_mask;
+	};
+	std::vector<Pass> m_passes;
+
+public:
+	GTransformPipelineElementwise(size_t dims) : GTransformPipelineOp(dims, dims) {}
+	virtual ~GTransformPipelineElementwise() {}
+
+	virtual bool inPlace() { return true; }
+	virtual bool isElementwise() { return true; }
+
+	bool empty() { return m_passes.size() == 0; }
+
+	/// Adds an affine pass, composing it with the previous pass if that was also affine
+	void addAffine(const GVec& scale, const GVec& shift)
+	{
+		if(m_passes.size() > 0 && !m_passes.back().m_log)
+		{
+			Pass& p = m_passes.back();
+			for(size_t i = 0; i < m_inDims; i++)
+			{
+				p.m_scale[i] *= scale[i];
+				p.m_shift[i] = p.m_shift[i] * scale[i] + shift[i];
+			}
+			return;
+		}
+		m_passes.resize(m_passes.size() + 1);
+		Pass& p = m_passes.back();
+		p.m_log = false;
+		p.m_scale.copy(scale);
+		p.m_shift.copy(shift);
+	}
+
+	void addLog(const GRelation& rel)
+	{
+		m_passes.resize(m_passes.size() + 1);
+		Pass& p = m_passes.back();
+		p.m_log = true;
+		p.m_mask.resize(m_inDims);
+		for(size_t i = 0; i < m_inDims; i++)
+			p.m_mask[i] = (rel.valueCount(i) == 0 ? 1 : 0);
+	}
+
+	/// If the last pass is affine, removes it and returns true
+	bool popAffine(GVec& scale, GVec& shift)
+	{
+		if(m_passes.size() == 0 || m_passes.back().m_log)
+			return false;
+		scale.copy(m_passes.back().m_scale);
+		shift.copy(m_passes.back().m_shift);
+		m_passes.pop_back();
+		return true;
+	}
+
+	virtual void apply(const double* pIn, double* pOut, size_t rows)
+	{
+		size_t passCount = m_passes.size();
+		for(size_t r = 0; r < rows; r++)
+		{
+			double* pRow = pOut + r * m_inDims;
+			for(size_t i = 0; i < m_inDims; i++)
+			{
+				double x = pRow[i];
+				if(x == UNKNOWN_REAL_VALUE)
+					continue;
+				for(size_t k = 0; k < passCount; k++)
+				{
+					const Pass& p = m_passes[k];
+					if(p.m_log)
+					{
+						if(p.m_mask[i])
+							x = log(x);
+					}
+					else
+						x = p.m_scale[i] * x + p.m_shift[i];
+				}
+				pRow[i] = x;
+			}
+		}
+	}
+};
+
+/// Projects onto a basis, with an optional affine stage folded into the projection matrix
+class GTransformPipelineProjection : public GTransformPipelineOp
+{
+protected:
+	GMatrix m_weights; // the basis scaled by the folded affine stage
+	GMatrix m_terms; // the constant part of each product, which must be removed when an input is unknown
+	GVec m_bias; // the sum of each row of m_terms
+
+public:
+	GTransformPipelineProjection(const GMatrix& basis, const GVec& centroid, const GVec* pScale, const GVec* pShift)
+	: GTransformPipelineOp(basis.cols(), basis.rows()), m_weights(basis.rows(), basis.cols()), m_terms(basis.rows(), basis.cols()), m_bias(basis.rows())
+	{
+		// With y = scale * x + shift, basis * (y - centroid) = (basis * scale) * x + basis * (shift - centroid)
+		for(size_t j = 0; j < m_outDims; j++)
+		{
+			const GVec& b = basis[j];
+			GVec& w = m_weights[j];
+			GVec& t = m_terms[j];
+			m_bias[j] = 0.0;
+			for(size_t i = 0; i < m_inDims; i++)
+			{
+				if(b[i] == UNKNOWN_REAL_VALUE || centroid[i] == UNKNOWN_REAL_VALUE)
+				{
+					w[i] = 0.0;
+					t[i] = 0.0;
+					continue;
+				}
+				w[i] = pScale ? b[i] * (*pScale)[i] : b[i];
+				t[i] = b[i] * ((pShift ? (*pShift)[i] : 0.0) - centroid[i]);
+				m_bias[j] += t[i];
+			}
+		}
+	}
+
+	virtual ~GTransformPipelineProjection() {}
+
+	virtual void apply(const double* pIn, double* pOut, size_t rows)
+	{
+		for(size_t r = 0; r < rows; r++)
+		{
+			const double* x = pIn + r * m_inDims;
+			double* y = pOut + r * m_outDims;
+			bool anyUnknown = false;
+			for(size_t i = 0; i < m_inDims; i++)
+			{
+				if(x[i] == UNKNOWN_REAL_VALUE)
+				{
+					anyUnknown = true;
+					break;
+				}
+			}
+			for(size_t j = 0; j < m_outDims; j++)
+			{
+				const double* w = m_weights[j].data();
+				double sum = m_bias[j];
+				if(anyUnknown)
+				{
+					const double* t = m_terms[j].data();
+					for(size_t i = 0; i < m_inDims; i++)
+					{
+						if(x[i] == UNKNOWN_REAL_VALUE)
+							sum -= t[i];
+						else
+							sum += w[i] * x[i];
+					}
+				}
+				else
+				{
+					for(size_t i = 0; i < m_inDims; i++)
+						sum += w[i] * x[i];
+				}
+				y[j] = sum;
+			}
+		}
+	}
+};
+
+/// Expands nominal attributes into categorical distributions (like GNominalToCat::transform)
+class GTransformPipelineNominalToCat : public GTransformPipelineOp
+{
+protected:
+	std::vector<size_t> m_valueCounts;
+	size_t m_valueCap;
+	bool m_preserveUnknowns;
+
+public:
+	GTransformPipelineNominalToCat(const GRelation& rel, size_t valueCap, bool preserveUnknowns)
+	: GTransformPipelineOp(rel.size(), 0), m_valueCap(valueCap), m_preserveUnknowns(preserveUnknowns)
+	{
+		m_valueCounts.resize(m_inDims);
+		for(size_t i = 0; i < m_inDims; i++)
+		{
+			m_valueCounts[i] = rel.valueCount(i);
+			m_outDims += (m_valueCounts[i] >= 3 && m_valueCounts[i] < valueCap ? m_valueCounts[i] : 1);
+		}
+	}
+
+	virtual ~GTransformPipelineNominalToCat() {}
+
+	virtual void apply(const double* pIn, double* pOut, size_t rows)
+	{
+		for(size_t r = 0; r < rows; r++)
+		{
+			const double* x = pIn + r * m_inDims;
+			double* y = pOut + r * m_outDims;
+			for(size_t i = 0; i < m_inDims; i++)
+			{
+				size_t nValues = m_valueCounts[i];
+				if(nValues == 0)
+					*(y++) = x[i];
+				else if(nValues == 1)
+					*(y++) = (x[i] == UNKNOWN_DISCRETE_VALUE ? UNKNOWN_REAL_VALUE : 0.0);
+				else if(nValues == 2)
+				{
+					if(x[i] == UNKNOWN_DISCRETE_VALUE)
+						*(y++) = (m_preserveUnknowns ? UNKNOWN_REAL_VALUE : 0.5);
+					else
+						*(y++) = x[i];
+				}
+				else if(nValues < m_valueCap)
+				{
+					if(x[i] >= 0)
+					{
+						GVec::setAll(y, 0.0, nValues);
+						y[(size_t)x[i]] = 1.0;
+					}
+					else
+						GVec::setAll(y, m_preserveUnknowns ? UNKNOWN_REAL_VALUE : 1.0 / nValues, nValues);
+					y += nValues;
+				}
+				else
+					*(y++) = (x[i] == UNKNOWN_DISCRETE_VALUE ? UNKNOWN_REAL_VALUE : x[i]);
+			}
+		}
+	}
+};
+
+/// Computes the products of pairs of attributes (like GPairProduct::transform)
+class GTransformPipelinePairProduct : public GTransformPipelineOp
+{
+public:
+	GTransformPipelinePairProduct(size_t inDims, size_t outDims) : GTransformPipelineOp(inDims, outDims) {}
+	virtual ~GTransformPipelinePairProduct() {}
+
+	virtual void apply(const double* pIn, double* pOut, size_t rows)
+	{
+		for(size_t r = 0; r < rows; r++)
+		{
+			const double* x = pIn + r * m_inDims;
+			double* y = pOut + r * m_outDims;
+			size_t n = 0;
+			for(size_t j = 0; j < m_inDims && n < m_outDims; j++)
+			{
+				for(size_t i = j; i < m_inDims && n < m_outDims; i++)
+					y[n++] = x[i] * x[j];
+			}
+		}
+	}
+};
+
+/// Calls a transform that could not be compiled
+class GTransformPipelineOpaque : public GTransformPipelineOp
+{
+protected:
+	GIncrementalTransform* m_pTransform;
+	GVec m_in;
+	GVec m_out;
+
+public:
+	GTransformPipelineOpaque(GIncrementalTransform* pTransform)
+	: GTransformPipelineOp(pTransform->before().size(), pTransform->after().size()), m_pTransform(pTransform), m_in(m_inDims), m_out(m_outDims)
+	{
+	}
+
+	virtual ~GTransformPipelineOpaque() {}
+
+	virtual void apply(const double* pIn, double* pOut, size_t rows)
+	{
+		for(size_t r = 0; r < rows; r++)
+		{
+			memcpy(m_in.data(), pIn + r * m_inDims, m_inDims * sizeof(double));
+			m_pTransform->transform(m_in, m_out);
+			memcpy(pOut + r * m_outDims, m_out.data(), m_outDims * sizeof(double));
+		}
+	}
+};
+
+GTransformPipeline::GTransformPipeline()
+: m_inputDims(0), m_blockRows(0), m_compiled(false)
+{
+}
+
+GTransformPipeline::~GTransformPipeline()
+{
+	for(size_t i = 0; i < m_ops.size(); i++)
+		delete(m_ops[i]);
+}
+
+void GTransformPipeline::add(GIncrementalTransform* pTransform)
+{
+	pTransform->addToPipeline(*this);
+}
+
+void GTransformPipeline::addOp(GTransformPipelineOp* pOp)
+{
+	std::unique_ptr<GTransformPipelineOp> hOp(pOp);
+	if(m_compiled)
+		throw Ex("Stages cannot be added after compile is called");
+	if(m_ops.size() == 0)
+		m_inputDims = pOp->m_inDims;
+	else if(m_ops.back()->m_outDims != pOp->m_inDims)
+		throw Ex("Mismatching sizes. The previous stage outputs ", to_str(m_ops.back()->m_outDims), " values, but the next one expects ", to_str(pOp->m_inDims));
+	m_ops.push_back(hOp.release());
+}
+
+void GTransformPipeline::addAffine(const GVec& scale, const GVec& shift)
+{
+	if(m_ops.size() == 0 || !m_ops.back()->isElementwise())
+		addOp(new GTransformPipelineElementwise(scale.size()));
+	((GTransformPipelineElementwise*)m_ops.back())->addAffine(scale, shift);
+}
+
+void GTransformPipeline::addLog(const GRelation& rel)
+{
+	if(m_ops.size() == 0 || !m_ops.back()->isElementwise())
+		addOp(new GTransformPipelineElementwise(rel.size()));
+	((GTransformPipelineElementwise*)m_ops.back())->addLog(rel);
+}
+
+void GTransformPipeline::addProjection(const GMatrix& basis, const GVec& centroid)
+{
+	// Fold a preceding affine pass into the projection
+	GVec scale, shift;
+	if(m_ops.size() > 0 && m_ops.back()->isElementwise() && ((GTransformPipelineElementwise*)m_ops.back())->popAffine(scale, shift))
+	{
+		if(((GTransformPipelineElementwise*)m_ops.back())->empty())
+		{
+			delete(m_ops.back());
+			m_ops.pop_back();
+		}
+		addOp(new GTransformPipelineProjection(basis, centroid, &scale, &shift));
+	}
+	else
+		addOp(new GTransformPipelineProjection(basis, centroid, NULL, NULL));
+}
+
+void GTransformPipeline::addNominalToCat(const GRelation& rel, size_t valueCap, bool preserveUnknowns)
+{
+	addOp(new GTransformPipelineNominalToCat(rel, valueCap, preserveUnknowns));
+}
+
+void GTransformPipeline::addPairProduct(size_t inputDims, size_t outputDims)
+{
+	addOp(new GTransformPipelinePairProduct(inputDims, outputDims));
+}
+
+void GTransformPipeline::addTransform(GIncrementalTransform* pTransform)
+{
+	addOp(new GTransformPipelineOpaque(pTransform));
+}
+
+void GTransformPipeline::compile(size_t blockRows)
+{
+	if(m_ops.size() == 0)
+		throw Ex("No stages were added");
+	m_blockRows = std::max((size_t)1, blockRows);
+	size_t maxDims = m_inputDims;
+	for(size_t i = 0; i < m_ops.size(); i++)
+		maxDims = std::max(maxDims, m_ops[i]->m_outDims);
+	m_buf[0].resize(m_blockRows * maxDims);
+	m_buf[1].resize(m_blockRows * maxDims);
+	m_compiled = true;
+}
+
+size_t GTransformPipeline::outputDims() const
+{
+	return m_ops.size() > 0 ? m_ops.back()->m_outDims : m_inputDims;
+}
+
+size_t GTransformPipeline::run(size_t rows)
+{
+	size_t cur = 0;
+	for(size_t i = 0; i < m_ops.size(); i++)
+	{
+		GTransformPipelineOp* pOp = m_ops[i];
+		if(pOp->inPlace())
+			pOp->apply(m_buf[cur].data(), m_buf[cur].data(), rows);
+		else
+		{
+			pOp->apply(m_buf[cur].data(), m_buf[1 - cur].data(), rows);
+			cur = 1 - cur;
+		}
+	}
+	return cur;
+}
+
+void GTransformPipeline::transform(const GVec& in, GVec& out)
+{
+	if(!m_compiled)
+		throw Ex("compile has not been called");
+	GAssert(in.size() == m_inputDims && out.size() == outputDims());
+	memcpy(m_buf[0].data(), in.data(), m_inputDims * sizeof(double));
+	size_t cur = run(1);
+	memcpy(out.data(), m_buf[cur].data(), outputDims() * sizeof(double));
+}
+
+void GTransformPipeline::transformBatch(const GMatrix& in, GMatrix& out)
+{
+	if(!m_compiled)
+		throw Ex("compile has not been called");
+	if(in.cols() != m_inputDims || out.rows() != in.rows() || out.cols() != outputDims())
+		throw Ex("Mismatching sizes");
+	size_t outDims = outputDims();
+	for(size_t start = 0; start < in.rows(); start += m_blockRows)
+	{
+		size_t rows = std::min(m_blockRows, in.rows() - start);
+		double* pBuf = m_buf[0].data();
+		for(size_t r = 0; r < rows; r++)
+			memcpy(pBuf + r * m_inputDims, in[start + r].data(), m_inputDims * sizeof(double));
+		size_t cur = run(rows);
+		pBuf = m_buf[cur].data();
+		for(size_t r = 0; r < rows; r++)
+			memcpy(out[start + r].data(), pBuf + r * outDims, outDims * sizeof(double));
+	}
+}
+
+#ifndef MIN_PREDICT
+// static
+void GTransformPipeline::test()
+{
+	// Make some data with continuous and nominal attributes, and a few unknown values
+	GRand rand(0);
+	vector<size_t> valCounts;
+	valCounts.push_back(0);
+	valCounts.push_back(4);
+	valCounts.push_back(0);
+	valCounts.push_back(2);
+	valCounts.push_back(0);
+	GMatrix data(valCounts);
+	data.newRows(300);
+	for(size_t i = 0; i < data.rows(); i++)
+	{
+		GVec& row = data[i];
+		row[0] = rand.uniform() * 10.0 + 1.0;
+		row[1] = (double)rand.next(4);
+		row[2] = rand.normal() * 3.0;
+		row[3] = (double)rand.next(2);
+		row[4] = rand.uniform() * 100.0 + 0.5;
+		if(i % 17 == 3)
+			row[2] = UNKNOWN_REAL_VALUE;
+		if(i % 23 == 5)
+			row[1] = UNKNOWN_DISCRETE_VALUE;
+	}
+
+	// (GPCA cannot be trained with unknown continuous values, so the transforms are trained without them)
+	GMatrix known(data);
+	for(size_t i = 0; i < known.rows(); i++)
+	{
+		if(known[i][2] == UNKNOWN_REAL_VALUE)
+			known[i][2] = 0.0;
+	}
+
+	// Build chains that exercise each kind of stage, and compare with the unfused transforms
+	for(size_t chain = 0; chain < 3; chain++)
+	{
+		GIncrementalTransform* pTrans;
+		if(chain == 0)
+			pTrans = new GIncrementalTransformChainer(new GIncrementalTransformChainer(new GNominalToCat(), new GNormalize(-1.0, 1.0)), new GPCA(3));
+		else if(chain == 1)
+			pTrans = new GIncrementalTransformChainer(new GIncrementalTransformChainer(new GNormalize(1.0, 2.0), new GLogify()), new GIncrementalTransformChainer(new GNormalize(), new GNominalToCat()));
+		else
+			pTrans = new GIncrementalTransformChainer(new GIncrementalTransformChainer(new GNominalToCat(), new GDiscretize(4)), new GPairProduct(20));
+		std::unique_ptr<GIncrementalTransform> hTrans(pTrans);
+		pTrans->train(known);
+		GTransformPipeline pipeline;
+		pipeline.add(pTrans);
+		pipeline.compile(16);
+		if(chain == 0 && pipeline.stageCount() != 2)
+			throw Ex("Expected the normalization to be folded into the projection");
+		if(chain == 1 && pipeline.stageCount() != 2)
+			throw Ex("Expected the elementwise stages to be fused");
+		const GMatrix& in = (chain == 2 ? known : data); // (GDiscretize cannot handle unknown continuous values either)
+		GMatrix fused(in.rows(), pipeline.outputDims());
+		pipeline.transformBatch(in, fused);
+		GVec out(pipeline.outputDims());
+		GVec expected(pipeline.outputDims());
+		for(size_t i = 0; i < in.rows(); i++)
+		{
+			pTrans->transform(in[i], expected);
+			pipeline.transform(in[i], out);
+			for(size_t j = 0; j < expected.size(); j++)
+			{
+				if(std::abs(fused[i][j] - expected[j]) > 1e-9 * (1.0 + std::abs(expected[j])) || std::abs(out[j] - expected[j]) > 1e-9 * (1.0 + std::abs(expected[j])))
+					throw Ex("The fused pipeline disagrees with the transform");
+			}
+		}
+	}
+}
+#endif // MIN_PREDICT
+
 
 
 } // namespace GClasses
@@ -25,6 +25,8 @@
 namespace GClasses {
 
 class GActivationFunction;
+class GTransformPipeline;
+class GTransformPipelineOp;
 
 /// This is the base class of algorithms that transform data without supervision
 class GTransform
@@ -130,6 +132,12 @@ public:
 	/// This assumes train was previously called, and untransforms all the rows in pIn and returns the results.
 	virtual std::unique_ptr<GMatrix> untransformBatch(const GMatrix& in);
 
+	/// Appends the operations that perform this transform to pipeline. The default
+	/// implementation just adds this transform as an opaque stage. Transforms that
+	/// are elementwise or affine override this so their stages can be fused with
+	/// their neighbors. train must be called before this method is used.
+	virtual void addToPipeline(GTransformPipeline& pipeline);
+
 protected:
 	/// Child classes should use this in their implementation of serialize
 	virtual GDomNode* baseDomNode(GDom* pDoc, const char* szClassName) const;
@@ -178,6 +186,9 @@ public:
 	/// See the comment for GIncrementalTransform::train
 	virtual void transform(const GVec& in, GVec& out);
 
+	/// Transforms all the rows in a single pass through the fused stages of both transforms.
+	virtual GMatrix* transformBatch(const GMatrix& in);
+
 	/// See the comment for GIncrementalTransform::untransform
 	virtual void untransform(const GVec& in, GVec& out);
 
@@ -186,6 +197,9 @@ public:
 	virtual void untransformToDistribution(const GVec& in, GPrediction* pOut);
 #endif // MIN_PREDICT
 
+	/// Adds the stages of both transforms
+	virtual void addToPipeline(GTransformPipeline& pipeline);
+
 protected:
 	/// See the comment for GIncrementalTransform::train
 	virtual GRelation* trainInner(const GMatrix& data);
@@ -261,6 +275,9 @@ public:
 	/// See the comment for GIncrementalTransform::untransformToDistribution
 	virtual void untransformToDistribution(const GVec& in, GPrediction* pOut);
 
+	/// Adds a projection stage
+	virtual void addToPipeline(GTransformPipeline& pipeline);
+
 	/// Returns a reference to the pseudo-random number generator used by this object.
 	GRand& rand() { return m_rand; }
 protected:
@@ -340,6 +357,9 @@ public:
 	/// See the comment for GIncrementalTransform::transform
 	virtual void transform(const GVec& in, GVec& out);
 
+	/// Adds a pair-product stage
+	virtual void addToPipeline(GTransformPipeline& pipeline);
+
 	/// Throws an exception (because this transform cannot be reversed).
 	virtual void untransform(const GVec& in, GVec& out)
 	{ throw Ex("This transformation cannot be reversed"); }
@@ -452,14 +472,44 @@ protected:
 /// deselected. The transform method uses only the highest-ranked attributes.
 class GAttributeSelector : public GIncrementalTransform
 {
+public:
+	/// The methods that may be used to rank the attributes
+	enum Ranker
+	{
+		/// Repeatedly trains a single-layer neural network and deselects the attribute with the
+		/// smallest weights, one attribute per retraining. (This is the default.)
+		NEURAL_WRAPPER,
+
+		/// Trains a single-layer neural network on part of the data, measures (concurrently) how much
+		/// the error on the rest of the data increases when each remaining attribute is replaced by
+		/// its mean, and deselects a portion of the attributes whose removal hurts least. Then repeats.
+		PARALLEL_WRAPPER,
+
+		/// Ranks each attribute by its mutual information with the labels. (Continuous values are binned.)
+		MUTUAL_INFORMATION,
+
+		/// Ranks each attribute by the one-way ANOVA F statistic between its values and the label
+		/// classes. (Continuous labels are binned. If the attribute is nominal, it defines the groups.
+		/// If both the attribute and the label are nominal, there are no values to average, so the
+		/// chi-square statistic of their contingency table divided by its degrees of freedom is used.)
+		ANOVA_F,
+
+		/// Ranks each attribute by the magnitude of its correlation with the labels. (Where a
+		/// nominal value is involved, the correlation ratio or Cramer's V is used instead of Pearson's r.)
+		CORRELATION,
+	};
+
 protected:
 	size_t m_labelDims;
 	size_t m_targetFeatures;
 	std::vector<size_t> m_ranks;
 	size_t m_seed;
+	Ranker m_ranker;
+	size_t m_workerThreads;
+	double m_removalPortion;
 
 public:
-	GAttributeSelector(size_t labelDims, size_t targetFeatures) : GIncrementalTransform(), m_labelDims(labelDims), m_targetFeatures(targetFeatures), m_seed(1234567)
+	GAttributeSelector(size_t labelDims, size_t targetFeatures) : GIncrementalTransform(), m_labelDims(labelDims), m_targetFeatures(targetFeatures), m_seed(1234567), m_ranker(NEURAL_WRAPPER), m_workerThreads(1), m_removalPortion(0.1)
 	{
 	}
 
@@ -495,12 +545,36 @@ public:
 	/// Sets a random seed to use with this attribute selector
 	void setSeed(size_t seed) { m_seed = seed; }
 
+	/// Specifies how the attributes will be ranked. (The default is NEURAL_WRAPPER.)
+	void setRanker(Ranker r) { m_ranker = r; }
+
+	/// Specifies the number of threads used to score the attributes. (The default is 1.
+	/// NEURAL_WRAPPER always uses one thread.)
+	void setWorkerThreads(size_t n) { m_workerThreads = (n > 1 ? n : 1); }
+
+	/// Specifies the portion of the remaining attributes that PARALLEL_WRAPPER deselects in each
+	/// round. (The default is 0.1. At least one attribute is always deselected.)
+	void setRemovalPortion(double d) { m_removalPortion = d; }
+
+	/// Returns the ranker with the specified name ("nn", "parallel", "mi", "anova", or "corr").
+	/// Throws if the name is not recognized.
+	static Ranker rankerFromName(const char* szName);
+
 protected:
 	/// See the comment for GIncrementalTransform::train
 	virtual GRelation* trainInner(const GMatrix& data);
 
 	/// Throws an exception (because this transform cannot be trained without data)
 	virtual GRelation* trainInner(const GRelation& relation);
+
+	/// Ranks the attributes with the NEURAL_WRAPPER method
+	void rankByNeuralWrapper(const GMatrix& data);
+
+	/// Ranks the attributes with the PARALLEL_WRAPPER method
+	void rankByParallelWrapper(const GMatrix& data);
+
+	/// Ranks the attributes with one of the filter methods (MUTUAL_INFORMATION, ANOVA_F, or CORRELATION)
+	void rankByFilter(const GMatrix& data);
 };
 #endif // MIN_PREDICT
 
@@ -544,6 +618,9 @@ public:
 	/// Makes a mapping from the post-transform attribute indexes to the pre-transform attribute indexes
 	void reverseAttrMap(std::vector<size_t>& rmap);
 
+	/// Adds a one-hot encoding stage
+	virtual void addToPipeline(GTransformPipeline& pipeline);
+
 	/// Specify to preserve unknown values. That is, an unknown nominal value will be
 	/// converted to a distribution of all unknown real values.
 	void preserveUnknowns() { m_preserveUnknowns = true; }
@@ -594,6 +671,9 @@ public:
 	/// Specify the input min and range values for each attribute
 	void setMinsAndRanges(const GRelation& pRel, const GVec& mins, const GVec& ranges);
 
+	/// Adds an elementwise affine stage
+	virtual void addToPipeline(GTransformPipeline& pipeline);
+
 protected:
 	/// See the comment for GIncrementalTransform::train
 	virtual GRelation* trainInner(const GMatrix& data);
@@ -726,6 +806,9 @@ public:
 	/// See the comment for GIncrementalTransform::untransformToDistribution
 	virtual void untransformToDistribution(const GVec& in, GPrediction* pOut);
 
+	/// Adds an elementwise logarithm stage
+	virtual void addToPipeline(GTransformPipeline& pipeline);
+
 protected:
 	/// See the comment for GIncrementalTransform::trainInner
 	virtual GRelation* trainInner(const GMatrix& data);
@@ -734,6 +817,82 @@ protected:
 	virtual GRelation* trainInner(const GRelation& relation);
 };
 
+
+
+/// Compiles a sequence of trained transforms into stages that process rows in blocks,
+/// so a batch is not materialized once per transform. Consecutive elementwise stages
+/// (GNormalize, GLogify) are fused into one pass, and an affine stage that immediately
+/// precedes a projection (GPCA) is folded into the projection matrix. GNominalToCat and
+/// GPairProduct are compiled into their own stages, and any other transform is called
+/// as an opaque stage. All buffers are allocated by compile, so transforming does not
+/// allocate. The transforms must not be retrained while this object is in use.
+class GTransformPipeline
+{
+protected:
+	std::vector<GTransformPipelineOp*> m_ops;
+	size_t m_inputDims;
+	size_t m_blockRows;
+	bool m_compiled;
+	std::vector<double> m_buf[2];
+
+public:
+	GTransformPipeline();
+	~GTransformPipeline();
+
+#ifndef MIN_PREDICT
+	/// Performs unit tests for this class. Throws an exception if there is a failure.
+	static void test();
+#endif // MIN_PREDICT
+
+	/// Appends the stages of a trained transform. (Calls pTransform->addToPipeline.)
+	void add(GIncrementalTransform* pTransform);
+
+	/// Allocates the buffers for processing blockRows rows at a time. This must be
+	/// called after the last stage is added, and before transforming any rows.
+	void compile(size_t blockRows = 64);
+
+	/// Returns the number of values in each input row
+	size_t inputDims() const { return m_inputDims; }
+
+	/// Returns the number of values in each output row
+	size_t outputDims() const;
+
+	/// Returns the number of stages that remain after fusion
+	size_t stageCount() const { return m_ops.size(); }
+
+	/// Transforms a single row
+	void transform(const GVec& in, GVec& out);
+
+	/// Transforms every row in in, and puts the results in the corresponding row
+	/// of out. (out must already have in.rows() rows of outputDims() values.)
+	void transformBatch(const GMatrix& in, GMatrix& out);
+
+	/// Adds a stage that computes scale[i] * x[i] + shift[i] for each element that is not unknown.
+	void addAffine(const GVec& scale, const GVec& shift);
+
+	/// Adds a stage that computes log(x[i]) for each continuous attribute in rel that is not unknown.
+	void addLog(const GRelation& rel);
+
+	/// Adds a stage that computes the dot product of each row of basis with (x - centroid), ignoring unknowns.
+	void addProjection(const GMatrix& basis, const GVec& centroid);
+
+	/// Adds a stage that behaves like GNominalToCat::transform
+	void addNominalToCat(const GRelation& rel, size_t valueCap, bool preserveUnknowns);
+
+	/// Adds a stage that behaves like GPairProduct::transform
+	void addPairProduct(size_t inputDims, size_t outputDims);
+
+	/// Adds an opaque stage that calls pTransform->transform
+	void addTransform(GIncrementalTransform* pTransform);
+
+protected:
+	/// Adds a stage, checking that its input size matches the output of the previous stage
+	void addOp(GTransformPipelineOp* pOp);
+
+	/// Runs all the stages on rows rows in m_buf[0]. Returns the index of the buffer that holds the results.
+	size_t run(size_t rows);
+};
+
 } // namespace GClasses
 
 #endif // __GTRANSFORM_H__
@@ -20,8 +20,12 @@
 #include "GWave.h"
 #include "GError.h"
 #include "GMath.h"
+#include "GThread.h"
+#include "GFile.h"
+#include "GRand.h"
 #include <fstream>
 #include <errno.h>
+#include <string.h>
 #include "math.h"
 #include "GFourier.h"
 
@@ -57,6 +61,93 @@ struct WaveHeader
 #	pragma pack()
 #endif
 
+void GWave_fillHeader(struct WaveHeader& waveHeader, unsigned short channels, unsigned int sampleRate, unsigned short bitsPerSample, size_t dataBytes)
+{
+	waveHeader.RIFF[0] = 'R';
+	waveHeader.RIFF[1] = 'I';
+	waveHeader.RIFF[2] = 'F';
+	waveHeader.RIFF[3] = 'F';
+	waveHeader.dwSize = (unsigned int)(sizeof(WaveHeader) - 8 + dataBytes + (dataBytes & 1));
+	waveHeader.WAVE[0] = 'W';
+	waveHeader.WAVE[1] = 'A';
+	waveHeader.WAVE[2] = 'V';
+	waveHeader.WAVE[3] = 'E';
+	waveHeader.fmt_[0] = 'f';
+	waveHeader.fmt_[1] = 'm';
+	waveHeader.fmt_[2] = 't';
+	waveHeader.fmt_[3] = ' ';
+	waveHeader.dw16 = 16;
+	waveHeader.wOne_0 = 1;
+	waveHeader.wChnls = channels;
+	waveHeader.dwSRate = sampleRate;
+	waveHeader.BytesPerSec = sampleRate * channels * bitsPerSample / 8;
+	waveHeader.wBlkAlign = channels * bitsPerSample / 8;
+	waveHeader.BitsPerSample = bitsPerSample;
+	waveHeader.DATA[0] = 'd';
+	waveHeader.DATA[1] = 'a';
+	waveHeader.DATA[2] = 't';
+	waveHeader.DATA[3] = 'a';
+	waveHeader.dwDSize = (unsigned int)dataBytes;
+}
+
+void GWave_checkBitsPerSample(int bitsPerSample)
+{
+	if(bitsPerSample != 8 && bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32)
+		throw Ex("Unsupported bits-per-sample: ", to_str(bitsPerSample));
+}
+
+// Converts one little-endian sample to a value from -1 to 1
+inline double GWave_decodeSample(const unsigned char* pX, unsigned short bitsPerSample)
+{
+	switch(bitsPerSample)
+	{
+		case 8: return (double(*pX) - 0x80) / 0x80; // 8-bit is unsigned
+		case 16: return double((short)(pX[0] | (pX[1] << 8))) / 0x8000; // the rest are signed
+		case 24:
+		{
+			int v = pX[0] | (pX[1] << 8) | (pX[2] << 16);
+			if(v & 0x800000)
+				v -= 0x1000000;
+			return double(v) / 0x800000;
+		}
+		case 32: return double((int)((unsigned int)pX[0] | ((unsigned int)pX[1] << 8) | ((unsigned int)pX[2] << 16) | ((unsigned int)pX[3] << 24))) / 0x80000000;
+	}
+	return 0.0;
+}
+
+// Converts a value from -1 to 1 to a little-endian sample
+inline void GWave_encodeSample(double d, unsigned char* pX, unsigned short bitsPerSample)
+{
+	switch(bitsPerSample)
+	{
+		case 8: *pX = (unsigned char)std::max(0.0, std::min(255.0, floor((d + 1) * 0x80 + 0.5))); break;
+		case 16:
+		{
+			int v = (int)std::max(-32768.0, std::min(32767.0, floor(d * 0x8000 + 0.5)));
+			pX[0] = (unsigned char)(v & 0xff);
+			pX[1] = (unsigned char)((v >> 8) & 0xff);
+			break;
+		}
+		case 24:
+		{
+			int v = (int)std::max(-8388608.0, std::min(8388607.0, floor(d * 0x800000 + 0.5)));
+			pX[0] = (unsigned char)(v & 0xff);
+			pX[1] = (unsigned char)((v >> 8) & 0xff);
+			pX[2] = (unsigned char)((v >> 16) & 0xff);
+			break;
+		}
+		case 32:
+		{
+			unsigned int v = (unsigned int)(int)std::max(-2147483648.0, std::min(2147483647.0, floor(d * 0x80000000 + 0.5)));
+			pX[0] = (unsigned char)(v & 0xff);
+			pX[1] = (unsigned char)((v >> 8) & 0xff);
+			pX[2] = (unsigned char)((v >> 16) & 0xff);
+			pX[3] = (unsigned char)((v >> 24) & 0xff);
+			break;
+		}
+	}
+}
+
 
 GWave::GWave()
 : m_sampleCount(0),
@@ -84,30 +175,19 @@ void GWave::setData(unsigned char* pData, int bps, int sample_Count, int chans,
 
 void GWave::load(const char* szFilename)
 {
-	// Read in the wave header
-	std::ifstream s;
-	s.exceptions(std::ios::badbit | std::ios::failbit);
+	GWaveReader reader(szFilename);
+	size_t size = reader.frames() * reader.channels() * reader.bitsPerSample() / 8;
+	unsigned char* pData = new unsigned char[size];
 	try
 	{
-		s.open(szFilename, std::ios::binary);
+		reader.readRaw(pData, reader.frames());
 	}
-	catch(const std::exception&)
+	catch(...)
 	{
-		throw Ex("Error while trying to open the file, ", szFilename, ". ", strerror(errno));
+		delete[] pData;
+		throw;
 	}
-	struct WaveHeader waveHeader;
-	s.read((char*)&waveHeader, sizeof(struct WaveHeader));
-
-	// Get stats from the wave header
-	int size = waveHeader.dwDSize;
-	m_channels = waveHeader.wChnls;
-	m_sampleRate = waveHeader.dwSRate;
-	m_bitsPerSample = waveHeader.BitsPerSample;
-	m_sampleCount = size / (m_bitsPerSample / 8);
-
-	// Read the wave data
-	m_pData = new unsigned char[size];
-	s.read((char*)m_pData, size);
+	setData(pData, reader.bitsPerSample(), (int)reader.frames(), reader.channels(), reader.sampleRate());
 }
 
 void GWave::save(const char* szFilename)
@@ -115,31 +195,7 @@ void GWave::save(const char* szFilename)
 	// Write the wave header
 	int size = m_sampleCount * m_channels * m_bitsPerSample / 8;
 	struct WaveHeader waveHeader;
-	waveHeader.RIFF[0] = 'R';
-	waveHeader.RIFF[1] = 'I';
-	waveHeader.RIFF[2] = 'F';
-	waveHeader.RIFF[3] = 'F';
-	waveHeader.dwSize = sizeof(WaveHeader) - 8 + size;
-	waveHeader.WAVE[0] = 'W';
-	waveHeader.WAVE[1] = 'A';
-	waveHeader.WAVE[2] = 'V';
-	waveHeader.WAVE[3] = 'E';
-	waveHeader.fmt_[0] = 'f';
-	waveHeader.fmt_[1] = 'm';
-	waveHeader.fmt_[2] = 't';
-	waveHeader.fmt_[3] = ' ';
-	waveHeader.dw16 = 16;
-	waveHeader.wOne_0 = 1;
-	waveHeader.wChnls = m_channels;
-	waveHeader.dwSRate = m_sampleRate;
-	waveHeader.BytesPerSec = m_sampleRate * m_channels * m_bitsPerSample / 8;
-	waveHeader.wBlkAlign = m_channels * m_bitsPerSample / 8;
-	waveHeader.BitsPerSample = m_bitsPerSample;
-	waveHeader.DATA[0] = 'd';
-	waveHeader.DATA[1] = 'a';
-	waveHeader.DATA[2] = 't';
-	waveHeader.DATA[3] = 'a';
-	waveHeader.dwDSize = size;
+	GWave_fillHeader(waveHeader, m_channels, m_sampleRate, m_bitsPerSample, size);
 
 	// Make the file
 	std::ofstream os;
@@ -197,37 +253,234 @@ double* GWaveIterator::current()
 {
 	unsigned char* pX = m_pPos;
 	double* pY = m_pSamples;
+	unsigned short bits = m_wave.bitsPerSample();
 	for(unsigned short i = 0; i < m_wave.channels(); i++)
 	{
-		switch(m_wave.bitsPerSample())
-		{
-			case 8: *pY = (double(*pX) - 0x80) / 0x80; break; // 8-bit is unsigned
-			case 16: *pY = double(*(short*)pX) / 0x8000; break; // 16-bit is signed
-			case 32: *pY = double(*(int*)pX) / 0x80000000; break; // 32-bit is signed
-		}
-		pX += m_wave.bitsPerSample() / 8;
+		*pY = GWave_decodeSample(pX, bits);
+		pX += bits / 8;
 		pY++;
 	}
 	return m_pSamples;
 }
 
-void GWaveIterator::set(double* pSamples)
+void GWaveIterator::set(const double* pSamples)
 {
 	unsigned char* pX = m_pPos;
-	double* pY = pSamples;
+	const double* pY = pSamples;
+	unsigned short bits = m_wave.bitsPerSample();
 	for(unsigned short i = 0; i < m_wave.channels(); i++)
 	{
-		switch(m_wave.bitsPerSample())
+		GWave_encodeSample(*pY, pX, bits);
+		pX += bits / 8;
+		pY++;
+	}
+}
+
+
+
+
+void GWaveSource::readBlocks(size_t blockFrames, GWaveBlockHandler& handler)
+{
+	if(blockFrames < 1)
+		throw Ex("The block size must be at least 1");
+	std::vector<double> buf(blockFrames * channels());
+	while(remaining() > 0)
+	{
+		size_t frames = read(buf.data(), blockFrames);
+		if(frames == 0)
+			break;
+		handler.onBlock(buf.data(), frames);
+	}
+}
+
+
+
+
+// Reads a little-endian unsigned integer
+inline unsigned int GWaveReader_le(const unsigned char* p, size_t bytes)
+{
+	unsigned int v = 0;
+	for(size_t i = bytes; i > 0; i--)
+		v = (v << 8) | p[i - 1];
+	return v;
+}
+
+GWaveReader::GWaveReader(const char* szFilename)
+: m_channels(0), m_sampleRate(0), m_bitsPerSample(0), m_frames(0), m_position(0), m_dataStart(0)
+{
+	m_stream.exceptions(std::ios::badbit | std::ios::failbit);
+	try
+	{
+		m_stream.open(szFilename, std::ios::binary);
+	}
+	catch(const std::exception&)
+	{
+		throw Ex("Error while trying to open the file, ", szFilename, ". ", strerror(errno));
+	}
+	m_stream.seekg(0, std::ios::end);
+	std::streamoff fileSize = m_stream.tellg();
+	m_stream.seekg(0, std::ios::beg);
+	unsigned char riff[12];
+	if(fileSize < 12)
+		throw Ex("Not a WAV file: ", szFilename);
+	m_stream.read((char*)riff, 12);
+	if(memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0)
+		throw Ex("Not a WAV file: ", szFilename);
+
+	// Find the format and data chunks, skipping any others
+	bool haveFormat = false;
+	while(true)
+	{
+		std::streamoff pos = m_stream.tellg();
+		if(pos + 8 > fileSize)
+			throw Ex("No data was found in ", szFilename);
+		unsigned char chunk[8];
+		m_stream.read((char*)chunk, 8);
+		std::streamoff chunkSize = GWaveReader_le(chunk + 4, 4);
+		if(memcmp(chunk, "fmt ", 4) == 0)
 		{
-			case 8: *pX = (unsigned char)std::max(0.0, std::min(255.0, floor((*pY + 1) * 0x80 + 0.5))); break;
-			case 16: *(short*)pX = (short)std::max(-32768.0, std::min(32767.0, floor(*pY * 0x8000 + 0.5))); break;
-			case 32: *(int*)pX = (int)std::max(-2147483648.0, std::min(2147483647.0, floor(*pY * 0x80000000 + 0.5))); break;
+			unsigned char fmt[16];
+			if(chunkSize < 16 || pos + 8 + 16 > fileSize)
+				throw Ex("Invalid format chunk in ", szFilename);
+			m_stream.read((char*)fmt, 16);
+			unsigned int format = GWaveReader_le(fmt, 2);
+			if(format != 1 && format != 0xfffe)
+				throw Ex("Only PCM wave files are supported");
+			m_channels = (unsigned short)GWaveReader_le(fmt + 2, 2);
+			m_sampleRate = GWaveReader_le(fmt + 4, 4);
+			m_bitsPerSample = (unsigned short)GWaveReader_le(fmt + 14, 2);
+			GWave_checkBitsPerSample(m_bitsPerSample);
+			if(m_channels < 1)
+				throw Ex("Invalid number of channels in ", szFilename);
+			haveFormat = true;
 		}
-		pX += m_wave.bitsPerSample() / 8;
-		pY++;
+		else if(memcmp(chunk, "data", 4) == 0)
+		{
+			if(!haveFormat)
+				throw Ex("The data comes before the format in ", szFilename);
+			m_dataStart = pos + 8;
+
+			// (Some programs that write as they record leave the size unset, so the size of the file is trusted over the header.)
+			std::streamoff bytes = std::min(chunkSize, fileSize - m_dataStart);
+			m_frames = (size_t)bytes / (m_channels * m_bitsPerSample / 8);
+			break;
+		}
+		m_stream.seekg(pos + 8 + chunkSize + (chunkSize & 1));
 	}
 }
 
+// virtual
+GWaveReader::~GWaveReader()
+{
+}
+
+size_t GWaveReader::readRaw(unsigned char* pBytes, size_t frames)
+{
+	frames = std::min(frames, remaining());
+	m_stream.read((char*)pBytes, frames * m_channels * m_bitsPerSample / 8);
+	m_position += frames;
+	return frames;
+}
+
+// virtual
+size_t GWaveReader::read(double* pSamples, size_t frames)
+{
+	frames = std::min(frames, remaining());
+	size_t bytesPerSample = m_bitsPerSample / 8;
+	m_raw.resize(frames * m_channels * bytesPerSample);
+	readRaw(m_raw.data(), frames);
+	const unsigned char* pX = m_raw.data();
+	for(size_t i = frames * m_channels; i > 0; i--)
+	{
+		*(pSamples++) = GWave_decodeSample(pX, m_bitsPerSample);
+		pX += bytesPerSample;
+	}
+	return frames;
+}
+
+void GWaveReader::seek(size_t frame)
+{
+	if(frame > m_frames)
+		throw Ex("Position ", to_str(frame), " is out of range. There are only ", to_str(m_frames), " frames");
+	m_stream.seekg(m_dataStart + (std::streamoff)(frame * m_channels * m_bitsPerSample / 8));
+	m_position = frame;
+}
+
+
+
+
+GWaveWriter::GWaveWriter(const char* szFilename, int bitsPerSample, int channels, int sampleRate)
+: m_channels((unsigned short)channels), m_sampleRate(sampleRate), m_bitsPerSample((unsigned short)bitsPerSample), m_frames(0), m_open(false)
+{
+	GWave_checkBitsPerSample(bitsPerSample);
+	if(channels < 1)
+		throw Ex("There must be at least one channel");
+	m_stream.exceptions(std::ios::badbit | std::ios::failbit);
+	try
+	{
+		m_stream.open(szFilename, std::ios::binary);
+	}
+	catch(const std::exception&)
+	{
+		throw Ex("Error while trying to create the file, ", szFilename, ". ", strerror(errno));
+	}
+	m_open = true;
+
+	// Write a header with no data. (close will fill in the sizes.)
+	struct WaveHeader waveHeader;
+	GWave_fillHeader(waveHeader, m_channels, m_sampleRate, m_bitsPerSample, 0);
+	m_stream.write((const char*)&waveHeader, sizeof(struct WaveHeader));
+}
+
+// virtual
+GWaveWriter::~GWaveWriter()
+{
+	if(m_open)
+	{
+		try
+		{
+			close();
+		}
+		catch(...)
+		{
+		}
+	}
+}
+
+// virtual
+void GWaveWriter::write(const double* pSamples, size_t frames)
+{
+	if(!m_open)
+		throw Ex("The file has already been closed");
+	size_t bytesPerSample = m_bitsPerSample / 8;
+	m_raw.resize(frames * m_channels * bytesPerSample);
+	unsigned char* pX = m_raw.data();
+	for(size_t i = frames * m_channels; i > 0; i--)
+	{
+		GWave_encodeSample(*(pSamples++), pX, m_bitsPerSample);
+		pX += bytesPerSample;
+	}
+	m_stream.write((const char*)m_raw.data(), m_raw.size());
+	m_frames += frames;
+}
+
+void GWaveWriter::close()
+{
+	if(!m_open)
+		return;
+	m_open = false;
+	size_t dataBytes = m_frames * m_channels * m_bitsPerSample / 8;
+	if(dataBytes + sizeof(WaveHeader) > 0xffffffffu)
+		throw Ex("Too many samples for the WAV format");
+	if(dataBytes & 1)
+		m_stream.put('\0'); // Chunks are padded to an even size
+	struct WaveHeader waveHeader;
+	GWave_fillHeader(waveHeader, m_channels, m_sampleRate, m_bitsPerSample, dataBytes);
+	m_stream.seekp(0);
+	m_stream.write((const char*)&waveHeader, sizeof(struct WaveHeader));
+	m_stream.close();
+}
+
 
 
 
@@ -235,7 +488,7 @@ void GWaveIterator::set(double* pSamples)
 
 
 GFourierWaveProcessor::GFourierWaveProcessor(size_t blockSize)
-: m_blockSize(blockSize)
+: m_blockSize(blockSize), m_plan(blockSize), m_workerThreads(1), m_batchBlocks(16)
 {
 	m_pBufA = new struct ComplexNumber[m_blockSize];
 	m_pBufB = new struct ComplexNumber[m_blockSize];
@@ -256,70 +509,212 @@ GFourierWaveProcessor::~GFourierWaveProcessor()
 	delete[] m_pBufFinal;
 }
 
+/// Wraps a GWaveIterator as a GWaveSource
+class GWaveIteratorSource : public GWaveSource
+{
+protected:
+	GWaveIterator m_it;
+	unsigned short m_channels;
+
+public:
+	GWaveIteratorSource(GWave& wave) : m_it(wave), m_channels(wave.channels()) {}
+	virtual ~GWaveIteratorSource() {}
+
+	virtual unsigned short channels() { return m_channels; }
+
+	virtual size_t remaining() { return m_it.remaining(); }
+
+	virtual size_t read(double* pSamples, size_t frames)
+	{
+		frames = std::min(frames, m_it.remaining());
+		for(size_t i = 0; i < frames; i++)
+		{
+			memcpy(pSamples, m_it.current(), sizeof(double) * m_channels);
+			pSamples += m_channels;
+			m_it.advance();
+		}
+		return frames;
+	}
+};
+
+/// Wraps a GWaveIterator as a GWaveSink
+class GWaveIteratorSink : public GWaveSink
+{
+protected:
+	GWaveIterator m_it;
+	unsigned short m_channels;
+
+public:
+	GWaveIteratorSink(GWave& wave) : m_it(wave), m_channels(wave.channels()) {}
+	virtual ~GWaveIteratorSink() {}
+
+	virtual void write(const double* pSamples, size_t frames)
+	{
+		if(frames > m_it.remaining())
+			throw Ex("Too many samples");
+		for(size_t i = 0; i < frames; i++)
+		{
+			m_it.set(pSamples);
+			pSamples += m_channels;
+			m_it.advance();
+		}
+	}
+};
+
 void GFourierWaveProcessor::reduce(GWave& signal)
 {
-	for(unsigned short chan = 0; chan < signal.channels(); chan++)
-	{
-		// Denoise the signal. Here is an ascii-art representation of how the blocks align.
-		// Suppose the signal is 4 blocks long (n=4). i will iterate from 0 to 4.
-		//                 _________ _________ _________ _________
-		//  0   A    B    C    D    E
-		//  1             A    B    C    D    E
-		//  2                       A    B    C    D    E
-		//  3                                 A    B    C    D    E
-		//  4                                           A    B    C    D    E
-		GWaveIterator itSignalIn(signal);
-		GWaveIterator itSignalOut(signal);
-		size_t n = itSignalIn.remaining() / m_blockSize;
-		if((m_blockSize * n) < itSignalIn.remaining())
-			n++;
-		for(size_t i = 0; i <= n; i++)
+	GWaveIteratorSource in(signal);
+	GWaveIteratorSink out(signal);
+	reduce(in, out);
+}
+
+void GFourierWaveProcessor::processBlock(const double* pSamples, struct ComplexNumber* pBuf)
+{
+	for(size_t i = 0; i < m_blockSize; i++)
+	{
+		pBuf[i].real = pSamples[i];
+		pBuf[i].imag = 0.0;
+	}
+	m_plan.transform(pBuf, true);
+	process(pBuf);
+	m_plan.transform(pBuf, false);
+}
+
+/// Processes the blocks of one batch. (Used by GFourierWaveProcessor::reduce.)
+class GFourierWaveProcessorWorker : public GWorkerThread
+{
+protected:
+	GFourierWaveProcessor& m_processor;
+	const double* m_pWindow;
+	size_t m_windowSize;
+	struct ComplexNumber* m_pAligned;
+	struct ComplexNumber* m_pStraddling;
+	size_t m_batch;
+	size_t m_straddles;
+
+public:
+	std::string m_error;
+
+	GFourierWaveProcessorWorker(GMasterThread& master, GFourierWaveProcessor& processor, const double* pWindow, size_t windowSize, struct ComplexNumber* pAligned, struct ComplexNumber* pStraddling, size_t batch, size_t straddles)
+	: GWorkerThread(master), m_processor(processor), m_pWindow(pWindow), m_windowSize(windowSize), m_pAligned(pAligned), m_pStraddling(pStraddling), m_batch(batch), m_straddles(straddles)
+	{
+	}
+
+	virtual ~GFourierWaveProcessorWorker()
+	{
+	}
+
+	virtual void doJob(size_t jobId)
+	{
+		size_t blockSize = m_processor.m_blockSize;
+		size_t batchBlocks = m_processor.m_batchBlocks;
+		size_t chan = jobId / (m_batch + m_straddles);
+		size_t block = jobId % (m_batch + m_straddles);
+		const double* pSamples = m_pWindow + chan * m_windowSize;
+		try
+		{
+			if(block < m_batch)
+				m_processor.processBlock(pSamples + block * blockSize, m_pAligned + (chan * batchBlocks + block) * blockSize);
+			else
+			{
+				// Straddling block s begins half a block before aligned block s
+				size_t s = block - m_batch + 1;
+				m_processor.processBlock(pSamples + s * blockSize - blockSize / 2, m_pStraddling + (chan * (batchBlocks + 1) + s) * blockSize);
+			}
+		}
+		catch(const std::exception& e)
+		{
+			if(m_error.length() == 0)
+				m_error = e.what();
+		}
+	}
+};
+
+void GFourierWaveProcessor::reduce(GWaveSource& in, GWaveSink& out)
+{
+	// The signal is divided into aligned blocks, and straddling blocks that begin in the middle of each
+	// aligned block (except the last). Each aligned block is blended with the straddling ones on either side.
+	// Here is an ascii-art representation of how the blocks align:
+	//  aligned:      |____0____|____1____|____2____|____3____|
+	//  straddling:        |____1____|____2____|____3____|
+	// The signal passes through a window that holds batchBlocks aligned blocks of each channel, plus
+	// half a block more for the last straddling block. The last straddling block of each batch is
+	// kept for blending with the first aligned block of the next batch.
+	size_t half = m_blockSize / 2;
+	size_t chans = in.channels();
+	size_t frames = in.remaining();
+	size_t blocks = (frames + m_blockSize - 1) / m_blockSize;
+	size_t windowSize = m_batchBlocks * m_blockSize + half;
+	std::vector<double> window(chans * windowSize);
+	std::vector<double> interleaved(chans * windowSize);
+	std::vector<struct ComplexNumber> aligned(chans * m_batchBlocks * m_blockSize);
+	std::vector<struct ComplexNumber> straddling(chans * (m_batchBlocks + 1) * m_blockSize);
+	size_t have = 0; // The number of samples of each channel already in the window
+	for(size_t firstBlock = 0; firstBlock < blocks; firstBlock += m_batchBlocks)
+	{
+		size_t batch = std::min(m_batchBlocks, blocks - firstBlock);
+		size_t straddles = std::min(batch, blocks - 1 - firstBlock);
+
+		// Fill the window, padding with zeros past the end of the signal
+		size_t want = batch * m_blockSize + half;
+		size_t got = in.read(interleaved.data(), want - have);
+		for(size_t c = 0; c < chans; c++)
+		{
+			double* pChan = window.data() + c * windowSize;
+			for(size_t i = 0; i < got; i++)
+				pChan[have + i] = interleaved[i * chans + c];
+			for(size_t i = have + got; i < want; i++)
+				pChan[i] = 0.0;
+		}
+
+		// Process all of the blocks in the window
+		std::string error;
 		{
-			// Encode block D (which also covers the latter-half of C and the first-half of E)
-			if(i != n)
+			size_t jobs = chans * (batch + straddles);
+			size_t threads = std::max((size_t)1, std::min(m_workerThreads, jobs));
+			std::vector<GFourierWaveProcessorWorker*> workers;
+			GMasterThread master;
+			for(size_t i = 0; i < threads; i++)
 			{
-				encodeBlock(itSignalIn, m_pBufD, chan);
-				struct ComplexNumber* pSrc = m_pBufD;
-				struct ComplexNumber* pDest = m_pBufC + m_blockSize / 2;
-				for(size_t j = 0; j < m_blockSize / 2; j++)
-					*(pDest++) = *(pSrc++);
-				pDest = m_pBufE;
-				for(size_t j = 0; j < m_blockSize / 2; j++)
-					*(pDest++) = *(pSrc++);
-
-				// Blocks C and D are fully-encoded, so we can bring them to the Fourier domain now
-				if(i != 0)
-					GFourier::fft(m_blockSize, m_pBufC, true);
-				GFourier::fft(m_blockSize, m_pBufD, true);
+				workers.push_back(new GFourierWaveProcessorWorker(master, *this, window.data(), windowSize, aligned.data(), straddling.data(), batch, straddles));
+				master.addWorker(workers[i]);
 			}
+			master.doJobs(jobs);
+			for(size_t i = 0; i < threads; i++)
+			{
+				if(workers[i]->m_error.length() > 0 && error.length() == 0)
+					error = workers[i]->m_error;
+			}
+		}
+		if(error.length() > 0)
+			throw Ex(error);
 
-			// Process the blocks that are ready-to-go
-			if(i != 0)
+		// Blend the blocks, and write the results
+		size_t outFrames = std::min(batch * m_blockSize, frames - firstBlock * m_blockSize);
+		for(size_t j = 0; j < batch; j++)
+		{
+			for(size_t c = 0; c < chans; c++)
 			{
-				// Denoise blocks B and C
-				process(m_pBufB);
-				GFourier::fft(m_blockSize, m_pBufB, false);
-				if(i != n)
-				{
-					process(m_pBufC);
-					GFourier::fft(m_blockSize, m_pBufC, false);
-				}
-
-				// Interpolate A, B, and C to produce the final B
-				interpolate(i == 1 ? NULL : m_pBufA, m_pBufB, i == n ? NULL : m_pBufC, m_blockSize / 2);
-				decodeBlock(itSignalOut, chan);
+				struct ComplexNumber* pPre = (firstBlock + j > 0 ? &straddling[(c * (m_batchBlocks + 1) + j) * m_blockSize] : NULL);
+				struct ComplexNumber* pCur = &aligned[(c * m_batchBlocks + j) * m_blockSize];
+				struct ComplexNumber* pPost = (j < straddles ? &straddling[(c * (m_batchBlocks + 1) + j + 1) * m_blockSize] : NULL);
+				interpolate(pPre, pCur, pPost, half);
+				size_t end = std::min(m_blockSize, outFrames - j * m_blockSize);
+				for(size_t i = 0; i < end; i++)
+					interleaved[(j * m_blockSize + i) * chans + c] = m_pBufFinal[i].real;
 			}
+		}
+		out.write(interleaved.data(), outFrames);
 
-			// Shift A<-C, B<-D, C<-E
-			struct ComplexNumber* pTemp = m_pBufA;
-			m_pBufA = m_pBufC;
-			m_pBufC = m_pBufE;
-			m_pBufE = pTemp;
-			pTemp = m_pBufB;
-			m_pBufB = m_pBufD;
-			m_pBufD = pTemp;
+		// Keep what the next batch needs
+		for(size_t c = 0; c < chans; c++)
+		{
+			double* pChan = window.data() + c * windowSize;
+			memmove(pChan, pChan + batch * m_blockSize, sizeof(double) * half);
+			struct ComplexNumber* pStraddling = &straddling[c * (m_batchBlocks + 1) * m_blockSize];
+			memcpy(pStraddling, pStraddling + batch * m_blockSize, sizeof(struct ComplexNumber) * m_blockSize);
 		}
-		GAssert(itSignalOut.remaining() == 0);
+		have = half;
 	}
 }
 
@@ -409,5 +804,146 @@ void GFourierWaveProcessor::interpolate(struct ComplexNumber* pPre, struct Compl
 }
 
 
+#ifndef NO_TEST_CODE
+/// Passes the signal through unchanged, or cuts the high frequencies
+class GWaveTestProcessor : public GFourierWaveProcessor
+{
+protected:
+	bool m_lowPass;
+
+public:
+	GWaveTestProcessor(size_t blockSize, bool lowPass) : GFourierWaveProcessor(blockSize), m_lowPass(lowPass) {}
+	virtual ~GWaveTestProcessor() {}
+
+protected:
+	virtual void process(struct ComplexNumber* pBuf)
+	{
+		if(!m_lowPass)
+			return;
+		for(size_t i = 0; i < m_blockSize; i++)
+		{
+			size_t freq = std::min(i, m_blockSize - i);
+			double scale = (freq < m_blockSize / 16 ? 1.0 : 0.3);
+			pBuf[i].real *= scale;
+			pBuf[i].imag *= scale;
+		}
+	}
+};
+
+void GWave_makeTestWave(GWave& wave, size_t frames, int channels, GRand& rand)
+{
+	unsigned char* pData = new unsigned char[frames * channels * 2];
+	wave.setData(pData, 16, (int)frames, channels, 44100);
+	GWaveIterator it(wave);
+	std::vector<double> samples(channels);
+	for(size_t i = 0; i < frames; i++)
+	{
+		for(int c = 0; c < channels; c++)
+			samples[c] = 0.3 * sin(0.01 * i * (c + 1)) + 0.1 * rand.normal();
+		it.set(samples.data());
+		it.advance();
+	}
+}
+
+void GWave_checkSame(GWave& a, GWave& b)
+{
+	if(a.sampleCount() != b.sampleCount() || a.channels() != b.channels() || a.bitsPerSample() != b.bitsPerSample())
+		throw Ex("The waves have different sizes");
+	if(memcmp(a.data(), b.data(), a.sampleCount() * a.channels() * a.bitsPerSample() / 8) != 0)
+		throw Ex("The waves have different samples");
+}
+
+/// Copies every block into a GWave
+class GWaveTestBlockHandler : public GWaveBlockHandler
+{
+public:
+	GWaveIterator m_it;
+	size_t m_blocks;
+
+	GWaveTestBlockHandler(GWave& wave) : m_it(wave), m_blocks(0) {}
+	virtual ~GWaveTestBlockHandler() {}
+
+	virtual void onBlock(const double* pSamples, size_t frames)
+	{
+		for(size_t i = 0; i < frames; i++)
+		{
+			m_it.set(pSamples + i * 2);
+			m_it.advance();
+		}
+		m_blocks++;
+	}
+};
+
+// static
+void GWave::test()
+{
+	GRand rand(0);
+	char szIn[512];
+	GFile::tempFilename(szIn);
+	char szOut[512];
+	GFile::tempFilename(szOut);
+	try
+	{
+		// Reading a saved file in blocks should give back the same samples
+		GWave wave;
+		GWave_makeTestWave(wave, 10007, 2, rand);
+		wave.save(szIn);
+		GWave copy;
+		GWave_makeTestWave(copy, 10007, 2, rand);
+		{
+			GWaveReader reader(szIn);
+			if(reader.frames() != 10007 || reader.channels() != 2 || reader.sampleRate() != 44100)
+				throw Ex("Wrong header");
+			GWaveTestBlockHandler handler(copy);
+			reader.readBlocks(1000, handler);
+			if(handler.m_blocks != 11)
+				throw Ex("Wrong number of blocks");
+		}
+		GWave_checkSame(copy, wave);
+
+		// Writing in pieces and loading should also give back the same samples
+		{
+			GWaveReader reader(szIn);
+			GWaveWriter writer(szOut, 16, 2, 44100);
+			std::vector<double> buf(2 * 777);
+			while(reader.remaining() > 0)
+			{
+				size_t frames = reader.read(buf.data(), 777);
+				writer.write(buf.data(), frames);
+			}
+		}
+		copy.load(szOut);
+		GWave_checkSame(copy, wave);
+
+		// Processing with no change should not change the signal
+		GWaveTestProcessor identity(256, false);
+		identity.reduce(copy);
+		GWave_checkSame(copy, wave);
+
+		// Processing a file as a stream, with several threads, should give the same results as processing it in memory
+		GWaveTestProcessor lowPass(256, true);
+		lowPass.reduce(wave);
+		GWaveTestProcessor lowPassStream(256, true);
+		lowPassStream.setWorkerThreads(3);
+		lowPassStream.setBatchBlocks(3);
+		{
+			GWaveReader reader(szIn);
+			GWaveWriter writer(szOut, 16, 2, 44100);
+			lowPassStream.reduce(reader, writer);
+		}
+		copy.load(szOut);
+		GWave_checkSame(copy, wave);
+	}
+	catch(...)
+	{
+		GFile::deleteFile(szIn);
+		GFile::deleteFile(szOut);
+		throw;
+	}
+	GFile::deleteFile(szIn);
+	GFile::deleteFile(szOut);
+}
+#endif // NO_TEST_CODE
+
 } // namespace GClasses
 
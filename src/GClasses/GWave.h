@@ -21,6 +21,9 @@
 #define __GWAVE_H__
 
 #include "GError.h"
+#include "GFourier.h"
+#include <fstream>
+#include <vector>
 
 namespace GClasses {
 
@@ -69,6 +72,134 @@ public:
 
 	/// Returns the number of channels
 	unsigned short channels() { return m_channels; }
+
+#ifndef NO_TEST_CODE
+	/// Performs unit tests for this class and the related streaming classes. Throws an exception if there is a failure.
+	static void test();
+#endif
+};
+
+
+/// Receives the blocks of samples read by GWaveSource::readBlocks.
+class GWaveBlockHandler
+{
+public:
+	GWaveBlockHandler() {}
+	virtual ~GWaveBlockHandler() {}
+
+	/// pSamples contains frames frames of interleaved samples from -1 to 1. (A frame is one sample
+	/// for each channel.) The buffer is reused for the next block.
+	virtual void onBlock(const double* pSamples, size_t frames) = 0;
+};
+
+
+/// An abstract source of interleaved samples, from -1 to 1.
+class GWaveSource
+{
+public:
+	GWaveSource() {}
+	virtual ~GWaveSource() {}
+
+	/// Returns the number of channels
+	virtual unsigned short channels() = 0;
+
+	/// Returns the number of frames that have not been read yet
+	virtual size_t remaining() = 0;
+
+	/// Reads up to frames frames into pSamples, which must have room for frames * channels() values.
+	/// Returns the number of frames read.
+	virtual size_t read(double* pSamples, size_t frames) = 0;
+
+	/// Reads the rest of the samples, and passes them to handler in blocks of blockFrames frames.
+	/// (The last block may be shorter.) Only one block is held in memory at a time.
+	void readBlocks(size_t blockFrames, GWaveBlockHandler& handler);
+};
+
+
+/// An abstract destination for interleaved samples, from -1 to 1.
+class GWaveSink
+{
+public:
+	GWaveSink() {}
+	virtual ~GWaveSink() {}
+
+	/// Writes frames frames from pSamples, which contains frames * channels interleaved values.
+	virtual void write(const double* pSamples, size_t frames) = 0;
+};
+
+
+/// Reads a PCM WAV file a little at a time, so files that are too big to load can be processed.
+class GWaveReader : public GWaveSource
+{
+protected:
+	std::ifstream m_stream;
+	unsigned short m_channels;
+	unsigned int m_sampleRate;
+	unsigned short m_bitsPerSample;
+	size_t m_frames;
+	size_t m_position;
+	std::streamoff m_dataStart;
+	std::vector<unsigned char> m_raw;
+
+public:
+	/// Opens szFilename and reads its header
+	GWaveReader(const char* szFilename);
+	virtual ~GWaveReader();
+
+	/// Returns the number of channels
+	virtual unsigned short channels() { return m_channels; }
+
+	/// Returns the sample rate
+	unsigned int sampleRate() { return m_sampleRate; }
+
+	/// Returns the number of bits-per-sample
+	unsigned short bitsPerSample() { return m_bitsPerSample; }
+
+	/// Returns the total number of frames in the file
+	size_t frames() { return m_frames; }
+
+	/// Returns the number of frames that have not been read yet
+	virtual size_t remaining() { return m_frames - m_position; }
+
+	/// Reads up to frames frames, converted to values from -1 to 1
+	virtual size_t read(double* pSamples, size_t frames);
+
+	/// Reads up to frames frames in the raw format of the file. pBytes must have room for
+	/// frames * channels() * bitsPerSample() / 8 bytes. Returns the number of frames read.
+	size_t readRaw(unsigned char* pBytes, size_t frames);
+
+	/// Moves to the specified frame
+	void seek(size_t frame);
+};
+
+
+/// Writes a PCM WAV file a little at a time. The header is completed when close is called.
+class GWaveWriter : public GWaveSink
+{
+protected:
+	std::ofstream m_stream;
+	unsigned short m_channels;
+	unsigned int m_sampleRate;
+	unsigned short m_bitsPerSample;
+	size_t m_frames;
+	bool m_open;
+	std::vector<unsigned char> m_raw;
+
+public:
+	/// Creates szFilename. bitsPerSample should be 8, 16, 24, or 32.
+	GWaveWriter(const char* szFilename, int bitsPerSample, int channels, int sampleRate);
+
+	/// Calls close, if it has not been called already
+	virtual ~GWaveWriter();
+
+	/// Writes frames frames of interleaved values from -1 to 1. Values out of range are clipped.
+	virtual void write(const double* pSamples, size_t frames);
+
+	/// Returns the number of frames written so far
+	size_t frames() { return m_frames; }
+
+	/// Writes the sizes into the header and closes the file
+	void close();
 };
 
 
@@ -102,7 +233,7 @@ public:
 	/// pSamples should be an array of doubles, one for each channel,
 	/// where each value ranges from -1 to 1. Sets the values in the
 	/// format specified by the wave object.
-	void set(double* pSamples);
+	void set(const double* pSamples);
 
 	/// Copies the position of another wave iterator that is iterating
 	/// on the same wave. (Behavior is undefined if the other iterator
@@ -114,11 +245,17 @@ public:
 /// This is an abstract class that processes a wave file in blocks. Specifically, it
 /// divides the wave file up into overlapping blocks, converts them into Fourier space,
 /// calls the abstract "process" method with each block, converts back from Fourier space,
-/// and then interpolates to create the wave output.
+/// and then interpolates to create the wave output. The signal is streamed through a
+/// buffer that holds a fixed number of blocks of each channel, so its length is not
+/// limited by memory. The blocks in the buffer may be processed by several threads.
 class GFourierWaveProcessor
 {
+friend class GFourierWaveProcessorWorker;
 protected:
 	size_t m_blockSize;
+	GFftPlan m_plan;
+	size_t m_workerThreads;
+	size_t m_batchBlocks;
 	struct ComplexNumber* m_pBufA;
 	struct ComplexNumber* m_pBufB;
 	struct ComplexNumber* m_pBufC;
@@ -131,14 +268,32 @@ public:
 	GFourierWaveProcessor(size_t blockSize);
 	virtual ~GFourierWaveProcessor();
 
+	GFourierWaveProcessor(const GFourierWaveProcessor&) = delete;
+	GFourierWaveProcessor& operator=(const GFourierWaveProcessor&) = delete;
+
+	/// Specifies the number of threads used to process blocks. (The default is 1.)
+	/// If this is more than 1, process must be safe to call from several threads at once.
+	void setWorkerThreads(size_t n) { m_workerThreads = (n > 1 ? n : 1); }
+
+	/// Specifies how many blocks of each channel are buffered and processed at once. (The default is 16.)
+	void setBatchBlocks(size_t n) { m_batchBlocks = (n > 1 ? n : 1); }
+
 	/// Transforms signal
 	void reduce(GWave& signal);
 
+	/// Transforms the samples from in, and writes them to out. (They may refer to the same
+	/// wave, since each sample is written after it is read.)
+	void reduce(GWaveSource& in, GWaveSink& out);
+
 protected:
 	/// pBuf represents a block of m_blockSize complex numbers in Fourier space.
 	/// This method should transform the block in some way.
 	virtual void process(struct ComplexNumber* pBuf) = 0;
 
+	/// Copies m_blockSize samples, starting at pSamples, into pBuf, transforms
+	/// them to Fourier space, processes them, and transforms them back.
+	void processBlock(const double* pSamples, struct ComplexNumber* pBuf);
+
 	/// Convert the specified channel from an iterator to an array of complex numbers (in temporal space).
 	void encodeBlock(GWaveIterator& it, struct ComplexNumber* pBuf, unsigned short chan);
 
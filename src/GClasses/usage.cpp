@@ -240,6 +240,8 @@ UsageNode* makeAlgorithmUsageTree()
 		pOpts->add("-noise [var]=1.0", "The variance of the noise parameter.");
 		pOpts->add("-prior [var]=1024.0", "The prior variance for the weights. (This value will be multiplied by an identity matrix to form the prior covariance for the weights.");
 		pOpts->add("-maxsamples [n]=350", "The maximum number of samples to train with. (If the training data contains more than [n] rows, then it will automatically randomly sub-sample the training data in order to limit computational complexity.)");
+		pOpts->add("-inducing [m]=0", "Use the FITC sparse approximation with [m] inducing points, which are randomly selected training samples. This trains with all of the training data in O(n*m^2) time, so -maxsamples is ignored. (0 means to train the exact model.)");
+		pOpts->add("-threads [n]=1", "The number of threads to use for computing the kernel matrices during training.");
 		UsageNode* pKern = pOpts->add("-kernel [k]", "Specify the kernel to use");
 		pKern->add("identity", "This simple kernel causes it to learn a linear model. If no kernel is specified, this is the default.");
 		pKern->add("chisquared", "A Chi Squared kernel.");
@@ -410,6 +412,7 @@ UsageNode* makeAudioUsageTree()
 		pPS->add("[out]=out.wav", "The filename to which to save the results.");
 		UsageNode* pOpts = pPS->add("<options>");
 		pOpts->add("-blocksize [n]=2048", "Specify the block size. [n] must be a power of 2.");
+		pOpts->add("-threads [n]=1", "Specify the number of threads to use for processing blocks.");
 	}
 	{
 		UsageNode* pRedNoise = pRoot->add("reduceambientnoise [noise] [in] [out] <options>", "Learns the distribution in [noise], and subtracts it from [in] to generate [out].");
@@ -419,6 +422,7 @@ UsageNode* makeAudioUsageTree()
 		UsageNode* pOpts = pRedNoise->add("<options>");
 		pOpts->add("-blocksize [n]=2048", "Specify the size of the blocks in which the audio is processed. [n] must be a power of 2.");
 		pOpts->add("-deviations [d]=2.5", "Specify the number of standard deviations from the noise mean to count as noise. Larger values will make it more aggressive at reducing noise, with more potential to disrupt the signal. Smaller (or negative) values can be used to make it less aggressive.");
+		pOpts->add("-threads [n]=1", "Specify the number of threads to use for processing blocks.");
 	}
 	{
 		UsageNode* pSan = pRoot->add("sanitize [in] [out] <options>", "Finds segments of quiet in the input wave file, and replaces them with complete silence.");
@@ -433,7 +437,7 @@ UsageNode* makeAudioUsageTree()
 		pSpec->add("[in]=in.wav", "The filename of an audio track in wav format.");
 		UsageNode* pOpts = pSpec->add("<options>");
 		pOpts->add("-start [pos]=0", "Specify the starting position in the wav file (in samples) to begin sampling.");
-		pOpts->add("-size [n]=4096", "Specify the number of samples to take. This will also be the width of the resulting histogram in pixels. [n] must be a power of 2.");
+		pOpts->add("-size [n]=4096", "Specify the number of samples to take. This will also be the width of the resulting histogram in pixels. Sizes whose only prime factors are 2, 3, and 5 are fastest.");
 		pOpts->add("-height [h]=512", "Specify the height of the chart in pixels.");
 		pOpts->add("-out [filename]=plot.ppm", "Specify the output filename of the PPM image that is generated.");
 	}
@@ -451,6 +455,31 @@ UsageNode* makeAudioUsageTree()
 
 
 
+UsageNode* makeBenchUsageTree()
+{
+	UsageNode* pRoot = new UsageNode("waffles_bench [command]", "Measure the speed of some core operations with synthetic data, and detect performance regressions.");
+	{
+		UsageNode* pRun = pRoot->add("run <options>", "Run the benchmarks, and print a JSON report of their times to stdout. (Progress is printed to stderr.) Each benchmark is run once to warm up, and then timed over several repetitions. The data is generated from a fixed seed, so reports made with the same options can be compared.");
+		UsageNode* pOpts = pRun->add("<options>");
+		pOpts->add("-filter [substring]", "Only run the benchmarks whose names contain the specified substring. This option may be given more than once.");
+		pOpts->add("-scale [factor]=1.0", "Multiply the size of each problem by the specified factor.");
+		pOpts->add("-reps [n]=5", "Specify the number of timed repetitions of each benchmark. The report gives the median, min, mean, and max.");
+		pOpts->add("-seed [value]=0", "Specify a seed for the random number generators that generate the data.");
+		pOpts->add("-out [filename]=bench.json", "Write the report to the specified file instead of stdout.");
+	}
+	{
+		UsageNode* pCompare = pRoot->add("compare <options> [baseline] [current]", "Compare two reports made by \"run\", and print a JSON comparison of the median times to stdout. Each regression is also printed to stderr, and the exit code is 2 if there are any. (It is 1 if there is an error.) Benchmarks in the baseline that are missing from the current report are listed in the comparison and printed to stderr.");
+		UsageNode* pOpts = pCompare->add("<options>");
+		pOpts->add("-threshold [portion]=0.1", "Flag a benchmark as a regression if its median time grew by more than this portion.");
+		pOpts->add("-floor [seconds]=0.0001", "Do not flag benchmarks whose current median is below this many seconds, since such short times are noisy.");
+		pCompare->add("[baseline]=before.json", "The filename of the report to compare against.");
+		pCompare->add("[current]=after.json", "The filename of the newer report.");
+	}
+	pRoot->add("list", "Print the names of the benchmarks.");
+	pRoot->add("usage", "Print usage information.");
+	return pRoot;
+}
+
 UsageNode* makeClusterUsageTree()
 {
 	UsageNode* pRoot = new UsageNode("waffles_cluster [command]", "Cluster data.");
@@ -614,7 +643,12 @@ UsageNode* makeCollaborativeFilterUsageTree()
 
 UsageNode* makeDimRedUsageTree()
 {
-	UsageNode* pRoot = new UsageNode("waffles_dimred [command]", "Reduce dimensionality, attribute selection, operations related to manifold learning, NLDR, etc.");
+	UsageNode* pRoot = new UsageNode("waffles_dimred <profile_opts> [command]", "Reduce dimensionality, attribute selection, operations related to manifold learning, NLDR, etc.");
+	{
+		UsageNode* pPO = pRoot->add("<profile_opts>", "These options may precede the command. They make the tool record where its time goes, and write a report when the command finishes.");
+		pPO->add("--profile [filename]=profile.json", "Write a summary of the time spent in each instrumented part of the code (with the number of calls, quantiles of their durations, and a histogram), along with some counts and distributions, to the specified JSON file. The times are in microseconds.");
+		pPO->add("--profile-trace [filename]=trace.json", "Write each timed call (up to a million of them) to the specified file in Chrome's trace-event format. It can be viewed in chrome://tracing or ui.perfetto.dev.");
+	}
 	{
 		UsageNode* pAS = pRoot->add("attributeselector [dataset] <data_opts> <options>", "Make a ranked list of attributes from most to least salient. The ranked list is printed to stdout. Attributes are zero-indexed.");
 		pAS->add("[dataset]=data.arff", "The filename of a dataset.");
@@ -625,6 +659,9 @@ UsageNode* makeDimRedUsageTree()
 		pOpts->add("-out [n] [filename]", "Save a dataset containing only the [n]-most salient features to [filename].");
 		pOpts->add("-seed [value]=0", "Specify a seed for the random number generator.");
 		pOpts->add("-labeldims [n]=1", "Specify the number of dimensions in the label (output) vector. The default is 1. (Don't confuse this with the number of class labels. It only takes one dimension to specify a class label, even if there are k possible labels.)");
+		pOpts->add("-ranker [method]=nn", "Specify how to rank the attributes. \"nn\" (the default) repeatedly trains a single-layer neural network and deselects the attribute with the smallest weights, one attribute per retraining. \"parallel\" trains the network on part of the data, measures how much the error on the rest grows when each attribute is replaced by its mean, and deselects a portion of the attributes in each round. \"mi\" ranks by mutual information with the labels, \"anova\" by the one-way ANOVA F statistic, and \"corr\" by the magnitude of the correlation. The last three score each attribute only once, so they are much faster with many attributes, and they are more reliable than the wrappers when there are many more attributes than rows.");
+		pOpts->add("-threads [n]=1", "Specify the number of threads to use for scoring the attributes. (This has no effect with \"-ranker nn\".)");
+		pOpts->add("-removeportion [value]=0.1", "Specify the portion of the remaining attributes to deselect in each round with \"-ranker parallel\". At least one attribute is deselected in each round.");
 	}
 	{
 		UsageNode* pBE = pRoot->add("blendembeddings [data-orig] [neighbor-finder] [data-a] [data-b] <options>", "Compute a blended \"average\" embedding from two reduced-dimensionality embeddings of some data.");
@@ -679,6 +716,9 @@ UsageNode* makeDimRedUsageTree()
 	    pOpts->add("-seed [integer]",
 		       "Seed the random number generator with integer to "
 		       "obtain reproducible results");
+	    pOpts->add("-threads [n]=1",
+		       "Use n threads to find the best matching nodes for "
+		       "the training points and to update the node weights.");
 	    pOpts->add("-neighborhood [gaussian|uniform]",
 		       "Use the specified neighborhood type to determine the "
 		       "influence of a node on its neighbors.");
@@ -1003,9 +1043,20 @@ UsageNode* makeGenerateUsageTree()
 
 UsageNode* makeLearnUsageTree()
 {
-	UsageNode* pRoot = new UsageNode("waffles_learn [command]", "Supervised learning, transduction, cross-validation, etc.");
+	UsageNode* pRoot = new UsageNode("waffles_learn <profile_opts> [command]", "Supervised learning, transduction, cross-validation, etc.");
 	{
-		UsageNode* pAT = pRoot->add("autotune [dataset] <data_opts> [algname]", "Use cross-validation to automatically determine a good set of parameters for the specified algorithm with the specified data. The selected parameters are printed to stdout.");
+		UsageNode* pPO = pRoot->add("<profile_opts>", "These options may precede the command. They make the tool record where its time goes, and write a report when the command finishes.");
+		pPO->add("--profile [filename]=profile.json", "Write a summary of the time spent in each instrumented part of the code (with the number of calls, quantiles of their durations, and a histogram), along with some counts and distributions, to the specified JSON file. The times are in microseconds.");
+		pPO->add("--profile-trace [filename]=trace.json", "Write each timed call (up to a million of them) to the specified file in Chrome's trace-event format. It can be viewed in chrome://tracing or ui.perfetto.dev.");
+	}
+	{
+		UsageNode* pAT = pRoot->add("autotune <options> [dataset] <data_opts> [algname]", "Use cross-validation to automatically determine a good set of parameters for the specified algorithm with the specified data. The selected parameters are printed to stdout.");
+		UsageNode* pOpts = pAT->add("<options>");
+		pOpts->add("-threads [n]=1", "Evaluate the cross-validation folds of each candidate set of parameters with up to [n] threads. (With -hyperband, this is the number of candidates to evaluate at the same time.)");
+		pOpts->add("-hyperband [max_budget]=27", "Instead of the model's own tuning procedure, search with Hyperband, which evaluates many random sets of parameters with small portions of the training data, and only gives more data to the most promising ones. [max_budget] is the ratio between the largest and smallest portions. 30% of the data is held out for validation. Supported for decisiontree, knn, naivebayes, naiveinstance, and neuralnet.");
+		pOpts->add("-eta [n]=3", "With -hyperband, keep the best 1/[n] of the candidates in each round, and give them [n] times more data.");
+		pOpts->add("-checkpoint [filename]=sweep.json", "Record the seed and every finished evaluation in this file, one JSON object per line (and imply -hyperband). If the file already exists, the evaluations it records are not repeated, so an interrupted search can be resumed by running the same command again. (The recorded seed is used, so -seed need not be specified again.)");
+		pOpts->add("-seed [value]=0", "Specify a seed for the random number generator used by -hyperband.");
 		pAT->add("[dataset]=train.arff", "The filename of a dataset.");
 		UsageNode* pDO = pAT->add("<data_opts>");
 		pDO->add("-labels [attr_list]=0", "Specify which attributes to use as labels. (If not specified, the default is to use the last attribute for the label.) [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a"
@@ -1035,6 +1086,35 @@ UsageNode* makeLearnUsageTree()
 		pDO->add("-ignore [attr_list]=0", "Specify attributes to ignore. [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a range of columns. "
 			"A '*' preceding a value means to index from the right instead of the left. For example, \"0,2-5\" refers to columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
 	}
+	{
+		UsageNode* pPS = pRoot->add("paramserver <options> [dataset] <data_opts> neuralnet <nn_options>", "Coordinates data-parallel training of a neural network by several \"paramworker\" processes. Each worker trains with its own shard of the data, and after each round it sends the change in its weights to this server, which adds the average change to the master weights and sends them back. The trained model-file is printed to stdout. (The data must be continuous, and it should already be normalized.)");
+		UsageNode* pOpts = pPS->add("<options>");
+		pOpts->add("-seed [value]=0", "Specify a seed for the random number generator. (It determines the initial weights.)");
+		pOpts->add("-port [n]=9393", "Specify the TCP port on which to listen for workers.");
+		pOpts->add("-workers [n]=2", "Specify the number of workers to wait for.");
+		pOpts->add("-rounds [n]=10", "Specify the number of rounds each worker will perform.");
+		pOpts->add("-staleness [n]=0", "Specify how many rounds a worker may get ahead of the slowest worker. 0 makes training synchronous, so every worker begins each round with the same weights.");
+		pOpts->add("-timeout [seconds]=600", "Give up if no message arrives from a worker for this long.");
+		pPS->add("[dataset]=train.arff", "The filename of a dataset with the same columns as the shards the workers will use. (It is only used to determine the shape of the model.)");
+		UsageNode* pDO = pPS->add("<data_opts>");
+		pDO->add("-labels [attr_list]=0", "Specify which attributes to use as labels. (If not specified, the default is to use the last attribute for the label.) [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a range of columns.  A '*' preceding a value means to index from the right instead of the left. For example, \"0,2-5\" refers to columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
+		pDO->add("-ignore [attr_list]=0", "Specify attributes to ignore. [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a range of columns.  A '*' preceding a value means to index from the right instead of the left. For example, \"0,2-5\" refers to columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
+		pPS->add("<nn_options>", "The same options that the \"neuralnet\" algorithm accepts. The workers must be given the same layers.");
+	}
+	{
+		UsageNode* pPW = pRoot->add("paramworker <options> [host] [dataset] <data_opts> neuralnet <nn_options>", "Trains a neural network with a shard of the data, in coordination with a \"paramserver\" process.");
+		UsageNode* pOpts = pPW->add("<options>");
+		pOpts->add("-seed [value]=0", "Specify a seed for the random number generator. (It determines the order in which the rows are presented.)");
+		pOpts->add("-port [n]=9393", "Specify the TCP port of the server.");
+		pOpts->add("-epochs [n]=1", "Specify the number of passes over the shard in each round.");
+		pOpts->add("-timeout [seconds]=600", "Give up if no message arrives from the server for this long.");
+		pPW->add("[host]=localhost", "The name or address of the machine on which the server is running.");
+		pPW->add("[dataset]=shard1.arff", "The filename of this worker's shard of the training data.");
+		UsageNode* pDO = pPW->add("<data_opts>");
+		pDO->add("-labels [attr_list]=0", "Specify which attributes to use as labels. (If not specified, the default is to use the last attribute for the label.) [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a range of columns.  A '*' preceding a value means to index from the right instead of the left. For example, \"0,2-5\" refers to columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
+		pDO->add("-ignore [attr_list]=0", "Specify attributes to ignore. [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a range of columns.  A '*' preceding a value means to index from the right instead of the left. For example, \"0,2-5\" refers to columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
+		pPW->add("<nn_options>", "The same options that the \"neuralnet\" algorithm accepts. They must specify the same layers as the server's.");
+	}
 	{
 		UsageNode* pPredict = pRoot->add("predict <options> [model-file] [dataset] <data_opts>", "Predict labels for all of the patterns in [dataset]. Results are printed in the form of a \".arff\" file (including both features and predictions) to stdout.");
 		UsageNode* pOpts = pPredict->add("<options>");
@@ -1114,6 +1194,7 @@ UsageNode* makeLearnUsageTree()
 		pOpts->add("-reps [value]=5", "Specify the number of repetitions to perform. If not specified, the default is 5.");
 		pOpts->add("-folds [value]=2", "Specify the number of folds to use. If not specified, the default is 2.");
 		pOpts->add("-succinct", "Just report the average mean squared error. Do not report results at each fold.");
+		pOpts->add("-threads [n]=1", "Train and test up to [n] folds (from any of the repetitions) at the same time. Each thread uses its own copy of the model. With two or more threads, the results for a given seed do not depend on the number of threads.");
 		pCV->add("[dataset]=data.arff", "The filename of a dataset.");
 		UsageNode* pDO = pCV->add("<data_opts>");
 		pDO->add("-labels [attr_list]=0", "Specify which attributes to use as labels. (If not specified, the default is to use the last attribute for the label.) [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a range of columns.  A '*' preceding a value means to index from the right instead of the left. For example, \"0,2-5\" refers to columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
@@ -1144,6 +1225,14 @@ UsageNode* makeLearnUsageTree()
 					" columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
 		pDO->add("-ignore [attr_list]=0", "Specify attributes to ignore. [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a range of columns.  A '*' preceding a value means to index from the right instead of the left. For example, \"0,2-5\" refers to columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
 	}
+	{
+		UsageNode* pQ = pRoot->add("quantize [model-file] [dataset] <data_opts>", "Replaces the layers of a trained neural network with 8-bit approximations, which make the model-file several times smaller and make predictions faster, usually at the cost of a small loss of accuracy. The quantized model can be used for prediction, but it can no longer be trained. The quantized model-file is printed to stdout.");
+		pQ->add("[model-file]=model.json", "The filename of a trained model that contains a neural network. (It may be wrapped in filters, such as the ones that \"train\" adds automatically.)");
+		pQ->add("[dataset]=calibrate.arff", "The filename of a dataset that is representative of the data the model will be asked to predict. It is used to calibrate the range of the values that feed into each layer. (Values outside this range are clipped.) The labels are ignored.");
+		UsageNode* pDO = pQ->add("<data_opts>");
+		pDO->add("-labels [attr_list]=0", "Specify which attributes to use as labels. (If not specified, the default is to use the last attribute for the label.) [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a range of columns.  A '*' preceding a value means to index from the right instead of the left. For example, \"0,2-5\" refers to columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
+		pDO->add("-ignore [attr_list]=0", "Specify attributes to ignore. [attr_list] is a comma-separated list of zero-indexed columns. A hypen may be used to specify a range of columns.  A '*' preceding a value means to index from the right instead of the left. For example, \"0,2-5\" refers to columns 0, 2, 3, 4, and 5. \"*0\" refers to the last column. \"0-*1\" refers to all but the last column.");
+	}
 /*	{
 		UsageNode* pTR = pRoot->add("trainrecurrent <options> [method] [obs-data] [action-data] [context-dims] [algorithm] [algorithm]", "Train a recurrent model of a dynamical system with the specified training [method]. The training data is specified by [obs-data], which specifies the sequence of observations, and [action-data], which specifies the sequence of actions. "
 			"[context-dims] specifies the number of dimensions in the state-space of the system. The two algorithms specify the two functions of a model of a dynamical system. The first [algorithm] models the transition function. The second [algorithm] models the observation function.");
@@ -1397,7 +1486,12 @@ UsageNode* makePlotUsageTree()
 
 UsageNode* makeRecommendUsageTree()
 {
-	UsageNode* pRoot = new UsageNode("waffles_recommend [command]", "Predict missing values in data, and test collaborative-filtering recommendation systems.");
+	UsageNode* pRoot = new UsageNode("waffles_recommend <profile_opts> [command]", "Predict missing values in data, and test collaborative-filtering recommendation systems.");
+	{
+		UsageNode* pPO = pRoot->add("<profile_opts>", "These options may precede the command. They make the tool record where its time goes, and write a report when the command finishes.");
+		pPO->add("--profile [filename]=profile.json", "Write a summary of the time spent in each instrumented part of the code (with the number of calls, quantiles of their durations, and a histogram), along with some counts and distributions, to the specified JSON file. The times are in microseconds.");
+		pPO->add("--profile-trace [filename]=trace.json", "Write each timed call (up to a million of them) to the specified file in Chrome's trace-event format. It can be viewed in chrome://tracing or ui.perfetto.dev.");
+	}
 	{
 		UsageNode* pCV = pRoot->add("crossvalidate <options> [3col-data] [collab-filter]", "Measure accuracy using cross-validation. Prints MSE and MAE to stdout.");
 		UsageNode* pOpts = pCV->add("<options>");
@@ -1460,6 +1554,8 @@ UsageNode* makeSparseUsageTree()
 		pOpts->add("-binary", "Just use the value 1 if the word occurs in a document, or a 0 if it does not occur. The default behavior is to compute the somewhat more meaningful value: a/b*log(c/d), where a=the number of times the word occurs in this document, b=the max number of times this word occurs in any document, c=total number of documents, and d=number of documents that contain this word.");
 		pOpts->add("-out [features-filename] [labels-filename]", "Specify the filenames for the sparse feature matrix and the dense labels matrix. Note that if only one folder of documents is provided, then [labels-filename] will be ignored (since all documents come from the same folder/class), but a bogus filename must be provided for it anyway.");
 		pOpts->add("-vocabfile [filename]=vocab.txt", "Save the vocabulary of words to the specified file. The default is to not save the list of words. Note that the words will be stemmed (unless -nostem was specified), so it is normal for many of them to appear misspelled.");
+		pOpts->add("-threads [n]=1", "Specify the number of threads to use. The documents are tokenized and stemmed concurrently, and the results do not depend on the number of threads.");
+		pOpts->add("-hash [buckets]=1048576", "Use the hashing trick instead of building a vocabulary. Each word is mapped to one of [buckets] columns by a hash of its stem, and only one pass is made over the documents. Each occurrence of a word adds 1 (instead of the weight described for -binary). This cannot be used with -vocabfile.");
 	}
 	{
 		UsageNode* pFPC = pRoot->add("fpc [sparse-matrix] [k]", "Computes the first [k] principal components of [sparse-matrix] and prints the results as a [k]-row dense matrix in ARFF format.");
@@ -1689,6 +1785,8 @@ UsageNode* makeTransformUsageTree()
 		pOpts->add("-time [attr] [format]", "Specify that a particular attribute is a date or time stamp in a particular format. Example format: \"YYYY-MM-DD hh:mm:ss\".");
 		pOpts->add("-nominal [attr]=0", "Indiciate that the specified attribute should be treated as nominal.");
 		pOpts->add("-real [attr]=0", "Indiciate that the specified attribute should be treated as real.");
+		pOpts->add("-threads [n]=1", "Use n threads to parse the file. (The results are the same as with one thread.)");
+		pOpts->add("-stream", "Read the file in blocks, and print each row as soon as it is parsed, so the whole file never needs to fit in memory. (The file is read twice: once to determine the meta-data, and again to convert the rows.)");
 	}
 	{
 		UsageNode* pEV = pRoot->add("enumeratevalues [dataset] [col]", "Enumerates all of the unique values in the specified column, and replaces each value with its enumeration. (For example, if you have a column that contains the social-security-number of each user, this will change them to numbers from 0 to n-1, where n is the number of unique users.)");
@@ -71,6 +71,7 @@ UsageNode* makeMasterUsageTree();
 
 UsageNode* makeAlgorithmUsageTree();
 UsageNode* makeAudioUsageTree();
+UsageNode* makeBenchUsageTree();
 UsageNode* makeClusterUsageTree();
 UsageNode* makeDimRedUsageTree();
 UsageNode* makeCollaborativeFilterUsageTree();
@@ -35,19 +35,21 @@ using namespace GClasses;
 using std::cerr;
 using std::cout;
 using std::string;
+using std::vector;
 
 // pow(2.0, 1.0 / 12.0)
 #define HALF_STEP_FACTOR 1.05946309435929526456182529494634170077920431749419
 
-class AmbientNoiseReducer : public GFourierWaveProcessor
+class AmbientNoiseReducer : public GFourierWaveProcessor, public GWaveBlockHandler
 {
 protected:
 	double m_deviations;
 	size_t m_noiseBlocks;
+	size_t m_noiseRemaining;
 	struct ComplexNumber* m_pNoise;
 
 public:
-	AmbientNoiseReducer(GWave& noise, size_t blockSize, double deviations)
+	AmbientNoiseReducer(GWaveReader& noise, size_t blockSize, double deviations)
 	: GFourierWaveProcessor(blockSize), m_deviations(deviations)
 	{
 		if(noise.channels() != 1)
@@ -56,17 +58,11 @@ public:
 		m_noiseBlocks = 0;
 
 		// Analyze the noise
-		GWaveIterator itNoise(noise);
-		if(itNoise.remaining() < m_blockSize * 8)
+		if(noise.frames() < m_blockSize * 8)
 			throw Ex("Not enough noise to analyze");
-		for(size_t i = 0; i < m_blockSize; i++)
-			itNoise.advance(); // skip a little bit from the beginning
-		while(itNoise.remaining() > m_blockSize * 2)
-		{
-			encodeBlock(itNoise, m_pBufA, 0);
-			GFourier::fft(m_blockSize, m_pBufA, true);
-			analyzeNoise(m_pBufA);
-		}
+		noise.seek(m_blockSize); // skip a little bit from the beginning
+		m_noiseRemaining = noise.frames() - m_blockSize;
+		noise.readBlocks(m_blockSize, *this);
 	}
 
 	virtual ~AmbientNoiseReducer()
@@ -74,6 +70,22 @@ public:
 		delete[] m_pNoise;
 	}
 
+	virtual void onBlock(const double* pSamples, size_t frames)
+	{
+		// Stop analyzing the noise when two blocks or fewer remain
+		bool analyze = (m_noiseRemaining > m_blockSize * 2);
+		m_noiseRemaining -= std::min(m_noiseRemaining, frames);
+		if(!analyze)
+			return;
+		for(size_t i = 0; i < m_blockSize; i++)
+		{
+			m_pBufA[i].real = pSamples[i];
+			m_pBufA[i].imag = 0.0;
+		}
+		m_plan.transform(m_pBufA, true);
+		analyzeNoise(m_pBufA);
+	}
+
 protected:
 	void analyzeNoise(struct ComplexNumber* pBuf)
 	{
@@ -129,7 +141,6 @@ class PitchShifter : public GFourierWaveProcessor
 protected:
 	double m_halfSteps;
 	double m_fac;
-	struct ComplexNumber* m_pBuf;
 
 public:
 	// If halfSteps is positive, it will shift the pitch up.
@@ -138,19 +149,18 @@ public:
 	: GFourierWaveProcessor(blockSize)
 	{
 		m_fac = pow(2.0, -halfSteps / 12);
-		m_pBuf = new struct ComplexNumber[m_blockSize];
 	}
 
 	virtual ~PitchShifter()
 	{
-		delete(m_pBuf);
 	}
 
 protected:
 	virtual void process(struct ComplexNumber* pBuf)
 	{
+		// (This is called from several threads at once, so the output buffer cannot be shared.)
+		GTEMPBUF(struct ComplexNumber, pOut, m_blockSize);
 		struct ComplexNumber* pIn = pBuf;
-		struct ComplexNumber* pOut = m_pBuf;
 
 		for(size_t i = 0; i < m_blockSize / 2; i++)
 		{
@@ -178,7 +188,7 @@ protected:
 				pOut[m_blockSize - i].real = 0.0;
 			}
 		}
-		memcpy(pBuf, m_pBuf, sizeof(struct ComplexNumber) * m_blockSize);
+		memcpy(pBuf, pOut, sizeof(struct ComplexNumber) * m_blockSize);
 	}
 };
 
@@ -352,10 +362,13 @@ void pitchShift(GArgReader& args)
 
 	// Parse params
 	size_t blockSize = 2048;
+	size_t threads = 1;
 	while(args.next_is_flag())
 	{
 		if(args.if_pop("-blocksize"))
 			blockSize = args.pop_uint();
+		else if(args.if_pop("-threads"))
+			threads = args.pop_uint();
 		else
 			throw Ex("Unrecognized option: ", args.pop_string());
 	}
@@ -363,11 +376,12 @@ void pitchShift(GArgReader& args)
 		throw Ex("the block size must be a power of 2");
 
 	// Shift pitch
-	GWave wSignal;
-	wSignal.load(inputFilename);
+	GWaveReader in(inputFilename);
+	GWaveWriter out(outputFilename, in.bitsPerSample(), in.channels(), in.sampleRate());
 	PitchShifter ps(blockSize, halfSteps);
-	ps.reduce(wSignal);
-	wSignal.save(outputFilename);
+	ps.setWorkerThreads(threads);
+	ps.reduce(in, out);
+	out.close();
 }
 
 void reduceAmbientNoise(GArgReader& args)
@@ -379,25 +393,28 @@ void reduceAmbientNoise(GArgReader& args)
 	// Parse params
 	size_t blockSize = 2048;
 	double deviations = 2.5;
+	size_t threads = 1;
 	while(args.next_is_flag())
 	{
 		if(args.if_pop("-blocksize"))
 			blockSize = args.pop_uint();
 		else if(args.if_pop("-deviations"))
 			deviations = args.pop_double();
+		else if(args.if_pop("-threads"))
+			threads = args.pop_uint();
 		else
 			throw Ex("Unrecognized option: ", args.pop_string());
 	}
 	if(!GBits::isPowerOfTwo((unsigned int)blockSize))
 		throw Ex("the block size must be a power of 2");
 
-	GWave wNoise;
-	wNoise.load(noiseFilename);
-	GWave wSignal;
-	wSignal.load(signalFilename);
-	AmbientNoiseReducer denoiser(wNoise, blockSize, deviations);
-	denoiser.reduce(wSignal);
-	wSignal.save(outputFilename);
+	GWaveReader noise(noiseFilename);
+	AmbientNoiseReducer denoiser(noise, blockSize, deviations);
+	denoiser.setWorkerThreads(threads);
+	GWaveReader in(signalFilename);
+	GWaveWriter out(outputFilename, in.bitsPerSample(), in.channels(), in.sampleRate());
+	denoiser.reduce(in, out);
+	out.close();
 }
 
 void sanitize(GArgReader& args)
@@ -488,28 +505,30 @@ void spectral(GArgReader& args)
 		else
 			throw Ex("Unrecognized option: ", args.pop_string());
 	}
-	if(!GBits::isPowerOfTwo((unsigned int)size))
-		throw Ex("the size must be a power of 2");
+	if(size < 2)
+		throw Ex("the size must be at least 2");
 
 	// Convert to the Fourier domain
-	GWave w;
-	w.load(filename);
-	GWaveIterator it(w);
-	if(it.remaining() < start + size)
+	GWaveReader w(filename);
+	if(w.frames() < start + size)
 		throw Ex("out of range. (start + size > samples)");
-	for(size_t i = 0; i < start; i++)
-		it.advance();
+	w.seek(start);
+	vector<double> frames(size * w.channels());
+	w.read(frames.data(), size);
+	vector<double> samples(size);
+	for(size_t i = 0; i < size; i++)
+		samples[i] = frames[i * w.channels()]; // the first channel
 	struct ComplexNumber* pCN = new struct ComplexNumber[size];
 	ArrayHolder<struct ComplexNumber> hCN(pCN);
-	struct ComplexNumber* p = pCN;
-	for(size_t i = 0; i < size; i++)
+	GFftRealPlan plan(size);
+	plan.forward(samples.data(), pCN);
+	for(size_t i = size / 2 + 1; i < size; i++)
 	{
-		p->real = *it.current();
-		p->imag = 0.0;
-		p++;
-		it.advance();
+		// The rest of the spectrum of a real signal mirrors the first half
+		pCN[i].real = pCN[size - i].real;
+		pCN[i].imag = -pCN[size - i].imag;
 	}
-	GFourier::fft(size, pCN, true);
+	struct ComplexNumber* p;
 
 	// Find the max Fourier magnitude
 	p = pCN;
@@ -0,0 +1,859 @@
+/*
+  The contents of this file are dedicated by all of its authors, including
+
+    Michael S. Gashler,
+    anonymous contributors,
+
+  to the public domain (http://creativecommons.org/publicdomain/zero/1.0/).
+
+  Note that some moral obligations still exist in the absence of legal ones.
+  For example, it would still be dishonest to deliberately misrepresent the
+  origin of a work. Although we impose no legal requirements to obtain a
+  license, it is beseeming for those who build on the works of others to
+  give back useful improvements, or pay it forward in their own field. If
+  you would like to cite us, a published paper about Waffles can be found
+  at http://jmlr.org/papers/volume12/gashler11a/gashler11a.pdf. If you find
+  our code to be useful, the Waffles team would love to hear how you use it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../GClasses/GApp.h"
+#include "../GClasses/GError.h"
+#include "../GClasses/GDom.h"
+#include "../GClasses/GFile.h"
+#include "../GClasses/GHolders.h"
+#include "../GClasses/GMatrix.h"
+#include "../GClasses/GVec.h"
+#include "../GClasses/GRand.h"
+#include "../GClasses/GTime.h"
+#include "../GClasses/GNeighborFinder.h"
+#include "../GClasses/GDecisionTree.h"
+#include "../GClasses/GNeuralNet.h"
+#include "../GClasses/GLayer.h"
+#include "../GClasses/GRecommender.h"
+#include "../GClasses/GFourier.h"
+#include "../GClasses/GKeyPair.h"
+#include "../GClasses/GBigInt.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <exception>
+#include "../GClasses/usage.h"
+
+using namespace GClasses;
+using std::cout;
+using std::cerr;
+using std::string;
+using std::vector;
+using std::ostringstream;
+
+// Results are accumulated here so the compiler cannot discard the work being timed
+volatile double g_sink = 0.0;
+
+size_t scaled(size_t n, double scale)
+{
+	return std::max((size_t)1, (size_t)(n * scale + 0.5));
+}
+
+void fillUniform(GMatrix& m, GRand& rand)
+{
+	for(size_t i = 0; i < m.rows(); i++)
+		m[i].fillUniform(rand);
+}
+
+// Makes a regression problem with a nonlinear target
+void makeRegressionData(GMatrix& features, GMatrix& labels, size_t rows, size_t featureCount, size_t labelCount, GRand& rand)
+{
+	features.resize(rows, featureCount);
+	labels.resize(rows, labelCount);
+	fillUniform(features, rand);
+	for(size_t i = 0; i < rows; i++)
+	{
+		for(size_t j = 0; j < labelCount; j++)
+		{
+			double d = 0.0;
+			for(size_t k = 0; k < featureCount; k++)
+				d += sin((double)(j + k + 1) * features[i][k]);
+			labels[i][j] = d / featureCount + 0.01 * rand.normal();
+		}
+	}
+}
+
+
+/// The base class of the benchmarks. prepare generates the data (and is not timed).
+/// run performs the operation being measured, and may be called several times.
+class Benchmark
+{
+public:
+	virtual ~Benchmark() {}
+
+	/// Returns the name that identifies this benchmark in reports.
+	virtual const char* name() = 0;
+
+	/// Generates the data. scale multiplies the size of the problem.
+	virtual void prepare(GRand& rand, double scale) = 0;
+
+	/// Returns a description of the size of the problem.
+	virtual string size() = 0;
+
+	/// Performs the operation once.
+	virtual void run() = 0;
+};
+
+
+class MatrixMultiplyBenchmark : public Benchmark
+{
+protected:
+	GMatrix m_a, m_b;
+
+public:
+	virtual const char* name() { return "matrix_multiply"; }
+	virtual void prepare(GRand& rand, double scale)
+	{
+		size_t n = scaled(200, scale);
+		m_a.resize(n, n);
+		m_b.resize(n, n);
+		fillUniform(m_a, rand);
+		fillUniform(m_b, rand);
+	}
+	virtual string size() { return to_str(m_a.rows()) + "x" + to_str(m_a.cols()); }
+	virtual void run()
+	{
+		GMatrix* pC = GMatrix::multiply(m_a, m_b, false, false);
+		g_sink = g_sink + (*pC)[0][0];
+		delete(pC);
+	}
+};
+
+
+class MatrixSvdBenchmark : public Benchmark
+{
+protected:
+	GMatrix m_a;
+
+public:
+	virtual const char* name() { return "matrix_svd"; }
+	virtual void prepare(GRand& rand, double scale)
+	{
+		m_a.resize(scaled(150, scale), scaled(100, scale));
+		fillUniform(m_a, rand);
+	}
+	virtual string size() { return to_str(m_a.rows()) + "x" + to_str(m_a.cols()); }
+	virtual void run()
+	{
+		GMatrix* pU;
+		double* pDiag;
+		GMatrix* pV;
+		m_a.singularValueDecomposition(&pU, &pDiag, &pV);
+		g_sink = g_sink + pDiag[0];
+		delete(pU);
+		delete[] pDiag;
+		delete(pV);
+	}
+};
+
+
+class MatrixEigsBenchmark : public Benchmark
+{
+protected:
+	GMatrix m_a;
+	GRand* m_pRand;
+
+public:
+	virtual const char* name() { return "matrix_eigs"; }
+	virtual void prepare(GRand& rand, double scale)
+	{
+		m_pRand = &rand;
+		size_t n = scaled(200, scale);
+		GMatrix b(n, n);
+		fillUniform(b, rand);
+		GMatrix* pSym = GMatrix::multiply(b, b, true, false); // symmetric
+		m_a.copy(pSym);
+		delete(pSym);
+	}
+	virtual string size() { return to_str(m_a.rows()) + "x" + to_str(m_a.cols()) + ", 10 eigenvectors"; }
+	virtual void run()
+	{
+		GVec vals;
+		GMatrix* pVecs = m_a.eigs(10, vals, m_pRand, true);
+		g_sink = g_sink + vals[0];
+		delete(pVecs);
+	}
+};
+
+
+class VecKernelsBenchmark : public Benchmark
+{
+protected:
+	GVec m_a, m_b;
+
+public:
+	virtual const char* name() { return "vec_kernels"; }
+	virtual void prepare(GRand& rand, double scale)
+	{
+		size_t n = scaled(100000, scale);
+		m_a.resize(n);
+		m_b.resize(n);
+		m_a.fillUniform(rand);
+		m_b.fillUniform(rand);
+	}
+	virtual string size() { return to_str(m_a.size()) + " elements, 20 passes"; }
+	virtual void run()
+	{
+		double d = 0.0;
+		for(size_t i = 0; i < 5; i++)
+		{
+			d += m_a.dotProduct(m_b);
+			d += m_a.squaredDistance(m_b);
+			m_a.addScaled(0.5, m_b);
+			m_a *= 0.5;
+		}
+		g_sink = g_sink + d;
+	}
+};
+
+
+/// Times either building a neighbor finder, or querying one that has already been built.
+class NeighborBenchmark : public Benchmark
+{
+protected:
+	string m_name;
+	int m_type; // 0=brute force, 1=kd-tree, 2=ball tree
+	bool m_build;
+	GMatrix m_points;
+	GMatrix m_queries;
+	std::unique_ptr<GNeighborFinderGeneralizing> m_pFinder;
+
+public:
+	NeighborBenchmark(int type, bool build)
+	: m_type(type), m_build(build)
+	{
+		m_name = type == 0 ? "neighbors_bruteforce" : (type == 1 ? "neighbors_kdtree" : "neighbors_balltree");
+		m_name += build ? "_build" : "_query";
+	}
+
+	virtual const char* name() { return m_name.c_str(); }
+
+	virtual void prepare(GRand& rand, double scale)
+	{
+		m_points.resize(scaled(5000, scale), 8);
+		fillUniform(m_points, rand);
+		m_queries.resize(scaled(500, scale), 8);
+		fillUniform(m_queries, rand);
+		if(!m_build)
+			m_pFinder.reset(build());
+	}
+
+	virtual string size()
+	{
+		string s = to_str(m_points.rows()) + " points, " + to_str(m_points.cols()) + " dims";
+		if(!m_build)
+			s += ", " + to_str(m_queries.rows()) + " queries, k=10";
+		return s;
+	}
+
+	GNeighborFinderGeneralizing* build()
+	{
+		if(m_type == 0)
+			return new GBruteForceNeighborFinder(&m_points, 10);
+		else if(m_type == 1)
+			return new GKdTree(&m_points, 10);
+		else
+			return new GBallTree(&m_points, 10);
+	}
+
+	virtual void run()
+	{
+		if(m_build)
+		{
+			GNeighborFinder* pFinder = build();
+			g_sink = g_sink + (double)pFinder->neighborCount();
+			delete(pFinder);
+		}
+		else
+		{
+			size_t sum = 0;
+			for(size_t i = 0; i < m_queries.rows(); i++)
+				sum += m_pFinder->findNeighbors(m_queries[i]);
+			g_sink = g_sink + (double)sum;
+		}
+	}
+};
+
+
+/// Times either training a tree-based model, or predicting with one that has already been trained.
+class TreeBenchmark : public Benchmark
+{
+protected:
+	string m_name;
+	bool m_forest;
+	bool m_train;
+	GMatrix m_features, m_labels;
+	std::unique_ptr<GSupervisedLearner> m_pModel;
+
+public:
+	TreeBenchmark(bool forest, bool train)
+	: m_forest(forest), m_train(train)
+	{
+		m_name = forest ? "randomforest" : "decisiontree";
+		m_name += train ? "_train" : "_predict";
+	}
+
+	virtual const char* name() { return m_name.c_str(); }
+
+	GSupervisedLearner* makeModel()
+	{
+		if(m_forest)
+			return new GRandomForest(30);
+		else
+			return new GDecisionTree();
+	}
+
+	virtual void prepare(GRand& rand, double scale)
+	{
+		makeRegressionData(m_features, m_labels, scaled(2000, scale), 10, 1, rand);
+		if(!m_train)
+		{
+			m_pModel.reset(makeModel());
+			m_pModel->train(m_features, m_labels);
+		}
+	}
+
+	virtual string size()
+	{
+		string s = to_str(m_features.rows()) + "x" + to_str(m_features.cols());
+		if(m_forest)
+			s += ", 30 trees";
+		return s;
+	}
+
+	virtual void run()
+	{
+		if(m_train)
+		{
+			GSupervisedLearner* pModel = makeModel();
+			pModel->train(m_features, m_labels);
+			delete(pModel);
+		}
+		else
+		{
+			GVec pred(1);
+			double sum = 0.0;
+			for(size_t i = 0; i < m_features.rows(); i++)
+			{
+				m_pModel->predict(m_features[i], pred);
+				sum += pred[0];
+			}
+			g_sink = g_sink + sum;
+		}
+	}
+};
+
+
+class NeuralNetEpochBenchmark : public Benchmark
+{
+protected:
+	GMatrix m_features, m_labels;
+	GNeuralNet m_nn;
+
+public:
+	virtual const char* name() { return "neuralnet_epoch"; }
+	virtual void prepare(GRand& rand, double scale)
+	{
+		makeRegressionData(m_features, m_labels, scaled(2000, scale), 16, 4, rand);
+		m_nn.addLayer(new GLayerClassic(FLEXIBLE_SIZE, 64));
+		m_nn.addLayer(new GLayerClassic(64, FLEXIBLE_SIZE));
+		m_nn.rand().setSeed(rand.next());
+		m_nn.beginIncrementalLearning(m_features, m_labels);
+	}
+	virtual string size() { return to_str(m_features.rows()) + " rows, 16-64-4"; }
+	virtual void run()
+	{
+		for(size_t i = 0; i < m_features.rows(); i++)
+			m_nn.trainIncremental(m_features[i], m_labels[i]);
+	}
+};
+
+
+class MatrixFactorizationEpochBenchmark : public Benchmark
+{
+protected:
+	GMatrix m_ratings;
+	std::unique_ptr<GMatrixFactorization> m_pMF;
+
+public:
+	virtual const char* name() { return "matrixfactorization_epoch"; }
+	virtual void prepare(GRand& rand, double scale)
+	{
+		size_t users = scaled(500, scale);
+		size_t items = scaled(200, scale);
+		size_t ratings = scaled(20000, scale);
+		m_ratings.resize(ratings, 3);
+		for(size_t i = 0; i < ratings; i++)
+		{
+			m_ratings[i][0] = (double)rand.next(users);
+			m_ratings[i][1] = (double)rand.next(items);
+			m_ratings[i][2] = rand.uniform();
+		}
+		m_pMF.reset(new GMatrixFactorization(8));
+		m_pMF->initProfiles(users, items);
+	}
+	virtual string size() { return to_str(m_ratings.rows()) + " ratings, rank 8"; }
+	virtual void run()
+	{
+		m_pMF->trainEpoch(m_ratings, 0.01);
+	}
+};
+
+
+/// Times parsing or serializing a dataset as ARFF or as JSON.
+class SerializationBenchmark : public Benchmark
+{
+protected:
+	string m_name;
+	bool m_json;
+	bool m_parse;
+	GMatrix m_data;
+	string m_text;
+
+public:
+	SerializationBenchmark(bool json, bool parse)
+	: m_json(json), m_parse(parse)
+	{
+		m_name = json ? "json" : "arff";
+		m_name += parse ? "_parse" : "_serialize";
+	}
+
+	virtual const char* name() { return m_name.c_str(); }
+
+	virtual void prepare(GRand& rand, double scale)
+	{
+		m_data.resize(scaled(5000, scale), 20);
+		fillUniform(m_data, rand);
+		m_text = serialize();
+	}
+
+	virtual string size() { return to_str(m_data.rows()) + "x" + to_str(m_data.cols()) + ", " + to_str(m_text.length()) + " bytes"; }
+
+	string serialize()
+	{
+		ostringstream oss;
+		if(m_json)
+		{
+			GDom doc;
+			doc.setRoot(m_data.serialize(&doc));
+			doc.writeJson(oss);
+		}
+		else
+			m_data.print(oss);
+		return oss.str();
+	}
+
+	virtual void run()
+	{
+		if(m_parse)
+		{
+			if(m_json)
+			{
+				GDom doc;
+				doc.parseJson(m_text.c_str(), m_text.length());
+				GMatrix m(doc.root());
+				g_sink = g_sink + m[0][0];
+			}
+			else
+			{
+				GMatrix m;
+				m.parseArff(m_text.c_str(), m_text.length());
+				g_sink = g_sink + m[0][0];
+			}
+		}
+		else
+			g_sink = g_sink + (double)serialize().length();
+	}
+};
+
+
+class FftBenchmark : public Benchmark
+{
+protected:
+	string m_name;
+	size_t m_baseSize;
+	vector<struct ComplexNumber> m_data;
+
+public:
+	FftBenchmark(const char* szName, size_t baseSize)
+	: m_name(szName), m_baseSize(baseSize)
+	{
+	}
+
+	virtual const char* name() { return m_name.c_str(); }
+
+	virtual void prepare(GRand& rand, double scale)
+	{
+		// Scaling changes the size by a power of 2, so it keeps the same prime factors
+		size_t n = m_baseSize;
+		for(double s = scale; s >= 2.0; s *= 0.5)
+			n *= 2;
+		for(double s = scale; s <= 0.5 && (n & 1) == 0; s *= 2.0)
+			n /= 2;
+		m_data.resize(n);
+		for(size_t i = 0; i < n; i++)
+		{
+			m_data[i].real = rand.normal();
+			m_data[i].imag = 0.0;
+		}
+		GFourier::fft(n, &m_data[0], true); // creates the cached plan
+		GFourier::fft(n, &m_data[0], false);
+	}
+
+	virtual string size() { return to_str(m_data.size()) + " points, forward and inverse"; }
+
+	virtual void run()
+	{
+		GFourier::fft(m_data.size(), &m_data[0], true);
+		GFourier::fft(m_data.size(), &m_data[0], false);
+		g_sink = g_sink + m_data[0].real;
+	}
+};
+
+
+class KeyGenBenchmark : public Benchmark
+{
+protected:
+	string m_name;
+	size_t m_bits;
+	vector<unsigned int> m_bytes;
+
+public:
+	KeyGenBenchmark(const char* szName, size_t bits)
+	: m_name(szName), m_bits(bits)
+	{
+	}
+
+	virtual const char* name() { return m_name.c_str(); }
+
+	virtual void prepare(GRand& rand, double scale)
+	{
+		// The time to find the primes depends a lot on where the search starts, so the random
+		// bytes come from a fixed seed (not the -seed option), and the key size is not scaled.
+		// That way, every report measures the same work.
+		GRand fixedRand(0);
+		size_t uintCount = m_bits / 64; // (each of the two primes has half of the bits)
+		m_bytes.resize(3 * uintCount);
+		for(size_t i = 0; i < m_bytes.size(); i++)
+			m_bytes[i] = (unsigned int)fixedRand.next();
+	}
+
+	virtual string size() { return to_str(m_bits) + "-bit modulus"; }
+
+	virtual void run()
+	{
+		unsigned int uintCount = (unsigned int)(m_bytes.size() / 3);
+		GKeyPair kp;
+		kp.generateKeyPair(uintCount, m_bytes.data(), m_bytes.data() + uintCount, m_bytes.data() + 2 * uintCount);
+		g_sink = g_sink + (double)kp.n()->getUInt(0);
+	}
+};
+
+
+void makeBenchmarks(vector<Benchmark*>& benchmarks)
+{
+	benchmarks.push_back(new MatrixMultiplyBenchmark());
+	benchmarks.push_back(new MatrixSvdBenchmark());
+	benchmarks.push_back(new MatrixEigsBenchmark());
+	benchmarks.push_back(new VecKernelsBenchmark());
+	for(int type = 0; type < 3; type++)
+	{
+		if(type > 0)
+			benchmarks.push_back(new NeighborBenchmark(type, true));
+		benchmarks.push_back(new NeighborBenchmark(type, false));
+	}
+	benchmarks.push_back(new TreeBenchmark(false, true));
+	benchmarks.push_back(new TreeBenchmark(false, false));
+	benchmarks.push_back(new TreeBenchmark(true, true));
+	benchmarks.push_back(new TreeBenchmark(true, false));
+	benchmarks.push_back(new NeuralNetEpochBenchmark());
+	benchmarks.push_back(new MatrixFactorizationEpochBenchmark());
+	benchmarks.push_back(new SerializationBenchmark(false, true));
+	benchmarks.push_back(new SerializationBenchmark(false, false));
+	benchmarks.push_back(new SerializationBenchmark(true, true));
+	benchmarks.push_back(new SerializationBenchmark(true, false));
+	benchmarks.push_back(new FftBenchmark("fft_pow2", 65536));
+	benchmarks.push_back(new FftBenchmark("fft_mixedradix", 60000));
+	benchmarks.push_back(new FftBenchmark("fft_bluestein", 4099));
+	benchmarks.push_back(new KeyGenBenchmark("gkeypair_keygen_2048", 2048));
+	benchmarks.push_back(new KeyGenBenchmark("gkeypair_keygen_4096", 4096));
+}
+
+void list(GArgReader& args)
+{
+	vector<Benchmark*> benchmarks;
+	VectorOfPointersHolder<Benchmark> hBenchmarks(benchmarks);
+	makeBenchmarks(benchmarks);
+	for(size_t i = 0; i < benchmarks.size(); i++)
+		cout << benchmarks[i]->name() << "\n";
+}
+
+void run(GArgReader& args)
+{
+	// Parse options
+	vector<string> filters;
+	double scale = 1.0;
+	size_t reps = 5;
+	unsigned int seed = 0;
+	string outFilename;
+	while(args.next_is_flag())
+	{
+		if(args.if_pop("-filter"))
+			filters.push_back(args.pop_string());
+		else if(args.if_pop("-scale"))
+			scale = args.pop_double();
+		else if(args.if_pop("-reps"))
+			reps = args.pop_uint();
+		else if(args.if_pop("-seed"))
+			seed = args.pop_uint();
+		else if(args.if_pop("-out"))
+			outFilename = args.pop_string();
+		else
+			throw Ex("Invalid option: ", args.peek());
+	}
+	if(scale <= 0.0)
+		throw Ex("The scale must be positive");
+	if(reps < 1)
+		throw Ex("Expected at least one repetition");
+
+	vector<Benchmark*> benchmarks;
+	VectorOfPointersHolder<Benchmark> hBenchmarks(benchmarks);
+	makeBenchmarks(benchmarks);
+	GDom doc;
+	GDomNode* pRoot = doc.newObj();
+	doc.setRoot(pRoot);
+	pRoot->addField(&doc, "units", doc.newString("seconds"));
+	pRoot->addField(&doc, "scale", doc.newDouble(scale));
+	pRoot->addField(&doc, "reps", doc.newInt(reps));
+	pRoot->addField(&doc, "seed", doc.newInt(seed));
+	GDomNode* pList = pRoot->addField(&doc, "benchmarks", doc.newList());
+	vector<double> times;
+	for(size_t i = 0; i < benchmarks.size(); i++)
+	{
+		Benchmark* pBench = benchmarks[i];
+		bool selected = filters.size() == 0;
+		for(size_t j = 0; j < filters.size(); j++)
+		{
+			if(strstr(pBench->name(), filters[j].c_str()))
+				selected = true;
+		}
+		if(!selected)
+			continue;
+
+		// Every benchmark gets its own generator, so its data does not depend on which others ran
+		GRand rand(seed + i);
+		pBench->prepare(rand, scale);
+		pBench->run(); // warm up
+		times.clear();
+		for(size_t j = 0; j < reps; j++)
+		{
+			double start = GTime::seconds();
+			pBench->run();
+			times.push_back(GTime::seconds() - start);
+		}
+		std::sort(times.begin(), times.end());
+		double sum = 0.0;
+		for(size_t j = 0; j < times.size(); j++)
+			sum += times[j];
+		double median = (times.size() & 1) ? times[times.size() / 2] : 0.5 * (times[times.size() / 2 - 1] + times[times.size() / 2]);
+		GDomNode* pB = pList->addItem(&doc, doc.newObj());
+		pB->addField(&doc, "name", doc.newString(pBench->name()));
+		pB->addField(&doc, "size", doc.newString(pBench->size().c_str()));
+		pB->addField(&doc, "median", doc.newDouble(median));
+		pB->addField(&doc, "min", doc.newDouble(times[0]));
+		pB->addField(&doc, "mean", doc.newDouble(sum / times.size()));
+		pB->addField(&doc, "max", doc.newDouble(times[times.size() - 1]));
+		cerr << pBench->name() << " (" << pBench->size() << "): " << to_str(median) << " seconds\n";
+		cerr.flush();
+	}
+	if(outFilename.length() > 0)
+		doc.saveJson(outFilename.c_str());
+	else
+	{
+		doc.writeJsonPretty(cout);
+		cout << "\n";
+	}
+}
+
+double medianOf(GDomNode* pBenchmark)
+{
+	return pBenchmark->field("median")->asDouble();
+}
+
+// Returns the number of regressions
+size_t compare(GArgReader& args)
+{
+	// Parse options
+	double threshold = 0.1;
+	double floor = 1e-4;
+	while(args.next_is_flag())
+	{
+		if(args.if_pop("-threshold"))
+			threshold = args.pop_double();
+		else if(args.if_pop("-floor"))
+			floor = args.pop_double();
+		else
+			throw Ex("Invalid option: ", args.peek());
+	}
+	const char* szBaseline = args.pop_string();
+	const char* szCurrent = args.pop_string();
+	GDom docBaseline;
+	docBaseline.loadJson(szBaseline);
+	GDom docCurrent;
+	docCurrent.loadJson(szCurrent);
+	if(docBaseline.root()->field("scale")->asDouble() != docCurrent.root()->field("scale")->asDouble())
+		throw Ex("The two reports were made with different scales");
+
+	GDom doc;
+	GDomNode* pRoot = doc.newObj();
+	doc.setRoot(pRoot);
+	pRoot->addField(&doc, "threshold", doc.newDouble(threshold));
+	GDomNode* pList = pRoot->addField(&doc, "comparisons", doc.newList());
+	size_t regressions = 0;
+	for(GDomListIterator it(docCurrent.root()->field("benchmarks")); it.current(); it.advance())
+	{
+		GDomNode* pCur = it.current();
+		const char* szName = pCur->field("name")->asString();
+		GDomNode* pBase = NULL;
+		for(GDomListIterator it2(docBaseline.root()->field("benchmarks")); it2.current(); it2.advance())
+		{
+			if(strcmp(it2.current()->field("name")->asString(), szName) == 0)
+			{
+				pBase = it2.current();
+				break;
+			}
+		}
+		if(!pBase)
+			continue;
+		if(strcmp(pBase->field("size")->asString(), pCur->field("size")->asString()) != 0)
+			throw Ex("The benchmark ", szName, " has a different size in the two reports");
+		double base = medianOf(pBase);
+		double cur = medianOf(pCur);
+		double ratio = base > 0.0 ? cur / base : 1.0;
+
+		// Differences among very short times are mostly noise, so they are not flagged
+		bool regression = (cur > base * (1.0 + threshold) && cur >= floor);
+		if(regression)
+			regressions++;
+		GDomNode* pC = pList->addItem(&doc, doc.newObj());
+		pC->addField(&doc, "name", doc.newString(szName));
+		pC->addField(&doc, "baseline", doc.newDouble(base));
+		pC->addField(&doc, "current", doc.newDouble(cur));
+		pC->addField(&doc, "ratio", doc.newDouble(ratio));
+		pC->addField(&doc, "regression", doc.newBool(regression));
+		if(regression)
+			cerr << "Regression: " << szName << " went from " << to_str(base) << " to " << to_str(cur) << " seconds\n";
+	}
+	pRoot->addField(&doc, "regressions", doc.newInt(regressions));
+
+	// Report the benchmarks that were dropped, so a regression cannot hide by disappearing
+	GDomNode* pMissing = pRoot->addField(&doc, "missing", doc.newList());
+	for(GDomListIterator it(docBaseline.root()->field("benchmarks")); it.current(); it.advance())
+	{
+		const char* szName = it.current()->field("name")->asString();
+		bool found = false;
+		for(GDomListIterator it2(docCurrent.root()->field("benchmarks")); it2.current(); it2.advance())
+		{
+			if(strcmp(it2.current()->field("name")->asString(), szName) == 0)
+			{
+				found = true;
+				break;
+			}
+		}
+		if(!found)
+		{
+			pMissing->addItem(&doc, doc.newString(szName));
+			cerr << "Missing: " << szName << " is in the baseline, but not in the current report\n";
+		}
+	}
+	doc.writeJsonPretty(cout);
+	cout << "\n";
+	return regressions;
+}
+
+void ShowUsage(const char* appName)
+{
+	cout << "Full Usage Information\n";
+	cout << "[Square brackets] are used to indicate required arguments.\n";
+	cout << "<Angled brackets> are used to indicate optional arguments.\n";
+	cout << "\n";
+	UsageNode* pUsageTree = makeBenchUsageTree();
+	Holder<UsageNode> hUsageTree(pUsageTree);
+	pUsageTree->print(cout, 0, 3, 76, 1000, true);
+	cout.flush();
+}
+
+void showError(GArgReader& args, const char* szAppName, const char* szMessage)
+{
+	cerr << "_________________________________\n";
+	cerr << szMessage << "\n\n";
+	args.set_pos(1);
+	const char* szCommand = args.peek();
+	UsageNode* pUsageTree = makeBenchUsageTree();
+	Holder<UsageNode> hUsageTree(pUsageTree);
+	if(szCommand)
+	{
+		UsageNode* pUsageCommand = pUsageTree->choice(szCommand);
+		if(pUsageCommand)
+		{
+			cerr << "Brief Usage Information:\n\n";
+			cerr << szAppName << " ";
+			pUsageCommand->print(cerr, 0, 3, 76, 1000, true);
+		}
+		else
+		{
+			cerr << "Brief Usage Information:\n\n";
+			pUsageTree->print(cerr, 0, 3, 76, 1, false);
+		}
+	}
+	else
+	{
+		pUsageTree->print(cerr, 0, 3, 76, 1, false);
+		cerr << "\nFor more specific usage information, enter as much of the command as you know.\n";
+	}
+	cerr << "\nTo see full usage information, run:\n	" << szAppName << " usage\n\n";
+	cerr.flush();
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _DEBUG
+	GApp::enableFloatingPointExceptions();
+#endif
+	int ret = 0;
+	PathData pd;
+	GFile::parsePath(argv[0], &pd);
+	const char* appName = argv[0] + pd.fileStart;
+	GArgReader args(argc, argv);
+	args.pop_string(); // advance past the app name
+	try
+	{
+		if(args.size() < 1) throw Ex("Expected a command");
+		else if(args.if_pop("usage")) ShowUsage(appName);
+		else if(args.if_pop("compare")) ret = compare(args) > 0 ? 2 : 0; // (errors return 1)
+		else if(args.if_pop("list")) list(args);
+		else if(args.if_pop("run")) run(args);
+		else throw Ex("Unrecognized command: ", args.peek());
+	}
+	catch(const std::exception& e)
+	{
+		if(strcmp(e.what(), "nevermind") != 0) // if an error message was not already displayed...
+			showError(args, appName, e.what());
+		ret = 1;
+	}
+
+	return ret;
+}
@@ -121,6 +121,8 @@ UsageNode* makeCryptoUsageTree()
 		UsageNode* pOpts = pEncrypt->add("<options>");
 		pOpts->add("-out [filename]", "Specify the name of the output file. (The default is to use the name of the path with the extension changed to .encrypted.)");
 		pOpts->add("-compress", "Take a lot longer, but produce a smaller encrypted archive file. (This feature really isn't very usable yet.)");
+		pOpts->add("-fastcompress", "Compress the archive with a fast LZ77-style codec. This is much faster than -compress, but does not compress as well.");
+		pOpts->add("-threads [n]", "Specify the number of threads to use with -fastcompress. (The default is 1.)");
 	}
 	{
 		UsageNode* pLogKeys = pRoot->add("logkeys [filename] <options>", "Log key-strokes to the specified file. (The program will exit if the panic-sequence \"xqwertx\" is detected.)");
@@ -947,10 +949,11 @@ void dump(GArgReader& args)
 #define SALT_LEN 32
 
 /// Assumes salt of length SALT_LEN has already been concatenated to passphrase
-void encryptPath(const char* pathName, char* passphrase, const char* targetName, bool compress)
+void encryptPath(const char* pathName, char* passphrase, const char* targetName, bool compress, bool fast = false, size_t threads = 1)
 {
 	// Encrypt the path
-	GFolderSerializer fs(pathName, compress);
+	GFolderSerializer fs(pathName, compress, fast);
+	fs.setWorkerThreads(threads);
 	GCrypto crypto(passphrase, strlen(passphrase));
 	std::ofstream ofs;
 	ofs.exceptions(std::ios::failbit|std::ios::badbit);
@@ -1027,7 +1030,7 @@ void decryptFile(const char* source, char* passphrase, char* outSalt, std::strin
 		if(first)
 		{
 			first = false;
-			if(memcmp(pBuf, "ugfs", 4) != 0 && memcmp(pBuf, "cgfs", 4) != 0)
+			if(memcmp(pBuf, "ugfs", 4) != 0 && memcmp(pBuf, "cgfs", 4) != 0 && memcmp(pBuf, "zgfs", 4) != 0)
 				throw Ex("The passphrase is incorrect");
 		}
 		fd.doNext(pBuf, chunkSize);
@@ -1622,12 +1625,21 @@ void encrypt(GArgReader& args)
 	sTarget.assign(pathName + pd.fileStart, pd.extStart - pd.fileStart);
 	sTarget.append(".encrypted");
 	bool compress = false;
+	bool fast = false;
+	size_t threads = 1;
 	while(args.next_is_flag())
 	{
 		if(args.if_pop("-out"))
 			sTarget = args.pop_string();
 		else if(args.if_pop("-compress"))
 			compress = true;
+		else if(args.if_pop("-fastcompress"))
+		{
+			compress = true;
+			fast = true;
+		}
+		else if(args.if_pop("-threads"))
+			threads = args.pop_uint();
 		else
 			throw Ex("Invalid option: ", args.peek());
 	}
@@ -1636,7 +1648,7 @@ void encrypt(GArgReader& args)
 	readInPassphrase(passphrase, MAX_PASSPHRASE_LEN, salt);
 	PassphraseWiper pw(passphrase);
 	appendSalt(passphrase, salt);
-	encryptPath(pathName, passphrase, sTarget.c_str(), compress);
+	encryptPath(pathName, passphrase, sTarget.c_str(), compress, fast, threads);
 }
 
 #ifdef WINDOWS
@@ -43,6 +43,7 @@
 #include "../GClasses/GMath.h"
 #include "../GClasses/GDom.h"
 #include "../GClasses/GSelfOrganizingMap.h"
+#include "../GClasses/GProfiler.h"
 #include <time.h>
 #include <iostream>
 #include <string>
@@ -389,6 +390,9 @@ void attributeSelector(GArgReader& args)
 	unsigned int seed = getpid() * (unsigned int)time(NULL);
 	int targetFeatures = 1;
 	string outFilename = "";
+	GAttributeSelector::Ranker ranker = GAttributeSelector::NEURAL_WRAPPER;
+	size_t threads = 1;
+	double removalPortion = 0.1;
 	while(args.next_is_flag())
 	{
 		if(args.if_pop("-seed"))
@@ -398,13 +402,22 @@ void attributeSelector(GArgReader& args)
 			targetFeatures = args.pop_uint();
 			outFilename = args.pop_string();
 		}
+		else if(args.if_pop("-ranker"))
+			ranker = GAttributeSelector::rankerFromName(args.pop_string());
+		else if(args.if_pop("-threads"))
+			threads = args.pop_uint();
+		else if(args.if_pop("-removeportion"))
+			removalPortion = args.pop_double();
 		else
-			throw Ex("Invalid neighbor finder option: ", args.peek());
+			throw Ex("Invalid attribute selector option: ", args.peek());
 	}
 
 	// Do the attribute selection
 	GAttributeSelector as(labelDims, targetFeatures);
 	as.setSeed(seed);
+	as.setRanker(ranker);
+	as.setWorkerThreads(threads);
+	as.setRemovalPortion(removalPortion);
 	if(outFilename.length() > 0)
 	{
 		as.train(data);
@@ -1016,6 +1029,7 @@ void selfOrganizingMap(GArgReader& args){
   double endRate   = -1;//End learning rate
   unsigned numIter     = 100;//Total iterations
   unsigned numConverge = 1;//#steps for batch to converge
+  size_t threads = 1;
 
   while(args.next_is_flag()){
     if(args.if_pop("-tofile")){
@@ -1024,6 +1038,8 @@ void selfOrganizingMap(GArgReader& args){
       loadFrom = args.pop_string();
     }else if(args.if_pop("-seed")){
       rand.setSeed(args.pop_uint());
+    }else if(args.if_pop("-threads")){
+      threads = args.pop_uint();
     }else if(args.if_pop("-neighborhood")){
       string name = args.pop_string();
       if(name == "gaussian"){
@@ -1096,6 +1112,7 @@ void selfOrganizingMap(GArgReader& args){
     som.reset(new GSelfOrganizingMap
       (netDims, numNodes, topology.release(), algo.release(),
        weightDist.release(), nodeDist.release()));
+    som->setWorkerThreads(threads);
     //Train the network and transform the data in place
     out.reset(som->reduce(*pData));
   }else{
@@ -1404,6 +1421,8 @@ int main(int argc, char *argv[])
 	args.pop_string(); // advance past the app name
 	try
 	{
+		GProfiler::parseArgs(args);
+		GProfilerReportWriter reportWriter; // (writes the reports even if the command throws)
 		if(args.size() < 1) throw Ex("Expected a command");
 		else if(args.if_pop("usage")) ShowUsage(appName);
 		else if(args.if_pop("attributeselector")) attributeSelector(args);
@@ -1422,6 +1441,7 @@ int main(int argc, char *argv[])
 //		else if(args.if_pop("unsupervisedbackprop")) unsupervisedBackProp(args);
 //		else if(args.if_pop("autoencoder")) autoencoder(args);
 		else throw Ex("Unrecognized command: ", args.peek());
+		GProfiler::writeRequestedReports();
 	}
 	catch(const std::exception& e)
 	{
@@ -19,6 +19,7 @@
 */
 
 #include "../GClasses/GLearnerLib.h"
+#include "../GClasses/GProfiler.h"
 
 using namespace GClasses;
 
@@ -35,6 +36,8 @@ int main(int argc, char *argv[])
 	try
 	{
 		args.pop_string(); // advance past the name of this app
+		GProfiler::parseArgs(args);
+		GProfilerReportWriter reportWriter; // (writes the reports even if the command throws)
 		if(args.size() >= 1)
 		{
 			if(args.if_pop("usage"))
@@ -43,6 +46,10 @@ int main(int argc, char *argv[])
 				GLearnerLib::autoTune(args);
 			else if(args.if_pop("train"))
 				GLearnerLib::Train(args);
+			else if(args.if_pop("paramserver"))
+				GLearnerLib::paramServer(args);
+			else if(args.if_pop("paramworker"))
+				GLearnerLib::paramWorker(args);
 			else if(args.if_pop("test"))
 				GLearnerLib::Test(args);
 			else if(args.if_pop("predict"))
@@ -61,6 +68,8 @@ int main(int argc, char *argv[])
 				GLearnerLib::PrecisionRecall(args);
  			else if(args.if_pop("sterilize"))
  				GLearnerLib::sterilize(args);
+			else if(args.if_pop("quantize"))
+				GLearnerLib::quantize(args);
 //			else if(args.if_pop("trainrecurrent"))
 //				GLearnerLib::trainRecurrent(args);
 			else if(args.if_pop("regress"))
@@ -80,6 +89,7 @@ int main(int argc, char *argv[])
 			nRet = 1;
 			GLearnerLib::showError(args, appName, "Brief Usage Information:");
 		}
+		GProfiler::writeRequestedReports();
 	}
 	catch(const std::exception& e)
 	{
@@ -464,6 +464,24 @@ void PlotBar(GArgReader& args)
 	svg.print(cout);
 }
 
+/// Computes the points along a plotted function. The x values start at xmin and step
+/// by dx until one is past xmax. All of the y values are computed at once with the
+/// compiled function.
+void plotEquationPoints(GFunction* pFunc, GFunctionParser& parser, double xmin, double xmax, double dx, vector<double>& xs, vector<double>& ys)
+{
+	double x = xmin;
+	xs.push_back(x);
+	while(x <= xmax)
+	{
+		x += dx;
+		xs.push_back(x);
+	}
+	GCompiledFunction compiled(pFunc, parser);
+	ys.resize(xs.size());
+	const double* columns[1] = { xs.data() };
+	compiled.evaluate(columns, xs.size(), ys.data());
+}
+
 void PlotEquation(GArgReader& args)
 {
 	// Parse options
@@ -597,20 +615,13 @@ void PlotEquation(GArgReader& args)
 			col = gAHSV(0xff, i / 6.0f, 1.0f, 0.5f);
 		else
 			col = gAHSV(0xff, i / ((float)equationCount * 1.25f), 1.0f, 0.5f);
-		double dx = 2.0 * svg.hunit();
-		vector<double> params;
-		double x = xmin;
-		params.push_back(x);
-		double y = pFunc->call(params, mfp);
-		while(x <= xmax)
-		{
-			double xPrev = x;
-			double yPrev = y;
-			x += dx;
-			params[0] = x;
-			y = pFunc->call(params, mfp);
-			if(y > -1e100 && y < 1e100 && yPrev > -1e100 && yPrev < 1e100)
-				svg.line(xPrev, yPrev, x, y, thickness, col);
+		vector<double> xs;
+		vector<double> ys;
+		plotEquationPoints(pFunc, mfp, xmin, xmax, 2.0 * svg.hunit(), xs, ys);
+		for(size_t j = 1; j < xs.size(); j++)
+		{
+			if(ys[j] > -1e100 && ys[j] < 1e100 && ys[j - 1] > -1e100 && ys[j - 1] < 1e100)
+				svg.line(xs[j - 1], ys[j - 1], xs[j], ys[j], thickness, col);
 		}
 	}
 
@@ -786,20 +797,13 @@ public:
 		}
 		if(m_pFunc)
 		{
-			double dx = (xmax - xmin) / width;
-			x = xmin;
-			vector<double> params;
-			params.push_back(x);
-			y = m_pFunc->call(params, *m_pFP);
-			while(x <= xmax)
+			vector<double> xs;
+			vector<double> ys;
+			plotEquationPoints(m_pFunc, *m_pFP, xmin, xmax, (xmax - xmin) / width, xs, ys);
+			for(size_t j = 1; j < xs.size(); j++)
 			{
-				xPrev = x;
-				yPrev = y;
-				x += dx;
-				params[0] = x;
-				y = m_pFunc->call(params, *m_pFP);
-				if(y > -1e100 && y < 1e100 && yPrev > -1e100 && yPrev < 1e100)
-					svg.line(xPrev, yPrev, x, y, m_thickness, (unsigned int)m_color);
+				if(ys[j] > -1e100 && ys[j] < 1e100 && ys[j - 1] > -1e100 && ys[j - 1] < 1e100)
+					svg.line(xs[j - 1], ys[j - 1], xs[j], ys[j], m_thickness, (unsigned int)m_color);
 			}
 		}
 		else
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "../GClasses/GRecommenderLib.cpp"
+#include "../GClasses/GProfiler.h"
 #include <time.h>
 #include <iostream>
 #ifdef WIN32
@@ -52,6 +53,8 @@ int main(int argc, char *argv[])
 	try
 	{
 		args.pop_string(); // advance past the name of this app
+		GProfiler::parseArgs(args);
+		GProfilerReportWriter reportWriter; // (writes the reports even if the command throws)
 		if(args.size() >= 1)
 		{
 			if(args.if_pop("usage"))
@@ -79,6 +82,7 @@ int main(int argc, char *argv[])
 			nRet = 1;
 			GRecommenderLib::showError(args, appName, "Brief Usage Information:");
 		}
+		GProfiler::writeRequestedReports();
 	}
 	catch(const std::exception& e)
 	{
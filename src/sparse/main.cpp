@@ -532,130 +532,65 @@ void transpose(GArgReader& args)
 	}
 }
 
-class MyHtmlParser1 : public GHtml
+class MyHtmlParser : public GHtml
 {
 protected:
-	GVocabulary* m_pVocab;
+	string& m_text;
 
 public:
-	MyHtmlParser1(GVocabulary* pVocab, const char* pDoc, size_t nSize)
-	: GHtml(pDoc, nSize), m_pVocab(pVocab)
+	MyHtmlParser(const char* pDoc, size_t nSize, string& text)
+	: GHtml(pDoc, nSize), m_text(text)
 	{
 	}
 
-	virtual ~MyHtmlParser1() {}
+	virtual ~MyHtmlParser() {}
 
 	virtual void onTextChunk(const char* pChunk, size_t chunkSize)
 	{
-		m_pVocab->addWordsFromTextBlock(pChunk, chunkSize);
+		m_text.append(pChunk, chunkSize);
+		m_text += ' ';
 	}
 };
 
-class MyHtmlParser2 : public GHtml
+/// Loads .txt and .html documents for GCorpusVectorizer
+class MyDocumentFiles : public GCorpusDocuments
 {
-protected:
-	GSparseMatrix* m_pSM;
-	size_t m_row;
-	GVocabulary* m_pVocab;
-	bool m_binary;
-
 public:
-	MyHtmlParser2(const char* pDoc, size_t nSize, GSparseMatrix* pSM, size_t row, GVocabulary* pVocab, bool binary)
-	: GHtml(pDoc, nSize), m_pSM(pSM), m_row(row), m_pVocab(pVocab), m_binary(binary)
-	{
-	}
+	vector<string> m_filenames;
+	vector<bool> m_html;
+	vector<size_t> m_classes;
 
-	virtual ~MyHtmlParser2() {}
+	virtual ~MyDocumentFiles() {}
 
-	virtual void onTextChunk(const char* pChunk, size_t chunkSize)
+	virtual size_t count() { return m_filenames.size(); }
+
+	virtual void load(size_t doc, string& text)
 	{
-		GWordIterator it(pChunk, chunkSize);
-		const char* pWord;
-		size_t wordLen;
-		while(true)
+		size_t len;
+		char* pFile = GFile::loadFile(m_filenames[doc].c_str(), &len);
+		std::unique_ptr<char[]> hFile(pFile);
+		if(m_html[doc])
 		{
-			if(!it.next(&pWord, &wordLen))
-				break;
-			size_t col = m_pVocab->wordIndex(pWord, wordLen);
-			if(col != INVALID_INDEX)
+			text.clear();
+			MyHtmlParser parser(pFile, len, text);
+			while(true)
 			{
-				if(m_binary)
-					m_pSM->set(m_row, col, 1.0);
-				else
-					m_pSM->set(m_row, col, m_pSM->get(m_row, col) + m_pVocab->weight(col));
+				if(!parser.parseSomeMore())
+					break;
 			}
 		}
+		else
+			text.assign(pFile, len);
 	}
 };
 
-void addWordsToVocabFromHtmlFile(GVocabulary* pVocab, const char* szFilename)
-{
-	size_t len;
-	char* pFile = GFile::loadFile(szFilename, &len);
-	std::unique_ptr<char[]> hFile(pFile);
-	pVocab->newDoc();
-	MyHtmlParser1 parser(pVocab, pFile, len);
-	while(true)
-	{
-		if(!parser.parseSomeMore())
-			break;
-	}
-}
-
-void makeHtmlFileVector(GSparseMatrix* pFeatures, GMatrix* pLabels, int clss, size_t row, GVocabulary* pVocab, const char* szFilename, bool binary)
-{
-	size_t len;
-	char* pFile = GFile::loadFile(szFilename, &len);
-	std::unique_ptr<char[]> hFile(pFile);
-	MyHtmlParser2 parser(pFile, len, pFeatures, row, pVocab, binary);
-	while(true)
-	{
-		if(!parser.parseSomeMore())
-			break;
-	}
-	if(clss > 0)
-		pLabels->row(row)[0] = (double)clss;
-}
-
-void addWordsToVocabFromTextFile(GVocabulary* pVocab, const char* szFilename)
-{
-	size_t len;
-	char* pFile = GFile::loadFile(szFilename, &len);
-	std::unique_ptr<char[]> hFile(pFile);
-	pVocab->newDoc();
-	pVocab->addWordsFromTextBlock(pFile, len);
-}
-
-void makeTextFileVector(GSparseMatrix* pFeatures, GMatrix* pLabels, int clss, size_t row, GVocabulary* pVocab, const char* szFilename, bool binary)
-{
-	size_t len;
-	char* pFile = GFile::loadFile(szFilename, &len);
-	std::unique_ptr<char[]> hFile(pFile);
-	GWordIterator it(pFile, len);
-	const char* pWord;
-	size_t wordLen;
-	while(true)
-	{
-		if(!it.next(&pWord, &wordLen))
-			break;
-		size_t col = pVocab->wordIndex(pWord, wordLen);
-		if(col != INVALID_INDEX)
-		{
-			if(binary)
-				pFeatures->set(row, col, 1.0);
-			else
-				pFeatures->set(row, col, pFeatures->get(row, col) + pVocab->weight(col));
-		}
-	}
-	if(pLabels)
-		pLabels->row(row)[0] = (double)clss;
-}
-
 void docsToSparseMatrix(GArgReader& args)
 {
 	// Parse options
 	bool useStemmer = true;
 	bool binary = false;
+	size_t threads = 1;
+	size_t hashBuckets = 0;
 	string featuresFilename = "features.sparse";
 	string labelsFilename = "labels.arff";
 	string vocabFile = "";
@@ -672,103 +607,90 @@ void docsToSparseMatrix(GArgReader& args)
 		}
 		else if(args.if_pop("-vocabfile"))
 			vocabFile = args.pop_string();
+		else if(args.if_pop("-threads"))
+			threads = args.pop_uint();
+		else if(args.if_pop("-hash"))
+			hashBuckets = args.pop_uint();
 		else
 			throw Ex("Invalid option: ", args.peek());
 	}
+	if(hashBuckets > 0 && vocabFile.length() > 0)
+		throw Ex("No vocabulary is built when -hash is used, so -vocabfile cannot be used with it");
 
-	// Parse the vocabulary
-	GVocabulary vocab(useStemmer);
-	vocab.addTypicalStopWords();
+	// Find the documents
+	MyDocumentFiles docs;
 	vector<string> folders;
 	while(args.size() > 0)
 	{
-		const char* szFolder = args.pop_string();
-		folders.push_back(szFolder);
+		string folder = args.pop_string();
+		folders.push_back(folder);
+		if(folder.length() > 0 && folder[folder.length() - 1] != '/' && folder[folder.length() - 1] != '\\')
+			folder += "/";
+		vector<string> files;
 		char cwd[300];
 		if(!getcwd(cwd, 300))
 			throw Ex("Failed to get cwd");
-		if(chdir(szFolder) != 0)
-			throw Ex("Failed to change directory to: ", szFolder, ", from: ", cwd);
+		if(chdir(folder.c_str()) != 0)
+			throw Ex("Failed to change directory to: ", folder.c_str(), ", from: ", cwd);
+		GFile::fileList(files);
+		if(chdir(cwd) != 0)
+			throw Ex("Failed to change dir");
+		for(vector<string>::iterator it = files.begin(); it != files.end(); it++)
 		{
-			vector<string> files;
-			GFile::fileList(files);
-			for(vector<string>::iterator it = files.begin(); it != files.end(); it++)
+			const char* filename = it->c_str();
+			PathData pd;
+			GFile::parsePath(filename, &pd);
+			bool html;
+			if(_stricmp(filename + pd.extStart, ".txt") == 0)
+				html = false;
+			else if(_stricmp(filename + pd.extStart, ".html") == 0 || _stricmp(filename + pd.extStart, ".htm") == 0)
+				html = true;
+			else
 			{
-				const char* filename = it->c_str();
-				PathData pd;
-				GFile::parsePath(filename, &pd);
-				if(_stricmp(filename + pd.extStart, ".txt") == 0)
-					addWordsToVocabFromTextFile(&vocab, filename);
-				else if(_stricmp(filename + pd.extStart, ".html") == 0 || _stricmp(filename + pd.extStart, ".htm") == 0)
-					addWordsToVocabFromHtmlFile(&vocab, filename);
-				else
-					printf("Skipping file: %s. (Only .txt and .html is supported.)\n", filename);
+				printf("Skipping file: %s. (Only .txt and .html is supported.)\n", filename);
+				continue;
 			}
+			printf("%d) %s\n", (int)docs.m_filenames.size(), filename);
+			docs.m_filenames.push_back(folder + *it);
+			docs.m_html.push_back(html);
+			docs.m_classes.push_back(folders.size() - 1);
 		}
-		if(chdir(cwd) != 0)
-			throw Ex("failed to change dir");
 	}
 	if(folders.size() == 0)
 		throw Ex("At least one folder name must be specified");
-	printf("-----\n");
 
-	// Make the sparse feature matrix and the label matrix
-	GSparseMatrix sparseFeatures(vocab.docCount(), vocab.wordCount());
+	// Make the sparse feature matrix
+	GCorpusVectorizer vectorizer(useStemmer);
+	vectorizer.addTypicalStopWords();
+	vectorizer.setBinary(binary);
+	vectorizer.setWorkerThreads(threads);
+	vectorizer.useHashing(hashBuckets);
+	GSparseMatrix* pFeatures = vectorizer.vectorize(docs);
+	std::unique_ptr<GSparseMatrix> hFeatures(pFeatures);
+
+	// Make the label matrix
 	GMatrix* pLabels = NULL;
 	if(folders.size() > 1)
 	{
 		vector<size_t> classes;
 		classes.push_back(folders.size());
 		pLabels = new GMatrix(classes);
-		pLabels->newRows(vocab.docCount());
+		pLabels->newRows(docs.count());
+		for(size_t i = 0; i < docs.count(); i++)
+			pLabels->row(i)[0] = (double)docs.m_classes[i];
 	}
 	std::unique_ptr<GMatrix> hLabels(pLabels);
-	size_t row = 0;
-	for(int clss = 0; clss < (int)folders.size(); clss++)
-	{
-		const char* szFolder = folders[clss].c_str();
-		char cwd[300];
-		if(!getcwd(cwd, 300))
-			throw Ex("Failed to get cwd");
-		if(chdir(szFolder) != 0)
-			throw Ex("Failed to change directory to: ", szFolder, ", from: ", cwd);
-		{
-			vector<string> files;
-			GFile::fileList(files);
-			for(vector<string>::iterator it = files.begin(); it != files.end(); it++)
-			{
-				const char* filename = it->c_str();
-				PathData pd;
-				GFile::parsePath(filename, &pd);
-				if(_stricmp(filename + pd.extStart, ".txt") == 0)
-				{
-					printf("%d) %s\n", (int)row, filename);
-					makeTextFileVector(&sparseFeatures, pLabels, clss, row++, &vocab, filename, binary);
-				}
-				else if(_stricmp(filename + pd.extStart, ".html") == 0 || _stricmp(filename + pd.extStart, ".htm") == 0)
-				{
-					printf("%d) %s\n", (int)row, filename);
-					makeHtmlFileVector(&sparseFeatures, pLabels, clss, row++, &vocab, filename, binary);
-				}
-			}
-		}
-		if(chdir(cwd) != 0)
-			throw Ex("Failed to change dir");
-	}
 
 	// Save the files
 	if(vocabFile.length() > 0)
 	{
 		FILE* pFile = fopen(vocabFile.c_str(), "w");
 		FileHolder hFile(pFile);
-		for(size_t i = 0; i < vocab.wordCount(); i++)
-		{
-			const char* szWord = vocab.stats(i).m_szWord;
-			fprintf(pFile, "%s\n", szWord);
-		}
+		for(size_t i = 0; i < vectorizer.wordCount(); i++)
+			fprintf(pFile, "%s\n", vectorizer.word(i));
 	}
 	GDom doc;
-	doc.setRoot(sparseFeatures.serialize(&doc));
+	doc.setRoot(pFeatures->serialize(&doc));
 	doc.saveJson(featuresFilename.c_str());
 	if(pLabels)
 		pLabels->saveArff(labelsFilename.c_str());
@@ -36,24 +36,32 @@
 #include "../GClasses/GAssociative.h"
 #include "../GClasses/GBayesianNetwork.h"
 #include "../GClasses/GBezier.h"
+#include "../GClasses/GBigInt.h"
 #include "../GClasses/GBits.h"
 #include "../GClasses/GBitTable.h"
 #include "../GClasses/GCluster.h"
 #include "../GClasses/GCrypto.h"
 #include "../GClasses/GDecisionTree.h"
 #include "../GClasses/GDiff.h"
+#include "../GClasses/GDirList.h"
 #include "../GClasses/GDistance.h"
 #include "../GClasses/GDistribution.h"
 #include "../GClasses/GDom.h"
+#include "../GClasses/GDynamicPage.h"
 #include "../GClasses/GEnsemble.h"
 #include "../GClasses/GError.h"
+#include "../GClasses/GEvolutionary.h"
 #include "../GClasses/GFile.h"
 #include "../GClasses/GFourier.h"
+#include "../GClasses/GFunction.h"
 #include "../GClasses/GGaussianProcess.h"
 #include "../GClasses/GGraph.h"
 #include "../GClasses/GHashTable.h"
 #include "../GClasses/GHiddenMarkovModel.h"
 #include "../GClasses/GHillClimber.h"
+#include "../GClasses/GHyperSearch.h"
+#include "../GClasses/GImage.h"
+#include "../GClasses/GKernelTrick.h"
 #include "../GClasses/GKeyPair.h"
 #include "../GClasses/GKNN.h"
 #include "../GClasses/GLinear.h"
@@ -66,9 +74,11 @@
 #include "../GClasses/GNeighborFinder.h"
 #include "../GClasses/GNeuralDecomposition.h"
 #include "../GClasses/GNeuralNet.h"
+#include "../GClasses/GParameterServer.h"
 #include "../GClasses/GParticleSwarm.h"
 #include "../GClasses/GPolynomial.h"
 #include "../GClasses/GPriorityQueue.h"
+#include "../GClasses/GProfiler.h"
 #include "../GClasses/GRand.h"
 #include "../GClasses/GRayTrace.h"
 #include "../GClasses/GRecommender.h"
@@ -76,12 +86,14 @@
 #include "../GClasses/GSelfOrganizingMap.h"
 #include "../GClasses/GSocket.h"
 #include "../GClasses/GSparseMatrix.h"
+#include "../GClasses/GText.h"
 #include "../GClasses/GGridSearch.h"
 #include "../GClasses/GThread.h"
 #include "../GClasses/GTime.h"
 #include "../GClasses/GTransform.h"
 #include "../GClasses/GTree.h"
 #include "../GClasses/GVec.h"
+#include "../GClasses/GWave.h"
 #include "../GClasses/GReverseBits.h"
 
 using namespace GClasses;
@@ -905,6 +917,7 @@ public:
 		runTest("GBayesianModelCombination", GBayesianModelCombination::test);
 		runTest("GBayesNet", GBayesNet::test);
 		runTest("GBezier", GBezier::test);
+		runTest("GBigInt", GBigInt::test);
 		runTest("GBits", GBits::test);
 		runTest("GBitTable", GBitTable::test);
 		runTest("GBouncyBalls", GBouncyBalls::test);
@@ -912,8 +925,10 @@ public:
 		runTest("GBrandesBetweenness", GBrandesBetweennessCentrality::test);
 		runTest("GBucket", GBucket::test);
 		runTest("GCategoricalSamplerBatch", GCategoricalSamplerBatch::test);
+		runTest("GCompiledFunction", GCompiledFunction::test);
 		runTest("GCompressor", GCompressor::test);
 		runTest("GCoordVectorIterator", GCoordVectorIterator::test);
+		runTest("GCorpusVectorizer", GCorpusVectorizer::test);
 		runTest("GCrypto", GCrypto::test);
 		runTest("GCycleCut", GCycleCut::test);
 		runTest("GDecisionTree", GDecisionTree::test);
@@ -921,22 +936,30 @@ public:
 		runTest("GDijkstra", GDijkstra::test);
 		runTest("GDistanceMetric", GDistanceMetric::test);
 		runTest("GDom", GDom::test);
+		runTest("GDynamicPageServer", GDynamicPageServer::test);
 		runTest("GError.h - to_str", test_to_str);
+		runTest("GEvolutionaryOptimizer", GEvolutionaryOptimizer::test);
+		runTest("GFloatImage", GFloatImage::test);
 		runTest("GFloydWarshall", GFloydWarshall::test);
+		runTest("GFolderSerializer", GFolderSerializer::test);
 		runTest("GFourier", GFourier::test);
+		runTest("GFunctionParser", GFunctionParser::test);
 		runTest("GGaussianProcess", GGaussianProcess::test);
 		runTest("GGraphCut", GGraphCut::test);
 		runTest("GHashTable", GHashTable::test);
 		runTest("GHiddenMarkovModel", GHiddenMarkovModel::test);
 		runTest("GHillClimber", GHillClimber::test);
+		runTest("GHyperSearch", GHyperSearch::test);
 		runTest("GIncrementalTransform", GIncrementalTransform::test);
 		runTest("GInstanceRecommender", GInstanceRecommender::test);
 		runTest("GKdTree", GKdTree::test);
+		runTest("GKernel", GKernel::test);
 		runTest("GKeyPair", GKeyPair::test);
 		runTest("GKNN", GKNN::test);
 		runTest("GLinearDistribution", GLinearDistribution::test);
 		runTest("GLinearProgramming", GLinearProgramming::test);
 		runTest("GLinearRegressor", GLinearRegressor::test);
+		runTest("GLZCompressor", GLZCompressor::test);
 		runTest("GManifold", GManifold::test);
 		runTest("GMath", GMath::test);
 		runTest("GMatrix", GMatrix::test);
@@ -951,13 +974,17 @@ public:
 		runTest("GNeuralNet", GNeuralNet::test);
 //		runTest("GNonlinearPCA", GNonlinearPCA::test);
 		runTest("GPackageServer", GPackageServer::test);
+		runTest("GParameterServer", GParameterServer::test);
+		runTest("GParticleSwarm", GParticleSwarm::test);
 		runTest("GPolynomial", GPolynomial::test);
 		runTest("GPriorityQueue", GPriorityQueue::test);
 		runTest("GProbeSearch", GProbeSearch::test);
+		runTest("GProfiler", GProfiler::test);
 		runTest("GRand", GRand::test);
 		runTest("GRandomDirectionBinarySearch", GRandomDirectionBinarySearch::test);
 		runTest("GRandMersenneTwister", GRandMersenneTwister::test);
 		runTest("GRandomForest", GRandomForest::test);
+		runTest("GRayTraceScene", GRayTraceScene::test);
 		runTest("GRelation", GRelation::test);
 		runTest("GRelationalTable", GRelationalTable_test);
 		runTest("GResamplingAdaBoost", GResamplingAdaBoost::test);
@@ -972,7 +999,10 @@ public:
 		runTest("GSubImageFinder", GSubImageFinder::test);
 		runTest("GSubImageFinder2", GSubImageFinder2::test);
 		runTest("GSupervisedLearner", GSupervisedLearner::test);
+		runTest("GTCPServer", GTCPServer::test);
+		runTest("GTransformPipeline", GTransformPipeline::test);
 		runTest("GVec", GVec::test);
+		runTest("GWave", GWave::test);
 
 		// Test whether we can find and execute the command-line tools
 		bool runCommandLineTests = false;
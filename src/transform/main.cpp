@@ -828,19 +828,42 @@ void Export(GArgReader& args)
 		pData->relation().printRow(cout, pData->row(i).data(), separator, missing);
 }
 
+class ImportStreamPrinter : public GCSVRowHandler
+{
+protected:
+	const char* m_szName;
+	GRelation* m_pRelation;
+
+public:
+	ImportStreamPrinter(const char* szName) : m_szName(szName), m_pRelation(NULL) {}
+	virtual ~ImportStreamPrinter() { delete(m_pRelation); }
+
+	size_t cols() { return m_pRelation ? m_pRelation->size() : 0; }
+
+	virtual void onRelation(const GArffRelation& relation)
+	{
+		GArffRelation* pRelation = (GArffRelation*)relation.clone();
+		m_pRelation = pRelation;
+		pRelation->setName(m_szName);
+		pRelation->print(cout, NULL, 14);
+	}
+
+	virtual void onRow(const GVec& row)
+	{
+		m_pRelation->printRow(cout, row.data(), ",");
+	}
+};
+
 void Import(GArgReader& args)
 {
-	// Load the file
-	size_t len;
 	const char* filename = args.pop_string();
-	char* pFile = GFile::loadFile(filename, &len);
-	ArrayHolder<char> hFile(pFile);
 
 	// Parse Options
 	GCSVParser parser;
 	char separator = ',';
 	bool tolerant = false;
 	bool columnNamesInFirstRow = false;
+	bool stream = false;
 	size_t maxVals = 200;
 	while(args.size() > 0)
 	{
@@ -876,18 +899,32 @@ void Import(GArgReader& args)
 			size_t attr = args.pop_uint();
 			parser.setRealAttr(attr);
 		}
+		else if(args.if_pop("-threads"))
+			parser.setThreadCount(args.pop_uint());
+		else if(args.if_pop("-stream"))
+			stream = true;
 		else
 			throw Ex("Invalid option: ", args.peek());
 	}
 
 	// Parse the file
-	GMatrix data;
 	parser.setSeparator(separator);
 	parser.setMaxVals(maxVals);
 	if(tolerant)
 		parser.tolerant();
 	if(columnNamesInFirstRow)
 		parser.columnNamesInFirstRow();
+	if(stream)
+	{
+		// Print each row as it is parsed
+		ImportStreamPrinter printer(filename);
+		parser.parseStream(filename, printer);
+		cerr << "\nParsing Report:\n";
+		for(size_t i = 0; i < printer.cols(); i++)
+			cerr << to_str(i) << ") " << parser.report(i) << "\n";
+		return;
+	}
+	GMatrix data;
 	parser.parse(data, filename);
 	cerr << "\nParsing Report:\n";
 	for(size_t i = 0; i < data.cols(); i++)
@@ -1976,23 +2013,16 @@ void _function(GArgReader& args)
 		funcCount++;
 	}
 
-	// Compute the output matrix
+	// Compute the output matrix, one column at a time
 	GMatrix out(pData->rows(), funcCount);
-	vector<double> params;
 	for(int i = 1; true; i++)
 	{
 		sprintf(szFuncName, "f%d", i);
 		GFunction* pFunc = mfp.getFunctionNoThrow(szFuncName);
 		if(!pFunc)
 			break;
-		params.resize(pFunc->m_expectedParams);
-		for(size_t j = 0; j < pData->rows(); j++)
-		{
-			GVec& pIn = pData->row(j);
-			for(size_t k = 0; k < (size_t)pFunc->m_expectedParams; k++)
-				params[k] = pIn[k];
-			out[j][i - 1] = pFunc->call(params, mfp);
-		}
+		GCompiledFunction compiled(pFunc, mfp);
+		compiled.evaluate(*pData, out, i - 1);
 	}
 	out.print(cout);
 }